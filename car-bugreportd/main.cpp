@@ -24,27 +24,49 @@
 #include <android-base/stringprintf.h>
 #include <android-base/strings.h>
 #include <android-base/unique_fd.h>
+#include <arpa/inet.h>
 #include <cutils/sockets.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <ftw.h>
 #include <gui/SurfaceComposerClient.h>
 #include <log/log_main.h>
+#include <poll.h>
 #include <private/android_filesystem_config.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
 #include <sys/prctl.h>
+#include <sys/sendfile.h>
+#include <sys/signalfd.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <time.h>
 #include <unistd.h>
 #include <ziparchive/zip_writer.h>
+#include <zlib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <vector>
 
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434  // The same on every architecture.
+#endif
+
 namespace {
 // Directory used for keeping temporary files
 constexpr const char* kTempDirectory = "/data/user_de/0/com.android.shell/temp_bugreport_files";
@@ -57,13 +79,35 @@ constexpr const char* kCarBrOutputSocket = "car_br_output_socket";
 constexpr const char* kCarBrExtraOutputSocket = "car_br_extra_output_socket";
 // The prefix used by bugreportz protocol to indicate bugreport finished successfully.
 constexpr const char* kOkPrefix = "OK:";
+// The prefix used by bugreportz protocol to announce the path of the zip file being written.
+constexpr const char* kBeginPrefix = "BEGIN:";
 // Number of connect attempts to dumpstate socket
 constexpr const int kMaxDumpstateConnectAttempts = 20;
 // Wait time between connect attempts
 constexpr const int kWaitTimeBetweenConnectAttemptsInSec = 1;
+// Most bytes handed to a single sendfile() call. The kernel caps a single transfer a little
+// below 2GB anyway, and smaller calls let us notice errors sooner.
+constexpr const size_t kMaxSendfileChunk = 16 * 1024 * 1024;
+// Set this property to true to send the zip file on the output socket in chunks, each with a
+// sequence number and checksum, so it can be uploaded and resumed chunk by chunk.
+constexpr const char* kChunkedOutputProperty = "android.car.bugreportd.chunkedoutput";
+// Size of each chunk in chunked output mode, except the last one.
+constexpr const size_t kOutputChunkSize = 1024 * 1024;
+// Marks the start of each chunk header in chunked output mode ("CBRC").
+constexpr const uint32_t kChunkMagic = 0x43425243;
+// How long to wait for dumpstate to write more, when following the zip file it is writing.
+constexpr const int kFollowPollIntervalInMs = 100;
 // Wait time for dumpstate. No timeout in dumpstate is longer than 60 seconds. Choose
 // a value that is twice longer.
 constexpr const int kDumpstateTimeoutInSec = 120;
+// Most extra files read into memory ahead of being written to the zip.
+constexpr const size_t kMaxExtraFilesInFlight = 4;
+// Extra files with these suffixes are compressed already, so they are stored uncompressed.
+constexpr const char* kStoredSuffixes[] = {".png", ".jpg", ".gz", ".zip"};
+// Wait time for each screenshot to be captured.
+constexpr const int kScreenshotTimeoutInSec = 10;
+// Wait time for a command that timed out to go after each signal we send it.
+constexpr const int kKillGraceInSec = 5;
 // The prefix for screenshot filename in the generated zip file.
 constexpr const char* kScreenshotPrefix = "/screenshot";
 
@@ -72,6 +116,18 @@ using android::PhysicalDisplayId;
 using android::status_t;
 using android::SurfaceComposerClient;
 
+// The zip file being streamed to the output socket while dumpstate writes it.
+struct ZipStream {
+    std::string path;
+    std::thread thread;
+    // Whether to frame the zip into chunks, see sendChunk().
+    bool chunked = false;
+    // Set once dumpstate is done, whether it succeeded or not.
+    std::atomic<bool> dumpstate_done{false};
+    // Set by |thread| before it exits.
+    bool success = false;
+};
+
 // Returns a valid socket descriptor or -1 on failure.
 int openSocket(const char* service) {
     int s = android_get_control_socket(service);
@@ -96,15 +152,19 @@ int openSocket(const char* service) {
 }
 
 // Processes the given dumpstate progress protocol |line| and updates
-// |out_last_nonempty_line| when |line| is non-empty, and |out_zip_path| when
-// the bugreport is finished.
+// |out_last_nonempty_line| when |line| is non-empty, |out_begin_path| when dumpstate
+// starts writing the zip file, and |out_zip_path| when the bugreport is finished.
 void processLine(const std::string& line, std::string* out_zip_path,
-                 std::string* out_last_nonempty_line) {
+                 std::string* out_begin_path, std::string* out_last_nonempty_line) {
     // The protocol is documented in frameworks/native/cmds/bugreportz/readme.md
     if (line.empty()) {
         return;
     }
     *out_last_nonempty_line = line;
+    if (line.find(kBeginPrefix) == 0) {
+        *out_begin_path = line.substr(strlen(kBeginPrefix));
+        return;
+    }
     if (line.find(kOkPrefix) != 0) {
         return;
     }
@@ -112,7 +172,37 @@ void processLine(const std::string& line, std::string* out_zip_path,
     return;
 }
 
+// An extra file read into memory, ready to go into the zip.
+struct ExtraFile {
+    std::string name;
+    std::string contents;
+    bool loaded = false;
+};
+
+ExtraFile loadExtraFile(const std::string& filepath) {
+    ExtraFile file;
+    file.name = android::base::Basename(filepath);
+    file.loaded = android::base::ReadFileToString(filepath, &file.contents);
+    if (!file.loaded) {
+        ALOGE("Failed to read %s (%s)", filepath.c_str(), strerror(errno));
+    }
+    return file;
+}
+
+// Returns the ZipWriter flags for the entry |name|. Files that are compressed already, like the
+// PNG screenshots, are stored as they are, because deflating them again gains nothing.
+size_t zipEntryFlags(const std::string& name) {
+    for (const char* suffix : kStoredSuffixes) {
+        if (android::base::EndsWithIgnoreCase(name, suffix)) {
+            return 0;
+        }
+    }
+    return ZipWriter::kCompress;
+}
+
 // Sends the contents of the zip fileto |outfd|.
+// Worker threads read the next few files while the current one is being written, but the
+// entries still go into the zip in the order given.
 // Returns true if success
 void zipFilesToFd(const std::vector<std::string>& extra_files, int outfd) {
     // pass fclose as Deleter to close the file when unique_ptr is destroyed.
@@ -123,43 +213,37 @@ void zipFilesToFd(const std::vector<std::string>& extra_files, int outfd) {
     }
     auto writer = std::make_unique<ZipWriter>(outfile.get());
 
+    std::deque<std::future<ExtraFile>> pending;
+    size_t next_to_load = 0;
+    auto loadMore = [&]() {
+        while (next_to_load < extra_files.size() && pending.size() < kMaxExtraFilesInFlight) {
+            pending.push_back(
+                    std::async(std::launch::async, loadExtraFile, extra_files[next_to_load++]));
+        }
+    };
+
     int error = 0;
-    for (const auto& filepath : extra_files) {
-        const auto name = android::base::Basename(filepath);
+    loadMore();
+    while (!pending.empty()) {
+        ExtraFile file = pending.front().get();
+        pending.pop_front();
+        loadMore();
+        if (!file.loaded) {
+            // Leave it out rather than put a broken entry in the zip.
+            continue;
+        }
 
-        error = writer->StartEntry(name.c_str(), 0);
+        error = writer->StartEntry(file.name.c_str(), zipEntryFlags(file.name));
         if (error) {
             ALOGE("Failed to start entry %s", writer->ErrorCodeString(error));
             return;
         }
-        android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(filepath.c_str(), O_RDONLY)));
-        if (fd == -1) {
+        error = writer->WriteBytes(file.contents.data(), file.contents.size());
+        if (error) {
+            ALOGE("WriteBytes() failed %s", ZipWriter::ErrorCodeString(error));
+            // fail immediately
             return;
         }
-        while (1) {
-            char buffer[65536];
-
-            ssize_t bytes_read = TEMP_FAILURE_RETRY(read(fd, buffer, sizeof(buffer)));
-            if (bytes_read == 0) {
-                break;
-            }
-            if (bytes_read == -1) {
-                if (errno == EAGAIN) {
-                    ALOGE("timed out while reading %s", name.c_str());
-                } else {
-                    ALOGE("read terminated abnormally (%s)", strerror(errno));
-                }
-                // fail immediately
-                return;
-            }
-            error = writer->WriteBytes(buffer, bytes_read);
-            if (error) {
-                ALOGE("WriteBytes() failed %s", ZipWriter::ErrorCodeString(error));
-                // fail immediately
-                return;
-            }
-        }
-
         error = writer->FinishEntry();
         if (error) {
             ALOGE("failed to finish entry %s", writer->ErrorCodeString(error));
@@ -194,27 +278,235 @@ int copyTo(int fd_in, int fd_out, void* buffer, size_t buffer_len) {
     return bytes_read;
 }
 
-bool copyFile(const std::string& zip_path, int output_socket) {
+// Sends up to |count| bytes of |fd| starting at |*offset| to |fd_out|, and advances |*offset|.
+// sendfile() lets the kernel move the pages from the page cache straight to |fd_out| without
+// copying them through userspace. If it can't handle this pair of descriptors, |*use_sendfile|
+// is cleared and the bytes go through a userspace buffer from then on.
+// Returns the number of bytes sent, 0 at the end of the file, or -1 on failure.
+ssize_t sendFileRange(int fd, off_t* offset, size_t count, int fd_out, bool* use_sendfile) {
+    if (*use_sendfile) {
+        ssize_t bytes_sent = TEMP_FAILURE_RETRY(sendfile(fd_out, fd, offset, count));
+        if (bytes_sent >= 0) {
+            return bytes_sent;
+        }
+        if (errno != EINVAL && errno != ENOSYS) {
+            if (errno == EAGAIN) {
+                ALOGE("sendfile timed out");
+            } else {
+                ALOGE("sendfile terminated abnormally (%s)", strerror(errno));
+            }
+            return -1;
+        }
+        ALOGW("sendfile not supported for output, falling back to read/write");
+        *use_sendfile = false;
+    }
+
+    char buffer[65536];
+    ssize_t bytes_read =
+            TEMP_FAILURE_RETRY(pread(fd, buffer, std::min(count, sizeof(buffer)), *offset));
+    if (bytes_read == -1) {
+        ALOGE("read terminated abnormally (%s)", strerror(errno));
+        return -1;
+    }
+    if (!android::base::WriteFully(fd_out, buffer, bytes_read)) {
+        ALOGE("write failed");
+        return -1;
+    }
+    *offset += bytes_read;
+    return bytes_read;
+}
+
+// How the zip goes out on the output socket.
+struct ZipSender {
+    bool use_sendfile = true;
+    // In chunked mode the zip is framed into chunks, see sendChunk().
+    bool chunked = false;
+    uint32_t sequence = 0;
+    uLong crc = crc32(0, nullptr, 0);   // of all the chunks sent so far
+    std::vector<char> buffer;
+};
+
+bool writeChunkHeader(int fd_out, uint32_t sequence, uint32_t length, uint32_t crc) {
+    const uint32_t header[] = {htonl(kChunkMagic), htonl(sequence), htonl(length), htonl(crc)};
+    if (!android::base::WriteFully(fd_out, header, sizeof(header))) {
+        ALOGE("write failed");
+        return false;
+    }
+    return true;
+}
+
+// Sends the next kOutputChunkSize bytes of |fd| from |*offset| as one chunk, and advances
+// |*offset|. Each chunk is preceded by four big-endian 32 bit words: kChunkMagic, its sequence
+// number counting from 0, the length of the payload and the CRC32 of the payload. Only the last
+// chunk may be shorter than kOutputChunkSize, so a short chunk is only sent once |complete|.
+// finishChunks() ends the stream.
+// Returns the number of bytes sent, 0 if there isn't a chunk to send yet, or -1 on failure.
+ssize_t sendChunk(int fd, off_t* offset, int fd_out, ZipSender* sender, bool complete) {
+    sender->buffer.resize(kOutputChunkSize);
+    size_t length = 0;
+    while (length < kOutputChunkSize) {
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(
+                pread(fd, sender->buffer.data() + length, kOutputChunkSize - length,
+                      *offset + length));
+        if (bytes_read == -1) {
+            ALOGE("read terminated abnormally (%s)", strerror(errno));
+            return -1;
+        }
+        if (bytes_read == 0) {
+            break;
+        }
+        length += bytes_read;
+    }
+    if (length == 0 || (length < kOutputChunkSize && !complete)) {
+        return 0;
+    }
+
+    uLong chunk_crc = crc32(0, reinterpret_cast<const Bytef*>(sender->buffer.data()), length);
+    if (!writeChunkHeader(fd_out, sender->sequence, length, chunk_crc)) {
+        return -1;
+    }
+    if (!android::base::WriteFully(fd_out, sender->buffer.data(), length)) {
+        ALOGE("write failed");
+        return -1;
+    }
+    sender->crc = crc32_combine(sender->crc, chunk_crc, length);
+    sender->sequence++;
+    *offset += length;
+    return length;
+}
+
+// Ends a chunked stream with a header that has the number of chunks sent as its sequence
+// number, no payload, and the CRC32 of the whole zip, so the other side knows it has it all.
+bool finishChunks(int fd_out, ZipSender* sender) {
+    return writeChunkHeader(fd_out, sender->sequence, 0, sender->crc);
+}
+
+// Sends the next part of |fd| from |*offset| and advances |*offset|. |complete| tells whether
+// the file has been written in full.
+// Returns the number of bytes sent, 0 if there is nothing to send yet, or -1 on failure.
+ssize_t sendNext(int fd, off_t* offset, int fd_out, ZipSender* sender, bool complete) {
+    if (sender->chunked) {
+        return sendChunk(fd, offset, fd_out, sender, complete);
+    }
+    return sendFileRange(fd, offset, kMaxSendfileChunk, fd_out, &sender->use_sendfile);
+}
+
+// Sends whatever has to follow the end of the file.
+bool finishSending(int fd_out, ZipSender* sender) {
+    return !sender->chunked || finishChunks(fd_out, sender);
+}
+
+bool copyFile(const std::string& zip_path, int output_socket, bool chunked) {
     android::base::unique_fd fd(TEMP_FAILURE_RETRY(open(zip_path.c_str(), O_RDONLY)));
     if (fd == -1) {
         return false;
     }
+    // Tell the kernel we read the zip front to back once, so it reads ahead aggressively.
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    off_t offset = 0;
+    ZipSender sender;
+    sender.chunked = chunked;
     while (1) {
-        char buffer[65536];
-        int bytes_copied = copyTo(fd, output_socket, buffer, sizeof(buffer));
-        if (bytes_copied == 0) {
+        ssize_t bytes_sent = sendNext(fd, &offset, output_socket, &sender, true);
+        if (bytes_sent == 0) {
             break;
         }
-        if (bytes_copied == -1) {
+        if (bytes_sent == -1) {
             return false;
         }
     }
-    return true;
+    return finishSending(output_socket, &sender);
 }
 
-// Triggers a bugreport and waits until it is all collected.
+// Blocks until |inotify_fd| reports a change to the watched file, or up to
+// kFollowPollIntervalInMs in case the change was already underway when we looked.
+void waitForFileChange(int inotify_fd) {
+    if (inotify_fd == -1) {
+        usleep(kFollowPollIntervalInMs * 1000);
+        return;
+    }
+    struct pollfd pfd = {.fd = inotify_fd, .events = POLLIN, .revents = 0};
+    if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kFollowPollIntervalInMs)) <= 0) {
+        return;
+    }
+    // We only care that something happened, so drop the events.
+    char events[4096];
+    while (read(inotify_fd, events, sizeof(events)) > 0) {
+    }
+}
+
+// Sends the zip at |stream->path| to |output_socket| while dumpstate is still writing it, and
+// keeps following the file until dumpstate is done with it.
+// This relies on dumpstate's ZipWriter only appending to the file: it compresses its entries,
+// and so writes a data descriptor after each one rather than going back to patch its header.
+// Returns true if success
+bool followFile(ZipStream* stream, int output_socket) {
+    android::base::unique_fd inotify_fd(inotify_init1(IN_NONBLOCK | IN_CLOEXEC));
+    if (inotify_fd == -1) {
+        ALOGW("inotify_init1 failed (%s), polling %s instead", strerror(errno),
+              stream->path.c_str());
+    }
+
+    // The path is announced before the file is necessarily created.
+    android::base::unique_fd fd;
+    while (1) {
+        bool done = stream->dumpstate_done;
+        fd.reset(TEMP_FAILURE_RETRY(open(stream->path.c_str(), O_RDONLY)));
+        if (fd != -1) {
+            break;
+        }
+        if (errno != ENOENT || done) {
+            ALOGE("Failed to open %s (%s)", stream->path.c_str(), strerror(errno));
+            return false;
+        }
+        usleep(kFollowPollIntervalInMs * 1000);
+    }
+    if (inotify_fd != -1 &&
+        inotify_add_watch(inotify_fd, stream->path.c_str(), IN_MODIFY | IN_CLOSE_WRITE) == -1) {
+        ALOGW("inotify_add_watch(%s) failed (%s)", stream->path.c_str(), strerror(errno));
+        inotify_fd.reset();
+    }
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    off_t offset = 0;
+    ZipSender sender;
+    sender.chunked = stream->chunked;
+    while (1) {
+        // Check before reading, so that reaching the end afterwards means we have it all.
+        bool done = stream->dumpstate_done;
+        ssize_t bytes_sent = sendNext(fd, &offset, output_socket, &sender, done);
+        if (bytes_sent == -1) {
+            return false;
+        }
+        if (bytes_sent > 0) {
+            continue;
+        }
+        if (done) {
+            break;
+        }
+        // We caught up with dumpstate, so wait for it to write more.
+        waitForFileChange(inotify_fd);
+    }
+    ALOGI("Streamed %lld bytes of %s", static_cast<long long>(offset), stream->path.c_str());
+    return finishSending(output_socket, &sender);
+}
+
+// Runs on its own thread once dumpstate announces the zip path.
+void streamZip(ZipStream* stream) {
+    int output_socket = openSocket(kCarBrOutputSocket);
+    if (output_socket == -1) {
+        return;
+    }
+    stream->success = followFile(stream, output_socket);
+    close(output_socket);
+}
+
+// Triggers a bugreport and waits until it is all collected. Once dumpstate announces the zip
+// path, |stream| starts sending the zip to the output socket while it is being written.
 // returns false if error, true if success
-bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zip_path) {
+bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zip_path,
+                 ZipStream* stream) {
     // Socket will not be available until service starts.
     android::base::unique_fd s;
     for (int i = 0; i < kMaxDumpstateConnectAttempts; i++) {
@@ -238,6 +530,7 @@ bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zi
     }
 
     std::string line;
+    std::string begin_path;
     std::string last_nonempty_line;
     while (true) {
         char buffer[65536];
@@ -252,8 +545,12 @@ bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zi
         for (int i = 0; i < bytes_read; i++) {
             char c = buffer[i];
             if (c == '\n') {
-                processLine(line, zip_path, &last_nonempty_line);
+                processLine(line, zip_path, &begin_path, &last_nonempty_line);
                 line.clear();
+                if (!begin_path.empty() && !stream->thread.joinable()) {
+                    stream->path = begin_path;
+                    stream->thread = std::thread(streamZip, stream);
+                }
             } else {
                 line.append(1, c);
             }
@@ -262,7 +559,7 @@ bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zi
     }
     s.reset();
     // Process final line, in case it didn't finish with newline.
-    processLine(line, zip_path, &last_nonempty_line);
+    processLine(line, zip_path, &begin_path, &last_nonempty_line);
     // if doBugReport finished successfully, zip path should be set.
     if (zip_path->empty()) {
         ALOGE("no zip file path was found in bugreportz progress data");
@@ -271,51 +568,10 @@ bool doBugreport(int progress_socket, size_t* out_bytes_written, std::string* zi
     return true;
 }
 
-bool waitpid_with_timeout(pid_t pid, int timeout_secs, int* status) {
-    sigset_t child_mask, old_mask;
-    sigemptyset(&child_mask);
-    sigaddset(&child_mask, SIGCHLD);
-
-    if (sigprocmask(SIG_BLOCK, &child_mask, &old_mask) == -1) {
-        ALOGE("*** sigprocmask failed: %s\n", strerror(errno));
-        return false;
-    }
-
-    timespec ts = {.tv_sec = timeout_secs, .tv_nsec = 0};
-    int ret = TEMP_FAILURE_RETRY(sigtimedwait(&child_mask, nullptr, &ts));
-    int saved_errno = errno;
-
-    // Set the signals back the way they were.
-    if (sigprocmask(SIG_SETMASK, &old_mask, nullptr) == -1) {
-        ALOGE("*** sigprocmask failed: %s\n", strerror(errno));
-        if (ret == 0) {
-            return false;
-        }
-    }
-    if (ret == -1) {
-        errno = saved_errno;
-        if (errno == EAGAIN) {
-            errno = ETIMEDOUT;
-        } else {
-            ALOGE("*** sigtimedwait failed: %s\n", strerror(errno));
-        }
-        return false;
-    }
-
-    pid_t child_pid = waitpid(pid, status, WNOHANG);
-    if (child_pid != pid) {
-        if (child_pid != -1) {
-            ALOGE("*** Waiting for pid %d, got pid %d instead\n", pid, child_pid);
-        } else {
-            ALOGE("*** waitpid failed: %s\n", strerror(errno));
-        }
-        return false;
-    }
-    return true;
-}
-
-// Runs the given command. Kills the command if it does not finish by timeout.
-int runCommand(int timeout_secs, const char* file, std::vector<const char*> args) {
+// Starts the command in a child process, with |signal_mask| as its signal mask.
+// Returns the pid of the child, or -1 on failure.
+pid_t startCommand(const char* file, const std::vector<const char*>& args,
+                   const sigset_t& signal_mask) {
     pid_t pid = fork();
 
     // handle error case
@@ -335,65 +591,314 @@ int runCommand(int timeout_secs, const char* file, std::vector<const char*> args
         sigact.sa_handler = SIG_IGN;
         sigaction(SIGPIPE, &sigact, nullptr);
 
+        /* the parent may block SIGCHLD for itself, the command should get the usual mask */
+        sigprocmask(SIG_SETMASK, &signal_mask, nullptr);
+
         execvp(file, (char**)args.data());
-        // execvp's result will be handled after waitpid_with_timeout() below, but
+        // execvp's result will be handled by ChildSupervisor, but
         // if it failed, it's safer to exit dumpstate.
         ALOGE("execvp on command %s failed (error: %s)", file, strerror(errno));
         _exit(EXIT_FAILURE);
     }
+    return pid;
+}
 
-    // handle parent case
-    int status;
-    bool ret = waitpid_with_timeout(pid, timeout_secs, &status);
+// Runs commands in child processes and supervises them all from one event loop on a thread of
+// its own, so the bugreport can go on while they run. Each command has its own timeout, after
+// which it gets SIGTERM, and SIGKILL if it is still there kKillGraceInSec later.
+// Each child is watched through a pidfd, which epoll reports readable once the child exits.
+// Kernels without pidfds get a signalfd for SIGCHLD instead, with SIGCHLD blocked from then on.
+class ChildSupervisor {
+  public:
+    // Called on the event loop thread with the command's exit status, or -1 if it could not be
+    // run or had to be killed.
+    using ExitCallback = std::function<void(int status)>;
+
+    ~ChildSupervisor();
+
+    // Starts |file| with |args|, which must end with nullptr.
+    void start(const char* file, const std::vector<const char*>& args, int timeout_secs,
+               ExitCallback on_exit);
+
+    // Blocks until every command started so far has finished.
+    void waitAll();
+
+  private:
+    struct Child {
+        std::string file;
+        pid_t pid = -1;
+        android::base::unique_fd pidfd;
+        std::chrono::steady_clock::time_point deadline;
+        int kill_signal = SIGTERM;  // What we send next at |deadline|, or 0 if we gave up.
+        bool done = false;
+        ExitCallback on_exit;
+    };
 
-    if (!ret) {
-        if (errno == ETIMEDOUT) {
-            ALOGE("command %s timed out (killing pid %d)", file, pid);
-        } else {
-            ALOGE("command %s: Error (killing pid %d)\n", file, pid);
+    bool initLocked();
+    void loop();
+    void finishLocked(Child* child, int status);
+    void reapLocked(Child* child);
+    int handleDeadlinesLocked();
+
+    std::mutex lock_;
+    std::condition_variable done_cv_;
+    std::vector<std::unique_ptr<Child>> children_;
+    android::base::unique_fd epoll_fd_;
+    android::base::unique_fd wake_fd_;    // An eventfd that gets the loop to look again.
+    android::base::unique_fd signal_fd_;  // Only without pidfds.
+    sigset_t old_mask_;                   // Our signal mask before we blocked SIGCHLD, if we did.
+    std::thread thread_;
+    bool quit_ = false;
+};
+
+// epoll event data for the descriptors that aren't a child's pidfd.
+constexpr const uint64_t kWakeEvent = UINT64_MAX;
+constexpr const uint64_t kSignalEvent = UINT64_MAX - 1;
+
+int pidfdOpen(pid_t pid) {
+    return syscall(__NR_pidfd_open, pid, 0);
+}
+
+ChildSupervisor::~ChildSupervisor() {
+    if (!thread_.joinable()) {
+        return;
+    }
+    waitAll();
+    {
+        std::lock_guard<std::mutex> lock(lock_);
+        quit_ = true;
+    }
+    uint64_t one = 1;
+    TEMP_FAILURE_RETRY(write(wake_fd_, &one, sizeof(one)));
+    thread_.join();
+
+    if (signal_fd_ != -1) {
+        // Drop the SIGCHLDs the signalfd didn't take, now that all the children are reaped.
+        sigset_t child_mask;
+        sigemptyset(&child_mask);
+        sigaddset(&child_mask, SIGCHLD);
+        timespec no_wait = {.tv_sec = 0, .tv_nsec = 0};
+        while (sigtimedwait(&child_mask, nullptr, &no_wait) > 0) {
         }
-        kill(pid, SIGTERM);
-        if (!waitpid_with_timeout(pid, 5, nullptr)) {
-            kill(pid, SIGKILL);
-            if (!waitpid_with_timeout(pid, 5, nullptr)) {
-                ALOGE("could not kill command '%s' (pid %d) even with SIGKILL.\n", file, pid);
-            }
+        sigprocmask(SIG_SETMASK, &old_mask_, nullptr);
+    }
+}
+
+// Sets up the event loop the first time a command is started.
+bool ChildSupervisor::initLocked() {
+    if (thread_.joinable()) {
+        return true;
+    }
+    sigprocmask(SIG_SETMASK, nullptr, &old_mask_);
+    epoll_fd_.reset(epoll_create1(EPOLL_CLOEXEC));
+    wake_fd_.reset(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC));
+    if (epoll_fd_ == -1 || wake_fd_ == -1) {
+        ALOGE("Failed to set up the child event loop: %s", strerror(errno));
+        return false;
+    }
+    epoll_event event = {.events = EPOLLIN, .data = {.u64 = kWakeEvent}};
+    epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, wake_fd_, &event);
+
+    android::base::unique_fd self(pidfdOpen(getpid()));
+    if (self == -1) {
+        ALOGW("pidfd_open unavailable (%s), watching SIGCHLD instead", strerror(errno));
+        // Blocked before the loop thread starts, so that no thread of ours takes the signal.
+        sigset_t child_mask;
+        sigemptyset(&child_mask);
+        sigaddset(&child_mask, SIGCHLD);
+        if (sigprocmask(SIG_BLOCK, &child_mask, nullptr) == -1) {
+            ALOGE("*** sigprocmask failed: %s\n", strerror(errno));
+            return false;
         }
-        return -1;
+        signal_fd_.reset(signalfd(-1, &child_mask, SFD_NONBLOCK | SFD_CLOEXEC));
+        if (signal_fd_ == -1) {
+            ALOGE("signalfd failed: %s", strerror(errno));
+            sigprocmask(SIG_SETMASK, &old_mask_, nullptr);
+            return false;
+        }
+        event.data.u64 = kSignalEvent;
+        epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, signal_fd_, &event);
+    }
+
+    thread_ = std::thread(&ChildSupervisor::loop, this);
+    return true;
+}
+
+void ChildSupervisor::start(const char* file, const std::vector<const char*>& args,
+                            int timeout_secs, ExitCallback on_exit) {
+    std::lock_guard<std::mutex> lock(lock_);
+    auto child = std::make_unique<Child>();
+    child->file = file;
+    child->on_exit = std::move(on_exit);
+    child->deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_secs);
+    Child* started = child.get();
+    children_.push_back(std::move(child));
+
+    if (!initLocked()) {
+        finishLocked(started, -1);
+        return;
+    }
+    started->pid = startCommand(file, args, old_mask_);
+    if (started->pid < 0) {
+        finishLocked(started, -1);
+        return;
     }
+    if (signal_fd_ == -1) {
+        // A child that exits before this stays a zombie until reaped, so it can't be missed.
+        started->pidfd.reset(pidfdOpen(started->pid));
+        epoll_event event = {.events = EPOLLIN, .data = {.u64 = children_.size() - 1}};
+        if (started->pidfd == -1 ||
+            epoll_ctl(epoll_fd_, EPOLL_CTL_ADD, started->pidfd, &event) == -1) {
+            ALOGE("Failed to watch pid %d: %s", started->pid, strerror(errno));
+        }
+    }
+
+    // The loop has a new deadline to keep.
+    uint64_t one = 1;
+    TEMP_FAILURE_RETRY(write(wake_fd_, &one, sizeof(one)));
+}
+
+void ChildSupervisor::waitAll() {
+    std::unique_lock<std::mutex> lock(lock_);
+    done_cv_.wait(lock, [this]() {
+        return std::all_of(children_.begin(), children_.end(),
+                           [](const std::unique_ptr<Child>& child) { return child->done; });
+    });
+}
 
-    if (WIFSIGNALED(status)) {
-        ALOGE("command '%s' failed: killed by signal %d\n", file, WTERMSIG(status));
-    } else if (WIFEXITED(status) && WEXITSTATUS(status) > 0) {
+void ChildSupervisor::finishLocked(Child* child, int status) {
+    if (child->done) {
+        return;
+    }
+    child->done = true;
+    if (child->pidfd != -1) {
+        epoll_ctl(epoll_fd_, EPOLL_CTL_DEL, child->pidfd, nullptr);
+        child->pidfd.reset();
+    }
+
+    // Whatever was killed counts as failed.
+    if (status != -1 && WIFSIGNALED(status)) {
+        ALOGE("command '%s' failed: killed by signal %d\n", child->file.c_str(),
+              WTERMSIG(status));
+        status = -1;
+    } else if (status != -1 && WIFEXITED(status) && WEXITSTATUS(status) > 0) {
         status = WEXITSTATUS(status);
-        ALOGE("command '%s' failed: exit code %d\n", file, status);
+        ALOGE("command '%s' failed: exit code %d\n", child->file.c_str(), status);
+    }
+    if (child->on_exit) {
+        child->on_exit(status);
     }
+    done_cv_.notify_all();
+}
 
-    return status;
+// Finishes |child| if it has exited.
+void ChildSupervisor::reapLocked(Child* child) {
+    if (child->done || child->pid < 0) {
+        return;
+    }
+    int status = -1;
+    pid_t child_pid = TEMP_FAILURE_RETRY(waitpid(child->pid, &status, WNOHANG));
+    if (child_pid == child->pid) {
+        finishLocked(child, status);
+    } else if (child_pid == -1) {
+        ALOGE("*** waitpid(%d) failed: %s\n", child->pid, strerror(errno));
+        finishLocked(child, -1);
+    }
 }
 
-void takeScreenshotForDisplayId(PhysicalDisplayId id, const char* tmp_dir,
-        std::vector<std::string>* extra_files) {
-    std::string id_as_string = std::to_string(id);
-    std::string filename = std::string(tmp_dir) + kScreenshotPrefix + id_as_string + ".png";
-    std::vector<const char*> args { "-p", "-d", id_as_string.c_str(), filename.c_str(), nullptr };
-    ALOGI("capturing screen for display (%s) as %s", id_as_string.c_str(), filename.c_str());
-    int status = runCommand(10, "/system/bin/screencap", args);
-    if (status == 0) {
-        LOG(INFO) << "Screenshot saved for display:" << id_as_string;
+// Signals the children whose time is up. Returns how long epoll_wait() may wait until the next
+// deadline, in milliseconds, or -1 if there is none.
+int ChildSupervisor::handleDeadlinesLocked() {
+    auto now = std::chrono::steady_clock::now();
+    int timeout_ms = -1;
+    for (auto& child : children_) {
+        if (child->done) {
+            continue;
+        }
+        if (now >= child->deadline) {
+            if (child->kill_signal == 0) {
+                ALOGE("could not kill command '%s' (pid %d) even with SIGKILL.\n",
+                      child->file.c_str(), child->pid);
+                finishLocked(child.get(), -1);
+                continue;
+            }
+            if (child->kill_signal == SIGTERM) {
+                ALOGE("command %s timed out (killing pid %d)", child->file.c_str(), child->pid);
+            }
+            kill(child->pid, child->kill_signal);
+            child->kill_signal = (child->kill_signal == SIGTERM) ? SIGKILL : 0;
+            child->deadline = now + std::chrono::seconds(kKillGraceInSec);
+        }
+        auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+                child->deadline - now).count() + 1;
+        if (timeout_ms == -1 || remaining < timeout_ms) {
+            timeout_ms = remaining;
+        }
     }
-    // add the file regardless of the exit status of the screencap util.
-    extra_files->push_back(filename);
+    return timeout_ms;
+}
 
-    LOG(ERROR) << "Failed to take screenshot for display:" << id_as_string;
+// The body of the event loop thread.
+void ChildSupervisor::loop() {
+    std::unique_lock<std::mutex> lock(lock_);
+    while (!quit_) {
+        int timeout_ms = handleDeadlinesLocked();
+        lock.unlock();
+        epoll_event events[8];
+        int count = TEMP_FAILURE_RETRY(epoll_wait(epoll_fd_, events, arraysize(events),
+                                                  timeout_ms));
+        lock.lock();
+        if (count == -1) {
+            ALOGE("epoll_wait failed: %s", strerror(errno));
+            // Nothing will tell us about the children any more, so stop waiting for them.
+            for (auto& child : children_) {
+                finishLocked(child.get(), -1);
+            }
+            return;
+        }
+        for (int i = 0; i < count; i++) {
+            uint64_t data = events[i].data.u64;
+            if (data == kWakeEvent) {
+                uint64_t value;
+                TEMP_FAILURE_RETRY(read(wake_fd_, &value, sizeof(value)));
+            } else if (data == kSignalEvent) {
+                // SIGCHLDs are merged while pending, so check every child each time.
+                signalfd_siginfo info;
+                while (read(signal_fd_, &info, sizeof(info)) > 0) {
+                }
+                for (auto& child : children_) {
+                    reapLocked(child.get());
+                }
+            } else if (data < children_.size()) {
+                reapLocked(children_[data].get());
+            }
+        }
+    }
 }
 
-void takeScreenshot(const char* tmp_dir, std::vector<std::string>* extra_files) {
+void takeScreenshot(const char* tmp_dir, ChildSupervisor* supervisor,
+                    std::vector<std::string>* extra_files) {
     // Now send the screencaptures
     std::vector<PhysicalDisplayId> ids = SurfaceComposerClient::getPhysicalDisplayIds();
 
-    for (PhysicalDisplayId display_id : ids) {
-        takeScreenshotForDisplayId(display_id, tmp_dir, extra_files);
+    // Capture all the displays at once, so each one doesn't wait for the one before it, and
+    // while the rest of the bugreport goes on.
+    for (PhysicalDisplayId id : ids) {
+        std::string id_as_string = std::to_string(id);
+        std::string filename = std::string(tmp_dir) + kScreenshotPrefix + id_as_string + ".png";
+        ALOGI("capturing screen for display (%s) as %s", id_as_string.c_str(), filename.c_str());
+        supervisor->start("/system/bin/screencap",
+                          {"-p", "-d", id_as_string.c_str(), filename.c_str(), nullptr},
+                          kScreenshotTimeoutInSec, [id_as_string](int status) {
+                              if (status == 0) {
+                                  LOG(INFO) << "Screenshot saved for display:" << id_as_string;
+                              } else {
+                                  LOG(ERROR) << "Failed to take screenshot for display:"
+                                             << id_as_string;
+                              }
+                          });
+        // add the file regardless of the exit status of the screencap util.
+        extra_files->push_back(filename);
     }
 }
 
@@ -447,10 +952,11 @@ int main(void) {
 
     auto t0 = std::chrono::steady_clock::now();
 
+    ChildSupervisor supervisor;
     std::vector<std::string> extra_files;
     if (createTempDir(kTempDirectory) == OK) {
         // take screenshots of the physical displays as early as possible
-        takeScreenshot(kTempDirectory, &extra_files);
+        takeScreenshot(kTempDirectory, &supervisor, &extra_files);
     }
 
     // Start the dumpstatez service.
@@ -465,17 +971,30 @@ int main(void) {
         android::base::SetProperty("ctl.stop", "car-dumpstatez");
         return EXIT_FAILURE;
     }
-    bool ret_val = doBugreport(progress_socket, &bytes_written, &zip_path);
+    ZipStream stream;
+    stream.chunked = android::base::GetBoolProperty(kChunkedOutputProperty, false);
+    bool ret_val = doBugreport(progress_socket, &bytes_written, &zip_path, &stream);
     close(progress_socket);
 
-    int output_socket = openSocket(kCarBrOutputSocket);
-    if (output_socket != -1 && ret_val) {
-        ret_val = copyFile(zip_path, output_socket);
-    }
-    if (output_socket != -1) {
-        close(output_socket);
+    stream.dumpstate_done = true;
+    if (stream.thread.joinable()) {
+        // The zip has been going out as dumpstate wrote it, so only the tail is left.
+        stream.thread.join();
+        ret_val = ret_val && stream.success;
+    } else {
+        // dumpstate never announced the zip path, so send it all now that it's done.
+        int output_socket = openSocket(kCarBrOutputSocket);
+        if (output_socket != -1 && ret_val) {
+            ret_val = copyFile(zip_path, output_socket, stream.chunked);
+        }
+        if (output_socket != -1) {
+            close(output_socket);
+        }
     }
 
+    // The screenshots have been going on alongside dumpstate, and go into the extra zip.
+    supervisor.waitAll();
+
     int extra_output_socket = openSocket(kCarBrExtraOutputSocket);
     if (extra_output_socket != -1 && ret_val) {
         zipFilesToFd(extra_files, extra_output_socket);
@@ -29,12 +29,54 @@ namespace hardware {
 namespace power {
 
 // Public functions
+CarPowerManager::~CarPowerManager() {
+    // Clear the listener if one is set
+    clearListener();
+
+    std::thread reconnectThread;
+    {
+        std::lock_guard<std::mutex> lock(mConnectionLock);
+        mShuttingDown = true;
+        mReconnectSignal.notify_one();
+        reconnectThread = std::move(mReconnectThread);
+
+        if (mIsConnected && (mDeathRecipient != nullptr)) {
+            IInterface::asBinder(mICarPower)->unlinkToDeath(mDeathRecipient);
+        }
+    }
+    if (reconnectThread.joinable()) {
+        reconnectThread.join();
+    }
+}
+
 int CarPowerManager::clearListener() {
     int retVal = -1;
 
+    {
+        std::lock_guard<std::mutex> lock(mConnectionLock);
+        if (mListenerToService != nullptr) {
+            if (mIsConnected) {
+                mICarPower->unregisterListener(mListenerToService);
+            }
+            mListenerToService = nullptr;
+            retVal = 0;
+        }
+    }
+    stopDispatchThread();
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mListener = nullptr;
+        mLooper = nullptr;
+    }
+    return retVal;
+}
+
+int CarPowerManager::finished() {
+    int retVal = -1;
+
+    std::lock_guard<std::mutex> lock(mConnectionLock);
     if (mIsConnected && (mListenerToService != nullptr)) {
-        mICarPower->unregisterListener(mListenerToService);
-        mListenerToService = nullptr;
+        mICarPower->finished(mListenerToService);
         retVal = 0;
     }
     return retVal;
@@ -44,36 +86,180 @@ int CarPowerManager::requestShutdownOnNextSuspend() {
     int retVal = -1;
 
     if (connectToCarService()) {
-        mICarPower->requestShutdownOnNextSuspend();
-        retVal = 0;
+        std::lock_guard<std::mutex> lock(mConnectionLock);
+        if (mIsConnected) {
+            mICarPower->requestShutdownOnNextSuspend();
+            retVal = 0;
+        }
     }
     return retVal;
 }
 
 int CarPowerManager::setListener(Listener listener) {
-    int retVal = -1;
+    stopDispatchThread();
+    return registerListener(std::move(listener), nullptr, false);
+}
 
-    if (connectToCarService()) {
+int CarPowerManager::setListener(Listener listener, const sp<Looper>& looper) {
+    if (looper == nullptr) {
+        return registerListener(std::move(listener), startDispatchThread(), false);
+    }
+    stopDispatchThread();
+    return registerListener(std::move(listener), looper, false);
+}
+
+int CarPowerManager::setListenerWithCompletion(Listener listener, const sp<Looper>& looper) {
+    if (looper == nullptr) {
+        return registerListener(std::move(listener), startDispatchThread(), true);
+    }
+    stopDispatchThread();
+    return registerListener(std::move(listener), looper, true);
+}
+
+
+// Private functions
+int CarPowerManager::registerListener(Listener listener, const sp<Looper>& looper,
+                                      bool withCompletion) {
+    // Set the listener before CarService can call it
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mListener = std::move(listener);
+        mLooper = looper;
+    }
+
+    bool connected = connectToCarService();
+    {
+        std::lock_guard<std::mutex> lock(mConnectionLock);
+        // CarService may have gone again since
+        connected = connected && mIsConnected;
+
+        if ((mListenerToService != nullptr) && (mWithCompletion != withCompletion)) {
+            // CarService keeps the two kinds of listener apart, so start over
+            if (connected) {
+                mICarPower->unregisterListener(mListenerToService);
+            }
+            mListenerToService = nullptr;
+        }
         if (mListenerToService == nullptr) {
             mListenerToService = new CarPowerStateListener(this);
-            mICarPower->registerListener(mListenerToService);
+            mWithCompletion = withCompletion;
+            if (connected) {
+                registerWithCarService();
+            }
         }
+    }
 
-        // Set the listener
-        mListener = listener;
-        retVal = 0;
+    if (!connected) {
+        // The reconnect thread registers it once CarService shows up
+        scheduleReconnect();
+    }
+    return 0;
+}
+
+void CarPowerManager::dispatch(State state) {
+    Listener listener;
+    sp<Looper> looper;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        listener = mListener;
+        looper = mLooper;
+    }
+    if (listener == nullptr) {
+        // Cleared while the state change was on its way
+        ALOGW(LOG_TAG "No listener for state change %d", static_cast<int>(state));
+        return;
+    }
+
+    if (looper == nullptr) {
+        listener(state);
+    } else {
+        // Hand the state change over and let the binder thread go back to the pool
+        looper->sendMessage(new StateChangeHandler(std::move(listener), state),
+                            Message(static_cast<int>(state)));
     }
-    return retVal;
+}
+
+sp<Looper> CarPowerManager::startDispatchThread() {
+    if (mDispatchThread.joinable()) {
+        // Already running
+        return mDispatchLooper;
+    }
+
+    // The thread only holds on to what it shares with us, in case it outlives us (see below)
+    sp<Looper> looper = new Looper(false /* allowNonCallbacks */);
+    auto stop = std::make_shared<std::atomic<bool>>(false);
+    mDispatchThread = std::thread([looper, stop]() {
+        while (!*stop) {
+            looper->pollOnce(-1);
+        }
+    });
+    mDispatchLooper = looper;
+    mStopDispatching = stop;
+    return looper;
+}
+
+void CarPowerManager::stopDispatchThread() {
+    if (!mDispatchThread.joinable()) {
+        return;
+    }
+
+    // Nothing more goes to the thread once it's been told to stop
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mLooper == mDispatchLooper) {
+            mLooper = nullptr;
+        }
+    }
+    *mStopDispatching = true;
+    mDispatchLooper->wake();
+
+    if (mDispatchThread.get_id() == std::this_thread::get_id()) {
+        // Called from the listener itself, so let the thread finish on its own
+        mDispatchThread.detach();
+    } else {
+        mDispatchThread.join();
+    }
+    mDispatchLooper = nullptr;
+    mStopDispatching = nullptr;
 }
 
 
-// Private functions
 bool CarPowerManager::connectToCarService() {
+    {
+        std::lock_guard<std::mutex> lock(mConnectionLock);
+        if (mIsConnected) {
+            // Service is already connected
+            return true;
+        }
+    }
+
+    sp<ICarPower> carPower = getCarPowerService();
+    if (carPower == nullptr) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mConnectionLock);
     if (mIsConnected) {
-        // Service is already connected
+        // Someone else got there while we were looking
         return true;
     }
+    if (mShuttingDown) {
+        return false;
+    }
+    mICarPower = carPower;
+
+    // Hear about it if CarService goes away, so we can come back without anyone polling us
+    if (mDeathRecipient == nullptr) {
+        mDeathRecipient = new CarServiceDeathRecipient(this);
+    }
+    if (IInterface::asBinder(mICarPower)->linkToDeath(mDeathRecipient) != OK) {
+        ALOGW(LOG_TAG "Cannot watch ICarPower, CarService restarts will go unnoticed");
+    }
+    mIsConnected = true;
+    return true;
+}
 
+sp<ICarPower> CarPowerManager::getCarPowerService() {
     const String16 ICarName("car_service");
     const String16 ICarPowerName("power");
 
@@ -83,38 +269,105 @@ bool CarPowerManager::connectToCarService() {
     sp<IServiceManager> serviceManager = defaultServiceManager();
     if (serviceManager == nullptr) {
         ALOGE(LOG_TAG "Cannot get defaultServiceManager");
-        return(false);
+        return nullptr;
     }
 
     sp<IBinder> binder = (serviceManager->getService(ICarName));
     if (binder == nullptr) {
         ALOGE(LOG_TAG "Cannot get ICar");
-        return false;
+        return nullptr;
     }
 
     // Get ICarPower
     sp<ICar> iCar = interface_cast<ICar>(binder);
     if (iCar == nullptr) {
         ALOGW(LOG_TAG "car service unavailable");
-        return false;
+        return nullptr;
     }
 
     iCar->getCarService(ICarPowerName, &binder);
     if (binder == nullptr) {
         ALOGE(LOG_TAG "Cannot get ICarPower");
-        return false;
+        return nullptr;
     }
 
-    mICarPower = interface_cast<ICarPower>(binder);
-    if (mICarPower == nullptr) {
+    sp<ICarPower> carPower = interface_cast<ICarPower>(binder);
+    if (carPower == nullptr) {
         ALOGW(LOG_TAG "car power management service unavailable");
-        return false;
     }
-    mIsConnected = true;
-    return true;
+    return carPower;
+}
+
+
+void CarPowerManager::registerWithCarService() {
+    if (mWithCompletion) {
+        mICarPower->registerListenerWithCompletion(mListenerToService);
+    } else {
+        mICarPower->registerListener(mListenerToService);
+    }
+}
+
+void CarPowerManager::onCarServiceDied() {
+    ALOGW(LOG_TAG "CarService died, will reconnect");
+    {
+        std::lock_guard<std::mutex> lock(mConnectionLock);
+        mIsConnected = false;
+        mICarPower = nullptr;
+    }
+    scheduleReconnect();
+}
+
+void CarPowerManager::scheduleReconnect() {
+    std::lock_guard<std::mutex> lock(mConnectionLock);
+    if (mShuttingDown) {
+        return;
+    }
+    mReconnectNeeded = true;
+    if (!mReconnectThread.joinable()) {
+        mReconnectThread = std::thread(&CarPowerManager::reconnectLoop, this);
+    } else {
+        mReconnectSignal.notify_one();
+    }
+}
+
+void CarPowerManager::reconnectLoop() {
+    std::unique_lock<std::mutex> lock(mConnectionLock);
+    while (!mShuttingDown) {
+        mReconnectSignal.wait(lock, [this]() { return mShuttingDown || mReconnectNeeded; });
+
+        auto delay = kMinReconnectDelay;
+        while (!mShuttingDown) {
+            // Looking CarService up can block for a while, so nobody else waits on us meanwhile
+            lock.unlock();
+            bool connected = connectToCarService();
+            lock.lock();
+            if (connected || mShuttingDown) {
+                break;
+            }
+
+            // Wait a bit longer each time, so a CarService that's slow to come up doesn't have
+            // us hammering servicemanager
+            mReconnectSignal.wait_for(lock, delay, [this]() { return mShuttingDown; });
+            delay = std::min(delay * 2, kMaxReconnectDelay);
+        }
+        if (mShuttingDown) {
+            break;
+        }
+        if (!mIsConnected) {
+            // It died again before we had the lock back, so go round again
+            continue;
+        }
+
+        mReconnectNeeded = false;
+        if (mListenerToService != nullptr) {
+            ALOGI(LOG_TAG "Registering the listener again");
+            registerWithCarService();
+        }
+    }
 }
 
 
+
 } // namespace power
 } // namespace hardware
 } // namespace car
@@ -17,9 +17,19 @@
 #ifndef CAR_POWER_MANAGER
 #define CAR_POWER_MANAGER
 
+#include <binder/IBinder.h>
 #include <binder/Status.h>
+#include <utils/Looper.h>
 #include <utils/RefBase.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+
 #include "android/car/ICar.h"
 #include "android/car/hardware/power/BnCarPowerStateListener.h"
 #include "android/car/hardware/power/ICarPower.h"
@@ -54,10 +64,7 @@ public:
     using Listener = std::function<void(State)>;
 
     CarPowerManager() = default;
-    virtual ~CarPowerManager() {
-        // Clear the listener if one is set
-        clearListener();
-    }
+    virtual ~CarPowerManager();
 
     // Removes the listener and turns off callbacks
     //  Returns 0 on success
@@ -67,25 +74,44 @@ public:
     //  Returns 0 on success
     int requestShutdownOnNextSuspend();
 
-    // Set the callback function.  This will execute in the binder thread.
+    // Set the callback function.  This will execute in the binder thread, so it must not block:
+    //  CarService's power state machine can't move on until it returns.
+    //  If CarService isn't up yet, or goes away later, the listener is registered again in the
+    //  background as soon as it's back, so there is no need to retry.
     //  Returns 0 on success
     int setListener(Listener listener);
 
+    // Set the callback function, to be run on |looper|, or on a thread of our own if |looper| is
+    //  null.  The binder thread only queues the state change, so the callback may take its time.
+    //  Returns 0 on success
+    int setListener(Listener listener, const sp<Looper>& looper);
+
+    // As above, but CarService also waits in kShutdownPrepare until finished() is called, so
+    //  the client can report when it's ready for suspend on its own schedule.  CarService only
+    //  accepts this from clients running as system.
+    //  Returns 0 on success
+    int setListenerWithCompletion(Listener listener, const sp<Looper>& looper = nullptr);
+
+    // Tells CarService that the listener is done preparing for shutdown or suspend
+    //  Returns 0 on success
+    int finished();
+
 private:
     class CarPowerStateListener final : public BnCarPowerStateListener {
     public:
         explicit CarPowerStateListener(CarPowerManager* parent) : mParent(parent) {};
 
         Status onStateChanged(int state) override {
+            // Whether there's still a listener is for dispatch() to say, under mLock
             sp<CarPowerManager> parent = mParent;
-            if ((parent == nullptr) || (parent->mListener == nullptr)) {
+            if (parent == nullptr) {
                 ALOGE("CarPowerManagerNative: onStateChanged null pointer detected!");
             } else if ((state < static_cast<int>(State::kFirst)) ||
                        (state > static_cast<int>(State::kLast)) )  {
                 ALOGE("CarPowerManagerNative: onStateChanged unknown state: %d", state);
             } else {
                 // Notify the listener of the state transition
-                parent->mListener(static_cast<State>(state));
+                parent->dispatch(static_cast<State>(state));
             }
             return binder::Status::ok();
         };
@@ -94,12 +120,78 @@ private:
         sp<CarPowerManager> mParent;
     };
 
-    bool connectToCarService();
+    // Runs the listener for one state change on the looper it was posted to
+    class StateChangeHandler final : public MessageHandler {
+    public:
+        StateChangeHandler(Listener listener, State state) :
+                mListener(std::move(listener)), mState(state) {}
 
+        void handleMessage(const Message&) override { mListener(mState); }
+
+    private:
+        Listener mListener;
+        State mState;
+    };
+
+    // Notices when CarService dies, so we can reconnect.  Binder may deliver the death after
+    //  we're gone, so this only holds on to us weakly.
+    class CarServiceDeathRecipient final : public IBinder::DeathRecipient {
+    public:
+        explicit CarServiceDeathRecipient(CarPowerManager* parent) : mParent(parent) {};
+
+        void binderDied(const wp<IBinder>&) override {
+            sp<CarPowerManager> parent = mParent.promote();
+            if (parent != nullptr) {
+                parent->onCarServiceDied();
+            }
+        }
+
+    private:
+        wp<CarPowerManager> mParent;
+    };
+
+    // Reconnect attempts back off exponentially between these
+    static constexpr std::chrono::milliseconds kMinReconnectDelay{100};
+    static constexpr std::chrono::milliseconds kMaxReconnectDelay{10000};
+
+    // Called without mConnectionLock, since looking CarService up can block for seconds; the
+    //  lock is only taken to publish the connection
+    bool connectToCarService();
+    static sp<ICarPower> getCarPowerService();
+    // Called with mConnectionLock held
+    void registerWithCarService();
+
+    void onCarServiceDied();
+    void scheduleReconnect();
+    void reconnectLoop();
+    int registerListener(Listener listener, const sp<Looper>& looper, bool withCompletion);
+    void dispatch(State state);
+    sp<Looper> startDispatchThread();
+    void stopDispatchThread();
+
+    // Guards the cached connection to CarService, and what we've registered with it
+    std::mutex mConnectionLock;
     sp<ICarPower> mICarPower;
-    bool mIsConnected;
-    Listener mListener;
+    bool mIsConnected = false;
     sp<CarPowerStateListener> mListenerToService;
+    bool mWithCompletion = false;
+    sp<CarServiceDeathRecipient> mDeathRecipient;
+
+    // Brings the connection back in the background whenever it's lost
+    std::thread mReconnectThread;
+    std::condition_variable mReconnectSignal;
+    bool mReconnectNeeded = false;
+    bool mShuttingDown = false;
+
+    // Guards the listener and where it runs, which the binder thread reads on every state change
+    std::mutex mLock;
+    Listener mListener;
+    sp<Looper> mLooper;             // null to run the listener on the binder thread
+
+    // Our own thread and looper, for clients that don't bring a looper of their own
+    std::thread mDispatchThread;
+    sp<Looper> mDispatchLooper;
+    std::shared_ptr<std::atomic<bool>> mStopDispatching;
 };
 
 } // namespace power
@@ -19,6 +19,13 @@
 BOARD_PLAT_PUBLIC_SEPOLICY_DIR += packages/services/Car/car_product/sepolicy/public
 BOARD_PLAT_PRIVATE_SEPOLICY_DIR += packages/services/Car/car_product/sepolicy/private
 
+# Set CAR_PROCFS_INSPECTOR_PROC_CONNECTOR := true before inheriting this file to have
+# procfs-inspector follow the kernel proc connector instead of scanning /proc for each request.
+# That needs CAP_NET_ADMIN, so it's off unless asked for.
+ifeq ($(CAR_PROCFS_INSPECTOR_PROC_CONNECTOR),true)
+BOARD_PLAT_PRIVATE_SEPOLICY_DIR += packages/services/Car/car_product/sepolicy/procconnector
+endif
+
 PRODUCT_PACKAGES += \
     Bluetooth \
     CarDeveloperOptions \
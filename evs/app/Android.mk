@@ -6,9 +6,13 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
     evs_app.cpp \
     EvsStateControl.cpp \
+    FramePacer.cpp \
+    QualityGovernor.cpp \
     RenderBase.cpp \
     RenderDirectView.cpp \
+    LensDistortion.cpp \
     RenderTopView.cpp \
+    RenderStitchedView.cpp \
     ConfigManager.cpp \
     glError.cpp \
     shader.cpp \
@@ -19,6 +23,10 @@ LOCAL_SRC_FILES := \
     FormatConvert.cpp \
     RenderPixelCopy.cpp
 
+# For the manager's ExtendedInfo.h
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../manager \
+
 LOCAL_SHARED_LIBRARIES := \
     libbinder \
     libcutils \
@@ -34,8 +42,11 @@ LOCAL_SHARED_LIBRARIES := \
     libpng \
     android.hardware.automotive.evs@1.0 \
     android.hardware.automotive.vehicle@2.0 \
+    android.hardware.thermal@1.0 \
+    android.hardware.thermal@2.0 \
 
 LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
     libmath \
     libjsoncpp \
 
@@ -47,6 +58,7 @@ LOCAL_MODULE:= evs_app
 LOCAL_MODULE_TAGS := optional
 
 LOCAL_CFLAGS += -DLOG_TAG=\"EvsApp\"
+LOCAL_CFLAGS += -DATRACE_TAG=ATRACE_TAG_CAMERA
 LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
 LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
 
@@ -60,6 +72,8 @@ LOCAL_MODULE_PATH := $(TARGET_OUT_ETC)/automotive/evs
 LOCAL_SRC_FILES := $(LOCAL_MODULE)
 include $(BUILD_PREBUILT)
 
+# Products may also install CarFromTop.ktx and LabeledChecker.ktx next to these images.  The app
+# loads such prebaked (eg: ETC2 or ASTC) textures in preference to decoding the PNGs.
 include $(CLEAR_VARS)
 LOCAL_MODULE := CarFromTop.png
 LOCAL_MODULE_CLASS := ETC
@@ -16,14 +16,114 @@
 #include "ConfigManager.h"
 
 #include "json/json.h"
+#include "FileUtils.h"
+#include "LensDistortion.h"
 
 #include <fstream>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <math.h>
 #include <assert.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+
+using ::android::automotive::evs::support::hashString;
+using ::android::automotive::evs::support::kHashSeed;
+using ::android::automotive::evs::support::writeFileAtomically;
 
 
 static const float kDegreesToRadians = M_PI / 180.0f;
 
+// Where we keep what we parsed out of each configuration file, so we don't parse it again
+static const char kCacheDir[] = "/data/misc/evs_app";
+static const uint32_t kCacheMagic = 0x43535645;    // "EVSC"
+static const uint32_t kCacheVersion = 3;            // Bump when the layout below changes
+
+
+// Builds the cache file as a flat sequence of fixed size fields and length prefixed strings
+class CacheWriter {
+public:
+    template <typename T> void put(const T& value) {
+        const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+        mData.insert(mData.end(), bytes, bytes + sizeof(value));
+    }
+    void putBytes(const void* data, size_t size) {
+        put<uint32_t>(size);
+        const uint8_t* bytes = static_cast<const uint8_t*>(data);
+        mData.insert(mData.end(), bytes, bytes + size);
+    }
+    void putString(const std::string& str) { putBytes(str.data(), str.size()); }
+
+    const std::vector<uint8_t>& data() const { return mData; }
+
+private:
+    std::vector<uint8_t> mData;
+};
+
+
+// Reads back what CacheWriter wrote.  Once anything runs off the end, ok() stays false.
+class CacheReader {
+public:
+    CacheReader(const uint8_t* data, size_t size) : mPos(data), mEnd(data + size) {}
+
+    template <typename T> T get() {
+        T value = {};
+        if (check(sizeof(value))) {
+            memcpy(&value, mPos, sizeof(value));
+            mPos += sizeof(value);
+        }
+        return value;
+    }
+    void getBytes(std::vector<uint8_t>& bytes) {
+        const uint32_t size = get<uint32_t>();
+        if (check(size)) {
+            bytes.assign(mPos, mPos + size);
+            mPos += size;
+        }
+    }
+    std::string getString() {
+        const uint32_t size = get<uint32_t>();
+        std::string str;
+        if (check(size)) {
+            str.assign(reinterpret_cast<const char*>(mPos), size);
+            mPos += size;
+        }
+        return str;
+    }
+
+    bool ok() const { return mOk; }
+
+private:
+    bool check(size_t size) {
+        mOk = mOk && size <= (size_t)(mEnd - mPos);
+        return mOk;
+    }
+
+    const uint8_t*  mPos;
+    const uint8_t*  mEnd;
+    bool            mOk = true;
+};
+
+
+// Each configuration file gets a cache named for its path
+static std::string getCacheFileName(const char* configFileName) {
+    const uint64_t hash = hashString(kHashSeed, configFileName);
+    char name[sizeof(kCacheDir) + 32];
+    snprintf(name, sizeof(name), "%s/config_%016" PRIx64 ".bin", kCacheDir, hash);
+    return name;
+}
+
+
+// A camera's warp mesh is cached under a name that includes the grid size, so a build with a
+// different grid doesn't pick up meshes it can't use
+static std::string getWarpMeshName(const ConfigManager::CameraInfo& cam) {
+    return "ConfigManager/warpMesh/" + std::to_string(kWarpMeshColumns) + "x" +
+           std::to_string(kWarpMeshRows) + "/" + cam.cameraId;
+}
+
 
 static float normalizeToPlusMinus180degrees(float theta) {
     const float wraps = floor((theta+180.0f) / 360.0f);
@@ -49,7 +149,208 @@ static bool readChildNodeAsFloat(const char* groupName,
 }
 
 
-bool ConfigManager::initialize(const char* configFileName)
+bool ConfigManager::initialize(const char* configFileName) {
+    // Use what we parsed last time, if the file hasn't changed since
+    struct stat configInfo = {};
+    if (stat(configFileName, &configInfo) != 0) {
+        printf("Failed to read configuration file %s: %s\n", configFileName, strerror(errno));
+        return false;
+    }
+    mCacheFileName = getCacheFileName(configFileName);
+    if (!loadCache(configInfo)) {
+        if (!readConfigFile(configFileName)) {
+            return false;
+        }
+
+        // Cache what we found for next time.  Nothing derived from the old file still applies.
+        mConfigSize = configInfo.st_size;
+        mConfigMtimeNs = configInfo.st_mtim.tv_sec * 1000000000ll + configInfo.st_mtim.tv_nsec;
+        mDerivedData.clear();
+        mCacheChanged = true;
+    }
+
+    // The warp meshes go in the cache along with everything else derived from the configuration
+    const size_t meshSize = (kWarpMeshColumns + 1) * (kWarpMeshRows + 1) * 4 * sizeof(float);
+    for (auto&& info : mCameras) {
+        std::vector<uint8_t> data;
+        if (info.hasDistortion() && getDerivedData(getWarpMeshName(info), data) &&
+            data.size() == meshSize) {
+            info.warpMesh.resize(meshSize / sizeof(float));
+            memcpy(info.warpMesh.data(), data.data(), meshSize);
+            continue;
+        }
+
+        buildWarpMesh(info);
+        if (!info.warpMesh.empty()) {
+            putDerivedData(getWarpMeshName(info), info.warpMesh.data(),
+                           info.warpMesh.size() * sizeof(float));
+        }
+    }
+    return true;
+}
+
+
+void ConfigManager::flushCache() {
+    if (mCacheChanged && saveCache()) {
+        mCacheChanged = false;
+    }
+}
+
+
+bool ConfigManager::getDerivedData(const std::string& name, std::vector<uint8_t>& data) const {
+    auto it = mDerivedData.find(name);
+    if (it == mDerivedData.end()) {
+        return false;
+    }
+    data = it->second;
+    return true;
+}
+
+
+void ConfigManager::putDerivedData(const std::string& name, const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    mDerivedData[name].assign(bytes, bytes + size);
+    mCacheChanged = true;
+}
+
+
+bool ConfigManager::loadCache(const struct stat& configInfo) {
+    int fd = open(mCacheFileName.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info = {};
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        return false;
+    }
+
+    // Only a cache of this exact version of the configuration file will do
+    CacheReader reader(static_cast<const uint8_t*>(mapping), info.st_size);
+    const int64_t mtimeNs = configInfo.st_mtim.tv_sec * 1000000000ll + configInfo.st_mtim.tv_nsec;
+    bool valid = reader.get<uint32_t>() == kCacheMagic &&
+                 reader.get<uint32_t>() == kCacheVersion &&
+                 reader.get<uint64_t>() == (uint64_t)configInfo.st_size &&
+                 reader.get<int64_t>() == mtimeNs;
+    if (valid) {
+        mCarWidth               = reader.get<float>();
+        mWheelBase              = reader.get<float>();
+        mFrontExtent            = reader.get<float>();
+        mRearExtent             = reader.get<float>();
+        mFrontRangeInCarSpace   = reader.get<float>();
+        mRearRangeInCarSpace    = reader.get<float>();
+        mStitchedView           = reader.get<uint8_t>() != 0;
+        const uint32_t rateCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < rateCount && reader.ok(); i++) {
+            const std::string function = reader.getString();
+            mFrameRates[function] = reader.get<float>();
+        }
+        mCarGraphicFrontPixel   = reader.get<float>();
+        mCarGraphicRearPixel    = reader.get<float>();
+
+        mCameras.resize(reader.get<uint32_t>());
+        for (auto&& info : mCameras) {
+            info.cameraId    = reader.getString();
+            info.function    = reader.getString();
+            info.position[0] = reader.get<float>();
+            info.position[1] = reader.get<float>();
+            info.position[2] = reader.get<float>();
+            info.yaw         = reader.get<float>();
+            info.pitch       = reader.get<float>();
+            info.hfov        = reader.get<float>();
+            info.vfov        = reader.get<float>();
+            for (auto&& k : info.distortion) {
+                k = reader.get<float>();
+            }
+            info.opticalCenter[0] = reader.get<float>();
+            info.opticalCenter[1] = reader.get<float>();
+            info.focalLength[0]   = reader.get<float>();
+            info.focalLength[1]   = reader.get<float>();
+            if (!reader.ok()) {
+                break;
+            }
+        }
+
+        const uint32_t derivedCount = reader.get<uint32_t>();
+        for (uint32_t i = 0; i < derivedCount && reader.ok(); i++) {
+            const std::string name = reader.getString();
+            reader.getBytes(mDerivedData[name]);
+        }
+        valid = reader.ok();
+    }
+    munmap(mapping, info.st_size);
+
+    if (!valid) {
+        mCameras.clear();
+        mFrameRates.clear();
+        mDerivedData.clear();
+        return false;
+    }
+
+    mConfigSize = configInfo.st_size;
+    mConfigMtimeNs = mtimeNs;
+    return true;
+}
+
+
+bool ConfigManager::saveCache() const {
+    CacheWriter writer;
+    writer.put<uint32_t>(kCacheMagic);
+    writer.put<uint32_t>(kCacheVersion);
+    writer.put<uint64_t>(mConfigSize);
+    writer.put<int64_t>(mConfigMtimeNs);
+
+    writer.put<float>(mCarWidth);
+    writer.put<float>(mWheelBase);
+    writer.put<float>(mFrontExtent);
+    writer.put<float>(mRearExtent);
+    writer.put<float>(mFrontRangeInCarSpace);
+    writer.put<float>(mRearRangeInCarSpace);
+    writer.put<uint8_t>(mStitchedView);
+    writer.put<uint32_t>(mFrameRates.size());
+    for (auto&& entry : mFrameRates) {
+        writer.putString(entry.first);
+        writer.put<float>(entry.second);
+    }
+    writer.put<float>(mCarGraphicFrontPixel);
+    writer.put<float>(mCarGraphicRearPixel);
+
+    writer.put<uint32_t>(mCameras.size());
+    for (auto&& info : mCameras) {
+        writer.putString(info.cameraId);
+        writer.putString(info.function);
+        writer.put<float>(info.position[0]);
+        writer.put<float>(info.position[1]);
+        writer.put<float>(info.position[2]);
+        writer.put<float>(info.yaw);
+        writer.put<float>(info.pitch);
+        writer.put<float>(info.hfov);
+        writer.put<float>(info.vfov);
+        for (auto&& k : info.distortion) {
+            writer.put<float>(k);
+        }
+        writer.put<float>(info.opticalCenter[0]);
+        writer.put<float>(info.opticalCenter[1]);
+        writer.put<float>(info.focalLength[0]);
+        writer.put<float>(info.focalLength[1]);
+    }
+
+    writer.put<uint32_t>(mDerivedData.size());
+    for (auto&& entry : mDerivedData) {
+        writer.putString(entry.first);
+        writer.putBytes(entry.second.data(), entry.second.size());
+    }
+
+    const std::vector<uint8_t>& data = writer.data();
+    return writeFileAtomically(mCacheFileName, data.data(), data.size());
+}
+
+
+bool ConfigManager::readConfigFile(const char* configFileName)
 {
     bool complete = true;
 
@@ -94,6 +395,15 @@ bool ConfigManager::initialize(const char* configFileName)
         }
         complete &= readChildNodeAsFloat("display", displayNode, "frontRange", &mFrontRangeInCarSpace);
         complete &= readChildNodeAsFloat("display", displayNode, "rearRange",  &mRearRangeInCarSpace);
+        mStitchedView = displayNode.get("stitched", false).asBool();
+
+        // Optional frame rate caps, by camera function ("reverse", "park", etc)
+        Json::Value frameRatesNode = displayNode["frameRates"];
+        if (frameRatesNode.isObject()) {
+            for (auto&& function : frameRatesNode.getMemberNames()) {
+                mFrameRates[function] = frameRatesNode[function].asFloat();
+            }
+        }
     }
 
 
@@ -179,6 +489,29 @@ bool ConfigManager::initialize(const char* configFileName)
             info.cameraId    = cameraId;
             info.function    = function;
 
+            // Fisheye cameras can say how to correct their images
+            Json::Value distortionNode = node["distortion"];
+            if (distortionNode.isObject()) {
+                Json::Value kNode      = distortionNode["k"];
+                Json::Value centerNode = distortionNode["center"];
+                Json::Value focalNode  = distortionNode["focal"];
+                if (focalNode.isArray() && focalNode.size() == 2 &&
+                    focalNode[0].asFloat() > 0 && focalNode[1].asFloat() > 0) {
+                    for (unsigned i = 0; i < 4 && kNode.isArray() && i < kNode.size(); i++) {
+                        info.distortion[i] = kNode[i].asFloat();
+                    }
+                    if (centerNode.isArray() && centerNode.size() == 2) {
+                        info.opticalCenter[0] = centerNode[0].asFloat();
+                        info.opticalCenter[1] = centerNode[1].asFloat();
+                    }
+                    info.focalLength[0] = focalNode[0].asFloat();
+                    info.focalLength[1] = focalNode[1].asFloat();
+                } else {
+                    printf("Ignoring distortion for camera %s without a valid focal length\n",
+                           cameraId);
+                }
+            }
+
             mCameras.push_back(info);
         }
     }
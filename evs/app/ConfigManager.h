@@ -16,6 +16,10 @@
 #ifndef CONFIG_MANAGER_H
 #define CONFIG_MANAGER_H
 
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include <map>
 #include <vector>
 #include <string>
 
@@ -30,9 +34,35 @@ public:
         float pitch = 0;    // positive upward (ie: right hand rule about local x axis)
         float hfov  = 0;    // radians
         float vfov  = 0;    // radians
+
+        // Optional lens distortion, for fisheye cameras whose images need correcting.  hfov and
+        // vfov then describe the corrected view.  A ray at angle theta off the optical axis
+        // lands theta * (1 + k1 theta^2 + k2 theta^4 + k3 theta^6 + k4 theta^8) focal lengths
+        // from the optical center (the equidistant fisheye model, as OpenCV calibrates it).
+        float distortion[4]     = {0};              // k1 to k4
+        float opticalCenter[2]  = {0.5f, 0.5f};     // In texture coordinates
+        float focalLength[2]    = {0};              // In image widths and heights
+        bool hasDistortion() const  { return focalLength[0] > 0 && focalLength[1] > 0; };
+
+        // Built from the above when the configuration is first loaded, and cached from then on
+        // (see LensDistortion.h):  a grid over the image, each vertex being the ideal texture
+        // coordinates followed by where the lens actually puts them.  Empty if the camera has
+        // no distortion.
+        std::vector<float> warpMesh;
     };
 
+    // Reads the given JSON configuration.  What we parse out of it is kept in a binary cache,
+    // so later starts read that instead for as long as the JSON file stays the same.  Changes
+    // to the cache are only written out by flushCache(); call that once startup has put all the
+    // derived data (below) it's going to, so a fresh configuration costs one write.
     bool initialize(const char* configFileName);
+    void flushCache();
+
+    // Anything users of the configuration work out from it can be kept in our cache as well,
+    // under a name of their choosing, so it's only worked out once per configuration.
+    // getDerivedData() returns false if nothing has been put under the name yet.
+    bool getDerivedData(const std::string& name, std::vector<uint8_t>& data) const;
+    void putDerivedData(const std::string& name, const void* data, size_t size);
 
     // World space dimensions of the car
     float getCarWidth() const   { return mCarWidth; };
@@ -63,6 +93,16 @@ public:
         return -getDisplayRightLocation(aspectRatio);
     };
 
+    // Should multi camera views blend the cameras together instead of layering them?
+    bool useStitchedView() const    { return mStitchedView; };
+
+    // How many frames per second should we draw while showing the cameras for this function?
+    // Returns 0 if it isn't limited, in which case we keep up with the cameras.
+    float getFrameRate(const std::string& function) const {
+        auto it = mFrameRates.find(function);
+        return (it != mFrameRates.end()) ? it->second : 0.0f;
+    };
+
     // At which texel (vertically in the image) are the front and rear bumpers of the car?
     float carGraphicFrontPixel() const      { return mCarGraphicFrontPixel; };
     float carGraphicRearPixel() const       { return mCarGraphicRearPixel; };
@@ -70,6 +110,19 @@ public:
     const std::vector<CameraInfo>& getCameras() const   { return mCameras; };
 
 private:
+    bool readConfigFile(const char* configFileName);
+    bool loadCache(const struct stat& configInfo);
+    bool saveCache() const;
+
+    // Where our cache lives, and which version of the JSON file it holds
+    std::string mCacheFileName;
+    uint64_t    mConfigSize = 0;
+    int64_t     mConfigMtimeNs = 0;
+
+    // See putDerivedData()
+    std::map<std::string, std::vector<uint8_t>> mDerivedData;
+    bool        mCacheChanged = false;      // Since we last wrote it out
+
     // Camera information
     std::vector<CameraInfo> mCameras;
 
@@ -85,6 +138,8 @@ private:
     // Display information
     float    mFrontRangeInCarSpace;     // How far the display extends in front of the car
     float    mRearRangeInCarSpace;      // How far the display extends behind the car
+    bool     mStitchedView = false;     // Blend the top down view's cameras at their seams
+    std::map<std::string, float> mFrameRates;  // Frame rate caps by camera function
 
     // Top view car image information
     float mCarGraphicFrontPixel;    // How many pixels from the top of the image does the car start
@@ -16,16 +16,40 @@
 #include "EvsStateControl.h"
 #include "RenderDirectView.h"
 #include "RenderTopView.h"
+#include "RenderStitchedView.h"
 #include "RenderPixelCopy.h"
+#include "VideoTex.h"
 
+#include <math.h>
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include <log/log.h>
 #include <inttypes.h>
 #include <utils/SystemClock.h>
+#include <utils/Trace.h>
 #include <binder/IServiceManager.h>
 
+// The longest we'll wait for new video before we look at the vehicle state again
+static const std::chrono::milliseconds kMaxFrameWait(100);
+
+// How far we cut back, in the stages the QualityGovernor takes us through when we're hot or busy.
+// The resolution scale applies each way, so this is about half the pixels.
+static const float kReducedRenderScale = 0.7f;
+static const float kReducedFrameRate   = 15.0f;    // For states that would otherwise run free
+
+// The camera function names the configuration uses to describe each of our states
+static const char* kStateFunctions[EvsStateControl::NUM_STATES] = {
+    "off",
+    "reverse",
+    "left",
+    "right",
+    "park",
+};
+
+
 static bool isSfReady() {
     const android::String16 serviceName("SurfaceFlinger");
     return android::defaultServiceManager()->checkService(serviceName) != nullptr;
@@ -120,6 +144,9 @@ EvsStateControl::EvsStateControl(android::sp <IVehicle>       pVnet,
     }
 #endif
 
+    // Heat is one of the things that decides how much quality we can afford
+    mQualityGovernor.startThermalMonitoring();
+
     ALOGD("State controller ready");
 }
 
@@ -137,8 +164,9 @@ void EvsStateControl::postCommand(const Command& cmd) {
     mCommandQueue.push(cmd);
     mLock.unlock();
 
-    // Send a signal to wake updateLoop in case it is asleep
+    // Send a signal to wake updateLoop in case it is asleep, whether idle or waiting for video
     mWakeSignal.notify_all();
+    StreamHandler::interruptFrameWait();
 }
 
 
@@ -157,7 +185,12 @@ void EvsStateControl::updateLoop() {
                     run = false;
                     break;
                 case Op::CHECK_VEHICLE_STATE:
-                    // Just running selectStateForCurrentConditions below will take care of this
+                    // We're subscribed to the changes, but resync now and then "just in case"
+                    mVehicleStateStale = true;
+                    break;
+                case Op::VEHICLE_PROPERTY_CHANGED:
+                    updateVehicleProperty(static_cast<int32_t>(cmd.arg1),
+                                          static_cast<int32_t>(cmd.arg2));
                     break;
                 case Op::TOUCH_EVENT:
                     // Implement this given the x/y location of the touch event
@@ -167,20 +200,43 @@ void EvsStateControl::updateLoop() {
             }
         }
 
-        // Review vehicle state and choose an appropriate renderer
-        if (!selectStateForCurrentConditions()) {
-            ALOGE("selectStateForCurrentConditions failed so we're going to die");
-            break;
+        // Review vehicle state and choose an appropriate renderer, but only when there's
+        // something new to look at (the dummy vehicle runs on a timer, so always check it)
+        if (mVehicleStateStale || mVehicleStateChanged || mVehicle == nullptr) {
+            if (!selectStateForCurrentConditions()) {
+                ALOGE("selectStateForCurrentConditions failed so we're going to die");
+                break;
+            }
         }
 
+        // We've had the vehicle to look after while the GPU finished our last frame, so it
+        // should be ready to go out by now
+        returnPendingTarget();
+
+        // Close the cameras the last renderer left behind if nobody has wanted them for a while
+        const std::chrono::milliseconds poolTimeout = releaseIdleVideoTextures();
+
         // If we have an active renderer, give it a chance to draw
         if (mCurrentRenderer) {
+            // Redrawing the same video would only burn power, so wait until some arrives
+            // (but not so long that we miss a change in the vehicle state)
+            if (!mRedrawNeeded && !mCurrentRenderer->waitForNewFrame(kMaxFrameWait)) {
+                continue;
+            }
+
+            // Hold new video until this state's frame rate and the display vsync say it's due,
+            // but show a new state as soon as we can
+            mFramePacer.waitForFrameSlot(mRedrawNeeded);
+            mRedrawNeeded = false;
+
             // Get the output buffer we'll use to display the imagery
+            ATRACE_BEGIN("getTargetBuffer");
             BufferDesc tgtBuffer = {};
             mDisplay->getTargetBuffer([&tgtBuffer](const BufferDesc& buff) {
                                           tgtBuffer = buff;
                                       }
             );
+            ATRACE_END();
 
             if (tgtBuffer.memHandle == nullptr) {
                 ALOGE("Didn't get requested output buffer -- skipping this frame.");
@@ -191,17 +247,33 @@ void EvsStateControl::updateLoop() {
                     run = false;
                 }
 
-                // Send the finished image back for display
-                mDisplay->returnTargetBufferForDisplay(tgtBuffer);
+                // The GPU may still be working on it; it goes back for display on our next pass
+                mPendingTarget = tgtBuffer;
             }
         } else {
-            // No active renderer, so sleep until somebody wakes us with another command
+            // No active renderer, so sleep until somebody wakes us with another command (or it's
+            // time to close more of the pooled cameras)
             std::unique_lock<std::mutex> lock(mLock);
-            mWakeSignal.wait(lock);
+            if (mCommandQueue.empty()) {
+                if (poolTimeout > std::chrono::milliseconds::zero()) {
+                    mWakeSignal.wait_for(lock, poolTimeout);
+                } else {
+                    mWakeSignal.wait(lock);
+                }
+            }
         }
     }
 
     ALOGW("EvsStateControl update loop ending");
+    returnPendingTarget();
+
+    // Stop our cameras while we still have the GL context their textures belong to, rather than
+    // leave the pool holding them open until the process dies
+    if (mCurrentRenderer) {
+        mCurrentRenderer->deactivate();
+        mCurrentRenderer = nullptr;
+    }
+    releaseIdleVideoTextures(true /* releaseAll */);
 
     // TODO:  Fix it so we can exit cleanly from the main thread instead
     printf("Shutting down app due to state control loop ending\n");
@@ -210,20 +282,103 @@ void EvsStateControl::updateLoop() {
 }
 
 
+void EvsStateControl::returnPendingTarget() {
+    if (mPendingTarget.memHandle == nullptr) {
+        return;
+    }
+
+    // Send the finished image back for display
+    RenderBase::waitForRendering();
+    ATRACE_BEGIN("returnTargetBufferForDisplay");
+    mDisplay->returnTargetBufferForDisplay(mPendingTarget);
+    ATRACE_END();
+    mPendingTarget = {};
+    mFramePacer.frameDelivered();
+    updateQuality();
+}
+
+
+void EvsStateControl::updateQuality() {
+    // The reverse view is what the driver relies on, so it always gets everything we have, and
+    // its frames don't count toward what the other views can afford
+    if (mCurrentState == REVERSE || !mCurrentRenderer) {
+        return;
+    }
+
+    if (mQualityGovernor.update(mFramePacer.getLastFrameLoad(),
+                                systemTime(SYSTEM_TIME_MONOTONIC))) {
+        applyQuality(mCurrentState);
+    }
+}
+
+
+void EvsStateControl::applyQuality(State state) {
+    const QualityGovernor::Level level = (state == REVERSE) ? QualityGovernor::FULL
+                                                            : mQualityGovernor.getLevel();
+
+    RenderBase::Quality quality;
+    float frameRate = mStateFrameRate;
+    if (level >= QualityGovernor::REDUCED_RESOLUTION) {
+        quality.renderScale = kReducedRenderScale;
+    }
+    if (level >= QualityGovernor::REDUCED_REFRESH) {
+        // Half the cameras each frame, so each still gets a new frame every other one
+        quality.camerasPerFrame = std::max<unsigned>((mCameraList[state].size() + 1) / 2, 1);
+    }
+    if (level >= QualityGovernor::REDUCED_FRAME_RATE) {
+        // The manager thins out the frames it sends us to match, so the cameras' frames don't
+        // cost us anything either
+        frameRate = (frameRate > 0) ? frameRate / 2 : kReducedFrameRate;
+        quality.cameraFrameRate = static_cast<unsigned>(ceilf(frameRate));
+    }
+
+    mFramePacer.setTargetFrameRate(frameRate);
+    mCurrentRenderer->setQuality(quality);
+}
+
+
+void EvsStateControl::updateVehicleProperty(int32_t propId, int32_t value) {
+    VehiclePropValue* pCachedValue = nullptr;
+    if (propId == static_cast<int32_t>(VehicleProperty::GEAR_SELECTION)) {
+        pCachedValue = &mGearValue;
+    } else if (propId == static_cast<int32_t>(VehicleProperty::TURN_SIGNAL_STATE)) {
+        // Hearing from the turn signal means it's available after all
+        pCachedValue = &mTurnSignalValue;
+        mTurnSignalValue.prop = propId;
+    } else {
+        ALOGW("Ignoring unexpected vehicle property 0x%08X", propId);
+        return;
+    }
+
+    if (pCachedValue->value.int32Values.size() == 1 &&
+        pCachedValue->value.int32Values[0] == value) {
+        // Nothing has really changed, so there's no reason to look at our state again
+        return;
+    }
+
+    // Replace the value (rather than write through it, since it might point at a dummy)
+    pCachedValue->value.int32Values = hidl_vec<int32_t>({value});
+    mVehicleStateChanged = true;
+}
+
+
 bool EvsStateControl::selectStateForCurrentConditions() {
     static int32_t sDummyGear   = int32_t(VehicleGear::GEAR_REVERSE);
     static int32_t sDummySignal = int32_t(VehicleTurnSignal::NONE);
 
     if (mVehicle != nullptr) {
-        // Query the car state
-        if (invokeGet(&mGearValue) != StatusCode::OK) {
-            ALOGE("GEAR_SELECTION not available from vehicle.  Exiting.");
-            return false;
-        }
-        if ((mTurnSignalValue.prop == 0) || (invokeGet(&mTurnSignalValue) != StatusCode::OK)) {
-            // Silently treat missing turn signal state as no turn signal active
-            mTurnSignalValue.value.int32Values.setToExternal(&sDummySignal, 1);
-            mTurnSignalValue.prop = 0;
+        // Subscriptions keep our copy of the car state current, so we only query it to resync
+        if (mVehicleStateStale) {
+            if (invokeGet(&mGearValue) != StatusCode::OK) {
+                ALOGE("GEAR_SELECTION not available from vehicle.  Exiting.");
+                return false;
+            }
+            if ((mTurnSignalValue.prop == 0) ||
+                (invokeGet(&mTurnSignalValue) != StatusCode::OK)) {
+                // Silently treat missing turn signal state as no turn signal active
+                mTurnSignalValue.value.int32Values.setToExternal(&sDummySignal, 1);
+                mTurnSignalValue.prop = 0;
+            }
         }
     } else {
         // While testing without a vehicle, behave as if we're in reverse for the first 20 seconds
@@ -255,6 +410,9 @@ bool EvsStateControl::selectStateForCurrentConditions() {
         desiredState = PARKING;
     }
 
+    mVehicleStateStale   = false;
+    mVehicleStateChanged = false;
+
     // Apply the desire state
     return configureEvsPipeline(desiredState);
 }
@@ -286,6 +444,9 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
         return true;
     }
 
+    // The last frame we drew belongs to the old state, so let it go before it's replaced
+    returnPendingTarget();
+
     ALOGD("Switching to state %d.", desiredState);
     ALOGD("  Current state %d has %zu cameras", mCurrentState,
           mCameraList[mCurrentState].size());
@@ -318,9 +479,15 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
                 return false;
             }
         } else if (mCameraList[desiredState].size() > 1 || desiredState == PARKING) {
-            mDesiredRenderer = std::make_unique<RenderTopView>(mEvs,
-                                                               mCameraList[desiredState],
-                                                               mConfig);
+            if (mConfig.useStitchedView()) {
+                mDesiredRenderer = std::make_unique<RenderStitchedView>(mEvs,
+                                                                        mCameraList[desiredState],
+                                                                        mConfig);
+            } else {
+                mDesiredRenderer = std::make_unique<RenderTopView>(mEvs,
+                                                                   mCameraList[desiredState],
+                                                                   mConfig);
+            }
             if (!mDesiredRenderer) {
                 ALOGE("Failed to construct top view renderer.  Skipping state change.");
                 return false;
@@ -330,7 +497,10 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
                   desiredState, static_cast<unsigned int>(mCameraList[desiredState].size()));
         }
 
-        // GL renderer is now ready.
+        // GL renderer is now ready, and so is the display vsync we pace our frames to
+        if (!isGlReady) {
+            mFramePacer.enableVsync();
+        }
         isGlReady = true;
     }
 
@@ -346,6 +516,9 @@ bool EvsStateControl::configureEvsPipeline(State desiredState) {
         mDisplay->setDisplayState(DisplayState::NOT_VISIBLE);
     } else {
         mCurrentRenderer = std::move(mDesiredRenderer);
+        mRedrawNeeded = true;
+        mStateFrameRate = mConfig.getFrameRate(kStateFunctions[desiredState]);
+        applyQuality(desiredState);
 
         // Start the camera stream
         ALOGD("EvsStartCameraStreamTiming start time: %" PRId64 "ms", android::elapsedRealtime());
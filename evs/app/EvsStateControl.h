@@ -20,6 +20,8 @@
 #include "StreamHandler.h"
 #include "ConfigManager.h"
 #include "RenderBase.h"
+#include "FramePacer.h"
+#include "QualityGovernor.h"
 
 #include <android/hardware/automotive/vehicle/2.0/IVehicle.h>
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
@@ -62,6 +64,7 @@ public:
     enum class Op {
         EXIT,
         CHECK_VEHICLE_STATE,
+        VEHICLE_PROPERTY_CHANGED,   // arg1 is the property id, arg2 its new (int32) value
         TOUCH_EVENT,
     };
 
@@ -80,8 +83,12 @@ public:
 private:
     void updateLoop();
     StatusCode invokeGet(VehiclePropValue *pRequestedPropValue);
+    void updateVehicleProperty(int32_t propId, int32_t value);
     bool selectStateForCurrentConditions();
     bool configureEvsPipeline(State desiredState);  // Only call from one thread!
+    void returnPendingTarget();
+    void updateQuality();
+    void applyQuality(State state);     // To the current renderer
 
     sp<IVehicle>                mVehicle;
     sp<IEvsEnumerator>          mEvs;
@@ -90,12 +97,19 @@ private:
 
     VehiclePropValue            mGearValue;
     VehiclePropValue            mTurnSignalValue;
+    bool                        mVehicleStateStale   = true;    // Must ask the VHAL again
+    bool                        mVehicleStateChanged = true;    // Must choose our state again
 
     State                       mCurrentState = OFF;
 
     std::vector<ConfigManager::CameraInfo>  mCameraList[NUM_STATES];
     std::unique_ptr<RenderBase> mCurrentRenderer;
     std::unique_ptr<RenderBase> mDesiredRenderer;
+    bool                        mRedrawNeeded = false;  // The current renderer hasn't drawn yet
+    BufferDesc                  mPendingTarget = {};    // Drawn, but maybe not finished by the GPU
+    FramePacer                  mFramePacer;            // Decides when we draw each frame
+    QualityGovernor             mQualityGovernor;       // Decides how well we draw them
+    float                       mStateFrameRate = 0.0f; // What the config wants for this state
 
     std::thread                 mRenderThread;  // The thread that runs the main rendering loop
 
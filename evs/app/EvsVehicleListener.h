@@ -19,20 +19,26 @@
 
 #include "EvsStateControl.h"
 
+#include <map>
+
 /*
- * This class listens for asynchronous updates from the Vehicle HAL.  While the EVS
- * applications is active, it can poll the vehicle state directly.  However, when it goes to
- * sleep, we need these notifications to bring it active again.
+ * This class listens for asynchronous updates from the Vehicle HAL.  The values it is sent are
+ * passed along to the EVS application so it never has to poll the vehicle state while it runs,
+ * and so it wakes up again when it has gone to sleep.
  */
 class EvsVehicleListener : public IVehicleCallback {
 public:
     // Methods from ::android::hardware::automotive::vehicle::V2_0::IVehicleCallback follow.
-    Return<void> onPropertyEvent(const hidl_vec <VehiclePropValue> & /*values*/) override {
+    Return<void> onPropertyEvent(const hidl_vec <VehiclePropValue> & values) override {
         {
-            // Our use case is so simple, we don't actually need to update a variable,
-            // but the docs seem to say we have to take the lock anyway to keep
-            // the condition variable implementation happy.
+            // Only the latest value of each property matters, so a burst of events collapses
+            // into a single update for the state controller
             std::lock_guard<std::mutex> g(mLock);
+            for (auto&& value : values) {
+                if (value.value.int32Values.size() > 0) {
+                    mChangedValues[value.prop] = value.value.int32Values[0];
+                }
+            }
         }
         mEventCond.notify_one();
         return Return<void>();
@@ -50,31 +56,46 @@ public:
         return Return<void>();
     }
 
-    bool waitForEvents(int timeout_ms) {
+    // Returns true with the property values that changed, or false if none did before the timeout
+    bool waitForEvents(int timeout_ms, std::map<int32_t, int32_t>& changedValues) {
         std::unique_lock<std::mutex> g(mLock);
-        std::cv_status result = mEventCond.wait_for(g, std::chrono::milliseconds(timeout_ms));
-        return (result == std::cv_status::no_timeout);
+        bool changed = mEventCond.wait_for(g, std::chrono::milliseconds(timeout_ms),
+                                           [this](){ return !mChangedValues.empty(); });
+        changedValues.swap(mChangedValues);
+        mChangedValues.clear();
+        return changed;
     }
 
     void run(EvsStateControl *pStateController) {
+        std::map<int32_t, int32_t> changedValues;
         while (true) {
             // Wait until we have an event to which to react
-            // (wake up and validate our current state "just in case" every so often)
-            waitForEvents(5000);
-
-            // If we were delivered an event (or it's been a while) update as necessary
-            EvsStateControl::Command cmd = {
-                .operation = EvsStateControl::Op::CHECK_VEHICLE_STATE,
-                .arg1      = 0,
-                .arg2      = 0,
-            };
-            pStateController->postCommand(cmd);
+            if (waitForEvents(5000, changedValues)) {
+                // Hand over the new values so the state controller needn't ask for them
+                for (auto&& entry : changedValues) {
+                    EvsStateControl::Command cmd = {
+                        .operation = EvsStateControl::Op::VEHICLE_PROPERTY_CHANGED,
+                        .arg1      = static_cast<uint32_t>(entry.first),
+                        .arg2      = static_cast<uint32_t>(entry.second),
+                    };
+                    pStateController->postCommand(cmd);
+                }
+            } else {
+                // Validate our current state "just in case" every so often
+                EvsStateControl::Command cmd = {
+                    .operation = EvsStateControl::Op::CHECK_VEHICLE_STATE,
+                    .arg1      = 0,
+                    .arg2      = 0,
+                };
+                pStateController->postCommand(cmd);
+            }
         }
     }
 
 private:
     std::mutex mLock;
     std::condition_variable mEventCond;
+    std::map<int32_t, int32_t> mChangedValues;  // Latest value of each property, by property id
 };
 
 #endif //CAR_EVS_APP_VEHICLELISTENER_H
@@ -16,6 +16,19 @@
 
 #include "FormatConvert.h"
 
+#include <string.h>
+
+#include <algorithm>
+
+#include "YuvConvert.h"
+
+using ::android::automotive::evs::support::ChromaOffsets;
+using ::android::automotive::evs::support::chromaOffsets;
+using ::android::automotive::evs::support::rgbaFromNv21Rows;
+using ::android::automotive::evs::support::rgbaFromYuyvRow;
+using ::android::automotive::evs::support::rgbaFromYv12Rows;
+using ::android::automotive::evs::support::rgbxFromY;
+
 
 // Round up to the nearest multiple of the given alignment value
 template<unsigned alignment>
@@ -28,38 +41,10 @@ int align(int value) {
 }
 
 
-// Limit the given value to the provided range.  :)
-static inline float clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
-}
-
-
-static uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
-
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
-
-    return (R      ) |
-           (G <<  8) |
-           (B << 16) |
-           0xFF000000;  // Fill the alpha channel with ones
-}
-
-
 void copyNV21toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels)
+                     uint32_t* dst, unsigned dstStridePixels,
+                     unsigned firstRow, unsigned numRows)
 {
     // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleaved
     // U/V array.  It assumes an even width and height for the overall image, and a horizontal
@@ -72,17 +57,33 @@ void copyNV21toRGB32(unsigned width, unsigned height,
     uint8_t* srcY = src;
     uint8_t* srcUV = src+offsetUV;
 
-    for (unsigned r = 0; r < height; r++) {
-        // Note that we're walking the same UV row twice for even/odd luminance rows
-        uint8_t* rowY  = srcY  + r*strideLum;
-        uint8_t* rowUV = srcUV + (r/2 * strideColor);
+    // We work on a pair of rows at a time, since they share their chroma samples
+    const unsigned lastRow = std::min(firstRow + numRows, height);
+    for (unsigned r = firstRow; r < lastRow; r += 2) {
+        // An odd last row is simply converted twice
+        const unsigned rBot = (r + 1 < lastRow) ? r + 1 : r;
+        uint8_t* rowYTop = srcY  + r*strideLum;
+        uint8_t* rowYBot = srcY  + rBot*strideLum;
+        uint8_t* rowUV   = srcUV + (r/2 * strideColor);
+
+        uint32_t* rowDestTop = dst + r*dstStridePixels;
+        uint32_t* rowDestBot = dst + rBot*dstStridePixels;
 
-        uint32_t* rowDest = dst + r*dstStridePixels;
+        const unsigned vectorPixels = rgbaFromNv21Rows(rowYTop, rowYBot, rowUV,
+                                                       (uint8_t*)rowDestTop, (uint8_t*)rowDestBot,
+                                                       width);
 
-        for (unsigned c = 0; c < width; c++) {
-            unsigned uCol = (c & ~1);   // uCol is always even and repeats 1:2 with Y values
+        for (unsigned c = vectorPixels; c < width; c += 2) {
+            unsigned uCol = c;          // uCol is always even and repeats 1:2 with Y values
             unsigned vCol = uCol | 1;   // vCol is always odd
-            rowDest[c] = yuvToRgbx(rowY[c], rowUV[uCol], rowUV[vCol]);
+            const ChromaOffsets offsets = chromaOffsets(rowUV[uCol], rowUV[vCol]);
+
+            rowDestTop[c] = rgbxFromY(rowYTop[c], offsets);
+            rowDestBot[c] = rgbxFromY(rowYBot[c], offsets);
+            if (c + 1 < width) {
+                rowDestTop[c+1] = rgbxFromY(rowYTop[c+1], offsets);
+                rowDestBot[c+1] = rgbxFromY(rowYBot[c+1], offsets);
+            }
         }
     }
 }
@@ -90,7 +91,8 @@ void copyNV21toRGB32(unsigned width, unsigned height,
 
 void copyYV12toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels)
+                     uint32_t* dst, unsigned dstStridePixels,
+                     unsigned firstRow, unsigned numRows)
 {
     // The YV12 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 U array, followed
     // by another 1/2 x 1/2 V array.  It assumes an even width and height for the overall image,
@@ -107,16 +109,33 @@ void copyYV12toRGB32(unsigned width, unsigned height,
     uint8_t* srcU = src+offsetU;
     uint8_t* srcV = src+offsetV;
 
-    for (unsigned r = 0; r < height; r++) {
-        // Note that we're walking the same U and V rows twice for even/odd luminance rows
-        uint8_t* rowY = srcY + r*strideLum;
-        uint8_t* rowU = srcU + (r/2 * strideColor);
-        uint8_t* rowV = srcV + (r/2 * strideColor);
-
-        uint32_t* rowDest = dst + r*dstStridePixels;
-
-        for (unsigned c = 0; c < width; c++) {
-            rowDest[c] = yuvToRgbx(rowY[c], rowU[c], rowV[c]);
+    // We work on a pair of rows at a time, since they share their chroma samples
+    const unsigned lastRow = std::min(firstRow + numRows, height);
+    for (unsigned r = firstRow; r < lastRow; r += 2) {
+        // An odd last row is simply converted twice
+        const unsigned rBot = (r + 1 < lastRow) ? r + 1 : r;
+        uint8_t* rowYTop = srcY + r*strideLum;
+        uint8_t* rowYBot = srcY + rBot*strideLum;
+        uint8_t* rowU    = srcU + (r/2 * strideColor);
+        uint8_t* rowV    = srcV + (r/2 * strideColor);
+
+        uint32_t* rowDestTop = dst + r*dstStridePixels;
+        uint32_t* rowDestBot = dst + rBot*dstStridePixels;
+
+        const unsigned vectorPixels = rgbaFromYv12Rows(rowYTop, rowYBot, rowU, rowV,
+                                                       (uint8_t*)rowDestTop, (uint8_t*)rowDestBot,
+                                                       width);
+
+        for (unsigned c = vectorPixels; c < width; c += 2) {
+            // Each chroma sample covers two columns
+            const ChromaOffsets offsets = chromaOffsets(rowU[c/2], rowV[c/2]);
+
+            rowDestTop[c] = rgbxFromY(rowYTop[c], offsets);
+            rowDestBot[c] = rgbxFromY(rowYBot[c], offsets);
+            if (c + 1 < width) {
+                rowDestTop[c+1] = rgbxFromY(rowYTop[c+1], offsets);
+                rowDestBot[c+1] = rgbxFromY(rowYBot[c+1], offsets);
+            }
         }
     }
 }
@@ -124,15 +143,22 @@ void copyYV12toRGB32(unsigned width, unsigned height,
 
 void copyYUYVtoRGB32(unsigned width, unsigned height,
                      uint8_t* src, unsigned srcStridePixels,
-                     uint32_t* dst, unsigned dstStridePixels)
+                     uint32_t* dst, unsigned dstStridePixels,
+                     unsigned firstRow, unsigned numRows)
 {
-    uint32_t* srcWords = (uint32_t*)src;
+    uint32_t* srcWords = (uint32_t*)src + firstRow * srcStridePixels/2;
+    dst += firstRow * dstStridePixels;
+    const unsigned lastRow = std::min(firstRow + numRows, height);
 
     const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
     const int dstRowPadding32 = dstStridePixels   - width;    // 4 bytes per pixel, 4 bytes per word
 
-    for (unsigned r = 0; r < height; r++) {
-        for (unsigned c = 0; c < width/2; c++) {
+    for (unsigned r = firstRow; r < lastRow; r++) {
+        const unsigned vectorPixels = rgbaFromYuyvRow((uint8_t*)srcWords, (uint8_t*)dst, width);
+        srcWords += vectorPixels/2;
+        dst += vectorPixels;
+
+        for (unsigned c = vectorPixels/2; c < width/2; c++) {
             // Note:  we're walking two pixels at a time here (even/odd)
             uint32_t srcPixel = *srcWords++;
 
@@ -142,8 +168,9 @@ void copyYUYVtoRGB32(unsigned width, unsigned height,
             uint8_t V  = (srcPixel >> 24) & 0xFF;
 
             // On the RGB output, we're writing one pixel at a time
-            *(dst+0) = yuvToRgbx(Y1, U, V);
-            *(dst+1) = yuvToRgbx(Y2, U, V);
+            const ChromaOffsets offsets = chromaOffsets(U, V);
+            *(dst+0) = rgbxFromY(Y1, offsets);
+            *(dst+1) = rgbxFromY(Y2, offsets);
             dst += 2;
         }
 
@@ -157,8 +184,12 @@ void copyYUYVtoRGB32(unsigned width, unsigned height,
 void copyMatchedInterleavedFormats(unsigned width, unsigned height,
                                    void* src, unsigned srcStridePixels,
                                    void* dst, unsigned dstStridePixels,
-                                   unsigned pixelSize) {
-    for (unsigned row = 0; row < height; row++) {
+                                   unsigned pixelSize,
+                                   unsigned firstRow, unsigned numRows) {
+    src = (uint8_t*)src + firstRow * srcStridePixels * pixelSize;
+    dst = (uint8_t*)dst + firstRow * dstStridePixels * pixelSize;
+    const unsigned lastRow = std::min(firstRow + numRows, height);
+    for (unsigned row = firstRow; row < lastRow; row++) {
         // Copy the entire row of pixel data
         memcpy(dst, src, width * pixelSize);
 
@@ -21,13 +21,19 @@
 #include <stdint.h>
 
 
+// Each of these converts the rows [firstRow, firstRow + numRows) of an image of the given height,
+// so a frame can be split into bands converted in parallel.  Bands of the 4:2:0 formats must
+// start on an even row, since each pair of rows shares its chroma samples.
+
+
 // Given an image buffer in NV21 format (HAL_PIXEL_FORMAT_YCRCB_420_SP), output 32bit RGBx values.
 // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleaved
 // U/V array.  It assumes an even width and height for the overall image, and a horizontal
 // stride that is an even multiple of 16 bytes for both the Y and UV arrays.
 void copyNV21toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels);
+                     uint32_t* dst, unsigned dstStridePixels,
+                     unsigned firstRow, unsigned numRows);
 
 
 // Given an image buffer in YV12 format (HAL_PIXEL_FORMAT_YV12), output 32bit RGBx values.
@@ -37,7 +43,8 @@ void copyNV21toRGB32(unsigned width, unsigned height,
 // and V arrays.
 void copyYV12toRGB32(unsigned width, unsigned height,
                      uint8_t* src,
-                     uint32_t* dst, unsigned dstStridePixels);
+                     uint32_t* dst, unsigned dstStridePixels,
+                     unsigned firstRow, unsigned numRows);
 
 
 // Given an image buffer in YUYV format (HAL_PIXEL_FORMAT_YCBCR_422_I), output 32bit RGBx values.
@@ -46,7 +53,8 @@ void copyYV12toRGB32(unsigned width, unsigned height,
 // stride that is an even multiple of 16 bytes for both the Y and UV arrays.
 void copyYUYVtoRGB32(unsigned width, unsigned height,
                      uint8_t* src, unsigned srcStrideBytes,
-                     uint32_t* dst, unsigned dstStrideBytes);
+                     uint32_t* dst, unsigned dstStrideBytes,
+                     unsigned firstRow, unsigned numRows);
 
 
 // Given an simple rectangular image buffer with an integer number of bytes per pixel,
@@ -55,6 +63,7 @@ void copyYUYVtoRGB32(unsigned width, unsigned height,
 void copyMatchedInterleavedFormats(unsigned width, unsigned height,
                                    void* src, unsigned srcStridePixels,
                                    void* dst, unsigned dstStridePixels,
-                                   unsigned pixelSize);
+                                   unsigned pixelSize,
+                                   unsigned firstRow, unsigned numRows);
 
 #endif // EVS_VTS_FORMATCONVERT_H
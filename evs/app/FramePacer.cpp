@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FramePacer.h"
+
+#include <inttypes.h>
+#include <poll.h>
+
+#include <algorithm>
+#include <thread>
+
+#include <gui/SurfaceComposerClient.h>
+#include <log/log.h>
+#include <ui/DisplayInfo.h>
+#include <utils/Trace.h>
+
+using namespace android;
+
+
+// If a vsync doesn't arrive within a few refresh periods, we go ahead without it
+static const int kMaxVsyncWaitMs = 50;
+
+// How often we log how many frames missed their deadlines
+static const nsecs_t kReportInterval = s2ns(10);
+
+
+void FramePacer::setTargetFrameRate(float framesPerSecond) {
+    mFrameInterval = (framesPerSecond > 0) ? nsecs_t(1e9f / framesPerSecond) : 0;
+    mNextSlot = 0;
+}
+
+
+bool FramePacer::enableVsync() {
+    if (mVsyncReceiver) {
+        // Already done
+        return true;
+    }
+
+    std::unique_ptr<DisplayEventReceiver> receiver = std::make_unique<DisplayEventReceiver>();
+    if (receiver->initCheck() != NO_ERROR) {
+        ALOGW("No display vsync available, so frames will be paced by the clock alone");
+        return false;
+    }
+
+    // We ask for each vsync as we need it rather than have them stream to us continuously
+    receiver->setVsyncRate(0);
+
+    sp<IBinder> mainDpy = SurfaceComposerClient::getInternalDisplayToken();
+    DisplayInfo mainDpyInfo;
+    if (mainDpy != nullptr &&
+        SurfaceComposerClient::getDisplayInfo(mainDpy, &mainDpyInfo) == NO_ERROR &&
+        mainDpyInfo.fps > 0) {
+        mVsyncPeriod = nsecs_t(1e9f / mainDpyInfo.fps);
+    }
+    ALOGI("Pacing frames to the display vsync every %" PRId64 "us",
+          nanoseconds_to_microseconds(mVsyncPeriod));
+
+    mVsyncReceiver = std::move(receiver);
+    return true;
+}
+
+
+void FramePacer::waitForFrameSlot(bool immediate) {
+    nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (!immediate) {
+        ATRACE_NAME("FramePacer::waitForFrameSlot");
+
+        // Hold back until the target frame rate allows another frame, leaving the last moments
+        // of the wait to the vsync (when we have one) so we don't miss it by a hair
+        const nsecs_t wakeTime = mVsyncReceiver ? mNextSlot - mVsyncPeriod / 2 : mNextSlot;
+        if (now < wakeTime) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(wakeTime - now));
+        }
+
+        // Start right after a vsync so the frame has as long as possible to get to the display
+        const nsecs_t vsyncTime = mVsyncReceiver ? waitForVsync() : 0;
+        now = (vsyncTime > 0) ? vsyncTime : systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
+    // The next slot is counted from this one, so frames don't drift off the vsync, but we don't
+    // try to catch up on slots we've already missed
+    mNextSlot = now + mFrameInterval;
+    mSlotStart = now;
+    mDeadline = now + std::max(mFrameInterval, mVsyncPeriod);
+}
+
+
+void FramePacer::frameDelivered() {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    mFrameCount++;
+    if (mDeadline > mSlotStart) {
+        mLastFrameLoad = float(now - mSlotStart) / float(mDeadline - mSlotStart);
+    }
+    if (now > mDeadline) {
+        mMissedCount++;
+        mTotalMissed++;
+        ATRACE_INT("EvsMissedFrames", mTotalMissed);
+    }
+
+    reportStats(now);
+}
+
+
+nsecs_t FramePacer::waitForVsync() {
+    // Drop anything left over from before, then ask for the next one
+    DisplayEventReceiver::Event events[8];
+    while (mVsyncReceiver->getEvents(events, 8) > 0) {}
+    mVsyncReceiver->requestNextVsync();
+
+    nsecs_t vsyncTime = 0;
+    struct pollfd fds = { .fd = mVsyncReceiver->getFd(), .events = POLLIN, .revents = 0 };
+    if (poll(&fds, 1, kMaxVsyncWaitMs) > 0) {
+        ssize_t count;
+        while ((count = mVsyncReceiver->getEvents(events, 8)) > 0) {
+            for (ssize_t i = 0; i < count; i++) {
+                if (events[i].header.type == DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                    vsyncTime = events[i].header.timestamp;
+                }
+            }
+        }
+    }
+    return vsyncTime;
+}
+
+
+void FramePacer::reportStats(nsecs_t now) {
+    if (mReportTime == 0) {
+        mReportTime = now;
+        return;
+    }
+    if (now - mReportTime < kReportInterval) {
+        return;
+    }
+
+    if (mMissedCount > 0) {
+        ALOGI("%u of %u frames missed their display deadline in the last %" PRId64 "ms "
+              "(%u in total)", mMissedCount, mFrameCount,
+              nanoseconds_to_milliseconds(now - mReportTime), mTotalMissed);
+    }
+    mReportTime  = now;
+    mFrameCount  = 0;
+    mMissedCount = 0;
+}
@@ -0,0 +1,70 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_EVS_APP_FRAMEPACER_H
+#define CAR_EVS_APP_FRAMEPACER_H
+
+#include <gui/DisplayEventReceiver.h>
+#include <utils/Timers.h>
+
+#include <memory>
+
+
+/*
+ * Decides when the update loop should start drawing each frame.  Frames are held back to the
+ * target frame rate of the current state, and once SurfaceFlinger is up they're started on a
+ * display vsync so each one has a full refresh period to reach the screen.  It also counts the
+ * frames that didn't make it in time.
+ */
+class FramePacer {
+public:
+    // Frames are drawn no faster than this, or as fast as video arrives if it is 0
+    void setTargetFrameRate(float framesPerSecond);
+
+    // Starts aligning frames with the display vsync.  Only call once SurfaceFlinger is running.
+    bool enableVsync();
+
+    // Blocks until it's time to start drawing the next frame, unless it's wanted immediately
+    void waitForFrameSlot(bool immediate);
+
+    // Records that the frame started by the last waitForFrameSlot() went out for display
+    void frameDelivered();
+
+    // How long that frame took to draw relative to the time it had, so 1.0 used all of it
+    float getLastFrameLoad() const  { return mLastFrameLoad; };
+
+private:
+    nsecs_t waitForVsync();
+    void reportStats(nsecs_t now);
+
+    std::unique_ptr<android::DisplayEventReceiver>  mVsyncReceiver;
+    nsecs_t     mVsyncPeriod    = 16666667;     // Assume 60Hz until the display tells us
+    nsecs_t     mFrameInterval  = 0;            // No faster than this between frames
+
+    nsecs_t     mNextSlot       = 0;    // The soonest the next frame may start
+    nsecs_t     mSlotStart      = 0;    // When the current frame started
+    nsecs_t     mDeadline       = 0;    // When the current frame should be on its way out
+    float       mLastFrameLoad  = 0.0f;
+
+    // Statistics, reported now and then
+    nsecs_t     mReportTime     = 0;
+    unsigned    mFrameCount     = 0;
+    unsigned    mMissedCount    = 0;
+    unsigned    mTotalMissed    = 0;
+};
+
+
+#endif //CAR_EVS_APP_FRAMEPACER_H
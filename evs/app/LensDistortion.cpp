@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "LensDistortion.h"
+
+#include <math.h>
+
+
+android::vec2 distortTexCoord(const ConfigManager::CameraInfo& cam, const android::vec2& ideal) {
+    if (!cam.hasDistortion()) {
+        return ideal;
+    }
+
+    // The ray the ideal camera sees at this point, in focal lengths from the optical axis
+    const float x = (ideal.x - 0.5f) * 2.0f * tanf(cam.hfov * 0.5f);
+    const float y = (ideal.y - 0.5f) * 2.0f * tanf(cam.vfov * 0.5f);
+    const float r = sqrtf(x * x + y * y);
+
+    // The lens puts it at a distance from the optical center that goes with the ray's angle off
+    // the axis rather than the tangent of that angle (see CameraInfo::distortion)
+    float scale = 1.0f;
+    if (r > 1e-6f) {
+        const float theta = atanf(r);
+        const float t2 = theta * theta;
+        const float* k = cam.distortion;
+        const float thetaD = theta * (1.0f + t2 * (k[0] + t2 * (k[1] + t2 * (k[2] + t2 * k[3]))));
+        scale = thetaD / r;
+    }
+
+    return android::vec2(cam.opticalCenter[0] + cam.focalLength[0] * x * scale,
+                         cam.opticalCenter[1] + cam.focalLength[1] * y * scale);
+}
+
+
+void buildWarpMesh(ConfigManager::CameraInfo& cam) {
+    cam.warpMesh.clear();
+    if (!cam.hasDistortion()) {
+        return;
+    }
+
+    cam.warpMesh.reserve((kWarpMeshColumns + 1) * (kWarpMeshRows + 1) * 4);
+    for (unsigned row = 0; row <= kWarpMeshRows; row++) {
+        for (unsigned col = 0; col <= kWarpMeshColumns; col++) {
+            const android::vec2 ideal((float)col / kWarpMeshColumns, (float)row / kWarpMeshRows);
+            const android::vec2 actual = distortTexCoord(cam, ideal);
+            cam.warpMesh.insert(cam.warpMesh.end(), { ideal.x, ideal.y, actual.x, actual.y });
+        }
+    }
+}
+
+
+std::vector<uint16_t> getWarpMeshIndices() {
+    std::vector<uint16_t> indices;
+    indices.reserve(kWarpMeshColumns * kWarpMeshRows * 6);
+    const unsigned stride = kWarpMeshColumns + 1;
+    for (unsigned row = 0; row < kWarpMeshRows; row++) {
+        for (unsigned col = 0; col < kWarpMeshColumns; col++) {
+            const uint16_t topLeft = row * stride + col;
+            const uint16_t bottomLeft = topLeft + stride;
+            indices.insert(indices.end(), { topLeft, bottomLeft, (uint16_t)(topLeft + 1),
+                                            (uint16_t)(topLeft + 1), bottomLeft,
+                                            (uint16_t)(bottomLeft + 1) });
+        }
+    }
+    return indices;
+}
@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef CAR_EVS_APP_LENSDISTORTION_H
+#define CAR_EVS_APP_LENSDISTORTION_H
+
+#include "ConfigManager.h"
+
+#include <math/vec2.h>
+
+#include <stdint.h>
+#include <vector>
+
+
+// How finely a warp mesh samples the image.  Lens distortion is smooth enough that interpolating
+// linearly between vertices this far apart stays well within a pixel.
+static const unsigned kWarpMeshColumns = 32;
+static const unsigned kWarpMeshRows    = 24;
+
+
+// Where the lens actually puts what an ideal pinhole camera covering the camera's hfov x vfov
+// would see at the given texture coordinates.  Cameras without distortion parameters give back
+// the coordinates unchanged.
+android::vec2 distortTexCoord(const ConfigManager::CameraInfo& cam, const android::vec2& ideal);
+
+// Fills in cam.warpMesh from its distortion parameters, or empties it if it has none
+void buildWarpMesh(ConfigManager::CameraInfo& cam);
+
+// Triangles covering the warp mesh grid, as indices into its vertices
+std::vector<uint16_t> getWarpMeshIndices();
+
+
+#endif //CAR_EVS_APP_LENSDISTORTION_H
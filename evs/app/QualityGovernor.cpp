@@ -0,0 +1,211 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "QualityGovernor.h"
+
+#include <algorithm>
+
+#include <log/log.h>
+#include <utils/Trace.h>
+
+using ::android::hardware::hidl_vec;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::hardware::thermal::V1_0::ThermalStatus;
+using ::android::hardware::thermal::V1_0::ThermalStatusCode;
+using ::android::hardware::thermal::V2_0::IThermal;
+using ::android::hardware::thermal::V2_0::IThermalChangedCallback;
+using ::android::hardware::thermal::V2_0::Temperature;
+using ::android::hardware::thermal::V2_0::TemperatureType;
+using ::android::hardware::thermal::V2_0::ThrottlingSeverity;
+
+
+// How quickly the average frame load follows the latest frames (the weight of each new one)
+static const float kLoadSmoothing = 0.1f;
+
+// An average over this is running out of time for its frames, and under this has room to spare
+static const float kOverloadThreshold = 0.9f;
+static const float kHeadroomThreshold = 0.6f;
+
+// How long we put up with running over budget before giving up some quality
+static const nsecs_t kStepDownTime = ms2ns(1000);
+
+// How long we need headroom for before taking a stage of quality back, which doubles each time
+// a stage doesn't hold up
+static const nsecs_t kMinStepUpDelay = s2ns(5);
+static const nsecs_t kMaxStepUpDelay = s2ns(60);
+
+
+// The thermal HAL holds on to this, and may call it on a binder thread even while or after we
+// unregister it, so it only reaches the governor until the governor detaches it
+class QualityGovernor::ThermalListener : public IThermalChangedCallback {
+public:
+    explicit ThermalListener(QualityGovernor* governor) : mGovernor(governor) {};
+
+    Return<void> notifyThrottling(const Temperature& temperature) override {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mGovernor != nullptr) {
+            mGovernor->updateSeverity(temperature.name, temperature.throttlingStatus);
+        }
+        return Void();
+    }
+
+    // Once this returns, no call reaches the governor
+    void detach() {
+        std::lock_guard<std::mutex> lock(mLock);
+        mGovernor = nullptr;
+    }
+
+private:
+    std::mutex          mLock;      // Held for as long as a call uses mGovernor
+    QualityGovernor*    mGovernor;
+};
+
+
+QualityGovernor::~QualityGovernor() {
+    if (mThermalListener != nullptr) {
+        mThermalListener->detach();
+        if (mThermal != nullptr) {
+            mThermal->unregisterThermalChangedCallback(mThermalListener, [](ThermalStatus) {});
+        }
+    }
+}
+
+
+bool QualityGovernor::startThermalMonitoring() {
+    mThermal = IThermal::tryGetService();
+    if (mThermal == nullptr) {
+        ALOGW("No thermal HAL, so image quality will follow frame times alone");
+        return false;
+    }
+
+    // Listen first, so no change can slip by between reading where things stand and listening
+    mThermalListener = new ThermalListener(this);
+    bool registered = false;
+    Return<void> result = mThermal->registerThermalChangedCallback(
+            mThermalListener, false /* filterType */, TemperatureType::UNKNOWN,
+            [&registered](ThermalStatus status) {
+                registered = (status.code == ThermalStatusCode::SUCCESS);
+            });
+    if (!result.isOk() || !registered) {
+        ALOGW("Failed to listen for thermal changes, so image quality will follow frame times "
+              "alone");
+        mThermalListener->detach();
+        mThermalListener = nullptr;
+        mThermal = nullptr;
+        return false;
+    }
+
+    mThermal->getCurrentTemperatures(false /* filterType */, TemperatureType::UNKNOWN,
+                                     [this](ThermalStatus status,
+                                            const hidl_vec<Temperature>& temperatures) {
+                                         if (status.code != ThermalStatusCode::SUCCESS) {
+                                             return;
+                                         }
+                                         for (auto&& temperature : temperatures) {
+                                             updateSeverity(temperature.name,
+                                                            temperature.throttlingStatus);
+                                         }
+                                     });
+    return true;
+}
+
+
+bool QualityGovernor::update(float frameLoad, nsecs_t now) {
+    mAverageLoad += (frameLoad - mAverageLoad) * kLoadSmoothing;
+
+    // A stage that has held up for long enough has shown it can, so the next one gets the
+    // benefit of the doubt again
+    if (mStepUpDelay == 0 || (mLastStepUp != 0 && now - mLastStepUp > kMaxStepUpDelay)) {
+        mStepUpDelay = kMinStepUpDelay;
+    }
+
+    // Stages only the heat called for can come back as soon as we aren't over budget, while
+    // those we took for running over need proper headroom
+    const Level floor = getThermalFloor();
+    const float headroom = (mLevel > mLoadLevel) ? kOverloadThreshold : kHeadroomThreshold;
+
+    Level level = mLevel;
+    if (level < floor) {
+        level = floor;
+        mOverloadSince = mHeadroomSince = 0;
+    } else if (mAverageLoad > kOverloadThreshold) {
+        mHeadroomSince = 0;
+        if (mOverloadSince == 0) {
+            mOverloadSince = now;
+        } else if (now - mOverloadSince >= kStepDownTime && level + 1 < NUM_LEVELS) {
+            level = static_cast<Level>(level + 1);
+            mLoadLevel = level;
+            mOverloadSince = 0;
+            if (now - mLastStepUp < mStepUpDelay) {
+                // We had only just come back to the stage we're leaving
+                mStepUpDelay = std::min(mStepUpDelay * 2, kMaxStepUpDelay);
+            }
+        }
+    } else if (mAverageLoad < headroom && level > floor) {
+        mOverloadSince = 0;
+        if (mHeadroomSince == 0) {
+            mHeadroomSince = now;
+        } else if (now - mHeadroomSince >= mStepUpDelay) {
+            level = static_cast<Level>(level - 1);
+            mLoadLevel = std::min(mLoadLevel, level);
+            mHeadroomSince = 0;
+            mLastStepUp = now;
+        }
+    } else {
+        mOverloadSince = mHeadroomSince = 0;
+    }
+
+    if (level == mLevel) {
+        return false;
+    }
+
+    ALOGI("Image quality level %d -> %d (frame load %.2f, thermal severity %d)",
+          mLevel, level, mAverageLoad, mWorstSeverity.load());
+    ATRACE_INT("EvsQualityLevel", level);
+    mLevel = level;
+    return true;
+}
+
+
+void QualityGovernor::updateSeverity(const std::string& sensor, ThrottlingSeverity severity) {
+    std::lock_guard<std::mutex> lock(mThermalLock);
+    mSeverities[sensor] = severity;
+
+    ThrottlingSeverity worst = ThrottlingSeverity::NONE;
+    for (auto&& entry : mSeverities) {
+        worst = std::max(worst, entry.second);
+    }
+    if (static_cast<int>(worst) != mWorstSeverity.exchange(static_cast<int>(worst))) {
+        ALOGI("Thermal throttling severity is now %d", static_cast<int>(worst));
+    }
+}
+
+
+QualityGovernor::Level QualityGovernor::getThermalFloor() const {
+    switch (static_cast<ThrottlingSeverity>(mWorstSeverity.load())) {
+    case ThrottlingSeverity::NONE:
+    case ThrottlingSeverity::LIGHT:
+        return FULL;
+    case ThrottlingSeverity::MODERATE:
+        return REDUCED_RESOLUTION;
+    case ThrottlingSeverity::SEVERE:
+        return REDUCED_REFRESH;
+    default:
+        // CRITICAL and beyond
+        return REDUCED_FRAME_RATE;
+    }
+}
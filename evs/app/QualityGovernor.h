@@ -0,0 +1,86 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_EVS_APP_QUALITYGOVERNOR_H
+#define CAR_EVS_APP_QUALITYGOVERNOR_H
+
+#include <android/hardware/thermal/2.0/IThermal.h>
+#include <android/hardware/thermal/2.0/IThermalChangedCallback.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+/*
+ * Decides how much image quality we can afford, from how hot the thermal HAL says we are and
+ * how much of each frame's time budget drawing it takes.  Quality drops a stage as soon as the
+ * thermal status calls for it, or once frames have been running over budget for a while, and
+ * comes back a stage at a time once there's been headroom for longer.  A stage we came back to
+ * only to leave again soon waits longer before we try it the next time.
+ *
+ * Only the update loop calls update(), while thermal changes arrive on a binder thread.
+ */
+class QualityGovernor {
+public:
+    // Each stage keeps the reductions of those before it
+    enum Level {
+        FULL = 0,
+        REDUCED_RESOLUTION,     // The top view draws below the display's resolution
+        REDUCED_REFRESH,        // The top view takes new frames from only some cameras each frame
+        REDUCED_FRAME_RATE,     // We draw, and ask the cameras for, fewer frames per second
+        NUM_LEVELS  // Must come last
+    };
+
+    ~QualityGovernor();
+
+    // Starts following the thermal HAL, if there is one.  Without it we go by frame times alone.
+    bool startThermalMonitoring();
+
+    // Takes how long the last frame took relative to its budget (1.0 being all of it), and
+    // returns true if the level changed as a result
+    bool update(float frameLoad, nsecs_t now);
+
+    Level getLevel() const  { return mLevel; };
+
+private:
+    class ThermalListener;
+    void updateSeverity(const std::string& sensor,
+                        ::android::hardware::thermal::V2_0::ThrottlingSeverity severity);
+    Level getThermalFloor() const;
+
+    Level       mLevel          = FULL;
+    Level       mLoadLevel      = FULL; // The level frame times alone have called for
+    float       mAverageLoad    = 0.0f;
+    nsecs_t     mOverloadSince  = 0;    // When the average last went over budget, or 0
+    nsecs_t     mHeadroomSince  = 0;    // When the average last dropped well below it, or 0
+    nsecs_t     mLastStepUp     = 0;
+    nsecs_t     mStepUpDelay    = 0;    // How long we need headroom for before stepping back up
+
+    ::android::sp<::android::hardware::thermal::V2_0::IThermal> mThermal;
+    ::android::sp<ThermalListener>                              mThermalListener;
+
+    // The thermal HAL reports per sensor, so we keep the worst of them
+    std::mutex                                                  mThermalLock;
+    std::map<std::string, ::android::hardware::thermal::V2_0::ThrottlingSeverity>
+                                                                mSeverities;
+    std::atomic<int>                                            mWorstSeverity {0};
+};
+
+
+#endif //CAR_EVS_APP_QUALITYGOVERNOR_H
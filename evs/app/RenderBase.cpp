@@ -19,6 +19,7 @@
 
 #include <log/log.h>
 #include <ui/GraphicBuffer.h>
+#include <utils/Trace.h>
 
 // Eventually we shouldn't need this dependency, but for now the
 // graphics allocator interface isn't fully supported on all platforms
@@ -30,10 +31,13 @@ using ::android::GraphicBuffer;
 EGLDisplay   RenderBase::sDisplay = EGL_NO_DISPLAY;
 EGLContext   RenderBase::sContext = EGL_NO_CONTEXT;
 EGLSurface   RenderBase::sDummySurface = EGL_NO_SURFACE;
-GLuint       RenderBase::sFrameBuffer = -1;
-GLuint       RenderBase::sColorBuffer = -1;
+EGLConfig    RenderBase::sConfig = nullptr;
 GLuint       RenderBase::sDepthBuffer = -1;
-EGLImageKHR  RenderBase::sKHRimage = EGL_NO_IMAGE_KHR;
+// Comfortably more buffers than a display cycles through (the sample driver allows up to 8)
+static const size_t kMaxRenderTargets = 16;
+::android::automotive::evs::support::BufferCache<RenderBase::RenderTarget>
+             RenderBase::sRenderTargets(kMaxRenderTargets);
+EGLSyncKHR   RenderBase::sRenderFence = EGL_NO_SYNC_KHR;
 unsigned     RenderBase::sWidth  = 0;
 unsigned     RenderBase::sHeight = 0;
 float        RenderBase::sAspectRatio = 0.0f;
@@ -121,23 +125,53 @@ bool RenderBase::prepareGL() {
     ALOGI("GL EXTENSIONS:\n  %s", gl_extensions);
 
 
-    // Reserve handles for the color and depth targets we'll be setting up
-    glGenRenderbuffers(1, &sColorBuffer);
+    // Reserve a handle for the depth target we'll be setting up.  Each target buffer gets its
+    // own color buffer and frame buffer object when we first see it.
     glGenRenderbuffers(1, &sDepthBuffer);
 
-    // Set up the frame buffer object we can modify and use for off screen rendering
-    glGenFramebuffers(1, &sFrameBuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, sFrameBuffer);
-
 
     // Now that we're assured success, store object handles we constructed
     sDisplay = display;
     sContext = context;
+    sConfig  = egl_config;
+
+    return true;
+}
+
+
+bool RenderBase::attachSharedContext(EGLContext& context, EGLSurface& surface) {
+    const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    const EGLint surface_attribs[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+
+    // Like our own, this context never draws to its surface, but needs one to be current
+    surface = eglCreatePbufferSurface(sDisplay, sConfig, surface_attribs);
+    if (surface == EGL_NO_SURFACE) {
+        ALOGE("Failed to create a surface for a shared context: %s", getEGLError());
+        return false;
+    }
+    context = eglCreateContext(sDisplay, sConfig, sContext, context_attribs);
+    if (context == EGL_NO_CONTEXT) {
+        ALOGE("Failed to create a shared context: %s", getEGLError());
+        eglDestroySurface(sDisplay, surface);
+        return false;
+    }
+    if (!eglMakeCurrent(sDisplay, surface, surface, context)) {
+        ALOGE("Failed to make a shared context current: %s", getEGLError());
+        releaseSharedContext(context, surface);
+        return false;
+    }
 
     return true;
 }
 
 
+void RenderBase::releaseSharedContext(EGLContext context, EGLSurface surface) {
+    eglMakeCurrent(sDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(sDisplay, context);
+    eglDestroySurface(sDisplay, surface);
+}
+
+
 bool RenderBase::attachRenderTarget(const BufferDesc& tgtBuffer) {
     // Hardcoded to RGBx for now
     if (tgtBuffer.format != HAL_PIXEL_FORMAT_RGBA_8888) {
@@ -145,73 +179,151 @@ bool RenderBase::attachRenderTarget(const BufferDesc& tgtBuffer) {
         return false;
     }
 
+    RenderTarget* target = findRenderTarget(tgtBuffer);
+    if (target == nullptr) {
+        return false;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, target->frameBuffer);
+
+    // Store the size of our target buffer
+    sWidth = tgtBuffer.width;
+    sHeight = tgtBuffer.height;
+    sAspectRatio = (float)sWidth / sHeight;
+
+    // Set the viewport
+    glViewport(0, 0, sWidth, sHeight);
+
+#if 1   // We don't actually need the clear if we're going to cover the whole screen anyway
+    // Clear the color buffer
+    glClearColor(0.8f, 0.1f, 0.2f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+#endif
+
+
+    return true;
+}
+
+
+RenderBase::RenderTarget* RenderBase::findRenderTarget(const BufferDesc& tgtBuffer) {
+    RenderTarget* cached = sRenderTargets.find(tgtBuffer);
+    if (cached != nullptr) {
+        return cached;
+    }
+    ATRACE_NAME("RenderBase::createRenderTarget");
+
+    RenderTarget target = {};
+
     // create a GraphicBuffer from the existing handle
-    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(tgtBuffer.memHandle,
-                                                     GraphicBuffer::CLONE_HANDLE,
-                                                     tgtBuffer.width, tgtBuffer.height,
-                                                     tgtBuffer.format, 1, // layer count
-                                                     GRALLOC_USAGE_HW_RENDER,
-                                                     tgtBuffer.stride);
-    if (pGfxBuffer.get() == nullptr) {
+    target.graphicBuffer = new GraphicBuffer(tgtBuffer.memHandle,
+                                             GraphicBuffer::CLONE_HANDLE,
+                                             tgtBuffer.width, tgtBuffer.height,
+                                             tgtBuffer.format, 1, // layer count
+                                             GRALLOC_USAGE_HW_RENDER,
+                                             tgtBuffer.stride);
+    if (target.graphicBuffer.get() == nullptr) {
         ALOGE("Failed to allocate GraphicBuffer to wrap image handle");
-        return false;
+        return nullptr;
     }
 
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
-    EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    sKHRimage = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
-                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (sKHRimage == EGL_NO_IMAGE_KHR) {
+    EGLClientBuffer clientBuf =
+            static_cast<EGLClientBuffer>(target.graphicBuffer->getNativeBuffer());
+    target.image = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
+                                     EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                     eglImageAttributes);
+    if (target.image == EGL_NO_IMAGE_KHR) {
         ALOGE("error creating EGLImage for target buffer: %s", getEGLError());
-        return false;
+        return nullptr;
     }
 
-    // Construct a render buffer around the external buffer
-    glBindRenderbuffer(GL_RENDERBUFFER, sColorBuffer);
-    glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER, static_cast<GLeglImageOES>(sKHRimage));
+    // Construct a render buffer around the external buffer, and a frame buffer object around that
+    glGenRenderbuffers(1, &target.colorBuffer);
+    glGenFramebuffers(1, &target.frameBuffer);
+
+    // Whatever happens from here, we'll either keep these objects or clean them up
+    auto fail = [&target]() {
+        glDeleteFramebuffers(1, &target.frameBuffer);
+        glDeleteRenderbuffers(1, &target.colorBuffer);
+        eglDestroyImageKHR(sDisplay, target.image);
+        return nullptr;
+    };
+
+    glBindRenderbuffer(GL_RENDERBUFFER, target.colorBuffer);
+    glEGLImageTargetRenderbufferStorageOES(GL_RENDERBUFFER,
+                                           static_cast<GLeglImageOES>(target.image));
     if (eglGetError() != EGL_SUCCESS) {
         ALOGI("glEGLImageTargetRenderbufferStorageOES => %s", getEGLError());
-        return false;
+        return fail();
     }
 
-    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, sColorBuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.frameBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                              target.colorBuffer);
     if (eglGetError() != EGL_SUCCESS) {
         ALOGE("glFramebufferRenderbuffer => %s", getEGLError());
-        return false;
+        return fail();
     }
 
     GLenum checkResult = glCheckFramebufferStatus(GL_FRAMEBUFFER);
     if (checkResult != GL_FRAMEBUFFER_COMPLETE) {
         ALOGE("Offscreen framebuffer not configured successfully (%d: %s)",
               checkResult, getGLFramebufferError());
-        return false;
+        return fail();
     }
 
-    // Store the size of our target buffer
-    sWidth = tgtBuffer.width;
-    sHeight = tgtBuffer.height;
-    sAspectRatio = (float)sWidth / sHeight;
+    return sRenderTargets.insert(tgtBuffer, target, releaseRenderTarget);
+}
 
-    // Set the viewport
-    glViewport(0, 0, sWidth, sHeight);
 
-#if 1   // We don't actually need the clear if we're going to cover the whole screen anyway
-    // Clear the color buffer
-    glClearColor(0.8f, 0.1f, 0.2f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-#endif
+void RenderBase::releaseRenderTarget(RenderTarget& target) {
+    glDeleteFramebuffers(1, &target.frameBuffer);
+    glDeleteRenderbuffers(1, &target.colorBuffer);
+    eglDestroyImageKHR(sDisplay, target.image);
+    target = {};
+}
 
 
-    return true;
+void RenderBase::releaseRenderTargets() {
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    sRenderTargets.clear(releaseRenderTarget);
 }
 
 
 void RenderBase::detachRenderTarget() {
-    // Drop our external render target
-    if (sKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(sDisplay, sKHRimage);
-        sKHRimage = EGL_NO_IMAGE_KHR;
+    // Mark the end of this frame's work and get the GPU going on it, without waiting for it
+    if (sRenderFence != EGL_NO_SYNC_KHR) {
+        eglDestroySyncKHR(sDisplay, sRenderFence);
     }
-}
\ No newline at end of file
+    sRenderFence = eglCreateSyncKHR(sDisplay, EGL_SYNC_FENCE_KHR, nullptr);
+    if (sRenderFence == EGL_NO_SYNC_KHR) {
+        // Without a fence, there's nothing for waitForRendering to wait on, so do it now
+        ALOGW("Failed to create render fence (%s), so finishing the frame", getEGLError());
+        glFinish();
+    } else {
+        glFlush();
+    }
+
+    // We keep our hold on the target buffer, since we're likely to be handed it again
+}
+
+
+bool RenderBase::waitForRendering() {
+    if (sRenderFence == EGL_NO_SYNC_KHR) {
+        // Nothing outstanding
+        return true;
+    }
+    ATRACE_CALL();
+
+    // A frame should never take anywhere near this long, but we'd rather drop one than hang
+    static const EGLTimeKHR kRenderTimeout = 1000000000;    // 1 second in nanoseconds
+    const EGLint result = eglClientWaitSyncKHR(sDisplay, sRenderFence, 0, kRenderTimeout);
+    eglDestroySyncKHR(sDisplay, sRenderFence);
+    sRenderFence = EGL_NO_SYNC_KHR;
+
+    if (result != EGL_CONDITION_SATISFIED_KHR) {
+        ALOGE("Rendering didn't finish (%s)", getEGLError());
+        return false;
+    }
+    return true;
+}
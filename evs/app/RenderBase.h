@@ -25,6 +25,11 @@
 #include <GLES3/gl3ext.h>
 
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
+#include <ui/GraphicBuffer.h>
+
+#include "BufferCache.h"
+
+#include <chrono>
 
 using namespace ::android::hardware::automotive::evs::V1_0;
 using ::android::sp;
@@ -43,21 +48,57 @@ public:
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer) = 0;
 
+    // Blocks until there is new video to draw, or up to the given timeout.  Returns true if
+    // a new frame is ready.  Renderers without video inputs are always ready to draw.
+    virtual bool waitForNewFrame(std::chrono::nanoseconds /*timeout*/) { return true; };
+
+    // What a renderer may give up to draw for less, as the state controller asks when the system
+    // is hot or busy.  Each renderer takes up whatever applies to it, from its next frame on.
+    struct Quality {
+        float       renderScale     = 1.0f; // Of the display's resolution, each way
+        unsigned    camerasPerFrame = 0;    // How many cameras show new frames per frame, 0 all
+        unsigned    cameraFrameRate = 0;    // The most frames per second we want, 0 all
+    };
+    virtual void setQuality(const Quality& quality) { mQuality = quality; };
+
+    // Blocks until the GPU has finished the last frame any renderer drew.  drawFrame() only
+    // submits the work, so call this before letting anyone else see the target buffer.
+    static bool waitForRendering();
+
 protected:
     static bool prepareGL();
 
+    // Makes a context sharing our textures and buffers current on the calling thread, so it
+    // can load assets for us.  Once done, that thread hands it back to releaseSharedContext().
+    static bool attachSharedContext(EGLContext& context, EGLSurface& surface);
+    static void releaseSharedContext(EGLContext context, EGLSurface surface);
+
     static bool attachRenderTarget(const BufferDesc& tgtBuffer);
     static void detachRenderTarget();
 
+    // The display cycles through a few buffers at most, so we wrap each one for GL the first
+    // time we're given it and keep it ready for the next time
+    struct RenderTarget {
+        sp<android::GraphicBuffer>      graphicBuffer;  // Keeps its own clone of the handle
+        EGLImageKHR                     image       = EGL_NO_IMAGE_KHR;
+        GLuint                          colorBuffer = 0;
+        GLuint                          frameBuffer = 0;
+    };
+    static RenderTarget* findRenderTarget(const BufferDesc& tgtBuffer);
+    static void releaseRenderTarget(RenderTarget& target);
+    static void releaseRenderTargets();
+
+    Quality             mQuality;
+
     // OpenGL state shared among all renderers
     static EGLDisplay   sDisplay;
     static EGLContext   sContext;
     static EGLSurface   sDummySurface;
-    static GLuint       sFrameBuffer;
-    static GLuint       sColorBuffer;
+    static EGLConfig    sConfig;
     static GLuint       sDepthBuffer;
 
-    static EGLImageKHR  sKHRimage;
+    static ::android::automotive::evs::support::BufferCache<RenderTarget>  sRenderTargets;
+    static EGLSyncKHR   sRenderFence;   // Signals when the last detached frame is done
 
     static unsigned     sWidth;
     static unsigned     sHeight;
@@ -15,12 +15,14 @@
  */
 
 #include "RenderDirectView.h"
+#include "LensDistortion.h"
 #include "VideoTex.h"
 #include "glError.h"
 #include "shader.h"
 #include "shader_simpleTex.h"
 
 #include <log/log.h>
+#include <utils/Trace.h>
 #include <math/mat4.h>
 
 
@@ -47,15 +49,80 @@ bool RenderDirectView::activate() {
             ALOGE("Error buliding shader program");
             return false;
         }
+
+        // Our uniforms never change, so they're set once here and stay with the program.  We
+        // model in screen space, so the model to clip space transform is the identity.
+        GLint cameraMatLoc = glGetUniformLocation(mShaderProgram, "cameraMat");
+        GLint texLoc = glGetUniformLocation(mShaderProgram, "tex");
+        if (cameraMatLoc < 0 || texLoc < 0) {
+            ALOGE("Couldn't find shader parameters 'cameraMat' and 'tex'");
+            glDeleteProgram(mShaderProgram);
+            mShaderProgram = 0;
+            return false;
+        }
+        const android::mat4 identityMatrix;
+        glUseProgram(mShaderProgram);
+        glUniformMatrix4fv(cameraMatLoc, 1, false, identityMatrix.asArray());
+        glUniform1i(texLoc, 0);     // The sampler reads from texture slot 0
+        glUseProgram(0);
     }
 
-    // Construct our video texture
-    mTexture.reset(createVideoTexture(mEnumerator, mCameraInfo.cameraId.c_str(), sDisplay));
+    // The full screen quad doesn't change either, so it lives in a buffer of its own.  For a
+    // lens that needs correcting, the quad is the warp mesh instead, so the correction takes
+    // no more than the same single draw.
+    if (!mQuadVertexArray) {
+        // TODO:  We're flipping horizontally here, but should do it only for specified cameras!
+        std::vector<GLfloat> verts;
+        std::vector<uint16_t> indices;
+        if (mCameraInfo.hasDistortion()) {
+            const std::vector<float>& mesh = mCameraInfo.warpMesh;
+            for (size_t i = 0; i + 4 <= mesh.size(); i += 4) {
+                // Ideal texture coordinates, flipped the same way as the plain quad below
+                verts.insert(verts.end(), { 1.0f - 2.0f * mesh[i], 2.0f * mesh[i + 1] - 1.0f,
+                                            0.0f, mesh[i + 2], mesh[i + 3] });
+            }
+            indices = getWarpMeshIndices();
+        } else {
+            verts = { -1.0f,  1.0f, 0.0f,   1.0f, 1.0f,   // left top in window space
+                       1.0f,  1.0f, 0.0f,   0.0f, 1.0f,   // right top
+                      -1.0f, -1.0f, 0.0f,   1.0f, 0.0f,   // left bottom
+                       1.0f, -1.0f, 0.0f,   0.0f, 0.0f    // right bottom
+            };
+        }
+        const GLsizei stride = 5 * sizeof(GLfloat);
+
+        glGenVertexArrays(1, &mQuadVertexArray);
+        glGenBuffers(1, &mQuadBuffer);
+        glBindVertexArray(mQuadVertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+        glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GLfloat), verts.data(),
+                     GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const void*)(3 * sizeof(GLfloat)));
+        glEnableVertexAttribArray(0);
+        glEnableVertexAttribArray(1);
+        if (!indices.empty()) {
+            // The vertex array keeps hold of its index buffer binding
+            glGenBuffers(1, &mQuadIndexBuffer);
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mQuadIndexBuffer);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(uint16_t),
+                         indices.data(), GL_STATIC_DRAW);
+            mQuadIndexCount = indices.size();
+        }
+        glBindVertexArray(0);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    }
+
+    // Construct our video texture, or pick up the one the last renderer left streaming
+    mTexture.reset(acquireVideoTexture(mEnumerator, mCameraInfo.cameraId.c_str(), sDisplay));
     if (!mTexture) {
         ALOGE("Failed to set up video texture for %s (%s)",
               mCameraInfo.cameraId.c_str(), mCameraInfo.function.c_str());
 // TODO:  For production use, we may actually want to fail in this case, but not yet...
 //       return false;
+    } else {
+        mTexture->setMaxFrameRate(mQuality.cameraFrameRate);
     }
 
     return true;
@@ -63,82 +130,71 @@ bool RenderDirectView::activate() {
 
 
 void RenderDirectView::deactivate() {
-    // Release our video texture
-    // We can't hold onto it because some other Render object might need the same camera
-    // TODO(b/131492626):  investigate whether sharing video textures can save
-    // the time.
-  mTexture = nullptr;
+    // Release our video texture to the pool, since the next renderer may want the same camera
+    releaseVideoTexture(std::move(mTexture));
+
+    // The GL context outlives us, so whatever we made in it goes now.  Deleting 0 is a no-op.
+    glDeleteVertexArrays(1, &mQuadVertexArray);
+    glDeleteBuffers(1, &mQuadBuffer);
+    glDeleteBuffers(1, &mQuadIndexBuffer);
+    glDeleteProgram(mShaderProgram);
+    mQuadVertexArray = 0;
+    mQuadBuffer      = 0;
+    mQuadIndexBuffer = 0;
+    mQuadIndexCount  = 0;
+    mShaderProgram   = 0;
+}
+
+
+void RenderDirectView::setQuality(const Quality& quality) {
+    RenderBase::setQuality(quality);
+    if (mTexture) {
+        mTexture->setMaxFrameRate(quality.cameraFrameRate);
+    }
 }
 
 
 bool RenderDirectView::drawFrame(const BufferDesc& tgtBuffer) {
+    ATRACE_CALL();
+
     // Tell GL to render to the given buffer
     if (!attachRenderTarget(tgtBuffer)) {
         ALOGE("Failed to attached render target");
         return false;
     }
 
-    // Select our screen space simple texture shader
+    // Select our screen space simple texture shader, whose uniforms are already set
     glUseProgram(mShaderProgram);
 
-    // Set up the model to clip space transform (identity matrix if we're modeling in screen space)
-    GLint loc = glGetUniformLocation(mShaderProgram, "cameraMat");
-    if (loc < 0) {
-        ALOGE("Couldn't set shader parameter 'cameraMat'");
-        return false;
-    } else {
-        const android::mat4 identityMatrix;
-        glUniformMatrix4fv(loc, 1, false, identityMatrix.asArray());
-    }
-
-
-    // Bind the texture and assign it to the shader's sampler
+    // Bind the texture to the slot the shader's sampler reads from
     mTexture->refresh();
     glActiveTexture(GL_TEXTURE0);
     glBindTexture(GL_TEXTURE_2D, mTexture->glId());
 
-
-    GLint sampler = glGetUniformLocation(mShaderProgram, "tex");
-    if (sampler < 0) {
-        ALOGE("Couldn't set shader parameter 'tex'");
-        return false;
-    } else {
-        // Tell the sampler we looked up from the shader to use texture slot 0 as its source
-        glUniform1i(sampler, 0);
-    }
-
     // We want our image to show up opaque regardless of alpha values
     glDisable(GL_BLEND);
 
-
-    // Draw a rectangle on the screen
-    GLfloat vertsCarPos[] = { -1.0,  1.0, 0.0f,   // left top in window space
-                               1.0,  1.0, 0.0f,   // right top
-                              -1.0, -1.0, 0.0f,   // left bottom
-                               1.0, -1.0, 0.0f    // right bottom
-    };
-    // TODO:  We're flipping horizontally here, but should do it only for specified cameras!
-    GLfloat vertsCarTex[] = { 1.0f, 1.0f,   // left top
-                              0.0f, 1.0f,   // right top
-                              1.0f, 0.0f,   // left bottom
-                              0.0f, 0.0f    // right bottom
-    };
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsCarPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, vertsCarTex);
-    glEnableVertexAttribArray(0);
-    glEnableVertexAttribArray(1);
-
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
-
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+    // Draw a rectangle on the screen, or the warp mesh that corrects the lens
+    glBindVertexArray(mQuadVertexArray);
+    if (mQuadIndexCount > 0) {
+        glDrawElements(GL_TRIANGLES, mQuadIndexCount, GL_UNSIGNED_SHORT, nullptr);
+    } else {
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    }
+    glBindVertexArray(0);
 
 
     // Now that everything is submitted, release our hold on the texture resource
     detachRenderTarget();
 
-    // Wait for the rendering to finish
-    glFinish();
-    detachRenderTarget();
     return true;
 }
+
+
+bool RenderDirectView::waitForNewFrame(std::chrono::nanoseconds timeout) {
+    std::vector<StreamHandler*> streams;
+    if (mTexture) {
+        streams.push_back(mTexture->streamHandler());
+    }
+    return StreamHandler::waitForNewFrame(streams, timeout);
+}
@@ -39,6 +39,10 @@ public:
     virtual void deactivate() override;
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer);
+    virtual bool waitForNewFrame(std::chrono::nanoseconds timeout) override;
+
+    // Only the camera frame rate applies to a single full screen view
+    virtual void setQuality(const Quality& quality) override;
 
 protected:
     sp<IEvsEnumerator>              mEnumerator;
@@ -47,6 +51,10 @@ protected:
     std::unique_ptr<VideoTex>       mTexture;
 
     GLuint                          mShaderProgram = 0;
+    GLuint                          mQuadVertexArray = 0;   // The full screen quad
+    GLuint                          mQuadBuffer = 0;
+    GLuint                          mQuadIndexBuffer = 0;   // Only for a warp mesh
+    GLsizei                         mQuadIndexCount = 0;
 };
 
 
@@ -16,8 +16,26 @@
 
 #include "RenderPixelCopy.h"
 #include "FormatConvert.h"
+#include "glError.h"
+#include "shader.h"
+#include "shader_simpleTex.h"
+#include "shader_externalTex.h"
 
+#include <GLES3/gl3.h>
 #include <log/log.h>
+#include <utils/Trace.h>
+#include <math/mat4.h>
+
+using ::android::GraphicBuffer;
+using ::android::automotive::evs::support::ConversionPool;
+
+
+unsigned RenderPixelCopy::sConversionThreads = 1;
+std::unique_ptr<ConversionPool> RenderPixelCopy::sConversionPool;
+
+
+// Whichever way we end up copying a camera buffer, one wrapper allowing both will serve
+static const uint32_t kSourceUsage = GRALLOC_USAGE_HW_TEXTURE | GRALLOC_USAGE_SW_READ_OFTEN;
 
 
 RenderPixelCopy::RenderPixelCopy(sp<IEvsEnumerator> enumerator,
@@ -50,75 +68,212 @@ bool RenderPixelCopy::activate() {
 
     mStreamHandler = pStreamHandler;
 
+    // We can always fall back on the CPU, so it's no failure if the GPU isn't ready for us
+    mGpuReady = prepareGpuCopy();
+    ALOGI("Pixel copy will use the %s", mGpuReady ? "GPU where it can" : "CPU");
+
     return true;
 }
 
 
 void RenderPixelCopy::deactivate() {
+    releaseHeldFrame();
+    releaseWrappedBuffers(mSourceBuffers);
+    releaseWrappedBuffers(mTargetBuffers);
     mStreamHandler = nullptr;
+
+    // The program is only ours, so it goes with the rest of our GL state.  With the program
+    // binary cache, building it again next time is quick.
+    if (mShaderProgram) {
+        glDeleteProgram(mShaderProgram);
+        mShaderProgram = 0;
+    }
+    mGpuReady = false;
+}
+
+
+bool RenderPixelCopy::prepareGpuCopy() {
+    if (!prepareGL()) {
+        ALOGW("GL isn't available yet");
+        return false;
+    }
+
+    // Load our shader program if we don't have it already
+    if (!mShaderProgram) {
+        mShaderProgram = buildShaderProgram(vtxShader_simpleTexture,
+                                            pixShader_externalTexture,
+                                            "externalTexture");
+        if (!mShaderProgram) {
+            ALOGW("Couldn't build the external texture shader");
+            return false;
+        }
+        mCameraMatLoc = glGetUniformLocation(mShaderProgram, "cameraMat");
+        mTexLoc = glGetUniformLocation(mShaderProgram, "tex");
+    }
+
+    return true;
 }
 
 
 bool RenderPixelCopy::drawFrame(const BufferDesc& tgtBuffer) {
+    ATRACE_CALL();
+
+    // Make sure we have the latest frame data
+    if (mStreamHandler->newFrameAvailable()) {
+        releaseHeldFrame();
+        mHeldFrame = &mStreamHandler->getNewFrame();
+    }
+    if (mHeldFrame == nullptr) {
+        // Nothing to show yet
+        return true;
+    }
+    const BufferDesc& srcBuffer = *mHeldFrame;
+
+    if (mGpuReady && mCpuOnlyFormats.count(srcBuffer.format) == 0) {
+        if (drawFrameWithGpu(srcBuffer, tgtBuffer)) {
+            return true;
+        }
+    }
+    return drawFrameWithCpu(srcBuffer, tgtBuffer);
+}
+
+
+bool RenderPixelCopy::drawFrameWithGpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer) {
+    WrappedBuffer* source = findWrappedBuffer(mSourceBuffers, srcBuffer, kSourceUsage);
+    if (source == nullptr) {
+        return false;
+    }
+    if (source->texture == 0 && !importSourceImage(*source)) {
+        // Leave this format to the CPU from now on
+        ALOGW("GPU can't import camera format 0x%X, so copying it with the CPU", srcBuffer.format);
+        mCpuOnlyFormats.insert(srcBuffer.format);
+        releaseWrappedBuffers(mSourceBuffers);
+        return false;
+    }
+
+    // Tell GL to render to the given buffer
+    if (!attachRenderTarget(tgtBuffer)) {
+        ALOGE("Failed to attached render target");
+        return false;
+    }
+
+    // Just like the CPU copy, the image lands pixel for pixel at the start of the target buffer
+    // and is cropped to whichever is smaller.  Both buffers start at GL's origin, so no flips.
+    const unsigned width  = std::min(tgtBuffer.width,  srcBuffer.width);
+    const unsigned height = std::min(tgtBuffer.height, srcBuffer.height);
+    glViewport(0, 0, width, height);
+
+    glUseProgram(mShaderProgram);
+    const android::mat4 identityMatrix;
+    glUniformMatrix4fv(mCameraMatLoc, 1, false, identityMatrix.asArray());
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, source->texture);
+    glUniform1i(mTexLoc, 0);
+    glDisable(GL_BLEND);
+
+    const GLfloat maxS = (GLfloat)width  / srcBuffer.width;
+    const GLfloat maxT = (GLfloat)height / srcBuffer.height;
+    const GLfloat vertsPos[] = { -1.0f, -1.0f, 0.0f,
+                                  1.0f, -1.0f, 0.0f,
+                                 -1.0f,  1.0f, 0.0f,
+                                  1.0f,  1.0f, 0.0f };
+    const GLfloat vertsTex[] = { 0.0f, 0.0f,
+                                 maxS, 0.0f,
+                                 0.0f, maxT,
+                                 maxS, maxT };
+    // Our vertices live in client memory, which GL only reads from without a vertex array
+    // object or array buffer bound.  Another renderer may have left either behind.
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsPos);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, vertsTex);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+
+    // Now that everything is submitted, release our hold on the texture resource
+    detachRenderTarget();
+
+    return true;
+}
+
+
+bool RenderPixelCopy::drawFrameWithCpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer) {
     bool success = true;
 
-    sp<android::GraphicBuffer> tgt = new android::GraphicBuffer(
-            tgtBuffer.memHandle, android::GraphicBuffer::CLONE_HANDLE,
-            tgtBuffer.width, tgtBuffer.height, tgtBuffer.format, 1, tgtBuffer.usage,
-            tgtBuffer.stride);
+    if (tgtBuffer.format != HAL_PIXEL_FORMAT_RGBA_8888) {
+        // We always expect 32 bit RGB for the display output for now.  Is there a need for 565?
+        ALOGE("Diplay buffer is always expected to be 32bit RGBA");
+        return false;
+    }
+
+    WrappedBuffer* target = findWrappedBuffer(mTargetBuffers, tgtBuffer,
+                                              GRALLOC_USAGE_SW_WRITE_OFTEN);
+    WrappedBuffer* source = findWrappedBuffer(mSourceBuffers, srcBuffer, kSourceUsage);
+    if (target == nullptr || source == nullptr) {
+        return false;
+    }
 
     // Lock our target buffer for writing (should be RGBA8888 format)
     uint32_t* tgtPixels = nullptr;
-    tgt->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, (void**)&tgtPixels);
+    target->graphicBuffer->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, (void**)&tgtPixels);
 
     if (tgtPixels) {
-        if (tgtBuffer.format != HAL_PIXEL_FORMAT_RGBA_8888) {
-            // We always expect 32 bit RGB for the display output for now.  Is there a need for 565?
-            ALOGE("Diplay buffer is always expected to be 32bit RGBA");
+        // Lock our source buffer for reading (current expectation are for this to be NV21 format)
+        unsigned char* srcPixels = nullptr;
+        source->graphicBuffer->lock(GRALLOC_USAGE_SW_READ_OFTEN, (void**)&srcPixels);
+        if (!srcPixels) {
+            ALOGE("Failed to get pointer into src image data");
             success = false;
         } else {
-            // Make sure we have the latest frame data
-            if (mStreamHandler->newFrameAvailable()) {
-                const BufferDesc& srcBuffer = mStreamHandler->getNewFrame();
-
-                // Lock our source buffer for reading (current expectation are for this to be NV21 format)
-                sp<android::GraphicBuffer> src = new android::GraphicBuffer(
-                        srcBuffer.memHandle, android::GraphicBuffer::CLONE_HANDLE,
-                        srcBuffer.width, srcBuffer.height, srcBuffer.format, 1, srcBuffer.usage,
-                        srcBuffer.stride);
-                unsigned char* srcPixels = nullptr;
-                src->lock(GRALLOC_USAGE_SW_READ_OFTEN, (void**)&srcPixels);
-                if (!srcPixels) {
-                    ALOGE("Failed to get pointer into src image data");
-                }
-
-                // Make sure we don't run off the end of either buffer
-                const unsigned width     = std::min(tgtBuffer.width,
-                                                    srcBuffer.width);
-                const unsigned height    = std::min(tgtBuffer.height,
-                                                    srcBuffer.height);
+            // Make sure we don't run off the end of either buffer
+            const unsigned width     = std::min(tgtBuffer.width,
+                                                srcBuffer.width);
+            const unsigned height    = std::min(tgtBuffer.height,
+                                                srcBuffer.height);
 
+            auto convertRows = [&](unsigned firstRow, unsigned numRows) {
                 if (srcBuffer.format == HAL_PIXEL_FORMAT_YCRCB_420_SP) {   // 420SP == NV21
                     copyNV21toRGB32(width, height,
                                     srcPixels,
-                                    tgtPixels, tgtBuffer.stride);
+                                    tgtPixels, tgtBuffer.stride,
+                                    firstRow, numRows);
                 } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YV12) { // YUV_420P == YV12
                     copyYV12toRGB32(width, height,
                                     srcPixels,
-                                    tgtPixels, tgtBuffer.stride);
+                                    tgtPixels, tgtBuffer.stride,
+                                    firstRow, numRows);
                 } else if (srcBuffer.format == HAL_PIXEL_FORMAT_YCBCR_422_I) { // YUYV
                     copyYUYVtoRGB32(width, height,
                                     srcPixels, srcBuffer.stride,
-                                    tgtPixels, tgtBuffer.stride);
+                                    tgtPixels, tgtBuffer.stride,
+                                    firstRow, numRows);
                 } else if (srcBuffer.format == tgtBuffer.format) {  // 32bit RGBA
                     copyMatchedInterleavedFormats(width, height,
                                                   srcPixels, srcBuffer.stride,
                                                   tgtPixels, tgtBuffer.stride,
-                                                  tgtBuffer.pixelSize);
+                                                  tgtBuffer.pixelSize,
+                                                  firstRow, numRows);
                 }
+            };
 
-                mStreamHandler->doneWithFrame(srcBuffer);
+            // Large frames go faster split across a few cores, if we've been given them
+            if (sConversionThreads > 1 && !sConversionPool) {
+                sConversionPool = std::make_unique<ConversionPool>(sConversionThreads);
             }
+            if (sConversionPool) {
+                sConversionPool->convert(convertRows, height);
+            } else {
+                convertRows(0, height);
+            }
+
+            source->graphicBuffer->unlock();
         }
     } else {
         ALOGE("Failed to lock buffer contents for contents transfer");
@@ -126,8 +281,98 @@ bool RenderPixelCopy::drawFrame(const BufferDesc& tgtBuffer) {
     }
 
     if (tgtPixels) {
-        tgt->unlock();
+        target->graphicBuffer->unlock();
     }
 
     return success;
 }
+
+
+RenderPixelCopy::WrappedBuffer* RenderPixelCopy::findWrappedBuffer(WrappedBufferCache& buffers,
+                                                                   const BufferDesc& desc,
+                                                                   uint32_t usage) {
+    WrappedBuffer* cached = buffers.find(desc);
+    if (cached != nullptr) {
+        return cached;
+    }
+    ATRACE_NAME("RenderPixelCopy::wrapBuffer");
+
+    WrappedBuffer wrapped = {};
+    wrapped.graphicBuffer = new GraphicBuffer(desc.memHandle,
+                                              GraphicBuffer::CLONE_HANDLE,
+                                              desc.width, desc.height,
+                                              desc.format, 1, // layer count
+                                              desc.usage | usage,
+                                              desc.stride);
+    if (wrapped.graphicBuffer.get() == nullptr) {
+        ALOGE("Failed to allocate GraphicBuffer to wrap image handle");
+        return nullptr;
+    }
+
+    return buffers.insert(desc, wrapped,
+                          [this](WrappedBuffer& old) { releaseWrappedBuffer(old); });
+}
+
+
+bool RenderPixelCopy::importSourceImage(WrappedBuffer& source) {
+    // Get a GL compatible reference to the camera buffer
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer clientBuf =
+            static_cast<EGLClientBuffer>(source.graphicBuffer->getNativeBuffer());
+    source.image = eglCreateImageKHR(sDisplay, EGL_NO_CONTEXT,
+                                     EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                     eglImageAttributes);
+    if (source.image == EGL_NO_IMAGE_KHR) {
+        ALOGW("error creating EGLImage for camera buffer: %s", getEGLError());
+        return false;
+    }
+
+    // As an external image, the GPU takes care of sampling it in its own format
+    glGenTextures(1, &source.texture);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, source.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                                 static_cast<GLeglImageOES>(source.image));
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+    if (glGetError() != GL_NO_ERROR) {
+        return false;
+    }
+
+    return true;
+}
+
+
+void RenderPixelCopy::releaseWrappedBuffer(WrappedBuffer& wrapped) {
+    if (wrapped.texture != 0) {
+        glDeleteTextures(1, &wrapped.texture);
+    }
+    if (wrapped.image != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(sDisplay, wrapped.image);
+    }
+    wrapped = {};
+}
+
+
+void RenderPixelCopy::releaseWrappedBuffers(WrappedBufferCache& buffers) {
+    buffers.clear([this](WrappedBuffer& wrapped) { releaseWrappedBuffer(wrapped); });
+}
+
+
+void RenderPixelCopy::releaseHeldFrame() {
+    if (mHeldFrame != nullptr) {
+        mStreamHandler->doneWithFrame(*mHeldFrame);
+        mHeldFrame = nullptr;
+    }
+}
+
+
+bool RenderPixelCopy::waitForNewFrame(std::chrono::nanoseconds timeout) {
+    std::vector<StreamHandler*> streams;
+    if (mStreamHandler != nullptr) {
+        streams.push_back(mStreamHandler.get());
+    }
+    return StreamHandler::waitForNewFrame(streams, timeout);
+}
@@ -21,30 +21,81 @@
 #include "RenderBase.h"
 
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
+#include "BufferCache.h"
 #include "ConfigManager.h"
 #include "VideoTex.h"
+#include "ConversionPool.h"
+
+#include <set>
 
 
 using namespace ::android::hardware::automotive::evs::V1_0;
 
 
 /*
- * Renders the view from a single specified camera directly to the full display.
+ * Renders the view from a single specified camera directly to the full display.  We're used
+ * before SurfaceFlinger is up, but GL may well work already, so the GPU does the copy if it can
+ * import the camera's buffers.  The CPU handles the formats it can't.
  */
 class RenderPixelCopy: public RenderBase {
 public:
     RenderPixelCopy(sp<IEvsEnumerator> enumerator, const ConfigManager::CameraInfo& cam);
 
+    // The CPU copy is split into this many bands, converted in parallel
+    static void setConversionThreads(unsigned count) { sConversionThreads = count; };
+
     virtual bool activate() override;
     virtual void deactivate() override;
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer);
+    virtual bool waitForNewFrame(std::chrono::nanoseconds timeout) override;
 
 protected:
     sp<IEvsEnumerator>              mEnumerator;
     ConfigManager::CameraInfo       mCameraInfo;
 
     sp<StreamHandler>               mStreamHandler;
+
+private:
+    bool prepareGpuCopy();
+    bool drawFrameWithGpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer);
+    bool drawFrameWithCpu(const BufferDesc& srcBuffer, const BufferDesc& tgtBuffer);
+    void releaseHeldFrame();
+
+    // The camera cycles through a small set of buffers, so whichever way we copy them, we wrap
+    // each one just once (and likewise the display's)
+    struct WrappedBuffer {
+        sp<android::GraphicBuffer>      graphicBuffer;  // Keeps its own clone of the handle
+        EGLImageKHR                     image   = EGL_NO_IMAGE_KHR;   // GPU path only
+        GLuint                          texture = 0;
+    };
+    typedef ::android::automotive::evs::support::BufferCache<WrappedBuffer> WrappedBufferCache;
+    WrappedBuffer* findWrappedBuffer(WrappedBufferCache& buffers, const BufferDesc& desc,
+                                     uint32_t usage);
+    bool importSourceImage(WrappedBuffer& source);
+    void releaseWrappedBuffer(WrappedBuffer& wrapped);
+    void releaseWrappedBuffers(WrappedBufferCache& buffers);
+
+    // Comfortably more buffers than a camera or display cycles through
+    static const size_t kMaxWrappedBuffers = 16;
+
+    WrappedBufferCache              mSourceBuffers {kMaxWrappedBuffers};
+    WrappedBufferCache              mTargetBuffers {kMaxWrappedBuffers};    // CPU path only
+
+    bool                            mGpuReady = false;
+    std::set<uint32_t>              mCpuOnlyFormats;    // The GPU couldn't import these
+    GLuint                          mShaderProgram = 0;
+    GLint                           mCameraMatLoc = -1;
+    GLint                           mTexLoc = -1;
+
+    // The GPU reads the camera buffer after drawFrame() returns, so we hold the latest frame
+    // until the next one replaces it
+    const BufferDesc*               mHeldFrame = nullptr;
+
+    // Lives as long as the app, since we may be recreated on every state change
+    static unsigned                         sConversionThreads;
+    static std::unique_ptr<::android::automotive::evs::support::ConversionPool>
+                                            sConversionPool;
 };
 
 
@@ -0,0 +1,232 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "RenderStitchedView.h"
+#include "LensDistortion.h"
+#include "glError.h"
+#include "shader.h"
+#include "shader_stitchedTex.h"
+
+#include <log/log.h>
+#include <utils/Trace.h>
+#include <math/half.h>
+#include <math/vec4.h>
+
+#include <algorithm>
+#include <vector>
+
+
+// Rows in the remap texture.  It's sampled with linear filtering, and the mapping it holds is
+// smooth, so it needn't be anywhere near the resolution of the display.
+static const unsigned kRemapHeight = 256;
+
+// How far in from the edges of its image (in 0 to 1 texture space) a camera takes to fade in.
+// Overlapping cameras blend across this band instead of meeting at a hard edge.
+static const float kSeamWidth = 0.15f;
+
+
+RenderStitchedView::RenderStitchedView(sp<IEvsEnumerator> enumerator,
+                                       const std::vector<ConfigManager::CameraInfo>& camList,
+                                       const ConfigManager& config) :
+    RenderTopView(enumerator, camList, config) {
+    if (camList.size() > kMaxCameras) {
+        ALOGW("Only the first %u of %zu cameras will be stitched", kMaxCameras, camList.size());
+    }
+}
+
+
+bool RenderStitchedView::activate() {
+    // Our base class brings up GL, the cameras, and everything we draw besides the ground
+    if (!RenderTopView::activate()) {
+        return false;
+    }
+
+    mStitchProgram = buildShaderProgram(vtxShader_stitchedTexture,
+                                        pixShader_stitchedTexture,
+                                        "stitchedTexture");
+    if (!mStitchProgram) {
+        ALOGE("Failed to build shader program");
+        return false;
+    }
+    mStitchCameraMat = glGetUniformLocation(mStitchProgram, "cameraMat");
+
+    // The remap goes in texture unit 0, with the cameras in the units after it
+    static const char* const kCameraSamplers[kMaxCameras] = { "cam0", "cam1", "cam2", "cam3" };
+    glUseProgram(mStitchProgram);
+    glUniform1i(glGetUniformLocation(mStitchProgram, "remap"), 0);
+    for (unsigned i = 0; i < kMaxCameras; i++) {
+        glUniform1i(glGetUniformLocation(mStitchProgram, kCameraSamplers[i]), i + 1);
+    }
+
+    return true;
+}
+
+
+void RenderStitchedView::deactivate() {
+    glDeleteTextures(1, &mRemapTexture);
+    glDeleteVertexArrays(1, &mQuadVertexArray);
+    glDeleteBuffers(1, &mQuadBuffer);
+    glDeleteProgram(mStitchProgram);
+    mRemapTexture    = 0;
+    mQuadVertexArray = 0;
+    mQuadBuffer      = 0;
+    mStitchProgram   = 0;
+
+    RenderTopView::deactivate();
+}
+
+
+void RenderStitchedView::updateGroundGeometry() {
+    // Our base class works out each camera's projection, which the remap is built from
+    RenderTopView::updateGroundGeometry();
+
+    // The whole visible ground, with remap coordinates running 0 to 1 from left to right and
+    // bottom to top
+    const float top    = mConfig.getDisplayTopLocation();
+    const float bottom = mConfig.getDisplayBottomLocation();
+    const float right  = mConfig.getDisplayRightLocation(sAspectRatio);
+    const float left   = mConfig.getDisplayLeftLocation(sAspectRatio);
+    const GLfloat verts[] = { left,  top,    0.0f,   0.0f, 1.0f,
+                              right, top,    0.0f,   1.0f, 1.0f,
+                              left,  bottom, 0.0f,   0.0f, 0.0f,
+                              right, bottom, 0.0f,   1.0f, 0.0f,
+    };
+    const GLsizei stride = 5 * sizeof(GLfloat);
+
+    if (!mQuadVertexArray) {
+        glGenVertexArrays(1, &mQuadVertexArray);
+        glGenBuffers(1, &mQuadBuffer);
+    }
+    glBindVertexArray(mQuadVertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, mQuadBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const void*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    buildRemapTexture();
+}
+
+
+void RenderStitchedView::buildRemapTexture() {
+    ATRACE_CALL();
+
+    const unsigned height = kRemapHeight;
+    const unsigned width  = std::max(1u, (unsigned)(kRemapHeight * sAspectRatio + 0.5f));
+    const unsigned numCameras = std::min((unsigned)mActiveCameras.size(), kMaxCameras);
+
+    const float top    = mConfig.getDisplayTopLocation();
+    const float bottom = mConfig.getDisplayBottomLocation();
+    const float right  = mConfig.getDisplayRightLocation(sAspectRatio);
+    const float left   = mConfig.getDisplayLeftLocation(sAspectRatio);
+
+    // One RGBA layer per camera:  where the ground point lands in its image, then its weight.
+    // Layers for cameras we don't have keep a weight of zero.
+    std::vector<android::half> texels(width * height * 4 * kMaxCameras, android::half(0.0f));
+    for (unsigned row = 0; row < height; row++) {
+        const float y = bottom + (row + 0.5f) / height * (top - bottom);
+        for (unsigned col = 0; col < width; col++) {
+            const float x = left + (col + 0.5f) / width * (right - left);
+
+            float u[kMaxCameras] = {};
+            float v[kMaxCameras] = {};
+            float weight[kMaxCameras] = {};
+            float totalWeight = 0.0f;
+            for (unsigned i = 0; i < numCameras; i++) {
+                // Project the way the projectedTexture shader does, flipping the image in V
+                const android::vec4 p = mActiveCameras[i].projectionMatrix *
+                                        android::vec4(x, y, 0.0f, 1.0f);
+                if (p.w <= 0.0f) {
+                    // Behind this camera
+                    continue;
+                }
+                u[i] = ( p.x / p.w + 1.0f) * 0.5f;
+                v[i] = (-p.y / p.w + 1.0f) * 0.5f;
+
+                // Fade out towards the edges of the image, so neighbouring cameras blend
+                const float edge = std::min(std::min(u[i], 1.0f - u[i]),
+                                            std::min(v[i], 1.0f - v[i]));
+                weight[i] = std::min(std::max(edge / kSeamWidth, 0.0f), 1.0f);
+                totalWeight += weight[i];
+
+                // Then look up the ground point where the lens actually put it
+                if (mActiveCameras[i].info.hasDistortion()) {
+                    const android::vec2 uv = distortTexCoord(mActiveCameras[i].info,
+                                                             android::vec2(u[i], v[i]));
+                    u[i] = uv.x;
+                    v[i] = uv.y;
+                }
+            }
+
+            for (unsigned i = 0; i < numCameras; i++) {
+                android::half* texel = &texels[((i * height + row) * width + col) * 4];
+
+                // Clamped so the coordinates keep their precision as half floats.  Linear
+                // filtering near an image's edge still sees the true, continuous mapping.
+                texel[0] = android::half(std::min(std::max(u[i], -1.0f), 2.0f));
+                texel[1] = android::half(std::min(std::max(v[i], -1.0f), 2.0f));
+                texel[2] = android::half(totalWeight > 0.0f ? weight[i] / totalWeight : 0.0f);
+            }
+        }
+    }
+
+    if (!mRemapTexture) {
+        glGenTextures(1, &mRemapTexture);
+    }
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mRemapTexture);
+    glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_RGBA16F, width, height, kMaxCameras, 0,
+                 GL_RGBA, GL_HALF_FLOAT, texels.data());
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    ALOGD("Built a %u x %u stitching remap for %u cameras", width, height, numCameras);
+}
+
+
+void RenderStitchedView::renderGround() {
+    glBindVertexArray(mQuadVertexArray);
+
+    glDisable(GL_BLEND);
+
+    glUseProgram(mStitchProgram);
+    glUniformMatrix4fv(mStitchCameraMat, 1, false, orthoMatrix.asArray());
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, mRemapTexture);
+    for (unsigned i = 0; i < kMaxCameras; i++) {
+        // Cameras without video show the checkerboard, as in the plain top view.  Units past
+        // our last camera get it too so they're valid, but their weights are all zero.
+        GLuint texId = mTexAssets.checkerBoard ? mTexAssets.checkerBoard->glId() : 0;
+        if (i < mActiveCameras.size() && mActiveCameras[i].tex) {
+            texId = mActiveCameras[i].tex->glId();
+        }
+        glActiveTexture(GL_TEXTURE1 + i);
+        glBindTexture(GL_TEXTURE_2D, texId);
+    }
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    // Everything else we draw expects to be using texture unit 0
+    glActiveTexture(GL_TEXTURE0);
+    glBindVertexArray(0);
+}
@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_EVS_APP_RENDERSTITCHEDVIEW_H
+#define CAR_EVS_APP_RENDERSTITCHEDVIEW_H
+
+
+#include "RenderTopView.h"
+
+
+/*
+ * A top down view like RenderTopView's, but with the camera images stitched together rather than
+ * painted over one another.  Where each point on the ground falls in each camera's image, and how
+ * much each camera should contribute there, is worked out once into a remap texture whenever the
+ * display changes shape.  Every frame is then drawn in one pass whose cost doesn't depend on how
+ * many cameras there are, and cameras fade into one another across their overlaps.
+ */
+class RenderStitchedView: public RenderTopView {
+public:
+    RenderStitchedView(sp<IEvsEnumerator> enumerator,
+                       const std::vector<ConfigManager::CameraInfo>& camList,
+                       const ConfigManager& config);
+
+    virtual bool activate() override;
+    virtual void deactivate() override;
+
+protected:
+    virtual void updateGroundGeometry() override;
+    virtual void renderGround() override;
+
+private:
+    void buildRemapTexture();
+
+    // The most cameras we can blend (one texture unit each, plus one for the remap)
+    static const unsigned kMaxCameras = 4;
+
+    GLuint      mStitchProgram      = 0;
+    GLint       mStitchCameraMat    = -1;   // Uniform location
+    GLuint      mRemapTexture       = 0;    // One layer per camera
+    GLuint      mQuadVertexArray    = 0;    // The visible ground, with remap coordinates
+    GLuint      mQuadBuffer         = 0;
+};
+
+
+#endif //CAR_EVS_APP_RENDERSTITCHEDVIEW_H
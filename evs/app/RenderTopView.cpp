@@ -15,6 +15,7 @@
  */
 
 #include "RenderTopView.h"
+#include "LensDistortion.h"
 #include "VideoTex.h"
 #include "glError.h"
 #include "shader.h"
@@ -22,8 +23,17 @@
 #include "shader_projectedTex.h"
 
 #include <log/log.h>
+#include <utils/Trace.h>
 #include <math/mat4.h>
+#include <math/vec2.h>
 #include <math/vec3.h>
+#include <math/vec4.h>
+
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
 
 
 // Simple aliases to make geometric math using vectors more readable
@@ -91,6 +101,69 @@ static android::mat4 cameraLookMatrix(const ConfigManager::CameraInfo& cam) {
 }
 
 
+// A camera's view matrix depends only on the configuration, so we keep it in the config's cache
+static std::string getViewMatrixName(const ConfigManager::CameraInfo& cam) {
+    return "RenderTopView/viewMatrix/" + cam.cameraId;
+}
+
+static android::mat4 getCameraViewMatrix(const ConfigManager& config,
+                                         const ConfigManager::CameraInfo& cam) {
+    android::mat4 V;
+    std::vector<uint8_t> data;
+    if (config.getDerivedData(getViewMatrixName(cam), data) && data.size() == sizeof(V)) {
+        memcpy(&V, data.data(), sizeof(V));
+        return V;
+    }
+    return cameraLookMatrix(cam);
+}
+
+
+void RenderTopView::putDerivedData(ConfigManager& config) {
+    for (auto&& cam : config.getCameras()) {
+        std::vector<uint8_t> data;
+        if (!config.getDerivedData(getViewMatrixName(cam), data)) {
+            const android::mat4 V = cameraLookMatrix(cam);
+            config.putDerivedData(getViewMatrixName(cam), &V, sizeof(V));
+        }
+    }
+}
+
+
+// Clips a convex polygon on the ground plane to the side of the line a*x + b*y + c = 0 where
+// that expression is positive (one pass of Sutherland-Hodgman)
+static std::vector<android::vec2> clipToHalfPlane(const std::vector<android::vec2>& polygon,
+                                                  float a, float b, float c) {
+    std::vector<android::vec2> clipped;
+    for (size_t i = 0; i < polygon.size(); i++) {
+        const android::vec2& p = polygon[i];
+        const android::vec2& q = polygon[(i + 1) % polygon.size()];
+        const float dp = a * p.x + b * p.y + c;
+        const float dq = a * q.x + b * q.y + c;
+        if (dp >= 0.0f) {
+            clipped.push_back(p);
+        }
+        if ((dp >= 0.0f) != (dq >= 0.0f)) {
+            // The edge crosses the line, so keep the point where it does
+            clipped.push_back(p + (q - p) * (dp / (dp - dq)));
+        }
+    }
+    return clipped;
+}
+
+
+// How many recent frames each camera's texture holds for us to line them up from, and the most
+// we'll delay one camera's frames to line them up with another's.  The delay is less than the
+// two frame periods that history covers at 30fps.
+static const unsigned kFrameHistory = 3;
+static const nsecs_t kMaxSyncDelay = 50 * 1000 * 1000;     // ns
+
+
+// How many cells, each way, the footprint of a camera with lens distortion is cut into.  Its
+// texture coordinates are only right at the vertices, so these need to be close enough together
+// for interpolating between them to follow the lens.
+static const unsigned kGroundMeshCells = 32;
+
+
 RenderTopView::RenderTopView(sp<IEvsEnumerator> enumerator,
                              const std::vector<ConfigManager::CameraInfo>& camList,
                              const ConfigManager& mConfig) :
@@ -128,58 +201,90 @@ bool RenderTopView::activate() {
         ALOGE("Failed to build shader program");
         return false;
     }
-
-
-    // Load the checkerboard text image
-    mTexAssets.checkerBoard.reset(createTextureFromPng(
-                                  "/system/etc/automotive/evs/LabeledChecker.png"));
-    if (!mTexAssets.checkerBoard) {
-        ALOGE("Failed to load checkerboard texture");
-        return false;
-    }
-
-    // Load the car image
-    mTexAssets.carTopView.reset(createTextureFromPng(
-                                "/system/etc/automotive/evs/CarFromTop.png"));
-    if (!mTexAssets.carTopView) {
-        ALOGE("Failed to load carTopView texture");
-        return false;
+    mPgmAssets.simpleCameraMat = glGetUniformLocation(mPgmAssets.simpleTexture, "cameraMat");
+    mPgmAssets.projectedCameraMat = glGetUniformLocation(mPgmAssets.projectedTexture,
+                                                         "cameraMat");
+    mPgmAssets.projectedProjectionMat = glGetUniformLocation(mPgmAssets.projectedTexture,
+                                                             "projectionMat");
+
+    // The car's footprint depends only on its image and our config, so we can rebuild it now if
+    // we kept the image from before.  The ground plane has to wait until we know the shape of
+    // our display.
+    if (mTexAssets.carTopView) {
+        buildCarGeometry();
     }
 
-
-    // Set up streaming video textures for our associated cameras
-    for (auto&& cam: mActiveCameras) {
-        cam.tex.reset(createVideoTexture(mEnumerator, cam.info.cameraId.c_str(), sDisplay));
+    // Cameras the last renderer was showing are still streaming in the pool, so we can show
+    // them from our first frame
+    stopLoading();
+    std::vector<size_t> camerasToOpen;
+    for (size_t i = 0; i < mActiveCameras.size(); i++) {
+        ActiveCamera& cam = mActiveCameras[i];
         if (!cam.tex) {
-            ALOGE("Failed to set up video texture for %s (%s)",
-                  cam.info.cameraId.c_str(), cam.info.function.c_str());
-// TODO:  For production use, we may actually want to fail in this case, but not yet...
-//            return false;
+            cam.tex.reset(findPooledVideoTexture(cam.info.cameraId.c_str(), kFrameHistory));
+        }
+        if (cam.tex) {
+            cam.tex->setMaxFrameRate(mQuality.cameraFrameRate);
+        } else {
+            camerasToOpen.push_back(i);
         }
     }
 
+    // Everything else comes from the loader.  We keep our images between activations, so it
+    // only has to load those the first time.
+    const bool loadTextures = !mTexAssets.checkerBoard || !mTexAssets.carTopView;
+    mLoader = std::thread([this, loadTextures, camerasToOpen]() {
+        loadAssets(loadTextures, camerasToOpen);
+    });
+
     return true;
 }
 
 
+RenderTopView::~RenderTopView() {
+    stopLoading();
+}
+
+
 void RenderTopView::deactivate() {
-    // Release our video textures
-    // We can't hold onto it because some other Render object might need the same camera
-    // TODO(b/131492626):  investigate whether sharing video textures can save
-    // the time.
+    stopLoading();
+    releaseGeometry();
+    releaseScaledTarget();
+
+    // Release our video textures to the pool, since the next renderer may want the same cameras
     for (auto&& cam: mActiveCameras) {
-        cam.tex = nullptr;
+        releaseVideoTexture(std::move(cam.tex));
     }
 }
 
 
 bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
+    ATRACE_CALL();
+
     // Tell GL to render to the given buffer
     if (!attachRenderTarget(tgtBuffer)) {
         ALOGE("Failed to attached render target");
         return false;
     }
 
+    // Drawing fewer pixels and scaling them up costs the GPU a lot less than drawing every
+    // layer of the view at the display's resolution
+    GLint targetFrameBuffer = 0;
+    bool scaled = false;
+    if (mQuality.renderScale < 1.0f) {
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &targetFrameBuffer);
+        scaled = attachScaledTarget();
+        if (!scaled) {
+            glBindFramebuffer(GL_FRAMEBUFFER, targetFrameBuffer);
+            glViewport(0, 0, sWidth, sHeight);
+        }
+    } else {
+        releaseScaledTarget();
+    }
+
+    // Draw with whatever the loader has for us so far
+    adoptLoadedAssets();
+
     // Set up our top down projection matrix from car space (world units, Xfwd, Yright, Zup)
     // to view space (-1 to 1)
     const float top    = mConfig.getDisplayTopLocation();
@@ -196,39 +301,273 @@ bool RenderTopView::drawFrame(const BufferDesc& tgtBuffer) {
 //    orthoMatrix = android::mat4::ortho(left, right, bottom, top, near, far);
     orthoMatrix = android::mat4::ortho(left, right, top, bottom, near, far);
 
+    // The ground plane covers the display, so needs rebuilding if the display changes shape
+    if (mGeometry.groundAspectRatio != sAspectRatio) {
+        updateGroundGeometry();
+    }
+
+    // Refresh our video texture contents with frames that go together
+    showSynchronizedFrames();
+
+    renderGround();
+
+    // Draw the car image
+    renderCarTopView();
+
+    if (scaled) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, mScaledTarget.frameBuffer);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, targetFrameBuffer);
+        glBlitFramebuffer(0, 0, mScaledTarget.width, mScaledTarget.height,
+                          0, 0, sWidth, sHeight, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        glBindFramebuffer(GL_FRAMEBUFFER, targetFrameBuffer);
+    }
 
-    // Refresh our video texture contents.  We do it all at once in hopes of getting
-    // better coherence among images.  This does not guarantee synchronization, of course...
+    // Now that everythign is submitted, release our hold on the texture resource
+    detachRenderTarget();
+
+    return true;
+}
+
+
+//
+// The cameras aren't synchronized to one another, so their newest frames can have been captured
+// up to a frame period apart, and moving things don't line up where their images meet.  Each
+// camera holds a short history instead, and we show from each the frame that arrived closest to
+// the newest moment they all have a frame for.  A camera whose frames stop coming is left out,
+// so it can't hold the others back by more than kMaxSyncDelay.
+//
+// When we're asked to refresh only some of the cameras each frame, they take turns, and the rest
+// keep showing what they showed last time.
+//
+void RenderTopView::showSynchronizedFrames() {
+    ATRACE_CALL();
+
+    const size_t count = mActiveCameras.size();
+    if (count == 0) {
+        return;
+    }
+    const size_t refreshCount = (mQuality.camerasPerFrame > 0) ?
+                                std::min<size_t>(mQuality.camerasPerFrame, count) : count;
+    const size_t first = mNextRefresh % count;
+    mNextRefresh = (first + refreshCount) % count;
+    auto refreshed = [count, first, refreshCount](size_t i) {
+        return (i + count - first) % count < refreshCount;
+    };
+
+    nsecs_t newest = 0;
+    for (size_t i = 0; i < count; i++) {
+        ActiveCamera& cam = mActiveCameras[i];
+        if (cam.tex && refreshed(i)) {
+            cam.tex->takeNewFrame();
+            newest = std::max(newest, cam.tex->streamHandler()->getFrameTimestamp());
+        }
+    }
+    if (newest == 0) {
+        // No frames from anyone yet
+        return;
+    }
+
+    nsecs_t target = newest;
+    for (size_t i = 0; i < count; i++) {
+        const ActiveCamera& cam = mActiveCameras[i];
+        if (cam.tex && refreshed(i)) {
+            const nsecs_t latest = cam.tex->streamHandler()->getFrameTimestamp();
+            if (latest >= newest - kMaxSyncDelay) {
+                target = std::min(target, latest);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        ActiveCamera& cam = mActiveCameras[i];
+        if (cam.tex && refreshed(i)) {
+            cam.tex->showFrameNear(target);
+        }
+    }
+}
+
+
+void RenderTopView::setQuality(const Quality& quality) {
+    RenderBase::setQuality(quality);
     for (auto&& cam: mActiveCameras) {
         if (cam.tex) {
-            cam.tex->refresh();
+            cam.tex->setMaxFrameRate(quality.cameraFrameRate);
         }
     }
+}
+
 
-    // Iterate over all the cameras and project their images onto the ground plane
+bool RenderTopView::attachScaledTarget() {
+    const GLsizei width  = std::max(GLsizei(sWidth * mQuality.renderScale), 1);
+    const GLsizei height = std::max(GLsizei(sHeight * mQuality.renderScale), 1);
+
+    if (width != mScaledTarget.width || height != mScaledTarget.height) {
+        if (!mScaledTarget.frameBuffer) {
+            glGenFramebuffers(1, &mScaledTarget.frameBuffer);
+            glGenRenderbuffers(1, &mScaledTarget.colorBuffer);
+        }
+        glBindRenderbuffer(GL_RENDERBUFFER, mScaledTarget.colorBuffer);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, mScaledTarget.frameBuffer);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER,
+                                  mScaledTarget.colorBuffer);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+            // We'll just draw at full resolution
+            ALOGE("Failed to set up a %dx%d render target", width, height);
+            releaseScaledTarget();
+            return false;
+        }
+        mScaledTarget.width  = width;
+        mScaledTarget.height = height;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, mScaledTarget.frameBuffer);
+    glViewport(0, 0, width, height);
+    glClear(GL_COLOR_BUFFER_BIT);
+    return true;
+}
+
+
+void RenderTopView::releaseScaledTarget() {
+    if (!mScaledTarget.frameBuffer) {
+        return;
+    }
+
+    glDeleteFramebuffers(1, &mScaledTarget.frameBuffer);
+    glDeleteRenderbuffers(1, &mScaledTarget.colorBuffer);
+    mScaledTarget = {};
+}
+
+
+bool RenderTopView::waitForNewFrame(std::chrono::nanoseconds timeout) {
+    // Anything the loader has finished is worth a frame too.  It interrupts our wait to tell us.
+    if (mAssetsPending) {
+        return true;
+    }
+
+    std::vector<StreamHandler*> streams;
     for (auto&& cam: mActiveCameras) {
-        renderCameraOntoGroundPlane(cam);
+        if (cam.tex) {
+            streams.push_back(cam.tex->streamHandler());
+        }
     }
+    return StreamHandler::waitForNewFrame(streams, timeout) || mAssetsPending;
+}
 
-    // Draw the car image
-    renderCarTopView();
 
-    // Now that everythign is submitted, release our hold on the texture resource
-    detachRenderTarget();
+//
+// Runs on the loader thread to open our cameras and load our images, handing each one over
+// as soon as it's ready so the render thread can start showing it
+//
+void RenderTopView::loadAssets(bool loadTextures, const std::vector<size_t>& camerasToOpen) {
+    ATRACE_CALL();
+    EGLContext context = EGL_NO_CONTEXT;
+    EGLSurface surface = EGL_NO_SURFACE;
+    if (!attachSharedContext(context, surface)) {
+        ALOGE("Failed to set up GL for loading our assets");
+        return;
+    }
 
-    // Wait for the rendering to finish
-    glFinish();
-    detachRenderTarget();
-    return true;
+    auto handOver = [this]() {
+        mAssetsPending = true;
+        StreamHandler::interruptFrameWait();
+    };
+
+    if (loadTextures) {
+        // Load the checkerboard text image, then the car image
+        std::unique_ptr<TexWrapper> checkerBoard(createTextureAsset(
+                "/system/etc/automotive/evs/LabeledChecker.png"));
+        if (!checkerBoard) {
+            ALOGE("Failed to load checkerboard texture");
+        }
+        std::unique_ptr<TexWrapper> carTopView(createTextureAsset(
+                "/system/etc/automotive/evs/CarFromTop.png"));
+        if (!carTopView) {
+            ALOGE("Failed to load carTopView texture");
+        }
+
+        // The render thread may draw with these as soon as it has them
+        glFinish();
+        {
+            std::lock_guard<std::mutex> lock(mLoadLock);
+            mLoaded.checkerBoard = std::move(checkerBoard);
+            mLoaded.carTopView = std::move(carTopView);
+        }
+        handOver();
+    }
+
+    // Set up streaming video textures for our associated cameras
+    for (size_t n = 0; n < camerasToOpen.size() && !mStopLoading; n++) {
+        const size_t i = camerasToOpen[n];
+        const ConfigManager::CameraInfo& info = mActiveCameras[i].info;
+        std::unique_ptr<VideoTex> tex(acquireVideoTexture(mEnumerator, info.cameraId.c_str(),
+                                                          sDisplay, kFrameHistory));
+        if (!tex) {
+            ALOGE("Failed to set up video texture for %s (%s)",
+                  info.cameraId.c_str(), info.function.c_str());
+// TODO:  For production use, we may actually want to fail in this case, but not yet...
+            continue;
+        }
+
+        glFinish();
+        {
+            std::lock_guard<std::mutex> lock(mLoadLock);
+            mLoaded.cameraTex.emplace_back(i, std::move(tex));
+        }
+        handOver();
+    }
+
+    releaseSharedContext(context, surface);
+}
+
+
+void RenderTopView::stopLoading() {
+    if (mLoader.joinable()) {
+        mStopLoading = true;
+        mLoader.join();
+        mStopLoading = false;
+    }
+
+    // Anything finished but not yet taken on goes too
+    std::lock_guard<std::mutex> lock(mLoadLock);
+    mLoaded.checkerBoard.reset();
+    mLoaded.carTopView.reset();
+    for (auto&& loaded : mLoaded.cameraTex) {
+        releaseVideoTexture(std::move(loaded.second));
+    }
+    mLoaded.cameraTex.clear();
+    mAssetsPending = false;
+}
+
+
+void RenderTopView::adoptLoadedAssets() {
+    if (!mAssetsPending.exchange(false)) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(mLoadLock);
+    if (mLoaded.checkerBoard) {
+        mTexAssets.checkerBoard = std::move(mLoaded.checkerBoard);
+    }
+    if (mLoaded.carTopView) {
+        mTexAssets.carTopView = std::move(mLoaded.carTopView);
+        buildCarGeometry();
+    }
+    for (auto&& loaded : mLoaded.cameraTex) {
+        loaded.second->setMaxFrameRate(mQuality.cameraFrameRate);
+        mActiveCameras[loaded.first].tex = std::move(loaded.second);
+    }
+    mLoaded.cameraTex.clear();
 }
 
 
 //
-// Responsible for drawing the car's self image in the top down view.
-// Draws in car model space (units of meters with origin at center of rear axel)
-// NOTE:  We probably want to eventually switch to using a VertexArray based model system.
+// Builds the car's self image for the top down view, in car model space (units of meters with
+// origin at center of rear axel)
 //
-void RenderTopView::renderCarTopView() {
+void RenderTopView::buildCarGeometry() {
     // Compute the corners of our image footprint in car space
     const float carLengthInTexels = mConfig.carGraphicRearPixel() - mConfig.carGraphicFrontPixel();
     const float carSpaceUnitsPerTexel = mConfig.getCarLength() / carLengthInTexels;
@@ -244,29 +583,220 @@ void RenderTopView::renderCarTopView() {
     const float ltCS = 0.5f * textureHeightInCarSpace * textureAspectRatio;
     const float rtCS = -ltCS;
 
-    GLfloat vertsCarPos[] = { ltCS, tpCS, 0.0f,   // left top in car space
-                              rtCS, tpCS, 0.0f,   // right top
-                              ltCS, btCS, 0.0f,   // left bottom
-                              rtCS, btCS, 0.0f    // right bottom
-    };
+    // Positions in car space, then texture coordinates
     // NOTE:  We didn't flip the image in the texture, so V=0 is actually the top of the image
-    GLfloat vertsCarTex[] = { 0.0f, 0.0f,   // left top
-                              1.0f, 0.0f,   // right top
-                              0.0f, 1.0f,   // left bottom
-                              1.0f, 1.0f    // right bottom
+    const GLfloat verts[] = { ltCS, tpCS, 0.0f,   0.0f, 0.0f,     // left top
+                              rtCS, tpCS, 0.0f,   1.0f, 0.0f,     // right top
+                              ltCS, btCS, 0.0f,   0.0f, 1.0f,     // left bottom
+                              rtCS, btCS, 0.0f,   1.0f, 1.0f,     // right bottom
     };
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsCarPos);
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, vertsCarTex);
+    const GLsizei stride = 5 * sizeof(GLfloat);
+
+    if (!mGeometry.carVertexArray) {
+        glGenVertexArrays(1, &mGeometry.carVertexArray);
+        glGenBuffers(1, &mGeometry.carBuffer);
+    }
+    glBindVertexArray(mGeometry.carVertexArray);
+    glBindBuffer(GL_ARRAY_BUFFER, mGeometry.carBuffer);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(verts), verts, GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (const void*)(3 * sizeof(GLfloat)));
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+
+//
+// Works out where on the ground each camera's image can land, and builds just that polygon for
+// it to draw into instead of the whole visible ground plane.
+//
+void RenderTopView::updateGroundGeometry() {
+    // How far is the farthest any camera should even consider projecting it's image?
+    const float visibleSizeV = mConfig.getDisplayTopLocation() - mConfig.getDisplayBottomLocation();
+    const float visibleSizeH = visibleSizeV * sAspectRatio;
+    const float maxRange = (visibleSizeH > visibleSizeV) ? visibleSizeH : visibleSizeV;
+
+    // The part of the ground plane we can see
+    const float top = mConfig.getDisplayTopLocation();
+    const float bottom = mConfig.getDisplayBottomLocation();
+    const float wsHeight = top - bottom;
+    const float wsWidth = wsHeight * sAspectRatio;
+    const float right =  wsWidth * 0.5f;
+    const float left = -right;
+
+    const std::vector<android::vec2> visibleGround = {
+        android::vec2(left, top), android::vec2(right, top),
+        android::vec2(right, bottom), android::vec2(left, bottom),
+    };
 
+    for (auto&& cam: mActiveCameras) {
+        // Construct the projection matrix (View + Projection) associated with this sensor
+        // TODO:  Consider just hard coding the far plane distance as it likely doesn't matter
+        const android::mat4 V = getCameraViewMatrix(mConfig, cam.info);
+        const android::mat4 P = perspective(cam.info.hfov, cam.info.vfov, cam.info.position[Z],
+                                            maxRange);
+        const android::mat4& M = cam.projectionMatrix = P*V;
+
+        // A ground point (x, y, 0, 1) lands in the image where -w <= x, y <= w and w > 0, as the
+        // projectedTexture shader decides.  On the ground each of those bounds is a straight
+        // line, so the camera's footprint is the visible ground clipped to those lines.
+        // Column major, so M[col][row].
+        auto clipRow = [&M](unsigned row, float sign) {
+            return android::vec3(M[0][3] + sign * M[0][row],
+                                 M[1][3] + sign * M[1][row],
+                                 M[3][3] + sign * M[3][row]);
+        };
+        const android::vec3 bounds[] = {
+            clipRow(0, 1.0f), clipRow(0, -1.0f),    // -w <= x <= w
+            clipRow(1, 1.0f), clipRow(1, -1.0f),    // -w <= y <= w
+            clipRow(3, 0.0f) - android::vec3(0.0f, 0.0f, 1e-4f),   // w > 0
+        };
+        std::vector<android::vec2> footprint = visibleGround;
+        for (auto&& line : bounds) {
+            footprint = clipToHalfPlane(footprint, line.x, line.y, line.z);
+        }
+
+        std::vector<GLfloat> verts;
+        cam.groundWarped = cam.info.hasDistortion();
+        if (footprint.size() < 3) {
+            // Nothing to draw
+        } else if (!cam.groundWarped) {
+            // Drawn as a triangle fan, since the clipped polygon is convex
+            for (auto&& point : footprint) {
+                verts.insert(verts.end(), { point.x, point.y, 0.0f });
+            }
+        } else {
+            // The projection can't follow the lens on its own, so cut the footprint into cells
+            // and work out where each of their corners lands in the distorted image up front
+            auto addVertex = [&M, &cam, &verts](const android::vec2& point) {
+                const android::vec4 p = M * android::vec4(point.x, point.y, 0.0f, 1.0f);
+                const android::vec2 ideal((p.x / p.w + 1.0f) * 0.5f, (1.0f - p.y / p.w) * 0.5f);
+                const android::vec2 uv = distortTexCoord(cam.info, ideal);
+                verts.insert(verts.end(), { point.x, point.y, 0.0f, uv.x, uv.y });
+            };
+
+            android::vec2 minPoint = footprint[0];
+            android::vec2 maxPoint = footprint[0];
+            for (auto&& point : footprint) {
+                minPoint = android::vec2(std::min(minPoint.x, point.x),
+                                         std::min(minPoint.y, point.y));
+                maxPoint = android::vec2(std::max(maxPoint.x, point.x),
+                                         std::max(maxPoint.y, point.y));
+            }
+            const android::vec2 cellSize = (maxPoint - minPoint) * (1.0f / kGroundMeshCells);
+
+            // The footprint's edges as lines with its inside on their positive side
+            android::vec2 centroid(0.0f, 0.0f);
+            for (auto&& point : footprint) {
+                centroid = centroid + point * (1.0f / footprint.size());
+            }
+            std::vector<android::vec3> edges;
+            for (size_t i = 0; i < footprint.size(); i++) {
+                const android::vec2& p = footprint[i];
+                const android::vec2& q = footprint[(i + 1) % footprint.size()];
+                android::vec3 line(p.y - q.y, q.x - p.x, p.x * q.y - q.x * p.y);
+                if (line.x * centroid.x + line.y * centroid.y + line.z < 0.0f) {
+                    line = -line;
+                }
+                edges.push_back(line);
+            }
+
+            for (unsigned row = 0; row < kGroundMeshCells; row++) {
+                const float y0 = minPoint.y + cellSize.y * row;
+                const float y1 = y0 + cellSize.y;
+                for (unsigned col = 0; col < kGroundMeshCells; col++) {
+                    const float x0 = minPoint.x + cellSize.x * col;
+                    const float x1 = x0 + cellSize.x;
+                    std::vector<android::vec2> cell = {
+                        android::vec2(x0, y0), android::vec2(x1, y0),
+                        android::vec2(x1, y1), android::vec2(x0, y1),
+                    };
+                    for (auto&& line : edges) {
+                        cell = clipToHalfPlane(cell, line.x, line.y, line.z);
+                    }
+
+                    // What's left is still convex, so fan it out into separate triangles
+                    for (size_t i = 1; i + 1 < cell.size(); i++) {
+                        addVertex(cell[0]);
+                        addVertex(cell[i]);
+                        addVertex(cell[i + 1]);
+                    }
+                }
+            }
+        }
+        const unsigned floatsPerVertex = cam.groundWarped ? 5 : 3;
+        cam.groundVertexCount = verts.size() / floatsPerVertex;
+
+        if (!cam.groundVertexArray) {
+            glGenVertexArrays(1, &cam.groundVertexArray);
+            glGenBuffers(1, &cam.groundBuffer);
+        }
+        glBindVertexArray(cam.groundVertexArray);
+        glBindBuffer(GL_ARRAY_BUFFER, cam.groundBuffer);
+        glBufferData(GL_ARRAY_BUFFER, verts.size() * sizeof(GLfloat), verts.data(),
+                     GL_STATIC_DRAW);
+        const GLsizei stride = floatsPerVertex * sizeof(GLfloat);
+        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (const void*)0);
+        glEnableVertexAttribArray(0);
+        if (cam.groundWarped) {
+            glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride,
+                                  (const void*)(3 * sizeof(GLfloat)));
+            glEnableVertexAttribArray(1);
+        } else {
+            glDisableVertexAttribArray(1);
+        }
+    }
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    mGeometry.groundAspectRatio = sAspectRatio;
+}
+
+
+void RenderTopView::releaseGeometry() {
+    for (auto&& cam: mActiveCameras) {
+        glDeleteVertexArrays(1, &cam.groundVertexArray);
+        glDeleteBuffers(1, &cam.groundBuffer);
+        cam.groundVertexArray = 0;
+        cam.groundBuffer      = 0;
+        cam.groundVertexCount = 0;
+        cam.groundWarped      = false;
+    }
+
+    glDeleteVertexArrays(1, &mGeometry.carVertexArray);
+    glDeleteBuffers(1, &mGeometry.carBuffer);
+    mGeometry = {};
+}
+
+
+//
+// Iterates over all the cameras and projects their images onto the ground plane
+//
+void RenderTopView::renderGround() {
+    for (auto&& cam: mActiveCameras) {
+        renderCameraOntoGroundPlane(cam);
+    }
+}
+
+
+//
+// Responsible for drawing the car's self image in the top down view.
+//
+void RenderTopView::renderCarTopView() {
+    if (!mTexAssets.carTopView) {
+        // Not loaded yet
+        return;
+    }
+
+    glBindVertexArray(mGeometry.carVertexArray);
 
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
     glUseProgram(mPgmAssets.simpleTexture);
-    GLint loc = glGetUniformLocation(mPgmAssets.simpleTexture, "cameraMat");
-    glUniformMatrix4fv(loc, 1, false, orthoMatrix.asArray());
+    glUniformMatrix4fv(mPgmAssets.simpleCameraMat, 1, false, orthoMatrix.asArray());
     glBindTexture(GL_TEXTURE_2D, mTexAssets.carTopView->glId());
 
     glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
@@ -274,70 +804,45 @@ void RenderTopView::renderCarTopView() {
 
     glDisable(GL_BLEND);
 
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+    glBindVertexArray(0);
 }
 
 
-// NOTE:  Might be worth reviewing the ideas at
-// http://math.stackexchange.com/questions/1691895/inverse-of-perspective-matrix
-// to see if that simplifies the math, although we'll still want to compute the actual ground
-// interception points taking into account the pitchLimit as below.
 void RenderTopView::renderCameraOntoGroundPlane(const ActiveCamera& cam) {
-    // How far is the farthest any camera should even consider projecting it's image?
-    const float visibleSizeV = mConfig.getDisplayTopLocation() - mConfig.getDisplayBottomLocation();
-    const float visibleSizeH = visibleSizeV * sAspectRatio;
-    const float maxRange = (visibleSizeH > visibleSizeV) ? visibleSizeH : visibleSizeV;
-
-    // Construct the projection matrix (View + Projection) associated with this sensor
-    // TODO:  Consider just hard coding the far plane distance as it likely doesn't matter
-    const android::mat4 V = cameraLookMatrix(cam.info);
-    const android::mat4 P = perspective(cam.info.hfov, cam.info.vfov, cam.info.position[Z], maxRange);
-    const android::mat4 projectionMatix = P*V;
-
-    // Just draw the whole darn ground plane for now -- we're wasting fill rate, but so what?
-    // A 2x optimization would be to draw only the 1/2 space of the window in the direction
-    // the sensor is facing.  A more complex solution would be to construct the intersection
-    // of the sensor volume with the ground plane and render only that geometry.
-    const float top = mConfig.getDisplayTopLocation();
-    const float bottom = mConfig.getDisplayBottomLocation();
-    const float wsHeight = top - bottom;
-    const float wsWidth = wsHeight * sAspectRatio;
-    const float right =  wsWidth * 0.5f;
-    const float left = -right;
-
-    const android::vec3 topLeft(left, top, 0.0f);
-    const android::vec3 topRight(right, top, 0.0f);
-    const android::vec3 botLeft(left, bottom, 0.0f);
-    const android::vec3 botRight(right, bottom, 0.0f);
-
-    GLfloat vertsPos[] = { topLeft[X],  topLeft[Y],  topLeft[Z],
-                           topRight[X], topRight[Y], topRight[Z],
-                           botLeft[X],  botLeft[Y],  botLeft[Z],
-                           botRight[X], botRight[Y], botRight[Z],
-    };
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 0, vertsPos);
-    glEnableVertexAttribArray(0);
+    if (cam.groundVertexCount == 0) {
+        // None of the ground we're showing is in view of this camera
+        return;
+    }
 
+    glBindVertexArray(cam.groundVertexArray);
 
     glDisable(GL_BLEND);
 
-    glUseProgram(mPgmAssets.projectedTexture);
-    GLint locCam = glGetUniformLocation(mPgmAssets.projectedTexture, "cameraMat");
-    glUniformMatrix4fv(locCam, 1, false, orthoMatrix.asArray());
-    GLint locProj = glGetUniformLocation(mPgmAssets.projectedTexture, "projectionMat");
-    glUniformMatrix4fv(locProj, 1, false, projectionMatix.asArray());
+    if (cam.groundWarped) {
+        // The texture coordinates already account for the projection and the lens
+        glUseProgram(mPgmAssets.simpleTexture);
+        glUniformMatrix4fv(mPgmAssets.simpleCameraMat, 1, false, orthoMatrix.asArray());
+    } else {
+        glUseProgram(mPgmAssets.projectedTexture);
+        glUniformMatrix4fv(mPgmAssets.projectedCameraMat, 1, false, orthoMatrix.asArray());
+        glUniformMatrix4fv(mPgmAssets.projectedProjectionMat, 1, false,
+                           cam.projectionMatrix.asArray());
+    }
 
     GLuint texId;
     if (cam.tex) {
         texId = cam.tex->glId();
-    } else {
+    } else if (mTexAssets.checkerBoard) {
         texId = mTexAssets.checkerBoard->glId();
+    } else {
+        // Nothing to show here until the loader gets further
+        glBindVertexArray(0);
+        return;
     }
     glBindTexture(GL_TEXTURE_2D, texId);
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDrawArrays(cam.groundWarped ? GL_TRIANGLES : GL_TRIANGLE_FAN, 0, cam.groundVertexCount);
 
 
-    glDisableVertexAttribArray(0);
+    glBindVertexArray(0);
 }
@@ -26,6 +26,10 @@
 #include "VideoTex.h"
 #include <math/mat4.h>
 
+#include <atomic>
+#include <mutex>
+#include <thread>
+
 
 using namespace ::android::hardware::automotive::evs::V1_0;
 
@@ -38,20 +42,53 @@ public:
     RenderTopView(sp<IEvsEnumerator> enumerator,
                   const std::vector<ConfigManager::CameraInfo>& camList,
                   const ConfigManager& config);
+    virtual ~RenderTopView() override;
+
+    // Works out at startup what we'd otherwise work out from the configuration each time we're
+    // used, for the configuration to keep in its cache
+    static void putDerivedData(ConfigManager& config);
 
+    // Only the shader programs are ready when this returns.  The cameras and images follow
+    // from a loader thread, and we draw with placeholders until they arrive.
     virtual bool activate() override;
     virtual void deactivate() override;
 
     virtual bool drawFrame(const BufferDesc& tgtBuffer);
+    virtual bool waitForNewFrame(std::chrono::nanoseconds timeout) override;
+
+    virtual void setQuality(const Quality& quality) override;
 
 protected:
     struct ActiveCamera {
         const ConfigManager::CameraInfo&    info;
         std::unique_ptr<VideoTex>           tex;
 
+        // Where this camera's image lands on the ground, built along with the ground plane
+        android::mat4                       projectionMatrix;   // Car space to sensor space
+        GLuint                              groundVertexArray = 0;
+        GLuint                              groundBuffer      = 0;
+        GLsizei                             groundVertexCount = 0;  // Zero if none is visible
+        bool                                groundWarped      = false;  // Lens corrected UVs
+
         ActiveCamera(const ConfigManager::CameraInfo& c) : info(c) {};
     };
 
+    // The loader thread's work, with a GL context of its own that shares ours
+    void loadAssets(bool loadTextures, const std::vector<size_t>& camerasToOpen);
+    void stopLoading();
+    void adoptLoadedAssets();                // Takes on whatever the loader has finished
+
+    void showSynchronizedFrames();          // Brings in new frames, matched up across cameras
+
+    // Below full resolution we draw into a smaller buffer of our own, then scale it up
+    bool attachScaledTarget();
+    void releaseScaledTarget();
+
+    void buildCarGeometry();
+    virtual void updateGroundGeometry();    // When the display changes shape
+    void releaseGeometry();
+
+    virtual void renderGround();            // Everything under the car
     void renderCarTopView();
     void renderCameraOntoGroundPlane(const ActiveCamera& cam);
 
@@ -67,9 +104,42 @@ protected:
     struct {
         GLuint simpleTexture;
         GLuint projectedTexture;
+
+        // Uniform locations, looked up once the programs are built
+        GLint  simpleCameraMat;
+        GLint  projectedCameraMat;
+        GLint  projectedProjectionMat;
     } mPgmAssets;
 
+    // Our geometry never changes from frame to frame, so it lives in GL buffers
+    struct {
+        GLuint carVertexArray       = 0;
+        GLuint carBuffer            = 0;
+        float  groundAspectRatio    = 0.0f;     // Display shape the footprints were built for
+    } mGeometry;
+
     android::mat4   orthoMatrix;
+
+    struct {
+        GLuint  frameBuffer = 0;
+        GLuint  colorBuffer = 0;
+        GLsizei width       = 0;
+        GLsizei height      = 0;
+    } mScaledTarget;
+
+    size_t          mNextRefresh = 0;   // The first camera to show new frames next time, when
+                                        // only some of them do each frame
+
+    // What the loader has finished that we haven't taken on yet.  Guarded by mLoadLock.
+    struct {
+        std::unique_ptr<TexWrapper> checkerBoard;
+        std::unique_ptr<TexWrapper> carTopView;
+        std::vector<std::pair<size_t, std::unique_ptr<VideoTex>>> cameraTex;  // By camera index
+    } mLoaded;
+    std::mutex          mLoadLock;
+    std::atomic<bool>   mAssetsPending {false};     // Is there anything in mLoaded?
+    std::atomic<bool>   mStopLoading {false};
+    std::thread         mLoader;
 };
 
 
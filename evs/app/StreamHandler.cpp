@@ -15,20 +15,39 @@
  */
 
 #include "StreamHandler.h"
+#include "ExtendedInfo.h"
 
 #include <stdio.h>
 #include <string.h>
 
+#include <algorithm>
+
 #include <log/log.h>
 #include <cutils/native_handle.h>
+#include <utils/Trace.h>
+
+using ::android::automotive::evs::support::makeTraceCookie;
+using ::android::automotive::evs::V1_0::implementation::kExtendedInfoMaxFrameRate;
+
 
+// Each frame we hold shows on this async track, from its arrival until we send it back
+static const char kFrameTrack[] = "EVS app frame";
 
-StreamHandler::StreamHandler(android::sp <IEvsCamera> pCamera) :
-    mCamera(pCamera)
+std::mutex              StreamHandler::sWaitLock;
+std::condition_variable StreamHandler::sWaitSignal;
+uint64_t                StreamHandler::sWaitInterrupts = 0;
+
+
+StreamHandler::StreamHandler(android::sp <IEvsCamera> pCamera, unsigned maxHeldFrames) :
+    mCamera(pCamera),
+    mMaxHeldFrames(std::min(std::max(maxHeldFrames, 1u), kMaxSlots - 2)),
+    mFreeSlots((1u << kMaxSlots) - 1)
 {
-    // We rely on the camera having at least two buffers available since we'll hold one and
-    // expect the camera to be able to capture a new image in the background.
-    pCamera->setMaxFramesInFlight(2);
+    mHeldSlots.reserve(mMaxHeldFrames);
+
+    // We rely on the camera having a buffer beyond those our client holds, since we expect
+    // the camera to be able to capture a new image in the background.
+    pCamera->setMaxFramesInFlight(mMaxHeldFrames + 1);
 }
 
 
@@ -86,80 +105,161 @@ bool StreamHandler::isRunning() {
 }
 
 
+bool StreamHandler::setMaxFrameRate(unsigned framesPerSecond) {
+    Return<EvsResult> result = mCamera->setExtendedInfo(kExtendedInfoMaxFrameRate,
+                                                        static_cast<int32_t>(framesPerSecond));
+    if (!result.isOk() || result != EvsResult::OK) {
+        // Most likely the hardware camera itself rather than the manager
+        ALOGD("Camera didn't take a frame rate cap of %u", framesPerSecond);
+        return false;
+    }
+    return true;
+}
+
+
 bool StreamHandler::newFrameAvailable() {
-    std::unique_lock<std::mutex> lock(mLock);
-    return (mReadyBuffer >= 0);
+    return mReadySlot.load(std::memory_order_relaxed) != kNoSlot;
 }
 
 
 const BufferDesc& StreamHandler::getNewFrame() {
-    std::unique_lock<std::mutex> lock(mLock);
+    static const BufferDesc kNoBuffer = {};
 
-    if (mHeldBuffer >= 0) {
-        ALOGE("Ignored call for new frame while still holding the old one.");
-    } else {
-        if (mReadyBuffer < 0) {
-            ALOGE("Returning invalid buffer because we don't have any.  Call newFrameAvailable first?");
-            mReadyBuffer = 0;   // This is a lie!
-        }
+    if (mHeldSlots.size() >= mMaxHeldFrames) {
+        ALOGE("Ignored call for new frame while already holding %zu.", mHeldSlots.size());
+        return mSlots[mHeldSlots.back()].buffer;
+    }
 
-        // Move the ready buffer into the held position, and clear the ready position
-        mHeldBuffer = mReadyBuffer;
-        mReadyBuffer = -1;
+    // Take whatever is in the mailbox, leaving it empty
+    const int slot = mReadySlot.exchange(kNoSlot, std::memory_order_acquire);
+    if (slot == kNoSlot) {
+        ALOGE("Returning invalid buffer because we don't have any.  Call newFrameAvailable first?");
+        return kNoBuffer;
     }
 
-    return mBuffers[mHeldBuffer];
+    mHeldSlots.push_back(slot);
+    return mSlots[slot].buffer;
 }
 
 
-void StreamHandler::doneWithFrame(const BufferDesc& buffer) {
-    std::unique_lock<std::mutex> lock(mLock);
+nsecs_t StreamHandler::getFrameTimestamp() {
+    return mHeldSlots.empty() ? 0 : mSlots[mHeldSlots.back()].arrivalTime;
+}
+
 
-    // We better be getting back the buffer we original delivered!
-    if ((mHeldBuffer < 0) || (buffer.bufferId != mBuffers[mHeldBuffer].bufferId)) {
+void StreamHandler::doneWithFrame(const BufferDesc& buffer) {
+    auto it = std::find_if(mHeldSlots.begin(), mHeldSlots.end(),
+                           [this, &buffer](unsigned slot) {
+                               return mSlots[slot].buffer.bufferId == buffer.bufferId;
+                           });
+    if (it == mHeldSlots.end()) {
+        // We better be getting back a buffer we originally delivered!
         ALOGE("StreamHandler::doneWithFrame got an unexpected buffer!");
+        return;
     }
 
-    // Send the buffer back to the underlying camera
-    mCamera->doneWithFrame(mBuffers[mHeldBuffer]);
+    // Copy the frame out before its slot goes back to the delivery thread, then send it
+    // back to the underlying camera
+    const unsigned slot = *it;
+    const BufferDesc held = mSlots[slot].buffer;
+    mHeldSlots.erase(it);
+    releaseSlot(slot);
 
-    // Clear the held position
-    mHeldBuffer = -1;
+    ATRACE_ASYNC_END(kFrameTrack, makeTraceCookie(mTraceOwner, held.bufferId));
+    mCamera->doneWithFrame(held);
 }
 
 
-Return<void> StreamHandler::deliverFrame(const BufferDesc& buffer) {
-    ALOGD("Received a frame from the camera (%p)", buffer.memHandle.getNativeHandle());
+bool StreamHandler::waitForNewFrame(const std::vector<StreamHandler*>& handlers,
+                                    std::chrono::nanoseconds timeout) {
+    ATRACE_CALL();
+    auto frameReady = [&handlers]() {
+        return std::any_of(handlers.begin(), handlers.end(),
+                           [](StreamHandler* h) { return h->newFrameAvailable(); });
+    };
+
+    std::unique_lock<std::mutex> lock(sWaitLock);
+    const uint64_t interrupts = sWaitInterrupts;
+    sWaitSignal.wait_for(lock, timeout, [&]() {
+        return frameReady() || sWaitInterrupts != interrupts;
+    });
+    return frameReady();
+}
+
 
-    // Take the lock to protect our frame slots and running state variable
+void StreamHandler::interruptFrameWait() {
     {
-        std::unique_lock <std::mutex> lock(mLock);
+        std::lock_guard<std::mutex> lock(sWaitLock);
+        sWaitInterrupts++;
+    }
+    sWaitSignal.notify_all();
+}
+
+
+int StreamHandler::takeFreeSlot() {
+    // We're the only thread that takes slots, so the only thing that can change the mask under
+    // us is a slot being released
+    uint32_t freeSlots = mFreeSlots.load(std::memory_order_acquire);
+    while (freeSlots != 0) {
+        const unsigned slot = __builtin_ctz(freeSlots);
+        if (mFreeSlots.compare_exchange_weak(freeSlots, freeSlots & ~(1u << slot),
+                                             std::memory_order_acquire)) {
+            return slot;
+        }
+    }
+    return kNoSlot;
+}
+
 
-        if (buffer.memHandle.getNativeHandle() == nullptr) {
-            // Signal that the last frame has been received and the stream is stopped
+void StreamHandler::releaseSlot(unsigned slot) {
+    mFreeSlots.fetch_or(1u << slot, std::memory_order_release);
+}
+
+
+Return<void> StreamHandler::deliverFrame(const BufferDesc& buffer) {
+    ATRACE_CALL();
+    ALOGD("Received a frame from the camera (%p)", buffer.memHandle.getNativeHandle());
+    const nsecs_t arrivalTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    if (buffer.memHandle.getNativeHandle() == nullptr) {
+        // Signal that the last frame has been received and the stream is stopped
+        {
+            std::lock_guard<std::mutex> lock(mLock);
             mRunning = false;
-        } else {
-            // Do we already have a "ready" frame?
-            if (mReadyBuffer >= 0) {
-                // Send the previously saved buffer back to the camera unused
-                mCamera->doneWithFrame(mBuffers[mReadyBuffer]);
-
-                // We'll reuse the same ready buffer index
-            } else if (mHeldBuffer >= 0) {
-                // The client is holding a buffer, so use the other slot for "on deck"
-                mReadyBuffer = 1 - mHeldBuffer;
-            } else {
-                // This is our first buffer, so just pick a slot
-                mReadyBuffer = 0;
-            }
-
-            // Save this frame until our client is interested in it
-            mBuffers[mReadyBuffer] = buffer;
         }
+        mSignal.notify_all();
+        return Void();
     }
 
-    // Notify anybody who cares that things have changed
-    mSignal.notify_all();
+    const int slot = takeFreeSlot();
+    if (slot == kNoSlot) {
+        // The camera sent more frames than it should have, so this one goes straight back
+        ALOGE("No free slot for a new frame, so returning it unused");
+        mCamera->doneWithFrame(buffer);
+        return Void();
+    }
+
+    // Save this frame until our client is interested in it
+    mSlots[slot].buffer = buffer;
+    mSlots[slot].arrivalTime = arrivalTime;
+    ATRACE_ASYNC_BEGIN(kFrameTrack, makeTraceCookie(mTraceOwner, buffer.bufferId));
+
+    // Post it in the mailbox, and if the client never took the last one, send that back to
+    // the camera unused
+    const int replaced = mReadySlot.exchange(slot, std::memory_order_acq_rel);
+    if (replaced == kNoSlot) {
+        // The mailbox was empty, so anyone waiting for a frame needs to hear about this one.
+        // Passing through the lock makes sure a waiter can't miss it between checking our
+        // mailbox and going to sleep.
+        { std::lock_guard<std::mutex> lock(sWaitLock); }
+        sWaitSignal.notify_all();
+    } else {
+        const BufferDesc unused = mSlots[replaced].buffer;
+        releaseSlot(replaced);
+
+        ATRACE_ASYNC_END(kFrameTrack, makeTraceCookie(mTraceOwner, unused.bufferId));
+        mCamera->doneWithFrame(unused);
+    }
 
     return Void();
 }
@@ -17,14 +17,22 @@
 #ifndef EVS_VTS_STREAMHANDLER_H
 #define EVS_VTS_STREAMHANDLER_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
 #include <queue>
+#include <vector>
 
 #include "ui/GraphicBuffer.h"
+#include <utils/Timers.h>
 
 #include <android/hardware/automotive/evs/1.0/IEvsCameraStream.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <android/hardware/automotive/evs/1.0/IEvsDisplay.h>
 
+#include "TraceCookie.h"
+
 using namespace ::android::hardware::automotive::evs::V1_0;
 using ::android::hardware::Return;
 using ::android::hardware::Void;
@@ -39,12 +47,19 @@ using ::android::sp;
  * hold onto the most recent image buffer, returning older ones.
  * Note that the video frames are delivered on a background thread, while the control interface
  * is actuated from the applications foreground thread.
+ *
+ * Frames pass from the delivery thread to a single consuming thread through a fixed set of
+ * slots without taking a lock:  the newest frame sits in a one slot mailbox until the consumer
+ * takes it, and a newer frame arriving first sends it back to the camera unseen.  The consumer
+ * may hold several frames at once (for effects that blend frames over time), and gives each
+ * back with doneWithFrame() in any order.
  */
 class StreamHandler : public IEvsCameraStream {
 public:
     virtual ~StreamHandler() { shutdown(); };
 
-    StreamHandler(android::sp <IEvsCamera> pCamera);
+    // maxHeldFrames is how many frames the consumer may hold at once
+    StreamHandler(android::sp <IEvsCamera> pCamera, unsigned maxHeldFrames = 1);
     void shutdown();
 
     bool startStream();
@@ -53,28 +68,70 @@ public:
 
     bool isRunning();
 
+    // Asks the EVS manager to send us no more than this many frames per second, or every frame
+    // if it is 0.  Fails if we're talking to a camera that can't do that.
+    bool setMaxFrameRate(unsigned framesPerSecond);
+
+    // These are for the consuming thread only
     bool newFrameAvailable();
-    const BufferDesc& getNewFrame();
+    const BufferDesc& getNewFrame();    // Valid until it is given back with doneWithFrame()
+    nsecs_t getFrameTimestamp();    // When the newest held frame arrived here (CLOCK_MONOTONIC)
     void doneWithFrame(const BufferDesc& buffer);
 
+    // The frames the consumer holds, oldest first, for those keeping a short history to pick from
+    unsigned getMaxHeldFrames() const   { return mMaxHeldFrames; };
+    unsigned getHeldFrameCount() const  { return mHeldSlots.size(); };
+    const BufferDesc& getHeldFrame(unsigned i) const { return mSlots[mHeldSlots[i]].buffer; };
+    nsecs_t getHeldFrameTimestamp(unsigned i) const  { return mSlots[mHeldSlots[i]].arrivalTime; };
+
+    // Blocks until any of the given streams has a new frame, the timeout runs out, or another
+    // thread calls interruptFrameWait().  Returns true if a new frame is available.
+    static bool waitForNewFrame(const std::vector<StreamHandler*>& handlers,
+                                std::chrono::nanoseconds timeout);
+    static void interruptFrameWait();
+
 private:
     // Implementation for ::android::hardware::automotive::evs::V1_0::ICarCameraStream
     Return<void> deliverFrame(const BufferDesc& buffer)  override;
 
+    // Room for every frame the camera may have out with us, plus one being delivered
+    static const unsigned kMaxSlots = 8;
+    static const int kNoSlot = -1;
+
+    struct Slot {
+        BufferDesc  buffer;
+        nsecs_t     arrivalTime = 0;    // When it got to us
+    };
+
+    int takeFreeSlot();                 // Delivery thread only
+    void releaseSlot(unsigned slot);    // Either thread
+
     // Values initialized as startup
     android::sp <IEvsCamera>    mCamera;
+    const unsigned              mMaxHeldFrames;
 
-    // Since we get frames delivered to us asnchronously via the ICarCameraStream interface,
-    // we need to protect all member variables that may be modified while we're streaming
-    // (ie: those below)
+    // Protects the stream state (ie: the members just below), but not the frames
     std::mutex                  mLock;
     std::condition_variable     mSignal;
-
     bool                        mRunning = false;
 
-    BufferDesc                  mBuffers[2];
-    int                         mHeldBuffer = -1;   // Index of the one currently held by the client
-    int                         mReadyBuffer = -1;  // Index of the newest available buffer
+    // Each slot is at any time either free (owned by the delivery thread), in the mailbox,
+    // or held by the consumer.  Ownership changes hands only through these atomics.
+    Slot                        mSlots[kMaxSlots];
+    std::atomic<uint32_t>       mFreeSlots;             // Bit mask
+    std::atomic<int>            mReadySlot {kNoSlot};   // The mailbox
+
+    // Only touched by the consuming thread
+    std::vector<unsigned>       mHeldSlots;             // Oldest first
+
+    // Tells our trace spans apart from other StreamHandlers'.  See makeTraceCookie().
+    const unsigned              mTraceOwner =
+            ::android::automotive::evs::support::nextTraceOwner();
+
+    // Shared by every StreamHandler, so one thread can wait on frames from several cameras
+    static std::mutex               sWaitLock;
+    static std::condition_variable  sWaitSignal;
+    static uint64_t                 sWaitInterrupts;    // Protected by sWaitLock
 };
 
 
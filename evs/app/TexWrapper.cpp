@@ -21,6 +21,70 @@
 #include <fcntl.h>
 #include <malloc.h>
 #include <png.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <GLES3/gl3.h>
+
+#include <algorithm>
+#include <string>
+
+
+// The fixed size header at the start of every KTX version 1 file
+struct KtxHeader {
+    uint8_t     identifier[12];
+    uint32_t    endianness;
+    uint32_t    glType;                 // Zero for compressed formats
+    uint32_t    glTypeSize;
+    uint32_t    glFormat;               // Zero for compressed formats
+    uint32_t    glInternalFormat;
+    uint32_t    glBaseInternalFormat;
+    uint32_t    pixelWidth;
+    uint32_t    pixelHeight;
+    uint32_t    pixelDepth;
+    uint32_t    numberOfArrayElements;
+    uint32_t    numberOfFaces;
+    uint32_t    numberOfMipmapLevels;
+    uint32_t    bytesOfKeyValueData;
+};
+
+static const uint8_t kKtxIdentifier[12] = {
+    0xAB, 'K', 'T', 'X', ' ', '1', '1', 0xBB, '\r', '\n', 0x1A, '\n'
+};
+static const uint32_t kKtxNativeEndian = 0x04030201;
+
+
+// The bytes each pixel of an uncompressed level takes, or 0 for a layout we don't know
+static unsigned getKtxPixelSize(GLenum format, GLenum type) {
+    switch (type) {
+    case GL_UNSIGNED_SHORT_5_6_5:
+    case GL_UNSIGNED_SHORT_4_4_4_4:
+    case GL_UNSIGNED_SHORT_5_5_5_1:
+        return 2;
+    case GL_UNSIGNED_BYTE:
+        break;
+    default:
+        return 0;
+    }
+
+    switch (format) {
+    case GL_ALPHA:
+    case GL_LUMINANCE:
+    case GL_RED:
+        return 1;
+    case GL_LUMINANCE_ALPHA:
+    case GL_RG:
+        return 2;
+    case GL_RGB:
+        return 3;
+    case GL_RGBA:
+        return 4;
+    default:
+        return 0;
+    }
+}
 
 
 /* Create an new empty GL texture that will be filled later */
@@ -56,6 +120,128 @@ TexWrapper::~TexWrapper() {
 }
 
 
+/* Factory to build TexWrapper objects from a given KTX file */
+TexWrapper* createTextureFromKtx(const char* filename)
+{
+    // Map the whole file, so its image data can go to GL without a copy of our own
+    int fd = open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return nullptr;
+    }
+    struct stat info = {};
+    void* mapping = MAP_FAILED;
+    if (fstat(fd, &info) == 0 && (size_t)info.st_size >= sizeof(KtxHeader)) {
+        mapping = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("%s could not be mapped.\n", filename);
+        return nullptr;
+    }
+    const uint8_t* const fileStart = (const uint8_t*)mapping;
+    const uint8_t* const fileEnd = fileStart + info.st_size;
+
+    // We only handle plain 2D textures, written in our own byte order
+    const KtxHeader* header = (const KtxHeader*)fileStart;
+    if (memcmp(header->identifier, kKtxIdentifier, sizeof(kKtxIdentifier)) != 0 ||
+        header->endianness != kKtxNativeEndian ||
+        header->pixelWidth == 0 || header->pixelHeight == 0 || header->pixelDepth > 1 ||
+        header->numberOfArrayElements > 0 || header->numberOfFaces != 1) {
+        printf("%s is not a KTX 2D texture we can use.\n", filename);
+        munmap(mapping, info.st_size);
+        return nullptr;
+    }
+    const bool compressed = (header->glType == 0);
+    const unsigned levels = std::max(header->numberOfMipmapLevels, 1u);
+    const unsigned pixelSize = compressed ? 0 : getKtxPixelSize(header->glFormat, header->glType);
+    if ((!compressed && pixelSize == 0) || levels > 32 ||
+        header->bytesOfKeyValueData > info.st_size - sizeof(KtxHeader)) {
+        printf("%s is not a KTX 2D texture we can use.\n", filename);
+        munmap(mapping, info.st_size);
+        return nullptr;
+    }
+
+    // Set up the OpenGL texture to contain this image
+    GLuint textureId;
+    glGenTextures(1, &textureId);
+    glBindTexture(GL_TEXTURE_2D, textureId);
+
+    // Send each mip level to GL, each one preceded in the file by its size
+    const uint8_t* level = fileStart + sizeof(KtxHeader) + header->bytesOfKeyValueData;
+    bool valid = true;
+    for (unsigned i = 0; i < levels && valid; i++) {
+        uint32_t imageSize = 0;
+        if (level + sizeof(imageSize) > fileEnd) {
+            valid = false;
+            break;
+        }
+        memcpy(&imageSize, level, sizeof(imageSize));
+        level += sizeof(imageSize);
+        if (imageSize > (size_t)(fileEnd - level)) {
+            valid = false;
+            break;
+        }
+
+        const GLsizei width  = std::max(header->pixelWidth  >> i, 1u);
+        const GLsizei height = std::max(header->pixelHeight >> i, 1u);
+
+        // GL reads a whole image from what we give it, so the level must hold every row
+        const uint64_t rowSize = ((uint64_t)width * pixelSize + 3) & ~3ull;
+        if (!compressed && imageSize < rowSize * height) {
+            valid = false;
+            break;
+        }
+
+        if (compressed) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, i, header->glInternalFormat, width, height, 0,
+                                   imageSize, level);
+        } else {
+            // KTX pads rows to 4 bytes, which is what GL expects by default
+            glTexImage2D(GL_TEXTURE_2D, i, header->glInternalFormat, width, height, 0,
+                         header->glFormat, header->glType, level);
+        }
+        valid = (glGetError() == GL_NO_ERROR);
+
+        // Levels are padded out to 4 bytes as well
+        level += (imageSize + 3) & ~3u;
+    }
+    munmap(mapping, info.st_size);
+
+    if (!valid) {
+        // Most likely a compressed format this GPU doesn't support
+        printf("%s could not be loaded as a texture.\n", filename);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glDeleteTextures(1, &textureId);
+        return nullptr;
+    }
+
+    // Sample as we would from a PNG (see below), without relying on any mips we didn't get
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, levels - 1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    return new TexWrapper(textureId, header->pixelWidth, header->pixelHeight);
+}
+
+
+/* Factory to build TexWrapper objects from a prebaked KTX or, failing that, a PNG */
+TexWrapper* createTextureAsset(const char* pngFilename)
+{
+    std::string ktxFilename(pngFilename);
+    const size_t extension = ktxFilename.rfind(".png");
+    if (extension != std::string::npos) {
+        ktxFilename.replace(extension, std::string::npos, ".ktx");
+        TexWrapper* texture = createTextureFromKtx(ktxFilename.c_str());
+        if (texture) {
+            return texture;
+        }
+    }
+
+    return createTextureFromPng(pngFilename);
+}
+
+
 /* Factory to build TexWrapper objects from a given PNG file */
 TexWrapper* createTextureFromPng(const char * filename)
 {
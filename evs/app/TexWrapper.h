@@ -39,4 +39,12 @@ protected:
 
 TexWrapper* createTextureFromPng(const char* filename);
 
+// Loads a KTX (version 1) file, compressed formats like ETC2 or ASTC included, straight into a
+// texture.  Returns nullptr if the file is missing, malformed or in a format our GPU lacks.
+TexWrapper* createTextureFromKtx(const char* filename);
+
+// Loads the given PNG, preferring a prebaked .ktx of the same name alongside it when there is
+// one, since that needs no decoding and may well be smaller on the GPU
+TexWrapper* createTextureAsset(const char* pngFilename);
+
 #endif // TEXWRAPPER_H
\ No newline at end of file
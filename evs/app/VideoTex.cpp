@@ -13,8 +13,10 @@
  * See the License for the specific language governing permissions and
  * limitations under the License.
  */
+#include <mutex>
 #include <vector>
 #include <stdio.h>
+#include <stdlib.h>
 #include <fcntl.h>
 #include <alloca.h>
 #include <unistd.h>
@@ -26,6 +28,7 @@
 #include "glError.h"
 
 #include <ui/GraphicBuffer.h>
+#include <utils/Trace.h>
 
 // Eventually we shouldn't need this dependency, but for now the
 // graphics allocator interface isn't fully supported on all platforms
@@ -33,15 +36,18 @@
 using ::android::GraphicBuffer;
 
 
-VideoTex::VideoTex(sp<IEvsEnumerator> pEnum,
+VideoTex::VideoTex(const char* evsCameraId,
+                   sp<IEvsEnumerator> pEnum,
                    sp<IEvsCamera> pCamera,
                    sp<StreamHandler> pStreamHandler,
                    EGLDisplay glDisplay)
     : TexWrapper()
+    , mCameraId(evsCameraId)
     , mEnumerator(pEnum)
     , mCamera(pCamera)
     , mStreamHandler(pStreamHandler)
-    , mDisplay(glDisplay) {
+    , mDisplay(glDisplay)
+    , mEmptyTexture(id) {
     // Nothing but initialization here...
 }
 
@@ -52,84 +58,171 @@ VideoTex::~VideoTex() {
     // Close the camera
     mEnumerator->closeCamera(mCamera);
 
-    // Drop our device texture image
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
-    }
+    // Drop our device texture images, and leave TexWrapper the one texture it made
+    releaseBufferImages();
 }
 
 
 // Return true if the texture contents are changed
 bool VideoTex::refresh() {
-    if (!mStreamHandler->newFrameAvailable()) {
+    if (!takeNewFrame()) {
         // No new image has been delivered, so there's nothing to do here
         return false;
     }
 
-    // If we already have an image backing us, then it's time to return it
-    if (mImageBuffer.memHandle.getNativeHandle() != nullptr) {
-        // Drop our device texture image
-        if (mKHRimage != EGL_NO_IMAGE_KHR) {
-            eglDestroyImageKHR(mDisplay, mKHRimage);
-            mKHRimage = EGL_NO_IMAGE_KHR;
+    // Show the newest frame, which gives back every other one we hold
+    return showFrameNear(mStreamHandler->getFrameTimestamp());
+}
+
+
+bool VideoTex::takeNewFrame() {
+    if (!mStreamHandler->newFrameAvailable()) {
+        return false;
+    }
+
+    // Make room by giving back the oldest frame we hold.  Its texture stays in our cache for the
+    // next time the camera sends us this buffer.  Should we be showing it, our caller will pick
+    // another with showFrameNear() before drawing, since a newer one is now closer to any time
+    // still worth asking for.
+    if (mStreamHandler->getHeldFrameCount() >= mStreamHandler->getMaxHeldFrames()) {
+        mStreamHandler->doneWithFrame(mStreamHandler->getHeldFrame(0));
+    }
+
+    mStreamHandler->getNewFrame();
+    return true;
+}
+
+
+bool VideoTex::showFrameNear(nsecs_t timestamp) {
+    const unsigned count = mStreamHandler->getHeldFrameCount();
+    if (count == 0) {
+        return false;
+    }
+    ATRACE_NAME("VideoTex::showFrameNear");
+
+    // Our frames are oldest first, so take the last one no farther from the time than those
+    // before it
+    unsigned best = 0;
+    for (unsigned i = 1; i < count; i++) {
+        if (llabs(mStreamHandler->getHeldFrameTimestamp(i) - timestamp) <=
+            llabs(mStreamHandler->getHeldFrameTimestamp(best) - timestamp)) {
+            best = i;
         }
+    }
+
+    // Since times only move forward, nothing older than that will be wanted again
+    for (unsigned i = 0; i < best; i++) {
+        mStreamHandler->doneWithFrame(mStreamHandler->getHeldFrame(0));
+    }
+
+    const nsecs_t shownTimestamp = mStreamHandler->getHeldFrameTimestamp(0);
+    if (shownTimestamp == mShownTimestamp) {
+        // Still the frame we were already showing
+        return false;
+    }
+    mShownTimestamp = shownTimestamp;
+
+    BufferImage* bufferImage = findBufferImage(mStreamHandler->getHeldFrame(0));
+    if (bufferImage == nullptr) {
+        // Returning "true" in this error condition because we may have released the
+        // previous image and so the texture may change in unpredictable ways now!
+        id = mEmptyTexture;
+        return true;
+    }
+
+    id = bufferImage->texture;
+    return true;
+}
 
-        // Return it since we're done with it
-        mStreamHandler->doneWithFrame(mImageBuffer);
+
+void VideoTex::setMaxFrameRate(unsigned framesPerSecond) {
+    if (framesPerSecond != mMaxFrameRate) {
+        mMaxFrameRate = framesPerSecond;
+        mStreamHandler->setMaxFrameRate(framesPerSecond);
     }
+}
 
-    // Get the new image we want to use as our contents
-    mImageBuffer = mStreamHandler->getNewFrame();
 
+VideoTex::BufferImage* VideoTex::findBufferImage(const BufferDesc& buffer) {
+    BufferImage* cached = mBufferImages.find(buffer);
+    if (cached != nullptr) {
+        return cached;
+    }
+    ATRACE_NAME("VideoTex::createBufferImage");
 
     // create a GraphicBuffer from the existing handle
-    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(mImageBuffer.memHandle,
-                                                     GraphicBuffer::CLONE_HANDLE,
-                                                     mImageBuffer.width, mImageBuffer.height,
-                                                     mImageBuffer.format, 1, // layer count
-                                                     GRALLOC_USAGE_HW_TEXTURE,
-                                                     mImageBuffer.stride);
-    if (pGfxBuffer.get() == nullptr) {
+    BufferImage bufferImage = {};
+    bufferImage.graphicBuffer = new GraphicBuffer(buffer.memHandle,
+                                                  GraphicBuffer::CLONE_HANDLE,
+                                                  buffer.width, buffer.height,
+                                                  buffer.format, 1, // layer count
+                                                  GRALLOC_USAGE_HW_TEXTURE,
+                                                  buffer.stride);
+    if (bufferImage.graphicBuffer.get() == nullptr) {
         ALOGE("Failed to allocate GraphicBuffer to wrap image handle");
-        // Returning "true" in this error condition because we already released the
-        // previous image (if any) and so the texture may change in unpredictable ways now!
-        return true;
+        return nullptr;
     }
 
     // Get a GL compatible reference to the graphics buffer we've been given
     EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
-    EGLClientBuffer clientBuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-    mKHRimage = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
-                                  EGL_NATIVE_BUFFER_ANDROID, clientBuf,
-                                  eglImageAttributes);
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
+    EGLClientBuffer clientBuf =
+            static_cast<EGLClientBuffer>(bufferImage.graphicBuffer->getNativeBuffer());
+    bufferImage.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
+                                          EGL_NATIVE_BUFFER_ANDROID, clientBuf,
+                                          eglImageAttributes);
+    if (bufferImage.image == EGL_NO_IMAGE_KHR) {
         const char *msg = getEGLError();
         ALOGE("error creating EGLImage: %s", msg);
-    } else {
-        // Update the texture handle we already created to refer to this gralloc buffer
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, glId());
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
-
-        // Initialize the sampling properties (it seems the sample may not work if this isn't done)
-        // The user of this texture may very well want to set their own filtering, but we're going
-        // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
-        // if they forget.
-        // TODO:  Can we do this once for the texture ID rather than ever refresh?
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
-        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        return nullptr;
     }
 
-    return true;
+    // Give this buffer a texture of its own
+    glGenTextures(1, &bufferImage.texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, bufferImage.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(bufferImage.image));
+
+    // Initialize the sampling properties (it seems the sample may not work if this isn't done)
+    // The user of this texture may very well want to set their own filtering, but we're going
+    // to pay the (minor) price of setting this up for them to avoid the dreaded "black image"
+    // if they forget.
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    return mBufferImages.insert(buffer, bufferImage,
+                                [this](BufferImage& old) { releaseBufferImage(old); });
+}
+
+
+void VideoTex::releaseBufferImage(BufferImage& bufferImage) {
+    if (bufferImage.texture != 0) {
+        // We may have been showing this one
+        if (id == bufferImage.texture) {
+            id = mEmptyTexture;
+        }
+        glDeleteTextures(1, &bufferImage.texture);
+    }
+    if (bufferImage.image != EGL_NO_IMAGE_KHR) {
+        eglDestroyImageKHR(mDisplay, bufferImage.image);
+    }
+    bufferImage = {};
+}
+
+
+void VideoTex::releaseBufferImages() {
+    mBufferImages.clear([this](BufferImage& bufferImage) { releaseBufferImage(bufferImage); });
+
+    // None of the textures we might have been showing are left
+    id = mEmptyTexture;
 }
 
 
 VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
                              const char* evsCameraId,
-                             EGLDisplay glDisplay) {
+                             EGLDisplay glDisplay,
+                             unsigned frameHistory) {
     // Set up the camera to feed this texture
     sp<IEvsCamera> pCamera = pEnum->openCamera(evsCameraId);
     if (pCamera.get() == nullptr) {
@@ -138,7 +231,7 @@ VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
     }
 
     // Initialize the stream that will help us update this texture's contents
-    sp<StreamHandler> pStreamHandler = new StreamHandler(pCamera);
+    sp<StreamHandler> pStreamHandler = new StreamHandler(pCamera, frameHistory);
     if (pStreamHandler.get() == nullptr) {
         ALOGE("failed to allocate FrameHandler");
         return nullptr;
@@ -151,5 +244,98 @@ VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
         return nullptr;
     }
 
-    return new VideoTex(pEnum, pCamera, pStreamHandler, glDisplay);
+    return new VideoTex(evsCameraId, pEnum, pCamera, pStreamHandler, glDisplay);
+}
+
+
+// How long a video texture waits in the pool for a new owner before we close its camera
+static const std::chrono::milliseconds kPoolIdleTime(3000);
+
+struct PooledVideoTex {
+    std::unique_ptr<VideoTex>               tex;
+    std::chrono::steady_clock::time_point   releaseTime;
+};
+static std::mutex sPoolLock;
+static std::unordered_map<std::string, PooledVideoTex> sPool;   // By camera id
+
+
+VideoTex* acquireVideoTexture(sp<IEvsEnumerator> pEnum,
+                              const char* evsCameraId,
+                              EGLDisplay glDisplay,
+                              unsigned frameHistory) {
+    VideoTex* tex = findPooledVideoTexture(evsCameraId, frameHistory);
+    if (tex == nullptr) {
+        tex = createVideoTexture(pEnum, evsCameraId, glDisplay, frameHistory);
+    }
+    return tex;
+}
+
+
+VideoTex* findPooledVideoTexture(const char* evsCameraId, unsigned frameHistory) {
+    std::lock_guard<std::mutex> lock(sPoolLock);
+    auto it = sPool.find(evsCameraId);
+    if (it == sPool.end()) {
+        return nullptr;
+    }
+
+    // A texture holding too few frames stays put until it's replaced or times out
+    if (it->second.tex->streamHandler()->getMaxHeldFrames() < frameHistory) {
+        return nullptr;
+    }
+
+    VideoTex* tex = it->second.tex.release();
+    sPool.erase(it);
+    return tex;
+}
+
+
+void releaseVideoTexture(std::unique_ptr<VideoTex> tex) {
+    if (!tex) {
+        return;
+    }
+
+    // There's only ever one texture per camera, but if we somehow get a second, the one already
+    // waiting is simply destroyed
+    std::unique_ptr<VideoTex> replaced;
+    {
+        std::lock_guard<std::mutex> lock(sPoolLock);
+        PooledVideoTex& entry = sPool[tex->cameraId()];
+        replaced = std::move(entry.tex);
+        entry.tex = std::move(tex);
+        entry.releaseTime = std::chrono::steady_clock::now();
+    }
+    replaced.reset();
+}
+
+
+std::chrono::milliseconds releaseIdleVideoTextures(bool releaseAll) {
+    const auto now = std::chrono::steady_clock::now();
+    std::chrono::milliseconds nextDue = std::chrono::milliseconds::zero();
+
+    // Pull the expired ones out under the lock, but close their cameras after we let it go
+    std::vector<std::unique_ptr<VideoTex>> expired;
+    {
+        std::lock_guard<std::mutex> lock(sPoolLock);
+        for (auto it = sPool.begin(); it != sPool.end();) {
+            const auto idleTime = std::chrono::duration_cast<std::chrono::milliseconds>(
+                    now - it->second.releaseTime);
+            if (releaseAll || idleTime >= kPoolIdleTime) {
+                expired.push_back(std::move(it->second.tex));
+                it = sPool.erase(it);
+            } else {
+                const auto remaining = kPoolIdleTime - idleTime;
+                if (nextDue == std::chrono::milliseconds::zero() || remaining < nextDue) {
+                    nextDue = remaining;
+                }
+                ++it;
+            }
+        }
+    }
+
+    for (auto&& tex : expired) {
+        ALOGD("Releasing idle video texture for %s", tex->cameraId().c_str());
+    }
+    expired.clear();
+
+    return nextDue;
 }
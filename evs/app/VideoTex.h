@@ -25,9 +25,17 @@
 
 #include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
 
+#include "BufferCache.h"
 #include "TexWrapper.h"
 #include "StreamHandler.h"
 
+#include <ui/GraphicBuffer.h>
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <unordered_map>
+
 
 using namespace ::android::hardware::automotive::evs::V1_0;
 
@@ -35,7 +43,8 @@ using namespace ::android::hardware::automotive::evs::V1_0;
 class VideoTex: public TexWrapper {
     friend VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
                                         const char * evsCameraId,
-                                        EGLDisplay glDisplay);
+                                        EGLDisplay glDisplay,
+                                        unsigned frameHistory);
 
 public:
     VideoTex() = delete;
@@ -43,24 +52,77 @@ public:
 
     bool refresh();     // returns true if the texture contents were updated
 
+    // For lining up frames from several cameras:  takeNewFrame() adds any new frame to the short
+    // history we were created to keep, and showFrameNear() then switches to the one that arrived
+    // closest to the given time, giving back any older ones.  Times should only move forward.
+    bool takeNewFrame();
+    bool showFrameNear(nsecs_t timestamp);  // returns true if the texture contents were updated
+
+    // The most frames per second we want from the camera, or 0 for all of them.  Only bothers
+    // the camera when it changes.
+    void setMaxFrameRate(unsigned framesPerSecond);
+
+    StreamHandler* streamHandler() const { return mStreamHandler.get(); };
+    const std::string& cameraId() const { return mCameraId; };
+
 private:
-    VideoTex(sp<IEvsEnumerator> pEnum,
+    VideoTex(const char* evsCameraId,
+             sp<IEvsEnumerator> pEnum,
              sp<IEvsCamera> pCamera,
              sp<StreamHandler> pStreamHandler,
              EGLDisplay glDisplay);
 
+    // The camera cycles through a small set of buffers, so we wrap each one for GL just once,
+    // the first time we see it, and from then on only switch textures.
+    struct BufferImage {
+        sp<android::GraphicBuffer>      graphicBuffer;  // Keeps its own clone of the handle
+        EGLImageKHR                     image   = EGL_NO_IMAGE_KHR;
+        GLuint                          texture = 0;
+    };
+    BufferImage* findBufferImage(const BufferDesc& buffer);
+    void releaseBufferImage(BufferImage& bufferImage);
+    void releaseBufferImages();
+
+    // Comfortably more buffers than a camera cycles through
+    static const size_t kMaxBufferImages = 16;
+
+    std::string         mCameraId;
     sp<IEvsEnumerator>  mEnumerator;
     sp<IEvsCamera>      mCamera;
     sp<StreamHandler>   mStreamHandler;
-    BufferDesc          mImageBuffer;
+    nsecs_t             mShownTimestamp = 0;    // Tells which held frame we're showing
+    unsigned            mMaxFrameRate = 0;
 
     EGLDisplay          mDisplay;
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+
+    ::android::automotive::evs::support::BufferCache<BufferImage>
+                        mBufferImages {kMaxBufferImages};
+    GLuint              mEmptyTexture;  // Ours until the first frame, and TexWrapper's to delete
 };
 
 
+// frameHistory is how many recent frames the texture holds for showFrameNear() to pick from.
+// Only renderers that line up several cameras need more than the one being shown.
 VideoTex* createVideoTexture(sp<IEvsEnumerator> pEnum,
                              const char * deviceName,
-                             EGLDisplay glDisplay);
+                             EGLDisplay glDisplay,
+                             unsigned frameHistory = 1);
+
+// Renderers come and go with the vehicle state, but the next one often wants the same cameras as
+// the last.  So instead of closing a camera when they're done with it, renderers hand its video
+// texture back to a pool, stream still running, where it waits a few seconds for a new owner.
+// A pooled texture is only handed out if it keeps at least the history asked for.  Safe to call
+// from any thread.
+VideoTex* acquireVideoTexture(sp<IEvsEnumerator> pEnum,
+                              const char* evsCameraId,
+                              EGLDisplay glDisplay,
+                              unsigned frameHistory = 1);
+VideoTex* findPooledVideoTexture(const char* evsCameraId,   // Never opens the camera
+                                 unsigned frameHistory = 1);
+void releaseVideoTexture(std::unique_ptr<VideoTex> tex);
+
+// Destroys the pooled textures that have waited too long (or all of them), so call it where they
+// were used in GL.  Returns how long until the next one is due to go, or zero if none are left.
+std::chrono::milliseconds releaseIdleVideoTextures(bool releaseAll = false);
 
 #endif // VIDEOTEX_H
\ No newline at end of file
@@ -14,7 +14,9 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <stdio.h>
+#include <stdlib.h>
 
 #include <hidl/HidlTransportSupport.h>
 #include <utils/Errors.h>
@@ -31,12 +33,17 @@
 #include "EvsStateControl.h"
 #include "EvsVehicleListener.h"
 #include "ConfigManager.h"
+#include "ConversionPool.h"
+#include "RenderPixelCopy.h"
+#include "RenderTopView.h"
 
 
 // libhidl:
 using android::hardware::configureRpcThreadpool;
 using android::hardware::joinRpcThreadpool;
 
+using ::android::automotive::evs::support::ConversionPool;
+
 
 // Helper to subscribe to VHal notifications
 static bool subscribeToVHal(sp<IVehicle> pVnet,
@@ -81,6 +88,16 @@ int main(int argc, char** argv)
             evsServiceName = "EvsEnumeratorHw";
         } else if (strcmp(argv[i], "--mock") == 0) {
             evsServiceName = "EvsEnumeratorHw-Mock";
+        } else if (strcmp(argv[i], "--pixel-copy-threads") == 0) {
+            i++;
+            unsigned threads = 0;
+            if (i >= argc || !ConversionPool::parseThreadCount(argv[i], &threads)) {
+                printf("--pixel-copy-threads <count> was not provided with a count from 1 to %u\n",
+                       ConversionPool::kMaxBands);
+                printHelp = true;
+            } else {
+                RenderPixelCopy::setConversionThreads(threads);
+            }
         } else if (strcmp(argv[i], "--help") == 0) {
             printHelp = true;
         } else {
@@ -93,6 +110,7 @@ int main(int argc, char** argv)
         printf("  --test   Do not talk to Vehicle Hal, but simulate 'reverse' instead\n");
         printf("  --hw     Bypass EvsManager by connecting directly to EvsEnumeratorHw\n");
         printf("  --mock   Connect directly to EvsEnumeratorHw-Mock\n");
+        printf("  --pixel-copy-threads <count>  Split CPU pixel copies over <count> threads\n");
     }
 
     // Load our configuration information
@@ -101,6 +119,8 @@ int main(int argc, char** argv)
         ALOGE("Missing or improper configuration for the EVS application.  Exiting.");
         return 1;
     }
+    RenderTopView::putDerivedData(config);
+    config.flushCache();
 
     // Set thread pool size to one to avoid concurrent events from the HAL.
     // This pool will handle the EvsCameraStream callbacks.
@@ -20,7 +20,8 @@
 #include <GLES2/gl2.h>
 
 
-// Create a program object given vertex and pixels shader source
+// Create a program object given vertex and pixels shader source.  Linked programs are cached
+// on disk, so later starts skip compiling and linking.
 GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc, const char* name);
 
 #endif // SHADER_H
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHADER_STITCHED_TEX_H
+#define SHADER_STITCHED_TEX_H
+
+// This shader composes the ground from up to four camera images in a single pass.
+// Layer N of the remap texture gives, for each point on the ground, where it falls in camera N's
+// image (xy) and how much that camera contributes there (z).  The weights at each point add up
+// to one where any camera sees it, and are zero wherever a camera doesn't.
+
+const char vtxShader_stitchedTexture[] = ""
+        "#version 300 es                    \n"
+        "layout(location = 0) in vec4 pos;  \n"
+        "layout(location = 1) in vec2 tex;  \n"
+        "uniform mat4 cameraMat;            \n"
+        "out highp vec2 remapCoord;         \n"
+        "void main()                        \n"
+        "{                                  \n"
+        "   gl_Position = cameraMat * pos;  \n"
+        "   remapCoord = tex;               \n"
+        "}                                  \n";
+
+const char pixShader_stitchedTexture[] =
+        "#version 300 es                                                \n"
+        "precision mediump float;                                       \n"
+        "uniform highp sampler2DArray remap;                            \n"
+        "uniform sampler2D cam0;                                        \n"
+        "uniform sampler2D cam1;                                        \n"
+        "uniform sampler2D cam2;                                        \n"
+        "uniform sampler2D cam3;                                        \n"
+        "in highp vec2 remapCoord;                                      \n"
+        "out vec4 color;                                                \n"
+        "                                                               \n"
+        "vec3 contribution(sampler2D cam, float layer)                  \n"
+        "{                                                              \n"
+        "    highp vec3 m = texture(remap, vec3(remapCoord, layer)).xyz;\n"
+        "    return m.z * texture(cam, m.xy).rgb;                       \n"
+        "}                                                              \n"
+        "                                                               \n"
+        "void main()                                                    \n"
+        "{                                                              \n"
+        "    color = vec4(contribution(cam0, 0.0) +                     \n"
+        "                 contribution(cam1, 1.0) +                     \n"
+        "                 contribution(cam2, 2.0) +                     \n"
+        "                 contribution(cam3, 3.0), 1.0);                \n"
+        "}                                                              \n";
+
+#endif // SHADER_STITCHED_TEX_H
@@ -0,0 +1,77 @@
+
+LOCAL_PATH:= $(call my-dir)
+
+##################################
+# Frame latency through the EVS stack
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    LatencyBenchmark.cpp \
+    StageTimes.cpp \
+    SyntheticCamera.cpp \
+    ../manager/HalCamera.cpp \
+    ../manager/VirtualCamera.cpp \
+    ../manager/FrameStats.cpp \
+    ../manager/FrameExporter.cpp \
+    ../manager/FrameRecorder.cpp \
+    ../manager/SeqpacketServer.cpp \
+    ../sampleDriver/bufferCopy.cpp \
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../manager \
+    $(LOCAL_PATH)/../sampleDriver \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libEGL \
+    libGLESv2 \
+    liblog \
+    libmediandk \
+    libnativewindow \
+    libutils \
+    libui \
+    libhidlbase \
+    libhidltransport \
+    libhwbinder \
+    android.hardware.automotive.evs@1.0 \
+
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
+
+LOCAL_MODULE := evs_latency_benchmark
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -DLOG_TAG=\"EvsBenchmark\"
+LOCAL_CFLAGS += -DATRACE_TAG=ATRACE_TAG_CAMERA
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_EXECUTABLE)
+
+
+##################################
+# Throughput of the per frame pixel format conversions
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    FormatBenchmark.cpp \
+    ../app/FormatConvert.cpp \
+    ../sampleDriver/bufferCopy.cpp \
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../app \
+    $(LOCAL_PATH)/../sampleDriver \
+
+LOCAL_SHARED_LIBRARIES := \
+    libhidlbase \
+    libutils \
+    android.hardware.automotive.evs@1.0 \
+
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
+
+LOCAL_MODULE := evs_format_benchmark
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_BENCHMARK)
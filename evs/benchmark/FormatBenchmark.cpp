@@ -0,0 +1,288 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures the pixel format conversions the EVS app (FormatConvert) and the sample driver
+// (bufferCopy) run on every frame.  Each kernel is timed at the frame sizes we see in practice,
+// with packed rows, padded rows and rows that don't start on a cache line.  Besides the usual
+// bytes per second, we report pixels per second and, where the kernel lets us read the cycle
+// counter, CPU cycles per pixel.
+
+#include <benchmark/benchmark.h>
+
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include "FormatConvert.h"
+#include "bufferCopy.h"
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+namespace driver = ::android::hardware::automotive::evs::V1_0::implementation;
+
+
+// How the test images are laid out in memory (the third benchmark argument)
+enum Layout {
+    kPacked     = 0,    // Rows exactly as wide as the image, starting on a cache line
+    kPadded     = 1,    // Rows padded out past the next multiple of 64 pixels, as gralloc may do
+    kUnaligned  = 2,    // Packed rows, but the image starts 4 bytes past a cache line
+};
+
+static const uintptr_t kCacheLine = 64;
+
+
+// Pixels per row of an image of the given width in the given layout.  The NV21 and YV12
+// layouts fix their own strides from the width, so this only applies to the interleaved ones.
+static unsigned rowPixels(unsigned width, Layout layout) {
+    return (layout == kPadded) ? (width + 64) & ~63u : width;
+}
+
+
+// A buffer of noise placed as the layout asks.  Noise, so no kernel gets to benefit from runs
+// of identical pixels.
+class TestImage {
+public:
+    TestImage(size_t bytes, Layout layout) : mStorage(bytes + 2 * kCacheLine) {
+        uintptr_t start = ((uintptr_t)mStorage.data() + kCacheLine - 1) & ~(kCacheLine - 1);
+        if (layout == kUnaligned) {
+            // Our kernels all read and write whole 32 bit words, so stay word aligned
+            start += 4;
+        }
+        mData = (uint8_t*)start;
+
+        uint32_t seed = 1;
+        for (size_t i = 0; i < bytes; i++) {
+            seed = seed * 1103515245 + 12345;
+            mData[i] = seed >> 16;
+        }
+    };
+
+    uint8_t* data() { return mData; };
+
+private:
+    std::vector<uint8_t>    mStorage;
+    uint8_t*                mData;
+};
+
+
+// Counts the CPU cycles spent by this thread in user space, where perf lets us
+class CycleCounter {
+public:
+    CycleCounter() {
+        perf_event_attr attr = {};
+        attr.type           = PERF_TYPE_HARDWARE;
+        attr.size           = sizeof(attr);
+        attr.config         = PERF_COUNT_HW_CPU_CYCLES;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv     = 1;
+        mFd = syscall(__NR_perf_event_open, &attr, 0 /* this thread */, -1 /* any cpu */,
+                      -1 /* no group */, 0);
+    };
+    ~CycleCounter() {
+        if (mFd >= 0) {
+            close(mFd);
+        }
+    };
+
+    bool valid() const { return mFd >= 0; };
+    uint64_t read() const {
+        uint64_t count = 0;
+        if (mFd >= 0 && ::read(mFd, &count, sizeof(count)) != sizeof(count)) {
+            count = 0;
+        }
+        return count;
+    };
+
+private:
+    int mFd;
+};
+
+
+// Runs the given conversion of one frame for as long as the benchmark wants, then reports the
+// rates for the run.  bytesPerFrame is what one conversion reads plus what it writes.
+template <typename Conversion>
+static void measure(benchmark::State& state, size_t bytesPerFrame, Conversion convert) {
+    const uint64_t pixelsPerFrame = (uint64_t)state.range(0) * state.range(1);
+
+    CycleCounter cycles;
+    const uint64_t startCycles = cycles.read();
+    for (auto _ : state) {
+        convert();
+        benchmark::ClobberMemory();
+    }
+    const uint64_t elapsedCycles = cycles.read() - startCycles;
+
+    const uint64_t pixels = state.iterations() * pixelsPerFrame;
+    state.SetBytesProcessed(state.iterations() * bytesPerFrame);
+    state.counters["pixels/s"] = benchmark::Counter(pixels, benchmark::Counter::kIsRate);
+    if (cycles.valid() && pixels > 0) {
+        state.counters["cycles/pixel"] = (double)elapsedCycles / pixels;
+    }
+}
+
+
+// Describes a target buffer the way the driver's fill functions expect
+static BufferDesc makeTarget(unsigned width, unsigned height, unsigned stride,
+                             unsigned pixelSize) {
+    BufferDesc buff = {};
+    buff.width     = width;
+    buff.height    = height;
+    buff.stride    = stride;
+    buff.pixelSize = pixelSize;
+    return buff;
+}
+
+
+//
+// FormatConvert, from the EVS app
+//
+
+static void BM_copyNV21toRGB32(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned dstStride = rowPixels(width, layout);
+
+    TestImage src(width * height * 3 / 2, layout);
+    TestImage dst(dstStride * height * 4, layout);
+    measure(state, width * height * 3 / 2 + width * height * 4, [&]() {
+        copyNV21toRGB32(width, height, src.data(), (uint32_t*)dst.data(), dstStride, 0, height);
+    });
+}
+
+static void BM_copyYV12toRGB32(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned dstStride = rowPixels(width, layout);
+
+    TestImage src(width * height * 3 / 2, layout);
+    TestImage dst(dstStride * height * 4, layout);
+    measure(state, width * height * 3 / 2 + width * height * 4, [&]() {
+        copyYV12toRGB32(width, height, src.data(), (uint32_t*)dst.data(), dstStride, 0, height);
+    });
+}
+
+static void BM_copyYUYVtoRGB32(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned stride = rowPixels(width, layout);
+
+    TestImage src(stride * height * 2, layout);
+    TestImage dst(stride * height * 4, layout);
+    measure(state, width * height * (2 + 4), [&]() {
+        copyYUYVtoRGB32(width, height, src.data(), stride, (uint32_t*)dst.data(), stride,
+                        0, height);
+    });
+}
+
+
+//
+// bufferCopy, from the sample driver
+//
+
+static void BM_fillNV21FromNV21(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const BufferDesc tgtBuff = makeTarget(width, height, width, 1);
+
+    TestImage src(width * height * 3 / 2, layout);
+    TestImage dst(width * height * 3 / 2, layout);
+    measure(state, width * height * 3, [&]() {
+        driver::fillNV21FromNV21(tgtBuff, dst.data(), src.data(), width, 0, height);
+    });
+}
+
+static void BM_fillNV21FromYUYV(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned srcStride = rowPixels(width, layout);
+    const BufferDesc tgtBuff = makeTarget(width, height, width, 1);
+
+    TestImage src(srcStride * height * 2, layout);
+    TestImage dst(width * height * 3 / 2, layout);
+    measure(state, width * height * 2 + width * height * 3 / 2, [&]() {
+        driver::fillNV21FromYUYV(tgtBuff, dst.data(), src.data(), srcStride * 2, 0, height);
+    });
+}
+
+static void BM_fillRGBAFromYUYV(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned stride = rowPixels(width, layout);
+    const BufferDesc tgtBuff = makeTarget(width, height, stride, 4);
+
+    TestImage src(stride * height * 2, layout);
+    TestImage dst(stride * height * 4, layout);
+    measure(state, width * height * (2 + 4), [&]() {
+        driver::fillRGBAFromYUYV(tgtBuff, dst.data(), src.data(), stride * 2, 0, height);
+    });
+}
+
+static void BM_fillYUYVFromYUYV(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned stride = rowPixels(width, layout);
+    const BufferDesc tgtBuff = makeTarget(width, height, stride, 2);
+
+    TestImage src(stride * height * 2, layout);
+    TestImage dst(stride * height * 2, layout);
+    measure(state, width * height * (2 + 2), [&]() {
+        driver::fillYUYVFromYUYV(tgtBuff, dst.data(), src.data(), stride * 2, 0, height);
+    });
+}
+
+static void BM_fillYUYVFromUYVY(benchmark::State& state) {
+    const unsigned width = state.range(0), height = state.range(1);
+    const Layout layout = (Layout)state.range(2);
+    const unsigned stride = rowPixels(width, layout);
+    const BufferDesc tgtBuff = makeTarget(width, height, stride, 2);
+
+    TestImage src(stride * height * 2, layout);
+    TestImage dst(stride * height * 2, layout);
+    measure(state, width * height * (2 + 2), [&]() {
+        driver::fillYUYVFromUYVY(tgtBuff, dst.data(), src.data(), stride * 2, 0, height);
+    });
+}
+
+
+// Every kernel runs at each of these frame sizes, in each layout
+static void frameVariants(benchmark::internal::Benchmark* b) {
+    static const int kFrameSizes[][2] = {
+        {  720,  240 },     // The sample driver's default capture size
+        { 1280,  720 },
+        { 1920, 1080 },
+    };
+
+    b->ArgNames({"width", "height", "layout"});
+    for (auto&& size : kFrameSizes) {
+        for (int layout : { kPacked, kPadded, kUnaligned }) {
+            b->Args({ size[0], size[1], layout });
+        }
+    }
+}
+
+BENCHMARK(BM_copyNV21toRGB32)->Apply(frameVariants);
+BENCHMARK(BM_copyYV12toRGB32)->Apply(frameVariants);
+BENCHMARK(BM_copyYUYVtoRGB32)->Apply(frameVariants);
+BENCHMARK(BM_fillNV21FromNV21)->Apply(frameVariants);
+BENCHMARK(BM_fillNV21FromYUYV)->Apply(frameVariants);
+BENCHMARK(BM_fillRGBAFromYUYV)->Apply(frameVariants);
+BENCHMARK(BM_fillYUYVFromYUYV)->Apply(frameVariants);
+BENCHMARK(BM_fillYUYVFromUYVY)->Apply(frameVariants);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,366 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Measures how long frames take to get through the EVS stack.  By default a synthetic camera
+// feeds the manager's own HalCamera and VirtualCamera classes in this process, so every stage
+// from capture to the buffer coming back can be timed.  With --service, we are an ordinary
+// client of a running EVS service instead, and can only time what a client sees.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <hidl/HidlTransportSupport.h>
+#include <utils/Errors.h>
+#include <utils/StrongPointer.h>
+#include <utils/Log.h>
+
+#include <android/hardware/automotive/evs/1.0/IEvsEnumerator.h>
+
+#include <condition_variable>
+#include <deque>
+#include <inttypes.h>
+#include <string>
+#include <vector>
+
+#include "HalCamera.h"
+#include "VirtualCamera.h"
+#include "StageTimes.h"
+#include "SyntheticCamera.h"
+
+using android::hardware::configureRpcThreadpool;
+using android::hardware::hidl_vec;
+using android::automotive::evs::V1_0::implementation::HalCamera;
+using android::automotive::evs::V1_0::implementation::VirtualCamera;
+
+
+// How long we'll wait for a stream to wind down once we've asked it to stop
+static const nsecs_t kStopTimeout = s2ns(2);
+
+
+/*
+ * BenchmarkClient:
+ * Receives a camera stream the way StreamHandler does, holding each frame for a set time (as
+ * if rendering it) before a separate thread gives it back, and times the client side stages.
+ */
+class BenchmarkClient : public IEvsCameraStream {
+public:
+    BenchmarkClient(sp<IEvsCamera> camera, sp<SyntheticCamera> source, nsecs_t holdTime) :
+            mCamera(camera), mSource(source), mHoldTime(holdTime) {};
+
+    bool start();
+    void stop();
+    void report(unsigned index, nsecs_t elapsed) const;
+
+    // Implementation for ::android::hardware::automotive::evs::V1_0::IEvsCameraStream
+    Return<void> deliverFrame(const BufferDesc& buffer) override;
+
+private:
+    void returnFrames();
+
+    struct HeldFrame {
+        BufferDesc  buffer;
+        nsecs_t     arrivalTime;
+    };
+
+    sp<IEvsCamera>          mCamera;
+    sp<SyntheticCamera>     mSource;    // Null unless the frames come from a SyntheticCamera
+    const nsecs_t           mHoldTime;
+
+    std::mutex              mLock;
+    std::condition_variable mSignal;
+    std::deque<HeldFrame>   mHeldFrames;
+    bool                    mRunning = false;
+    bool                    mStreamEnded = false;
+    nsecs_t                 mLastArrival = 0;
+    std::thread             mReturnThread;
+
+    std::atomic<uint64_t>   mFramesReceived {0};
+    StageTimes              mForwardToClient    {"forwardFrame -> client"};
+    StageTimes              mArrivalInterval    {"client frame interval"};
+    StageTimes              mHoldTimes          {"client hold"};
+    StageTimes              mDoneCall           {"doneWithFrame call"};
+};
+
+
+bool BenchmarkClient::start() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mRunning = true;
+        mStreamEnded = false;
+    }
+    mReturnThread = std::thread([this]() { returnFrames(); });
+
+    if (mCamera->startVideoStream(this) != EvsResult::OK) {
+        ALOGE("Failed to start the video stream");
+        stop();
+        return false;
+    }
+    return true;
+}
+
+
+void BenchmarkClient::stop() {
+    mCamera->stopVideoStream();
+
+    // Frames can still arrive until the stream tells us it has ended
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!mSignal.wait_for(lock, std::chrono::nanoseconds(kStopTimeout),
+                          [this]() { return mStreamEnded; })) {
+        ALOGW("Timed out waiting for the end of the stream");
+    }
+    mRunning = false;
+    lock.unlock();
+    mSignal.notify_all();
+
+    if (mReturnThread.joinable()) {
+        mReturnThread.join();
+    }
+}
+
+
+Return<void> BenchmarkClient::deliverFrame(const BufferDesc& buffer) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (buffer.memHandle == nullptr) {
+        mStreamEnded = true;
+    } else {
+        if (mSource != nullptr) {
+            mForwardToClient.record(now - mSource->getForwardTime(buffer.bufferId));
+        }
+        if (mLastArrival != 0) {
+            mArrivalInterval.record(now - mLastArrival);
+        }
+        mLastArrival = now;
+        mFramesReceived++;
+
+        mHeldFrames.push_back({buffer, now});
+    }
+    mSignal.notify_all();
+    return Void();
+}
+
+
+// Gives each frame back once we've held it for long enough, then drains whatever is left when
+// we're stopped so the stream can shut down cleanly
+void BenchmarkClient::returnFrames() {
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mSignal.wait(lock, [this]() { return !mRunning || !mHeldFrames.empty(); });
+        if (mHeldFrames.empty()) {
+            break;
+        }
+
+        const HeldFrame frame = mHeldFrames.front();
+        const nsecs_t due = frame.arrivalTime + mHoldTime;
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (mRunning && due > now) {
+            lock.unlock();
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+            lock.lock();
+            now = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+        mHeldFrames.pop_front();
+        lock.unlock();
+
+        mHoldTimes.record(now - frame.arrivalTime);
+        mCamera->doneWithFrame(frame.buffer);
+        mDoneCall.record(systemTime(SYSTEM_TIME_MONOTONIC) - now);
+
+        lock.lock();
+    }
+}
+
+
+void BenchmarkClient::report(unsigned index, nsecs_t elapsed) const {
+    const double seconds = elapsed / (double)s2ns(1);
+    printf("Client %u: received %" PRIu64 " frames (%.1f fps)\n",
+           index, mFramesReceived.load(), mFramesReceived / seconds);
+    if (mSource != nullptr) {
+        mForwardToClient.report();
+    }
+    mArrivalInterval.report();
+    mHoldTimes.report();
+    mDoneCall.report();
+}
+
+
+// Main entry point
+int main(int argc, char** argv)
+{
+    // Set up default behavior, then check for command line options
+    const char* serviceName = nullptr;
+    const char* cameraId = nullptr;
+    unsigned width = 720;
+    unsigned height = 240;
+    unsigned framesPerSecond = 30;
+    unsigned seconds = 10;
+    unsigned buffers = 3;
+    unsigned clients = 1;
+    unsigned holdMs = 0;
+    bool fillFrames = true;
+    bool printHelp = false;
+    for (int i=1; i< argc; i++) {
+        const bool hasArg = i + 1 < argc;
+        if (strcmp(argv[i], "--service") == 0 && hasArg) {
+            serviceName = argv[++i];
+        } else if (strcmp(argv[i], "--camera") == 0 && hasArg) {
+            cameraId = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && hasArg &&
+                   sscanf(argv[i + 1], "%ux%u", &width, &height) == 2) {
+            i++;
+        } else if (strcmp(argv[i], "--fps") == 0 && hasArg) {
+            framesPerSecond = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--seconds") == 0 && hasArg) {
+            seconds = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--buffers") == 0 && hasArg) {
+            buffers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--clients") == 0 && hasArg) {
+            clients = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--hold") == 0 && hasArg) {
+            holdMs = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-fill") == 0) {
+            fillFrames = false;
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printHelp = true;
+        } else {
+            printf("Ignoring unrecognized command line arg '%s'\n", argv[i]);
+            printHelp = true;
+        }
+    }
+    if (printHelp) {
+        printf("Options include:\n");
+        printf("  --service <name>  Measure a running EVS service (eg: default, "
+               "EvsEnumeratorHw) instead of\n"
+               "                    the in process pipeline\n");
+        printf("  --camera <id>     With --service, the camera to open (default: the first)\n");
+        printf("  --size <w>x<h>    Synthetic frame size (default: 720x240)\n");
+        printf("  --fps <n>         Synthetic frame rate (default: 30)\n");
+        printf("  --no-fill         Don't convert each synthetic frame, just pass buffers around\n");
+        printf("  --seconds <n>     How long to stream for (default: 10)\n");
+        printf("  --buffers <n>     Frames in flight each client asks for (default: 3)\n");
+        printf("  --clients <n>     How many clients share the camera (default: 1)\n");
+        printf("  --hold <ms>       How long each client keeps each frame (default: 0)\n");
+        return 0;
+    }
+    if (!width || !height || !framesPerSecond || !clients || !buffers) {
+        ALOGE("Frame size, rate, and buffer and client counts must all be non zero");
+        return 1;
+    }
+
+    // Frames from a service arrive on our binder threads, one per client so they don't
+    // hold each other up
+    configureRpcThreadpool(clients, false /* callerWillJoin */);
+
+    // Open a camera for each client, either from the service or from our own pipeline
+    sp<IEvsEnumerator> enumerator;
+    sp<SyntheticCamera> syntheticCamera;
+    sp<HalCamera> halCamera;
+    std::vector<sp<IEvsCamera>> cameras;
+    std::string openedId;
+    if (serviceName != nullptr) {
+        enumerator = IEvsEnumerator::getService(serviceName);
+        if (enumerator.get() == nullptr) {
+            ALOGE("getService(%s) returned NULL.  Exiting.", serviceName);
+            return 1;
+        }
+        if (cameraId != nullptr) {
+            openedId = cameraId;
+        } else {
+            enumerator->getCameraList([&openedId](hidl_vec<CameraDesc> cameraList) {
+                if (cameraList.size() > 0) {
+                    openedId = cameraList[0].cameraId;
+                }
+            });
+        }
+        for (unsigned i = 0; i < clients; i++) {
+            sp<IEvsCamera> camera = enumerator->openCamera(openedId);
+            if (camera.get() == nullptr) {
+                ALOGE("Failed to open camera '%s'.  Exiting.", openedId.c_str());
+                return 1;
+            }
+            cameras.push_back(camera);
+        }
+    } else {
+        syntheticCamera = new SyntheticCamera(width, height, framesPerSecond, fillFrames);
+        halCamera = new HalCamera(syntheticCamera);
+        for (unsigned i = 0; i < clients; i++) {
+            sp<VirtualCamera> camera = halCamera->makeVirtualCamera();
+            if (camera.get() == nullptr) {
+                ALOGE("Failed to create a client camera.  Exiting.");
+                return 1;
+            }
+            cameras.push_back(camera);
+        }
+        openedId = "synthetic";
+    }
+
+    std::vector<sp<BenchmarkClient>> handlers;
+    for (auto&& camera : cameras) {
+        if (camera->setMaxFramesInFlight(buffers) != EvsResult::OK) {
+            ALOGW("Couldn't get %u frames in flight", buffers);
+        }
+        handlers.push_back(new BenchmarkClient(camera, syntheticCamera, ms2ns(holdMs)));
+    }
+
+    printf("Streaming camera %s to %u client(s) for %u seconds\n",
+           openedId.c_str(), clients, seconds);
+    const nsecs_t startTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (auto&& handler : handlers) {
+        if (!handler->start()) {
+            return 1;
+        }
+    }
+    sleep(seconds);
+    for (auto&& handler : handlers) {
+        handler->stop();
+    }
+    const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - startTime;
+
+    // Report, with every stage in microseconds
+    printf("\n  %-28s %8s %10s %10s %10s %10s\n", "stage (us)", "count", "p50", "p90", "p99",
+           "max");
+    if (syntheticCamera != nullptr) {
+        syntheticCamera->report(elapsed);
+    }
+    for (unsigned i = 0; i < handlers.size(); i++) {
+        handlers[i]->report(i, elapsed);
+    }
+    if (halCamera != nullptr) {
+        printf("\nManager statistics:\n");
+        fflush(stdout);
+        halCamera->dump(STDOUT_FILENO);
+    }
+
+    // Clean up
+    for (auto&& camera : cameras) {
+        if (enumerator != nullptr) {
+            enumerator->closeCamera(camera);
+        } else {
+            halCamera->disownVirtualCamera(reinterpret_cast<VirtualCamera*>(camera.get()));
+        }
+    }
+    handlers.clear();
+    cameras.clear();
+    halCamera = nullptr;
+    if (syntheticCamera != nullptr) {
+        syntheticCamera->shutdown();
+    }
+
+    return 0;
+}
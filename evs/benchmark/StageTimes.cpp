@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "StageTimes.h"
+
+#include <algorithm>
+#include <stdio.h>
+
+
+void StageTimes::record(nsecs_t duration) {
+    std::lock_guard<std::mutex> lock(mLock);
+    mSamples.push_back(duration);
+}
+
+
+size_t StageTimes::count() const {
+    std::lock_guard<std::mutex> lock(mLock);
+    return mSamples.size();
+}
+
+
+void StageTimes::report() const {
+    std::vector<nsecs_t> sorted;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        sorted = mSamples;
+    }
+
+    if (sorted.empty()) {
+        printf("  %-28s %8s\n", mName, "-");
+        return;
+    }
+    std::sort(sorted.begin(), sorted.end());
+
+    // Nearest rank percentiles
+    auto percentile = [&sorted](unsigned p) {
+        const size_t rank = (sorted.size() * p + 99) / 100;
+        return nanoseconds_to_microseconds(sorted[rank ? rank - 1 : 0]);
+    };
+    printf("  %-28s %8zu %10lld %10lld %10lld %10lld\n",
+           mName, sorted.size(),
+           (long long)percentile(50), (long long)percentile(90), (long long)percentile(99),
+           (long long)nanoseconds_to_microseconds(sorted.back()));
+}
@@ -0,0 +1,48 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVS_BENCHMARK_STAGETIMES_H
+#define EVS_BENCHMARK_STAGETIMES_H
+
+#include <utils/Timers.h>
+
+#include <mutex>
+#include <vector>
+
+
+/*
+ * StageTimes:
+ * Collects one duration per frame for a single stage of the frame pipeline, and summarizes them
+ * as percentiles once the run is over.  Every sample is kept, so the tail isn't smoothed away.
+ */
+class StageTimes {
+public:
+    explicit StageTimes(const char* name) : mName(name) {};
+
+    void record(nsecs_t duration);
+    size_t count() const;
+
+    // Prints the sample count and the p50/p90/p99/max of the stage, in microseconds
+    void report() const;
+
+private:
+    const char*             mName;
+
+    mutable std::mutex      mLock;
+    std::vector<nsecs_t>    mSamples;
+};
+
+#endif // EVS_BENCHMARK_STAGETIMES_H
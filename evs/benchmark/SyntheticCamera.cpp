@@ -0,0 +1,275 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SyntheticCamera.h"
+#include "bufferCopy.h"
+
+#include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
+#include <utils/Log.h>
+
+#include <inttypes.h>
+#include <stdio.h>
+
+using ::android::GraphicBufferAllocator;
+using ::android::GraphicBufferMapper;
+
+
+static const uint32_t kUsage = GRALLOC_USAGE_HW_TEXTURE     |
+                               GRALLOC_USAGE_SW_READ_RARELY |
+                               GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+
+SyntheticCamera::SyntheticCamera(unsigned width, unsigned height, unsigned framesPerSecond,
+                                 bool fillFrames) :
+        mWidth(width),
+        mHeight(height),
+        mFramesPerSecond(framesPerSecond),
+        mFillFrames(fillFrames) {
+    // Diagonal bars of luma over a constant chroma, so the converted frames are easy to
+    // recognize if anyone looks at them
+    mPattern.resize(mWidth * mHeight * 2);
+    for (unsigned r = 0; r < mHeight; r++) {
+        uint8_t* row = mPattern.data() + r * mWidth * 2;
+        for (unsigned c = 0; c < mWidth; c++) {
+            row[c * 2]     = ((r + c) & 0x40) ? 0xEB : 0x10;
+            row[c * 2 + 1] = (c & 1) ? 0x60 : 0xA0;
+        }
+    }
+}
+
+
+void SyntheticCamera::shutdown() {
+    stopVideoStream();
+
+    std::lock_guard<std::mutex> lock(mLock);
+    for (auto&& buffer : mBuffers) {
+        if (buffer.handle != nullptr) {
+            GraphicBufferMapper::get().unlock(buffer.handle);
+            GraphicBufferAllocator::get().free(buffer.handle);
+            buffer = BufferRecord();
+        }
+    }
+    mBuffersAllocated = 0;
+}
+
+
+Return<void> SyntheticCamera::getCameraInfo(getCameraInfo_cb _hidl_cb) {
+    CameraDesc description = {};
+    description.cameraId = "synthetic";
+    _hidl_cb(description);
+    return Void();
+}
+
+
+Return<EvsResult> SyntheticCamera::setMaxFramesInFlight(uint32_t bufferCount) {
+    if (bufferCount < 1 || bufferCount > kMaxBuffers) {
+        ALOGE("Can't provide %u buffers", bufferCount);
+        return EvsResult::BUFFER_NOT_AVAILABLE;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mBuffersWanted = bufferCount;
+    for (auto&& buffer : mBuffers) {
+        if (mBuffersAllocated < bufferCount && buffer.handle == nullptr) {
+            uint32_t stride = 0;
+            if (GraphicBufferAllocator::get().allocate(mWidth, mHeight,
+                                                       HAL_PIXEL_FORMAT_RGBA_8888, 1, kUsage,
+                                                       &buffer.handle, &stride, 0,
+                                                       "SyntheticCamera") != android::NO_ERROR ||
+                buffer.handle == nullptr) {
+                ALOGE("Failed to allocate a %u x %u buffer", mWidth, mHeight);
+                buffer.handle = nullptr;
+                return EvsResult::BUFFER_NOT_AVAILABLE;
+            }
+            mStride = stride;
+            GraphicBufferMapper::get().lock(buffer.handle,
+                                            GRALLOC_USAGE_SW_WRITE_OFTEN |
+                                            GRALLOC_USAGE_SW_READ_NEVER,
+                                            android::Rect(mWidth, mHeight), &buffer.pixels);
+            mBuffersAllocated++;
+        } else if (mBuffersAllocated > bufferCount && buffer.handle != nullptr &&
+                   !buffer.inUse) {
+            GraphicBufferMapper::get().unlock(buffer.handle);
+            GraphicBufferAllocator::get().free(buffer.handle);
+            buffer = BufferRecord();
+            mBuffersAllocated--;
+        }
+    }
+
+    // Buffers that are out right now get trimmed once they come back
+    return EvsResult::OK;
+}
+
+
+Return<EvsResult> SyntheticCamera::startVideoStream(const sp<IEvsCameraStream>& stream) {
+    if (mRunning) {
+        return EvsResult::STREAM_ALREADY_RUNNING;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mStream = stream;
+    }
+    mRunning = true;
+    mThread = std::thread([this]() { generateFrames(); });
+    return EvsResult::OK;
+}
+
+
+Return<void> SyntheticCamera::doneWithFrame(const BufferDesc& buffer) {
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (buffer.bufferId >= kMaxBuffers || !mBuffers[buffer.bufferId].inUse) {
+        ALOGE("doneWithFrame called with unexpected bufferId %u", buffer.bufferId);
+        return Void();
+    }
+
+    BufferRecord& record = mBuffers[buffer.bufferId];
+    record.inUse = false;
+    mCaptureToReturn.record(now - record.captureTime);
+    mFramesReturned++;
+
+    // Drop the buffer if we were asked for fewer while it was out
+    if (mBuffersAllocated > mBuffersWanted) {
+        GraphicBufferMapper::get().unlock(record.handle);
+        GraphicBufferAllocator::get().free(record.handle);
+        record = BufferRecord();
+        mBuffersAllocated--;
+    }
+    return Void();
+}
+
+
+Return<void> SyntheticCamera::stopVideoStream() {
+    // Our frame thread sends the end of stream marker on its way out
+    mRunning = false;
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mStream = nullptr;
+    return Void();
+}
+
+
+Return<int32_t> SyntheticCamera::getExtendedInfo(uint32_t /*opaqueIdentifier*/) {
+    return 0;
+}
+
+
+Return<EvsResult> SyntheticCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
+                                                   int32_t /*opaqueValue*/) {
+    return EvsResult::INVALID_ARG;
+}
+
+
+nsecs_t SyntheticCamera::getForwardTime(uint32_t bufferId) const {
+    // No lock needed:  we only write this before handing the buffer out, and the receiver only
+    // reads it before handing the buffer back
+    return (bufferId < kMaxBuffers) ? mBuffers[bufferId].forwardTime : 0;
+}
+
+
+void SyntheticCamera::generateFrames() {
+    const nsecs_t interval = s2ns(1) / mFramesPerSecond;
+    nsecs_t due = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    while (mRunning) {
+        // Keep to the frame schedule like a sensor would, without catching up on missed frames
+        due += interval;
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (due > now) {
+            std::this_thread::sleep_for(std::chrono::nanoseconds(due - now));
+        } else if (now - due > interval) {
+            due = now;
+        }
+        const nsecs_t captureTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        // Find a buffer to put the frame in
+        BufferDesc buff = {};
+        sp<IEvsCameraStream> stream;
+        void* pixels = nullptr;
+        {
+            std::lock_guard<std::mutex> lock(mLock);
+            int idx = -1;
+            for (unsigned i = 0; i < kMaxBuffers && idx < 0; i++) {
+                if (mBuffers[i].handle != nullptr && !mBuffers[i].inUse) {
+                    idx = i;
+                }
+            }
+            if (idx < 0) {
+                mFramesDropped++;
+                continue;
+            }
+
+            mBuffers[idx].inUse = true;
+            mBuffers[idx].captureTime = captureTime;
+            pixels = mBuffers[idx].pixels;
+            stream = mStream;
+
+            buff.width      = mWidth;
+            buff.height     = mHeight;
+            buff.stride     = mStride;
+            buff.format     = HAL_PIXEL_FORMAT_RGBA_8888;
+            buff.usage      = kUsage;
+            buff.bufferId   = idx;
+            buff.memHandle  = mBuffers[idx].handle;
+        }
+
+        if (mFillFrames && pixels != nullptr) {
+            android::hardware::automotive::evs::V1_0::implementation::fillRGBAFromYUYV(
+                    buff, (uint8_t*)pixels, mPattern.data(), mWidth * 2, 0, mHeight);
+        }
+
+        const nsecs_t forwardTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        mBuffers[buff.bufferId].forwardTime = forwardTime;
+        mCaptureToForward.record(forwardTime - captureTime);
+
+        if (stream != nullptr) {
+            stream->deliverFrame(buff);
+            mDeliverCall.record(systemTime(SYSTEM_TIME_MONOTONIC) - forwardTime);
+            mFramesSent++;
+        }
+    }
+
+    // Tell our stream there won't be any more frames
+    sp<IEvsCameraStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        stream = mStream;
+    }
+    if (stream != nullptr) {
+        BufferDesc nullBuff = {};
+        stream->deliverFrame(nullBuff);
+    }
+}
+
+
+void SyntheticCamera::report(nsecs_t elapsed) const {
+    const double seconds = elapsed / (double)s2ns(1);
+    printf("Synthetic camera: %u x %u at %u fps, %s\n", mWidth, mHeight, mFramesPerSecond,
+           mFillFrames ? "converting each frame from YUYV" : "not filling frames");
+    printf("  sent %" PRIu64 " (%.1f fps), returned %" PRIu64 ", dropped %" PRIu64
+           " for lack of a free buffer\n",
+           mFramesSent.load(), mFramesSent / seconds, mFramesReturned.load(),
+           mFramesDropped.load());
+    mCaptureToForward.report();
+    mDeliverCall.report();
+    mCaptureToReturn.report();
+}
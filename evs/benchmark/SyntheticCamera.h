@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef EVS_BENCHMARK_SYNTHETICCAMERA_H
+#define EVS_BENCHMARK_SYNTHETICCAMERA_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
+#include <android/hardware/automotive/evs/1.0/IEvsCameraStream.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "StageTimes.h"
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+using ::android::hardware::Return;
+using ::android::hardware::Void;
+using ::android::sp;
+
+
+/*
+ * SyntheticCamera:
+ * A stand in for the hardware IEvsCamera which produces frames at a fixed rate and times each
+ * one on its way out and back.  Each frame is converted from a YUYV test pattern into an RGBA
+ * gralloc buffer by the sample driver's own conversion code, so the capture stage costs what it
+ * does in the driver, just without a sensor.
+ */
+class SyntheticCamera : public IEvsCamera {
+public:
+    SyntheticCamera(unsigned width, unsigned height, unsigned framesPerSecond, bool fillFrames);
+    virtual ~SyntheticCamera() { shutdown(); };
+    void shutdown();
+
+    // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
+    Return<void> getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
+    Return<EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
+    Return<EvsResult> startVideoStream(const sp<IEvsCameraStream>& stream) override;
+    Return<void> doneWithFrame(const BufferDesc& buffer) override;
+    Return<void> stopVideoStream() override;
+    Return<int32_t> getExtendedInfo(uint32_t opaqueIdentifier) override;
+    Return<EvsResult> setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue) override;
+
+    // When the frame now in the given buffer was handed to our stream (CLOCK_MONOTONIC).
+    // Only meaningful while the receiver of that frame still holds it.
+    nsecs_t getForwardTime(uint32_t bufferId) const;
+
+    // Prints the per stage latencies of the frames we produced, and our frame counts
+    void report(nsecs_t elapsed) const;
+
+private:
+    void generateFrames();
+
+    static const unsigned kMaxBuffers = 64;
+
+    struct BufferRecord {
+        buffer_handle_t handle   = nullptr;
+        void*           pixels   = nullptr;     // Mapped once when allocated, as the driver does
+        bool            inUse    = false;
+        nsecs_t         captureTime = 0;        // When this frame was "captured"
+        nsecs_t         forwardTime = 0;        // When it went out to the stream
+    };
+
+    const unsigned          mWidth;
+    const unsigned          mHeight;
+    const unsigned          mFramesPerSecond;
+    const bool              mFillFrames;
+
+    uint32_t                mStride = 0;        // Pixels per row of our output buffers
+    std::vector<uint8_t>    mPattern;           // The YUYV image every frame is converted from
+
+    std::mutex              mLock;              // Protects the members below
+    BufferRecord            mBuffers[kMaxBuffers];
+    unsigned                mBuffersAllocated = 0;
+    unsigned                mBuffersWanted = 0;
+    sp<IEvsCameraStream>    mStream;
+
+    std::thread             mThread;
+    std::atomic<bool>       mRunning {false};
+
+    // Frame counts
+    std::atomic<uint64_t>   mFramesSent     {0};
+    std::atomic<uint64_t>   mFramesReturned {0};
+    std::atomic<uint64_t>   mFramesDropped  {0};    // No buffer was free when one was due
+
+    // Per frame stage timings
+    StageTimes              mCaptureToForward   {"capture -> forwardFrame"};
+    StageTimes              mDeliverCall        {"HalCamera::deliverFrame call"};
+    StageTimes              mCaptureToReturn    {"capture -> buffer returned"};
+};
+
+#endif // EVS_BENCHMARK_SYNTHETICCAMERA_H
@@ -0,0 +1,27 @@
+LOCAL_PATH:= $(call my-dir)
+
+##################################
+# Reference consumer of the frames the EVS manager exports with --export
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    evs_export_reader.cpp \
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../manager \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    liblog \
+    libui \
+    libutils \
+
+LOCAL_INIT_RC := evs_export_reader.rc
+
+LOCAL_MODULE := evs_export_reader
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -DLOG_TAG=\"EvsExportReader\"
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_EXECUTABLE)
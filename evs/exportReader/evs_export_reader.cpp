@@ -0,0 +1,325 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// A minimal consumer of the frames the EVS manager exports with --export <camera_id>, to start
+// real ones from.  It connects, maps the ring and the buffers the manager sends, then for every
+// frame reads a little of the image and checks afterwards that the buffer wasn't recycled under
+// it, printing how often that happened once a second.
+//
+//   evs_export_reader <camera_id>
+
+#include <cutils/native_handle.h>
+#include <log/log.h>
+#include <ui/GraphicBufferMapper.h>
+#include <ui/Rect.h>
+#include <utils/SystemClock.h>
+
+#include <errno.h>
+#include <linux/futex.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "FrameExport.h"
+
+using namespace android;
+using namespace ::android::automotive::evs::V1_0::implementation;
+
+
+// More than any buffer the manager will send us needs
+static const size_t kMaxMessageFds  = 16;
+static const size_t kMaxMessageSize = sizeof(ExportBufferMessage) + 256 * sizeof(int);
+
+static const ssize_t kTruncated = -2;
+
+
+// A buffer the manager sent us, imported so we can map it
+struct ReaderBuffer {
+    buffer_handle_t     handle = nullptr;
+    uint32_t            width = 0;
+    uint32_t            height = 0;
+    uint32_t            stride = 0;
+    uint32_t            pixelSize = 0;
+};
+
+
+static int connectToManager(const std::string& cameraId) {
+    const std::string name = std::string(kExportSocketPrefix) + cameraId;
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (name.size() + 1 > sizeof(addr.sun_path)) {
+        fprintf(stderr, "Camera id %s is too long\n", cameraId.c_str());
+        return -1;
+    }
+    memcpy(addr.sun_path + 1, name.data(), name.size());
+    const socklen_t addrLen = offsetof(struct sockaddr_un, sun_path) + 1 + name.size();
+
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, reinterpret_cast<struct sockaddr*>(&addr), addrLen) != 0) {
+        fprintf(stderr, "Failed to connect to @%s: %s\n", name.c_str(), strerror(errno));
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+
+// Receives one message and the fds that came with it.  Returns its length, 0 if the manager went
+// away, -1 if there was nothing waiting (with |flags| MSG_DONTWAIT) or something went wrong, or
+// kTruncated if a message didn't fit and was dropped.
+static ssize_t receive(int socketFd, std::vector<uint8_t>* data, std::vector<int>* fds,
+                       int flags) {
+    data->resize(kMaxMessageSize);
+    fds->clear();
+
+    struct iovec iov = { data->data(), data->size() };
+    char control[CMSG_SPACE(sizeof(int) * kMaxMessageFds)];
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+
+    ssize_t length = TEMP_FAILURE_RETRY(recvmsg(socketFd, &msg, flags | MSG_CMSG_CLOEXEC));
+    if (length < 0) {
+        return -1;
+    }
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            const int* received = reinterpret_cast<const int*>(CMSG_DATA(cmsg));
+            const size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            fds->insert(fds->end(), received, received + count);
+        }
+    }
+    if (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) {
+        // Whatever this was, we didn't get all of it
+        ALOGE("Dropped a truncated message from the manager");
+        for (int fd : *fds) close(fd);
+        fds->clear();
+        return kTruncated;
+    }
+    data->resize(length);
+    return length;
+}
+
+
+static const ExportRing* mapRing(int socketFd) {
+    std::vector<uint8_t> data;
+    std::vector<int> fds;
+    uint32_t type = 0;
+    if (receive(socketFd, &data, &fds, 0) < static_cast<ssize_t>(sizeof(type)) ||
+        fds.size() != 1) {
+        fprintf(stderr, "Didn't get the ring from the manager\n");
+        for (int fd : fds) close(fd);
+        return nullptr;
+    }
+    memcpy(&type, data.data(), sizeof(type));
+
+    // The manager only lets us map it read-only
+    void* ring = (type == kExportRingMessage) ?
+            mmap(nullptr, sizeof(ExportRing), PROT_READ, MAP_SHARED, fds[0], 0) : MAP_FAILED;
+    close(fds[0]);
+    if (ring == MAP_FAILED) {
+        fprintf(stderr, "Failed to map the ring: %s\n", strerror(errno));
+        return nullptr;
+    }
+
+    const ExportRing* mapped = static_cast<const ExportRing*>(ring);
+    if (mapped->magic != kExportMagic || mapped->version != kExportVersion ||
+        mapped->slotCount == 0 || mapped->slotCount > kExportSlots) {
+        fprintf(stderr, "The ring isn't one we understand\n");
+        munmap(ring, sizeof(ExportRing));
+        return nullptr;
+    }
+    return mapped;
+}
+
+
+// Imports a buffer from a kExportBufferMessage, replacing whatever we had with its id
+static void noteBuffer(const std::vector<uint8_t>& data, std::vector<int>& fds,
+                       std::vector<ReaderBuffer>* buffers) {
+    ExportBufferMessage header = {};
+    if (data.size() < sizeof(header)) {
+        return;
+    }
+    memcpy(&header, data.data(), sizeof(header));
+    if (header.bufferId >= buffers->size() || header.numFds != fds.size() ||
+        data.size() != sizeof(header) + sizeof(int) * header.numInts) {
+        ALOGE("Ignoring a malformed buffer message for buffer %u", header.bufferId);
+        return;
+    }
+
+    native_handle_t* received = native_handle_create(header.numFds, header.numInts);
+    if (received == nullptr) {
+        return;
+    }
+    memcpy(received->data, fds.data(), sizeof(int) * header.numFds);
+    memcpy(received->data + header.numFds, data.data() + sizeof(header),
+           sizeof(int) * header.numInts);
+    fds.clear();    // The handle has them now
+
+    GraphicBufferMapper& mapper = GraphicBufferMapper::get();
+    ReaderBuffer& buffer = (*buffers)[header.bufferId];
+    if (buffer.handle != nullptr) {
+        mapper.freeBuffer(buffer.handle);
+        buffer.handle = nullptr;
+    }
+    buffer_handle_t imported = nullptr;
+    status_t status = mapper.importBuffer(received, header.width, header.height, 1,
+                                          header.format, header.usage, header.stride,
+                                          &imported);
+    native_handle_close(received);
+    native_handle_delete(received);
+    if (status != NO_ERROR) {
+        ALOGE("Failed to import buffer %u: %d", header.bufferId, status);
+        return;
+    }
+    buffer.handle    = imported;
+    buffer.width     = header.width;
+    buffer.height    = header.height;
+    buffer.stride    = header.stride;
+    buffer.pixelSize = header.pixelSize;
+}
+
+
+// Takes in whatever the manager has sent since we last looked.  Returns false once it's gone.
+static bool drainMessages(int socketFd, std::vector<ReaderBuffer>* buffers) {
+    std::vector<uint8_t> data;
+    std::vector<int> fds;
+    for (;;) {
+        ssize_t length = receive(socketFd, &data, &fds, MSG_DONTWAIT);
+        if (length == 0) {
+            return false;
+        }
+        if (length == kTruncated) {
+            continue;
+        }
+        if (length < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+
+        uint32_t type = 0;
+        if (static_cast<size_t>(length) >= sizeof(type)) {
+            memcpy(&type, data.data(), sizeof(type));
+        }
+        if (type == kExportBufferMessage) {
+            noteBuffer(data, fds, buffers);
+        }
+        for (int fd : fds) close(fd);
+    }
+}
+
+
+// Stands in for whatever a real consumer does with the image:  sums its first row
+static bool readFrame(const ReaderBuffer& buffer, uint32_t* checksum) {
+    void* pixels = nullptr;
+    GraphicBufferMapper& mapper = GraphicBufferMapper::get();
+    if (mapper.lock(buffer.handle, GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_NEVER,
+                    Rect(buffer.width, buffer.height), &pixels) != NO_ERROR ||
+        pixels == nullptr) {
+        return false;
+    }
+    const uint8_t* row = static_cast<const uint8_t*>(pixels);
+    uint32_t sum = 0;
+    for (uint32_t i = 0; i < buffer.width * buffer.pixelSize; i++) {
+        sum += row[i];
+    }
+    mapper.unlock(buffer.handle);
+    *checksum = sum;
+    return true;
+}
+
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        fprintf(stderr, "Usage: %s <camera_id>\n", argv[0]);
+        return 1;
+    }
+
+    int socketFd = connectToManager(argv[1]);
+    if (socketFd < 0) {
+        return 1;
+    }
+    const ExportRing* ring = mapRing(socketFd);
+    if (ring == nullptr) {
+        return 1;
+    }
+    std::vector<ReaderBuffer> buffers(std::min(ring->maxBuffers, kMaxExportedBuffers));
+
+    uint64_t lastFrameNumber = 0;
+    unsigned framesRead = 0, framesSkipped = 0, framesRecycled = 0;
+    uint32_t checksum = 0;
+    int64_t lastReport = uptimeMillis();
+    for (;;) {
+        // Sleep until the manager publishes a frame, or a while has gone by without one
+        const uint32_t frameCount = ring->frameCount.load(std::memory_order_acquire);
+        const struct timespec timeout = { 0, 200 * 1000 * 1000 };
+        syscall(SYS_futex, &ring->frameCount, FUTEX_WAIT, frameCount, &timeout, nullptr, 0);
+
+        // New buffers come before the frames they hold
+        if (!drainMessages(socketFd, &buffers)) {
+            fprintf(stderr, "The manager went away\n");
+            break;
+        }
+
+        ExportedFrame frame = {};
+        if (readLatestExportedFrame(*ring, &frame) && frame.frameNumber != lastFrameNumber) {
+            if (lastFrameNumber != 0) {
+                framesSkipped += frame.frameNumber - lastFrameNumber - 1;
+            }
+            lastFrameNumber = frame.frameNumber;
+
+            const ReaderBuffer& buffer = buffers[frame.bufferId];
+            uint32_t sum = 0;
+            if (buffer.handle != nullptr && readFrame(buffer, &sum)) {
+                // Only now do we know whether what we read was the frame we wanted
+                if (isExportedFrameCurrent(*ring, frame)) {
+                    framesRead++;
+                    checksum = sum;
+                } else {
+                    framesRecycled++;
+                }
+            }
+        }
+
+        const int64_t now = uptimeMillis();
+        if (now - lastReport >= 1000) {
+            printf("%u frames read, %u skipped, %u recycled while reading, last checksum %08x\n",
+                   framesRead, framesSkipped, framesRecycled, checksum);
+            fflush(stdout);
+            framesRead = framesSkipped = framesRecycled = 0;
+            lastReport = now;
+        }
+    }
+
+    for (auto&& buffer : buffers) {
+        if (buffer.handle != nullptr) {
+            GraphicBufferMapper::get().freeBuffer(buffer.handle);
+        }
+    }
+    close(socketFd);
+    return 1;
+}
@@ -8,6 +8,11 @@ LOCAL_SRC_FILES := \
     Enumerator.cpp \
     HalCamera.cpp \
     VirtualCamera.cpp \
+    FrameStats.cpp \
+    FrameExporter.cpp \
+    FrameRecorder.cpp \
+    CameraListNotifier.cpp \
+    SeqpacketServer.cpp \
     HalDisplay.cpp
 
 
@@ -20,7 +25,14 @@ LOCAL_SHARED_LIBRARIES := \
     libhidltransport \
     libhardware \
     android.hardware.automotive.evs@1.0 \
-    libhwbinder
+    libhwbinder \
+    libEGL \
+    libGLESv2 \
+    libmediandk \
+    libnativewindow
+
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
 
 
 LOCAL_INIT_RC := android.automotive.evs.manager@1.0.rc
@@ -31,6 +43,7 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_STRIP_MODULE := keep_symbols
 
 LOCAL_CFLAGS += -DLOG_TAG=\"EvsManager\"
+LOCAL_CFLAGS += -DATRACE_TAG=ATRACE_TAG_CAMERA
 LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
 LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
 
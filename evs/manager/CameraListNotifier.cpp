@@ -0,0 +1,81 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CameraListNotifier.h"
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A client that can't take even this many notifications is ignoring them
+static const unsigned kMaxClients = 8;
+
+
+CameraListNotifier::CameraListNotifier() :
+        mServer(kCameraListSocket, "camera list client", kMaxClients) {}
+
+
+CameraListNotifier::~CameraListNotifier() {
+    mServer.stop();
+}
+
+
+bool CameraListNotifier::start() {
+    return mServer.start([this](int fd, pid_t) { return sendCurrent(fd); },
+                         [this](const std::vector<int>& clients, std::vector<int>* gone) {
+                             sendChange(clients, gone);
+                         });
+}
+
+
+void CameraListNotifier::notify(uint32_t generation, uint32_t cameraCount) {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mCurrent = { generation, cameraCount };
+        mChanged = true;
+    }
+    mServer.wake();
+}
+
+
+bool CameraListNotifier::sendCurrent(int fd) {
+    std::lock_guard<std::mutex> lock(mLock);
+    return SeqpacketServer::send(fd, &mCurrent, sizeof(mCurrent));
+}
+
+
+void CameraListNotifier::sendChange(const std::vector<int>& clients, std::vector<int>* gone) {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mChanged) {
+        return;
+    }
+    for (int fd : clients) {
+        if (!SeqpacketServer::send(fd, &mCurrent, sizeof(mCurrent))) {
+            gone->push_back(fd);
+        }
+    }
+    mChanged = false;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
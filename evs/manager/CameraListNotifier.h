@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_CAMERALISTNOTIFIER_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_CAMERALISTNOTIFIER_H
+
+#include <mutex>
+#include <vector>
+
+#include <stdint.h>
+
+#include "SeqpacketServer.h"
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Native clients that want to know when cameras come and go, rather than polling
+// getCameraList(), connect to this abstract SOCK_SEQPACKET socket.  They get a CameraListChange
+// straight away and again each time the manager's camera list changes.  Fetching the list itself
+// is then a getCameraList() away, which the manager answers from its cache.  Clients run as
+// AID_AUTOMOTIVE_EVS, from domains with the evs_camera_list_client attribute (see
+// evs/sepolicy/evs_manager.te).
+static const char kCameraListSocket[] = "evs_camera_list";
+
+struct CameraListChange {
+    uint32_t    generation;     // Goes up by one with each change
+    uint32_t    cameraCount;    // How many cameras there are now
+};
+
+
+// Serves the socket above for the Enumerator
+class CameraListNotifier {
+public:
+    CameraListNotifier();
+    ~CameraListNotifier();
+
+    // Starts accepting clients.  Returns false if it can't.
+    bool start();
+
+    // Tells every client, and every client that connects from now on, about the given list
+    void notify(uint32_t generation, uint32_t cameraCount);
+
+private:
+    // Our SeqpacketServer's handlers
+    bool sendCurrent(int fd);
+    void sendChange(const std::vector<int>& clients, std::vector<int>* gone);
+
+    SeqpacketServer         mServer;        // Woken when there's a change to send
+
+    std::mutex              mLock;          // Guards the fields below
+    CameraListChange        mCurrent = {};
+    bool                    mChanged = false;   // mCurrent not yet sent to the clients we have
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_CAMERALISTNOTIFIER_H
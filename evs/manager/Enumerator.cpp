@@ -14,6 +14,11 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+#include <chrono>
+#include <stdio.h>
+#include <string.h>
+
 #include <hwbinder/IPCThreadState.h>
 #include <cutils/android_filesystem_config.h>
 
@@ -26,6 +31,28 @@ namespace evs {
 namespace V1_0 {
 namespace implementation {
 
+using namespace std::chrono_literals;
+
+
+// EVS 1.0 has no way for the hardware to tell us about hotplug, so we ask it this often.  The
+// hardware answers from its own list, so this is cheap.
+static const auto kCameraListRefreshInterval = 1s;
+
+// How long a client asking for the list may wait for the first one, the same as the hardware
+static const auto kFirstCameraListTimeout = 10s;
+
+
+Enumerator::~Enumerator() {
+    {
+        std::lock_guard<std::mutex> lock(mCameraListLock);
+        mCameraListQuit = true;
+    }
+    mCameraListSignal.notify_all();
+    if (mCameraListThread.joinable()) {
+        mCameraListThread.join();
+    }
+}
+
 
 bool Enumerator::init(const char* hardwareServiceName) {
     ALOGD("init");
@@ -34,10 +61,50 @@ bool Enumerator::init(const char* hardwareServiceName) {
     mHwEnumerator = IEvsEnumerator::getService(hardwareServiceName);
     bool result = (mHwEnumerator.get() != nullptr);
 
+    // Open the cameras we keep in standby now, so the first client doesn't wait for them
+    for (auto&& cameraId : mStandbyCameraIds) {
+        if (!result) {
+            break;
+        }
+        sp<IEvsCamera> device = mHwEnumerator->openCamera(cameraId);
+        if (device == nullptr) {
+            ALOGE("Failed to open hardware camera %s for standby", cameraId.c_str());
+            continue;
+        }
+        sp<HalCamera> hwCamera = wrapHwCamera(device, cameraId);
+        mCameras[cameraId] = hwCamera;
+        mStandbyCameras.push_back(hwCamera);
+        ALOGI("Holding hardware camera %s in standby", cameraId.c_str());
+    }
+
+    // Start keeping track of the camera list, and let clients hear about changes to it
+    if (result) {
+        if (!mCameraListNotifier.start()) {
+            ALOGW("Clients won't be told when cameras come and go");
+        }
+        mCameraListThread = std::thread([this]() { cameraListThread(); });
+    }
+
     return result;
 }
 
 
+sp<HalCamera> Enumerator::wrapHwCamera(const sp<IEvsCamera>& device, const std::string& cameraId) {
+    sp<HalCamera> hwCamera = new HalCamera(device, cameraId);
+    if (hwCamera != nullptr &&
+        std::find(mExportCameraIds.begin(), mExportCameraIds.end(), cameraId) !=
+                mExportCameraIds.end()) {
+        hwCamera->enableFrameExport(cameraId);
+    }
+    if (hwCamera != nullptr &&
+        std::find(mRecordCameraIds.begin(), mRecordCameraIds.end(), cameraId) !=
+                mRecordCameraIds.end()) {
+        hwCamera->enableRecording(mRecordOptions);
+    }
+    return hwCamera;
+}
+
+
 bool Enumerator::checkPermission() {
     hardware::IPCThreadState *ipc = hardware::IPCThreadState::self();
     if (AID_AUTOMOTIVE_EVS != ipc->getCallingUid()) {
@@ -56,8 +123,73 @@ Return<void> Enumerator::getCameraList(getCameraList_cb list_cb)  {
         return Void();
     }
 
-    // Simply pass through to hardware layer
-    return mHwEnumerator->getCameraList(list_cb);
+    // Answer from our copy of the list, which only needs waiting for until we first have it
+    hidl_vec<CameraDesc> cameras;
+    {
+        std::unique_lock<std::mutex> lock(mCameraListLock);
+        if (!mCameraListSignal.wait_for(lock, kFirstCameraListTimeout,
+                                        [this]() { return mCameraListReady; })) {
+            ALOGW("Still waiting for the hardware's camera list");
+        }
+        cameras = mCameraList;
+    }
+
+    list_cb(cameras);
+    return Void();
+}
+
+
+void Enumerator::cameraListThread() {
+    std::unique_lock<std::mutex> lock(mCameraListLock);
+    while (!mCameraListQuit) {
+        lock.unlock();
+        refreshCameraList();
+        lock.lock();
+
+        mCameraListSignal.wait_for(lock, kCameraListRefreshInterval,
+                                   [this]() { return mCameraListQuit; });
+    }
+}
+
+
+void Enumerator::refreshCameraList() {
+    // This may block for a while if the hardware has no cameras yet, which is why it's done on
+    // our own thread
+    std::vector<CameraDesc> cameras;
+    Return<void> result = mHwEnumerator->getCameraList([&cameras](hidl_vec<CameraDesc> list) {
+        cameras.assign(list.begin(), list.end());
+    });
+    if (!result.isOk()) {
+        ALOGE("Failed to get the camera list from the hardware");
+        return;
+    }
+    std::sort(cameras.begin(), cameras.end(), [](const CameraDesc& a, const CameraDesc& b) {
+        return strcmp(a.cameraId.c_str(), b.cameraId.c_str()) < 0;
+    });
+
+    uint32_t generation;
+    uint32_t count;
+    {
+        std::lock_guard<std::mutex> lock(mCameraListLock);
+        const bool same = mCameraListReady &&
+                          std::equal(cameras.begin(), cameras.end(),
+                                     mCameraList.begin(), mCameraList.end(),
+                                     [](const CameraDesc& a, const CameraDesc& b) {
+                                         return a.cameraId == b.cameraId &&
+                                                a.vendorFlags == b.vendorFlags;
+                                     });
+        if (same) {
+            return;
+        }
+        mCameraList = std::move(cameras);
+        mCameraListReady = true;
+        generation = ++mCameraListGeneration;
+        count = mCameraList.size();
+        ALOGI("Camera list changed:  %u cameras", count);
+    }
+    mCameraListSignal.notify_all();
+
+    mCameraListNotifier.notify(generation, count);
 }
 
 
@@ -67,20 +199,14 @@ Return<sp<IEvsCamera>> Enumerator::openCamera(const hidl_string& cameraId) {
         return nullptr;
     }
 
+    // Opens and closes are serialized, so two clients can't both open the same hardware camera
+    std::lock_guard<std::mutex> lock(mLock);
+
     // Is the underlying hardware camera already open?
     sp<HalCamera> hwCamera;
-    for (auto &&cam : mCameras) {
-        bool match = false;
-        cam->getHwCamera()->getCameraInfo([cameraId, &match](CameraDesc desc) {
-                                      if (desc.cameraId == cameraId) {
-                                          match = true;
-                                      }
-                                  }
-        );
-        if (match) {
-            hwCamera = cam;
-            break;
-        }
+    auto it = mCameras.find(cameraId);
+    if (it != mCameras.end()) {
+        hwCamera = it->second;
     }
 
     // Do we need to open a new hardware camera?
@@ -90,7 +216,7 @@ Return<sp<IEvsCamera>> Enumerator::openCamera(const hidl_string& cameraId) {
         if (device == nullptr) {
             ALOGE("Failed to open hardware camera %s", cameraId.c_str());
         } else {
-            hwCamera = new HalCamera(device);
+            hwCamera = wrapHwCamera(device, cameraId);
             if (hwCamera == nullptr) {
                 ALOGE("Failed to allocate camera wrapper object");
                 mHwEnumerator->closeCamera(device);
@@ -104,9 +230,9 @@ Return<sp<IEvsCamera>> Enumerator::openCamera(const hidl_string& cameraId) {
         clientCamera = hwCamera->makeVirtualCamera();
     }
 
-    // Add the hardware camera to our list, which will keep it alive via ref count
+    // Add the hardware camera to our table, which will keep it alive via ref count
     if (clientCamera != nullptr) {
-        mCameras.push_back(hwCamera);
+        mCameras.emplace(cameraId, hwCamera);
     } else {
         ALOGE("Requested camera %s not found or not available", cameraId.c_str());
     }
@@ -130,17 +256,21 @@ Return<void> Enumerator::closeCamera(const ::android::sp<IEvsCamera>& clientCame
     // Find the parent camera that backs this virtual camera
     sp<HalCamera> halCamera = virtualCamera->getHalCamera();
 
+    std::lock_guard<std::mutex> lock(mLock);
+
     // Tell the virtual camera's parent to clean it up and drop it
     // NOTE:  The camera objects will only actually destruct when the sp<> ref counts get to
     //        zero, so it is important to break all cyclic references.
     halCamera->disownVirtualCamera(virtualCamera);
 
-    // Did we just remove the last client of this camera?
-    if (halCamera->getClientCount() == 0) {
+    // Did we just remove the last client of this camera?  Cameras held in standby stay open.
+    const bool standby = std::find(mStandbyCameras.begin(), mStandbyCameras.end(), halCamera) !=
+                         mStandbyCameras.end();
+    if (halCamera->getClientCount() == 0 && !standby) {
         // Take this now unused camera out of our list
         // NOTE:  This should drop our last reference to the camera, resulting in its
         //        destruction.
-        mCameras.remove(halCamera);
+        mCameras.erase(halCamera->getId());
     }
 
     return Void();
@@ -160,6 +290,7 @@ Return<sp<IEvsDisplay>> Enumerator::openDisplay() {
     // create/destroy order and provides a cleaner restart sequence if the previous owner
     // is non-responsive for some reason.
     // Request exclusive access to the EVS display
+    std::lock_guard<std::mutex> lock(mLock);
     sp<IEvsDisplay> pActiveDisplay = mHwEnumerator->openDisplay();
     if (pActiveDisplay == nullptr) {
         ALOGE("EVS Display unavailable");
@@ -182,6 +313,7 @@ Return<sp<IEvsDisplay>> Enumerator::openDisplay() {
 Return<void> Enumerator::closeDisplay(const ::android::sp<IEvsDisplay>& display) {
     ALOGD("closeDisplay");
 
+    std::lock_guard<std::mutex> lock(mLock);
     sp<IEvsDisplay> pActiveDisplay = mActiveDisplay.promote();
 
     // Drop the active display
@@ -205,18 +337,47 @@ Return<DisplayState> Enumerator::getDisplayState()  {
     }
 
     // Do we have a display object we think should be active?
-    sp<IEvsDisplay> pActiveDisplay = mActiveDisplay.promote();
-    if (pActiveDisplay != nullptr) {
-        // Pass this request through to the hardware layer
-        return pActiveDisplay->getDisplayState();
-    } else {
-        // We don't have a live display right now
-        mActiveDisplay = nullptr;
-        return DisplayState::NOT_OPEN;
+    sp<IEvsDisplay> pActiveDisplay;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        pActiveDisplay = mActiveDisplay.promote();
+        if (pActiveDisplay == nullptr) {
+            // We don't have a live display right now
+            mActiveDisplay = nullptr;
+            return DisplayState::NOT_OPEN;
+        }
     }
+
+    // Pass this request through to the hardware layer.  We don't hold our lock across the call,
+    // so a slow display can't hold up everyone opening and closing cameras.
+    return pActiveDisplay->getDisplayState();
 }
 
 
+Return<void> Enumerator::debug(const hidl_handle& fd, const hidl_vec<hidl_string>& /*options*/) {
+    if (fd.getNativeHandle() == nullptr || fd->numFds < 1) {
+        ALOGE("Ignoring debug request without a file descriptor to write to");
+        return Void();
+    }
+    const int out = fd->data[0];
+
+    // Dumping the cameras takes a while, so we do it from a copy of the list
+    std::vector<sp<HalCamera>> cameras;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        for (auto&& cam : mCameras) {
+            cameras.push_back(cam.second);
+        }
+    }
+
+    dprintf(out, "EVS manager: %zu hardware cameras open\n", cameras.size());
+    for (auto&& cam : cameras) {
+        cam->dump(out);
+    }
+
+    return Void();
+}
+
 } // namespace implementation
 } // namespace V1_0
 } // namespace evs
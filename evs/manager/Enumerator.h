@@ -17,8 +17,15 @@
 #ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_EVSCAMERAENUMERATOR_H
 #define ANDROID_AUTOMOTIVE_EVS_V1_0_EVSCAMERAENUMERATOR_H
 
+#include <condition_variable>
 #include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
+#include "CameraListNotifier.h"
 #include "HalCamera.h"
 #include "VirtualCamera.h"
 
@@ -28,6 +35,8 @@
 using namespace ::android::hardware::automotive::evs::V1_0;
 using ::android::hardware::Return;
 using ::android::hardware::hidl_string;
+using ::android::hardware::hidl_vec;
+using ::android::hardware::hidl_handle;
 
 namespace android {
 namespace automotive {
@@ -45,15 +54,58 @@ public:
     Return<void>            closeDisplay(const ::android::sp<IEvsDisplay>& display)  override;
     Return<DisplayState>    getDisplayState()  override;
 
+    // Methods from ::android::hidl::base::V1_0::IBase follow.
+    // Dumps frame delivery statistics for every open camera, eg: via "lshal debug"
+    Return<void>            debug(const hidl_handle& fd, const hidl_vec<hidl_string>& options)
+                                    override;
+
     // Implementation details
+    ~Enumerator();
     bool init(const char* hardwareServiceName);
 
+    // Keeps the given hardware camera open even while no client is using it, so that opening
+    // it is instant and the driver can hold it ready to stream.  Call before init().
+    void addStandbyCamera(const char* cameraId)     { mStandbyCameraIds.push_back(cameraId); };
+
+    // Publishes the frames of the given camera for native consumers (see FrameExport.h).  Call
+    // before init().
+    void addExportCamera(const char* cameraId)      { mExportCameraIds.push_back(cameraId); };
+
+    // Records the frames of the given camera into MP4 files (see FrameRecorder.h).  Call before
+    // init().
+    void addRecordCamera(const char* cameraId)      { mRecordCameraIds.push_back(cameraId); };
+    void setRecordOptions(const FrameRecorder::Options& options)    { mRecordOptions = options; };
+
 private:
     bool checkPermission();
+    sp<HalCamera> wrapHwCamera(const sp<IEvsCamera>& device, const std::string& cameraId);
+    void cameraListThread();
+    void refreshCameraList();
 
     sp<IEvsEnumerator>          mHwEnumerator;  // Hardware enumerator
+
+    // Calls come in on several threads, so the fields below are guarded by this lock
+    std::mutex                  mLock;
     wp<IEvsDisplay>             mActiveDisplay; // Display proxy object warpping hw display
-    std::list<sp<HalCamera>>    mCameras;       // Camera proxy objects wrapping hw cameras
+    // Camera proxy objects wrapping hw cameras, by camera id
+    std::unordered_map<std::string, sp<HalCamera>>  mCameras;
+
+    std::vector<std::string>    mStandbyCameraIds;  // Cameras to keep open (see above)
+    std::list<sp<HalCamera>>    mStandbyCameras;    // The ones we managed to open
+    std::vector<std::string>    mExportCameraIds;   // Cameras to export frames from
+    std::vector<std::string>    mRecordCameraIds;   // Cameras to record
+    FrameRecorder::Options      mRecordOptions;
+
+    // The hardware's camera list, which we keep up to date on our own thread so that clients
+    // needn't wait on the hardware for it (see CameraListNotifier.h)
+    std::mutex                  mCameraListLock;    // Guards the fields below
+    std::condition_variable     mCameraListSignal;  // Signaled on the first list, or to quit
+    std::vector<CameraDesc>     mCameraList;        // Sorted by cameraId
+    bool                        mCameraListReady    = false;
+    uint32_t                    mCameraListGeneration   = 0;
+    bool                        mCameraListQuit     = false;
+    std::thread                 mCameraListThread;
+    CameraListNotifier          mCameraListNotifier;
 };
 
 } // namespace implementation
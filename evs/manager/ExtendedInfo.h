@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_EXTENDEDINFO_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_EXTENDEDINFO_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// The setExtendedInfo() identifiers the EVS manager handles itself, for its clients to include
+// rather than copy.  Anything else goes on to the hardware camera.
+
+// Caps the frame rate a client receives, for clients that don't need every frame.  The value is
+// the maximum number of frames per second, or zero (the default) to receive every frame.  The
+// manager handles this without passing it on to the hardware, and frames beyond the cap are
+// never sent across to the client.
+static const uint32_t kExtendedInfoMaxFrameRate = 0x45564652;   // 'EVFR'
+
+// Says how much a client's frames matter, as one of the ClientPriority values below.  When the
+// hardware can't supply every client's full quota of frames in flight, the lower priority
+// clients are cut back first.
+static const uint32_t kExtendedInfoClientPriority = 0x45565052; // 'EVPR'
+
+enum ClientPriority : int32_t {
+    PRIORITY_DISPLAY    = 0,    // Someone is watching, so latency matters most (the default)
+    PRIORITY_RECORDING  = 1,
+    PRIORITY_ANALYTICS  = 2,
+    NUM_PRIORITIES,
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_EXTENDEDINFO_H
@@ -0,0 +1,169 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMEEXPORT_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMEEXPORT_H
+
+#include <atomic>
+#include <stdint.h>
+
+
+// What the EVS manager shares with read-only frame consumers when a camera is exported with
+// --export <camera_id>.  Consumers include this header and talk to the manager over the abstract
+// SOCK_SEQPACKET socket below, which delivers:
+//
+//   - one kExportRingMessage, carrying the fd of the ExportRing below to mmap() read-only
+//   - one kExportBufferMessage per hardware buffer, with that buffer's native_handle fds
+//     attached and its ints following the ExportBufferMessage header, as the buffers are first
+//     seen and again whenever the hardware replaces one
+//
+// After that, frames show up in the ring with no further IPC.  Consumers don't hold frames:  a
+// frame's buffer goes back to the hardware as soon as the manager's own clients are done with
+// it, which bumps bufferGeneration[bufferId].  A consumer that reads a frame should check the
+// generation again afterwards, and discard what it read if it has changed.  The inline functions
+// at the end do both halves of this, and evs/exportReader is a complete consumer to start from.
+//
+// Only processes running as AID_AUTOMOTIVE_EVS are let in, from domains with the evs_frame_consumer
+// attribute (see evs/sepolicy/evs_manager.te).
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// The socket for a camera is kExportSocketPrefix followed by its camera id
+static const char kExportSocketPrefix[] = "evs_frames.";
+
+static const uint32_t kExportMagic          = 0x45564658;  // 'EVFX'
+static const uint32_t kExportVersion        = 1;
+static const uint32_t kExportSlots          = 16;   // How many recent frames the ring holds
+static const uint32_t kMaxExportedBuffers   = 256;  // Buffer ids beyond this aren't exported
+
+static const uint32_t kExportRingMessage    = 1;
+static const uint32_t kExportBufferMessage  = 2;
+
+struct ExportBufferMessage {
+    uint32_t    type;           // kExportBufferMessage
+    uint32_t    bufferId;
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    stride;
+    uint32_t    pixelSize;
+    uint32_t    format;
+    uint32_t    usage;
+    uint32_t    numFds;         // Attached as SCM_RIGHTS
+    uint32_t    numInts;        // Follow this header
+};
+
+// One published frame.  The writer makes sequence odd while it fills in the slot and even again
+// once it's done, so a reader that sees the same even sequence before and after copying the slot
+// got a consistent copy.
+struct ExportedFrame {
+    std::atomic<uint32_t>   sequence;
+    uint32_t                bufferId;
+    uint32_t                bufferGeneration;   // bufferGeneration[bufferId] as of this frame
+    uint32_t                reserved;
+    uint64_t                frameNumber;        // Counts up from 1 for every frame published
+    int64_t                 arrivalTimeNs;      // When the manager got it (CLOCK_MONOTONIC)
+};
+
+struct ExportRing {
+    uint32_t                magic;
+    uint32_t                version;
+    uint32_t                slotCount;
+    uint32_t                maxBuffers;
+
+    // The number of frames published so far, wrapping around, which doubles as a futex word
+    // that consumers can FUTEX_WAIT on for the next one.  The latest frame is in
+    // slots[(frameCount - 1) % slotCount].
+    std::atomic<uint32_t>   frameCount;
+    uint32_t                reserved[3];
+
+    std::atomic<uint32_t>   bufferGeneration[kMaxExportedBuffers];
+    ExportedFrame           slots[kExportSlots];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free,
+              "the ring is shared between processes, so its atomics must not need locks");
+
+
+// The writer's half of the protocol:  fills in the slot for frame |frameNumber| (counting from 1)
+// and publishes it.  Waking anyone waiting on frameCount is left to the caller.
+inline void publishExportedFrame(ExportRing* ring, uint32_t bufferId, uint64_t frameNumber,
+                                 int64_t arrivalTimeNs) {
+    ExportedFrame& slot = ring->slots[(frameNumber - 1) % kExportSlots];
+
+    // Odd while we write (see ExportedFrame)
+    const uint32_t sequence = slot.sequence.load(std::memory_order_relaxed);
+    slot.sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    slot.bufferId = bufferId;
+    slot.bufferGeneration = ring->bufferGeneration[bufferId].load(std::memory_order_acquire);
+    slot.frameNumber = frameNumber;
+    slot.arrivalTimeNs = arrivalTimeNs;
+
+    slot.sequence.store(sequence + 2, std::memory_order_release);
+    ring->frameCount.fetch_add(1, std::memory_order_release);
+}
+
+// Called by the writer as a buffer goes back to the hardware, so the frames it held go stale
+inline void retireExportedBuffer(ExportRing* ring, uint32_t bufferId) {
+    ring->bufferGeneration[bufferId].fetch_add(1, std::memory_order_release);
+}
+
+// The reader's half:  copies out the latest frame, returning false if there isn't one yet or the
+// writer was part way through it.  A reader that gets false can simply try again.
+inline bool readLatestExportedFrame(const ExportRing& ring, ExportedFrame* frame) {
+    const uint32_t frameCount = ring.frameCount.load(std::memory_order_acquire);
+    if (frameCount == 0 || ring.slotCount == 0) {
+        return false;
+    }
+    const ExportedFrame& slot = ring.slots[(frameCount - 1) % ring.slotCount];
+
+    const uint32_t before = slot.sequence.load(std::memory_order_acquire);
+    if (before & 1) {
+        return false;
+    }
+    frame->bufferId         = slot.bufferId;
+    frame->bufferGeneration = slot.bufferGeneration;
+    frame->frameNumber      = slot.frameNumber;
+    frame->arrivalTimeNs    = slot.arrivalTimeNs;
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (slot.sequence.load(std::memory_order_relaxed) != before) {
+        return false;
+    }
+
+    frame->sequence.store(before, std::memory_order_relaxed);
+    return frame->bufferId < ring.maxBuffers && frame->bufferId < kMaxExportedBuffers;
+}
+
+// Whether the buffer of a frame read from the ring still holds that frame.  A reader checks this
+// after it's done with the pixels, and throws away what it read if it's false.
+inline bool isExportedFrameCurrent(const ExportRing& ring, const ExportedFrame& frame) {
+    return ring.bufferGeneration[frame.bufferId].load(std::memory_order_acquire) ==
+           frame.bufferGeneration;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMEEXPORT_H
@@ -0,0 +1,231 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameExporter.h"
+
+#include <cutils/ashmem.h>
+#include <log/log.h>
+#include <utils/Trace.h>
+
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "BufferCache.h"
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Enough for the few consumers we expect
+static const unsigned kMaxConsumers = 8;
+
+
+FrameExporter::FrameExporter(const std::string& cameraId) :
+        mCameraId(cameraId),
+        mServer(std::string(kExportSocketPrefix) + cameraId, "frame consumer", kMaxConsumers) {}
+
+
+FrameExporter::~FrameExporter() {
+    // Before anything its handlers use goes away
+    mServer.stop();
+
+    for (auto&& buffer : mBuffers) {
+        if (buffer.handle != nullptr) {
+            native_handle_close(buffer.handle);
+            native_handle_delete(buffer.handle);
+        }
+    }
+    if (mRing != nullptr) {
+        munmap(mRing, sizeof(ExportRing));
+    }
+    if (mRingFd >= 0) close(mRingFd);
+}
+
+
+bool FrameExporter::start() {
+    const std::string name = std::string(kExportSocketPrefix) + mCameraId;
+
+    // The ring lives in ashmem that consumers can only ever map read-only
+    mRingFd = ashmem_create_region(name.c_str(), sizeof(ExportRing));
+    if (mRingFd < 0) {
+        ALOGE("Failed to create the frame export ring for %s", mCameraId.c_str());
+        return false;
+    }
+    void* ring = mmap(nullptr, sizeof(ExportRing), PROT_READ | PROT_WRITE, MAP_SHARED, mRingFd, 0);
+    if (ring == MAP_FAILED) {
+        ALOGE("Failed to map the frame export ring: %s", strerror(errno));
+        return false;
+    }
+    mRing = new (ring) ExportRing();
+    mRing->magic      = kExportMagic;
+    mRing->version    = kExportVersion;
+    mRing->slotCount  = kExportSlots;
+    mRing->maxBuffers = kMaxExportedBuffers;
+    if (ashmem_set_prot_region(mRingFd, PROT_READ) != 0) {
+        ALOGE("Failed to make the frame export ring read-only: %s", strerror(errno));
+        return false;
+    }
+
+    // Consumers find us by an abstract socket named after the camera
+    const bool started = mServer.start(
+            [this](int fd, pid_t) { return sendEverything(fd); },
+            [this](const std::vector<int>& consumers, std::vector<int>* gone) {
+                sendChangedBuffers(consumers, gone);
+            });
+    if (!started) {
+        return false;
+    }
+    ALOGI("Exporting frames from camera %s on @%s", mCameraId.c_str(), name.c_str());
+    return true;
+}
+
+
+bool FrameExporter::noteBuffer(const BufferDesc& buffer) {
+    const native_handle_t* handle = buffer.memHandle.getNativeHandle();
+    const uint64_t identity = support::bufferIdentity(handle);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    ExportedBuffer& exported = mBuffers[buffer.bufferId];
+    if (exported.handle != nullptr && exported.identity == identity) {
+        // The usual case:  nothing new
+        return false;
+    }
+
+    native_handle_t* copy = native_handle_clone(handle);
+    if (copy == nullptr) {
+        ALOGE("Failed to keep a copy of buffer %u to export", buffer.bufferId);
+        return false;
+    }
+    if (exported.handle != nullptr) {
+        native_handle_close(exported.handle);
+        native_handle_delete(exported.handle);
+    }
+    exported.handle = copy;
+    exported.identity = identity;
+    // Field by field, as copying the whole BufferDesc would clone its handle all over again
+    exported.desc.width     = buffer.width;
+    exported.desc.height    = buffer.height;
+    exported.desc.stride    = buffer.stride;
+    exported.desc.pixelSize = buffer.pixelSize;
+    exported.desc.format    = buffer.format;
+    exported.desc.usage     = buffer.usage;
+    exported.desc.bufferId  = buffer.bufferId;
+    mChangedBuffers.push_back(buffer.bufferId);
+    return true;
+}
+
+
+void FrameExporter::publishFrame(const BufferDesc& buffer, nsecs_t arrivalTime) {
+    ATRACE_CALL();
+
+    if (buffer.bufferId >= kMaxExportedBuffers) {
+        if (!mWarnedBufferId) {
+            ALOGW("Buffer ids from %u up can't be exported", kMaxExportedBuffers);
+            mWarnedBufferId = true;
+        }
+        return;
+    }
+
+    // New buffers go out to the consumers from our own thread, before they're needed
+    if (noteBuffer(buffer)) {
+        mServer.wake();
+    }
+
+    publishExportedFrame(mRing, buffer.bufferId, ++mFrameNumber, arrivalTime);
+
+    // One wake for everyone waiting, and none at all while nobody is connected
+    if (mServer.getClientCount() > 0) {
+        syscall(SYS_futex, reinterpret_cast<uint32_t*>(&mRing->frameCount), FUTEX_WAKE, INT_MAX,
+                nullptr, nullptr, 0);
+    }
+}
+
+
+void FrameExporter::frameReturned(uint32_t bufferId) {
+    if (bufferId < kMaxExportedBuffers) {
+        retireExportedBuffer(mRing, bufferId);
+    }
+}
+
+
+bool FrameExporter::sendRing(int fd) {
+    const uint32_t type = kExportRingMessage;
+    return SeqpacketServer::send(fd, &type, sizeof(type), &mRingFd, 1);
+}
+
+
+bool FrameExporter::sendBuffer(int fd, const ExportedBuffer& buffer) {
+    const native_handle_t* handle = buffer.handle;
+    ExportBufferMessage header = {
+        kExportBufferMessage,
+        buffer.desc.bufferId,
+        buffer.desc.width,
+        buffer.desc.height,
+        buffer.desc.stride,
+        buffer.desc.pixelSize,
+        buffer.desc.format,
+        buffer.desc.usage,
+        static_cast<uint32_t>(handle->numFds),
+        static_cast<uint32_t>(handle->numInts),
+    };
+
+    std::vector<uint8_t> message(sizeof(header) + sizeof(int) * handle->numInts);
+    memcpy(message.data(), &header, sizeof(header));
+    memcpy(message.data() + sizeof(header), handle->data + handle->numFds,
+           sizeof(int) * handle->numInts);
+    return SeqpacketServer::send(fd, message.data(), message.size(), handle->data, handle->numFds);
+}
+
+
+bool FrameExporter::sendEverything(int fd) {
+    std::lock_guard<std::mutex> lock(mLock);
+    bool ok = sendRing(fd);
+    for (auto&& buffer : mBuffers) {
+        if (ok && buffer.handle != nullptr) {
+            ok = sendBuffer(fd, buffer);
+        }
+    }
+    return ok;
+}
+
+
+void FrameExporter::sendChangedBuffers(const std::vector<int>& consumers,
+                                       std::vector<int>* gone) {
+    std::lock_guard<std::mutex> lock(mLock);
+    for (uint32_t bufferId : mChangedBuffers) {
+        for (int fd : consumers) {
+            if (!sendBuffer(fd, mBuffers[bufferId])) {
+                gone->push_back(fd);
+            }
+        }
+    }
+    mChangedBuffers.clear();
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
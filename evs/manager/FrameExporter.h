@@ -0,0 +1,94 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMEEXPORTER_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMEEXPORTER_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <cutils/native_handle.h>
+#include <utils/Timers.h>
+
+#include "FrameExport.h"
+#include "SeqpacketServer.h"
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Publishes a HalCamera's frames into shared memory for read-only consumers in other processes,
+// as laid out in FrameExport.h.  Publishing a frame costs a few stores and, when someone is
+// listening, one futex wake, however many consumers there are.
+class FrameExporter {
+public:
+    explicit FrameExporter(const std::string& cameraId);
+    ~FrameExporter();
+
+    // Sets up the ring and starts accepting consumers.  Returns false if it can't.
+    bool start();
+
+    // Called for each frame as it arrives from the hardware, and again as it goes back
+    void publishFrame(const BufferDesc& buffer, nsecs_t arrivalTime);
+    void frameReturned(uint32_t bufferId);
+
+    unsigned getConsumerCount() const   { return mServer.getClientCount(); };
+
+private:
+    // What we last sent consumers for each buffer id
+    struct ExportedBuffer {
+        native_handle_t*    handle = nullptr;   // Our own copy, or null if we haven't seen it
+        uint64_t            identity = 0;       // Tells a different buffer under the same id
+        BufferDesc          desc;               // Without memHandle
+    };
+
+    // Our SeqpacketServer's handlers
+    bool sendEverything(int fd);
+    void sendChangedBuffers(const std::vector<int>& consumers, std::vector<int>* gone);
+
+    bool sendRing(int fd);
+    bool sendBuffer(int fd, const ExportedBuffer& buffer);
+    bool noteBuffer(const BufferDesc& buffer);
+
+    std::string             mCameraId;
+    int                     mRingFd = -1;
+    ExportRing*             mRing = nullptr;
+    SeqpacketServer         mServer;        // Woken when there are new buffers to send out
+
+    // Only touched by publishFrame()
+    uint64_t                mFrameNumber = 0;
+    bool                    mWarnedBufferId = false;
+
+    std::mutex              mLock;          // Guards the fields below
+    ExportedBuffer          mBuffers[kMaxExportedBuffers];
+    std::vector<uint32_t>   mChangedBuffers;    // Not yet sent to the consumers we have
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMEEXPORTER_H
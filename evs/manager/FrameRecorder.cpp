@@ -0,0 +1,606 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include "FrameRecorder.h"
+#include "ShaderProgram.h"
+
+#include <log/log.h>
+#include <utils/Trace.h>
+#include <android/native_window.h>
+
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+static const char kMimeType[] = "video/avc";
+static const int32_t kColorFormatSurface = 0x7F000789;  // MediaCodecInfo's COLOR_FormatSurface
+static const uint32_t kBufferFlagKeyFrame = 1;          // MediaCodec's BUFFER_FLAG_KEY_FRAME
+
+// Comfortably more buffers than a camera cycles through
+static const size_t kMaxBufferImages = 16;
+
+// How long to wait for the encoder to finish once we've told it the stream is over
+static const int64_t kDrainTimeoutUs = 10000;
+static const unsigned kMaxDrainTries = 50;
+
+
+static const char kVertexShader[] =
+        "attribute vec4 pos;                        \n"
+        "attribute vec2 tex;                        \n"
+        "varying vec2 uv;                           \n"
+        "void main()                                \n"
+        "{                                          \n"
+        "   gl_Position = pos;                      \n"
+        "   uv = tex;                               \n"
+        "}                                          \n";
+
+// External textures, so the GPU takes care of whatever format the camera delivers
+static const char kFragmentShader[] =
+        "#extension GL_OES_EGL_image_external : require \n"
+        "precision mediump float;                   \n"
+        "uniform samplerExternalOES image;          \n"
+        "varying vec2 uv;                           \n"
+        "void main()                                \n"
+        "{                                          \n"
+        "   gl_FragColor = texture2D(image, uv);    \n"
+        "}                                          \n";
+
+
+FrameRecorder::FrameRecorder(const std::string& cameraId, const Options& options,
+                             std::function<void(const BufferDesc&)> doneWithFrame) :
+    mCameraId(cameraId),
+    mOptions(options),
+    mDoneWithFrame(doneWithFrame),
+    // Allowing for jitter, so a camera running at our rate doesn't lose every other frame
+    mMinFrameInterval(seconds_to_nanoseconds(1) / std::max(options.maxFrameRate, 1u) * 3 / 4),
+    mBufferImages(kMaxBufferImages) {
+}
+
+
+FrameRecorder::~FrameRecorder() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mQuit = true;
+    }
+    mSignal.notify_one();
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+}
+
+
+bool FrameRecorder::start() {
+    if (access(mOptions.directory.c_str(), W_OK) != 0) {
+        ALOGE("Can't record camera %s into %s: %s", mCameraId.c_str(),
+              mOptions.directory.c_str(), strerror(errno));
+        return false;
+    }
+
+    mThread = std::thread([this]() { recordingThread(); });
+    ALOGI("Recording camera %s into %s", mCameraId.c_str(), mOptions.directory.c_str());
+    return true;
+}
+
+
+bool FrameRecorder::recordFrame(const BufferDesc& buffer, nsecs_t arrivalTime) {
+    if (arrivalTime - mLastFrameTime < mMinFrameInterval) {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(mLock);
+    if (mQuit || mPending.size() >= kMaxPendingFrames) {
+        return false;
+    }
+    mLastFrameTime = arrivalTime;
+    mPending.push_back({ buffer, arrivalTime });
+    mSignal.notify_one();
+    return true;
+}
+
+
+void FrameRecorder::streamEnded() {
+    std::lock_guard<std::mutex> lock(mLock);
+    if (!mQuit) {
+        mPending.push_back({});
+        mSignal.notify_one();
+    }
+}
+
+
+void FrameRecorder::recordingThread() {
+    const bool ready = initGl();
+    if (!ready) {
+        ALOGE("Not recording camera %s without GL", mCameraId.c_str());
+    }
+
+    std::unique_lock<std::mutex> lock(mLock);
+    if (!ready) {
+        // Turn away frames from now on, but hand back any we already took
+        mQuit = true;
+    }
+    bool encoderFailed = false;
+    while (true) {
+        mSignal.wait(lock, [this]() { return mQuit || !mPending.empty(); });
+        if (mPending.empty()) {
+            break;
+        }
+        PendingFrame frame = mPending.front();
+        mPending.pop_front();
+        lock.unlock();
+
+        if (frame.buffer.memHandle == nullptr) {
+            // The stream stopped, so wrap up this file.  The next stream gets a fresh start.
+            stopEncoder();
+            encoderFailed = false;
+        } else {
+            if (ready && !encoderFailed) {
+                if (mCodec != nullptr &&
+                    (frame.buffer.width != mWidth || frame.buffer.height != mHeight)) {
+                    // A new size needs a new encoder, and a new file
+                    stopEncoder();
+                }
+                if (mCodec == nullptr && !startEncoder(frame.buffer.width, frame.buffer.height)) {
+                    ALOGE("Failed to start encoding camera %s", mCameraId.c_str());
+                    encoderFailed = true;
+                } else {
+                    encodeFrame(frame);
+                }
+            }
+            mDoneWithFrame(frame.buffer);
+        }
+
+        lock.lock();
+    }
+    lock.unlock();
+
+    stopEncoder();
+    shutdownGl();
+}
+
+
+bool FrameRecorder::initGl() {
+    mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (mDisplay == EGL_NO_DISPLAY || !eglInitialize(mDisplay, nullptr, nullptr)) {
+        ALOGE("Failed to initialize EGL for recording");
+        mDisplay = EGL_NO_DISPLAY;
+        return false;
+    }
+
+    // The encoder's input surface takes only configurations it can record
+    const EGLint configAttribs[] = {
+            EGL_RED_SIZE,           8,
+            EGL_GREEN_SIZE,         8,
+            EGL_BLUE_SIZE,          8,
+            EGL_RENDERABLE_TYPE,    EGL_OPENGL_ES2_BIT,
+            EGL_RECORDABLE_ANDROID, EGL_TRUE,
+            EGL_NONE
+    };
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(mDisplay, configAttribs, &mConfig, 1, &numConfigs) || numConfigs != 1) {
+        ALOGE("No recordable EGL configuration");
+        return false;
+    }
+
+    const EGLint contextAttribs[] = { EGL_CONTEXT_CLIENT_VERSION, 2, EGL_NONE };
+    mContext = eglCreateContext(mDisplay, mConfig, EGL_NO_CONTEXT, contextAttribs);
+    if (mContext == EGL_NO_CONTEXT) {
+        ALOGE("Failed to create a GL context for recording");
+        return false;
+    }
+    return true;
+}
+
+
+void FrameRecorder::shutdownGl() {
+    if (mDisplay == EGL_NO_DISPLAY) {
+        return;
+    }
+
+    // Destroying the context takes our program along with it
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (mContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(mDisplay, mContext);
+    }
+    eglTerminate(mDisplay);
+    mContext = EGL_NO_CONTEXT;
+    mDisplay = EGL_NO_DISPLAY;
+    mProgram = 0;
+}
+
+
+// Builds our program in the current context, and looks up everything we set on it just once
+bool FrameRecorder::buildProgram() {
+    mProgram = support::buildShaderProgram(kVertexShader, kFragmentShader, "recording");
+    if (!mProgram) {
+        return false;
+    }
+
+    const GLint posAttrib = glGetAttribLocation(mProgram, "pos");
+    const GLint texAttrib = glGetAttribLocation(mProgram, "tex");
+    const GLint texLoc = glGetUniformLocation(mProgram, "image");
+    if (posAttrib < 0 || texAttrib < 0 || texLoc < 0) {
+        ALOGE("Couldn't find the recording shader's parameters");
+        glDeleteProgram(mProgram);
+        mProgram = 0;
+        return false;
+    }
+    mPosAttrib = posAttrib;
+    mTexAttrib = texAttrib;
+
+    // The sampler reads from texture slot 0, which stays with the program
+    glUseProgram(mProgram);
+    glUniform1i(texLoc, 0);
+    glUseProgram(0);
+    return true;
+}
+
+
+bool FrameRecorder::startEncoder(uint32_t width, uint32_t height) {
+    ATRACE_CALL();
+
+    AMediaFormat* format = AMediaFormat_new();
+    AMediaFormat_setString(format, AMEDIAFORMAT_KEY_MIME, kMimeType);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_WIDTH, width);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_HEIGHT, height);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_COLOR_FORMAT, kColorFormatSurface);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_BIT_RATE, mOptions.bitRate);
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_FRAME_RATE, mOptions.maxFrameRate);
+    // A key frame every second, so a new file is never far off when one is due
+    AMediaFormat_setInt32(format, AMEDIAFORMAT_KEY_I_FRAME_INTERVAL, 1);
+
+    mCodec = AMediaCodec_createEncoderByType(kMimeType);
+    bool started = mCodec != nullptr &&
+                   AMediaCodec_configure(mCodec, format, nullptr, nullptr,
+                                         AMEDIACODEC_CONFIGURE_FLAG_ENCODE) == AMEDIA_OK &&
+                   AMediaCodec_createInputSurface(mCodec, &mInputWindow) == AMEDIA_OK &&
+                   AMediaCodec_start(mCodec) == AMEDIA_OK;
+    AMediaFormat_delete(format);
+
+    if (started) {
+        mSurface = eglCreateWindowSurface(mDisplay, mConfig, mInputWindow, nullptr);
+        started = mSurface != EGL_NO_SURFACE &&
+                  eglMakeCurrent(mDisplay, mSurface, mSurface, mContext);
+    }
+    if (started && !mProgram) {
+        started = buildProgram();
+    }
+    if (!started) {
+        stopEncoder();
+        return false;
+    }
+
+    mWidth = width;
+    mHeight = height;
+    return true;
+}
+
+
+void FrameRecorder::stopEncoder() {
+    if (mCodec == nullptr) {
+        return;
+    }
+    ATRACE_CALL();
+
+    // Let the encoder finish what it has, so the file ends with the last frame we gave it
+    if (mSurface != EGL_NO_SURFACE && AMediaCodec_signalEndOfInputStream(mCodec) == AMEDIA_OK) {
+        drainEncoder(true);
+    }
+    finishSegment();
+
+    // Our buffer images live in the context we had current with the encoder's surface
+    releaseBufferImages();
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (mSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(mDisplay, mSurface);
+        mSurface = EGL_NO_SURFACE;
+    }
+    if (mInputWindow != nullptr) {
+        ANativeWindow_release(mInputWindow);
+        mInputWindow = nullptr;
+    }
+
+    AMediaCodec_stop(mCodec);
+    AMediaCodec_delete(mCodec);
+    mCodec = nullptr;
+    if (mOutputFormat != nullptr) {
+        AMediaFormat_delete(mOutputFormat);
+        mOutputFormat = nullptr;
+    }
+    mWidth = 0;
+    mHeight = 0;
+}
+
+
+void FrameRecorder::encodeFrame(const PendingFrame& frame) {
+    ATRACE_CALL();
+
+    BufferImage* bufferImage = findBufferImage(frame.buffer);
+    if (bufferImage == nullptr) {
+        return;
+    }
+
+    glViewport(0, 0, mWidth, mHeight);
+    glUseProgram(mProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, bufferImage->texture);
+
+    // The camera's first row is the top of the image
+    static const GLfloat verts[] = { -1.0f,  1.0f,   0.0f, 0.0f,   // left top
+                                      1.0f,  1.0f,   1.0f, 0.0f,   // right top
+                                     -1.0f, -1.0f,   0.0f, 1.0f,   // left bottom
+                                      1.0f, -1.0f,   1.0f, 1.0f    // right bottom
+    };
+    glVertexAttribPointer(mPosAttrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), verts);
+    glVertexAttribPointer(mTexAttrib, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(GLfloat), verts + 2);
+    glEnableVertexAttribArray(mPosAttrib);
+    glEnableVertexAttribArray(mTexAttrib);
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    glDisableVertexAttribArray(mPosAttrib);
+    glDisableVertexAttribArray(mTexAttrib);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+
+    // The camera buffer goes back as soon as we return, so the GPU has to be done reading it
+    glFinish();
+
+    // The encoder takes its timestamps from the surface, in the same clock as our arrival times
+    eglPresentationTimeANDROID(mDisplay, mSurface, frame.arrivalTime);
+    eglSwapBuffers(mDisplay, mSurface);
+
+    drainEncoder(false);
+}
+
+
+// Moves whatever the encoder has finished into the current file, starting a new one on the first
+// key frame once the current one is long enough
+void FrameRecorder::drainEncoder(bool endOfStream) {
+    const int64_t segmentUs = static_cast<int64_t>(mOptions.segmentSeconds) * 1000000;
+    unsigned tries = 0;
+    while (true) {
+        AMediaCodecBufferInfo info = {};
+        const ssize_t index = AMediaCodec_dequeueOutputBuffer(mCodec, &info,
+                                                              endOfStream ? kDrainTimeoutUs : 0);
+        if (index == AMEDIACODEC_INFO_TRY_AGAIN_LATER) {
+            if (!endOfStream || ++tries >= kMaxDrainTries) {
+                break;
+            }
+        } else if (index == AMEDIACODEC_INFO_OUTPUT_FORMAT_CHANGED) {
+            // What every file's track is made from.  It comes before any frames.
+            if (mOutputFormat != nullptr) {
+                AMediaFormat_delete(mOutputFormat);
+            }
+            mOutputFormat = AMediaCodec_getOutputFormat(mCodec);
+        } else if (index >= 0) {
+            size_t size = 0;
+            uint8_t* data = AMediaCodec_getOutputBuffer(mCodec, index, &size);
+            const bool keyFrame = (info.flags & kBufferFlagKeyFrame) != 0;
+            if (data != nullptr && info.size > 0 &&
+                !(info.flags & AMEDIACODEC_BUFFER_FLAG_CODEC_CONFIG)) {
+                // The codec config is in the output format, which each file gets on its own
+                if (mMuxer != nullptr && keyFrame &&
+                    info.presentationTimeUs - mSegmentStartUs >= segmentUs) {
+                    finishSegment();
+                }
+                if (mMuxer == nullptr && keyFrame) {
+                    mSegmentStartUs = info.presentationTimeUs;
+                    startSegment();
+                }
+                if (mMuxer != nullptr) {
+                    AMediaMuxer_writeSampleData(mMuxer, mTrack, data, &info);
+                }
+            }
+            AMediaCodec_releaseOutputBuffer(mCodec, index, false);
+            if (info.flags & AMEDIACODEC_BUFFER_FLAG_END_OF_STREAM) {
+                break;
+            }
+        } else if (index != AMEDIACODEC_INFO_OUTPUT_BUFFERS_CHANGED) {
+            ALOGE("Lost the encoder's output for camera %s (%zd)", mCameraId.c_str(), index);
+            break;
+        }
+    }
+}
+
+
+bool FrameRecorder::startSegment() {
+    if (mOutputFormat == nullptr) {
+        ALOGE("The encoder didn't say what it makes, so we can't start a file");
+        return false;
+    }
+
+    // Named for the camera and the time, which sorts the files of each camera in order
+    std::string prefix = "evs_";
+    for (char c : mCameraId) {
+        prefix += isalnum(c) ? c : '_';
+    }
+    prefix += '_';
+    char timestamp[32] = {};
+    const time_t now = time(nullptr);
+    struct tm local = {};
+    strftime(timestamp, sizeof(timestamp), "%Y%m%d_%H%M%S.mp4", localtime_r(&now, &local));
+    const std::string path = mOptions.directory + "/" + prefix + timestamp;
+
+    deleteOldSegments(prefix);
+
+    mFileFd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (mFileFd < 0) {
+        ALOGE("Failed to create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    mMuxer = AMediaMuxer_new(mFileFd, AMEDIAMUXER_OUTPUT_FORMAT_MPEG_4);
+    if (mMuxer != nullptr) {
+        mTrack = AMediaMuxer_addTrack(mMuxer, mOutputFormat);
+    }
+    if (mMuxer == nullptr || mTrack < 0 || AMediaMuxer_start(mMuxer) != AMEDIA_OK) {
+        ALOGE("Failed to start writing %s", path.c_str());
+        if (mMuxer != nullptr) {
+            AMediaMuxer_delete(mMuxer);
+            mMuxer = nullptr;
+        }
+        close(mFileFd);
+        mFileFd = -1;
+        return false;
+    }
+
+    ALOGI("Recording camera %s to %s", mCameraId.c_str(), path.c_str());
+    return true;
+}
+
+
+void FrameRecorder::finishSegment() {
+    if (mMuxer != nullptr) {
+        AMediaMuxer_stop(mMuxer);
+        AMediaMuxer_delete(mMuxer);
+        mMuxer = nullptr;
+    }
+    if (mFileFd >= 0) {
+        close(mFileFd);
+        mFileFd = -1;
+    }
+    mTrack = -1;
+    mSegmentStartUs = -1;
+}
+
+
+// Deletes the oldest of this camera's files until there's room for one more within our limits
+void FrameRecorder::deleteOldSegments(const std::string& prefix) {
+    if (mOptions.maxSegments == 0 && mOptions.maxBytes == 0) {
+        return;
+    }
+
+    DIR* dir = opendir(mOptions.directory.c_str());
+    if (dir == nullptr) {
+        ALOGW("Failed to look for old recordings in %s: %s", mOptions.directory.c_str(),
+              strerror(errno));
+        return;
+    }
+
+    // Ours are the prefix followed by a timestamp just like startSegment() makes, which keeps
+    // us off the files of a camera whose id merely starts the same way
+    static const size_t kTimestampLength = strlen("YYYYmmdd_HHMMSS.mp4");
+    std::vector<std::pair<std::string, uint64_t>> segments;    // Name and size
+    uint64_t totalBytes = 0;
+    while (struct dirent* entry = readdir(dir)) {
+        const std::string name = entry->d_name;
+        struct stat info = {};
+        if (name.size() != prefix.size() + kTimestampLength ||
+            name.compare(0, prefix.size(), prefix) != 0 || !isdigit(name[prefix.size()]) ||
+            name.compare(name.size() - 4, 4, ".mp4") != 0 ||
+            fstatat(dirfd(dir), name.c_str(), &info, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISREG(info.st_mode)) {
+            continue;
+        }
+        segments.emplace_back(name, info.st_size);
+        totalBytes += info.st_size;
+    }
+
+    // Oldest first, making room for the new file at the size we expect it to reach
+    std::sort(segments.begin(), segments.end());
+    const uint64_t newBytes = static_cast<uint64_t>(mOptions.bitRate / 8) *
+                              mOptions.segmentSeconds;
+    size_t count = segments.size();
+    for (auto&& segment : segments) {
+        const bool tooMany = mOptions.maxSegments != 0 && count + 1 > mOptions.maxSegments;
+        const bool tooBig = mOptions.maxBytes != 0 && totalBytes + newBytes > mOptions.maxBytes;
+        if (!tooMany && !tooBig) {
+            break;
+        }
+        if (unlinkat(dirfd(dir), segment.first.c_str(), 0) != 0) {
+            ALOGW("Failed to delete old recording %s: %s", segment.first.c_str(),
+                  strerror(errno));
+            break;
+        }
+        ALOGI("Deleted old recording %s", segment.first.c_str());
+        count--;
+        totalBytes -= segment.second;
+    }
+    closedir(dir);
+}
+
+
+FrameRecorder::BufferImage* FrameRecorder::findBufferImage(const BufferDesc& buffer) {
+    BufferImage* cached = mBufferImages.find(buffer);
+    if (cached != nullptr) {
+        return cached;
+    }
+
+    BufferImage bufferImage = {};
+    bufferImage.graphicBuffer = new GraphicBuffer(buffer.memHandle,
+                                                  GraphicBuffer::CLONE_HANDLE,
+                                                  buffer.width, buffer.height,
+                                                  buffer.format, 1, // layer count
+                                                  GRALLOC_USAGE_HW_TEXTURE,
+                                                  buffer.stride);
+    if (bufferImage.graphicBuffer.get() == nullptr) {
+        ALOGE("Failed to wrap camera buffer %u for recording", buffer.bufferId);
+        return nullptr;
+    }
+
+    const EGLint imageAttribs[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+    EGLClientBuffer clientBuffer =
+            static_cast<EGLClientBuffer>(bufferImage.graphicBuffer->getNativeBuffer());
+    bufferImage.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                          clientBuffer, imageAttribs);
+    if (bufferImage.image == EGL_NO_IMAGE_KHR) {
+        ALOGE("Failed to make an EGLImage of camera buffer %u", buffer.bufferId);
+        return nullptr;
+    }
+
+    glGenTextures(1, &bufferImage.texture);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, bufferImage.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES,
+                                 static_cast<GLeglImageOES>(bufferImage.image));
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+
+    return mBufferImages.insert(buffer, bufferImage,
+                                [this](BufferImage& old) { releaseBufferImage(old); });
+}
+
+
+void FrameRecorder::releaseBufferImage(BufferImage& bufferImage) {
+    glDeleteTextures(1, &bufferImage.texture);
+    eglDestroyImageKHR(mDisplay, bufferImage.image);
+    bufferImage = {};
+}
+
+
+void FrameRecorder::releaseBufferImages() {
+    mBufferImages.clear([this](BufferImage& bufferImage) { releaseBufferImage(bufferImage); });
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
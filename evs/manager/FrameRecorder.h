@@ -0,0 +1,162 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMERECORDER_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMERECORDER_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+
+#include <media/NdkMediaCodec.h>
+#include <media/NdkMediaFormat.h>
+#include <media/NdkMediaMuxer.h>
+
+#include "BufferCache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Records a HalCamera's frames into a series of MP4 files, encoding them with the hardware
+// encoder right here in the manager.  Each frame is drawn straight from the camera's own buffer
+// onto the encoder's input surface by the GPU, so recording costs no CPU copies of the frame and
+// no IPC.  Frames are only seen while some client has the stream running.
+class FrameRecorder {
+public:
+    struct Options {
+        std::string directory       = "/data/misc/evs/recordings";  // Must already exist
+        int32_t     bitRate         = 4000000;  // bits per second
+        unsigned    segmentSeconds  = 60;       // Each file starts on a key frame
+        unsigned    maxFrameRate    = 30;       // Frames beyond this are skipped
+
+        // Before each new file, the camera's oldest files are deleted to keep it within these
+        // limits, counting the new one.  0 means no limit.
+        unsigned    maxSegments     = 60;
+        uint64_t    maxBytes        = 2048ull * 1024 * 1024;
+    };
+
+    // Frames that wait on the GPU are frames the camera can't reuse, so if we fall behind by more
+    // than this we skip frames instead.  With the one being drawn, that's how many we can hold,
+    // which our HalCamera asks the hardware for on top of its clients' buffers.
+    static const unsigned kMaxPendingFrames = 2;
+    static const unsigned kMaxHeldFrames = kMaxPendingFrames + 1;
+
+    // Frames we keep go back through doneWithFrame, from our own thread
+    FrameRecorder(const std::string& cameraId, const Options& options,
+                  std::function<void(const BufferDesc&)> doneWithFrame);
+    ~FrameRecorder();
+
+    bool start();
+
+    // Called for each frame as it arrives from the hardware.  Returns true if we kept it, and
+    // will hand it back through doneWithFrame once the GPU is done reading it.
+    bool recordFrame(const BufferDesc& buffer, nsecs_t arrivalTime);
+
+    // Finishes off the current file when the stream stops
+    void streamEnded();
+
+private:
+    struct PendingFrame {
+        BufferDesc  buffer;             // A null handle marks the end of the stream
+        nsecs_t     arrivalTime = 0;
+    };
+
+    // Our GL view of each camera buffer, made the first time we see it
+    struct BufferImage {
+        sp<GraphicBuffer>   graphicBuffer;  // Keeps its own clone of the handle
+        EGLImageKHR         image   = EGL_NO_IMAGE_KHR;
+        GLuint              texture = 0;
+    };
+
+    // Every bit of EGL, GL and media state is touched only on the recording thread
+    void recordingThread();
+    bool initGl();
+    void shutdownGl();
+    bool buildProgram();
+    bool startEncoder(uint32_t width, uint32_t height);
+    void stopEncoder();
+    void encodeFrame(const PendingFrame& frame);
+    void drainEncoder(bool endOfStream);
+    bool startSegment();
+    void finishSegment();
+    void deleteOldSegments(const std::string& prefix);
+    BufferImage* findBufferImage(const BufferDesc& buffer);
+    void releaseBufferImage(BufferImage& bufferImage);
+    void releaseBufferImages();
+
+    const std::string       mCameraId;
+    const Options           mOptions;
+    std::function<void(const BufferDesc&)> mDoneWithFrame;
+    std::thread             mThread;
+
+    // Frames the camera delivers faster than this many apart are left for our clients alone
+    const nsecs_t           mMinFrameInterval;
+    nsecs_t                 mLastFrameTime = 0;     // Only touched by recordFrame()
+
+    std::mutex              mLock;          // Guards the fields below
+    std::condition_variable mSignal;
+    std::deque<PendingFrame> mPending;
+    bool                    mQuit = false;
+
+    // The recording thread's
+    EGLDisplay              mDisplay = EGL_NO_DISPLAY;
+    EGLConfig               mConfig = nullptr;
+    EGLContext              mContext = EGL_NO_CONTEXT;
+    EGLSurface              mSurface = EGL_NO_SURFACE;  // On the encoder's input
+    GLuint                  mProgram = 0;
+    GLuint                  mPosAttrib = 0;
+    GLuint                  mTexAttrib = 0;
+    support::BufferCache<BufferImage>   mBufferImages;
+
+    AMediaCodec*            mCodec = nullptr;
+    ANativeWindow*          mInputWindow = nullptr;
+    uint32_t                mWidth = 0;
+    uint32_t                mHeight = 0;
+    AMediaFormat*           mOutputFormat = nullptr;    // Once the encoder tells us
+    AMediaMuxer*            mMuxer = nullptr;
+    int                     mFileFd = -1;
+    ssize_t                 mTrack = -1;
+    int64_t                 mSegmentStartUs = -1;       // Of the first frame in this file
+    bool                    mSyncRequested = false;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMERECORDER_H
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FrameStats.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+void LatencyHistogram::record(nsecs_t duration) {
+    if (duration < 0) {
+        duration = 0;
+    }
+
+    unsigned bucket = 0;
+    for (nsecs_t limit = ms2ns(1); bucket < kNumBuckets - 1 && duration >= limit; limit *= 2) {
+        bucket++;
+    }
+    mBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+    mCount.fetch_add(1, std::memory_order_relaxed);
+    mTotal.fetch_add(duration, std::memory_order_relaxed);
+
+    nsecs_t max = mMax.load(std::memory_order_relaxed);
+    while (duration > max &&
+           !mMax.compare_exchange_weak(max, duration, std::memory_order_relaxed)) {
+        // max now holds the latest value, so just check again
+    }
+}
+
+
+void LatencyHistogram::dump(int fd, const char* label) const {
+    const uint64_t count = mCount.load(std::memory_order_relaxed);
+    const double avgMs = count ? nanoseconds_to_microseconds(mTotal.load()) / 1000.0 / count : 0;
+    dprintf(fd, "%s: n=%" PRIu64 " avg=%.1fms max=%.1fms |", label, count, avgMs,
+            nanoseconds_to_microseconds(mMax.load()) / 1000.0);
+
+    unsigned limitMs = 1;
+    for (unsigned i = 0; i < kNumBuckets; i++, limitMs *= 2) {
+        if (i < kNumBuckets - 1) {
+            dprintf(fd, " <%u:%" PRIu64, limitMs, mBuckets[i].load(std::memory_order_relaxed));
+        } else {
+            dprintf(fd, " >=%u:%" PRIu64 "\n", limitMs / 2,
+                    mBuckets[i].load(std::memory_order_relaxed));
+        }
+    }
+}
+
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
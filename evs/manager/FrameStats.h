@@ -0,0 +1,58 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMESTATS_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMESTATS_H
+
+#include <utils/Timers.h>
+
+#include <atomic>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Collects how long frames spend somewhere, in power of two millisecond buckets, so that buffer
+// counts can be sized from what actually happens in the field.  Safe to update from any thread.
+class LatencyHistogram {
+public:
+    void record(nsecs_t duration);
+
+    // Writes a one line summary, prefixed by the given label, to the given file descriptor
+    void dump(int fd, const char* label) const;
+
+private:
+    // Bucket i counts durations under 2^i ms, and the last bucket counts everything longer
+    static const unsigned kNumBuckets = 11;
+
+    std::atomic<uint64_t>   mBuckets[kNumBuckets] = {};
+    std::atomic<uint64_t>   mCount {0};
+    std::atomic<nsecs_t>    mTotal {0};
+    std::atomic<nsecs_t>    mMax {0};
+};
+
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_FRAMESTATS_H
@@ -20,6 +20,11 @@
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
 
 
 namespace android {
@@ -32,6 +37,10 @@ namespace implementation {
 // TODO:  We need to hook up death monitoring to detect stream death so we can attempt a reconnect
 
 
+// Each frame shows on this async track from its arrival until it goes back to the hardware
+static const char kFrameTrack[] = "EVS frame";
+
+
 sp<VirtualCamera> HalCamera::makeVirtualCamera() {
 
     // Create the client camera interface object
@@ -41,16 +50,22 @@ sp<VirtualCamera> HalCamera::makeVirtualCamera() {
         return nullptr;
     }
 
-    // Make sure we have enough buffers available for all our clients
-    if (!changeFramesInFlight(client->getAllowedBuffers())) {
+    // Make sure we have enough buffers available for all our clients.  We hold our control
+    // lock until the client is in our list, so a concurrent rebalance can't leave it out.
+    std::lock_guard<std::recursive_mutex> lock(mControlLock);
+    unsigned granted = 0;
+    if (!changeFramesInFlightLocked(client, client->getAllowedBuffers(), &granted)) {
         // Gah!  We couldn't get enough buffers, so we can't support this client
         // Null the pointer, dropping our reference, thus destroying the client object
         client = nullptr;
         return nullptr;
     }
+    client->setGrantedBuffers(granted);
 
     // Add this client to our ownership list via weak pointer
-    mClients.push_back(client);
+    updateClients([&client](ClientList& clients) {
+        clients.push_back(client);
+    });
 
     // Return the strong pointer to the client
     return client;
@@ -64,69 +79,125 @@ void HalCamera::disownVirtualCamera(sp<VirtualCamera> virtualCamera) {
         return;
     }
 
-    // Make sure the virtual camera's stream is stopped
+    // Make sure the virtual camera's stream is stopped.  That takes the client's own control
+    // lock, which always comes before ours, so we mustn't hold ours yet.
     virtualCamera->stopVideoStream();
 
+    std::lock_guard<std::recursive_mutex> lock(mControlLock);
+
     // Remove the virtual camera from our client list
-    unsigned clientCount = mClients.size();
-    mClients.remove(virtualCamera);
-    if (clientCount != mClients.size() + 1) {
+    bool found = false;
+    updateClients([&virtualCamera, &found](ClientList& clients) {
+        auto it = std::find(clients.begin(), clients.end(),
+                            wp<VirtualCamera>(virtualCamera));
+        if (it != clients.end()) {
+            clients.erase(it);
+            found = true;
+        }
+    });
+    if (!found) {
         ALOGE("Couldn't find camera in our client list to remove it");
     }
     virtualCamera->shutdown();
 
     // Recompute the number of buffers required with the target camera removed from the list
-    if (!changeFramesInFlight(0)) {
+    if (!changeFramesInFlightLocked(nullptr, 0)) {
         ALOGE("Error when trying to reduce the in flight buffer count");
     }
 }
 
 
-bool HalCamera::changeFramesInFlight(int delta) {
-    // Walk all our clients and count their currently required frames
-    unsigned bufferCount = 0;
-    for (auto&& client :  mClients) {
+void HalCamera::updateClients(std::function<void(ClientList&)> change) {
+    std::lock_guard<std::mutex> lock(mClientLock);
+    auto clients = std::make_shared<ClientList>(*mClients);
+    change(*clients);
+    std::atomic_store(&mClients, std::shared_ptr<const ClientList>(std::move(clients)));
+}
+
+
+bool HalCamera::changeFramesInFlight(const sp<VirtualCamera>& changing, unsigned wanted,
+                                     unsigned* granted) {
+    std::lock_guard<std::recursive_mutex> lock(mControlLock);
+    return changeFramesInFlightLocked(changing, wanted, granted);
+}
+
+
+bool HalCamera::changeFramesInFlightLocked(const sp<VirtualCamera>& changing, unsigned wanted,
+                                           unsigned* granted) {
+    // Collect what each of our clients would like
+    struct Demand {
+        sp<VirtualCamera>   client;
+        ClientPriority      priority;
+        unsigned            wanted;
+        unsigned            granted;
+    };
+    std::vector<Demand> demands;
+    bool changingFound = false;
+    for (auto&& client : *getClients()) {
         sp<VirtualCamera> virtCam = client.promote();
         if (virtCam != nullptr) {
-            bufferCount += virtCam->getAllowedBuffers();
+            const bool isChanging = (virtCam == changing);
+            changingFound |= isChanging;
+            demands.push_back({ virtCam, virtCam->getPriority(),
+                                isChanging ? wanted : virtCam->getAllowedBuffers(), 0 });
         }
     }
-
-    // Add the requested delta
-    bufferCount += delta;
-
-    // Never drop below 1 buffer -- even if all client cameras get closed
-    if (bufferCount < 1) {
-        bufferCount = 1;
+    if (changing != nullptr && !changingFound) {
+        demands.push_back({ changing, changing->getPriority(), wanted, 0 });
     }
 
-    // Ask the hardware for the resulting buffer count
-    Return<EvsResult> result = mHwCamera->setMaxFramesInFlight(bufferCount);
-    bool success = (result.isOk() && result == EvsResult::OK);
+    // Start by asking for everything.  Each time the hardware refuses, cut the next lowest
+    // priority class back to a single buffer per client and try again.  The highest priority
+    // class is never cut back:  if even that doesn't fit, we fail as a whole.
+    bool success = false;
+    for (int cutoff = NUM_PRIORITIES; cutoff > PRIORITY_DISPLAY && !success; cutoff--) {
+        unsigned bufferCount = 0;
+        for (auto&& demand : demands) {
+            demand.granted = (demand.priority >= cutoff) ? std::min(demand.wanted, 1u)
+                                                         : demand.wanted;
+            bufferCount += demand.granted;
+        }
 
-    // Update the size of our array of outstanding frame records
-    if (success) {
-        std::vector<FrameRecord> newRecords;
-        newRecords.reserve(bufferCount);
+        // The recorder holds frames of its own while it encodes, whoever else is getting them
+        if (mRecorder) {
+            bufferCount += FrameRecorder::kMaxHeldFrames;
+        }
 
-        // Copy and compact the old records that are still active
-        for (const auto& rec : mFrames) {
-            if (rec.refCount > 0) {
-                newRecords.emplace_back(rec);
-            }
+        // Never drop below 1 buffer -- even if all client cameras get closed
+        if (bufferCount < 1) {
+            bufferCount = 1;
         }
-        if (newRecords.size() > (unsigned)bufferCount) {
-            ALOGW("We found more frames in use than requested.");
+
+        // Ask the hardware for the resulting buffer count
+        Return<EvsResult> result = mHwCamera->setMaxFramesInFlight(bufferCount);
+        success = (result.isOk() && result == EvsResult::OK);
+        if (!success && cutoff > PRIORITY_DISPLAY + 1) {
+            ALOGW("Hardware refused %u buffers, so cutting back clients of priority %d and up",
+                  bufferCount, cutoff - 1);
         }
+    }
+    if (!success) {
+        return false;
+    }
 
-        mFrames.swap(newRecords);
+    // Tell everyone how many they actually get
+    for (auto&& demand : demands) {
+        if (demand.client == changing) {
+            if (granted != nullptr) {
+                *granted = demand.granted;
+            }
+        } else {
+            demand.client->setGrantedBuffers(demand.granted);
+        }
     }
 
-    return success;
+    // Our frame table doesn't depend on the buffer count, so that's all there is to it
+    return true;
 }
 
 
 Return<EvsResult> HalCamera::clientStreamStarting() {
+    std::lock_guard<std::recursive_mutex> lock(mControlLock);
     Return<EvsResult> result = EvsResult::OK;
 
     if (mStreamState == STOPPED) {
@@ -139,9 +210,11 @@ Return<EvsResult> HalCamera::clientStreamStarting() {
 
 
 void HalCamera::clientStreamEnding() {
+    std::lock_guard<std::recursive_mutex> lock(mControlLock);
+
     // Do we still have a running client?
     bool stillRunning = false;
-    for (auto&& client : mClients) {
+    for (auto&& client : *getClients()) {
         sp<VirtualCamera> virtCam = client.promote();
         if (virtCam != nullptr) {
             stillRunning |= virtCam->isStreaming();
@@ -156,23 +229,91 @@ void HalCamera::clientStreamEnding() {
 }
 
 
-Return<void> HalCamera::doneWithFrame(const BufferDesc& buffer) {
-    // Find this frame in our list of outstanding frames
-    unsigned i;
-    for (i=0; i<mFrames.size(); i++) {
-        if (mFrames[i].frameId == buffer.bufferId) {
-            break;
+void HalCamera::dump(int fd) {
+    std::shared_ptr<const ClientList> clients = getClients();
+    dprintf(fd, "HalCamera %s: %s, %zu clients\n", mCameraId.c_str(),
+            mStreamState.load() == RUNNING ? "streaming" : "stopped", clients->size());
+    dprintf(fd, "  frames received: %" PRIu64 ", taken by no client: %" PRIu64 "\n",
+            mFramesReceived.load(), mFramesRejected.load());
+    mHoldTimes.dump(fd, "  held by clients");
+    if (mExporter) {
+        dprintf(fd, "  exported to %u native consumers\n", mExporter->getConsumerCount());
+    }
+
+    for (auto&& client : *clients) {
+        sp<VirtualCamera> virtCam = client.promote();
+        if (virtCam != nullptr) {
+            virtCam->dump(fd);
         }
     }
-    if (i == mFrames.size()) {
+}
+
+
+void HalCamera::enableFrameExport(const std::string& cameraId) {
+    std::unique_ptr<FrameExporter> exporter = std::make_unique<FrameExporter>(cameraId);
+    if (!exporter->start()) {
+        ALOGE("Frames from camera %s won't be exported", cameraId.c_str());
+        return;
+    }
+    mExporter = std::move(exporter);
+}
+
+
+void HalCamera::enableRecording(const FrameRecorder::Options& options) {
+    // The recorder holds frames like a client does, and gives them back the same way
+    std::unique_ptr<FrameRecorder> recorder = std::make_unique<FrameRecorder>(
+            mCameraId, options, [this](const BufferDesc& buffer) { doneWithFrame(buffer); });
+    if (!recorder->start()) {
+        ALOGE("Frames from camera %s won't be recorded", mCameraId.c_str());
+        return;
+    }
+    mRecorder = std::move(recorder);
+}
+
+
+HalCamera::FrameRecord* HalCamera::getFrameRecord(uint32_t bufferId) {
+    if (bufferId < kMaxDirectFrames) {
+        return &mFrames[bufferId];
+    }
+
+    std::lock_guard<std::mutex> lock(mOverflowLock);
+    return &mOverflowFrames[bufferId];
+}
+
+
+// Drops one reference to the frame, and returns true if that was the last one
+bool HalCamera::releaseFrame(FrameRecord& record) {
+    uint32_t count = record.refCount.load(std::memory_order_relaxed);
+    do {
+        if (count == 0) {
+            ALOGE("Frame returned more times than it was delivered");
+            return false;
+        }
+    } while (!record.refCount.compare_exchange_weak(count, count - 1,
+                                                    std::memory_order_acq_rel));
+
+    return count == 1;
+}
+
+
+Return<void> HalCamera::doneWithFrame(const BufferDesc& buffer) {
+    ATRACE_CALL();
+
+    // Find this frame in our table of outstanding frames
+    FrameRecord* record = getFrameRecord(buffer.bufferId);
+    if (record->refCount.load(std::memory_order_acquire) == 0) {
         ALOGE("We got a frame back with an ID we don't recognize!");
-    } else {
-        // Are there still clients using this buffer?
-        mFrames[i].refCount--;
-        if (mFrames[i].refCount <= 0) {
-            // Since all our clients are done with this buffer, return it to the device layer
-            mHwCamera->doneWithFrame(buffer);
+    } else if (releaseFrame(*record)) {
+        // Since all our clients are done with this buffer, return it to the device layer
+        const nsecs_t holdTime = systemTime(SYSTEM_TIME_MONOTONIC) - record->arrivalTime;
+        ALOGV("Frame %d held by clients for %" PRId64 " us", buffer.bufferId,
+              nanoseconds_to_microseconds(holdTime));
+        mHoldTimes.record(holdTime);
+        ATRACE_ASYNC_END(kFrameTrack, support::makeTraceCookie(mTraceOwner, buffer.bufferId));
+        if (mExporter) {
+            mExporter->frameReturned(buffer.bufferId);
         }
+        mHwCamera->doneWithFrame(buffer);
     }
 
     return Void();
@@ -180,13 +321,62 @@ Return<void> HalCamera::doneWithFrame(const BufferDesc& buffer) {
 
 
 Return<void> HalCamera::deliverFrame(const BufferDesc& buffer) {
-    // Run through all our clients and deliver this frame to any who are eligible
+    ATRACE_CALL();
+
+    // Take one look at our client list and stick with it for this frame
+    std::shared_ptr<const ClientList> clients = getClients();
+
+    if (buffer.memHandle == nullptr) {
+        // The end of stream marker isn't a real frame, so it is only passed along
+        for (auto&& client : *clients) {
+            sp<VirtualCamera> virtCam = client.promote();
+            if (virtCam != nullptr) {
+                virtCam->deliverFrame(buffer);
+            }
+        }
+        if (mRecorder) {
+            mRecorder->streamEnded();
+        }
+        return Void();
+    }
+
+    // BufferDesc can't carry the capture time across HIDL, so the best we can do is note when
+    // each frame got to us
+    mFramesReceived++;
+    FrameRecord* record = getFrameRecord(buffer.bufferId);
+    if (record->refCount.load(std::memory_order_acquire) != 0) {
+        ALOGW("Frame %d delivered again before all our clients returned it", buffer.bufferId);
+    }
+    record->arrivalTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (mExporter) {
+        mExporter->publishFrame(buffer, record->arrivalTime);
+    }
+
+    // We hold a reference of our own while we hand the frame out, so that a client returning
+    // it straight away can't send it back to the hardware before the others have seen it
+    record->refCount.store(1, std::memory_order_release);
+    ATRACE_ASYNC_BEGIN(kFrameTrack, support::makeTraceCookie(mTraceOwner, buffer.bufferId));
+
+    // Run through all our clients and hand this frame to any who are eligible, skipping those
+    // whose frame rate cap says they don't want it yet.  This only queues it for each client's
+    // own delivery thread, so a slow client can't hold us up.
     unsigned frameDeliveries = 0;
-    for (auto&& client : mClients) {
+    if (mRecorder) {
+        record->refCount.fetch_add(1, std::memory_order_acq_rel);
+        if (mRecorder->recordFrame(buffer, record->arrivalTime)) {
+            frameDeliveries++;
+        } else {
+            releaseFrame(*record);
+        }
+    }
+    for (auto&& client : *clients) {
         sp<VirtualCamera> virtCam = client.promote();
-        if (virtCam != nullptr) {
+        if (virtCam != nullptr && virtCam->wantsFrame(record->arrivalTime)) {
+            record->refCount.fetch_add(1, std::memory_order_acq_rel);
             if (virtCam->deliverFrame(buffer)) {
                 frameDeliveries++;
+            } else {
+                releaseFrame(*record);
             }
         }
     }
@@ -194,21 +384,19 @@ Return<void> HalCamera::deliverFrame(const BufferDesc& buffer) {
     if (frameDeliveries < 1) {
         // If none of our clients could accept the frame, then return it right away
         ALOGI("Trivially rejecting frame with no acceptances");
-        mHwCamera->doneWithFrame(buffer);
-    } else {
-        // Add an entry for this frame in our tracking list
-        unsigned i;
-        for (i=0; i<mFrames.size(); i++) {
-            if (mFrames[i].refCount == 0) {
-                break;
-            }
+        mFramesRejected++;
+    }
+
+    // Drop our own reference, and return the frame if nobody else still has it
+    if (releaseFrame(*record)) {
+        if (frameDeliveries > 0) {
+            mHoldTimes.record(systemTime(SYSTEM_TIME_MONOTONIC) - record->arrivalTime);
         }
-        if (i == mFrames.size()) {
-            mFrames.emplace_back(buffer.bufferId);
-        } else {
-            mFrames[i].frameId = buffer.bufferId;
+        ATRACE_ASYNC_END(kFrameTrack, support::makeTraceCookie(mTraceOwner, buffer.bufferId));
+        if (mExporter) {
+            mExporter->frameReturned(buffer.bufferId);
         }
-        mFrames[i].refCount = frameDeliveries;
+        mHwCamera->doneWithFrame(buffer);
     }
 
     return Void();
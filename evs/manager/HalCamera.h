@@ -20,9 +20,21 @@
 #include <android/hardware/automotive/evs/1.0/types.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
-
+#include <utils/Timers.h>
+
+#include "FrameExporter.h"
+#include "FrameRecorder.h"
+#include "FrameStats.h"
+#include "TraceCookie.h"
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
 #include <thread>
-#include <list>
+#include <unordered_map>
+#include <vector>
 
 
 using namespace ::android::hardware::automotive::evs::V1_0;
@@ -45,7 +57,8 @@ class VirtualCamera;    // From VirtualCamera.h
 // stream from the hardware camera and distribute it to the associated VirtualCamera objects.
 class HalCamera : public IEvsCameraStream {
 public:
-    HalCamera(sp<IEvsCamera> hwCamera) : mHwCamera(hwCamera) {};
+    HalCamera(sp<IEvsCamera> hwCamera, const std::string& cameraId) :
+        mHwCamera(hwCamera), mCameraId(cameraId) {};
 
     // Factory methods for client VirtualCameras
     sp<VirtualCamera>   makeVirtualCamera();
@@ -53,32 +66,89 @@ public:
 
     // Implementation details
     sp<IEvsCamera>      getHwCamera()       { return mHwCamera; };
-    unsigned            getClientCount()    { return mClients.size(); };
-    bool                changeFramesInFlight(int delta);
+    const std::string&  getId() const       { return mCameraId; };
+    unsigned            getClientCount()    { return getClients()->size(); };
+    // Shares out buffers among our clients and asks the hardware for the total.  The given
+    // client, which needn't be in our list yet, now wants the given number of buffers, and
+    // is told how many it actually gets.  Pass a null client just to rebalance.
+    bool                changeFramesInFlight(const sp<VirtualCamera>& changing, unsigned wanted,
+                                             unsigned* granted = nullptr);
 
     Return<EvsResult>   clientStreamStarting();
     void                clientStreamEnding();
     Return<void>        doneWithFrame(const BufferDesc& buffer);
 
+    // Also publishes our frames for native consumers in other processes (see FrameExport.h).
+    // They only see frames while some client has the stream running.
+    void                enableFrameExport(const std::string& cameraId);
+
+    // Also records our frames into MP4 files with the hardware encoder (see FrameRecorder.h).
+    // Like exported frames, they're only recorded while some client has the stream running.
+    void                enableRecording(const FrameRecorder::Options& options);
+
+    // Writes our frame statistics, and those of our clients, to the given file descriptor
+    void                dump(int fd);
+
     // Methods from ::android::hardware::automotive::evs::V1_0::ICarCameraStream follow.
     Return<void> deliverFrame(const BufferDesc& buffer)  override;
 
 private:
     sp<IEvsCamera>                  mHwCamera;
-    std::list<wp<VirtualCamera>>    mClients;   // Weak pointers -> objects destruct if client dies
-
-    enum {
+    const std::string               mCameraId;      // As the hardware enumerator knows it
+    // Our clients, by weak pointer so the objects destruct if the client dies.  Frame delivery
+    // reads the list without locking, so it is never changed in place:  each change publishes
+    // a new copy, and readers keep whichever copy they picked up for as long as they need it.
+    typedef std::vector<wp<VirtualCamera>> ClientList;
+    std::shared_ptr<const ClientList>   getClients()    { return std::atomic_load(&mClients); };
+    void                                updateClients(std::function<void(ClientList&)> change);
+
+    std::shared_ptr<const ClientList>   mClients = std::make_shared<ClientList>();
+    std::mutex                          mClientLock;    // Serializes updateClients()
+
+    // Serializes the calls that change our clients' buffers or the hardware stream, as they
+    // may come from any client on any RPC thread.  Frame delivery and returns never take it.
+    // It is recursive because the last reference to a client may drop while we hold it, and a
+    // client destroyed mid-stream calls clientStreamEnding() on its way out.
+    std::recursive_mutex            mControlLock;
+    bool                            changeFramesInFlightLocked(const sp<VirtualCamera>& changing,
+                                                               unsigned wanted,
+                                                               unsigned* granted = nullptr);
+
+    enum StreamState {
         STOPPED,
         RUNNING,
         STOPPING,
-    }                               mStreamState = STOPPED;
+    };
+    std::atomic<StreamState>        mStreamState {STOPPED};     // Written under mControlLock
 
+    // One per hardware buffer.  A frame is outstanding while its refCount is non-zero, and
+    // goes back to the hardware when the last client holding it is done.
     struct FrameRecord {
-        uint32_t    frameId;
-        uint32_t    refCount;
-        FrameRecord(uint32_t id) : frameId(id), refCount(0) {};
+        std::atomic<uint32_t>   refCount {0};
+        nsecs_t                 arrivalTime = 0;    // When the hardware delivered it to us
+                                                    // (CLOCK_MONOTONIC)
     };
-    std::vector<FrameRecord>        mFrames;
+
+    FrameRecord* getFrameRecord(uint32_t bufferId);
+    bool releaseFrame(FrameRecord& record);
+
+    // Frames are looked up directly by bufferId, which the hardware layer keeps small.  The few
+    // cameras that use larger ids fall back to a map, which is slower but still never shrinks,
+    // so record pointers stay valid without holding its lock.
+    static const uint32_t kMaxDirectFrames = 256;
+    FrameRecord                                 mFrames[kMaxDirectFrames];
+    std::mutex                                  mOverflowLock;
+    std::unordered_map<uint32_t, FrameRecord>   mOverflowFrames;
+
+    // Statistics for dump()
+    std::atomic<uint64_t>   mFramesReceived {0};    // Every frame the hardware sent us
+    std::atomic<uint64_t>   mFramesRejected {0};    // Those that no client took
+    LatencyHistogram        mHoldTimes;             // From arrival to going back to the hardware
+
+    std::unique_ptr<FrameExporter>  mExporter;  // Only if enableFrameExport() was called
+    std::unique_ptr<FrameRecorder>  mRecorder;  // Only if enableRecording() was called
+
+    const unsigned          mTraceOwner = support::nextTraceOwner();    // See makeTraceCookie()
 };
 
 } // namespace implementation
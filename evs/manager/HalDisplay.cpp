@@ -15,6 +15,7 @@
  */
 
 #include <log/log.h>
+#include <utils/Trace.h>
 #include "HalDisplay.h"
 
 namespace android {
@@ -93,6 +94,7 @@ Return<void> HalDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb) {
  * Notifies the display that the buffer is ready to be used.
  */
 Return<EvsResult> HalDisplay::returnTargetBufferForDisplay(const BufferDesc& buffer) {
+    ATRACE_CALL();
     if (mHwDisplay) {
         return mHwDisplay->returnTargetBufferForDisplay(buffer);
     } else {
@@ -0,0 +1,224 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "SeqpacketServer.h"
+
+#include <cutils/android_filesystem_config.h>
+#include <log/log.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <stddef.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+SeqpacketServer::SeqpacketServer(const std::string& name, const std::string& description,
+                                 unsigned maxClients) :
+        mName(name),
+        mDescription(description),
+        mMaxClients(maxClients) {}
+
+
+SeqpacketServer::~SeqpacketServer() {
+    stop();
+    if (mListenFd >= 0) close(mListenFd);
+    if (mWakeFd >= 0) close(mWakeFd);
+}
+
+
+bool SeqpacketServer::start(ConnectHandler onConnect, WakeHandler onWake) {
+    mOnConnect = std::move(onConnect);
+    mOnWake = std::move(onWake);
+
+    struct sockaddr_un addr = {};
+    addr.sun_family = AF_UNIX;
+    if (mName.size() + 1 > sizeof(addr.sun_path)) {
+        ALOGE("@%s is too long a socket name", mName.c_str());
+        return false;
+    }
+    memcpy(addr.sun_path + 1, mName.data(), mName.size());
+    const socklen_t addrLen = offsetof(struct sockaddr_un, sun_path) + 1 + mName.size();
+
+    mListenFd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (mListenFd < 0 ||
+        bind(mListenFd, reinterpret_cast<struct sockaddr*>(&addr), addrLen) != 0 ||
+        listen(mListenFd, mMaxClients) != 0) {
+        ALOGE("Failed to listen for %ss on @%s: %s", mDescription.c_str(), mName.c_str(),
+              strerror(errno));
+        return false;
+    }
+
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    if (mWakeFd < 0) {
+        ALOGE("Failed to create the wake up for @%s: %s", mName.c_str(), strerror(errno));
+        return false;
+    }
+
+    mThread = std::thread([this]() { serviceThread(); });
+    return true;
+}
+
+
+void SeqpacketServer::stop() {
+    if (mThread.joinable()) {
+        mQuit = true;
+        wake();
+        mThread.join();
+    }
+
+    for (int fd : mClients) {
+        close(fd);
+    }
+    mClients.clear();
+    mClientCount = 0;
+}
+
+
+void SeqpacketServer::wake() {
+    uint64_t one = 1;
+    if (mWakeFd >= 0 && write(mWakeFd, &one, sizeof(one)) != sizeof(one)) {
+        ALOGW("Failed to wake the thread serving @%s: %s", mName.c_str(), strerror(errno));
+    }
+}
+
+
+bool SeqpacketServer::send(int fd, const void* data, size_t length,
+                           const int* fds, size_t numFds) {
+    struct iovec iov = { const_cast<void*>(data), length };
+    struct msghdr msg = {};
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * numFds));
+    if (numFds > 0) {
+        msg.msg_control = control.data();
+        msg.msg_controllen = control.size();
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * numFds);
+        memcpy(CMSG_DATA(cmsg), fds, sizeof(int) * numFds);
+    }
+
+    ssize_t sent = TEMP_FAILURE_RETRY(sendmsg(fd, &msg, MSG_DONTWAIT | MSG_NOSIGNAL));
+    return sent == static_cast<ssize_t>(length);
+}
+
+
+void SeqpacketServer::acceptClient() {
+    int fd = TEMP_FAILURE_RETRY(accept4(mListenFd, nullptr, nullptr, SOCK_CLOEXEC));
+    if (fd < 0) {
+        return;
+    }
+
+    // The same rule as for the rest of the EVS manager's interface
+    struct ucred cred = {};
+    socklen_t len = sizeof(cred);
+    if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0 ||
+        cred.uid != AID_AUTOMOTIVE_EVS) {
+        ALOGE("EVS %s access denied: pid = %d, uid = %d", mDescription.c_str(), cred.pid,
+              cred.uid);
+        close(fd);
+        return;
+    }
+
+    if (mClients.size() >= mMaxClients) {
+        ALOGW("Turning away %s pid %d, we already have %u", mDescription.c_str(), cred.pid,
+              mMaxClients);
+        close(fd);
+        return;
+    }
+    if (!mOnConnect(fd, cred.pid)) {
+        ALOGW("Failed to set up %s pid %d: %s", mDescription.c_str(), cred.pid, strerror(errno));
+        close(fd);
+        return;
+    }
+
+    ALOGI("Connected %s pid %d on @%s", mDescription.c_str(), cred.pid, mName.c_str());
+    mClients.push_back(fd);
+    mClientCount = mClients.size();
+}
+
+
+void SeqpacketServer::serviceThread() {
+    while (!mQuit) {
+        std::vector<struct pollfd> fds;
+        fds.push_back({ mWakeFd, POLLIN, 0 });
+        fds.push_back({ mListenFd, POLLIN, 0 });
+        for (int fd : mClients) {
+            // Clients never send us anything, so all we look out for is them going away
+            fds.push_back({ fd, POLLIN, 0 });
+        }
+
+        if (TEMP_FAILURE_RETRY(poll(fds.data(), fds.size(), -1)) < 0) {
+            ALOGE("Poll on @%s failed: %s", mName.c_str(), strerror(errno));
+            break;
+        }
+        if (mQuit) {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN) {
+            uint64_t count;
+            if (read(mWakeFd, &count, sizeof(count)) != sizeof(count)) {
+                ALOGW("Failed to read the wake up for @%s: %s", mName.c_str(), strerror(errno));
+            }
+        }
+
+        // Drop anyone who hung up, or who can't take what changed.  Changes go to the clients
+        // we already have before we take on new ones, which are sent everything as they connect.
+        std::vector<int> gone;
+        for (size_t i = 2; i < fds.size(); i++) {
+            if (fds[i].revents != 0) {
+                gone.push_back(fds[i].fd);
+            }
+        }
+        mOnWake(mClients, &gone);
+
+        for (int fd : gone) {
+            auto it = std::find(mClients.begin(), mClients.end(), fd);
+            if (it != mClients.end()) {
+                ALOGI("A %s left @%s", mDescription.c_str(), mName.c_str());
+                mClients.erase(it);
+                close(fd);
+            }
+        }
+        mClientCount = mClients.size();
+
+        if (fds[1].revents & POLLIN) {
+            acceptClient();
+        }
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
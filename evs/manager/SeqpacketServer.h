@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_V1_0_SEQPACKETSERVER_H
+#define ANDROID_AUTOMOTIVE_EVS_V1_0_SEQPACKETSERVER_H
+
+#include <sys/types.h>
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Serves an abstract SOCK_SEQPACKET socket to native clients that only ever listen, from a
+// thread of its own.  It lets in processes running as AID_AUTOMOTIVE_EVS, the same rule as for
+// the rest of the manager's interface, up to a limit, and drops them when they hang up or can't
+// keep up.  What they're sent is up to the owner, through the two handlers:
+//
+//   - onConnect(fd, pid) sends a new client whatever it needs to start, and returns false to turn
+//     it away instead
+//   - onWake(clients, &gone) runs each time the thread wakes, wake() being one reason, before any
+//     new client is let in.  It sends the clients what has changed, and adds any it failed to
+//     send to into |gone|.
+//
+// Both run on the server's thread, which is the only one that touches the clients.
+class SeqpacketServer {
+public:
+    typedef std::function<bool(int fd, pid_t pid)> ConnectHandler;
+    typedef std::function<void(const std::vector<int>& clients, std::vector<int>* gone)>
+            WakeHandler;
+
+    // |description| is what the log calls the clients, like "frame consumer"
+    SeqpacketServer(const std::string& name, const std::string& description,
+                    unsigned maxClients);
+    ~SeqpacketServer();
+
+    // Starts listening on @name.  Returns false if it can't.
+    bool start(ConnectHandler onConnect, WakeHandler onWake);
+
+    // Stops the thread and drops every client.  Owners call this before tearing down anything
+    // their handlers use.
+    void stop();
+
+    // Has the thread call onWake() soon
+    void wake();
+
+    unsigned getClientCount() const     { return mClientCount; }
+
+    // Sends one message with the given fds attached, without waiting:  a client that doesn't
+    // keep up with its socket is dropped rather than allowed to hold up the manager
+    static bool send(int fd, const void* data, size_t length,
+                     const int* fds = nullptr, size_t numFds = 0);
+
+private:
+    void serviceThread();
+    void acceptClient();
+
+    const std::string       mName;
+    const std::string       mDescription;
+    const unsigned          mMaxClients;
+    ConnectHandler          mOnConnect;
+    WakeHandler             mOnWake;
+
+    int                     mListenFd = -1;
+    int                     mWakeFd = -1;   // eventfd:  wake() was called, or time to quit
+    std::atomic<bool>       mQuit {false};
+    std::thread             mThread;
+
+    std::vector<int>        mClients;       // Only touched by the thread once it's running
+    std::atomic<unsigned>   mClientCount {0};
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_V1_0_SEQPACKETSERVER_H
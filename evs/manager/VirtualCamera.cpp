@@ -20,6 +20,11 @@
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <inttypes.h>
+#include <stdio.h>
 
 
 namespace android {
@@ -29,8 +34,14 @@ namespace V1_0 {
 namespace implementation {
 
 
+// Each frame a client holds shows on this async track, from when we accept it for the client
+// until it comes back
+static const char kClientFrameTrack[] = "EVS client frame";
+
+
 VirtualCamera::VirtualCamera(sp<HalCamera> halCamera) :
     mHalCamera(halCamera) {
+    mDeliveryThread = std::thread([this]() { deliveryThread(); });
 }
 
 
@@ -40,6 +51,9 @@ VirtualCamera::~VirtualCamera() {
 
 
 void VirtualCamera::shutdown() {
+    // Nothing more goes to the client from here on
+    stopDeliveryThread();
+
     // In normal operation, the stream should already be stopped by the time we get here
     if (mStreamState != STOPPED) {
         // Note that if we hit this case, no terminating frame will be sent to the client,
@@ -49,15 +63,23 @@ void VirtualCamera::shutdown() {
         // Tell the frame delivery pipeline we don't want any more frames
         mStreamState = STOPPING;
 
-        if (mFramesHeld.size() > 0) {
+        std::deque<BufferDesc> framesHeld;
+        {
+            std::lock_guard<std::mutex> lock(mFrameLock);
+            framesHeld.swap(mFramesHeld);
+            mPendingFrames.clear();
+            mSendTimes.clear();
+        }
+        if (framesHeld.size() > 0) {
             ALOGW("VirtualCamera destructing with frames in flight.");
 
             // Return to the underlying hardware camera any buffers the client was holding
-            for (auto&& heldBuffer : mFramesHeld) {
+            for (auto&& heldBuffer : framesHeld) {
                 // Tell our parent that we're done with this buffer
+                ATRACE_ASYNC_END(kClientFrameTrack,
+                                 support::makeTraceCookie(mTraceOwner, heldBuffer.bufferId));
                 mHalCamera->doneWithFrame(heldBuffer);
             }
-            mFramesHeld.clear();
         }
 
         // Give the underlying hardware camera the heads up that it might be time to stop
@@ -69,7 +91,29 @@ void VirtualCamera::shutdown() {
 }
 
 
+bool VirtualCamera::wantsFrame(nsecs_t arrivalTime) {
+    const nsecs_t interval = mFrameInterval.load(std::memory_order_relaxed);
+    if (interval <= 0) {
+        return true;
+    }
+
+    // Frames don't arrive exactly on time, so take one that's a little early rather than wait
+    // almost a whole extra frame for the next
+    const nsecs_t due = mNextFrameTime.load(std::memory_order_relaxed);
+    if (arrivalTime < due - interval / 4) {
+        mFramesSkippedByRate++;
+        return false;
+    }
+
+    // Stay on schedule, unless we've fallen a whole interval behind it
+    mNextFrameTime.store((arrivalTime > due + interval) ? arrivalTime + interval : due + interval,
+                         std::memory_order_relaxed);
+    return true;
+}
+
+
 bool VirtualCamera::deliverFrame(const BufferDesc& buffer) {
+    std::lock_guard<std::mutex> lock(mFrameLock);
     if (buffer.memHandle == nullptr) {
         // Warn if we got an unexpected stream termination
         if (mStreamState != STOPPING) {
@@ -78,30 +122,107 @@ bool VirtualCamera::deliverFrame(const BufferDesc& buffer) {
         }
 
         // This is the stream end marker, so send it along, then mark the stream as stopped
-        mStream->deliverFrame(buffer);
+        mPendingFrames.push_back(buffer);
+        mFrameSignal.notify_one();
         mStreamState = STOPPED;
         return true;
     } else {
         if (mStreamState == STOPPED) {
             // A stopped stream gets no frames
             return false;
-        } else if (mFramesHeld.size() >= mFramesAllowed) {
-            // Indicate that we declined to send the frame to the client because they're at quota
+        } else if (mFramesHeld.size() >= mFramesGranted) {
+            // Indicate that we declined to send the frame to the client because they're at quota.
+            // Frames still waiting in our queue count against it, so a stuck client only ever
+            // drops its own frames.
             ALOGI("Skipping new frame as we hold %zu of %u allowed.",
-                  mFramesHeld.size(), mFramesAllowed);
+                  mFramesHeld.size(), mFramesGranted.load());
+            mFramesDroppedAtQuota++;
             return false;
         } else {
             // Keep a record of this frame so we can clean up if we have to in case of client death
             mFramesHeld.push_back(buffer);
+            ATRACE_ASYNC_BEGIN(kClientFrameTrack,
+                               support::makeTraceCookie(mTraceOwner, buffer.bufferId));
 
-            // Pass this buffer through to our client
-            mStream->deliverFrame(buffer);
+            // Queue this buffer for our delivery thread to pass through to our client
+            mPendingFrames.push_back(buffer);
+            mFrameSignal.notify_one();
             return true;
         }
     }
 }
 
 
+// Sends our queued frames to the client, one at a time and in order
+void VirtualCamera::deliveryThread() {
+    std::unique_lock<std::mutex> lock(mFrameLock);
+    while (true) {
+        mFrameSignal.wait(lock, [this]() { return mDeliveryQuit || !mPendingFrames.empty(); });
+        if (mDeliveryQuit) {
+            // We're being shut down, but the client should still hear that its stream ended
+            auto marker = std::find_if(mPendingFrames.begin(), mPendingFrames.end(),
+                                       [](const BufferDesc& pending) {
+                                           return pending.memHandle == nullptr;
+                                       });
+            if (marker == mPendingFrames.end()) {
+                break;
+            }
+            mPendingFrames.erase(mPendingFrames.begin(), marker);
+        }
+
+        BufferDesc buffer = mPendingFrames.front();
+        mPendingFrames.pop_front();
+        sp<IEvsCameraStream> stream = mStream;
+        if (buffer.memHandle != nullptr) {
+            mSendTimes[buffer.bufferId] = systemTime(SYSTEM_TIME_MONOTONIC);
+        }
+
+        // Don't hold the lock across the call, since this is where a slow client blocks us
+        lock.unlock();
+        if (stream != nullptr) {
+            ATRACE_NAME("deliverFrame to client");
+            auto result = stream->deliverFrame(buffer);
+            if (!result.isOk()) {
+                ALOGE("Failed to deliver frame %d to the client", buffer.bufferId);
+            } else if (buffer.memHandle != nullptr) {
+                mFramesDelivered++;
+            }
+        }
+        lock.lock();
+    }
+}
+
+
+void VirtualCamera::stopDeliveryThread() {
+    {
+        std::lock_guard<std::mutex> lock(mFrameLock);
+        mDeliveryQuit = true;
+    }
+    mFrameSignal.notify_one();
+
+    if (mDeliveryThread.joinable()) {
+        mDeliveryThread.join();
+    }
+}
+
+
+void VirtualCamera::dump(int fd) {
+    size_t framesHeld = 0;
+    {
+        std::lock_guard<std::mutex> lock(mFrameLock);
+        framesHeld = mFramesHeld.size();
+    }
+
+    dprintf(fd, "  VirtualCamera %p: %s, priority %d, %u of %u buffers granted, %zu held\n",
+            this, isStreaming() ? "streaming" : "stopped", mPriority.load(),
+            mFramesGranted.load(), mFramesAllowed.load(), framesHeld);
+    dprintf(fd, "    frames delivered: %" PRIu64 ", dropped at quota: %" PRIu64
+            ", skipped by rate cap: %" PRIu64 "\n",
+            mFramesDelivered.load(), mFramesDroppedAtQuota.load(), mFramesSkippedByRate.load());
+    mReturnLatency.dump(fd, "    returned by client after");
+}
+
+
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
 Return<void> VirtualCamera::getCameraInfo(getCameraInfo_cb info_cb) {
     // Straight pass through to hardware layer
@@ -110,23 +231,26 @@ Return<void> VirtualCamera::getCameraInfo(getCameraInfo_cb info_cb) {
 
 
 Return<EvsResult> VirtualCamera::setMaxFramesInFlight(uint32_t bufferCount) {
-    // How many buffers are we trying to add (or remove if negative)
-    int bufferCountChange = bufferCount - mFramesAllowed;
+    std::lock_guard<std::mutex> control(mControlLock);
 
-    // Ask our parent for more buffers
-    bool result = mHalCamera->changeFramesInFlight(bufferCountChange);
+    // Ask our parent for more buffers (or fewer)
+    unsigned granted = 0;
+    bool result = mHalCamera->changeFramesInFlight(this, bufferCount, &granted);
     if (!result) {
-        ALOGE("Failed to change buffer count by %d to %d", bufferCountChange, bufferCount);
+        ALOGE("Failed to change buffer count from %u to %d", mFramesAllowed.load(), bufferCount);
         return EvsResult::BUFFER_NOT_AVAILABLE;
     }
 
     // Update our notion of how many frames we're allowed
     mFramesAllowed = bufferCount;
+    mFramesGranted = granted;
     return EvsResult::OK;
 }
 
 
 Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCameraStream>& stream)  {
+    std::lock_guard<std::mutex> control(mControlLock);
+
     // We only support a single stream at a time
     if (mStreamState != STOPPED) {
         ALOGE("ignoring startVideoStream call when a stream is already running.");
@@ -134,16 +258,20 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
     }
 
     // Validate our held frame count is starting out at zero as we expect
-    assert(mFramesHeld.size() == 0);
+    {
+        std::lock_guard<std::mutex> lock(mFrameLock);
+        assert(mFramesHeld.size() == 0);
 
-    // Record the user's callback for use when we have a frame ready
-    mStream = stream;
-    mStreamState = RUNNING;
+        // Record the user's callback for use when we have a frame ready
+        mStream = stream;
+        mStreamState = RUNNING;
+    }
 
     // Tell the underlying camera hardware that we want to stream
     Return<EvsResult> result = mHalCamera->clientStreamStarting();
     if ((!result.isOk()) || (result != EvsResult::OK)) {
         // If we failed to start the underlying stream, then we're not actually running
+        std::lock_guard<std::mutex> lock(mFrameLock);
         mStream = nullptr;
         mStreamState = STOPPED;
         return EvsResult::UNDERLYING_SERVICE_ERROR;
@@ -157,25 +285,40 @@ Return<EvsResult> VirtualCamera::startVideoStream(const ::android::sp<IEvsCamera
 
 
 Return<void> VirtualCamera::doneWithFrame(const BufferDesc& buffer) {
+    ATRACE_CALL();
     if (buffer.memHandle == nullptr) {
         ALOGE("ignoring doneWithFrame called with invalid handle");
     } else {
         // Find this buffer in our "held" list
-        auto it = mFramesHeld.begin();
-        while (it != mFramesHeld.end()) {
-            if (it->bufferId == buffer.bufferId) {
-                // found it!
-                break;
+        bool found = false;
+        {
+            std::lock_guard<std::mutex> lock(mFrameLock);
+            auto it = mFramesHeld.begin();
+            while (it != mFramesHeld.end()) {
+                if (it->bufferId == buffer.bufferId) {
+                    // found it!
+                    break;
+                }
+                ++it;
+            }
+            if (it != mFramesHeld.end()) {
+                // Take this frame out of our "held" list
+                mFramesHeld.erase(it);
+                found = true;
+                ATRACE_ASYNC_END(kClientFrameTrack,
+                                 support::makeTraceCookie(mTraceOwner, buffer.bufferId));
+
+                auto sent = mSendTimes.find(buffer.bufferId);
+                if (sent != mSendTimes.end()) {
+                    mReturnLatency.record(systemTime(SYSTEM_TIME_MONOTONIC) - sent->second);
+                    mSendTimes.erase(sent);
+                }
             }
-            ++it;
         }
-        if (it == mFramesHeld.end()) {
+        if (!found) {
             // We should always find the frame in our "held" list
             ALOGE("Ignoring doneWithFrame called with unrecognized frameID %d", buffer.bufferId);
         } else {
-            // Take this frame out of our "held" list
-            mFramesHeld.erase(it);
-
             // Tell our parent that we're done with this buffer
             mHalCamera->doneWithFrame(buffer);
         }
@@ -186,22 +329,47 @@ Return<void> VirtualCamera::doneWithFrame(const BufferDesc& buffer) {
 
 
 Return<void> VirtualCamera::stopVideoStream()  {
+    std::lock_guard<std::mutex> control(mControlLock);
+
     if (mStreamState == RUNNING) {
         // Tell the frame delivery pipeline we don't want any more frames
         mStreamState = STOPPING;
 
-        // Deliver an empty frame to close out the frame stream
-        BufferDesc nullBuff = {};
-        auto result = mStream->deliverFrame(nullBuff);
-        if (!result.isOk()) {
-            ALOGE("Error delivering end of stream marker");
-        }
+        // Frames the client hasn't been sent yet can go straight back, and then an empty frame
+        // closes out the frame stream
+        std::deque<BufferDesc> unsent;
+        {
+            std::lock_guard<std::mutex> lock(mFrameLock);
+            for (auto&& pending : mPendingFrames) {
+                if (pending.memHandle == nullptr) {
+                    continue;
+                }
+                auto it = std::find_if(mFramesHeld.begin(), mFramesHeld.end(),
+                                       [&pending](const BufferDesc& held) {
+                                           return held.bufferId == pending.bufferId;
+                                       });
+                if (it != mFramesHeld.end()) {
+                    mFramesHeld.erase(it);
+                }
+                unsent.push_back(pending);
+            }
+            mPendingFrames.clear();
 
-        // Since we are single threaded, no frame can be delivered while this function is running,
-        // so we can go directly to the STOPPED state here on the server.
-        // Note, however, that there still might be frames already queued that client will see
-        // after returning from the client side of this call.
-        mStreamState = STOPPED;
+            BufferDesc nullBuff = {};
+            mPendingFrames.push_back(nullBuff);
+            mFrameSignal.notify_one();
+
+            // The hardware may still be delivering frames on another thread, but from here on
+            // deliverFrame() turns them away.
+            // Note, however, that there still might be frames already sent that client will see
+            // after returning from the client side of this call.
+            mStreamState = STOPPED;
+        }
+        for (auto&& buffer : unsent) {
+            ATRACE_ASYNC_END(kClientFrameTrack,
+                             support::makeTraceCookie(mTraceOwner, buffer.bufferId));
+            mHalCamera->doneWithFrame(buffer);
+        }
 
         // Give the underlying hardware camera the heads up that it might be time to stop
         mHalCamera->clientStreamEnding();
@@ -212,12 +380,50 @@ Return<void> VirtualCamera::stopVideoStream()  {
 
 
 Return<int32_t> VirtualCamera::getExtendedInfo(uint32_t opaqueIdentifier)  {
+    if (opaqueIdentifier == kExtendedInfoClientPriority) {
+        return mPriority.load();
+    }
+    if (opaqueIdentifier == kExtendedInfoMaxFrameRate) {
+        const nsecs_t interval = mFrameInterval;
+        return interval > 0 ? static_cast<int32_t>(s2ns(1) / interval) : 0;
+    }
+
     // Pass straight through to the hardware device
     return mHalCamera->getHwCamera()->getExtendedInfo(opaqueIdentifier);
 }
 
 
 Return<EvsResult> VirtualCamera::setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue)  {
+    // Priorities are ours to arbitrate, so we may need to rebalance the buffers we hand out
+    if (opaqueIdentifier == kExtendedInfoClientPriority) {
+        std::lock_guard<std::mutex> control(mControlLock);
+        if (opaqueValue < PRIORITY_DISPLAY || opaqueValue >= NUM_PRIORITIES) {
+            ALOGE("Ignoring unrecognized client priority %d", opaqueValue);
+            return EvsResult::INVALID_ARG;
+        }
+        mPriority = static_cast<ClientPriority>(opaqueValue);
+
+        unsigned granted = 0;
+        if (!mHalCamera->changeFramesInFlight(this, mFramesAllowed, &granted)) {
+            ALOGE("Failed to rebalance buffers for the new client priority");
+            return EvsResult::BUFFER_NOT_AVAILABLE;
+        }
+        mFramesGranted = granted;
+        return EvsResult::OK;
+    }
+
+    // Frame rate caps are ours to apply, and only affect this client
+    if (opaqueIdentifier == kExtendedInfoMaxFrameRate) {
+        if (opaqueValue < 0) {
+            ALOGE("Ignoring negative frame rate cap %d", opaqueValue);
+            return EvsResult::INVALID_ARG;
+        }
+        mFrameInterval = (opaqueValue > 0) ? s2ns(1) / opaqueValue : 0;
+        mNextFrameTime = 0;
+        ALOGD("Client frame rate capped at %d fps (0 is uncapped)", opaqueValue);
+        return EvsResult::OK;
+    }
+
     // Pass straight through to the hardware device
     // TODO: Should we restrict access to this entry point somehow?
     return mHalCamera->getHwCamera()->setExtendedInfo(opaqueIdentifier, opaqueValue);
@@ -20,9 +20,18 @@
 #include <android/hardware/automotive/evs/1.0/types.h>
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
+#include <utils/Timers.h>
 
-#include <thread>
+#include "ExtendedInfo.h"
+#include "FrameStats.h"
+#include "TraceCookie.h"
+
+#include <atomic>
+#include <condition_variable>
 #include <deque>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
 
 
 using namespace ::android::hardware::automotive::evs::V1_0;
@@ -51,11 +60,23 @@ public:
 
     sp<HalCamera>       getHalCamera()      { return mHalCamera; };
     unsigned            getAllowedBuffers() { return mFramesAllowed; };
+    ClientPriority      getPriority()       { return mPriority; };
+
+    // How many of its allowed buffers the client may actually hold, as arbitrated by HalCamera
+    void                setGrantedBuffers(unsigned count)   { mFramesGranted = count; };
     bool                isStreaming()       { return mStreamState == RUNNING; }
 
-    // Proxy to receive frames and forward them to the client's stream
+    // Applies the client's frame rate cap.  Returns false if the frame arriving at the given
+    // time isn't wanted, in which case we shouldn't even offer it.
+    bool                wantsFrame(nsecs_t arrivalTime);
+
+    // Proxy to receive frames and forward them to the client's stream.  Frames we accept are
+    // queued for our own delivery thread, so this never waits on the client.
     bool                deliverFrame(const BufferDesc& buffer);
 
+    // Writes our frame statistics to the given file descriptor
+    void                dump(int fd);
+
     // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
     Return<void>        getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
     Return<EvsResult>   setMaxFramesInFlight(uint32_t bufferCount) override;
@@ -66,16 +87,44 @@ public:
     Return<EvsResult>   setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue) override;
 
 private:
+    void                    deliveryThread();
+    void                    stopDeliveryThread();
+
     sp<HalCamera>           mHalCamera;     // The low level camera interface that backs this proxy
     sp<IEvsCameraStream>    mStream;
 
-    std::deque<BufferDesc>  mFramesHeld;
-    unsigned                mFramesAllowed  = 1;
-    enum {
+    // Serializes the client's calls that change its stream or buffers, which may otherwise come
+    // in concurrently on different RPC threads.  Taken before HalCamera's own control lock.
+    std::mutex              mControlLock;
+
+    std::mutex              mFrameLock;     // Guards the frame queues and mStream
+    std::condition_variable mFrameSignal;   // Signaled when mPendingFrames grows, or to quit
+    std::deque<BufferDesc>  mFramesHeld;    // Every frame we've accepted and not had back
+    std::deque<BufferDesc>  mPendingFrames; // Frames not yet sent to the client
+    std::atomic<unsigned>   mFramesAllowed  {1};    // How many the client asked for
+    std::atomic<unsigned>   mFramesGranted  {1};    // How many it gets (see setGrantedBuffers)
+    std::atomic<ClientPriority> mPriority   {PRIORITY_DISPLAY};
+    std::thread             mDeliveryThread;
+    bool                    mDeliveryQuit   = false;
+
+    std::atomic<nsecs_t>    mFrameInterval  {0};    // Minimum time between frames, if capped
+    std::atomic<nsecs_t>    mNextFrameTime  {0};    // When we're next due a frame, if capped
+
+    // Statistics for dump()
+    std::atomic<uint64_t>   mFramesDelivered        {0};    // Sent to the client
+    std::atomic<uint64_t>   mFramesDroppedAtQuota   {0};    // Refused as it held its quota
+    std::atomic<uint64_t>   mFramesSkippedByRate    {0};    // Not offered due to its rate cap
+    LatencyHistogram        mReturnLatency;                 // From sending to getting it back
+    std::unordered_map<uint32_t, nsecs_t> mSendTimes;       // By bufferId.  Uses mFrameLock.
+
+    const unsigned          mTraceOwner = support::nextTraceOwner();    // See makeTraceCookie()
+
+    enum StreamState {
         STOPPED,
         RUNNING,
         STOPPING,
-    }                       mStreamState    = STOPPED;
+    };
+    std::atomic<StreamState> mStreamState {STOPPED};
 };
 
 } // namespace implementation
@@ -15,6 +15,7 @@
  */
 
 #include <unistd.h>
+#include <stdlib.h>
 
 #include <hidl/HidlTransportSupport.h>
 #include <utils/Errors.h>
@@ -38,9 +39,27 @@ using namespace android::automotive::evs::V1_0::implementation;
 using namespace android;
 
 
-static void startService(const char *hardwareServiceName, const char * managerServiceName) {
+// Enough that a slow call from one client doesn't hold up frame returns from the others
+static const int kDefaultRpcThreads = 4;
+
+
+static void startService(const char *hardwareServiceName, const char * managerServiceName,
+                         std::vector<const char*> standbyCameraIds,
+                         std::vector<const char*> exportCameraIds,
+                         std::vector<const char*> recordCameraIds,
+                         FrameRecorder::Options recordOptions) {
     ALOGI("EVS managed service connecting to hardware service at %s", hardwareServiceName);
     android::sp<Enumerator> service = new Enumerator();
+    for (auto&& cameraId : standbyCameraIds) {
+        service->addStandbyCamera(cameraId);
+    }
+    for (auto&& cameraId : exportCameraIds) {
+        service->addExportCamera(cameraId);
+    }
+    for (auto&& cameraId : recordCameraIds) {
+        service->addRecordCamera(cameraId);
+    }
+    service->setRecordOptions(recordOptions);
     if (!service->init(hardwareServiceName)) {
         ALOGE("Failed to connect to hardware service - quitting from registrationThread");
         exit(1);
@@ -66,6 +85,11 @@ int main(int argc, char** argv) {
     // Set up default behavior, then check for command line options
     bool printHelp = false;
     const char* evsHardwareServiceName = kHardwareEnumeratorName;
+    std::vector<const char*> standbyCameraIds;
+    std::vector<const char*> exportCameraIds;
+    std::vector<const char*> recordCameraIds;
+    FrameRecorder::Options recordOptions;
+    int rpcThreads = kDefaultRpcThreads;
     for (int i=1; i< argc; i++) {
         if (strcmp(argv[i], "--mock") == 0) {
             evsHardwareServiceName = kMockEnumeratorName;
@@ -76,6 +100,71 @@ int main(int argc, char** argv) {
             } else {
                 evsHardwareServiceName = argv[i];
             }
+        } else if (strcmp(argv[i], "--standby") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--standby <camera_id> was not provided with a camera id\n");
+            } else {
+                standbyCameraIds.push_back(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--export") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--export <camera_id> was not provided with a camera id\n");
+            } else {
+                exportCameraIds.push_back(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--record") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--record <camera_id> was not provided with a camera id\n");
+            } else {
+                recordCameraIds.push_back(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--record-dir") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--record-dir <path> was not provided with a directory\n");
+            } else {
+                recordOptions.directory = argv[i];
+            }
+        } else if (strcmp(argv[i], "--record-bitrate") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1) {
+                ALOGE("--record-bitrate <bits_per_second> was not provided with a valid rate\n");
+            } else {
+                recordOptions.bitRate = atoi(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--record-segment") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1) {
+                ALOGE("--record-segment <seconds> was not provided with a valid length\n");
+            } else {
+                recordOptions.segmentSeconds = atoi(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--record-keep") == 0) {
+            // 0 keeps every file
+            i++;
+            if (i >= argc || atoi(argv[i]) < 0) {
+                ALOGE("--record-keep <files> was not provided with a valid count\n");
+            } else {
+                recordOptions.maxSegments = atoi(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--record-quota") == 0) {
+            // 0 allows any total size
+            i++;
+            if (i >= argc || atoi(argv[i]) < 0) {
+                ALOGE("--record-quota <megabytes> was not provided with a valid size\n");
+            } else {
+                recordOptions.maxBytes = static_cast<uint64_t>(atoi(argv[i])) * 1024 * 1024;
+            }
+        } else if (strcmp(argv[i], "--rpc-threads") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1) {
+                ALOGE("--rpc-threads <count> was not provided with a valid count\n");
+            } else {
+                rpcThreads = atoi(argv[i]);
+            }
         } else if (strcmp(argv[i], "--help") == 0) {
             printHelp = true;
         } else {
@@ -86,17 +175,38 @@ int main(int argc, char** argv) {
     if (printHelp) {
         printf("Options include:\n");
         printf("  --mock                   Connect to the mock driver at EvsEnumeratorHw-Mock\n");
-        printf("  --target <service_name>  Connect to the named IEvsEnumerator service");
+        printf("  --target <service_name>  Connect to the named IEvsEnumerator service\n");
+        printf("  --standby <camera_id>    Keep this hardware camera open while it isn't in use "
+               "(may be repeated)\n");
+        printf("  --export <camera_id>     Share this camera's frames with native consumers "
+               "(may be repeated)\n");
+        printf("  --record <camera_id>     Record this camera into MP4 files while it streams "
+               "(may be repeated)\n");
+        printf("  --record-dir <path>      Where recordings go (default %s)\n",
+               FrameRecorder::Options().directory.c_str());
+        printf("  --record-bitrate <bps>   Recording bit rate (default %d)\n",
+               FrameRecorder::Options().bitRate);
+        printf("  --record-segment <sec>   Start a new file this often (default %u)\n",
+               FrameRecorder::Options().segmentSeconds);
+        printf("  --record-keep <files>    Keep at most this many files per camera, 0 for all "
+               "(default %u)\n", FrameRecorder::Options().maxSegments);
+        printf("  --record-quota <MB>      Keep each camera's files within this size, 0 for any "
+               "(default %u)\n",
+               static_cast<unsigned>(FrameRecorder::Options().maxBytes / (1024 * 1024)));
+        printf("  --rpc-threads <count>    Serve clients on this many threads (default %d)\n",
+               kDefaultRpcThreads);
     }
 
 
-    // Prepare the RPC serving thread pool.  We're configuring it with no additional
-    // threads beyond the main thread which will "join" the pool below.
-    configureRpcThreadpool(1, true /* callerWillJoin */);
+    // Prepare the RPC serving thread pool.  The main thread "joins" the pool below as one of
+    // its threads.
+    configureRpcThreadpool(rpcThreads, true /* callerWillJoin */);
 
     // The connection to the underlying hardware service must happen on a dedicated thread to ensure
     // that the hwbinder response can be processed by the thread pool without blocking.
-    std::thread registrationThread(startService, evsHardwareServiceName, kManagedEnumeratorName);
+    std::thread registrationThread(startService, evsHardwareServiceName, kManagedEnumeratorName,
+                                   standbyCameraIds, exportCameraIds, recordCameraIds,
+                                   recordOptions);
 
     // Send this main thread to become a permanent part of the thread pool.
     // This is not expected to return.
@@ -6,11 +6,21 @@ include $(CLEAR_VARS)
 LOCAL_SRC_FILES := \
     service.cpp \
     EvsEnumerator.cpp \
+    CameraInventory.cpp \
     EvsV4lCamera.cpp \
+    EvsDerivedCamera.cpp \
+    EvsReplayCamera.cpp \
+    CaptureFile.cpp \
     EvsGlDisplay.cpp \
     GlWrapper.cpp \
+    KmsOutput.cpp \
+    GrallocPool.cpp \
+    OutputBufferRing.cpp \
     VideoCapture.cpp \
     bufferCopy.cpp \
+    GlYuvConverter.cpp \
+    MjpegDecoder.cpp \
+    glUtils.cpp \
 
 
 LOCAL_SHARED_LIBRARIES := \
@@ -22,14 +32,19 @@ LOCAL_SHARED_LIBRARIES := \
     libbase \
     libbinder \
     libcutils \
+    libdrm \
     libhardware \
     libhidlbase \
     libhidltransport \
+    libjpeg \
     liblog \
     libutils \
     libhardware_legacy\
     libhwbinder
 
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
+
 LOCAL_INIT_RC := android.hardware.automotive.evs@1.0-sample.rc
 
 LOCAL_MODULE := android.hardware.automotive.evs@1.0-sample
@@ -38,6 +53,7 @@ LOCAL_MODULE_TAGS := optional
 LOCAL_STRIP_MODULE := keep_symbols
 
 LOCAL_CFLAGS += -DLOG_TAG=\"EvsSampleDriver\"
+LOCAL_CFLAGS += -DATRACE_TAG=ATRACE_TAG_CAMERA
 LOCAL_CFLAGS += -DGL_GLEXT_PROTOTYPES -DEGL_EGLEXT_PROTOTYPES
 LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
 
@@ -0,0 +1,185 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CameraInventory.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+
+#include "FileUtils.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// The first line of every inventory file.  Bump the version if the layout below changes so
+// that older files are ignored rather than misread.
+static const char kInventoryHeader[] = "EVS camera inventory v1";
+
+// Each following line describes one device as tab separated fields:
+//      <device path> <identity> <capabilities> <format>,<format>,...
+// with the numeric values in hex.
+static const unsigned kNumFields = 4;
+
+
+// Returns the first line of the given small file, without its newline
+static std::string readSysfsLine(const std::string& fileName) {
+    std::string line;
+    FILE* fp = fopen(fileName.c_str(), "re");
+    if (fp) {
+        char buffer[256];
+        if (fgets(buffer, sizeof(buffer), fp)) {
+            buffer[strcspn(buffer, "\n")] = '\0';
+            line = buffer;
+        }
+        fclose(fp);
+    }
+    return line;
+}
+
+
+// Tabs and newlines would break up our lines, and device names are free to contain anything
+static std::string sanitize(std::string field) {
+    for (auto&& c : field) {
+        if (c == '\t' || c == '\n') {
+            c = ' ';
+        }
+    }
+    return field;
+}
+
+
+std::string getDeviceIdentity(const std::string& devicePath) {
+    // /dev/videoN is described by /sys/class/video4linux/videoN
+    const size_t nameStart = devicePath.find_last_of('/');
+    const std::string nodeName = devicePath.substr(nameStart == std::string::npos ? 0 :
+                                                                                nameStart + 1);
+    const std::string sysfsDir = "/sys/class/video4linux/" + nodeName;
+
+    // The physical device the node belongs to, which stays put when nodes get renumbered...
+    char busPath[PATH_MAX];
+    if (!realpath((sysfsDir + "/device").c_str(), busPath)) {
+        return std::string();
+    }
+
+    // ...plus which of that device's nodes this is, and what the driver calls it
+    return sanitize(std::string(busPath) + "#" + readSysfsLine(sysfsDir + "/index") + ":" +
+                    readSysfsLine(sysfsDir + "/name"));
+}
+
+
+bool loadCameraInventory(const char* fileName, std::vector<InventoryEntry>& entries) {
+    entries.clear();
+
+    FILE* fp = fopen(fileName, "re");
+    if (!fp) {
+        ALOGI("No camera inventory at %s", fileName);
+        return false;
+    }
+
+    bool valid = true;
+    char buffer[1024];
+    if (!fgets(buffer, sizeof(buffer), fp) ||
+        strncmp(buffer, kInventoryHeader, strlen(kInventoryHeader)) != 0) {
+        ALOGW("Ignoring camera inventory %s with an unrecognized header", fileName);
+        valid = false;
+    }
+
+    while (valid && fgets(buffer, sizeof(buffer), fp)) {
+        const size_t length = strcspn(buffer, "\n");
+        if (buffer[length] != '\n') {
+            ALOGW("Camera inventory line too long or truncated");
+            valid = false;
+            break;
+        }
+        buffer[length] = '\0';
+
+        // Split the line at its tabs (strtok would drop an empty identity field)
+        std::vector<std::string> fields;
+        const char* start = buffer;
+        for (const char* tab; (tab = strchr(start, '\t')) != nullptr; start = tab + 1) {
+            fields.emplace_back(start, tab - start);
+        }
+        fields.emplace_back(start);
+        if (fields.size() != kNumFields || fields[0].empty()) {
+            ALOGW("Malformed camera inventory line '%s'", buffer);
+            valid = false;
+            break;
+        }
+
+        InventoryEntry entry;
+        entry.devicePath   = fields[0];
+        entry.identity     = fields[1];
+        entry.capabilities = strtoul(fields[2].c_str(), nullptr, 16);
+        for (const char* fmt = fields[3].c_str(); *fmt; ) {
+            char* end = nullptr;
+            entry.formats.push_back(strtoul(fmt, &end, 16));
+            if (end == fmt) {
+                valid = false;
+                break;
+            }
+            fmt = (*end == ',') ? end + 1 : end;
+        }
+        entries.push_back(std::move(entry));
+    }
+
+    fclose(fp);
+
+    if (!valid) {
+        entries.clear();
+    }
+    return valid;
+}
+
+
+bool saveCameraInventory(const char* fileName, const std::vector<InventoryEntry>& entries) {
+    std::string text = std::string(kInventoryHeader) + "\n";
+    for (auto&& entry : entries) {
+        char number[16];
+        snprintf(number, sizeof(number), "%X", entry.capabilities);
+        text += sanitize(entry.devicePath) + "\t" + sanitize(entry.identity) + "\t" + number + "\t";
+        for (size_t i = 0; i < entry.formats.size(); i++) {
+            snprintf(number, sizeof(number), i ? ",%X" : "%X", entry.formats[i]);
+            text += number;
+        }
+        text += "\n";
+    }
+
+    // Leaves us with either the old list or the new one, whatever happens mid-way
+    if (!::android::automotive::evs::support::writeFileAtomically(fileName, text.data(),
+                                                                  text.size())) {
+        return false;
+    }
+
+    ALOGI("Saved %zu cameras to the inventory at %s", entries.size(), fileName);
+    return true;
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,65 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAMERAINVENTORY_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAMERAINVENTORY_H
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// What we learned about a qualified capture device when we last probed it
+struct InventoryEntry {
+    std::string             devicePath;         // eg: "/dev/video0"
+    std::string             identity;           // See getDeviceIdentity()
+    uint32_t                capabilities = 0;   // From VIDIOC_QUERYCAP
+    std::vector<uint32_t>   formats;            // V4L2 pixel formats the device offers
+
+    bool operator==(const InventoryEntry& other) const {
+        return devicePath == other.devicePath && identity == other.identity &&
+               capabilities == other.capabilities && formats == other.formats;
+    }
+};
+
+
+// Describes the hardware behind a video device node using only sysfs, so it is much cheaper
+// than opening the device.  If this hasn't changed since the device was probed, neither has
+// the device.  Returns an empty string if sysfs doesn't know about the node.
+std::string getDeviceIdentity(const std::string& devicePath);
+
+// Read back a list saved by saveCameraInventory().  Returns false if there is no usable list.
+bool loadCameraInventory(const char* fileName, std::vector<InventoryEntry>& entries);
+
+// Replaces the saved list.  The write is atomic, so a reader never sees a partial list.
+bool saveCameraInventory(const char* fileName, const std::vector<InventoryEntry>& entries);
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAMERAINVENTORY_H
@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "CaptureFile.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Writes all of the given bytes, or fails
+static bool writeAll(int fd, const void* data, size_t size) {
+    const uint8_t* next = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        const ssize_t written = TEMP_FAILURE_RETRY(write(fd, next, size));
+        if (written <= 0) {
+            return false;
+        }
+        next += written;
+        size -= written;
+    }
+    return true;
+}
+
+
+CaptureWriter::~CaptureWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mQuit = true;
+        mSignal.notify_one();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+    if (mFd >= 0) {
+        close(mFd);
+    }
+    if (mDroppedFrames > 0) {
+        ALOGW("%u frames were left out of %s because the disk couldn't keep up",
+              mDroppedFrames, mPath.c_str());
+    }
+}
+
+
+bool CaptureWriter::open(const std::string& path, uint32_t v4lFormat, uint32_t width,
+                         uint32_t height, uint32_t stride) {
+    mFd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (mFd < 0) {
+        ALOGE("Failed to create capture file %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    mPath = path;
+
+    CaptureFileHeader header = {};
+    memcpy(header.magic, kCaptureFileMagic, sizeof(header.magic));
+    header.version   = kCaptureFileVersion;
+    header.v4lFormat = v4lFormat;
+    header.width     = width;
+    header.height    = height;
+    header.stride    = stride;
+    if (!writeAll(mFd, &header, sizeof(header))) {
+        ALOGE("Failed to write to capture file %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    mThread = std::thread([this]() { writerThread(); });
+    ALOGI("Recording raw frames to %s", path.c_str());
+    return true;
+}
+
+
+void CaptureWriter::writeFrame(const void* data, uint32_t size, int64_t captureTimeNs) {
+    if (mFd < 0 || data == nullptr || size == 0) {
+        return;
+    }
+
+    PendingFrame frame;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        if (mQuit) {
+            // The file is no good any more
+            return;
+        }
+        if (mPending.size() >= kMaxPendingFrames) {
+            mDroppedFrames++;
+            return;
+        }
+        if (!mSpare.empty()) {
+            frame = std::move(mSpare.back());
+            mSpare.pop_back();
+        }
+    }
+
+    // Copy outside our lock, since this is the expensive part and the writer doesn't need it
+    frame.header = {};
+    frame.header.captureTimeNs = captureTimeNs;
+    frame.header.size = size;
+    frame.data.assign(static_cast<const uint8_t*>(data),
+                      static_cast<const uint8_t*>(data) + size);
+
+    std::lock_guard<std::mutex> lock(mLock);
+    mPending.push_back(std::move(frame));
+    mSignal.notify_one();
+}
+
+
+void CaptureWriter::writerThread() {
+    static const uint8_t kPadding[8] = {};
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mSignal.wait(lock, [this]() { return mQuit || !mPending.empty(); });
+        if (mPending.empty()) {
+            // Only once everything we were given is on disk
+            return;
+        }
+        PendingFrame frame = std::move(mPending.front());
+        mPending.pop_front();
+        lock.unlock();
+
+        const size_t padding = (8 - frame.header.size % 8) % 8;
+        if (!writeAll(mFd, &frame.header, sizeof(frame.header)) ||
+            !writeAll(mFd, frame.data.data(), frame.data.size()) ||
+            !writeAll(mFd, kPadding, padding)) {
+            ALOGE("Failed to write to capture file %s: %s", mPath.c_str(), strerror(errno));
+            lock.lock();
+            mPending.clear();
+            mQuit = true;
+            return;
+        }
+
+        lock.lock();
+        mSpare.push_back(std::move(frame));
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTUREFILE_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTUREFILE_H
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <stdint.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A capture file holds a camera's frames exactly as its driver produced them, so that
+// EvsReplayCamera can play them back through the same conversions later.  It starts with a
+// CaptureFileHeader, followed by each frame as a CaptureFrameHeader and then its bytes, padded
+// to a multiple of 8.  Everything is in the byte order of the machine that recorded it.
+static const char     kCaptureFileMagic[8] = { 'E', 'V', 'S', 'R', 'A', 'W', '\0', '\0' };
+static const uint32_t kCaptureFileVersion = 1;
+
+struct CaptureFileHeader {
+    char        magic[8];       // kCaptureFileMagic
+    uint32_t    version;        // kCaptureFileVersion
+    uint32_t    v4lFormat;      // V4L2_PIX_FMT_*
+    uint32_t    width;
+    uint32_t    height;
+    uint32_t    stride;         // Bytes per row, for uncompressed formats
+    uint32_t    reserved;
+};
+
+struct CaptureFrameHeader {
+    int64_t     captureTimeNs;  // When the camera captured it (CLOCK_MONOTONIC)
+    uint32_t    size;           // Bytes of frame data that follow
+    uint32_t    reserved;
+};
+
+static_assert(sizeof(CaptureFileHeader) % 8 == 0 && sizeof(CaptureFrameHeader) % 8 == 0,
+              "Capture file records must keep frame data 8 byte aligned");
+
+
+// Appends a camera's frames to a capture file.  Frames are copied and written out on a thread
+// of our own, so a slow disk costs us recorded frames rather than the camera's frame rate.
+class CaptureWriter {
+public:
+    ~CaptureWriter();
+
+    // Creates (or replaces) the file and writes its header
+    bool open(const std::string& path, uint32_t v4lFormat, uint32_t width, uint32_t height,
+              uint32_t stride);
+
+    // Queues a copy of the frame, or drops it if we're too far behind
+    void writeFrame(const void* data, uint32_t size, int64_t captureTimeNs);
+
+private:
+    struct PendingFrame {
+        CaptureFrameHeader      header;
+        std::vector<uint8_t>    data;
+    };
+
+    void writerThread();
+
+    // Frames we'll hold in memory waiting for the disk before we start dropping them
+    static const unsigned kMaxPendingFrames = 4;
+
+    int                         mFd = -1;
+    std::string                 mPath;
+    std::thread                 mThread;
+    unsigned                    mDroppedFrames = 0;     // Only touched by writeFrame()
+
+    std::mutex                  mLock;                  // Guards the fields below
+    std::condition_variable     mSignal;
+    std::deque<PendingFrame>    mPending;
+    std::vector<PendingFrame>   mSpare;                 // Written frames, to reuse their memory
+    bool                        mQuit = false;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_CAPTUREFILE_H
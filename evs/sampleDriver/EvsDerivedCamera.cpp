@@ -0,0 +1,405 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EvsDerivedCamera.h"
+#include "bufferCopy.h"
+
+#include <ui/GraphicBufferMapper.h>
+
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <inttypes.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Derived streams are small, so there's no call for as many buffers as a full camera might use
+static const unsigned kMaxBuffersInFlight = 8;
+
+static const uint32_t kUsage = GRALLOC_USAGE_HW_TEXTURE     |
+                               GRALLOC_USAGE_SW_READ_RARELY |
+                               GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+std::mutex                          EvsDerivedCamera::sRegistryLock;
+std::vector<wp<EvsDerivedCamera>>   EvsDerivedCamera::sRunning;
+std::atomic<unsigned>               EvsDerivedCamera::sRunningCount {0};
+std::set<std::string>               EvsDerivedCamera::sStreamingSources;
+
+
+bool EvsDerivedCamera::parseSpec(const char* arg, Spec* spec) {
+    // <name>=<parent_id>:<gray|rgba>:<W>x<H>[:<x>,<y>,<w>x<h>]
+    const char* equals = strchr(arg, '=');
+    if (equals == nullptr || equals == arg) {
+        return false;
+    }
+    const char* parentEnd = strchr(equals + 1, ':');
+    if (parentEnd == nullptr || parentEnd == equals + 1) {
+        return false;
+    }
+    const char* format = parentEnd + 1;
+
+    Spec parsed;
+    parsed.name.assign(arg, equals - arg);
+    parsed.parentId.assign(equals + 1, parentEnd - (equals + 1));
+    if (strncmp(format, "gray:", 5) == 0) {
+        parsed.format = HAL_PIXEL_FORMAT_Y8;
+    } else if (strncmp(format, "rgba:", 5) == 0) {
+        parsed.format = HAL_PIXEL_FORMAT_RGBA_8888;
+    } else {
+        return false;
+    }
+
+    const char* size = format + 5;
+    int consumed = 0;
+    if (sscanf(size, "%ux%u%n", &parsed.width, &parsed.height, &consumed) != 2 ||
+        parsed.width < 1 || parsed.height < 1) {
+        return false;
+    }
+    const char* crop = size + consumed;
+    if (*crop != '\0') {
+        consumed = 0;
+        if (sscanf(crop, ":%u,%u,%ux%u%n", &parsed.cropX, &parsed.cropY,
+                   &parsed.cropWidth, &parsed.cropHeight, &consumed) != 4 ||
+            crop[consumed] != '\0' || parsed.cropWidth < 1 || parsed.cropHeight < 1) {
+            return false;
+        }
+    }
+
+    *spec = parsed;
+    return true;
+}
+
+
+EvsDerivedCamera::EvsDerivedCamera(const Spec& spec) :
+        mSpec(spec),
+        mOutputBuffers(spec.name, "EvsDerivedCamera", kMaxBuffersInFlight) {
+    ALOGD("EvsDerivedCamera instantiated for %s", spec.name.c_str());
+
+    mDescription.cameraId = spec.name;
+    mOutputBuffers.setFormat(spec.width, spec.height, spec.format, kUsage);
+}
+
+
+EvsDerivedCamera::~EvsDerivedCamera() {
+    ALOGD("EvsDerivedCamera being destroyed");
+    shutdown();
+}
+
+
+//
+// This gets called if another caller "steals" ownership of the camera
+//
+void EvsDerivedCamera::shutdown() {
+    ALOGD("EvsDerivedCamera shutdown");
+
+    // Make sure our output stream is cleaned up
+    stopVideoStream();
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    mShutdown = true;
+
+    // Drop all the graphics buffers we've been using
+    mOutputBuffers.releaseAll();
+}
+
+
+// Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
+Return<void> EvsDerivedCamera::getCameraInfo(getCameraInfo_cb _hidl_cb) {
+    ALOGD("getCameraInfo");
+
+    // Send back our self description
+    _hidl_cb(mDescription);
+    return Void();
+}
+
+
+Return<EvsResult> EvsDerivedCamera::setMaxFramesInFlight(uint32_t bufferCount) {
+    ALOGD("setMaxFramesInFlight");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // If we've been displaced by another owner of the camera, then we can't do anything else
+    if (mShutdown) {
+        ALOGW("ignoring setMaxFramesInFlight call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
+    // We cannot function without at least one video buffer to send data
+    if (bufferCount < 1) {
+        ALOGE("Ignoring setMaxFramesInFlight with less than one buffer requested");
+        return EvsResult::INVALID_ARG;
+    }
+
+    return mOutputBuffers.setCount(bufferCount) ? EvsResult::OK
+                                                : EvsResult::BUFFER_NOT_AVAILABLE;
+}
+
+
+Return<EvsResult> EvsDerivedCamera::startVideoStream(
+        const ::android::sp<IEvsCameraStream>& stream) {
+    ALOGD("startVideoStream");
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // If the client never indicated otherwise, configure ourselves for a single buffer.  This
+        // happens before we take the registry lock, which the parent's capture thread wants too.
+        if (!mShutdown && mOutputBuffers.count() < 1 && !mOutputBuffers.setCount(1)) {
+            ALOGE("Failed to start stream because we couldn't get a graphics buffer");
+            return EvsResult::BUFFER_NOT_AVAILABLE;
+        }
+    }
+
+    // Taking the stream and joining the registry go together, so that a stop can't come in
+    // between and leave us registered with no stream
+    std::lock_guard<std::mutex> registry(sRegistryLock);
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // If we've been displaced by another owner of the camera, then we can't do anything else
+        if (mShutdown) {
+            ALOGW("ignoring startVideoStream call when camera has been lost.");
+            return EvsResult::OWNERSHIP_LOST;
+        }
+        if (mStream != nullptr) {
+            ALOGE("ignoring startVideoStream call when a stream is already running.");
+            return EvsResult::STREAM_ALREADY_RUNNING;
+        }
+
+        // Record the user's callback for use when we have a frame ready
+        mStream = stream;
+    }
+
+    // From here on the parent's capture thread hands us its frames
+    sRunning.push_back(this);
+    sRunningCount = sRunning.size();
+    if (sStreamingSources.count(mSpec.parentId)) {
+        ALOGI("%s is running off %s's frames", mSpec.name.c_str(), mSpec.parentId.c_str());
+    } else {
+        ALOGW("%s started, but gets no frames until %s streams", mSpec.name.c_str(),
+              mSpec.parentId.c_str());
+    }
+
+    return EvsResult::OK;
+}
+
+
+Return<void> EvsDerivedCamera::doneWithFrame(const BufferDesc& buffer) {
+    ALOGD("doneWithFrame");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    mOutputBuffers.doneWithFrame(buffer);
+    return Void();
+}
+
+
+Return<void> EvsDerivedCamera::stopVideoStream() {
+    ALOGD("stopVideoStream");
+
+    // Stop taking frames from the parent
+    {
+        std::lock_guard<std::mutex> lock(sRegistryLock);
+        sRunning.erase(std::remove_if(sRunning.begin(), sRunning.end(),
+                                      [this](const wp<EvsDerivedCamera>& entry) {
+                                          return entry == this;
+                                      }),
+                       sRunning.end());
+        sRunningCount = sRunning.size();
+    }
+
+    // Wait out a frame the capture thread may be in the middle of, so nothing follows the marker
+    std::lock_guard<std::mutex> delivery(mDeliveryLock);
+
+    sp<IEvsCameraStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        stream = mStream;
+        mStream = nullptr;
+    }
+
+    if (stream != nullptr) {
+        // Send one last NULL frame to signal the actual end of stream
+        BufferDesc nullBuff = {};
+        auto result = stream->deliverFrame(nullBuff);
+        if (!result.isOk()) {
+            ALOGE("Error delivering end of stream marker");
+        }
+    }
+
+    return Void();
+}
+
+
+Return<int32_t> EvsDerivedCamera::getExtendedInfo(uint32_t /*opaqueIdentifier*/) {
+    ALOGD("getExtendedInfo");
+    // Return zero by default as required by the spec
+    return 0;
+}
+
+
+Return<EvsResult> EvsDerivedCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
+                                                    int32_t /*opaqueValue*/) {
+    ALOGD("setExtendedInfo");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // If we've been displaced by another owner of the camera, then we can't do anything else
+    if (mShutdown) {
+        ALOGW("ignoring setExtendedInfo call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
+    // We don't store any device specific information in this implementation
+    return EvsResult::INVALID_ARG;
+}
+
+
+void EvsDerivedCamera::forwardSourceFrame(const std::string& parentId, const void* data,
+                                          uint32_t v4lFormat, unsigned width, unsigned height,
+                                          unsigned stride, int64_t captureTimeNs) {
+    // The usual case, and the one that has to cost nothing
+    if (sRunningCount == 0) {
+        return;
+    }
+
+    // We may hold the last reference to one of these by the time we're done with it, so it
+    // mustn't be let go while the registry is locked since its destructor wants the lock too
+    std::vector<sp<EvsDerivedCamera>> running;
+    {
+        std::lock_guard<std::mutex> lock(sRegistryLock);
+        for (auto&& entry : sRunning) {
+            running.push_back(entry.promote());
+        }
+    }
+
+    for (auto&& camera : running) {
+        if (camera != nullptr && camera->mSpec.parentId == parentId) {
+            camera->produceFrame(data, v4lFormat, width, height, stride, captureTimeNs);
+        }
+    }
+}
+
+
+void EvsDerivedCamera::setSourceStreaming(const std::string& parentId, bool streaming) {
+    // As in forwardSourceFrame, these mustn't be let go while the registry is locked
+    std::vector<sp<EvsDerivedCamera>> running;
+    {
+        std::lock_guard<std::mutex> lock(sRegistryLock);
+        const bool changed = streaming ? sStreamingSources.insert(parentId).second
+                                       : sStreamingSources.erase(parentId) > 0;
+        if (!changed) {
+            return;
+        }
+        for (auto&& entry : sRunning) {
+            running.push_back(entry.promote());
+        }
+    }
+
+    for (auto&& camera : running) {
+        if (camera == nullptr || camera->mSpec.parentId != parentId) {
+            continue;
+        }
+        if (streaming) {
+            ALOGI("%s is running off %s's frames", camera->mSpec.name.c_str(), parentId.c_str());
+        } else {
+            ALOGW("%s gets no frames until %s streams again", camera->mSpec.name.c_str(),
+                  parentId.c_str());
+        }
+    }
+}
+
+
+void EvsDerivedCamera::produceFrame(const void* data, uint32_t v4lFormat,
+                                    unsigned width, unsigned height, unsigned stride,
+                                    int64_t captureTimeNs) {
+    ATRACE_CALL();
+    std::lock_guard<std::mutex> delivery(mDeliveryLock);
+
+    // Take a free buffer, if we're allowed another one
+    BufferDesc buff = {};
+    sp<IEvsCameraStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mStream == nullptr) {
+            // Stopped since the frame was handed to us
+            return;
+        }
+        if (!mOutputBuffers.take(&buff)) {
+            return;
+        }
+        stream = mStream;
+    }
+
+    // Clip the part of the parent's image we were asked for to what it actually captured
+    const unsigned cropX = std::min(mSpec.cropX, width - 1);
+    const unsigned cropY = std::min(mSpec.cropY, height - 1);
+    const unsigned cropWidth  = std::min(mSpec.cropWidth ? mSpec.cropWidth : width,
+                                         width - cropX);
+    const unsigned cropHeight = std::min(mSpec.cropHeight ? mSpec.cropHeight : height,
+                                         height - cropY);
+
+    // Our buffers are small, so locking one for each frame is cheap next to the parent's work
+    void* pixels = nullptr;
+    GraphicBufferMapper& mapper = GraphicBufferMapper::get();
+    mapper.lock(buff.memHandle,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                android::Rect(buff.width, buff.height),
+                &pixels);
+    bool filled = false;
+    if (pixels != nullptr) {
+        filled = fillScaledView(buff, (uint8_t*)pixels, data, v4lFormat, width, height, stride,
+                                cropX, cropY, cropWidth, cropHeight);
+        mapper.unlock(buff.memHandle);
+        if (!filled) {
+            ALOGE("%s can't sample %s's frames in format 0x%08X", mSpec.name.c_str(),
+                  mSpec.parentId.c_str(), v4lFormat);
+        }
+    } else {
+        ALOGE("%s failed to gain access to image buffer for writing", mSpec.name.c_str());
+    }
+    if (!filled) {
+        // Better no frame than one that isn't the picture
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mOutputBuffers.putBack(buff.bufferId);
+        return;
+    }
+
+    auto result = stream->deliverFrame(buff);
+    if (result.isOk()) {
+        ALOGD("Delivered %s frame as id %d, %" PRId64 " us after capture",
+              mSpec.name.c_str(), buff.bufferId,
+              nanoseconds_to_microseconds(systemTime(SYSTEM_TIME_MONOTONIC) - captureTimeNs));
+    } else {
+        // This can happen if the client dies, so give the buffer back and let the main thread
+        // clean up the stream
+        ALOGE("Frame delivery call failed in the transport layer.");
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mOutputBuffers.putBack(buff.bufferId);
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
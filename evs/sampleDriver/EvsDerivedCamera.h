@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_EVSDERIVEDCAMERA_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_EVSDERIVEDCAMERA_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "OutputBufferRing.h"
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A smaller, cropped or luma-only view of another camera, offered to clients as a camera of its
+// own.  Its frames are sampled from the parent's capture buffers by the parent's capture thread,
+// in the same pass that fills the parent's own output, so it costs only the pixels it reads.
+// Frames only flow while the parent camera is streaming.
+class EvsDerivedCamera : public IEvsCamera {
+public:
+    struct Spec {
+        std::string name;           // The camera id clients open it by
+        std::string parentId;       // The V4L camera it is taken from
+        uint32_t    format = 0;     // HAL_PIXEL_FORMAT_Y8 or HAL_PIXEL_FORMAT_RGBA_8888
+        unsigned    width  = 0;
+        unsigned    height = 0;
+
+        // Part of the parent's image to show, in its pixels.  A zero size means all of it.
+        // Whatever falls outside the parent's image is clipped off when frames are made.
+        unsigned    cropX = 0;
+        unsigned    cropY = 0;
+        unsigned    cropWidth  = 0;
+        unsigned    cropHeight = 0;
+    };
+
+    // Reads a spec of the form <name>=<parent_id>:<gray|rgba>:<W>x<H>[:<x>,<y>,<w>x<h>]
+    static bool parseSpec(const char* arg, Spec* spec);
+
+    // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
+    Return<void> getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
+    Return <EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
+    Return <EvsResult> startVideoStream(const ::android::sp<IEvsCameraStream>& stream) override;
+    Return<void> doneWithFrame(const BufferDesc& buffer) override;
+    Return<void> stopVideoStream() override;
+    Return <int32_t> getExtendedInfo(uint32_t opaqueIdentifier) override;
+    Return <EvsResult> setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue) override;
+
+    // Implementation details
+    explicit EvsDerivedCamera(const Spec& spec);
+    virtual ~EvsDerivedCamera() override;
+    void shutdown();
+
+    const CameraDesc& getDesc() { return mDescription; };
+
+    // Called by the parent's capture thread with each frame it captures (a V4L2_PIX_FMT image)
+    // while the capture buffer is still its own.  Cheap when no derived stream is running.
+    static void forwardSourceFrame(const std::string& parentId, const void* data,
+                                   uint32_t v4lFormat, unsigned width, unsigned height,
+                                   unsigned stride, int64_t captureTimeNs);
+
+    // Called by the parent as it starts and stops passing us frames, so that a derived stream
+    // started without its parent can say why it isn't getting any
+    static void setSourceStreaming(const std::string& parentId, bool streaming);
+
+private:
+    void produceFrame(const void* data, uint32_t v4lFormat, unsigned width, unsigned height,
+                      unsigned stride, int64_t captureTimeNs);
+
+    const Spec  mSpec;
+    CameraDesc  mDescription = {};
+
+    std::mutex                  mAccessLock;    // Guards the fields below
+    sp<IEvsCameraStream>        mStream;
+    OutputBufferRing            mOutputBuffers;
+    bool                        mShutdown = false;
+
+    // Held by the capture thread while it fills and delivers a frame, so that once a stop has
+    // taken it no more frames can follow the end of stream marker
+    std::mutex                  mDeliveryLock;
+
+    // The derived streams running right now, whichever camera they come from, and the parents
+    // passing on frames
+    static std::mutex                           sRegistryLock;
+    static std::vector<wp<EvsDerivedCamera>>    sRunning;
+    static std::atomic<unsigned>                sRunningCount;
+    static std::set<std::string>                sStreamingSources;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_EVSDERIVEDCAMERA_H
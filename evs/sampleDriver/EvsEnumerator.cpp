@@ -18,7 +18,10 @@
 #include "EvsV4lCamera.h"
 #include "EvsGlDisplay.h"
 
+#include <algorithm>
+#include <memory>
 #include <dirent.h>
+#include <unistd.h>
 #include <hardware_legacy/uevent.h>
 #include <hwbinder/IPCThreadState.h>
 #include <cutils/android_filesystem_config.h>
@@ -40,11 +43,21 @@ namespace implementation {
 std::unordered_map<std::string, EvsEnumerator::CameraRecord> EvsEnumerator::sCameraList;
 wp<EvsGlDisplay>                                             EvsEnumerator::sActiveDisplay;
 std::mutex                                                   EvsEnumerator::sLock;
+std::mutex                                                   EvsEnumerator::sOpenLock;
 std::condition_variable                                      EvsEnumerator::sCameraSignal;
+std::unordered_set<std::string>                              EvsEnumerator::sStandbyCameras;
+std::vector<EvsEnumerator::DerivedRecord>                    EvsEnumerator::sDerivedCameras;
+std::vector<EvsEnumerator::ReplayRecord>                     EvsEnumerator::sReplayCameras;
 
 // Constants
 const auto kEnumerationTimeout = 10s;
 
+// How long we wait for a video device to answer our queries before giving up on it
+const auto kProbeTimeout = 2000ms;
+
+// Where we remember the cameras we found, so the next boot needn't probe for them
+static const char kInventoryFile[] = "/data/misc/evs/camera_inventory";
+
 
 bool EvsEnumerator::checkPermission() {
     hardware::IPCThreadState *ipc = hardware::IPCThreadState::self();
@@ -129,43 +142,216 @@ EvsEnumerator::EvsEnumerator() {
 }
 
 void EvsEnumerator::enumerateDevices() {
+    // Probing every video node can be slow (see probeDevices), and the rear camera has to be
+    // up within moments of boot.  So if we saved the cameras we found last time, we report
+    // those straight away and check them again in the background.
+    std::vector<InventoryEntry> inventory;
+    if (loadCameraInventory(kInventoryFile, inventory)) {
+        // A stat of each node is cheap, and saves reporting a camera that has obviously gone
+        inventory.erase(std::remove_if(inventory.begin(), inventory.end(),
+                                       [](const InventoryEntry& entry) {
+                                           return access(entry.devicePath.c_str(), F_OK) != 0;
+                                       }),
+                        inventory.end());
+    }
+    if (!inventory.empty()) {
+        for (auto&& entry : inventory) {
+            addCamera(entry.devicePath);
+        }
+        ALOGI("Reporting %zu cameras from the inventory until it is revalidated",
+              inventory.size());
+
+        std::thread(revalidateInventory, std::move(inventory)).detach();
+        return;
+    }
+
+    // Nothing to go on, so probe everything.  We do this in the background too, and each
+    // camera is added to the list as soon as it qualifies, so getCameraList can answer as
+    // soon as the first one is ready rather than once the slowest driver has replied.
+    std::thread([]() {
+        std::vector<InventoryEntry> found;
+        probeDevices({}, found);
+        saveCameraInventory(kInventoryFile, found);
+    }).detach();
+}
+
+
+void EvsEnumerator::addCamera(const std::string& devicePath) {
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        if (!sCameraList.emplace(devicePath, devicePath.c_str()).second) {
+            return;
+        }
+        ALOGI("%s is added", devicePath.c_str());
+        sCameraSignal.notify_all();
+    }
+
+    prepareStandby(devicePath);
+}
+
+
+void EvsEnumerator::prepareStandby(const std::string& cameraId) {
+    if (sStandbyCameras.find(cameraId) == sStandbyCameras.end()) {
+        return;
+    }
+
+    // Opening and priming the camera is the slow part, so we don't hold the lock for it
+    sp<EvsV4lCamera> camera = new EvsV4lCamera(cameraId.c_str());
+    if (!camera->prime()) {
+        ALOGE("Failed to prime %s for standby", cameraId.c_str());
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(sLock);
+    CameraRecord* pRecord = findCameraById(cameraId);
+    if (pRecord == nullptr || pRecord->activeInstance.promote() != nullptr ||
+        pRecord->standbyInstance != nullptr) {
+        // The camera went away or got opened meanwhile, so this one isn't needed after all
+        camera->shutdown();
+        return;
+    }
+    pRecord->standbyInstance = camera;
+    ALOGI("%s is primed and in standby", cameraId.c_str());
+}
+
+
+void EvsEnumerator::probeDevices(const std::vector<InventoryEntry>& trusted,
+                                 std::vector<InventoryEntry>& found) {
     // For every video* entry in the dev folder, see if it reports suitable capabilities
     // WARNING:  Depending on the driver implementations this could be slow, especially if
     //           there are timeouts or round trips to hardware required to collect the needed
-    //           information.  Platform implementers should consider hard coding this list of
-    //           known good devices to speed up the startup time of their EVS implementation.
-    //           For example, this code might be replaced with nothing more than:
-    //                   sCameraList.emplace("/dev/video0");
-    //                   sCameraList.emplace("/dev/video1");
+    //           information.  Devices listed in trusted are only opened again if sysfs says
+    //           the hardware behind their node has changed since they were probed.  The rest
+    //           are probed in parallel, and any that don't answer within kProbeTimeout are
+    //           left out so that one hung driver can't hold up every other camera.
     ALOGI("%s: Starting dev/video* enumeration", __FUNCTION__);
     unsigned videoCount   = 0;
-    unsigned captureCount = 0;
+    unsigned probeCount   = 0;
+    found.clear();
+
+    // Shared with the probe threads, which we may have to abandon if their driver hangs
+    struct ProbeState {
+        std::mutex                  lock;
+        std::condition_variable     signal;
+        unsigned                    pending = 0;
+        bool                        abandoned = false;
+        std::vector<InventoryEntry> found;
+    };
+    auto state = std::make_shared<ProbeState>();
+
     DIR* dir = opendir("/dev");
     if (!dir) {
         LOG_FATAL("Failed to open /dev folder\n");
     }
     struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        // We're only looking for entries starting with 'video'
+        if (strncmp(entry->d_name, "video", 5) != 0) {
+            continue;
+        }
+        videoCount++;
+
+        InventoryEntry device;
+        device.devicePath = std::string("/dev/") + entry->d_name;
+        device.identity   = getDeviceIdentity(device.devicePath);
+
+        auto known = std::find_if(trusted.begin(), trusted.end(),
+                                  [&device](const InventoryEntry& candidate) {
+                                      return candidate.devicePath == device.devicePath;
+                                  });
+        if (known != trusted.end() && !device.identity.empty() &&
+            known->identity == device.identity) {
+            // Same hardware as last time, so it will answer the same way
+            {
+                std::lock_guard<std::mutex> lock(state->lock);
+                state->found.push_back(*known);
+            }
+            addCamera(known->devicePath);
+            continue;
+        }
+
+        probeCount++;
+        {
+            std::lock_guard<std::mutex> lock(state->lock);
+            state->pending++;
+        }
+        std::thread([state, device]() mutable {
+            const bool qualified = qualifyCaptureDevice(device.devicePath.c_str(), &device);
+
+            bool accepted = false;
+            {
+                std::lock_guard<std::mutex> lock(state->lock);
+                if (state->abandoned) {
+                    ALOGW("%s answered too late to be included", device.devicePath.c_str());
+                } else {
+                    if (qualified) {
+                        state->found.push_back(device);
+                        accepted = true;
+                    }
+                    state->pending--;
+                    state->signal.notify_one();
+                }
+            }
+
+            // Outside our lock, since this may prime the camera for standby
+            if (accepted) {
+                addCamera(device.devicePath);
+            }
+        }).detach();
+    }
+    closedir(dir);
+
+    {
+        std::unique_lock<std::mutex> lock(state->lock);
+        if (!state->signal.wait_for(lock, kProbeTimeout, [&state]() {
+                                        return state->pending == 0;
+                                    })) {
+            ALOGE("%u video devices failed to answer within %lld ms", state->pending,
+                  static_cast<long long>(kProbeTimeout.count()));
+        }
+        state->abandoned = true;
+        found = std::move(state->found);
+    }
+
+    // Keep a stable order so that an unchanged inventory compares equal
+    std::sort(found.begin(), found.end(),
+              [](const InventoryEntry& a, const InventoryEntry& b) {
+                  return a.devicePath < b.devicePath;
+              });
+
+    ALOGI("Found %zu qualified video capture devices of %u checked (%u probed)\n",
+          found.size(), videoCount, probeCount);
+}
+
+
+void EvsEnumerator::revalidateInventory(std::vector<InventoryEntry> cached) {
+    // Any cameras that have appeared are added as the probe finds them
+    std::vector<InventoryEntry> current;
+    probeDevices(cached, current);
+    if (current == cached) {
+        ALOGI("Camera inventory is up to date");
+        return;
+    }
+
     {
         std::lock_guard<std::mutex> lock(sLock);
 
-        while ((entry = readdir(dir)) != nullptr) {
-            // We're only looking for entries starting with 'video'
-            if (strncmp(entry->d_name, "video", 5) == 0) {
-                std::string deviceName("/dev/");
-                deviceName += entry->d_name;
-                videoCount++;
-                if (sCameraList.find(deviceName) != sCameraList.end()) {
-                    ALOGI("%s has been added already.", deviceName.c_str());
-                    captureCount++;
-                } else if(qualifyCaptureDevice(deviceName.c_str())) {
-                    sCameraList.emplace(deviceName, deviceName.c_str());
-                    captureCount++;
-                }
+        // Drop the cameras we reported that aren't there any more
+        for (auto&& entry : cached) {
+            auto stillThere = std::find_if(current.begin(), current.end(),
+                                           [&entry](const InventoryEntry& candidate) {
+                                               return candidate.devicePath == entry.devicePath;
+                                           });
+            if (stillThere == current.end()) {
+                ALOGI("%s is no longer a usable camera", entry.devicePath.c_str());
+                sCameraList.erase(entry.devicePath);
             }
         }
+
+        sCameraSignal.notify_all();
     }
 
-    ALOGI("Found %d qualified video capture devices of %d checked\n", captureCount, videoCount);
+    saveCameraInventory(kInventoryFile, current);
 }
 
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsEnumerator follow.
@@ -175,6 +361,7 @@ Return<void> EvsEnumerator::getCameraList(getCameraList_cb _hidl_cb)  {
         return Void();
     }
 
+    hidl_vec<CameraDesc> hidlCameras;
     {
         std::unique_lock<std::mutex> lock(sLock);
         if (sCameraList.size() < 1) {
@@ -186,16 +373,30 @@ Return<void> EvsEnumerator::getCameraList(getCameraList_cb _hidl_cb)  {
                 ALOGD("Timer expired.  No new device has been added.");
             }
         }
-    }
 
-    const unsigned numCameras = sCameraList.size();
+        // Build up a packed array of CameraDesc for return.  We hold the lock while we do so
+        // because the uevent and inventory revalidation threads may be changing the list.
+        std::vector<CameraDesc> cameras;
+        for (const auto& [key, cam] : sCameraList) {
+            cameras.push_back(cam.desc);
+        }
 
-    // Build up a packed array of CameraDesc for return
-    hidl_vec<CameraDesc> hidlCameras;
-    hidlCameras.resize(numCameras);
-    unsigned i = 0;
-    for (const auto& [key, cam] : sCameraList) {
-        hidlCameras[i++] = cam.desc;
+        // Derived cameras come and go with the camera they're taken from
+        for (auto&& derived : sDerivedCameras) {
+            if (findCameraById(derived.spec.parentId) != nullptr) {
+                CameraDesc desc = {};
+                desc.cameraId = derived.spec.name;
+                cameras.push_back(desc);
+            }
+        }
+
+        // Replay cameras need nothing but their file
+        for (auto&& replay : sReplayCameras) {
+            CameraDesc desc = {};
+            desc.cameraId = replay.spec.name;
+            cameras.push_back(desc);
+        }
+        hidlCameras = cameras;
     }
 
     // Send back the results
@@ -213,23 +414,114 @@ Return<sp<IEvsCamera>> EvsEnumerator::openCamera(const hidl_string& cameraId) {
         return nullptr;
     }
 
-    // Is this a recognized camera id?
-    CameraRecord *pRecord = findCameraById(cameraId);
+    // Opening and closing are serialized, so a camera only ever has one active instance
+    std::lock_guard<std::mutex> openLock(sOpenLock);
 
-    // Has this camera already been instantiated by another caller?
-    sp<EvsV4lCamera> pActiveCamera = pRecord->activeInstance.promote();
+    // Derived cameras don't have a device of their own
+    if (DerivedRecord* pDerived = findDerivedById(cameraId)) {
+        return openDerivedCameraLocked(pDerived);
+    }
+
+    // Nor do replay cameras
+    if (ReplayRecord* pReplay = findReplayById(cameraId)) {
+        return openReplayCameraLocked(pReplay);
+    }
+
+    // Is this a recognized camera id?  The uevent thread may drop the record at any time, so
+    // we only look at it under sLock.
+    sp<EvsV4lCamera> pActiveCamera;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        CameraRecord *pRecord = findCameraById(cameraId);
+        if (!pRecord) {
+            ALOGE("Asked to open a camera whose name isn't recognized");
+            return nullptr;
+        }
+
+        // Has this camera already been instantiated by another caller?
+        pActiveCamera = pRecord->activeInstance.promote();
+    }
     if (pActiveCamera != nullptr) {
         ALOGW("Killing previous camera because of new caller");
-        closeCamera(pActiveCamera);
+        closeCameraLocked(pActiveCamera);
     }
 
-    // Construct a camera instance for the caller
-    pActiveCamera = new EvsV4lCamera(cameraId.c_str());
-    pRecord->activeInstance = pActiveCamera;
+    // Hand over the camera we've kept primed, if there is one, or else construct one
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        CameraRecord *pRecord = findCameraById(cameraId);
+        if (pRecord) {
+            pActiveCamera = pRecord->standbyInstance;
+            pRecord->standbyInstance = nullptr;
+        }
+    }
+    if (pActiveCamera == nullptr) {
+        pActiveCamera = new EvsV4lCamera(cameraId.c_str());
+    }
     if (pActiveCamera == nullptr) {
         ALOGE("Failed to allocate new EvsV4lCamera object for %s\n", cameraId.c_str());
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(sLock);
+    CameraRecord *pRecord = findCameraById(cameraId);
+    if (!pRecord) {
+        ALOGE("Camera %s went away while we were opening it", cameraId.c_str());
+        pActiveCamera->shutdown();
+        return nullptr;
+    }
+    pRecord->activeInstance = pActiveCamera;
+
+    return pActiveCamera;
+}
+
+
+sp<IEvsCamera> EvsEnumerator::openDerivedCameraLocked(DerivedRecord* pRecord) {
+    // The record itself never goes away, but its instance is only touched under sLock
+    sp<EvsDerivedCamera> pActiveCamera;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        if (findCameraById(pRecord->spec.parentId) == nullptr) {
+            ALOGE("Can't open %s while %s isn't available",
+                  pRecord->spec.name.c_str(), pRecord->spec.parentId.c_str());
+            return nullptr;
+        }
+        pActiveCamera = pRecord->activeInstance.promote();
     }
+    if (pActiveCamera != nullptr) {
+        ALOGW("Killing previous camera because of new caller");
+        closeCameraLocked(pActiveCamera);
+    }
+
+    pActiveCamera = new EvsDerivedCamera(pRecord->spec);
 
+    std::lock_guard<std::mutex> lock(sLock);
+    pRecord->activeInstance = pActiveCamera;
+    return pActiveCamera;
+}
+
+
+sp<IEvsCamera> EvsEnumerator::openReplayCameraLocked(ReplayRecord* pRecord) {
+    // The record itself never goes away, but its instance is only touched under sLock
+    sp<EvsReplayCamera> pActiveCamera;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        pActiveCamera = pRecord->activeInstance.promote();
+    }
+    if (pActiveCamera != nullptr) {
+        ALOGW("Killing previous camera because of new caller");
+        closeCameraLocked(pActiveCamera);
+    }
+
+    // Each open maps the file afresh, so a recording may be replaced between runs
+    pActiveCamera = new EvsReplayCamera(pRecord->spec);
+    if (!pActiveCamera->isOpen()) {
+        ALOGE("Failed to open replay camera %s", pRecord->spec.name.c_str());
+        return nullptr;
+    }
+
+    std::lock_guard<std::mutex> lock(sLock);
+    pRecord->activeInstance = pActiveCamera;
     return pActiveCamera;
 }
 
@@ -242,6 +534,13 @@ Return<void> EvsEnumerator::closeCamera(const ::android::sp<IEvsCamera>& pCamera
         return Void();
     }
 
+    std::lock_guard<std::mutex> openLock(sOpenLock);
+    closeCameraLocked(pCamera);
+    return Void();
+}
+
+
+void EvsEnumerator::closeCameraLocked(const sp<IEvsCamera>& pCamera) {
     // Get the camera id so we can find it in our list
     std::string cameraId;
     pCamera->getCameraInfo([&cameraId](CameraDesc desc) {
@@ -249,28 +548,67 @@ Return<void> EvsEnumerator::closeCamera(const ::android::sp<IEvsCamera>& pCamera
                            }
     );
 
-    // Find the named camera
-    CameraRecord *pRecord = findCameraById(cameraId);
+    // Derived cameras have no standby instance to bring back
+    if (DerivedRecord* pDerived = findDerivedById(cameraId)) {
+        sp<EvsDerivedCamera> pActiveDerived;
+        {
+            std::lock_guard<std::mutex> lock(sLock);
+            pActiveDerived = pDerived->activeInstance.promote();
+            if (pActiveDerived == nullptr || pActiveDerived != pCamera) {
+                ALOGW("Ignoring close of a derived camera that isn't the active one");
+                return;
+            }
+            pDerived->activeInstance = nullptr;
+        }
+        pActiveDerived->shutdown();
+        return;
+    }
 
-    // Is the display being destroyed actually the one we think is active?
-    if (!pRecord) {
-        ALOGE("Asked to close a camera whose name isn't recognized");
-    } else {
-        sp<EvsV4lCamera> pActiveCamera = pRecord->activeInstance.promote();
+    // Neither do replay cameras
+    if (ReplayRecord* pReplay = findReplayById(cameraId)) {
+        sp<EvsReplayCamera> pActiveReplay;
+        {
+            std::lock_guard<std::mutex> lock(sLock);
+            pActiveReplay = pReplay->activeInstance.promote();
+            if (pActiveReplay == nullptr || pActiveReplay != pCamera) {
+                ALOGW("Ignoring close of a replay camera that isn't the active one");
+                return;
+            }
+            pReplay->activeInstance = nullptr;
+        }
+        pActiveReplay->shutdown();
+        return;
+    }
+
+    // Find the named camera
+    sp<EvsV4lCamera> pActiveCamera;
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        CameraRecord *pRecord = findCameraById(cameraId);
 
+        // Is the camera being destroyed actually the one we think is active?
+        if (!pRecord) {
+            ALOGE("Asked to close a camera whose name isn't recognized");
+            return;
+        }
+        pActiveCamera = pRecord->activeInstance.promote();
         if (pActiveCamera == nullptr) {
             ALOGE("Somehow a camera is being destroyed when the enumerator didn't know one existed");
+            return;
         } else if (pActiveCamera != pCamera) {
             // This can happen if the camera was aggressively reopened, orphaning this previous instance
             ALOGW("Ignoring close of previously orphaned camera - why did a client steal?");
-        } else {
-            // Drop the active camera
-            pActiveCamera->shutdown();
-            pRecord->activeInstance = nullptr;
+            return;
         }
+        pRecord->activeInstance = nullptr;
     }
 
-    return Void();
+    // Drop the active camera
+    pActiveCamera->shutdown();
+
+    // A fresh instance takes its place in standby, since the client may still be holding onto
+    // this one
+    prepareStandby(cameraId);
 }
 
 
@@ -282,10 +620,11 @@ Return<sp<IEvsDisplay>> EvsEnumerator::openDisplay() {
 
     // If we already have a display active, then we need to shut it down so we can
     // give exclusive access to the new caller.
+    std::lock_guard<std::mutex> openLock(sOpenLock);
     sp<EvsGlDisplay> pActiveDisplay = sActiveDisplay.promote();
     if (pActiveDisplay != nullptr) {
         ALOGW("Killing previous display because of new caller");
-        closeDisplay(pActiveDisplay);
+        closeDisplayLocked(pActiveDisplay);
     }
 
     // Create a new display interface and return it
@@ -300,6 +639,13 @@ Return<sp<IEvsDisplay>> EvsEnumerator::openDisplay() {
 Return<void> EvsEnumerator::closeDisplay(const ::android::sp<IEvsDisplay>& pDisplay) {
     ALOGD("closeDisplay");
 
+    std::lock_guard<std::mutex> openLock(sOpenLock);
+    closeDisplayLocked(pDisplay);
+    return Void();
+}
+
+
+void EvsEnumerator::closeDisplayLocked(const sp<IEvsDisplay>& pDisplay) {
     // Do we still have a display object we think should be active?
     sp<EvsGlDisplay> pActiveDisplay = sActiveDisplay.promote();
     if (pActiveDisplay == nullptr) {
@@ -311,8 +657,6 @@ Return<void> EvsEnumerator::closeDisplay(const ::android::sp<IEvsDisplay>& pDisp
         pActiveDisplay->forceShutdown();
         sActiveDisplay = nullptr;
     }
-
-    return Void();
 }
 
 
@@ -323,7 +667,11 @@ Return<DisplayState> EvsEnumerator::getDisplayState()  {
     }
 
     // Do we still have a display object we think should be active?
-    sp<IEvsDisplay> pActiveDisplay = sActiveDisplay.promote();
+    sp<IEvsDisplay> pActiveDisplay;
+    {
+        std::lock_guard<std::mutex> openLock(sOpenLock);
+        pActiveDisplay = sActiveDisplay.promote();
+    }
     if (pActiveDisplay != nullptr) {
         return pActiveDisplay->getDisplayState();
     } else {
@@ -332,7 +680,7 @@ Return<DisplayState> EvsEnumerator::getDisplayState()  {
 }
 
 
-bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
+bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName, InventoryEntry* entry) {
     class FileHandleWrapper {
     public:
         FileHandleWrapper(int fd)   { mFd = fd; }
@@ -357,20 +705,29 @@ bool EvsEnumerator::qualifyCaptureDevice(const char* deviceName) {
         ((caps.capabilities & V4L2_CAP_STREAMING)     == 0)) {
         return false;
     }
+    if (entry) {
+        entry->capabilities = caps.capabilities;
+        entry->formats.clear();
+    }
 
     // Enumerate the available capture formats (if any)
     v4l2_fmtdesc formatDescription;
     formatDescription.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     bool found = false;
-    for (int i=0; !found; i++) {
+    // When taking inventory we want every format, not just the first one we can use
+    for (int i=0; !found || entry; i++) {
         formatDescription.index = i;
         if (ioctl(fd, VIDIOC_ENUM_FMT, &formatDescription) == 0) {
             ALOGI("FORMAT 0x%X, type 0x%X, desc %s, flags 0x%X",
                   formatDescription.pixelformat, formatDescription.type,
                   formatDescription.description, formatDescription.flags);
+            if (entry) {
+                entry->formats.push_back(formatDescription.pixelformat);
+            }
             switch (formatDescription.pixelformat)
             {
                 case V4L2_PIX_FMT_YUYV:     found = true; break;
+                case V4L2_PIX_FMT_UYVY:     found = true; break;
                 case V4L2_PIX_FMT_NV21:     found = true; break;
                 case V4L2_PIX_FMT_NV16:     found = true; break;
                 case V4L2_PIX_FMT_YVU420:   found = true; break;
@@ -406,6 +763,28 @@ EvsEnumerator::CameraRecord* EvsEnumerator::findCameraById(const std::string& ca
 }
 
 
+EvsEnumerator::DerivedRecord* EvsEnumerator::findDerivedById(const std::string& cameraId) {
+    // This list is fixed at startup, so needs no lock
+    for (auto&& record : sDerivedCameras) {
+        if (record.spec.name == cameraId) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+
+EvsEnumerator::ReplayRecord* EvsEnumerator::findReplayById(const std::string& cameraId) {
+    // This list is fixed at startup, so needs no lock
+    for (auto&& record : sReplayCameras) {
+        if (record.spec.name == cameraId) {
+            return &record;
+        }
+    }
+    return nullptr;
+}
+
+
 } // namespace implementation
 } // namespace V1_0
 } // namespace evs
@@ -21,8 +21,14 @@
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 
 #include <unordered_map>
+#include <unordered_set>
 #include <thread>
 #include <atomic>
+#include <vector>
+
+#include "CameraInventory.h"
+#include "EvsDerivedCamera.h"
+#include "EvsReplayCamera.h"
 
 namespace android {
 namespace hardware {
@@ -51,34 +57,82 @@ public:
     // Listen to video device uevents
     static void EvsUeventThread(std::atomic<bool>& running);
 
+    // Keeps the given camera open and primed whenever no client has it, so it starts streaming
+    // as quickly as possible.  Must be called before the first EvsEnumerator is constructed.
+    static void addStandbyCamera(const char* cameraId) { sStandbyCameras.insert(cameraId); };
+
+    // Offers a derived view of another camera under a camera id of its own.  It is listed
+    // whenever its parent is.  Must be called before the first EvsEnumerator is constructed.
+    static void addDerivedCamera(const EvsDerivedCamera::Spec& spec) {
+        sDerivedCameras.emplace_back(spec);
+    };
+
+    // Offers a camera that plays back a capture file instead of a device.  It is always
+    // listed.  Must be called before the first EvsEnumerator is constructed.
+    static void addReplayCamera(const EvsReplayCamera::Spec& spec) {
+        sReplayCameras.emplace_back(spec);
+    };
+
 private:
     struct CameraRecord {
         CameraDesc          desc;
         wp<EvsV4lCamera>    activeInstance;
+        sp<EvsV4lCamera>    standbyInstance;    // Primed and waiting for a client, if any
 
         CameraRecord(const char *cameraId) : desc() { desc.cameraId = cameraId; }
     };
 
+    struct DerivedRecord {
+        EvsDerivedCamera::Spec  spec;
+        wp<EvsDerivedCamera>    activeInstance;
+
+        explicit DerivedRecord(const EvsDerivedCamera::Spec& s) : spec(s) {}
+    };
+
+    struct ReplayRecord {
+        EvsReplayCamera::Spec   spec;
+        wp<EvsReplayCamera>     activeInstance;
+
+        explicit ReplayRecord(const EvsReplayCamera::Spec& s) : spec(s) {}
+    };
+
     bool checkPermission();
+    sp<IEvsCamera> openDerivedCameraLocked(DerivedRecord* pRecord);
+    sp<IEvsCamera> openReplayCameraLocked(ReplayRecord* pRecord);
+    void closeCameraLocked(const sp<IEvsCamera>& pCamera);
+    void closeDisplayLocked(const sp<IEvsDisplay>& pDisplay);
 
-    static bool qualifyCaptureDevice(const char* deviceName);
+    static bool qualifyCaptureDevice(const char* deviceName, InventoryEntry* entry = nullptr);
     static CameraRecord* findCameraById(const std::string& cameraId);
+    static DerivedRecord* findDerivedById(const std::string& cameraId);
+    static ReplayRecord* findReplayById(const std::string& cameraId);
     static void enumerateDevices();
+    static void addCamera(const std::string& devicePath);
+    static void prepareStandby(const std::string& cameraId);
+    static void probeDevices(const std::vector<InventoryEntry>& trusted,
+                             std::vector<InventoryEntry>& found);
+    static void revalidateInventory(std::vector<InventoryEntry> cached);
 
     // NOTE:  All members values are static so that all clients operate on the same state
     //        That is to say, this is effectively a singleton despite the fact that HIDL
     //        constructs a new instance for each client.
-    //        Because our server has a single thread in the thread pool, these values are
-    //        never accessed concurrently despite potentially having multiple instance objects
-    //        using them.
+    //        Calls arrive on several RPC threads, so these values are only touched under the
+    //        locks noted below.
     static std::unordered_map<std::string,
                               CameraRecord> sCameraList;
 
     static wp<EvsGlDisplay>                 sActiveDisplay; // Weak pointer.
                                                             // Object destructs if client dies.
+                                                            // Uses sOpenLock.
 
     static std::mutex                       sLock;          // Mutex on shared camera device list.
+    static std::mutex                       sOpenLock;      // Serializes opens and closes.
+                                                            // Taken before sLock.
     static std::condition_variable          sCameraSignal;  // Signal on camera device addition.
+
+    static std::unordered_set<std::string>  sStandbyCameras;    // Which cameras to keep primed
+    static std::vector<DerivedRecord>       sDerivedCameras;    // Instances use sLock
+    static std::vector<ReplayRecord>        sReplayCameras;     // Instances use sLock
 };
 
 } // namespace implementation
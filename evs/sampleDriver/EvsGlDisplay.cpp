@@ -16,9 +16,14 @@
 
 #include "EvsGlDisplay.h"
 
+#include <binder/IServiceManager.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 #include <utils/SystemClock.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
 
 
 namespace android {
@@ -30,6 +35,27 @@ namespace implementation {
 
 static bool sDebugFirstFrameDisplayed = false;
 
+// Our buffer ids count up from here.  An arbitrary magic number for self recognition.
+static const uint32_t kBufferIdBase = 0x3870;
+
+// How long getTargetBuffer() waits for a buffer to come off the screen when they're all busy
+static const std::chrono::milliseconds kBufferWait(100);
+
+// How often we look for SurfaceFlinger to hand over to while we're driving KMS ourselves
+static const std::chrono::milliseconds kSurfaceFlingerPoll(250);
+
+unsigned EvsGlDisplay::sBufferCount = 3;
+bool EvsGlDisplay::sOverlayEnabled = false;
+std::vector<GlWrapper::MirrorDisplay> EvsGlDisplay::sMirrorDisplays;
+std::string EvsGlDisplay::sKmsDevice;
+
+
+static bool isSurfaceFlingerReady() {
+    const String16 serviceName("SurfaceFlinger");
+    return defaultServiceManager()->checkService(serviceName) != nullptr;
+}
+
+
 EvsGlDisplay::EvsGlDisplay() {
     ALOGD("EvsGlDisplay instantiated");
 
@@ -52,28 +78,20 @@ EvsGlDisplay::~EvsGlDisplay() {
 void EvsGlDisplay::forceShutdown()
 {
     ALOGD("EvsGlDisplay forceShutdown");
-    std::lock_guard<std::mutex> lock(mAccessLock);
-
-    // If the buffer isn't being held by a remote client, release it now as an
-    // optimization to release the resources more quickly than the destructor might
-    // get called.
-    if (mBuffer.memHandle) {
-        // Report if we're going away while a buffer is outstanding
-        if (mFrameBusy) {
-            ALOGE("EvsGlDisplay going down while client is holding a buffer");
-        }
-
-        // Drop the graphics buffer we've been using
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        alloc.free(mBuffer.memHandle);
-        mBuffer.memHandle = nullptr;
-
-        mGlWrapper.shutdown();
-    }
+    std::unique_lock<std::mutex> lock(mAccessLock);
 
     // Put this object into an unrecoverable error state since somebody else
-    // is going to own the display now.
+    // is going to own the display now.  This also sends away anyone waiting on a buffer.
     mRequestedState = DisplayState::DEAD;
+    mPresentSignal.notify_all();
+
+    // Let the presentation thread finish the frame it's on, then take down GL
+    stopPresenting(lock);
+
+    // If the buffers aren't being held by a remote client, release them now as an
+    // optimization to release the resources more quickly than the destructor might
+    // get called.
+    releaseBuffers();
 }
 
 
@@ -113,12 +131,23 @@ Return<EvsResult> EvsGlDisplay::setDisplayState(DisplayState state) {
         return EvsResult::INVALID_ARG;
     }
 
+    // Our window only exists once the presentation thread has brought GL up, and not at all
+    // while we drive KMS ourselves
+    const bool haveWindow = (mGlState == GlState::READY) && !mKms;
     switch (state) {
     case DisplayState::NOT_VISIBLE:
-        mGlWrapper.hideWindow();
+        mShowOnPresent = false;
+        if (haveWindow) {
+            mGlWrapper.hideWindow();
+        } else if (mKms) {
+            mBlankRequested = true;
+            mPresentSignal.notify_all();
+        }
         break;
     case DisplayState::VISIBLE:
-        mGlWrapper.showWindow();
+        if (haveWindow) {
+            mGlWrapper.showWindow();
+        }
         break;
     default:
         break;
@@ -154,85 +183,70 @@ Return<DisplayState> EvsGlDisplay::getDisplayState()  {
  */
 Return<void> EvsGlDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb)  {
     ALOGV("getTargetBuffer");
-    std::lock_guard<std::mutex> lock(mAccessLock);
+    std::unique_lock<std::mutex> lock(mAccessLock);
 
+    BufferDesc nullBuff = {};
     if (mRequestedState == DisplayState::DEAD) {
         ALOGE("Rejecting buffer request from object that lost ownership of the display.");
-        BufferDesc nullBuff = {};
         _hidl_cb(nullBuff);
         return Void();
     }
 
-    // If we don't already have a buffer, allocate one now
-    if (!mBuffer.memHandle) {
-        // Initialize our display window
-        // NOTE:  This will cause the display to become "VISIBLE" before a frame is actually
-        // returned, which is contrary to the spec and will likely result in a black frame being
-        // (briefly) shown.
-        if (!mGlWrapper.initialize()) {
-            // Report the failure
-            ALOGE("Failed to initialize GL display");
-            BufferDesc nullBuff = {};
-            _hidl_cb(nullBuff);
-            return Void();
-        }
+    // Initialize our display window, if we haven't yet
+    // NOTE:  This will cause the display to become "VISIBLE" before a frame is actually
+    // returned, which is contrary to the spec and will likely result in a black frame being
+    // (briefly) shown.
+    if (!startPresenting(lock)) {
+        // Report the failure
+        ALOGE("Failed to initialize GL display");
+        _hidl_cb(nullBuff);
+        return Void();
+    }
 
-        // Assemble the buffer description we'll use for our render target
-        mBuffer.width       = mGlWrapper.getWidth();
-        mBuffer.height      = mGlWrapper.getHeight();
-        mBuffer.format      = HAL_PIXEL_FORMAT_RGBA_8888;
-        mBuffer.usage       = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER;
-        mBuffer.bufferId    = 0x3870;  // Arbitrary magic number for self recognition
-        mBuffer.pixelSize   = 4;
+    // If we don't already have our buffers, allocate them now
+    if (mBuffers.empty() && !allocateBuffers()) {
+        _hidl_cb(nullBuff);
+        return Void();
+    }
 
-        // Allocate the buffer that will hold our displayable image
-        buffer_handle_t handle = nullptr;
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
-        status_t result = alloc.allocate(mBuffer.width, mBuffer.height,
-                                         mBuffer.format, 1,
-                                         mBuffer.usage, &handle,
-                                         &mBuffer.stride,
-                                         0, "EvsGlDisplay");
-        if (result != NO_ERROR) {
-            ALOGE("Error %d allocating %d x %d graphics buffer",
-                  result, mBuffer.width, mBuffer.height);
-            BufferDesc nullBuff = {};
-            _hidl_cb(nullBuff);
-            mGlWrapper.shutdown();
-            return Void();
+    // Do we have a frame available?  If not, but some are only waiting to be shown, one of
+    // them will be free shortly.
+    auto findFree = [this]() -> DisplayBuffer* {
+        for (auto&& record : mBuffers) {
+            if (record.state == BufferState::FREE) {
+                return &record;
+            }
         }
-        if (!handle) {
-            ALOGE("We didn't get a buffer handle back from the allocator");
-            BufferDesc nullBuff = {};
-            _hidl_cb(nullBuff);
-            mGlWrapper.shutdown();
-            return Void();
-        }
-
-        mBuffer.memHandle = handle;
-        ALOGD("Allocated new buffer %p with stride %u",
-              mBuffer.memHandle.getNativeHandle(), mBuffer.stride);
-        mFrameBusy = false;
+        return nullptr;
+    };
+    DisplayBuffer* record = findFree();
+    if (record == nullptr) {
+        mPresentSignal.wait_for(lock, kBufferWait, [&]() {
+            record = findFree();
+            return record != nullptr || mRequestedState == DisplayState::DEAD;
+        });
     }
 
-    // Do we have a frame available?
-    if (mFrameBusy) {
+    if (mRequestedState == DisplayState::DEAD) {
+        ALOGE("Rejecting buffer request from object that lost ownership of the display.");
+        _hidl_cb(nullBuff);
+        return Void();
+    } else if (record == nullptr) {
         // This means either we have a 2nd client trying to compete for buffers
         // (an unsupported mode of operation) or else the client hasn't returned
-        // a previously issued buffer yet (they're behaving badly).
+        // the previously issued buffers yet (they're behaving badly).
         // NOTE:  We have to make the callback even if we have nothing to provide
         ALOGE("getTargetBuffer called while no buffers available.");
-        BufferDesc nullBuff = {};
         _hidl_cb(nullBuff);
         return Void();
     } else {
-        // Mark our buffer as busy
-        mFrameBusy = true;
+        // Mark the buffer as busy
+        record->state = BufferState::HELD;
 
         // Send the buffer to the client
         ALOGV("Providing display buffer handle %p as id %d",
-              mBuffer.memHandle.getNativeHandle(), mBuffer.bufferId);
-        _hidl_cb(mBuffer);
+              record->desc.memHandle.getNativeHandle(), record->desc.bufferId);
+        _hidl_cb(record->desc);
         return Void();
     }
 }
@@ -243,6 +257,7 @@ Return<void> EvsGlDisplay::getTargetBuffer(getTargetBuffer_cb _hidl_cb)  {
  * The buffer is no longer valid for use by the client after this call.
  */
 Return<EvsResult> EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc& buffer)  {
+    ATRACE_CALL();
     ALOGV("returnTargetBufferForDisplay %p", buffer.memHandle.getNativeHandle());
     std::lock_guard<std::mutex> lock(mAccessLock);
 
@@ -251,50 +266,365 @@ Return<EvsResult> EvsGlDisplay::returnTargetBufferForDisplay(const BufferDesc& b
         ALOGE ("returnTargetBufferForDisplay called without a valid buffer handle.\n");
         return EvsResult::INVALID_ARG;
     }
-    if (buffer.bufferId != mBuffer.bufferId) {
+
+    // If we've been displaced by another owner of the display, then we can't do anything else
+    // (and our buffers are already gone)
+    if (mRequestedState == DisplayState::DEAD) {
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
+    DisplayBuffer* record = findBuffer(buffer.bufferId);
+    if (record == nullptr) {
         ALOGE ("Got an unrecognized frame returned.\n");
         return EvsResult::INVALID_ARG;
     }
-    if (!mFrameBusy) {
+    if (record->state != BufferState::HELD) {
         ALOGE ("A frame was returned with no outstanding frames.\n");
         return EvsResult::BUFFER_NOT_AVAILABLE;
     }
 
-    mFrameBusy = false;
-
-    // If we've been displaced by another owner of the display, then we can't do anything else
-    if (mRequestedState == DisplayState::DEAD) {
-        return EvsResult::OWNERSHIP_LOST;
-    }
-
     // If we were waiting for a new frame, this is it!
     if (mRequestedState == DisplayState::VISIBLE_ON_NEXT_FRAME) {
         mRequestedState = DisplayState::VISIBLE;
-        mGlWrapper.showWindow();
+        mShowOnPresent = true;
     }
 
     // Validate we're in an expected state
     if (mRequestedState != DisplayState::VISIBLE) {
         // Not sure why a client would send frames back when we're not visible.
         ALOGW ("Got a frame returned while not visible - ignoring.\n");
+        record->state = BufferState::FREE;
     } else {
-        // Update the texture contents with the provided data
-// TODO:  Why doesn't it work to pass in the buffer handle we got from HIDL?
-//        if (!mGlWrapper.updateImageTexture(buffer)) {
-        if (!mGlWrapper.updateImageTexture(mBuffer)) {
-            return EvsResult::UNDERLYING_SERVICE_ERROR;
+        // Hand the frame to the presentation thread so the client can get on with the next one.
+        // If the last frame we were given still hasn't gone up, this one replaces it.
+        if (mNextToPresent >= 0) {
+            ALOGV("Dropping display buffer %d in favor of a newer frame", mNextToPresent);
+            mBuffers[mNextToPresent].state = BufferState::FREE;
         }
+        record->state = BufferState::PRESENTING;
+        mNextToPresent = record - mBuffers.data();
+    }
+    mPresentSignal.notify_all();
+
+    return EvsResult::OK;
+}
+
+
+/**
+ * Starts the presentation thread if it isn't running, and waits to hear whether it managed to
+ * bring up GL.  Expects mAccessLock to be held by the given lock.
+ */
+bool EvsGlDisplay::startPresenting(std::unique_lock<std::mutex>& lock) {
+    if (mGlState == GlState::NOT_STARTED) {
+        mStopPresenting = false;
+        mGlState = GlState::STARTING;
+        mPresentThread = std::thread([this]() { presentFrames(); });
+    }
+
+    mPresentSignal.wait(lock, [this]() { return mGlState != GlState::STARTING; });
+    if (mGlState == GlState::FAILED) {
+        // Clean up after the thread so the next request can try again
+        lock.unlock();
+        mPresentThread.join();
+        lock.lock();
+        mGlState = GlState::NOT_STARTED;
+        return false;
+    }
+
+    return true;
+}
+
 
-        // Put the image on the screen
-        mGlWrapper.renderImageToScreen();
-        if (!sDebugFirstFrameDisplayed) {
+/**
+ * Has the presentation thread take down GL and waits for it to finish.  Frames it hasn't put
+ * up yet are dropped.  Expects mAccessLock to be held by the given lock.
+ */
+void EvsGlDisplay::stopPresenting(std::unique_lock<std::mutex>& lock) {
+    if (mPresentThread.joinable()) {
+        mStopPresenting = true;
+        mPresentSignal.notify_all();
+
+        lock.unlock();
+        mPresentThread.join();
+        lock.lock();
+    }
+
+    mGlState = GlState::NOT_STARTED;
+    mShowOnPresent = false;
+    mBlankRequested = false;
+    if (mNextToPresent >= 0) {
+        mBuffers[mNextToPresent].state = BufferState::FREE;
+        mNextToPresent = -1;
+    }
+    if (mOnScreen >= 0) {
+        mBuffers[mOnScreen].state = BufferState::FREE;
+        mOnScreen = -1;
+    }
+}
+
+
+/**
+ * The body of the presentation thread.  GL contexts belong to a thread, so everything we do with
+ * mGlWrapper happens here, from initialization through to shutdown.  The same goes for
+ * mKmsOutput, which stands in for mGlWrapper until SurfaceFlinger is up, if we're allowed it.
+ */
+void EvsGlDisplay::presentFrames() {
+    bool kms = false;
+    bool initialized = false;
+    if (!sKmsDevice.empty() && !isSurfaceFlingerReady()) {
+        kms = initialized = mKmsOutput.initialize(sKmsDevice.c_str());
+    }
+    if (!initialized) {
+        initialized = mGlWrapper.initialize(sOverlayEnabled, sMirrorDisplays);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (initialized) {
+            mWidth   = kms ? mKmsOutput.getWidth()  : mGlWrapper.getWidth();
+            mHeight  = kms ? mKmsOutput.getHeight() : mGlWrapper.getHeight();
+            mOverlay = !kms && mGlWrapper.usingOverlay();
+            mKms     = kms;
+        }
+        mGlState = initialized ? GlState::READY : GlState::FAILED;
+        mPresentSignal.notify_all();
+    }
+    if (!initialized) {
+        return;
+    }
+
+    // Once SurfaceFlinger has the display, what we left on it comes down with its first frame
+    bool kmsLeftOnScreen = false;
+    nsecs_t nextHandOverCheck = 0;
+
+    std::unique_lock<std::mutex> lock(mAccessLock);
+    for (;;) {
+        auto haveWork = [this]() {
+            return mStopPresenting || mNextToPresent >= 0 || mBlankRequested;
+        };
+        if (mKms) {
+            // Keep looking out for SurfaceFlinger, whether or not frames are coming
+            mPresentSignal.wait_for(lock, kSurfaceFlingerPoll, haveWork);
+        } else {
+            mPresentSignal.wait(lock, haveWork);
+        }
+        if (mStopPresenting) {
+            break;
+        }
+
+        if (mKms && systemTime(SYSTEM_TIME_MONOTONIC) >= nextHandOverCheck) {
+            nextHandOverCheck = systemTime(SYSTEM_TIME_MONOTONIC) +
+                                std::chrono::nanoseconds(kSurfaceFlingerPoll).count();
+            if (isSurfaceFlingerReady()) {
+                lock.unlock();
+                const bool handedOver = handOverToSurfaceFlinger();
+                lock.lock();
+                if (handedOver) {
+                    mKms = false;
+                    mOverlay = mGlWrapper.usingOverlay();
+                    mBlankRequested = false;
+                    mShowOnPresent = (mRequestedState == DisplayState::VISIBLE);
+                    kmsLeftOnScreen = true;
+                }
+                continue;
+            }
+        }
+
+        if (mBlankRequested) {
+            // Anything still waiting to go up was meant for before the display went off
+            mBlankRequested = false;
+            if (mNextToPresent >= 0) {
+                mBuffers[mNextToPresent].state = BufferState::FREE;
+                mNextToPresent = -1;
+                mPresentSignal.notify_all();
+            }
+            if (mKms) {
+                lock.unlock();
+                mKmsOutput.blank();
+                lock.lock();
+                if (mOnScreen >= 0) {
+                    mBuffers[mOnScreen].state = BufferState::FREE;
+                    mOnScreen = -1;
+                    mPresentSignal.notify_all();
+                }
+            }
+            continue;
+        }
+        if (mNextToPresent < 0) {
+            // We only woke up to look for SurfaceFlinger
+            continue;
+        }
+
+        const int idx = mNextToPresent;
+        const bool show = mShowOnPresent;
+        const bool kmsFrame = mKms;
+        mNextToPresent = -1;
+        mShowOnPresent = false;
+
+        // No copy of the description:  that would clone its handle.  Nothing else touches the
+        // record while it is PRESENTING, and mBuffers only changes while we aren't running.
+        const BufferDesc& desc = mBuffers[idx].desc;
+        lock.unlock();
+
+        if (show && !kmsFrame) {
+            mGlWrapper.showWindow();
+        }
+
+        bool presented = false;
+        if (kmsFrame) {
+            // We scan the buffer out ourselves, and a blanked display comes back on with it
+            ATRACE_BEGIN("presentBuffer");
+            presented = mKmsOutput.presentBuffer(desc);
+            ATRACE_END();
+            if (!presented) {
+                ALOGE("Failed to scan out buffer %u", desc.bufferId);
+            }
+        } else if (mGlWrapper.usingOverlay()) {
+            // The composer takes the buffer itself
+            ATRACE_BEGIN("presentBuffer");
+            presented = mGlWrapper.presentBuffer(desc);
+            ATRACE_END();
+            if (!presented) {
+                ALOGE("Failed to present buffer %u", desc.bufferId);
+            }
+        } else {
+            // Update the texture contents with the provided data
+// TODO:  Why doesn't it work to pass in the buffer handle we got from HIDL?
+            if (!mGlWrapper.updateImageTexture(desc)) {
+                ALOGE("Failed to update the display texture from buffer %u", desc.bufferId);
+            } else {
+                // Put the image on the screen
+                ATRACE_BEGIN("renderImageToScreen");
+                mGlWrapper.renderImageToScreen();
+                ATRACE_END();
+                presented = true;
+            }
+        }
+        if (presented && !sDebugFirstFrameDisplayed) {
             ALOGD("EvsFirstFrameDisplayTiming start time: %" PRId64 "ms", elapsedRealtime());
             sDebugFirstFrameDisplayed = true;
         }
+        if (presented && !kmsFrame && kmsLeftOnScreen) {
+            mKmsOutput.shutdown();
+            kmsLeftOnScreen = false;
+        }
 
+        lock.lock();
+        if (presented && (kmsFrame || mGlWrapper.usingOverlay())) {
+            // The overlay keeps scanning out of this buffer until the next one replaces it
+            if (mOnScreen >= 0) {
+                mBuffers[mOnScreen].state = BufferState::FREE;
+            }
+            mOnScreen = idx;
+        } else {
+            mBuffers[idx].state = BufferState::FREE;
+
+            // The buffer KMS was scanning out before the hand over has been replaced too
+            if (presented && mOnScreen >= 0) {
+                mBuffers[mOnScreen].state = BufferState::FREE;
+                mOnScreen = -1;
+            }
+        }
+        mPresentSignal.notify_all();
     }
+    mKms = false;
+    lock.unlock();
 
-    return EvsResult::OK;
+    mKmsOutput.shutdown();
+    mGlWrapper.shutdown();
+}
+
+
+/**
+ * Gives the display up to SurfaceFlinger and brings up GL on it instead, leaving our last KMS
+ * frame up in the meantime.  If GL won't come up, we carry on with KMS.  Only called on the
+ * presentation thread, without mAccessLock.
+ */
+bool EvsGlDisplay::handOverToSurfaceFlinger() {
+    // The composer has to be DRM master to put anything up
+    mKmsOutput.releaseMaster();
+    if (!mGlWrapper.initialize(sOverlayEnabled, sMirrorDisplays)) {
+        ALOGW("SurfaceFlinger is up but GL isn't yet, so keeping the display on KMS for now");
+        mGlWrapper.shutdown();
+        mKmsOutput.reclaim();
+        return false;
+    }
+
+    ALOGI("Handed the display over to SurfaceFlinger");
+    return true;
+}
+
+
+/**
+ * Allocates sBufferCount render targets the size of the display.  Expects mAccessLock to be held,
+ * and GL to be up so we know how big to make them.
+ */
+bool EvsGlDisplay::allocateBuffers() {
+    // An overlay (or KMS) holds on to one buffer, so needs another for the client to render into
+    const unsigned count = std::max(sBufferCount, (mOverlay || mKms) ? 2u : 1u);
+    mBuffers.resize(count);
+
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (unsigned i = 0; i < count; i++) {
+        // Assemble the buffer description we'll use for our render target
+        BufferDesc& desc = mBuffers[i].desc;
+        desc.width       = mWidth;
+        desc.height      = mHeight;
+        desc.format      = HAL_PIXEL_FORMAT_RGBA_8888;
+        desc.usage       = GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_COMPOSER;
+        desc.bufferId    = kBufferIdBase + i;
+        desc.pixelSize   = 4;
+
+        // Allocate the buffer that will hold our displayable image
+        buffer_handle_t handle = nullptr;
+        status_t result = alloc.allocate(desc.width, desc.height,
+                                         desc.format, 1,
+                                         desc.usage, &handle,
+                                         &desc.stride,
+                                         0, "EvsGlDisplay");
+        if (result != NO_ERROR) {
+            ALOGE("Error %d allocating %d x %d graphics buffer",
+                  result, desc.width, desc.height);
+            releaseBuffers();
+            return false;
+        }
+        if (!handle) {
+            ALOGE("We didn't get a buffer handle back from the allocator");
+            releaseBuffers();
+            return false;
+        }
+
+        desc.memHandle = handle;
+        ALOGD("Allocated new buffer %p with stride %u as id %u",
+              desc.memHandle.getNativeHandle(), desc.stride, desc.bufferId);
+    }
+
+    return true;
+}
+
+
+/**
+ * Drops all our graphics buffers.  Expects mAccessLock to be held, and the presentation thread
+ * to be stopped.
+ */
+void EvsGlDisplay::releaseBuffers() {
+    GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
+    for (auto&& record : mBuffers) {
+        if (record.desc.memHandle) {
+            // Report if we're going away while a buffer is outstanding
+            if (record.state == BufferState::HELD) {
+                ALOGE("EvsGlDisplay going down while client is holding buffer %u",
+                      record.desc.bufferId);
+            }
+            alloc.free(record.desc.memHandle);
+        }
+    }
+    mBuffers.clear();
+}
+
+
+EvsGlDisplay::DisplayBuffer* EvsGlDisplay::findBuffer(uint32_t bufferId) {
+    const uint32_t idx = bufferId - kBufferIdBase;
+    return (idx < mBuffers.size()) ? &mBuffers[idx] : nullptr;
 }
 
 } // namespace implementation
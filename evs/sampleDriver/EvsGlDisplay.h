@@ -21,6 +21,14 @@
 #include <ui/GraphicBuffer.h>
 
 #include "GlWrapper.h"
+#include "KmsOutput.h"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 namespace android {
@@ -46,16 +54,81 @@ public:
 
     void forceShutdown();   // This gets called if another caller "steals" ownership of the display
 
+    // Sets how many target buffers displays opened afterwards cycle through.  With more than
+    // one, a client can render its next frame while we're still putting the last one up.  Our
+    // GlWrapper keeps a GL image for each, so there can be no more than kMaxBufferCount.
+    static const unsigned kMaxBufferCount = 8;
+    static void setBufferCount(unsigned count) { sBufferCount = count; };
+
+    // When enabled, displays opened afterwards hand their buffers straight to the composer as
+    // an overlay layer, where it can take them, instead of drawing them with GL
+    static void enableOverlay(bool enable) { sOverlayEnabled = enable; };
+
+    // Displays opened afterwards also show every frame on this display, such as a cluster
+    // alongside the center display, without the client drawing anything twice
+    static void addMirrorDisplay(uint64_t physicalId, uint32_t layerStack) {
+        sMirrorDisplays.push_back({ physicalId, layerStack });
+    };
+
+    // Displays opened before SurfaceFlinger is up drive this DRM device (eg: /dev/dri/card0)
+    // directly instead of failing, and hand over to SurfaceFlinger once it starts.  Meant for
+    // showing the rear view camera early in boot.
+    static void enableKms(const char* device) { sKmsDevice = device; };
+
 private:
-    DisplayDesc     mInfo           = {};
-    BufferDesc      mBuffer         = {};       // A graphics buffer into which we'll store images
+    enum class BufferState {
+        FREE,           // Ours, and ready to hand out
+        HELD,           // With the client, who is drawing into it
+        PRESENTING,     // Returned, and waiting for, going, or (as an overlay) up on screen
+    };
+    struct DisplayBuffer {
+        BufferDesc      desc    = {};
+        BufferState     state   = BufferState::FREE;
+    };
 
-    bool            mFrameBusy      = false;    // A flag telling us our buffer is in use
+    enum class GlState {
+        NOT_STARTED,
+        STARTING,
+        READY,
+        FAILED,
+    };
+
+    bool startPresenting(std::unique_lock<std::mutex>& lock);   // Brings up GL, if need be
+    void stopPresenting(std::unique_lock<std::mutex>& lock);
+    void presentFrames();           // The presentation thread, which owns everything GL
+    bool handOverToSurfaceFlinger();
+    bool allocateBuffers();
+    void releaseBuffers();
+    DisplayBuffer* findBuffer(uint32_t bufferId);
+
+    DisplayDesc     mInfo           = {};
     DisplayState    mRequestedState = DisplayState::NOT_VISIBLE;
 
-    GlWrapper       mGlWrapper;
+    GlWrapper       mGlWrapper;     // Only used on the presentation thread
+    KmsOutput       mKmsOutput;     // Likewise, and only until SurfaceFlinger takes over
 
+    // Protects everything below
     std::mutex      mAccessLock;
+    std::condition_variable     mPresentSignal;
+
+    std::vector<DisplayBuffer>  mBuffers;   // The graphics buffers into which we'll store images
+    int             mNextToPresent  = -1;   // Index of the newest returned buffer, if not yet shown
+    int             mOnScreen       = -1;   // Index of the overlay buffer being scanned out
+    bool            mShowOnPresent  = false;// Put the window up along with the next frame
+
+    std::thread     mPresentThread;
+    GlState         mGlState        = GlState::NOT_STARTED;
+    bool            mStopPresenting = false;
+    unsigned        mWidth          = 0;    // Of the display, once GL is up
+    unsigned        mHeight         = 0;
+    bool            mOverlay        = false;// Are we presenting through an overlay layer?
+    bool            mKms            = false;// Or through mKmsOutput, before SurfaceFlinger?
+    bool            mBlankRequested = false;// Have mKmsOutput turn the display off
+
+    static unsigned sBufferCount;
+    static bool     sOverlayEnabled;
+    static std::vector<GlWrapper::MirrorDisplay> sMirrorDisplays;
+    static std::string sKmsDevice;
 };
 
 } // namespace implementation
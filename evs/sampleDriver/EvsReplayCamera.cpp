@@ -0,0 +1,469 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "EvsReplayCamera.h"
+#include "bufferCopy.h"
+
+#include <ui/GraphicBufferMapper.h>
+
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fcntl.h>
+#include <linux/videodev2.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Same limit as a live camera
+static const unsigned kMaxBuffersInFlight = 100;
+
+// How long we pretend the gap is between the last frame of the file and the first, when the
+// file can't tell us
+static const int64_t kDefaultFrameIntervalNs = 33333333;
+
+
+bool EvsReplayCamera::parseSpec(const char* arg, Spec* spec) {
+    const char* equals = strchr(arg, '=');
+    if (equals == nullptr || equals == arg || equals[1] == '\0') {
+        return false;
+    }
+
+    Spec parsed;
+    parsed.name.assign(arg, equals - arg);
+    parsed.path = equals + 1;
+
+    static const char kFastSuffix[] = ":fast";
+    const size_t suffixLength = sizeof(kFastSuffix) - 1;
+    if (parsed.path.size() > suffixLength &&
+        parsed.path.compare(parsed.path.size() - suffixLength, suffixLength, kFastSuffix) == 0) {
+        parsed.path.resize(parsed.path.size() - suffixLength);
+        parsed.realTime = false;
+    }
+
+    *spec = parsed;
+    return true;
+}
+
+
+EvsReplayCamera::EvsReplayCamera(const Spec& spec) :
+        mSpec(spec),
+        mOutputBuffers(spec.name, "EvsReplayCamera", kMaxBuffersInFlight) {
+    ALOGD("EvsReplayCamera instantiated for %s", spec.path.c_str());
+
+    mDescription.cameraId = spec.name;
+    if (!openFile()) {
+        ALOGE("Failed to open capture file %s", spec.path.c_str());
+        return;
+    }
+
+    // Let clients see what the recorded camera was sending, as a live one would
+    mDescription.vendorFlags = mHeader.v4lFormat;
+
+    // We hand out each camera format's native output format, as a live camera does by default.
+    // The conversions read whole rows of the recorded stride, or whole 16 byte aligned planes for
+    // NV21 (see fillNV21FromNV21), so that's what every frame has to hold.
+    uint32_t format = 0;        // Values from android_pixel_format_t
+    uint32_t minStride = 0;
+    size_t frameBytes = 0;      // Compressed frames can be any size
+    switch (mHeader.v4lFormat) {
+    case V4L2_PIX_FMT_YUYV:
+        format = HAL_PIXEL_FORMAT_RGBA_8888;
+        mFill = fillRGBAFromYUYV;
+        minStride = mHeader.width * 2;
+        frameBytes = size_t(mHeader.stride) * mHeader.height;
+        break;
+    case V4L2_PIX_FMT_UYVY:
+        format = HAL_PIXEL_FORMAT_YCBCR_422_I;
+        mFill = fillYUYVFromUYVY;
+        minStride = mHeader.width * 2;
+        frameBytes = size_t(mHeader.stride) * mHeader.height;
+        break;
+    case V4L2_PIX_FMT_NV21:
+        format = HAL_PIXEL_FORMAT_YCRCB_420_SP;
+        mFill = fillNV21FromNV21;
+        minStride = mHeader.width;
+        frameBytes = size_t((mHeader.width + 15) & ~15u) * mHeader.height * 3 / 2;
+        break;
+    case V4L2_PIX_FMT_MJPEG:
+        format = HAL_PIXEL_FORMAT_RGBA_8888;
+        mMjpegDecoder = std::make_unique<MjpegDecoder>();
+        break;
+    default:
+        ALOGE("%s holds %4.4s frames, which we can't convert",
+              spec.path.c_str(), (char*)&mHeader.v4lFormat);
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        return;
+    }
+    if (mHeader.stride < minStride) {
+        ALOGE("%s has rows of %u bytes, too few for %u pixels of %4.4s", spec.path.c_str(),
+              mHeader.stride, mHeader.width, (char*)&mHeader.v4lFormat);
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        return;
+    }
+
+    // So we never read past the end of a frame, leave out any that were cut short
+    const size_t recorded = mFrames.size();
+    mFrames.erase(std::remove_if(mFrames.begin(), mFrames.end(),
+                                 [frameBytes](const Frame& frame) {
+                                     return frame.size < frameBytes;
+                                 }),
+                  mFrames.end());
+    if (mFrames.size() < recorded) {
+        ALOGW("%s has %zu frames smaller than the %zu bytes of a whole image, so we skip them",
+              spec.path.c_str(), recorded - mFrames.size(), frameBytes);
+    }
+    if (mFrames.empty()) {
+        ALOGE("%s holds no whole frames", spec.path.c_str());
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        return;
+    }
+
+    mOutputBuffers.setFormat(mHeader.width, mHeader.height, format,
+                             GRALLOC_USAGE_HW_TEXTURE     |
+                             GRALLOC_USAGE_SW_READ_RARELY |
+                             GRALLOC_USAGE_SW_WRITE_OFTEN);
+
+    ALOGI("Replaying %zu frames of %ux%u %4.4s from %s%s", mFrames.size(),
+          mHeader.width, mHeader.height, (char*)&mHeader.v4lFormat, spec.path.c_str(),
+          spec.realTime ? "" : " as fast as they're taken");
+}
+
+
+EvsReplayCamera::~EvsReplayCamera() {
+    ALOGD("EvsReplayCamera being destroyed");
+    shutdown();
+}
+
+
+bool EvsReplayCamera::openFile() {
+    int fd = open(mSpec.path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        ALOGE("open(%s): %s", mSpec.path.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat fileInfo = {};
+    if (fstat(fd, &fileInfo) < 0 || fileInfo.st_size < (off_t)sizeof(CaptureFileHeader)) {
+        ALOGE("%s is too short to be a capture file", mSpec.path.c_str());
+        close(fd);
+        return false;
+    }
+
+    // The mapping keeps the file for us, so we needn't hold on to the fd
+    mMappingSize = fileInfo.st_size;
+    mMapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mMapping == MAP_FAILED) {
+        ALOGE("mmap(%s): %s", mSpec.path.c_str(), strerror(errno));
+        mMapping = nullptr;
+        return false;
+    }
+    const uint8_t* base = static_cast<const uint8_t*>(mMapping);
+
+    memcpy(&mHeader, base, sizeof(mHeader));
+    if (memcmp(mHeader.magic, kCaptureFileMagic, sizeof(mHeader.magic)) != 0 ||
+        mHeader.version != kCaptureFileVersion || mHeader.width < 1 || mHeader.height < 1) {
+        ALOGE("%s isn't a capture file we can play", mSpec.path.c_str());
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        return false;
+    }
+
+    // Find every complete frame.  A recording that was cut short just ends early.
+    size_t offset = sizeof(CaptureFileHeader);
+    while (offset + sizeof(CaptureFrameHeader) <= mMappingSize) {
+        CaptureFrameHeader frameHeader;
+        memcpy(&frameHeader, base + offset, sizeof(frameHeader));
+        offset += sizeof(frameHeader);
+        if (frameHeader.size > mMappingSize - offset) {
+            break;
+        }
+        mFrames.push_back({ base + offset, frameHeader.size, frameHeader.captureTimeNs });
+        offset += (frameHeader.size + 7) & ~7u;
+    }
+    if (mFrames.empty()) {
+        ALOGE("%s holds no frames", mSpec.path.c_str());
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        return false;
+    }
+
+    return true;
+}
+
+
+//
+// This gets called if another caller "steals" ownership of the camera
+//
+void EvsReplayCamera::shutdown() {
+    ALOGD("EvsReplayCamera shutdown");
+
+    // Make sure our output stream is cleaned up
+    stopVideoStream();
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // Drop all the graphics buffers we've been using
+    mOutputBuffers.releaseAll();
+
+    if (mMapping != nullptr) {
+        munmap(mMapping, mMappingSize);
+        mMapping = nullptr;
+        mFrames.clear();
+    }
+}
+
+
+// Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
+Return<void> EvsReplayCamera::getCameraInfo(getCameraInfo_cb _hidl_cb) {
+    ALOGD("getCameraInfo");
+
+    // Send back our self description
+    _hidl_cb(mDescription);
+    return Void();
+}
+
+
+Return<EvsResult> EvsReplayCamera::setMaxFramesInFlight(uint32_t bufferCount) {
+    ALOGD("setMaxFramesInFlight");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // If we've been displaced by another owner of the camera, then we can't do anything else
+    if (!isOpen()) {
+        ALOGW("ignoring setMaxFramesInFlight call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
+    // We cannot function without at least one video buffer to send data
+    if (bufferCount < 1) {
+        ALOGE("Ignoring setMaxFramesInFlight with less than one buffer requested");
+        return EvsResult::INVALID_ARG;
+    }
+
+    return mOutputBuffers.setCount(bufferCount) ? EvsResult::OK
+                                                : EvsResult::BUFFER_NOT_AVAILABLE;
+}
+
+
+Return<EvsResult> EvsReplayCamera::startVideoStream(
+        const ::android::sp<IEvsCameraStream>& stream) {
+    ALOGD("startVideoStream");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // If we've been displaced by another owner of the camera, then we can't do anything else
+    if (!isOpen()) {
+        ALOGW("ignoring startVideoStream call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+    if (mStream != nullptr) {
+        ALOGE("ignoring startVideoStream call when a stream is already running.");
+        return EvsResult::STREAM_ALREADY_RUNNING;
+    }
+
+    // If the client never indicated otherwise, configure ourselves for a single buffer
+    if (mOutputBuffers.count() < 1 && !mOutputBuffers.setCount(1)) {
+        ALOGE("Failed to start stream because we couldn't get a graphics buffer");
+        return EvsResult::BUFFER_NOT_AVAILABLE;
+    }
+
+    // Record the user's callback, and start playing
+    mStream = stream;
+    mRunning = true;
+    mThread = std::thread([this]() { playbackThread(); });
+
+    return EvsResult::OK;
+}
+
+
+Return<void> EvsReplayCamera::doneWithFrame(const BufferDesc& buffer) {
+    ALOGD("doneWithFrame");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    if (mOutputBuffers.doneWithFrame(buffer)) {
+        // When we play as fast as we can, this is what we're waiting for
+        mStopSignal.notify_one();
+    }
+
+    return Void();
+}
+
+
+Return<void> EvsReplayCamera::stopVideoStream() {
+    ALOGD("stopVideoStream");
+
+    // Tell the playback thread to stop, and wait for it to finish
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mRunning = false;
+        mStopSignal.notify_one();
+    }
+    if (mThread.joinable()) {
+        mThread.join();
+    }
+
+    sp<IEvsCameraStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        stream = mStream;
+        mStream = nullptr;
+    }
+
+    if (stream != nullptr) {
+        // Send one last NULL frame to signal the actual end of stream
+        BufferDesc nullBuff = {};
+        auto result = stream->deliverFrame(nullBuff);
+        if (!result.isOk()) {
+            ALOGE("Error delivering end of stream marker");
+        }
+    }
+
+    return Void();
+}
+
+
+Return<int32_t> EvsReplayCamera::getExtendedInfo(uint32_t /*opaqueIdentifier*/) {
+    ALOGD("getExtendedInfo");
+    // Return zero by default as required by the spec
+    return 0;
+}
+
+
+Return<EvsResult> EvsReplayCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
+                                                   int32_t /*opaqueValue*/) {
+    ALOGD("setExtendedInfo");
+    std::lock_guard<std::mutex> lock(mAccessLock);
+
+    // If we've been displaced by another owner of the camera, then we can't do anything else
+    if (!isOpen()) {
+        ALOGW("ignoring setExtendedInfo call when camera has been lost.");
+        return EvsResult::OWNERSHIP_LOST;
+    }
+
+    // We don't store any device specific information in this implementation
+    return EvsResult::INVALID_ARG;
+}
+
+
+void EvsReplayCamera::playbackThread() {
+    // Each pass through the file is laid out on the clock one recording's length after the last
+    const int64_t firstCaptureNs = mFrames.front().captureTimeNs;
+    int64_t loopLengthNs = mFrames.back().captureTimeNs - firstCaptureNs;
+    loopLengthNs += (mFrames.size() > 1) ? loopLengthNs / (int64_t)(mFrames.size() - 1)
+                                         : kDefaultFrameIntervalNs;
+    int64_t loopStartNs = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    size_t next = 0;
+    while (mRunning) {
+        const Frame& frame = mFrames[next];
+        {
+            std::unique_lock<std::mutex> lock(mAccessLock);
+            if (mSpec.realTime) {
+                // Wait for the frame's time to come, as it did when it was recorded
+                const int64_t dueNs = loopStartNs + (frame.captureTimeNs - firstCaptureNs);
+                mStopSignal.wait_for(lock,
+                                     std::chrono::nanoseconds(
+                                             dueNs - systemTime(SYSTEM_TIME_MONOTONIC)),
+                                     [this]() { return !mRunning; });
+            } else {
+                // No faster than our clients give us buffers back
+                mStopSignal.wait(lock, [this]() {
+                                     return !mRunning || mOutputBuffers.haveRoom();
+                                 });
+            }
+        }
+        if (!mRunning) {
+            break;
+        }
+
+        deliverFrame(frame);
+
+        if (++next == mFrames.size()) {
+            next = 0;
+            loopStartNs += loopLengthNs;
+        }
+    }
+
+    ALOGD("Replay of %s ending", mSpec.path.c_str());
+}
+
+
+void EvsReplayCamera::deliverFrame(const Frame& frame) {
+    ATRACE_CALL();
+
+    // Take a free buffer, if we're allowed another one
+    BufferDesc buff = {};
+    sp<IEvsCameraStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (!mOutputBuffers.take(&buff)) {
+            return;
+        }
+        stream = mStream;
+    }
+
+    // Convert the recorded frame into the buffer, just as the camera's own frames would be
+    void* pixels = nullptr;
+    GraphicBufferMapper& mapper = GraphicBufferMapper::get();
+    mapper.lock(buff.memHandle,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                android::Rect(buff.width, buff.height),
+                &pixels);
+    bool converted = false;
+    if (pixels == nullptr) {
+        ALOGE("Camera failed to gain access to image buffer for writing");
+    } else {
+        if (mMjpegDecoder) {
+            converted = mMjpegDecoder->decode(buff, (uint8_t*)pixels, frame.data, frame.size);
+        } else {
+            mFill(buff, (uint8_t*)pixels, const_cast<uint8_t*>(frame.data), mHeader.stride,
+                  0, buff.height);
+            converted = true;
+        }
+        mapper.unlock(buff.memHandle);
+    }
+
+    auto result = converted ? stream->deliverFrame(buff) : Return<void>();
+    if (!converted || !result.isOk()) {
+        if (converted) {
+            ALOGE("Frame delivery call failed in the transport layer.");
+        }
+
+        // Since we didn't actually deliver it, mark the frame as available
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mOutputBuffers.putBack(buff.bufferId);
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
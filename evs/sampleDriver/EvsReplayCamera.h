@@ -0,0 +1,119 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_EVSREPLAYCAMERA_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_EVSREPLAYCAMERA_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "CaptureFile.h"
+#include "ConversionPool.h"
+#include "bufferCopy.h"
+#include "MjpegDecoder.h"
+#include "OutputBufferRing.h"
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// A camera that plays back a capture file (see CaptureFile.h) instead of talking to hardware,
+// so the rest of the stack can be loaded and measured on machines without cameras.  Frames are
+// read straight out of a mapping of the file and go through the same conversions a live
+// camera's would.  Playback loops at the end of the file.
+class EvsReplayCamera : public IEvsCamera {
+public:
+    struct Spec {
+        std::string name;               // The camera id clients open it by
+        std::string path;               // The capture file to play
+        bool        realTime = true;    // Keep the recorded timing, or go as fast as we can?
+    };
+
+    // Reads a spec of the form <name>=<path>[:fast]
+    static bool parseSpec(const char* arg, Spec* spec);
+
+    // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
+    Return<void> getCameraInfo(getCameraInfo_cb _hidl_cb)  override;
+    Return <EvsResult> setMaxFramesInFlight(uint32_t bufferCount) override;
+    Return <EvsResult> startVideoStream(const ::android::sp<IEvsCameraStream>& stream) override;
+    Return<void> doneWithFrame(const BufferDesc& buffer) override;
+    Return<void> stopVideoStream() override;
+    Return <int32_t> getExtendedInfo(uint32_t opaqueIdentifier) override;
+    Return <EvsResult> setExtendedInfo(uint32_t opaqueIdentifier, int32_t opaqueValue) override;
+
+    // Implementation details
+    explicit EvsReplayCamera(const Spec& spec);
+    virtual ~EvsReplayCamera() override;
+    void shutdown();
+
+    const CameraDesc& getDesc() { return mDescription; };
+    bool isOpen() { return mMapping != nullptr; };
+
+private:
+    struct Frame {
+        const uint8_t*  data;
+        uint32_t        size;
+        int64_t         captureTimeNs;
+    };
+
+    bool openFile();
+    void playbackThread();
+    void deliverFrame(const Frame& frame);
+
+    const Spec          mSpec;
+    CameraDesc          mDescription = {};
+
+    // The capture file, mapped for as long as we're open
+    void*               mMapping = nullptr;
+    size_t              mMappingSize = 0;
+    CaptureFileHeader   mHeader = {};
+    std::vector<Frame>  mFrames;
+
+    // How we get from what was recorded to what we hand out
+    FillFunction                    mFill = nullptr;
+    std::unique_ptr<MjpegDecoder>   mMjpegDecoder;
+
+    std::thread         mThread;
+    std::atomic<bool>   mRunning {false};
+
+    std::mutex                  mAccessLock;    // Guards the fields below
+    std::condition_variable     mStopSignal;    // Wakes the playback thread to stop, or when a
+                                                // buffer comes back
+    sp<IEvsCameraStream>        mStream;
+    OutputBufferRing            mOutputBuffers;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_EVSREPLAYCAMERA_H
@@ -15,12 +15,22 @@
  */
 
 #include "EvsV4lCamera.h"
+#include "EvsDerivedCamera.h"
 #include "EvsEnumerator.h"
+#include "GrallocPool.h"
 #include "bufferCopy.h"
 
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <algorithm>
+#include <inttypes.h>
+#include <linux/dma-buf.h>
+#include <sys/ioctl.h>
+
 
 namespace android {
 namespace hardware {
@@ -29,11 +39,81 @@ namespace evs {
 namespace V1_0 {
 namespace implementation {
 
+using ::android::automotive::evs::support::ConversionPool;
+using ::android::automotive::evs::support::makeTraceCookie;
+
 
 // Arbitrary limit on number of graphics buffers allowed to be allocated
 // Safeguards against unreasonable resource consumption and provides a testable limit
 static const unsigned MAX_BUFFERS_IN_FLIGHT = 100;
 
+// In zero copy mode the capture ring is our pool of output buffers, so we add a few more than
+// the clients asked for to keep the camera capturing while they hold their full quota.
+static const unsigned kZeroCopySpareBuffers = 2;
+
+// How many frames we watch the client for before deciding whether to change its buffer count,
+// and how heavily each new sample counts in our moving averages (as a power of two)
+static const unsigned kAdaptWindowFrames = 30;
+static const unsigned kAdaptAverageShift = 3;
+
+static_assert(MAX_BUFFERS_IN_FLIGHT + kZeroCopySpareBuffers <= 128,
+              "SlotSet can't track that many buffers");
+
+
+bool EvsV4lCamera::sZeroCopyEnabled = false;
+unsigned EvsV4lCamera::sConversionThreads = 1;
+bool EvsV4lCamera::sGpuConversionEnabled = false;
+bool EvsV4lCamera::sMjpegEnabled = false;
+uint32_t EvsV4lCamera::sOutputFormat = HAL_PIXEL_FORMAT_RGBA_8888;
+unsigned EvsV4lCamera::sRequestedWidth = 0;
+unsigned EvsV4lCamera::sRequestedHeight = 0;
+unsigned EvsV4lCamera::sAdaptiveBufferLimit = 0;
+std::map<std::string, std::string> EvsV4lCamera::sCaptureTaps;
+
+
+// The camera formats we can turn into the given output format, cheapest first.  Straight copies
+// come before swizzles, which come before real conversions.
+static std::vector<__u32> getSourceFormats(uint32_t outputFormat) {
+    switch (outputFormat) {
+    case HAL_PIXEL_FORMAT_YCRCB_420_SP: return { V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YUYV };
+    case HAL_PIXEL_FORMAT_YCBCR_422_I:  return { V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY };
+    case HAL_PIXEL_FORMAT_RGBA_8888:    return { V4L2_PIX_FMT_YUYV };
+    default:                            return {};
+    }
+}
+
+
+// The cheapest output format for a camera that can't produce the one we were asked for
+static uint32_t getNativeOutputFormat(__u32 v4lFormat) {
+    switch (v4lFormat) {
+    case V4L2_PIX_FMT_NV21:     return HAL_PIXEL_FORMAT_YCRCB_420_SP;
+    case V4L2_PIX_FMT_UYVY:     return HAL_PIXEL_FORMAT_YCBCR_422_I;
+    default:                    return HAL_PIXEL_FORMAT_RGBA_8888;
+    }
+}
+
+
+// Gralloc doesn't give us a portable way to get at the memory behind a buffer handle, but the
+// implementations we care about put the dmabuf backing single plane buffers in the first fd.
+static int getDmaBufFd(buffer_handle_t handle) {
+    if (handle == nullptr || handle->numFds < 1) {
+        return -1;
+    }
+    return handle->data[0];
+}
+
+
+// Since our output buffers stay mapped, we make the CPU caches coherent with the rest of the
+// system ourselves around each write.  Buffers we can't get a dmabuf for are assumed coherent.
+static void syncCpuWrite(buffer_handle_t handle, uint64_t flags) {
+    const int fd = getDmaBufFd(handle);
+    if (fd >= 0) {
+        dma_buf_sync sync = {};
+        sync.flags = flags | DMA_BUF_SYNC_WRITE;
+        ioctl(fd, DMA_BUF_IOCTL_SYNC, &sync);
+    }
+}
+
 
 EvsV4lCamera::EvsV4lCamera(const char *deviceName) :
         mFramesAllowed(0),
@@ -42,19 +122,70 @@ EvsV4lCamera::EvsV4lCamera(const char *deviceName) :
 
     mDescription.cameraId = deviceName;
 
+    // Output buffer format.  Zero copy only works if we hand out exactly what the camera captures.
+    const uint32_t requestedFormat = sZeroCopyEnabled ? HAL_PIXEL_FORMAT_YCBCR_422_I
+                                                      : sOutputFormat;
+
+    // Ask for the cheapest camera format that gives us what we want, but settle for anything
+    // we can convert into one of our output formats
+    std::vector<__u32> preferredFormats = getSourceFormats(requestedFormat);
+    std::vector<__u32> acceptableFormats = preferredFormats;
+    const bool mjpegPreferred = sMjpegEnabled && requestedFormat == HAL_PIXEL_FORMAT_RGBA_8888;
+    if (mjpegPreferred) {
+        // Worth the decode when we're told to, since the camera can then send more pixels
+        // than its link could carry uncompressed.  We only decode to RGBA.
+        preferredFormats.insert(preferredFormats.begin(), V4L2_PIX_FMT_MJPEG);
+        acceptableFormats.insert(acceptableFormats.begin(), V4L2_PIX_FMT_MJPEG);
+    }
+    for (auto&& fmt : { V4L2_PIX_FMT_NV21, V4L2_PIX_FMT_YUYV, V4L2_PIX_FMT_UYVY }) {
+        if (std::find(acceptableFormats.begin(), acceptableFormats.end(), fmt) ==
+            acceptableFormats.end()) {
+            acceptableFormats.push_back(fmt);
+        }
+    }
+    if (sMjpegEnabled && !mjpegPreferred) {
+        // Otherwise decoding costs more than any conversion, and we could only give out RGBA
+        // anyway, so it's the last resort
+        acceptableFormats.push_back(V4L2_PIX_FMT_MJPEG);
+    }
+
     // Initialize the video device
-    if (!mVideo.open(deviceName)) {
+    if (!mVideo.open(deviceName, acceptableFormats, sRequestedWidth, sRequestedHeight)) {
         ALOGE("Failed to open v4l device %s\n", deviceName);
     }
 
-    // Output buffer format.
-    // TODO: Does this need to be configurable?
-    mFormat = HAL_PIXEL_FORMAT_RGBA_8888;
+    const __u32 videoFormat = mVideo.getV4LFormat();
+    if (std::find(preferredFormats.begin(), preferredFormats.end(), videoFormat) !=
+        preferredFormats.end()) {
+        mFormat = requestedFormat;
+    } else {
+        mFormat = getNativeOutputFormat(videoFormat);
+        ALOGW("%s can't provide output format 0x%X, so using 0x%X instead",
+              deviceName, requestedFormat, mFormat);
+    }
+
+    // Let clients see which capture mode we settled on
+    mDescription.vendorFlags = videoFormat;
 
     // How we expect to use the gralloc buffers we'll exchange with our client
     mUsage  = GRALLOC_USAGE_HW_TEXTURE     |
               GRALLOC_USAGE_SW_READ_RARELY |
               GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+    // If we're allowed to, pass YUYV imagery through untouched so the camera can write it
+    // directly into the buffers our clients see
+    if (sZeroCopyEnabled && videoFormat == V4L2_PIX_FMT_YUYV) {
+        mUsage |= GRALLOC_USAGE_HW_CAMERA_WRITE;
+    }
+
+    // The GPU renders directly into our output buffers if we convert frames there
+    if (sGpuConversionEnabled && mFormat == HAL_PIXEL_FORMAT_RGBA_8888) {
+        mUsage |= GRALLOC_USAGE_HW_RENDER;
+    }
+
+    if (sConversionThreads > 1) {
+        mConversionPool = std::make_unique<ConversionPool>(sConversionThreads);
+    }
 }
 
 
@@ -82,19 +213,67 @@ void EvsV4lCamera::shutdown()
 
     // Drop all the graphics buffers we've been using
     if (mBuffers.size() > 0) {
-        GraphicBufferAllocator& alloc(GraphicBufferAllocator::get());
         for (auto&& rec : mBuffers) {
-            if (rec.inUse) {
+            if (rec.handle == nullptr) {
+                // Nothing to give back
+            } else if (rec.inUse) {
+                // Nobody else can have this one while the client may still be looking at it
                 ALOGW("Error - releasing buffer despite remote ownership");
+                GrallocPool::discard({ rec.handle, mStride, rec.pixels });
+            } else {
+                // Kept for a while in case the camera is opened again shortly
+                releaseOutputBuffer(rec);
             }
-            alloc.free(rec.handle);
             rec.handle = nullptr;
+            rec.pixels = nullptr;
         }
         mBuffers.clear();
+        mFreeSlots.clear();
+        mEmptySlots.clear();
     }
 }
 
 
+bool EvsV4lCamera::prime() {
+    ALOGD("prime");
+    std::vector<size_t> toMap;
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (!mVideo.isOpen()) {
+            ALOGE("Can't prime a camera that failed to open");
+            return false;
+        }
+        mStandby = true;
+
+        // Allocate the output buffers a stream would otherwise have to wait for
+        if (mFramesAllowed < 1 && !setAvailableFrames_Locked(1)) {
+            ALOGE("Failed to allocate the output buffers for standby");
+            return false;
+        }
+        for (size_t i = 0; i < mBuffers.size(); i++) {
+            if (mBuffers[i].handle != nullptr && mBuffers[i].pixels == nullptr) {
+                toMap.push_back(i);
+            }
+        }
+    }
+
+    // Map them too, unless the camera is going to write into them without our help
+    if (!(sZeroCopyEnabled && mVideo.getV4LFormat() == V4L2_PIX_FMT_YUYV)) {
+        for (auto&& idx : toMap) {
+            getMappedPixels(idx);
+        }
+    }
+
+    // Finally get the capture ring ready, so that starting a stream only turns the camera on
+    return mVideo.prime();
+}
+
+
+// Each output buffer a client holds shows as a span on this async track.  See
+// makeTraceCookie().
+static const char kBufferTrack[] = "EVS output buffer";
+
+
 // Methods from ::android::hardware::automotive::evs::V1_0::IEvsCamera follow.
 Return<void> EvsV4lCamera::getCameraInfo(getCameraInfo_cb _hidl_cb) {
     ALOGD("getCameraInfo");
@@ -175,6 +354,12 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const ::android::sp<IEvsCameraS
     case HAL_PIXEL_FORMAT_RGBA_8888:
         switch (videoSrcFormat) {
         case V4L2_PIX_FMT_YUYV:     mFillBufferFromVideo = fillRGBAFromYUYV;    break;
+        case V4L2_PIX_FMT_MJPEG:
+            // Not a fill function, since a compressed frame can't be split into bands
+            if (!mMjpegDecoder) {
+                mMjpegDecoder = std::make_unique<MjpegDecoder>();
+            }
+            break;
         default:
             ALOGE("Unhandled camera format %4.4s", (char*)&videoSrcFormat);
         }
@@ -191,25 +376,68 @@ Return<EvsResult> EvsV4lCamera::startVideoStream(const ::android::sp<IEvsCameraS
         ALOGE("Unhandled output format %4.4s", (char*)&mFormat);
     }
 
+    // If the camera produces exactly what we hand out, let it capture directly into our output
+    // buffers rather than copying every frame.  We fall back to copying if that can't be set up.
+    if (sZeroCopyEnabled && mFillBufferFromVideo == fillYUYVFromYUYV) {
+        mZeroCopy = startZeroCopy_Locked();
+    }
+
+    // The GPU can do the RGBA conversion for us if the camera will share its buffers
+    if (sGpuConversionEnabled && mFillBufferFromVideo == fillRGBAFromYUYV) {
+        mGpuConverter = std::make_unique<GlYuvConverter>();
+        mGpuConversionFailed = false;
+    }
+
+    // The last stream's frame timing and drops say nothing about this one's
+    mFramesSeen = 0;
+    mFramesSkipped = 0;
+    mLastCaptureTimeNs = 0;
+
+    // Each stream on a tapped camera replaces the recording of the last one
+    auto tap = sCaptureTaps.find(mDescription.cameraId);
+    if (tap != sCaptureTaps.end()) {
+        mCaptureWriter = std::make_unique<CaptureWriter>();
+        if (!mCaptureWriter->open(tap->second, videoSrcFormat, mVideo.getWidth(),
+                                  mVideo.getHeight(), mVideo.getStride())) {
+            mCaptureWriter = nullptr;
+        }
+    }
 
     // Record the user's callback for use when we have a frame ready
     mStream = stream;
 
-    // Set up the video stream with a callback to our member function forwardFrame()
+    // Set up the video stream with a callback to our member function forwardFrame().  The GPU
+    // converter's context belongs to the capture thread, so it is destroyed there as the thread
+    // finishes, rather than later on whichever binder thread stops the stream.
     if (!mVideo.startStream([this](VideoCapture*, imageBuffer* tgt, void* data) {
                                 this->forwardFrame(tgt, data);
+                            },
+                            [this]() {
+                                std::lock_guard<std::mutex> lock(mAccessLock);
+                                mGpuConverter = nullptr;
                             })
     ) {
         mStream = nullptr;  // No need to hold onto this if we failed to start
+        if (mZeroCopy) {
+            stopZeroCopy_Locked();
+        }
+        mGpuConverter = nullptr;
+        mCaptureWriter = nullptr;
         ALOGE("underlying camera start stream failed");
         return EvsResult::UNDERLYING_SERVICE_ERROR;
     }
 
+    // Compressed frames have nothing for derived views to sample (see forwardRawFrame)
+    if (mVideo.getV4LFormat() != V4L2_PIX_FMT_MJPEG) {
+        EvsDerivedCamera::setSourceStreaming(mDescription.cameraId, true);
+    }
+
     return EvsResult::OK;
 }
 
 
 Return<void> EvsV4lCamera::doneWithFrame(const BufferDesc& buffer)  {
+    ATRACE_CALL();
     ALOGD("doneWithFrame");
     std::lock_guard <std::mutex> lock(mAccessLock);
 
@@ -229,18 +457,32 @@ Return<void> EvsV4lCamera::doneWithFrame(const BufferDesc& buffer)  {
             // Mark the frame as available
             mBuffers[buffer.bufferId].inUse = false;
             mFramesInUse--;
+            const int64_t holdTimeNs = systemTime(SYSTEM_TIME_MONOTONIC) -
+                                       mBuffers[buffer.bufferId].captureTimeNs;
+            mHoldTimeNs += (holdTimeNs - mHoldTimeNs) >> kAdaptAverageShift;
+            ATRACE_ASYNC_END(kBufferTrack, makeTraceCookie(mTraceOwner, buffer.bufferId));
 
             // If this frame's index is high in the array, try to move it down
             // to improve locality after mFramesAllowed has been reduced.
-            if (buffer.bufferId >= mFramesAllowed) {
-                // Find an empty slot lower in the array (which should always exist in this case)
-                for (auto&& rec : mBuffers) {
-                    if (rec.handle == nullptr) {
-                        rec.handle = mBuffers[buffer.bufferId].handle;
-                        mBuffers[buffer.bufferId].handle = nullptr;
-                        break;
-                    }
-                }
+            // Note that buffer indices are tied to the capture ring in zero copy mode, so we
+            // can't move them around then.
+            const int emptySlot = mEmptySlots.first();
+            if (!mZeroCopy && buffer.bufferId >= mFramesAllowed &&
+                emptySlot >= 0 && (unsigned)emptySlot < buffer.bufferId) {
+                mBuffers[emptySlot].handle = mBuffers[buffer.bufferId].handle;
+                mBuffers[emptySlot].pixels = mBuffers[buffer.bufferId].pixels;
+                mBuffers[buffer.bufferId].handle = nullptr;
+                mBuffers[buffer.bufferId].pixels = nullptr;
+                mEmptySlots.erase(emptySlot);
+                mEmptySlots.insert(buffer.bufferId);
+                mFreeSlots.insert(emptySlot);
+            } else {
+                mFreeSlots.insert(buffer.bufferId);
+            }
+
+            if (mZeroCopy) {
+                // The camera may capture into this buffer again
+                mVideo.markFrameConsumed(buffer.bufferId);
             }
         }
     }
@@ -254,6 +496,23 @@ Return<void> EvsV4lCamera::stopVideoStream()  {
 
     // Tell the capture device to stop (and block until it does)
     mVideo.stopStream();
+    EvsDerivedCamera::setSourceStreaming(mDescription.cameraId, false);
+
+    // The capture thread is gone, so we may hand back the buffers the camera was writing into
+    if (mZeroCopy) {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        stopZeroCopy_Locked();
+    }
+
+    // Likewise, nobody is adding to our recording any more.  (The capture thread took the GPU
+    // converter with it.)
+    mCaptureWriter = nullptr;
+
+    // Cameras in standby go straight back to being ready for the next stream.  This is only
+    // needed after zero copy streams, since otherwise the capture buffers were kept anyway.
+    if (mStandby && mVideo.isOpen() && !mVideo.isPrimed()) {
+        mVideo.prime();
+    }
 
     if (mStream != nullptr) {
         std::unique_lock <std::mutex> lock(mAccessLock);
@@ -297,6 +556,11 @@ Return<EvsResult> EvsV4lCamera::setExtendedInfo(uint32_t /*opaqueIdentifier*/,
 
 
 bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
+    if (mZeroCopy) {
+        // The camera owns the buffer pool until the stream stops
+        ALOGE("Can't change the buffer count while capturing directly into our buffers");
+        return false;
+    }
     if (bufferCount < 1) {
         ALOGE("Ignoring request to set buffer count to zero");
         return false;
@@ -305,6 +569,7 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
         ALOGE("Rejecting buffer request in excess of internal limit");
         return false;
     }
+    mFramesRequested = bufferCount;
 
     // Is an increase required?
     if (mFramesAllowed < bufferCount) {
@@ -338,56 +603,18 @@ bool EvsV4lCamera::setAvailableFrames_Locked(unsigned bufferCount) {
 
 
 unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
     unsigned added = 0;
 
 
     while (added < numToAdd) {
-        unsigned pixelsPerLine;
-        buffer_handle_t memHandle = nullptr;
-        status_t result = alloc.allocate(mVideo.getWidth(), mVideo.getHeight(),
-                                         mFormat, 1,
-                                         mUsage,
-                                         &memHandle, &pixelsPerLine, 0, "EvsV4lCamera");
-        if (result != NO_ERROR) {
-            ALOGE("Error %d allocating %d x %d graphics buffer",
-                  result,
-                  mVideo.getWidth(),
-                  mVideo.getHeight());
+        // Buffers this camera gave back recently come first, since they're already allocated
+        // and likely mapped
+        GrallocPool::Buffer buffer;
+        if (!GrallocPool::acquire(mDescription.cameraId, mVideo.getWidth(), mVideo.getHeight(),
+                                  mFormat, mUsage, "EvsV4lCamera", &buffer)) {
             break;
         }
-        if (!memHandle) {
-            ALOGE("We didn't get a buffer handle back from the allocator");
-            break;
-        }
-        if (mStride) {
-            if (mStride != pixelsPerLine) {
-                ALOGE("We did not expect to get buffers with different strides!");
-            }
-        } else {
-            // Gralloc defines stride in terms of pixels per line
-            mStride = pixelsPerLine;
-        }
-
-        // Find a place to store the new buffer
-        bool stored = false;
-        for (auto&& rec : mBuffers) {
-            if (rec.handle == nullptr) {
-                // Use this existing entry
-                rec.handle = memHandle;
-                rec.inUse = false;
-                stored = true;
-                break;
-            }
-        }
-        if (!stored) {
-            // Add a BufferRecord wrapping this handle to our set of available buffers
-            mBuffers.emplace_back(memHandle);
-        }
-
-        mFramesAllowed++;
+        addOutputBuffer_Locked(buffer.handle, buffer.stride, buffer.pixels);
         added++;
     }
 
@@ -396,35 +623,230 @@ unsigned EvsV4lCamera::increaseAvailableFrames_Locked(unsigned numToAdd) {
 
 
 unsigned EvsV4lCamera::decreaseAvailableFrames_Locked(unsigned numToRemove) {
-    // Acquire the graphics buffer allocator
-    GraphicBufferAllocator &alloc(GraphicBufferAllocator::get());
-
     unsigned removed = 0;
 
-    for (auto&& rec : mBuffers) {
-        // Is this record not in use, but holding a buffer that we can free?
-        if ((rec.inUse == false) && (rec.handle != nullptr)) {
-            // Release buffer and update the record so we can recognize it as "empty"
-            alloc.free(rec.handle);
-            rec.handle = nullptr;
+    BufferRecord rec(nullptr);
+    while (removed < numToRemove && takeFreeBuffer_Locked(&rec)) {
+        releaseOutputBuffer(rec);
+        removed++;
+    }
+
+    return removed;
+}
+
+
+// Adds a buffer we have acquired to the ones we hand out
+void EvsV4lCamera::addOutputBuffer_Locked(buffer_handle_t memHandle, uint32_t stride,
+                                          void* pixels) {
+    if (mStride) {
+        if (mStride != stride) {
+            ALOGE("We did not expect to get buffers with different strides!");
+        }
+    } else {
+        // Gralloc defines stride in terms of pixels per line
+        mStride = stride;
+    }
+
+    // Find a place to store the new buffer
+    int slot = mEmptySlots.first();
+    if (slot >= 0) {
+        // Use this existing entry
+        mBuffers[slot].handle = memHandle;
+        mBuffers[slot].inUse = false;
+        mBuffers[slot].pixels = pixels;
+        mEmptySlots.erase(slot);
+    } else {
+        // Add a BufferRecord wrapping this handle to our set of available buffers
+        slot = mBuffers.size();
+        mBuffers.emplace_back(memHandle);
+        mBuffers[slot].pixels = pixels;
+    }
+    mFreeSlots.insert(slot);
+
+    mFramesAllowed++;
+}
+
+
+// Takes a buffer nobody is using out of the ones we hand out, for the caller to release
+bool EvsV4lCamera::takeFreeBuffer_Locked(BufferRecord* taken) {
+    // Find a record that is not in use, but holding a buffer that we can free
+    const int slot = mFreeSlots.first();
+    if (slot < 0) {
+        return false;
+    }
+    BufferRecord& rec = mBuffers[slot];
+    *taken = rec;
+
+    // Update the record so we can recognize it as "empty"
+    if (mGpuConverter) {
+        mGpuConverter->forgetTarget(rec.handle);
+    }
+    rec.handle = nullptr;
+    rec.pixels = nullptr;
+    mFreeSlots.erase(slot);
+    mEmptySlots.insert(slot);
+
+    mFramesAllowed--;
+    return true;
+}
+
 
-            mFramesAllowed--;
-            removed++;
+// Clients can only guess how many buffers they need.  Too few and we drop frames, too many and
+// graphics memory sits idle.  So when the client keeps us short we add a buffer, and when it
+// returns frames well within the time it has we take back one it didn't ask for.  This decides
+// which, if either, and returns +1 or -1 for adaptBufferCount() to carry out.
+int EvsV4lCamera::adaptBufferCount_Locked() {
+    // The capture ring is our buffer pool in zero copy mode, so we can't touch it then
+    if (mZeroCopy || mFramesSeen < kAdaptWindowFrames) {
+        return 0;
+    }
+
+    int change = 0;
+    if (mFramesSkipped > 0) {
+        if (mFramesAllowed < std::min(mAdaptiveLimit, MAX_BUFFERS_IN_FLIGHT)) {
+            ALOGI("%s dropped %u of %u frames, so it gets another buffer",
+                  mDescription.cameraId.c_str(), mFramesSkipped, mFramesSeen);
+            change = 1;
+        }
+    } else if (mFramesAllowed > mFramesRequested && mFrameIntervalNs > 0) {
+        // Each buffer covers a frame interval of hold time, and we keep one spare so the next
+        // frame has somewhere to go
+        const unsigned needed = mHoldTimeNs / mFrameIntervalNs + 2;
+        if (needed < mFramesAllowed) {
+            ALOGI("%s holds frames for %" PRId64 " us, so it gives a buffer back",
+                  mDescription.cameraId.c_str(), nanoseconds_to_microseconds(mHoldTimeNs));
+            change = -1;
+        }
+    }
+
+    mFramesSeen = 0;
+    mFramesSkipped = 0;
+    return change;
+}
 
-            if (removed == numToRemove) {
-                break;
+
+// Carries out what adaptBufferCount_Locked() decided, from the capture thread.  Allocating and
+// freeing happen outside mAccessLock, since clients giving frames back would wait on it.
+void EvsV4lCamera::adaptBufferCount(int change) {
+    if (change > 0) {
+        GrallocPool::Buffer buffer;
+        if (!GrallocPool::acquire(mDescription.cameraId, mVideo.getWidth(), mVideo.getHeight(),
+                                  mFormat, mUsage, "EvsV4lCamera", &buffer)) {
+            return;
+        }
+
+        // The client may have asked for buffers of its own in the meantime
+        std::unique_lock<std::mutex> lock(mAccessLock);
+        if (mFramesAllowed >= std::min(mAdaptiveLimit, MAX_BUFFERS_IN_FLIGHT)) {
+            lock.unlock();
+            GrallocPool::release(mDescription.cameraId, mVideo.getWidth(), mVideo.getHeight(),
+                                 mFormat, mUsage, buffer);
+            return;
+        }
+        addOutputBuffer_Locked(buffer.handle, buffer.stride, buffer.pixels);
+        ALOGI("%s now has %u buffers", mDescription.cameraId.c_str(), mFramesAllowed);
+    } else if (change < 0) {
+        BufferRecord rec(nullptr);
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            if (mFramesAllowed <= mFramesRequested || !takeFreeBuffer_Locked(&rec)) {
+                return;
             }
+            ALOGI("%s now has %u buffers", mDescription.cameraId.c_str(), mFramesAllowed);
         }
+        releaseOutputBuffer(rec);
     }
+}
 
-    return removed;
+
+// Hands a free buffer, along with our CPU mapping of it, back to the pool for the next stream
+void EvsV4lCamera::releaseOutputBuffer(const BufferRecord& rec) {
+    GrallocPool::release(mDescription.cameraId, mVideo.getWidth(), mVideo.getHeight(),
+                         mFormat, mUsage, { rec.handle, mStride, rec.pixels });
+}
+
+
+bool EvsV4lCamera::startZeroCopy_Locked() {
+    // The camera's rows have to land exactly where gralloc expects them (2 bytes per pixel)
+    if (mStride * 2 != mVideo.getStride()) {
+        ALOGW("Camera stride %u doesn't match output stride %u, so we'll copy frames",
+              mVideo.getStride(), mStride * 2);
+        return false;
+    }
+
+    // Add our spare buffers so the camera always has one to fill
+    unsigned added = increaseAvailableFrames_Locked(kZeroCopySpareBuffers);
+    if (added != kZeroCopySpareBuffers) {
+        ALOGW("Couldn't allocate spare buffers for zero copy capture");
+        decreaseAvailableFrames_Locked(added);
+        return false;
+    }
+
+    // Every one of our buffers becomes a slot in the capture ring with a matching index
+    std::vector<int> dmaBufFds;
+    dmaBufFds.reserve(mBuffers.size());
+    for (auto&& rec : mBuffers) {
+        int fd = getDmaBufFd(rec.handle);
+        if (rec.inUse || fd < 0) {
+            ALOGW("Buffer pool isn't suitable for zero copy capture, so we'll copy frames");
+            decreaseAvailableFrames_Locked(kZeroCopySpareBuffers);
+            return false;
+        }
+        dmaBufFds.push_back(fd);
+    }
+
+    if (!mVideo.setExternalBuffers(dmaBufFds)) {
+        decreaseAvailableFrames_Locked(kZeroCopySpareBuffers);
+        return false;
+    }
+
+    ALOGI("Capturing directly into %zu output buffers", dmaBufFds.size());
+    return true;
+}
+
+
+void EvsV4lCamera::stopZeroCopy_Locked() {
+    // Go back to capturing into our own buffers, and drop the spares we added
+    mVideo.setExternalBuffers({});
+    mZeroCopy = false;
+    decreaseAvailableFrames_Locked(kZeroCopySpareBuffers);
 }
 
 
 // This is the async callback from the video camera that tells us a frame is ready
-void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
+void EvsV4lCamera::forwardFrame(imageBuffer* pV4lBuff, void* pData) {
+    ATRACE_CALL();
+    if (mZeroCopy) {
+        // The image is already in the buffer we're going to hand out
+        forwardZeroCopyFrame(pV4lBuff);
+        return;
+    }
+
     bool readyForFrame = false;
     size_t idx = 0;
+    const int64_t captureTimeNs = mVideo.getCaptureTimeNs(pV4lBuff->index);
+
+    // See if the client needs more or fewer buffers than it has.  This comes before the frame is
+    // given a buffer, so a frame that would have been dropped gets the new one.
+    if (mAdaptiveLimit > 0) {
+        int change = 0;
+        {
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            if (mLastCaptureTimeNs > 0) {
+                mFrameIntervalNs += ((captureTimeNs - mLastCaptureTimeNs) - mFrameIntervalNs) >>
+                                    kAdaptAverageShift;
+            }
+            mLastCaptureTimeNs = captureTimeNs;
+            mFramesSeen++;
+            if (mFramesInUse >= mFramesAllowed) {
+                mFramesSkipped++;
+            }
+            change = adaptBufferCount_Locked();
+        }
+        if (change != 0) {
+            adaptBufferCount(change);
+        }
+    }
 
     // Lock scope for updating shared state
     {
@@ -436,20 +858,16 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
             ALOGW("Skipped a frame because too many are in flight\n");
         } else {
             // Identify an available buffer to fill
-            for (idx = 0; idx < mBuffers.size(); idx++) {
-                if (!mBuffers[idx].inUse) {
-                    if (mBuffers[idx].handle != nullptr) {
-                        // Found an available record, so stop looking
-                        break;
-                    }
-                }
-            }
-            if (idx >= mBuffers.size()) {
+            const int slot = mFreeSlots.first();
+            if (slot < 0) {
                 // This shouldn't happen since we already checked mFramesInUse vs mFramesAllowed
                 ALOGE("Failed to find an available buffer slot\n");
             } else {
                 // We're going to make the frame busy
+                idx = slot;
+                mFreeSlots.erase(idx);
                 mBuffers[idx].inUse = true;
+                mBuffers[idx].captureTimeNs = captureTimeNs;
                 mFramesInUse++;
                 readyForFrame = true;
             }
@@ -457,8 +875,11 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
     }
 
     if (!readyForFrame) {
+        // Our own client is behind, but any derived streams or recording may still want this frame
+        forwardRawFrame(pV4lBuff, pData);
+
         // We need to return the vide buffer so it can capture a new frame
-        mVideo.markFrameConsumed();
+        mVideo.markFrameConsumed(pV4lBuff->index);
     } else {
         // Assemble the buffer description we'll transmit below
         BufferDesc buff = {};
@@ -470,36 +891,80 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
         buff.bufferId   = idx;
         buff.memHandle  = mBuffers[idx].handle;
 
-        // Lock our output buffer for writing
-        void *targetPixels = nullptr;
-        GraphicBufferMapper &mapper = GraphicBufferMapper::get();
-        mapper.lock(buff.memHandle,
-                    GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
-                    android::Rect(buff.width, buff.height),
-                    (void **) &targetPixels);
-
-        // If we failed to lock the pixel buffer, we're about to crash, but log it first
-        if (!targetPixels) {
-            ALOGE("Camera failed to gain access to image buffer for writing");
+        // Let the GPU do the conversion if we can
+        ATRACE_BEGIN("convert");
+        bool converted = false;
+        bool decoded = true;    // Only MJPEG frames can turn out to be unusable
+        if (mGpuConverter && !mGpuConversionFailed) {
+            const int srcFd = mVideo.exportBuffer(pV4lBuff->index);
+            converted = (srcFd >= 0) &&
+                        mGpuConverter->convert(srcFd, pV4lBuff->index, mVideo.getStride(), buff);
+            if (!converted) {
+                // Don't keep trying since the CPU path works everywhere
+                ALOGW("GPU conversion failed, so converting on the CPU from now on");
+                mGpuConversionFailed = true;
+            }
         }
 
-        // Transfer the video image into the output buffer, making any needed
-        // format conversion along the way
-        mFillBufferFromVideo(buff, (uint8_t*)targetPixels, pData, mVideo.getStride());
+        if (!converted) {
+            // Get at our output buffer for writing
+            void *targetPixels = getMappedPixels(idx);
+
+            // If we failed to lock the pixel buffer, we're about to crash, but log it first
+            if (!targetPixels) {
+                ALOGE("Camera failed to gain access to image buffer for writing");
+            }
+            syncCpuWrite(mBuffers[idx].handle, DMA_BUF_SYNC_START);
+
+            // Transfer the video image into the output buffer, making any needed
+            // format conversion along the way
+            if (mMjpegDecoder) {
+                decoded = mMjpegDecoder->decode(buff, (uint8_t*)targetPixels, pData,
+                                                pV4lBuff->bytesused);
+            } else if (mConversionPool) {
+                const unsigned stride = mVideo.getStride();
+                mConversionPool->convert([&](unsigned firstRow, unsigned numRows) {
+                                             mFillBufferFromVideo(buff, (uint8_t*)targetPixels,
+                                                                  pData, stride,
+                                                                  firstRow, numRows);
+                                         }, buff.height);
+            } else {
+                mFillBufferFromVideo(buff, (uint8_t*)targetPixels, pData, mVideo.getStride(),
+                                     0, buff.height);
+            }
 
-        // Unlock the output buffer
-        mapper.unlock(buff.memHandle);
+            // Make sure our writes are visible to whoever reads the buffer next
+            syncCpuWrite(mBuffers[idx].handle, DMA_BUF_SYNC_END);
+        }
+        ATRACE_END();
 
+        // Fill any derived streams and recording from the capture buffer while it is still ours
+        forwardRawFrame(pV4lBuff, pData);
 
         // Give the video frame back to the underlying device for reuse
         // Note that we do this before making the client callback to give the underlying
         // camera more time to capture the next frame.
-        mVideo.markFrameConsumed();
+        mVideo.markFrameConsumed(pV4lBuff->index);
+
+        if (!decoded) {
+            // A damaged frame is better dropped than shown, so the buffer goes straight back
+            std::lock_guard<std::mutex> lock(mAccessLock);
+            mBuffers[idx].inUse = false;
+            mFreeSlots.insert(idx);
+            mFramesInUse--;
+            return;
+        }
 
         // Issue the (asynchronous) callback to the client -- can't be holding the lock
+        ATRACE_ASYNC_BEGIN(kBufferTrack, makeTraceCookie(mTraceOwner, buff.bufferId));
+        ATRACE_BEGIN("deliverFrame");
         auto result = mStream->deliverFrame(buff);
+        ATRACE_END();
         if (result.isOk()) {
-            ALOGD("Delivered %p as id %d", buff.memHandle.getNativeHandle(), buff.bufferId);
+            ALOGD("Delivered %p as id %d, %" PRId64 " us after capture",
+                  buff.memHandle.getNativeHandle(), buff.bufferId,
+                  nanoseconds_to_microseconds(systemTime(SYSTEM_TIME_MONOTONIC) -
+                                              mBuffers[idx].captureTimeNs));
         } else {
             // This can happen if the client dies and is likely unrecoverable.
             // To avoid consuming resources generating failing calls, we stop sending
@@ -508,13 +973,113 @@ void EvsV4lCamera::forwardFrame(imageBuffer* /*pV4lBuff*/, void* pData) {
             ALOGE("Frame delivery call failed in the transport layer.");
 
             // Since we didn't actually deliver it, mark the frame as available
+            ATRACE_ASYNC_END(kBufferTrack, makeTraceCookie(mTraceOwner, buff.bufferId));
             std::lock_guard<std::mutex> lock(mAccessLock);
             mBuffers[idx].inUse = false;
+            mFreeSlots.insert(idx);
             mFramesInUse--;
         }
     }
 }
 
+
+// Derived views of this camera (see EvsDerivedCamera) are sampled straight from its capture
+// buffers, so they don't have to wait for or reconvert our full size output.  Recordings are
+// taken from there too, so that replaying them goes through the same conversions we do.
+void EvsV4lCamera::forwardRawFrame(imageBuffer* pV4lBuff, void* pData) {
+    if (mCaptureWriter) {
+        // Compressed frames vary in size, so only the driver knows how much of the buffer counts
+        mCaptureWriter->writeFrame(pData,
+                                   pV4lBuff->bytesused ? pV4lBuff->bytesused
+                                                       : mVideo.getImageSize(),
+                                   mVideo.getCaptureTimeNs(pV4lBuff->index));
+    }
+
+    if (mVideo.getV4LFormat() == V4L2_PIX_FMT_MJPEG) {
+        // There are no pixels to sample until a frame is decoded
+        return;
+    }
+    EvsDerivedCamera::forwardSourceFrame(mDescription.cameraId, pData, mVideo.getV4LFormat(),
+                                         mVideo.getWidth(), mVideo.getHeight(),
+                                         mVideo.getStride(),
+                                         mVideo.getCaptureTimeNs(pV4lBuff->index));
+}
+
+
+// Our output buffers are mapped the first time we fill them on the CPU and stay mapped until
+// they're freed, which saves a lock/unlock on every frame.  Buffers we never touch on the CPU
+// (zero copy and GPU conversion) are never mapped.
+void* EvsV4lCamera::getMappedPixels(size_t idx) {
+    // The record is ours (inUse) but the main thread may be reading others, so don't race it
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        if (mBuffers[idx].pixels != nullptr) {
+            return mBuffers[idx].pixels;
+        }
+    }
+
+    void *pixels = nullptr;
+    GraphicBufferMapper &mapper = GraphicBufferMapper::get();
+    mapper.lock(mBuffers[idx].handle,
+                GRALLOC_USAGE_SW_WRITE_OFTEN | GRALLOC_USAGE_SW_READ_NEVER,
+                android::Rect(mVideo.getWidth(), mVideo.getHeight()),
+                (void **) &pixels);
+
+    std::lock_guard<std::mutex> lock(mAccessLock);
+    mBuffers[idx].pixels = pixels;
+    return pixels;
+}
+
+
+// In zero copy mode, the capture buffer index is also our output buffer index
+void EvsV4lCamera::forwardZeroCopyFrame(imageBuffer* pV4lBuff) {
+    ATRACE_CALL();
+    const unsigned idx = pV4lBuff->index;
+
+    // Lock scope for updating shared state
+    {
+        std::lock_guard<std::mutex> lock(mAccessLock);
+
+        // The camera can only have filled a buffer that none of our clients hold
+        mBuffers[idx].inUse = true;
+        mFreeSlots.erase(idx);
+        mBuffers[idx].captureTimeNs = mVideo.getCaptureTimeNs(idx);
+        mFramesInUse++;
+    }
+
+    // Assemble the buffer description we'll transmit below
+    BufferDesc buff = {};
+    buff.width      = mVideo.getWidth();
+    buff.height     = mVideo.getHeight();
+    buff.stride     = mStride;
+    buff.format     = mFormat;
+    buff.usage      = mUsage;
+    buff.bufferId   = idx;
+    buff.memHandle  = mBuffers[idx].handle;
+
+    // Issue the (asynchronous) callback to the client -- can't be holding the lock
+    ATRACE_ASYNC_BEGIN(kBufferTrack, makeTraceCookie(mTraceOwner, buff.bufferId));
+    ATRACE_BEGIN("deliverFrame");
+    auto result = mStream->deliverFrame(buff);
+    ATRACE_END();
+    if (result.isOk()) {
+        ALOGD("Delivered %p as id %d, %" PRId64 " us after capture",
+              buff.memHandle.getNativeHandle(), buff.bufferId,
+              nanoseconds_to_microseconds(systemTime(SYSTEM_TIME_MONOTONIC) -
+                                          mBuffers[idx].captureTimeNs));
+    } else {
+        ALOGE("Frame delivery call failed in the transport layer.");
+
+        // Since we didn't actually deliver it, give the buffer straight back to the camera
+        ATRACE_ASYNC_END(kBufferTrack, makeTraceCookie(mTraceOwner, buff.bufferId));
+        std::lock_guard<std::mutex> lock(mAccessLock);
+        mBuffers[idx].inUse = false;
+        mFreeSlots.insert(idx);
+        mFramesInUse--;
+        mVideo.markFrameConsumed(idx);
+    }
+}
+
 } // namespace implementation
 } // namespace V1_0
 } // namespace evs
@@ -21,9 +21,19 @@
 #include <android/hardware/automotive/evs/1.0/IEvsCamera.h>
 #include <ui/GraphicBuffer.h>
 
+#include <atomic>
 #include <thread>
 #include <functional>
-
+#include <map>
+#include <memory>
+#include <string>
+
+#include "CaptureFile.h"
+#include "ConversionPool.h"
+#include "GlYuvConverter.h"
+#include "bufferCopy.h"
+#include "MjpegDecoder.h"
+#include "TraceCookie.h"
 #include "VideoCapture.h"
 
 
@@ -57,13 +67,58 @@ public:
 
     const CameraDesc& getDesc() { return mDescription; };
 
+    // Allocates and maps everything a stream needs ahead of time, and keeps it between streams,
+    // so that startVideoStream() only has to turn the camera on.  For cameras held in standby.
+    bool prime();
+
+    // When enabled, cameras whose native format can be handed to clients unchanged capture
+    // directly into the output buffers instead of having each frame copied.
+    static void enableZeroCopy(bool enable) { sZeroCopyEnabled = enable; };
+
+    // Sets how many threads share the conversion of each frame in cameras opened afterwards
+    static void setConversionThreads(unsigned numThreads) { sConversionThreads = numThreads; };
+
+    // When enabled, YUYV cameras feeding RGBA streams have their frames converted on the GPU
+    static void enableGpuConversion(bool enable) { sGpuConversionEnabled = enable; };
+
+    // When enabled, cameras opened afterwards capture MJPEG if they offer it, and decode it
+    // into RGBA output buffers.  USB cameras often only reach full frame rate this way.
+    static void enableMjpeg(bool enable) { sMjpegEnabled = enable; };
+
+    // Sets the output format (android_pixel_format_t) and frame size cameras opened afterwards
+    // will try for.  A zero width or height keeps each camera's default frame size.
+    static void setOutputFormat(uint32_t format) { sOutputFormat = format; };
+    static void setRequestedResolution(unsigned width, unsigned height) {
+        sRequestedWidth = width;
+        sRequestedHeight = height;
+    };
+
+    // When non-zero, cameras opened afterwards add buffers beyond what their client asked for
+    // while it is dropping frames, up to this many in all, and give them back once its frames
+    // come back quickly again.  See adaptBufferCount_Locked().
+    static void setAdaptiveBufferLimit(unsigned maxFrames) { sAdaptiveBufferLimit = maxFrames; };
+
+    // Records every frame the camera captures, before any conversion, to a capture file each
+    // time it streams (see CaptureFile.h).  Used to make recordings for EvsReplayCamera.
+    static void addCaptureTap(const char* cameraId, const char* path) {
+        sCaptureTaps[cameraId] = path;
+    };
+
 private:
-    // These three functions are expected to be called while mAccessLock is held
+    // These functions are expected to be called while mAccessLock is held
     bool setAvailableFrames_Locked(unsigned bufferCount);
     unsigned increaseAvailableFrames_Locked(unsigned numToAdd);
     unsigned decreaseAvailableFrames_Locked(unsigned numToRemove);
+    void addOutputBuffer_Locked(buffer_handle_t memHandle, uint32_t stride, void* pixels);
+    int adaptBufferCount_Locked();
+    bool startZeroCopy_Locked();
+    void stopZeroCopy_Locked();
 
+    void adaptBufferCount(int change);
     void forwardFrame(imageBuffer* tgt, void* data);
+    void forwardZeroCopyFrame(imageBuffer* tgt);
+    void forwardRawFrame(imageBuffer* tgt, void* data);
+    void* getMappedPixels(size_t idx);
 
     sp <IEvsCameraStream> mStream = nullptr;  // The callback used to deliver each frame
 
@@ -77,21 +132,86 @@ private:
     struct BufferRecord {
         buffer_handle_t handle;
         bool inUse;
+        void* pixels;   // Our CPU mapping of the buffer, made the first time we fill it
+        int64_t captureTimeNs;  // When the frame it holds was captured (CLOCK_MONOTONIC)
 
-        explicit BufferRecord(buffer_handle_t h) : handle(h), inUse(false) {};
+        explicit BufferRecord(buffer_handle_t h) :
+                handle(h), inUse(false), pixels(nullptr), captureTimeNs(0) {};
+    };
+
+    // Takes a free buffer out of the ones we hand out (with mAccessLock held), and gives it back
+    // to the GrallocPool for the next stream on this camera
+    bool takeFreeBuffer_Locked(BufferRecord* taken);
+    void releaseOutputBuffer(const BufferRecord& rec);
+
+    // A set of indices into mBuffers with constant time insert, erase and lowest-member lookup
+    class SlotSet {
+    public:
+        static const unsigned kMaxSlots = 128;
+
+        void insert(unsigned slot)  { mBits[slot / 64] |=  (1ull << (slot % 64)); };
+        void erase(unsigned slot)   { mBits[slot / 64] &= ~(1ull << (slot % 64)); };
+        void clear()                { mBits[0] = mBits[1] = 0; };
+
+        // Returns the lowest slot in the set, or -1 if it is empty
+        int first() const {
+            if (mBits[0]) return __builtin_ctzll(mBits[0]);
+            if (mBits[1]) return 64 + __builtin_ctzll(mBits[1]);
+            return -1;
+        };
+
+    private:
+        uint64_t mBits[kMaxSlots / 64] = {};
     };
 
     std::vector <BufferRecord> mBuffers;    // Graphics buffers to transfer images
+    SlotSet mFreeSlots;                     // Records holding a buffer that isn't in use
+    SlotSet mEmptySlots;                    // Records that don't hold a buffer
     unsigned mFramesAllowed;                // How many buffers are we currently using
     unsigned mFramesInUse;                  // How many buffers are currently outstanding
+    unsigned mFramesRequested = 0;          // What the client asked for, the least we'll use
+    bool mZeroCopy = false;                 // Is the camera capturing straight into mBuffers?
+    bool mStandby = false;                  // Have we been asked to stay primed?  See prime()
+    const unsigned mTraceOwner =            // Tells our trace spans apart from other cameras'
+            ::android::automotive::evs::support::nextTraceOwner();
+
+    // What adaptBufferCount_Locked() has to go on, kept under mAccessLock
+    const unsigned mAdaptiveLimit = sAdaptiveBufferLimit;
+    unsigned mFramesSeen = 0;               // Frames captured in the current window
+    unsigned mFramesSkipped = 0;            // And how many of them we had no buffer for
+    int64_t mLastCaptureTimeNs = 0;
+    int64_t mFrameIntervalNs = 0;           // Moving averages
+    int64_t mHoldTimeNs = 0;
 
     // Which format specific function we need to use to move camera imagery into our output buffers
-    void(*mFillBufferFromVideo)(const BufferDesc& tgtBuff, uint8_t* tgt,
-                                void* imgData, unsigned imgStride);
+    FillFunction mFillBufferFromVideo = nullptr;
+
+    // Spreads the work of mFillBufferFromVideo across threads, if we've been asked to
+    std::unique_ptr<::android::automotive::evs::support::ConversionPool> mConversionPool;
+
+    // Converts frames on the GPU instead, when that's enabled and applicable to this stream
+    std::unique_ptr<GlYuvConverter> mGpuConverter;
+    bool mGpuConversionFailed = false;      // Only touched by the capture thread
+
+    // Decodes frames instead of mFillBufferFromVideo when we capture MJPEG
+    std::unique_ptr<MjpegDecoder> mMjpegDecoder;
+
+    // Records our capture buffers while we stream, if we've a capture tap.  See addCaptureTap()
+    std::unique_ptr<CaptureWriter> mCaptureWriter;
 
     // Synchronization necessary to deconflict the capture thread from the main service thread
     // Note that the service interface remains single threaded (ie: not reentrant)
     std::mutex mAccessLock;
+
+    static bool sZeroCopyEnabled;
+    static unsigned sConversionThreads;
+    static bool sGpuConversionEnabled;
+    static bool sMjpegEnabled;
+    static uint32_t sOutputFormat;
+    static unsigned sRequestedWidth;
+    static unsigned sRequestedHeight;
+    static unsigned sAdaptiveBufferLimit;
+    static std::map<std::string, std::string> sCaptureTaps;    // Camera id to capture file
 };
 
 } // namespace implementation
@@ -15,7 +15,9 @@
  */
 
 #include "GlWrapper.h"
+#include "glUtils.h"
 
+#include <inttypes.h>
 #include <stdio.h>
 #include <fcntl.h>
 #include <sys/ioctl.h>
@@ -55,136 +57,74 @@ const char pixelShaderSource[] =
         "}                                          \n";
 
 
-static const char *getEGLError(void) {
-    switch (eglGetError()) {
-        case EGL_SUCCESS:
-            return "EGL_SUCCESS";
-        case EGL_NOT_INITIALIZED:
-            return "EGL_NOT_INITIALIZED";
-        case EGL_BAD_ACCESS:
-            return "EGL_BAD_ACCESS";
-        case EGL_BAD_ALLOC:
-            return "EGL_BAD_ALLOC";
-        case EGL_BAD_ATTRIBUTE:
-            return "EGL_BAD_ATTRIBUTE";
-        case EGL_BAD_CONTEXT:
-            return "EGL_BAD_CONTEXT";
-        case EGL_BAD_CONFIG:
-            return "EGL_BAD_CONFIG";
-        case EGL_BAD_CURRENT_SURFACE:
-            return "EGL_BAD_CURRENT_SURFACE";
-        case EGL_BAD_DISPLAY:
-            return "EGL_BAD_DISPLAY";
-        case EGL_BAD_SURFACE:
-            return "EGL_BAD_SURFACE";
-        case EGL_BAD_MATCH:
-            return "EGL_BAD_MATCH";
-        case EGL_BAD_PARAMETER:
-            return "EGL_BAD_PARAMETER";
-        case EGL_BAD_NATIVE_PIXMAP:
-            return "EGL_BAD_NATIVE_PIXMAP";
-        case EGL_BAD_NATIVE_WINDOW:
-            return "EGL_BAD_NATIVE_WINDOW";
-        case EGL_CONTEXT_LOST:
-            return "EGL_CONTEXT_LOST";
-        default:
-            return "Unknown error";
-    }
-}
-
-
-// Given shader source, load and compile it
-static GLuint loadShader(GLenum type, const char *shaderSrc) {
-    // Create the shader object
-    GLuint shader = glCreateShader (type);
-    if (shader == 0) {
-        return 0;
+bool GlWrapper::getDisplaySize(const sp<IBinder>& display, unsigned* width, unsigned* height) {
+    DisplayInfo info;
+    if (SurfaceComposerClient::getDisplayInfo(display, &info) != NO_ERROR) {
+        return false;
     }
 
-    // Load and compile the shader
-    glShaderSource(shader, 1, &shaderSrc, nullptr);
-    glCompileShader(shader);
-
-    // Verify the compilation worked as expected
-    GLint compiled = 0;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
-    if (!compiled) {
-        ALOGE("Error compiling shader\n");
-
-        GLint size = 0;
-        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &size);
-        if (size > 0)
-        {
-            // Get and report the error message
-            char *infoLog = (char*)malloc(size);
-            glGetShaderInfoLog(shader, size, nullptr, infoLog);
-            ALOGE("  msg:\n%s\n", infoLog);
-            free(infoLog);
-        }
-
-        glDeleteShader(shader);
-        return 0;
+    if (info.orientation != DISPLAY_ORIENTATION_0 &&
+        info.orientation != DISPLAY_ORIENTATION_180) {
+        // rotated
+        *width = info.h;
+        *height = info.w;
+    } else {
+        *width = info.w;
+        *height = info.h;
     }
-
-    return shader;
+    return true;
 }
 
 
-// Create a program object given vertex and pixels shader source
-static GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc) {
-    GLuint program = glCreateProgram();
-    if (program == 0) {
-        ALOGE("Failed to allocate program object\n");
-        return 0;
-    }
-
-    // Compile the shaders and bind them to this program
-    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vtxSrc);
-    if (vertexShader == 0) {
-        ALOGE("Failed to load vertex shader\n");
-        glDeleteProgram(program);
-        return 0;
-    }
-    GLuint pixelShader = loadShader(GL_FRAGMENT_SHADER, pxlSrc);
-    if (pixelShader == 0) {
-        ALOGE("Failed to load pixel shader\n");
-        glDeleteProgram(program);
-        glDeleteShader(vertexShader);
-        return 0;
-    }
-    glAttachShader(program, vertexShader);
-    glAttachShader(program, pixelShader);
-
-    // Link the program
-    glLinkProgram(program);
-    GLint linked = 0;
-    glGetProgramiv(program, GL_LINK_STATUS, &linked);
-    if (!linked)
-    {
-        ALOGE("Error linking program.\n");
-        GLint size = 0;
-        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &size);
-        if (size > 0)
-        {
-            // Get and report the error message
-            char *infoLog = (char*)malloc(size);
-            glGetProgramInfoLog(program, size, nullptr, infoLog);
-            ALOGE("  msg:  %s\n", infoLog);
-            free(infoLog);
+// Makes a layer of our own on each display, either one that takes our client's buffers as they
+// are, or one with a surface for GL to draw onto.  A mirror we can't make a layer on is dropped,
+// but if the internal display fails, it leaves none.
+bool GlWrapper::createLayers(bool overlay) {
+    SurfaceComposerClient::Transaction transaction;
+    for (auto it = mOutputs.begin(); it != mOutputs.end(); ) {
+        Output& output = *it;
+        if (overlay) {
+            output.surfaceControl = mFlinger->createSurface(
+                    String8("Evs Display"), output.width, output.height,
+                    PIXEL_FORMAT_RGBA_8888, ISurfaceComposerClient::eFXSurfaceBufferState);
+        } else {
+            output.surfaceControl = mFlinger->createSurface(
+                    String8("Evs Display"), output.width, output.height,
+                    PIXEL_FORMAT_RGBX_8888, ISurfaceComposerClient::eOpaque);
+        }
+        if (output.surfaceControl == nullptr || !output.surfaceControl->isValid()) {
+            if (!output.mirror) {
+                for (auto&& created : mOutputs) {
+                    created.surfaceControl.clear();
+                }
+                return false;
+            }
+            ALOGW("Not mirroring to layer stack %u, where we couldn't make a layer",
+                  output.layerStack);
+            it = mOutputs.erase(it);
+            continue;
         }
 
-        glDeleteProgram(program);
-        glDeleteShader(vertexShader);
-        glDeleteShader(pixelShader);
-        return 0;
+        if (overlay) {
+            // The composer scales our client's buffers to fit each display
+            transaction.setFrame(output.surfaceControl, Rect(output.width, output.height))
+                       .setFlags(output.surfaceControl, layer_state_t::eLayerOpaque,
+                                 layer_state_t::eLayerOpaque);
+        } else {
+            output.surface = output.surfaceControl->getSurface();
+        }
+        if (output.mirror) {
+            transaction.setLayerStack(output.surfaceControl, output.layerStack);
+        }
+        ++it;
     }
-
-    return program;
+    transaction.apply();
+    return true;
 }
 
 
 // Main entry point
-bool GlWrapper::initialize() {
+bool GlWrapper::initialize(bool useOverlay, const std::vector<MirrorDisplay>& mirrors) {
     //
     //  Create the native full screen window and get a suitable configuration to match it
     //
@@ -208,31 +148,43 @@ bool GlWrapper::initialize() {
         return false;
     }
 
-    DisplayInfo mainDpyInfo;
-    err = SurfaceComposerClient::getDisplayInfo(mainDpy, &mainDpyInfo);
-    if (err != NO_ERROR) {
+    if (!getDisplaySize(mainDpy, &mWidth, &mHeight)) {
         ALOGE("ERROR: unable to get display characteristics");
         return false;
     }
+    mOutputs.resize(1);
+    mOutputs[0].width  = mWidth;
+    mOutputs[0].height = mHeight;
+
+    // Any other displays that want our frames too.  One that isn't there only costs us itself.
+    for (auto&& mirror : mirrors) {
+        sp<IBinder> display = SurfaceComposerClient::getPhysicalDisplayToken(mirror.physicalId);
+        Output output;
+        if (display == nullptr || !getDisplaySize(display, &output.width, &output.height)) {
+            ALOGW("Not mirroring to display %" PRIu64 ", which we couldn't find",
+                  mirror.physicalId);
+            continue;
+        }
+        output.mirror     = true;
+        output.layerStack = mirror.layerStack;
+        mOutputs.push_back(output);
+    }
 
-    if (mainDpyInfo.orientation != DISPLAY_ORIENTATION_0 &&
-        mainDpyInfo.orientation != DISPLAY_ORIENTATION_180) {
-        // rotated
-        mWidth = mainDpyInfo.h;
-        mHeight = mainDpyInfo.w;
-    } else {
-        mWidth = mainDpyInfo.w;
-        mHeight = mainDpyInfo.h;
+    // If we've been asked to, try for a layer that takes buffers straight from our client, which
+    // saves us drawing each one again.  Our client's buffers are already display sized RGBA, so
+    // there is nothing for the composer to scale or convert on the internal display.
+    if (useOverlay) {
+        if (createLayers(true)) {
+            mOverlay = true;
+            return true;
+        }
+        ALOGW("Failed to create an overlay layer, so falling back to drawing with GL");
     }
 
-    mFlingerSurfaceControl = mFlinger->createSurface(
-            String8("Evs Display"), mWidth, mHeight,
-            PIXEL_FORMAT_RGBX_8888, ISurfaceComposerClient::eOpaque);
-    if (mFlingerSurfaceControl == nullptr || !mFlingerSurfaceControl->isValid()) {
+    if (!createLayers(false)) {
         ALOGE("Failed to create SurfaceControl");
         return false;
     }
-    mFlingerSurface = mFlingerSurfaceControl->getSurface();
 
 
     // Set up our OpenGL ES context associated with the default display
@@ -268,11 +220,23 @@ bool GlWrapper::initialize() {
         return false;
     }
 
-    // Create the EGL render target surface
-    mSurface = eglCreateWindowSurface(mDisplay, egl_config, mFlingerSurface.get(), nullptr);
-    if (mSurface == EGL_NO_SURFACE) {
-        ALOGE("gelCreateWindowSurface failed.");
-        return false;
+    // Create the EGL render target surfaces, which all share the one context.  As with the
+    // layers, only the internal display is one we can't do without.
+    for (auto it = mOutputs.begin(); it != mOutputs.end(); ) {
+        Output& output = *it;
+        output.eglSurface = eglCreateWindowSurface(mDisplay, egl_config, output.surface.get(),
+                                                   nullptr);
+        if (output.eglSurface == EGL_NO_SURFACE) {
+            if (!output.mirror) {
+                ALOGE("eglCreateWindowSurface failed: %s", getEGLError());
+                return false;
+            }
+            ALOGW("Not mirroring to layer stack %u, where eglCreateWindowSurface failed: %s",
+                  output.layerStack, getEGLError());
+            it = mOutputs.erase(it);
+            continue;
+        }
+        ++it;
     }
 
     // Create the EGL context
@@ -287,7 +251,8 @@ bool GlWrapper::initialize() {
 
 
     // Activate our render target for drawing
-    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+    EGLSurface surface = mOutputs[0].eglSurface;
+    if (!eglMakeCurrent(mDisplay, surface, surface, mContext)) {
         ALOGE("Failed to make the OpenGL ES Context current: %s", getEGLError());
         return false;
     }
@@ -312,6 +277,7 @@ bool GlWrapper::initialize() {
     glBindTexture(GL_TEXTURE_2D, mTextureMap);
     glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
     glBindTexture(GL_TEXTURE_2D, 0);
+    mActiveTexture = mTextureMap;
 
     return true;
 }
@@ -319,112 +285,184 @@ bool GlWrapper::initialize() {
 
 void GlWrapper::shutdown() {
 
-    // Drop our device textures
-    if (mKHRimage != EGL_NO_IMAGE_KHR) {
-        eglDestroyImageKHR(mDisplay, mKHRimage);
-        mKHRimage = EGL_NO_IMAGE_KHR;
+    // An overlay layer never brought GL up
+    if (mDisplay != EGL_NO_DISPLAY) {
+        // Drop our device textures
+        releaseImageTextures();
+        glDeleteTextures(1, &mTextureMap);
+        mTextureMap = 0;
+        mActiveTexture = 0;
+
+        // Release all GL resources
+        eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        for (auto&& output : mOutputs) {
+            if (output.eglSurface != EGL_NO_SURFACE) {
+                eglDestroySurface(mDisplay, output.eglSurface);
+            }
+        }
+        eglDestroyContext(mDisplay, mContext);
+        eglTerminate(mDisplay);
+        mContext = EGL_NO_CONTEXT;
+        mDisplay = EGL_NO_DISPLAY;
     }
-
-    // Release all GL resources
-    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
-    eglDestroySurface(mDisplay, mSurface);
-    eglDestroyContext(mDisplay, mContext);
-    eglTerminate(mDisplay);
-    mSurface = EGL_NO_SURFACE;
-    mContext = EGL_NO_CONTEXT;
-    mDisplay = EGL_NO_DISPLAY;
+    mOverlayBuffers.clear([](sp<GraphicBuffer>&) {});
+    mOverlay = false;
 
     // Let go of our SurfaceComposer resources
-    mFlingerSurface.clear();
-    mFlingerSurfaceControl.clear();
+    mOutputs.clear();
     mFlinger.clear();
 }
 
 
 void GlWrapper::showWindow() {
-    if (mFlingerSurfaceControl != nullptr) {
-        SurfaceComposerClient::Transaction{}
-                .setLayer(mFlingerSurfaceControl, 0x7FFFFFFF)     // always on top
-                .show(mFlingerSurfaceControl)
-                .apply();
+    SurfaceComposerClient::Transaction transaction;
+    for (auto&& output : mOutputs) {
+        if (output.surfaceControl != nullptr) {
+            transaction.setLayer(output.surfaceControl, 0x7FFFFFFF)     // always on top
+                       .show(output.surfaceControl);
+        }
     }
+    transaction.apply();
 }
 
 
 void GlWrapper::hideWindow() {
-    if (mFlingerSurfaceControl != nullptr) {
-        SurfaceComposerClient::Transaction{}
-                .hide(mFlingerSurfaceControl)
-                .apply();
+    SurfaceComposerClient::Transaction transaction;
+    for (auto&& output : mOutputs) {
+        if (output.surfaceControl != nullptr) {
+            transaction.hide(output.surfaceControl);
+        }
     }
+    transaction.apply();
 }
 
 
 bool GlWrapper::updateImageTexture(const BufferDesc& buffer) {
+    const native_handle_t* handle = buffer.memHandle.getNativeHandle();
+
+    // Once we've seen a buffer, showing it again only means switching textures
+    ImageTexture* cached = mImageTextures.find(buffer);
+    if (cached != nullptr) {
+        mActiveTexture = cached->texture;
+        return true;
+    }
+
+    // Create an "image" object to wrap the gralloc buffer, with a GraphicBuffer around the
+    // provided handle to get there
+    ImageTexture imageTexture = {};
+    imageTexture.graphicBuffer = new GraphicBuffer(
+            buffer.width,
+            buffer.height,
+            buffer.format,
+            1,      /* layer count */
+            buffer.usage,
+            buffer.stride,
+            const_cast<native_handle_t*>(handle),
+            false   /* keep ownership */
+    );
+    if (imageTexture.graphicBuffer.get() == nullptr) {
+        ALOGE("Failed to allocate GraphicsBuffer to wrap our native handle");
+        return false;
+    }
+
 
-    // If we haven't done it yet, create an "image" object to wrap the gralloc buffer
-    if (mKHRimage == EGL_NO_IMAGE_KHR) {
-        // create a temporary GraphicBuffer to wrap the provided handle
-        sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(
+    // Get a GL compatible reference to the graphics buffer we've been given
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer cbuf =
+            static_cast<EGLClientBuffer>(imageTexture.graphicBuffer->getNativeBuffer());
+// TODO:  If we pass in a context, we get "bad context" back
+#if 0
+    imageTexture.image = eglCreateImageKHR(mDisplay, mContext,
+                                           EGL_NATIVE_BUFFER_ANDROID, cbuf,
+                                           eglImageAttributes);
+#else
+    imageTexture.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
+                                           EGL_NATIVE_BUFFER_ANDROID, cbuf,
+                                           eglImageAttributes);
+#endif
+    if (imageTexture.image == EGL_NO_IMAGE_KHR) {
+        ALOGE("error creating EGLImage: %s", getEGLError());
+        return false;
+    }
+
+
+    // Give this buffer a texture of its own, without mip-mapping like mTextureMap
+    glGenTextures(1, &imageTexture.texture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, imageTexture.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(imageTexture.image));
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    mImageTextures.insert(buffer, imageTexture,
+                          [this](ImageTexture& old) { releaseImageTexture(old); });
+    mActiveTexture = imageTexture.texture;
+    return true;
+}
+
+
+void GlWrapper::releaseImageTexture(ImageTexture& imageTexture) {
+    if (mActiveTexture == imageTexture.texture) {
+        mActiveTexture = mTextureMap;
+    }
+    glDeleteTextures(1, &imageTexture.texture);
+    eglDestroyImageKHR(mDisplay, imageTexture.image);
+    imageTexture = {};
+}
+
+
+void GlWrapper::releaseImageTextures() {
+    mImageTextures.clear([this](ImageTexture& imageTexture) {
+        releaseImageTexture(imageTexture);
+    });
+    mActiveTexture = mTextureMap;
+}
+
+
+bool GlWrapper::presentBuffer(const BufferDesc& buffer) {
+    const native_handle_t* handle = buffer.memHandle.getNativeHandle();
+
+    sp<GraphicBuffer> graphicBuffer;
+    sp<GraphicBuffer>* cached = mOverlayBuffers.find(buffer);
+    if (cached != nullptr) {
+        graphicBuffer = *cached;
+    } else {
+        graphicBuffer = new GraphicBuffer(
                 buffer.width,
                 buffer.height,
                 buffer.format,
                 1,      /* layer count */
                 buffer.usage,
                 buffer.stride,
-                const_cast<native_handle_t*>(buffer.memHandle.getNativeHandle()),
+                const_cast<native_handle_t*>(handle),
                 false   /* keep ownership */
         );
-        if (pGfxBuffer.get() == nullptr) {
+        if (graphicBuffer.get() == nullptr) {
             ALOGE("Failed to allocate GraphicsBuffer to wrap our native handle");
             return false;
         }
-
-
-        // Get a GL compatible reference to the graphics buffer we've been given
-        EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
-        EGLClientBuffer cbuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
-// TODO:  If we pass in a context, we get "bad context" back
-#if 0
-        mKHRimage = eglCreateImageKHR(mDisplay, mContext,
-                                      EGL_NATIVE_BUFFER_ANDROID, cbuf,
-                                      eglImageAttributes);
-#else
-        mKHRimage = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT,
-                                      EGL_NATIVE_BUFFER_ANDROID, cbuf,
-                                      eglImageAttributes);
-#endif
-        if (mKHRimage == EGL_NO_IMAGE_KHR) {
-            ALOGE("error creating EGLImage: %s", getEGLError());
-            return false;
-        }
-
-
-        // Update the texture handle we already created to refer to this gralloc buffer
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, mTextureMap);
-        glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(mKHRimage));
-
+        mOverlayBuffers.insert(buffer, graphicBuffer, [](sp<GraphicBuffer>&) {});
     }
 
+    // Every display takes the same buffer in the same transaction, so they all change together.
+    // Wait for the composer to take it, so we never have more than one queued up behind the one
+    // on screen.
+    SurfaceComposerClient::Transaction transaction;
+    for (auto&& output : mOutputs) {
+        transaction.setBuffer(output.surfaceControl, graphicBuffer);
+    }
+    transaction.apply(true /* synchronous */);
     return true;
 }
 
 
 void GlWrapper::renderImageToScreen() {
-    // Set the viewport
-    glViewport(0, 0, mWidth, mHeight);
-
-    // Clear the color buffer
-    glClearColor(0.1f, 0.5f, 0.1f, 1.0f);
-    glClear(GL_COLOR_BUFFER_BIT);
-
     // Select our screen space simple texture shader
     glUseProgram(mShaderProgram);
 
     // Bind the texture and assign it to the shader's sampler
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, mTextureMap);
+    glBindTexture(GL_TEXTURE_2D, mActiveTexture);
     GLint sampler = glGetUniformLocation(mShaderProgram, "tex");
     glUniform1i(sampler, 0);
 
@@ -450,15 +488,28 @@ void GlWrapper::renderImageToScreen() {
     glEnableVertexAttribArray(0);
     glEnableVertexAttribArray(1);
 
-    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+    // The same image goes to every display, each drawn at its own size
+    for (auto&& output : mOutputs) {
+        if (mOutputs.size() > 1) {
+            eglMakeCurrent(mDisplay, output.eglSurface, output.eglSurface, mContext);
+        }
 
+        // Set the viewport
+        glViewport(0, 0, output.width, output.height);
 
-    // Clean up and flip the rendered result to the front so it is visible
-    glDisableVertexAttribArray(0);
-    glDisableVertexAttribArray(1);
+        // Clear the color buffer
+        glClearColor(0.1f, 0.5f, 0.1f, 1.0f);
+        glClear(GL_COLOR_BUFFER_BIT);
 
-    glFinish();
+        glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+        // Flip the rendered result to the front so it is visible
+        glFinish();
+        eglSwapBuffers(mDisplay, output.eglSurface);
+    }
 
-    eglSwapBuffers(mDisplay, mSurface);
-}
 
+    // Clean up
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+}
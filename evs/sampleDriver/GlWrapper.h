@@ -29,43 +29,96 @@
 #include <gui/SurfaceComposerClient.h>
 
 #include <android/hardware/automotive/evs/1.0/types.h>
+#include <ui/GraphicBuffer.h>
+
+#include <vector>
+
+#include "BufferCache.h"
 
 
 using ::android::sp;
 using ::android::SurfaceComposerClient;
 using ::android::SurfaceControl;
 using ::android::Surface;
+using ::android::GraphicBuffer;
+using ::android::IBinder;
 using ::android::hardware::automotive::evs::V1_0::BufferDesc;
 
 
 class GlWrapper {
 public:
-    bool initialize();
+    // Another display to show the same frames on, besides the internal one
+    struct MirrorDisplay {
+        uint64_t    physicalId;     // As SurfaceFlinger knows it
+        uint32_t    layerStack;     // The layer stack that display shows
+    };
+
+    // With useOverlay, we try for a composer layer that shows our client's buffers directly
+    // instead of a GL surface we draw them onto.  See usingOverlay().  Each of the mirrors gets
+    // every frame too, scaled to fit, so our client still draws each frame only once.
+    bool initialize(bool useOverlay = false, const std::vector<MirrorDisplay>& mirrors = {});
     void shutdown();
 
     bool updateImageTexture(const BufferDesc& buffer);
     void renderImageToScreen();
 
+    // When we got an overlay layer, presentBuffer() puts a buffer up in place of the two calls
+    // above.  The buffer stays on screen, so must not be written, until the next one replaces it.
+    bool usingOverlay() const   { return mOverlay; };
+    bool presentBuffer(const BufferDesc& buffer);
+
     void showWindow();
     void hideWindow();
 
+    // The internal display's size, which is what our client draws
     unsigned getWidth()     { return mWidth; };
     unsigned getHeight()    { return mHeight; };
 
 private:
+    // A display we show frames on, and our layer there
+    struct Output {
+        bool                mirror     = false;     // If so, on layerStack
+        uint32_t            layerStack = 0;
+        unsigned            width      = 0;
+        unsigned            height     = 0;
+        sp<SurfaceControl>  surfaceControl;
+        sp<Surface>         surface;
+        EGLSurface          eglSurface = EGL_NO_SURFACE;
+    };
+    bool createLayers(bool overlay);
+    static bool getDisplaySize(const sp<IBinder>& display, unsigned* width, unsigned* height);
+
     sp<SurfaceComposerClient>   mFlinger;
-    sp<SurfaceControl>          mFlingerSurfaceControl;
-    sp<Surface>                 mFlingerSurface;
-    EGLDisplay                  mDisplay;
-    EGLSurface                  mSurface;
-    EGLContext                  mContext;
+    std::vector<Output>         mOutputs;           // The internal display first
+    EGLDisplay                  mDisplay = EGL_NO_DISPLAY;
+    EGLContext                  mContext = EGL_NO_CONTEXT;
+    bool                        mOverlay = false;   // No GL at all, if so
 
     unsigned mWidth  = 0;
     unsigned mHeight = 0;
 
-    EGLImageKHR mKHRimage = EGL_NO_IMAGE_KHR;
+    // The GL view of one of the buffers we've been asked to show, made the first time we see it
+    struct ImageTexture {
+        sp<GraphicBuffer>   graphicBuffer;  // Wraps the buffer handle for as long as we need it
+        EGLImageKHR         image;
+        GLuint              texture;
+    };
+    void releaseImageTexture(ImageTexture& imageTexture);
+    void releaseImageTextures();
+
+    template <typename Entry>
+    using BufferCache = ::android::automotive::evs::support::BufferCache<Entry>;
+
+    // Enough for every target buffer a display may cycle through (EvsGlDisplay::kMaxBufferCount)
+    static const size_t kMaxImageTextures = 8;
+
+    BufferCache<ImageTexture>       mImageTextures {kMaxImageTextures};
+
+    // What presentBuffer() hands the composer, the same way
+    BufferCache<sp<GraphicBuffer>>  mOverlayBuffers {kMaxImageTextures};
 
-    GLuint mTextureMap    = 0;
+    GLuint mTextureMap    = 0;      // Shown until we're given a buffer
+    GLuint mActiveTexture = 0;      // The texture renderImageToScreen() draws
     GLuint mShaderProgram = 0;
 };
 
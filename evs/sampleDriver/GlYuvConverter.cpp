@@ -0,0 +1,351 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GlYuvConverter.h"
+#include "glUtils.h"
+
+#include <cutils/log.h>
+#include <ui/GraphicBuffer.h>
+#include <utils/Trace.h>
+
+
+using android::GraphicBuffer;
+using android::sp;
+
+
+// The DRM fourcc code for packed YUYV (fourcc_code('Y', 'U', 'Y', 'V'))
+static const EGLint kDrmFormatYUYV = 0x56595559;
+
+
+static const char vertexShaderSource[] = ""
+        "#version 300 es                    \n"
+        "layout(location = 0) in vec4 pos;  \n"
+        "layout(location = 1) in vec2 tex;  \n"
+        "out vec2 uv;                       \n"
+        "void main()                        \n"
+        "{                                  \n"
+        "   gl_Position = pos;              \n"
+        "   uv = tex;                       \n"
+        "}                                  \n";
+
+static const char pixelShaderSource[] =
+        "#version 300 es                                        \n"
+        "#extension GL_OES_EGL_image_external_essl3 : require   \n"
+        "precision mediump float;                               \n"
+        "uniform samplerExternalOES tex;                        \n"
+        "in vec2 uv;                                            \n"
+        "out vec4 color;                                        \n"
+        "void main()                                            \n"
+        "{                                                      \n"
+        "    color = vec4(texture(tex, uv).rgb, 1.0);           \n"
+        "}                                                      \n";
+
+
+bool GlYuvConverter::initialize() {
+    mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (mDisplay == EGL_NO_DISPLAY) {
+        ALOGE("Failed to get egl display");
+        return false;
+    }
+
+    EGLint major = 3;
+    EGLint minor = 0;
+    if (!eglInitialize(mDisplay, &major, &minor)) {
+        ALOGE("Failed to initialize EGL: %s", getEGLError());
+        return false;
+    }
+
+    const EGLint config_attribs[] = {
+            // Tag                  Value
+            EGL_SURFACE_TYPE,       EGL_PBUFFER_BIT,
+            EGL_RENDERABLE_TYPE,    EGL_OPENGL_ES3_BIT_KHR,
+            EGL_RED_SIZE,           8,
+            EGL_GREEN_SIZE,         8,
+            EGL_BLUE_SIZE,          8,
+            EGL_DEPTH_SIZE,         0,
+            EGL_NONE
+    };
+
+    EGLConfig egl_config = {0};
+    EGLint numConfigs = -1;
+    eglChooseConfig(mDisplay, config_attribs, &egl_config, 1, &numConfigs);
+    if (numConfigs != 1) {
+        ALOGE("Didn't find a suitable configuration for GPU conversion");
+        return false;
+    }
+
+    // We only ever render into our own framebuffers, but we need something to make current
+    const EGLint surface_attribs[] = {EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE};
+    mSurface = eglCreatePbufferSurface(mDisplay, egl_config, surface_attribs);
+    if (mSurface == EGL_NO_SURFACE) {
+        ALOGE("eglCreatePbufferSurface failed: %s", getEGLError());
+        return false;
+    }
+
+    const EGLint context_attribs[] = {EGL_CONTEXT_CLIENT_VERSION, 3, EGL_NONE};
+    mContext = eglCreateContext(mDisplay, egl_config, EGL_NO_CONTEXT, context_attribs);
+    if (mContext == EGL_NO_CONTEXT) {
+        ALOGE("Failed to create OpenGL ES Context: %s", getEGLError());
+        return false;
+    }
+
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGE("Failed to make the OpenGL ES Context current: %s", getEGLError());
+        return false;
+    }
+
+    mShaderProgram = buildShaderProgram(vertexShaderSource, pixelShaderSource);
+    if (!mShaderProgram) {
+        ALOGE("Failed to build YUV conversion shader program");
+        return false;
+    }
+
+    glGenTextures(1, &mSourceTexture);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, mSourceTexture);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_EXTERNAL_OES, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+
+    return true;
+}
+
+
+void GlYuvConverter::shutdown() {
+    if (mDisplay == EGL_NO_DISPLAY) {
+        return;
+    }
+
+    // We're on the rendering thread, so the context is ours to release our GL objects with
+    if (mContext != EGL_NO_CONTEXT &&
+        eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        for (auto&& entry : mTargets) {
+            glDeleteFramebuffers(1, &entry.second.fbo);
+            glDeleteTextures(1, &entry.second.texture);
+        }
+        glDeleteTextures(1, &mSourceTexture);
+        glDeleteProgram(mShaderProgram);
+    }
+
+    for (auto&& entry : mTargets) {
+        eglDestroyImageKHR(mDisplay, entry.second.image);
+    }
+    mTargets.clear();
+    for (auto&& src : mSourceImages) {
+        if (src.image != EGL_NO_IMAGE_KHR) {
+            eglDestroyImageKHR(mDisplay, src.image);
+        }
+    }
+    mSourceImages.clear();
+    {
+        std::lock_guard<std::mutex> lock(mStaleLock);
+        mStaleTargets.clear();
+    }
+    mSourceTexture = 0;
+    mShaderProgram = 0;
+
+    // Note we don't terminate the display since the rest of the process may be using it
+    eglMakeCurrent(mDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (mContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(mDisplay, mContext);
+    }
+    if (mSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(mDisplay, mSurface);
+    }
+    mContext = EGL_NO_CONTEXT;
+    mSurface = EGL_NO_SURFACE;
+    mDisplay = EGL_NO_DISPLAY;
+    mInitFailed = false;
+}
+
+
+void GlYuvConverter::forgetTarget(buffer_handle_t handle) {
+    std::lock_guard<std::mutex> lock(mStaleLock);
+    mStaleTargets.push_back(handle);
+}
+
+
+void GlYuvConverter::releaseStaleTargets() {
+    std::vector<buffer_handle_t> stale;
+    {
+        std::lock_guard<std::mutex> lock(mStaleLock);
+        stale.swap(mStaleTargets);
+    }
+
+    for (auto&& handle : stale) {
+        auto it = mTargets.find(handle);
+        if (it != mTargets.end()) {
+            glDeleteFramebuffers(1, &it->second.fbo);
+            glDeleteTextures(1, &it->second.texture);
+            eglDestroyImageKHR(mDisplay, it->second.image);
+            mTargets.erase(it);
+        }
+    }
+}
+
+
+EGLImageKHR GlYuvConverter::getSourceImage(int fd, unsigned index, unsigned stride,
+                                           const BufferDesc& tgtBuff) {
+    if (index >= mSourceImages.size()) {
+        mSourceImages.resize(index + 1);
+    }
+
+    SourceImage& src = mSourceImages[index];
+    if (src.fd != fd && src.image != EGL_NO_IMAGE_KHR) {
+        // The capture ring has been rebuilt since we last saw this slot
+        eglDestroyImageKHR(mDisplay, src.image);
+        src.image = EGL_NO_IMAGE_KHR;
+    }
+
+    if (src.image == EGL_NO_IMAGE_KHR) {
+        // The source uses the same full range BT.601 encoding our CPU conversion assumes
+        const EGLint attribs[] = {
+                EGL_WIDTH,                      (EGLint)tgtBuff.width,
+                EGL_HEIGHT,                     (EGLint)tgtBuff.height,
+                EGL_LINUX_DRM_FOURCC_EXT,       kDrmFormatYUYV,
+                EGL_DMA_BUF_PLANE0_FD_EXT,      fd,
+                EGL_DMA_BUF_PLANE0_OFFSET_EXT,  0,
+                EGL_DMA_BUF_PLANE0_PITCH_EXT,   (EGLint)stride,
+                EGL_YUV_COLOR_SPACE_HINT_EXT,   EGL_ITU_REC601_EXT,
+                EGL_SAMPLE_RANGE_HINT_EXT,      EGL_YUV_FULL_RANGE_EXT,
+                EGL_NONE
+        };
+        src.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_LINUX_DMA_BUF_EXT,
+                                      nullptr, attribs);
+        if (src.image == EGL_NO_IMAGE_KHR) {
+            ALOGE("Failed to import capture buffer %u: %s", index, getEGLError());
+            return EGL_NO_IMAGE_KHR;
+        }
+        src.fd = fd;
+    }
+
+    return src.image;
+}
+
+
+GLuint GlYuvConverter::getTargetFramebuffer(const BufferDesc& tgtBuff) {
+    buffer_handle_t handle = tgtBuff.memHandle.getNativeHandle();
+    auto it = mTargets.find(handle);
+    if (it != mTargets.end()) {
+        return it->second.fbo;
+    }
+
+    // create a temporary GraphicBuffer to wrap the provided handle
+    sp<GraphicBuffer> pGfxBuffer = new GraphicBuffer(
+            tgtBuff.width,
+            tgtBuff.height,
+            tgtBuff.format,
+            1,      /* layer count */
+            tgtBuff.usage,
+            tgtBuff.stride,
+            const_cast<native_handle_t*>(handle),
+            false   /* keep ownership */
+    );
+    if (pGfxBuffer.get() == nullptr) {
+        ALOGE("Failed to allocate GraphicsBuffer to wrap our native handle");
+        return 0;
+    }
+
+    TargetImage target;
+    EGLint eglImageAttributes[] = {EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE};
+    EGLClientBuffer cbuf = static_cast<EGLClientBuffer>(pGfxBuffer->getNativeBuffer());
+    target.image = eglCreateImageKHR(mDisplay, EGL_NO_CONTEXT, EGL_NATIVE_BUFFER_ANDROID,
+                                     cbuf, eglImageAttributes);
+    if (target.image == EGL_NO_IMAGE_KHR) {
+        ALOGE("error creating EGLImage for output buffer: %s", getEGLError());
+        return 0;
+    }
+
+    glGenTextures(1, &target.texture);
+    glBindTexture(GL_TEXTURE_2D, target.texture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, static_cast<GLeglImageOES>(target.image));
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glGenFramebuffers(1, &target.fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, target.fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D,
+                           target.texture, 0);
+    GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (status != GL_FRAMEBUFFER_COMPLETE) {
+        ALOGE("Output buffer isn't renderable (%#x)", status);
+        glDeleteFramebuffers(1, &target.fbo);
+        glDeleteTextures(1, &target.texture);
+        eglDestroyImageKHR(mDisplay, target.image);
+        return 0;
+    }
+
+    mTargets[handle] = target;
+    return target.fbo;
+}
+
+
+bool GlYuvConverter::convert(int srcFd, unsigned srcIndex, unsigned srcStride,
+                             const BufferDesc& tgtBuff) {
+    ATRACE_CALL();
+    if (mInitFailed) {
+        return false;
+    }
+    if (mDisplay == EGL_NO_DISPLAY && !initialize()) {
+        // Leave things half built so shutdown() can clean up, but don't try again
+        mInitFailed = true;
+        return false;
+    }
+
+    // This is a no-op except on the first frame after the capture thread starts
+    if (!eglMakeCurrent(mDisplay, mSurface, mSurface, mContext)) {
+        ALOGE("Failed to make the OpenGL ES Context current: %s", getEGLError());
+        return false;
+    }
+
+    releaseStaleTargets();
+
+    EGLImageKHR srcImage = getSourceImage(srcFd, srcIndex, srcStride, tgtBuff);
+    GLuint fbo = getTargetFramebuffer(tgtBuff);
+    if (srcImage == EGL_NO_IMAGE_KHR || fbo == 0) {
+        return false;
+    }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glViewport(0, 0, tgtBuff.width, tgtBuff.height);
+
+    glUseProgram(mShaderProgram);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, mSourceTexture);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_EXTERNAL_OES, static_cast<GLeglImageOES>(srcImage));
+    glUniform1i(glGetUniformLocation(mShaderProgram, "tex"), 0);
+    glDisable(GL_BLEND);
+
+    // Framebuffer row 0 is at the bottom in GL terms, as is texture row 0, so mapping the
+    // bottom of the quad to V=0 copies the image without flipping it
+    static const GLfloat pos[] = { -1.0f, -1.0f,   1.0f, -1.0f,   -1.0f, 1.0f,   1.0f, 1.0f };
+    static const GLfloat tex[] = {  0.0f,  0.0f,   1.0f,  0.0f,    0.0f, 1.0f,   1.0f, 1.0f };
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, pos);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 0, tex);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+
+    glDrawArrays(GL_TRIANGLE_STRIP, 0, 4);
+
+    glDisableVertexAttribArray(0);
+    glDisableVertexAttribArray(1);
+    glBindTexture(GL_TEXTURE_EXTERNAL_OES, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    // The client may read the buffer as soon as we deliver it
+    glFinish();
+
+    return glGetError() == GL_NO_ERROR;
+}
@@ -0,0 +1,87 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GLYUVCONVERTER_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GLYUVCONVERTER_H
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <GLES2/gl2.h>
+#include <GLES2/gl2ext.h>
+#include <GLES3/gl3.h>
+
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+
+
+using ::android::hardware::automotive::evs::V1_0::BufferDesc;
+
+
+// Converts YUYV capture buffers into RGBA output buffers on the GPU.  The source dmabuf is
+// sampled through an external texture, so the driver does the color conversion, and the
+// result is rendered directly into the output gralloc buffer.
+//
+// The GL context belongs to whichever thread calls convert(), so all calls to it, shutdown() and
+// destruction included, must come from that same thread.
+class GlYuvConverter {
+public:
+    ~GlYuvConverter() { shutdown(); };
+
+    // Renders the YUYV image held in srcFd into the target buffer and waits for it to land.
+    // srcIndex identifies the capture buffer so its EGLImage can be reused on later frames.
+    bool convert(int srcFd, unsigned srcIndex, unsigned srcStride, const BufferDesc& tgtBuff);
+
+    // Tells us an output buffer is about to be freed.  Safe to call from any thread.
+    void forgetTarget(buffer_handle_t handle);
+
+    void shutdown();
+
+private:
+    bool initialize();
+    EGLImageKHR getSourceImage(int fd, unsigned index, unsigned stride, const BufferDesc& tgt);
+    GLuint getTargetFramebuffer(const BufferDesc& tgtBuff);
+    void releaseStaleTargets();
+
+    EGLDisplay  mDisplay = EGL_NO_DISPLAY;
+    EGLSurface  mSurface = EGL_NO_SURFACE;
+    EGLContext  mContext = EGL_NO_CONTEXT;
+    bool        mInitFailed = false;
+
+    GLuint mShaderProgram = 0;
+    GLuint mSourceTexture = 0;
+
+    struct SourceImage {
+        int         fd    = -1;
+        EGLImageKHR image = EGL_NO_IMAGE_KHR;
+    };
+    std::vector<SourceImage> mSourceImages;     // Indexed by capture buffer index
+
+    struct TargetImage {
+        EGLImageKHR image   = EGL_NO_IMAGE_KHR;
+        GLuint      texture = 0;
+        GLuint      fbo     = 0;
+    };
+    std::unordered_map<buffer_handle_t, TargetImage> mTargets;
+
+    // Output buffers freed since the last frame.  They're cleaned up on the rendering thread.
+    std::mutex                   mStaleLock;
+    std::vector<buffer_handle_t> mStaleTargets;
+};
+
+#endif // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GLYUVCONVERTER_H
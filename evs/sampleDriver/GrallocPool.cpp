@@ -0,0 +1,156 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "GrallocPool.h"
+
+#include <ui/GraphicBufferAllocator.h>
+#include <ui/GraphicBufferMapper.h>
+
+#include <log/log.h>
+
+#include <chrono>
+#include <thread>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Long enough to cover a trip from reverse through park and back again
+nsecs_t GrallocPool::sIdleTimeout = seconds_to_nanoseconds(30);
+
+std::mutex                                          GrallocPool::sLock;
+std::map<GrallocPool::Key,
+         std::vector<GrallocPool::IdleBuffer>>      GrallocPool::sIdle;
+std::condition_variable                             GrallocPool::sSignal;
+bool                                                GrallocPool::sTrimRunning = false;
+
+
+bool GrallocPool::acquire(const std::string& cameraId, uint32_t width, uint32_t height,
+                          uint32_t format, uint32_t usage, const char* requester,
+                          Buffer* buffer) {
+    {
+        std::lock_guard<std::mutex> lock(sLock);
+        auto found = sIdle.find(Key(cameraId, width, height, format, usage));
+        if (found != sIdle.end() && !found->second.empty()) {
+            // The most recently returned one, so the oldest are the ones left to age out
+            *buffer = found->second.back().buffer;
+            found->second.pop_back();
+            return true;
+        }
+    }
+
+    Buffer fresh;
+    status_t result = GraphicBufferAllocator::get().allocate(width, height, format, 1, usage,
+                                                             &fresh.handle, &fresh.stride, 0,
+                                                             requester);
+    if (result != NO_ERROR) {
+        ALOGE("Error %d allocating %u x %u graphics buffer", result, width, height);
+        return false;
+    }
+    if (!fresh.handle) {
+        ALOGE("We didn't get a buffer handle back from the allocator");
+        return false;
+    }
+
+    *buffer = fresh;
+    return true;
+}
+
+
+void GrallocPool::release(const std::string& cameraId, uint32_t width, uint32_t height,
+                          uint32_t format, uint32_t usage, const Buffer& buffer) {
+    if (sIdleTimeout <= 0) {
+        discard(buffer);
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(sLock);
+    sIdle[Key(cameraId, width, height, format, usage)].push_back(
+            { buffer, systemTime(SYSTEM_TIME_MONOTONIC) });
+
+    if (!sTrimRunning) {
+        sTrimRunning = true;
+        std::thread(trimThread).detach();
+    }
+    sSignal.notify_one();
+}
+
+
+void GrallocPool::discard(const Buffer& buffer) {
+    if (buffer.pixels != nullptr) {
+        GraphicBufferMapper::get().unlock(buffer.handle);
+    }
+    GraphicBufferAllocator::get().free(buffer.handle);
+}
+
+
+void GrallocPool::trimThread() {
+    std::unique_lock<std::mutex> lock(sLock);
+    while (true) {
+        // Take out everything that has sat idle too long, and see when the next one will have
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        nsecs_t nextExpiry = 0;
+        std::vector<Buffer> expired;
+        for (auto entry = sIdle.begin(); entry != sIdle.end();) {
+            std::vector<IdleBuffer>& buffers = entry->second;
+            auto kept = buffers.begin();
+            while (kept != buffers.end() && kept->releaseTime + sIdleTimeout <= now) {
+                expired.push_back(kept->buffer);
+                ++kept;
+            }
+            buffers.erase(buffers.begin(), kept);
+
+            if (buffers.empty()) {
+                entry = sIdle.erase(entry);
+            } else {
+                const nsecs_t expiry = buffers.front().releaseTime + sIdleTimeout;
+                if (nextExpiry == 0 || expiry < nextExpiry) {
+                    nextExpiry = expiry;
+                }
+                ++entry;
+            }
+        }
+
+        if (!expired.empty()) {
+            // The allocator can be slow, so nobody should wait on us while we call it
+            lock.unlock();
+            ALOGI("Freeing %zu output buffers that went unused", expired.size());
+            for (auto&& buffer : expired) {
+                discard(buffer);
+            }
+            lock.lock();
+            continue;
+        }
+
+        if (nextExpiry == 0) {
+            sSignal.wait(lock);
+        } else {
+            sSignal.wait_for(lock, std::chrono::nanoseconds(nextExpiry - now));
+        }
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,91 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GRALLOCPOOL_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GRALLOCPOOL_H
+
+#include <cutils/native_handle.h>
+#include <utils/Timers.h>
+
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// Keeps the output buffers a camera gives back for a while, so that the next stream on that
+// camera can take them instead of going back to the allocator.  Clients restart streams every
+// time the gear changes, and each restart used to free and reallocate the whole set.  Buffers
+// nobody takes within the idle timeout are freed in the background.
+class GrallocPool {
+public:
+    struct Buffer {
+        buffer_handle_t handle = nullptr;
+        uint32_t        stride = 0;         // Pixels per line, as gralloc reported it
+        void*           pixels = nullptr;   // Our CPU mapping, if we made one
+    };
+
+    // Hands out a buffer for the camera, one it gave back if one fits, or else a new one
+    // allocated under the requester's name
+    static bool acquire(const std::string& cameraId, uint32_t width, uint32_t height,
+                        uint32_t format, uint32_t usage, const char* requester, Buffer* buffer);
+
+    // Takes back a buffer the camera is done with, to be freed if nothing reuses it in time
+    static void release(const std::string& cameraId, uint32_t width, uint32_t height,
+                        uint32_t format, uint32_t usage, const Buffer& buffer);
+
+    // Frees a buffer right away, for when it may still be in someone else's hands
+    static void discard(const Buffer& buffer);
+
+    // How long given back buffers are kept.  Zero frees them as soon as they're given back.
+    static void setIdleTimeout(nsecs_t timeout) { sIdleTimeout = timeout; };
+
+private:
+    typedef std::tuple<std::string, uint32_t, uint32_t, uint32_t, uint32_t> Key;
+
+    struct IdleBuffer {
+        Buffer  buffer;
+        nsecs_t releaseTime;
+    };
+
+    static void trimThread();
+
+    static nsecs_t                                  sIdleTimeout;
+
+    static std::mutex                               sLock;      // Guards the fields below
+    static std::map<Key, std::vector<IdleBuffer>>   sIdle;      // Oldest first
+    static std::condition_variable                  sSignal;    // Signaled on each release
+    static bool                                     sTrimRunning;
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GRALLOCPOOL_H
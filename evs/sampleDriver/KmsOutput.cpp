@@ -0,0 +1,238 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "KmsOutput.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <drm_fourcc.h>
+#include <xf86drm.h>
+
+#include <log/log.h>
+#include <system/graphics.h>
+
+
+// How long we wait for a page flip before deciding the display has stopped answering
+static const int kFlipTimeoutMs = 100;
+
+
+bool KmsOutput::initialize(const char* device) {
+    mFd = open(device, O_RDWR | O_CLOEXEC);
+    if (mFd < 0) {
+        ALOGE("Failed to open %s: %s", device, strerror(errno));
+        return false;
+    }
+
+    // The first to open the device is master already, so this only matters if we weren't
+    if (drmSetMaster(mFd) != 0) {
+        ALOGW("Couldn't become DRM master of %s: %s", device, strerror(errno));
+    }
+
+    drmModeRes* resources = drmModeGetResources(mFd);
+    if (resources == nullptr) {
+        ALOGE("%s doesn't support mode setting", device);
+        shutdown();
+        return false;
+    }
+
+    // Take the first display that's plugged in, and the CRTC that's driving it if there is one
+    for (int i = 0; i < resources->count_connectors && mCrtcId == 0; i++) {
+        drmModeConnector* connector = drmModeGetConnector(mFd, resources->connectors[i]);
+        if (connector == nullptr) {
+            continue;
+        }
+        if (connector->connection == DRM_MODE_CONNECTED && connector->count_modes > 0) {
+            mMode = connector->modes[0];
+            for (int m = 0; m < connector->count_modes; m++) {
+                if (connector->modes[m].type & DRM_MODE_TYPE_PREFERRED) {
+                    mMode = connector->modes[m];
+                    break;
+                }
+            }
+
+            drmModeEncoder* encoder = drmModeGetEncoder(mFd, connector->encoder_id);
+            if (encoder != nullptr) {
+                mCrtcId = encoder->crtc_id;
+                drmModeFreeEncoder(encoder);
+            }
+
+            // Otherwise, any CRTC one of its encoders can be fed from
+            for (int e = 0; e < connector->count_encoders && mCrtcId == 0; e++) {
+                encoder = drmModeGetEncoder(mFd, connector->encoders[e]);
+                if (encoder == nullptr) {
+                    continue;
+                }
+                for (int c = 0; c < resources->count_crtcs; c++) {
+                    if (encoder->possible_crtcs & (1u << c)) {
+                        mCrtcId = resources->crtcs[c];
+                        break;
+                    }
+                }
+                drmModeFreeEncoder(encoder);
+            }
+            mConnectorId = connector->connector_id;
+        }
+        drmModeFreeConnector(connector);
+    }
+    drmModeFreeResources(resources);
+
+    if (mCrtcId == 0) {
+        ALOGE("Found no connected display on %s that we could drive", device);
+        shutdown();
+        return false;
+    }
+
+    ALOGI("Driving connector %u from CRTC %u at %ux%u@%u on %s", mConnectorId, mCrtcId,
+          mMode.hdisplay, mMode.vdisplay, mMode.vrefresh, device);
+    return true;
+}
+
+
+void KmsOutput::shutdown() {
+    if (mFd < 0) {
+        return;
+    }
+
+    for (auto&& [handle, framebuffer] : mFramebuffers) {
+        drmModeRmFB(mFd, framebuffer);
+    }
+    mFramebuffers.clear();
+
+    close(mFd);
+    mFd = -1;
+    mCrtcId = 0;
+    mModeSet = false;
+    mFlipPending = false;
+}
+
+
+bool KmsOutput::presentBuffer(const BufferDesc& buffer) {
+    const uint32_t framebuffer = getFramebuffer(buffer);
+    if (framebuffer == 0) {
+        return false;
+    }
+
+    // The first frame sets the mode, and the rest flip to their buffer on the next vsync
+    if (!mModeSet) {
+        if (drmModeSetCrtc(mFd, mCrtcId, framebuffer, 0, 0, &mConnectorId, 1, &mMode) != 0) {
+            ALOGE("Failed to set mode: %s", strerror(errno));
+            return false;
+        }
+        mModeSet = true;
+        return true;
+    }
+
+    if (drmModePageFlip(mFd, mCrtcId, framebuffer, DRM_MODE_PAGE_FLIP_EVENT, this) != 0) {
+        ALOGE("Failed to flip to buffer %u: %s", buffer.bufferId, strerror(errno));
+        return false;
+    }
+
+    // Wait until the old buffer is off the screen, since it goes back to our client after this
+    drmEventContext events = {};
+    events.version = 2;
+    events.page_flip_handler = onPageFlip;
+    mFlipPending = true;
+    while (mFlipPending) {
+        pollfd pfd = { mFd, POLLIN, 0 };
+        if (TEMP_FAILURE_RETRY(poll(&pfd, 1, kFlipTimeoutMs)) <= 0) {
+            ALOGW("Page flip didn't complete in %d ms", kFlipTimeoutMs);
+            mFlipPending = false;
+            break;
+        }
+        drmHandleEvent(mFd, &events);
+    }
+
+    return true;
+}
+
+
+void KmsOutput::blank() {
+    if (mModeSet) {
+        drmModeSetCrtc(mFd, mCrtcId, 0, 0, 0, nullptr, 0, nullptr);
+        mModeSet = false;
+    }
+}
+
+
+void KmsOutput::releaseMaster() {
+    if (drmDropMaster(mFd) != 0) {
+        ALOGW("Failed to drop DRM master: %s", strerror(errno));
+    }
+}
+
+
+bool KmsOutput::reclaim() {
+    if (drmSetMaster(mFd) != 0) {
+        ALOGE("Failed to take DRM master back: %s", strerror(errno));
+        return false;
+    }
+
+    // The composer may have changed the mode in the meantime
+    mModeSet = false;
+    return true;
+}
+
+
+uint32_t KmsOutput::getFramebuffer(const BufferDesc& buffer) {
+    const native_handle_t* handle = buffer.memHandle.getNativeHandle();
+    auto found = mFramebuffers.find(handle);
+    if (found != mFramebuffers.end()) {
+        return found->second;
+    }
+
+    if (handle == nullptr || handle->numFds < 1 || buffer.format != HAL_PIXEL_FORMAT_RGBA_8888) {
+        ALOGE("Buffer %u isn't one we can scan out", buffer.bufferId);
+        return 0;
+    }
+
+    // Gralloc buffers carry their dmabuf first
+    uint32_t gemHandle = 0;
+    if (drmPrimeFDToHandle(mFd, handle->data[0], &gemHandle) != 0) {
+        ALOGE("Failed to import buffer %u: %s", buffer.bufferId, strerror(errno));
+        return 0;
+    }
+
+    // The bytes of RGBA_8888 are what DRM calls ABGR8888, since it names them by their bits
+    const uint32_t handles[4] = { gemHandle };
+    const uint32_t pitches[4] = { buffer.stride * buffer.pixelSize };
+    const uint32_t offsets[4] = { 0 };
+    uint32_t framebuffer = 0;
+    const int result = drmModeAddFB2(mFd, buffer.width, buffer.height, DRM_FORMAT_ABGR8888,
+                                     handles, pitches, offsets, &framebuffer, 0);
+
+    // The framebuffer holds its own reference to the buffer
+    drm_gem_close gemClose = {};
+    gemClose.handle = gemHandle;
+    drmIoctl(mFd, DRM_IOCTL_GEM_CLOSE, &gemClose);
+
+    if (result != 0) {
+        ALOGE("Failed to make a framebuffer of buffer %u: %s", buffer.bufferId, strerror(errno));
+        return 0;
+    }
+
+    mFramebuffers[handle] = framebuffer;
+    return framebuffer;
+}
+
+
+void KmsOutput::onPageFlip(int /*fd*/, unsigned /*frame*/, unsigned /*sec*/, unsigned /*usec*/,
+                           void* data) {
+    static_cast<KmsOutput*>(data)->mFlipPending = false;
+}
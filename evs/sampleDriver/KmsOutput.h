@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_DISPLAY_KMSOUTPUT_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_DISPLAY_KMSOUTPUT_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+
+#include <xf86drmMode.h>
+
+#include <unordered_map>
+
+
+using ::android::hardware::automotive::evs::V1_0::BufferDesc;
+
+
+// Scans our display buffers out through DRM/KMS ourselves, for early in boot before
+// SurfaceFlinger (and the composer behind it) is up to do it for us.  We take the first
+// connected connector at its preferred mode, and put each buffer up whole with a page flip.
+// Once SurfaceFlinger starts we drop DRM master so its composer can take over, and keep showing
+// our last frame until it does.
+//
+// Like GlWrapper, this is only used from the display's presentation thread.
+class KmsOutput {
+public:
+    ~KmsOutput() { shutdown(); };
+
+    // Opens the given DRM device (eg: /dev/dri/card0) and becomes its master
+    bool initialize(const char* device);
+    void shutdown();
+
+    // Puts up a buffer in place of the last one, and waits for it to reach the screen.  It
+    // stays there, so must not be written, until the next one replaces it.
+    bool presentBuffer(const BufferDesc& buffer);
+
+    // Turns the display off until the next presentBuffer()
+    void blank();
+
+    // Lets the composer have the display while our last frame stays up.  Until shutdown(), we
+    // can take it back with reclaim() if the composer didn't get going after all.
+    void releaseMaster();
+    bool reclaim();
+
+    // The size of the mode we drive, which is what our client should draw
+    unsigned getWidth()     { return mMode.hdisplay; };
+    unsigned getHeight()    { return mMode.vdisplay; };
+
+private:
+    uint32_t getFramebuffer(const BufferDesc& buffer);
+    static void onPageFlip(int fd, unsigned frame, unsigned sec, unsigned usec, void* data);
+
+    int                 mFd = -1;
+    uint32_t            mConnectorId = 0;
+    uint32_t            mCrtcId = 0;
+    drmModeModeInfo     mMode = {};
+    bool                mModeSet = false;   // Is the CRTC scanning out one of our buffers?
+    bool                mFlipPending = false;
+
+    // The framebuffers we've made of our client's buffers, made the first time we see each
+    std::unordered_map<const native_handle_t*, uint32_t> mFramebuffers;
+};
+
+#endif // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_DISPLAY_KMSOUTPUT_H
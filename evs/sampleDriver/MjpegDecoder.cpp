@@ -0,0 +1,101 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "MjpegDecoder.h"
+
+#include <log/log.h>
+#include <utils/Trace.h>
+
+
+// libjpeg's default is to print the error and exit, which is no way for a service to behave
+void MjpegDecoder::onFatalError(j_common_ptr info) {
+    char message[JMSG_LENGTH_MAX];
+    (*info->err->format_message)(info, message);
+    ALOGW("Dropping MJPEG frame:  %s", message);
+
+    // Our ErrorManager starts with the part libjpeg knows about
+    longjmp(reinterpret_cast<ErrorManager*>(info->err)->jump, 1);
+}
+
+
+// Corrupt data warnings are routine with USB cameras, and one per frame would swamp the log, so
+// we only note them so that decode() drops the frame.  Other levels are just trace messages.
+void MjpegDecoder::onMessage(j_common_ptr info, int msgLevel) {
+    if (msgLevel < 0) {
+        reinterpret_cast<ErrorManager*>(info->err)->damaged = true;
+    }
+}
+
+
+MjpegDecoder::MjpegDecoder() {
+    mInfo.err = jpeg_std_error(&mError.pub);
+    mError.pub.error_exit = onFatalError;
+    mError.pub.emit_message = onMessage;
+    jpeg_create_decompress(&mInfo);
+}
+
+
+MjpegDecoder::~MjpegDecoder() {
+    jpeg_destroy_decompress(&mInfo);
+}
+
+
+bool MjpegDecoder::decode(const BufferDesc& tgtBuff, uint8_t* tgt, const void* data, size_t size) {
+    ATRACE_CALL();
+    if (data == nullptr || size == 0) {
+        return false;
+    }
+
+    // Nothing below may own anything that needs destroying, since a fatal error skips past it
+    if (setjmp(mError.jump)) {
+        jpeg_abort_decompress(&mInfo);
+        return false;
+    }
+
+    mError.damaged = false;
+    jpeg_mem_src(&mInfo, static_cast<unsigned char*>(const_cast<void*>(data)), size);
+    jpeg_read_header(&mInfo, TRUE);
+    if (mInfo.image_width != tgtBuff.width || mInfo.image_height != tgtBuff.height) {
+        if (!mWarnedSize) {
+            ALOGE("MJPEG frame is %ux%u, but our output buffers are %ux%u",
+                  mInfo.image_width, mInfo.image_height, tgtBuff.width, tgtBuff.height);
+            mWarnedSize = true;
+        }
+        jpeg_abort_decompress(&mInfo);
+        return false;
+    }
+
+    // Byte order R, G, B, A matches HAL_PIXEL_FORMAT_RGBA_8888.  The fast integer IDCT and
+    // plain upsampling are plenty for a camera feed, and take a good share off the decode time.
+    mInfo.out_color_space = JCS_EXT_RGBA;
+    mInfo.dct_method = JDCT_IFAST;
+    mInfo.do_fancy_upsampling = FALSE;
+    jpeg_start_decompress(&mInfo);
+
+    // Decode every row directly into its place in the output buffer
+    const unsigned strideBytes = tgtBuff.stride * 4;
+    mRows.resize(mInfo.output_height);
+    for (unsigned row = 0; row < mInfo.output_height; row++) {
+        mRows[row] = tgt + row * strideBytes;
+    }
+    while (mInfo.output_scanline < mInfo.output_height) {
+        jpeg_read_scanlines(&mInfo, &mRows[mInfo.output_scanline],
+                            mInfo.output_height - mInfo.output_scanline);
+    }
+
+    jpeg_finish_decompress(&mInfo);
+    return !mError.damaged;
+}
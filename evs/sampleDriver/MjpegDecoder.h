@@ -0,0 +1,63 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_MJPEGDECODER_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_MJPEGDECODER_H
+
+#include <csetjmp>
+#include <cstdio>
+#include <vector>
+
+#include <jpeglib.h>
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+
+
+using ::android::hardware::automotive::evs::V1_0::BufferDesc;
+
+
+// Decodes MJPEG capture frames straight into RGBA output buffers with libjpeg-turbo, which
+// uses the CPU's SIMD units for the IDCT, upsampling and color conversion.  Frames from UVC
+// cameras often leave out their Huffman tables, and libjpeg-turbo fills in the standard ones.
+//
+// Not thread safe:  each camera's capture thread should have its own.
+class MjpegDecoder {
+public:
+    MjpegDecoder();
+    ~MjpegDecoder();
+
+    // Decodes one compressed frame of exactly the target's size.  Returns false if the frame
+    // is damaged, even if libjpeg could carry on past the damage, or doesn't fit, in which case
+    // the target holds nothing worth showing.
+    bool decode(const BufferDesc& tgtBuff, uint8_t* tgt, const void* data, size_t size);
+
+private:
+    struct ErrorManager {
+        jpeg_error_mgr  pub;    // Must come first, since libjpeg only knows about this part
+        jmp_buf         jump;   // Where decode() picks up after a fatal error
+        bool            damaged;    // Set by libjpeg warnings about the current frame
+    };
+
+    static void onFatalError(j_common_ptr info);
+    static void onMessage(j_common_ptr info, int msgLevel);
+
+    jpeg_decompress_struct  mInfo = {};
+    ErrorManager            mError = {};
+    std::vector<JSAMPROW>   mRows;          // Where each decoded row goes in the target
+    bool                    mWarnedSize = false;
+};
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_MJPEGDECODER_H
@@ -0,0 +1,195 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "OutputBufferRing.h"
+#include "GrallocPool.h"
+
+#include <log/log.h>
+
+#include <algorithm>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+OutputBufferRing::OutputBufferRing(const std::string& cameraId, const char* requester,
+                                   unsigned maxBuffers) :
+        mCameraId(cameraId),
+        mRequester(requester),
+        mMaxBuffers(maxBuffers) {
+}
+
+
+OutputBufferRing::~OutputBufferRing() {
+    releaseAll();
+}
+
+
+void OutputBufferRing::setFormat(uint32_t width, uint32_t height, uint32_t format,
+                                 uint32_t usage) {
+    mWidth = width;
+    mHeight = height;
+    mFormat = format;
+    mUsage = usage;
+}
+
+
+bool OutputBufferRing::setCount(unsigned count) {
+    if (count > mMaxBuffers) {
+        ALOGE("Rejecting buffer request in excess of internal limit");
+        return false;
+    }
+
+    if (count <= mFramesAllowed) {
+        mFramesAllowed = count;
+        trim();
+        return true;
+    }
+
+    unsigned held = std::count_if(mBuffers.begin(), mBuffers.end(),
+                                  [](const BufferRecord& rec) { return rec.handle != nullptr; });
+    while (held < count) {
+        GrallocPool::Buffer buffer;
+        if (!GrallocPool::acquire(mCameraId, mWidth, mHeight, mFormat, mUsage, mRequester,
+                                  &buffer)) {
+            trim();
+            return false;
+        }
+        if (mStride && mStride != buffer.stride) {
+            ALOGE("We did not expect to get buffers with different strides!");
+        }
+        mStride = buffer.stride;
+
+        // Reuse an empty record if we have one, so buffer ids stay small
+        auto empty = std::find_if(mBuffers.begin(), mBuffers.end(),
+                                  [](const BufferRecord& rec) { return rec.handle == nullptr; });
+        if (empty == mBuffers.end()) {
+            empty = mBuffers.emplace(mBuffers.end());
+        }
+        empty->handle = buffer.handle;
+        empty->inUse = false;
+        held++;
+    }
+
+    mFramesAllowed = count;
+    return true;
+}
+
+
+bool OutputBufferRing::take(BufferDesc* buff) {
+    if (!haveRoom()) {
+        // Can't do anything right now -- skip this frame
+        ALOGW("%s skipped a frame because too many are in flight", mCameraId.c_str());
+        return false;
+    }
+    auto free = std::find_if(mBuffers.begin(), mBuffers.end(),
+                             [](const BufferRecord& rec) {
+                                 return rec.handle != nullptr && !rec.inUse;
+                             });
+    if (free == mBuffers.end()) {
+        ALOGE("Failed to find an available buffer slot");
+        return false;
+    }
+    free->inUse = true;
+    mFramesInUse++;
+
+    buff->width     = mWidth;
+    buff->height    = mHeight;
+    buff->stride    = mStride;
+    buff->format    = mFormat;
+    buff->usage     = mUsage;
+    buff->bufferId  = free - mBuffers.begin();
+    buff->memHandle = free->handle;
+    return true;
+}
+
+
+void OutputBufferRing::putBack(uint32_t bufferId) {
+    if (bufferId < mBuffers.size() && mBuffers[bufferId].inUse) {
+        mBuffers[bufferId].inUse = false;
+        mFramesInUse--;
+        trim();
+    }
+}
+
+
+bool OutputBufferRing::doneWithFrame(const BufferDesc& buffer) {
+    if (buffer.memHandle == nullptr) {
+        ALOGE("ignoring doneWithFrame called with null handle");
+    } else if (buffer.bufferId >= mBuffers.size()) {
+        ALOGE("ignoring doneWithFrame called with invalid bufferId %d (max is %zu)",
+              buffer.bufferId, mBuffers.size() - 1);
+    } else if (!mBuffers[buffer.bufferId].inUse) {
+        ALOGE("ignoring doneWithFrame called on frame %d which is already free",
+              buffer.bufferId);
+    } else {
+        mBuffers[buffer.bufferId].inUse = false;
+        mFramesInUse--;
+
+        // The client may have asked for fewer buffers while it was holding this one
+        trim();
+        return true;
+    }
+    return false;
+}
+
+
+void OutputBufferRing::releaseAll() {
+    for (auto&& rec : mBuffers) {
+        if (rec.handle == nullptr) {
+            // Nothing to give back
+        } else if (rec.inUse) {
+            ALOGW("Error - releasing buffer despite remote ownership");
+            GrallocPool::discard({ rec.handle, mStride, nullptr });
+        } else {
+            GrallocPool::release(mCameraId, mWidth, mHeight, mFormat, mUsage,
+                                 { rec.handle, mStride, nullptr });
+        }
+    }
+    mBuffers.clear();
+    mFramesAllowed = 0;
+    mFramesInUse = 0;
+}
+
+
+// Gives free buffers back until we hold no more than mFramesAllowed
+void OutputBufferRing::trim() {
+    unsigned held = std::count_if(mBuffers.begin(), mBuffers.end(),
+                                  [](const BufferRecord& rec) { return rec.handle != nullptr; });
+    for (auto&& rec : mBuffers) {
+        if (held <= mFramesAllowed) {
+            break;
+        }
+        if (rec.handle != nullptr && !rec.inUse) {
+            GrallocPool::release(mCameraId, mWidth, mHeight, mFormat, mUsage,
+                                 { rec.handle, mStride, nullptr });
+            rec.handle = nullptr;
+            held--;
+        }
+    }
+}
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
@@ -0,0 +1,95 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_OUTPUTBUFFERRING_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_OUTPUTBUFFERRING_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+
+#include <string>
+#include <vector>
+
+
+namespace android {
+namespace hardware {
+namespace automotive {
+namespace evs {
+namespace V1_0 {
+namespace implementation {
+
+
+// The output buffers of a camera that makes its own frames rather than capturing them, taken from
+// and given back to GrallocPool.  Clients set how many there are, and we hand out whichever is
+// free.  It has no lock of its own: the camera that owns it guards it with its access lock.
+class OutputBufferRing {
+public:
+    OutputBufferRing(const std::string& cameraId, const char* requester, unsigned maxBuffers);
+    ~OutputBufferRing();
+
+    // What every buffer looks like.  Set once, before the first setCount().
+    void setFormat(uint32_t width, uint32_t height, uint32_t format, uint32_t usage);
+
+    // Holds this many buffers.  Buffers being given up are freed now if they're free, or else
+    // when they come back.
+    bool setCount(unsigned count);
+    unsigned count() const { return mFramesAllowed; };
+
+    // Whether take() would find us allowed another buffer right now
+    bool haveRoom() const { return mFramesInUse < mFramesAllowed; };
+
+    // Marks a free buffer in use, and describes it in buff for delivery
+    bool take(BufferDesc* buff);
+
+    // Gives back a buffer that take() handed out but that never reached the client
+    void putBack(uint32_t bufferId);
+
+    // Gives back a buffer the client returned.  False if it wasn't one we had handed out.
+    bool doneWithFrame(const BufferDesc& buffer);
+
+    // Lets go of every buffer, freeing any the client still holds
+    void releaseAll();
+
+private:
+    struct BufferRecord {
+        buffer_handle_t handle = nullptr;   // Null if the record is empty
+        bool            inUse = false;
+    };
+
+    void trim();
+
+    const std::string           mCameraId;
+    const char* const           mRequester;
+    const unsigned              mMaxBuffers;
+
+    uint32_t                    mWidth = 0;
+    uint32_t                    mHeight = 0;
+    uint32_t                    mFormat = 0;    // Values from android_pixel_format_t
+    uint32_t                    mUsage = 0;
+
+    std::vector<BufferRecord>   mBuffers;
+    unsigned                    mFramesAllowed = 0;
+    unsigned                    mFramesInUse = 0;
+    uint32_t                    mStride = 0;    // Pixels per row of our buffers
+};
+
+} // namespace implementation
+} // namespace V1_0
+} // namespace evs
+} // namespace automotive
+} // namespace hardware
+} // namespace android
+
+#endif  // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_OUTPUTBUFFERRING_H
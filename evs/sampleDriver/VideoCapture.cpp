@@ -20,12 +20,19 @@
 #include <memory.h>
 #include <fcntl.h>
 #include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
 #include <sys/ioctl.h>
 #include <sys/mman.h>
+#include <poll.h>
 #include <cutils/log.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
 
 #include "assert.h"
 
+#include <algorithm>
+
 #include "VideoCapture.h"
 
 
@@ -33,10 +40,10 @@
 //        during the resource setup phase.  Of particular note is the potential to leak
 //        the file descriptor.  This must be fixed before using this code for anything but
 //        experimentation.
-bool VideoCapture::open(const char* deviceName) {
-    // If we want a polling interface for getting frames, we would use O_NONBLOCK
-//    int mDeviceFd = open(deviceName, O_RDWR | O_NONBLOCK, 0);
-    mDeviceFd = ::open(deviceName, O_RDWR, 0);
+bool VideoCapture::open(const char* deviceName, const std::vector<__u32>& formats,
+                        __u32 width, __u32 height) {
+    // We wait for frames with epoll so we can be woken up to stop without one arriving
+    mDeviceFd = ::open(deviceName, O_RDWR | O_NONBLOCK, 0);
     if (mDeviceFd < 0) {
         ALOGE("failed to open device %s (%d = %s)", deviceName, errno, strerror(errno));
         return false;
@@ -64,6 +71,7 @@ bool VideoCapture::open(const char* deviceName) {
 
     // Enumerate the available capture formats (if any)
     ALOGI("Supported capture formats:");
+    std::vector<__u32> supportedFormats;
     v4l2_fmtdesc formatDescriptions;
     formatDescriptions.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     for (int i=0; true; i++) {
@@ -75,6 +83,7 @@ bool VideoCapture::open(const char* deviceName) {
                    formatDescriptions.pixelformat,
                    formatDescriptions.flags
             );
+            supportedFormats.push_back(formatDescriptions.pixelformat);
         } else {
             // No more formats available
             break;
@@ -89,20 +98,43 @@ bool VideoCapture::open(const char* deviceName) {
         return false;
     }
 
+    // Pick the first format our caller can use that the device offers
+    __u32 chosenFormat = 0;
+    for (auto&& candidate : formats) {
+        if (std::find(supportedFormats.begin(), supportedFormats.end(), candidate) !=
+            supportedFormats.end()) {
+            chosenFormat = candidate;
+            break;
+        }
+    }
+
     // Set our desired output format
-    v4l2_format format;
+    v4l2_format format = {};
     format.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    format.fmt.pix.pixelformat = V4L2_PIX_FMT_UYVY;
-    format.fmt.pix.width = 720;
-    format.fmt.pix.height = 240;
-    ALOGI("Requesting format %c%c%c%c (0x%08X)",
-          ((char*)&format.fmt.pix.pixelformat)[0],
-          ((char*)&format.fmt.pix.pixelformat)[1],
-          ((char*)&format.fmt.pix.pixelformat)[2],
-          ((char*)&format.fmt.pix.pixelformat)[3],
-          format.fmt.pix.pixelformat);
-    if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0) {
-        ALOGE("VIDIOC_S_FMT: %s", strerror(errno));
+    if (chosenFormat == 0) {
+        ALOGE("%s doesn't offer any of the %zu formats we can use", deviceName, formats.size());
+    } else if (ioctl(mDeviceFd, VIDIOC_G_FMT, &format) < 0) {
+        ALOGE("VIDIOC_G_FMT: %s", strerror(errno));
+    } else {
+        // Start from the current settings so anything we don't care about stays as it was
+        if (width == 0 || height == 0) {
+            width  = format.fmt.pix.width;
+            height = format.fmt.pix.height;
+        }
+        chooseFrameSize(chosenFormat, width, height);
+
+        format.fmt.pix.pixelformat = chosenFormat;
+        format.fmt.pix.width = width;
+        format.fmt.pix.height = height;
+        ALOGI("Requesting format %c%c%c%c (0x%08X) at %ux%u",
+              ((char*)&format.fmt.pix.pixelformat)[0],
+              ((char*)&format.fmt.pix.pixelformat)[1],
+              ((char*)&format.fmt.pix.pixelformat)[2],
+              ((char*)&format.fmt.pix.pixelformat)[3],
+              format.fmt.pix.pixelformat, width, height);
+        if (ioctl(mDeviceFd, VIDIOC_S_FMT, &format) < 0) {
+            ALOGE("VIDIOC_S_FMT: %s", strerror(errno));
+        }
     }
 
     // Report the current output format
@@ -113,6 +145,7 @@ bool VideoCapture::open(const char* deviceName) {
         mWidth  = format.fmt.pix.width;
         mHeight = format.fmt.pix.height;
         mStride = format.fmt.pix.bytesperline;
+        mSizeImage = format.fmt.pix.sizeimage;
 
         ALOGI("Current output format:  fmt=0x%X, %dx%d, pitch=%d",
                format.fmt.pix.pixelformat,
@@ -134,11 +167,80 @@ bool VideoCapture::open(const char* deviceName) {
 }
 
 
+// Adjusts the given size to the closest frame size the device supports for the given format.
+// We prefer an exact match, then the smallest size that covers the request, then the largest.
+bool VideoCapture::chooseFrameSize(__u32 format, __u32& width, __u32& height) {
+    v4l2_frmsizeenum frameSize = {};
+    frameSize.pixel_format = format;
+    frameSize.index = 0;
+    if (ioctl(mDeviceFd, VIDIOC_ENUM_FRAMESIZES, &frameSize) < 0) {
+        // The driver doesn't say, so just ask for what we want and let VIDIOC_S_FMT adjust it
+        return false;
+    }
+
+    if (frameSize.type != V4L2_FRMSIZE_TYPE_DISCRETE) {
+        // Stepwise (or continuous, which is stepwise with a step of 1)
+        const v4l2_frmsize_stepwise& range = frameSize.stepwise;
+        auto fit = [](__u32 value, __u32 min, __u32 max, __u32 step) {
+            value = std::min(std::max(value, min), max);
+            return step > 1 ? min + (value - min) / step * step : value;
+        };
+        width  = fit(width,  range.min_width,  range.max_width,  range.step_width);
+        height = fit(height, range.min_height, range.max_height, range.step_height);
+        return true;
+    }
+
+    __u32 bestCover = 0, bestCoverWidth = 0, bestCoverHeight = 0;
+    __u32 largest = 0, largestWidth = 0, largestHeight = 0;
+    do {
+        const __u32 w = frameSize.discrete.width;
+        const __u32 h = frameSize.discrete.height;
+        if (w == width && h == height) {
+            return true;
+        }
+
+        const __u32 area = w * h;
+        if (w >= width && h >= height && (bestCover == 0 || area < bestCover)) {
+            bestCover = area;
+            bestCoverWidth = w;
+            bestCoverHeight = h;
+        }
+        if (area > largest) {
+            largest = area;
+            largestWidth = w;
+            largestHeight = h;
+        }
+
+        frameSize.index++;
+    } while (ioctl(mDeviceFd, VIDIOC_ENUM_FRAMESIZES, &frameSize) == 0);
+
+    if (bestCover > 0) {
+        width = bestCoverWidth;
+        height = bestCoverHeight;
+    } else {
+        width = largestWidth;
+        height = largestHeight;
+    }
+    return true;
+}
+
+
 void VideoCapture::close() {
     ALOGD("VideoCapture::close");
     // Stream should be stopped first!
     assert(mRunMode == STOPPED);
 
+    // A capture thread that ended on its own after an error still left its stream open
+    if (mCaptureThread.joinable()) {
+        stopStream();
+    }
+
+    // Let go of any buffers we were keeping primed
+    if (mBuffersReady) {
+        releaseBuffers();
+    }
+    mKeepBuffers = false;
+
     if (isOpen()) {
         ALOGD("closing video device file handled %d", mDeviceFd);
         ::close(mDeviceFd);
@@ -147,75 +249,107 @@ void VideoCapture::close() {
 }
 
 
-bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback) {
-    // Set the state of our background thread
-    int prevRunMode = mRunMode.fetch_or(RUN);
-    if (prevRunMode & RUN) {
-        // The background thread is already running, so we can't start a new stream
-        ALOGE("Already in RUN state, so we can't start a new streaming thread");
+bool VideoCapture::setNumBuffers(unsigned numBuffers) {
+    if (mRunMode != STOPPED) {
+        ALOGE("Can't change the capture buffer count while the stream is running");
+        return false;
+    }
+    if (numBuffers < 1) {
+        ALOGE("We need at least one capture buffer");
         return false;
     }
 
-    // Tell the L4V2 driver to prepare our streaming buffers
-    v4l2_requestbuffers bufrequest;
-    bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    bufrequest.memory = V4L2_MEMORY_MMAP;
-    bufrequest.count = 1;
-    if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
-        ALOGE("VIDIOC_REQBUFS: %s", strerror(errno));
+    // Any buffers we primed were allocated for the old count
+    if (mBuffersReady && numBuffers != mNumBuffers && !isUsingExternalBuffers()) {
+        releaseBuffers();
+    }
+
+    mNumBuffers = numBuffers;
+    return true;
+}
+
+
+bool VideoCapture::setExternalBuffers(const std::vector<int>& dmaBufFds) {
+    if (mRunMode != STOPPED) {
+        ALOGE("Can't change the capture buffers while the stream is running");
         return false;
     }
+    for (auto&& fd : dmaBufFds) {
+        if (fd < 0) {
+            ALOGE("Rejecting invalid dmabuf fd for external capture buffer");
+            return false;
+        }
+    }
+
+    // Any buffers we primed belong to the old arrangement
+    if (mBuffersReady && dmaBufFds != mDmaBufFds) {
+        releaseBuffers();
+    }
+
+    mDmaBufFds = dmaBufFds;
+    return true;
+}
+
 
-    // Get the information on the buffer that was created for us
-    memset(&mBufferInfo, 0, sizeof(mBufferInfo));
-    mBufferInfo.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    mBufferInfo.memory   = V4L2_MEMORY_MMAP;
-    mBufferInfo.index    = 0;
-    if (ioctl(mDeviceFd, VIDIOC_QUERYBUF, &mBufferInfo) < 0) {
-        ALOGE("VIDIOC_QUERYBUF: %s", strerror(errno));
+bool VideoCapture::prime() {
+    if (mRunMode != STOPPED) {
+        ALOGE("Can't prime the capture buffers while the stream is running");
         return false;
     }
 
-    ALOGI("Buffer description:");
-    ALOGI("  offset: %d", mBufferInfo.m.offset);
-    ALOGI("  length: %d", mBufferInfo.length);
-
-    // Get a pointer to the buffer contents by mapping into our address space
-    mPixelBuffer = mmap(
-            NULL,
-            mBufferInfo.length,
-            PROT_READ | PROT_WRITE,
-            MAP_SHARED,
-            mDeviceFd,
-            mBufferInfo.m.offset
-    );
-    if( mPixelBuffer == MAP_FAILED) {
-        ALOGE("mmap: %s", strerror(errno));
+    // From now on we hold onto the buffers between streams
+    mKeepBuffers = true;
+    return mBuffersReady || allocateBuffers();
+}
+
+
+bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback,
+                               std::function<void()> onStop) {
+    // A capture thread that ended on its own after an error still left its stream and event loop
+    // open, and its std::thread can't be replaced until it is joined
+    if (mRunMode == STOPPED && mCaptureThread.joinable()) {
+        stopStream();
+    }
+
+    // Set the state of our background thread
+    int prevRunMode = mRunMode.fetch_or(RUN);
+    if (prevRunMode & RUN) {
+        // The background thread is already running, so we can't start a new stream
+        ALOGE("Already in RUN state, so we can't start a new streaming thread");
         return false;
     }
-    memset(mPixelBuffer, 0, mBufferInfo.length);
-    ALOGI("Buffer mapped at %p", mPixelBuffer);
 
-    // Queue the first capture buffer
-    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfo) < 0) {
-        ALOGE("VIDIOC_QBUF: %s", strerror(errno));
+    // Unless we were primed, get the capture buffers ready now
+    if (!mBuffersReady && !allocateBuffers()) {
+        mRunMode = STOPPED;
         return false;
     }
 
     // Start the video stream
-    int type = mBufferInfo.type;
+    int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
     if (ioctl(mDeviceFd, VIDIOC_STREAMON, &type) < 0) {
         ALOGE("VIDIOC_STREAMON: %s", strerror(errno));
+        releaseBuffers();
+        mRunMode = STOPPED;
         return false;
     }
 
-    // Remember who to tell about new frames as they arrive
+    // Set up what our capture thread waits on:  the device, and a way to tell it to stop
+    if (!openEventLoop()) {
+        ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type);
+        releaseBuffers();
+        mRunMode = STOPPED;
+        return false;
+    }
+
+    // Remember who to tell about new frames as they arrive, and about the thread ending
     mCallback = callback;
+    mOnStop = onStop;
 
     // Fire up a thread to receive and dispatch the video frames
     mCaptureThread = std::thread([this](){ collectFrames(); });
 
-    ALOGD("Stream started.");
+    ALOGD("Stream started with %zu capture buffers.", mBufferInfos.size());
     return true;
 }
 
@@ -223,53 +357,237 @@ bool VideoCapture::startStream(std::function<void(VideoCapture*, imageBuffer*, v
 void VideoCapture::stopStream() {
     // Tell the background thread to stop
     int prevRunMode = mRunMode.fetch_or(STOPPING);
-    if (prevRunMode == STOPPED) {
-        // The background thread wasn't running, so set the flag back to STOPPED
-        mRunMode = STOPPED;
-    } else if (prevRunMode & STOPPING) {
+    if (prevRunMode & STOPPING) {
         ALOGE("stopStream called while stream is already stopping.  Reentrancy is not supported!");
         return;
-    } else {
-        // Block until the background thread is stopped
-        if (mCaptureThread.joinable()) {
-            mCaptureThread.join();
+    }
+
+    // The capture thread may already have ended on its own after a device error, in which case
+    // the stream and the event loop are still open just the same
+    if (mCaptureThread.joinable()) {
+        // Wake the background thread in case it's waiting for a frame, then wait for it to stop
+        if (prevRunMode & RUN) {
+            const uint64_t wake = 1;
+            if (write(mWakeFd, &wake, sizeof(wake)) != sizeof(wake)) {
+                ALOGE("Failed to wake the capture thread: %s", strerror(errno));
+            }
         }
+        mCaptureThread.join();
+        closeEventLoop();
 
         // Stop the underlying video stream (automatically empties the buffer queue)
-        int type = mBufferInfo.type;
+        int type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
         if (ioctl(mDeviceFd, VIDIOC_STREAMOFF, &type) < 0) {
             ALOGE("VIDIOC_STREAMOFF: %s", strerror(errno));
         }
 
         ALOGD("Capture thread stopped.");
+    } else if (mKeepBuffers) {
+        // We never streamed, and any buffers we primed are still queued, so there's nothing
+        // more to do
+        mRunMode = STOPPED;
+        return;
+    }
+    mRunMode = STOPPED;
+
+    // If we've been primed, keep the buffers ready for the next stream.  Otherwise unmap the
+    // buffers we allocated and hand them back to the driver.
+    if (!mKeepBuffers || !requeueBuffers()) {
+        releaseBuffers();
+    }
+
+    // Drop our reference to the frame delivery callback interface
+    mCallback = nullptr;
+    mOnStop = nullptr;
+}
+
+
+bool VideoCapture::allocateBuffers() {
+    // Tell the L4V2 driver to prepare our streaming buffers
+    const bool external = isUsingExternalBuffers();
+    const unsigned requested = external ? mDmaBufFds.size() : mNumBuffers;
+    v4l2_requestbuffers bufrequest;
+    bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    bufrequest.memory = external ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
+    bufrequest.count = requested;
+    if (ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest) < 0) {
+        ALOGE("VIDIOC_REQBUFS: %s", strerror(errno));
+        return false;
+    }
+
+    // The driver is allowed to give us a different number of buffers than we asked for
+    if (bufrequest.count < 1) {
+        ALOGE("VIDIOC_REQBUFS didn't provide any buffers");
+        return false;
+    }
+    if (bufrequest.count != requested) {
+        if (external) {
+            // Every external buffer must map to exactly one driver slot
+            ALOGE("Driver can't capture into %u external buffers (offered %u)",
+                  requested, bufrequest.count);
+            releaseBuffers();
+            return false;
+        }
+        ALOGW("Requested %u capture buffers, but got %u", requested, bufrequest.count);
+    }
+
+    mBufferInfos.resize(bufrequest.count);
+    mCaptureTimes.assign(bufrequest.count, 0);
+    mPixelBuffers.assign(bufrequest.count, MAP_FAILED);
+    for (unsigned i = 0; i < bufrequest.count; i++) {
+        v4l2_buffer& bufferInfo = mBufferInfos[i];
+        memset(&bufferInfo, 0, sizeof(bufferInfo));
+        bufferInfo.type     = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        bufferInfo.memory   = bufrequest.memory;
+        bufferInfo.index    = i;
+
+        if (external) {
+            // The driver writes straight into the client visible buffer, so there's nothing
+            // for us to map
+            bufferInfo.m.fd     = mDmaBufFds[i];
+            bufferInfo.length   = mSizeImage;
+        } else {
+            // Get the information on the buffer that was created for us
+            if (ioctl(mDeviceFd, VIDIOC_QUERYBUF, &bufferInfo) < 0) {
+                ALOGE("VIDIOC_QUERYBUF: %s", strerror(errno));
+                releaseBuffers();
+                return false;
+            }
+
+            ALOGI("Buffer %u description:", i);
+            ALOGI("  offset: %d", bufferInfo.m.offset);
+            ALOGI("  length: %d", bufferInfo.length);
+
+            // Get a pointer to the buffer contents by mapping into our address space
+            mPixelBuffers[i] = mmap(
+                    NULL,
+                    bufferInfo.length,
+                    PROT_READ | PROT_WRITE,
+                    MAP_SHARED,
+                    mDeviceFd,
+                    bufferInfo.m.offset
+            );
+            if (mPixelBuffers[i] == MAP_FAILED) {
+                ALOGE("mmap: %s", strerror(errno));
+                releaseBuffers();
+                return false;
+            }
+            ALOGI("Buffer %u mapped at %p", i, mPixelBuffers[i]);
+        }
+
+        // Queue this buffer so the driver can start filling it as soon as we start streaming
+        if (ioctl(mDeviceFd, VIDIOC_QBUF, &bufferInfo) < 0) {
+            ALOGE("VIDIOC_QBUF: %s", strerror(errno));
+            releaseBuffers();
+            return false;
+        }
+    }
+
+    mBuffersReady = true;
+    return true;
+}
+
+
+bool VideoCapture::requeueBuffers() {
+    // STREAMOFF took every buffer back from the driver, so give them all to it again
+    mLatestBuffer = -1;
+    mFrameReady = false;
+    for (unsigned i = 0; i < mBufferInfos.size(); i++) {
+        if (isUsingExternalBuffers()) {
+            mBufferInfos[i].m.fd   = mDmaBufFds[i];
+            mBufferInfos[i].length = mSizeImage;
+        }
+        if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[i]) < 0) {
+            ALOGE("VIDIOC_QBUF: %s", strerror(errno));
+            return false;
+        }
     }
 
-    // Unmap the buffers we allocated
-    munmap(mPixelBuffer, mBufferInfo.length);
+    return true;
+}
+
+
+void VideoCapture::releaseBuffers() {
+    // Unmap the buffers we allocated (external buffers were never mapped)
+    for (unsigned i = 0; i < mPixelBuffers.size(); i++) {
+        if (mPixelBuffers[i] != MAP_FAILED) {
+            munmap(mPixelBuffers[i], mBufferInfos[i].length);
+        }
+    }
+    mPixelBuffers.clear();
+    mBufferInfos.clear();
+    mCaptureTimes.clear();
+    mLatestBuffer = -1;
+
+    // Close any dmabufs we handed out
+    for (auto&& fd : mExportedFds) {
+        if (fd >= 0) {
+            ::close(fd);
+        }
+    }
+    mExportedFds.clear();
+    mFrameReady = false;
 
     // Tell the L4V2 driver to release our streaming buffers
     v4l2_requestbuffers bufrequest;
     bufrequest.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
-    bufrequest.memory = V4L2_MEMORY_MMAP;
+    bufrequest.memory = isUsingExternalBuffers() ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
     bufrequest.count = 0;
     ioctl(mDeviceFd, VIDIOC_REQBUFS, &bufrequest);
+    mBuffersReady = false;
+}
 
-    // Drop our reference to the frame delivery callback interface
-    mCallback = nullptr;
+
+int VideoCapture::exportBuffer(unsigned bufferIndex) {
+    if (isUsingExternalBuffers() || bufferIndex >= mBufferInfos.size()) {
+        return -1;
+    }
+
+    if (mExportedFds.size() != mBufferInfos.size()) {
+        mExportedFds.assign(mBufferInfos.size(), -1);
+    }
+
+    if (mExportedFds[bufferIndex] < 0) {
+        v4l2_exportbuffer expbuf = {};
+        expbuf.type = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+        expbuf.index = bufferIndex;
+        expbuf.flags = O_RDONLY | O_CLOEXEC;
+        if (ioctl(mDeviceFd, VIDIOC_EXPBUF, &expbuf) < 0) {
+            ALOGE("VIDIOC_EXPBUF failed for buffer %u: %s", bufferIndex, strerror(errno));
+            return -1;
+        }
+        mExportedFds[bufferIndex] = expbuf.fd;
+    }
+
+    return mExportedFds[bufferIndex];
 }
 
 
-void VideoCapture::markFrameReady() {
+void VideoCapture::markFrameReady(unsigned bufferIndex) {
+    mLatestBuffer = bufferIndex;
     mFrameReady = true;
 };
 
 
-bool VideoCapture::returnFrame() {
-    // We're giving the frame back to the system, so clear the "ready" flag
-    mFrameReady = false;
+bool VideoCapture::returnFrame(unsigned bufferIndex) {
+    ATRACE_CALL();
+    if (bufferIndex >= mBufferInfos.size()) {
+        ALOGE("Ignoring return of unrecognized capture buffer %u", bufferIndex);
+        return false;
+    }
+
+    // We're giving the frame back to the system, so clear the "ready" flag if
+    // it was the newest one we had
+    if (mLatestBuffer == (int)bufferIndex) {
+        mFrameReady = false;
+    }
 
     // Requeue the buffer to capture the next available frame
-    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfo) < 0) {
+    if (isUsingExternalBuffers()) {
+        mBufferInfos[bufferIndex].m.fd   = mDmaBufFds[bufferIndex];
+        mBufferInfos[bufferIndex].length = mSizeImage;
+    }
+    if (ioctl(mDeviceFd, VIDIOC_QBUF, &mBufferInfos[bufferIndex]) < 0) {
         ALOGE("VIDIOC_QBUF: %s", strerror(errno));
         return false;
     }
@@ -278,25 +596,152 @@ bool VideoCapture::returnFrame() {
 }
 
 
+bool VideoCapture::openEventLoop() {
+    mWakeFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    if (mWakeFd < 0 || mEpollFd < 0) {
+        ALOGE("Failed to create capture event loop: %s", strerror(errno));
+        closeEventLoop();
+        return false;
+    }
+
+    epoll_event event = {};
+    event.events = EPOLLIN;
+    event.data.fd = mDeviceFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mDeviceFd, &event) < 0) {
+        ALOGE("Failed to watch video device: %s", strerror(errno));
+        closeEventLoop();
+        return false;
+    }
+    event.data.fd = mWakeFd;
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mWakeFd, &event) < 0) {
+        ALOGE("Failed to watch capture wake up event: %s", strerror(errno));
+        closeEventLoop();
+        return false;
+    }
+
+    return true;
+}
+
+
+void VideoCapture::closeEventLoop() {
+    if (mEpollFd >= 0) {
+        ::close(mEpollFd);
+        mEpollFd = -1;
+    }
+    if (mWakeFd >= 0) {
+        ::close(mWakeFd);
+        mWakeFd = -1;
+    }
+}
+
+
 // This runs on a background thread to receive and dispatch video frames
 void VideoCapture::collectFrames() {
     // Run until our atomic signal is cleared
     while (mRunMode == RUN) {
-        // Wait for a buffer to be ready
-        if (ioctl(mDeviceFd, VIDIOC_DQBUF, &mBufferInfo) < 0) {
-            ALOGE("VIDIOC_DQBUF: %s", strerror(errno));
+        // Wait for the device to have a frame for us, or for stopStream() to wake us up
+        epoll_event events[2];
+        int numEvents = epoll_wait(mEpollFd, events, 2, -1);
+        if (numEvents < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("epoll_wait: %s", strerror(errno));
             break;
         }
 
-        markFrameReady();
+        bool deviceError = false;
+        bool deviceReady = false;
+        for (int i = 0; i < numEvents; i++) {
+            if (events[i].data.fd == mDeviceFd) {
+                deviceError |= (events[i].events & EPOLLERR) != 0;
+                deviceReady = true;
+            }
+        }
+        if (!deviceReady) {
+            // We were woken up to stop, which the loop condition takes care of
+            continue;
+        }
 
-        // If a callback was requested per frame, do that now
-        if (mCallback) {
-            mCallback(this, &mBufferInfo, mPixelBuffer);
+        // Collect every frame the driver has finished for us
+        bool failed = false;
+        unsigned framesCollected = 0;
+        while (mRunMode == RUN && !failed) {
+            if (collectFrame()) {
+                framesCollected++;
+            } else if (errno == EAGAIN) {
+                break;
+            } else {
+                failed = true;
+            }
+        }
+        if (failed) {
+            break;
+        }
+
+        if (deviceError && framesCollected == 0) {
+            // Some drivers report an error while every buffer is held by our clients.  Since
+            // that's level triggered, back off for a moment (unless we're asked to stop).
+            pollfd wakeFd = { mWakeFd, POLLIN, 0 };
+            poll(&wakeFd, 1, kErrorBackoffMs);
         }
     }
 
+    // Let our client clean up whatever it kept on this thread before we go
+    if (mOnStop) {
+        mOnStop();
+    }
+
     // Mark ourselves stopped
     ALOGD("VideoCapture thread ending");
     mRunMode = STOPPED;
 }
+
+
+// Dequeues and dispatches one frame.  Returns false with errno set if there wasn't one to get.
+bool VideoCapture::collectFrame() {
+    ATRACE_CALL();
+
+    // The driver tells us which slot of the ring it filled
+    v4l2_buffer buf = {};
+    buf.type   = V4L2_BUF_TYPE_VIDEO_CAPTURE;
+    buf.memory = isUsingExternalBuffers() ? V4L2_MEMORY_DMABUF : V4L2_MEMORY_MMAP;
+    ATRACE_BEGIN("VIDIOC_DQBUF");
+    const int result = ioctl(mDeviceFd, VIDIOC_DQBUF, &buf);
+    const int dqbufErrno = errno;
+    ATRACE_END();
+    errno = dqbufErrno;
+    if (result < 0) {
+        if (errno != EAGAIN) {
+            ALOGE("VIDIOC_DQBUF: %s", strerror(errno));
+        }
+        return false;
+    }
+    if (buf.index >= mBufferInfos.size()) {
+        ALOGE("VIDIOC_DQBUF returned unexpected buffer index %u", buf.index);
+        errno = EINVAL;
+        return false;
+    }
+
+    // Keep the latest per-frame metadata (timestamp, sequence, bytes used)
+    mBufferInfos[buf.index] = buf;
+
+    // Use the driver's capture time if it's on a clock the rest of the system can compare to
+    if ((buf.flags & V4L2_BUF_FLAG_TIMESTAMP_MASK) == V4L2_BUF_FLAG_TIMESTAMP_MONOTONIC) {
+        mCaptureTimes[buf.index] = seconds_to_nanoseconds(buf.timestamp.tv_sec) +
+                                   microseconds_to_nanoseconds(buf.timestamp.tv_usec);
+    } else {
+        mCaptureTimes[buf.index] = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
+
+    markFrameReady(buf.index);
+
+    // If a callback was requested per frame, do that now
+    if (mCallback) {
+        void* data = isUsingExternalBuffers() ? nullptr : mPixelBuffers[buf.index];
+        mCallback(this, &mBufferInfos[buf.index], data);
+    }
+
+    return true;
+}
@@ -19,18 +19,46 @@
 #include <atomic>
 #include <thread>
 #include <functional>
+#include <vector>
 #include <linux/videodev2.h>
 
 
 typedef v4l2_buffer imageBuffer;
 
 
+// Number of capture buffers we ask the V4L2 driver for unless told otherwise
+static const unsigned kDefaultNumCaptureBuffers = 4;
+
+
 class VideoCapture {
 public:
-    bool open(const char* deviceName);
+    // Opens the device and picks its capture mode.  We use the first of the given pixel formats
+    // the device supports, at its supported frame size closest to the one requested.  A zero
+    // width or height keeps the device's current frame size.
+    bool open(const char* deviceName, const std::vector<__u32>& formats,
+              __u32 width = 0, __u32 height = 0);
     void close();
 
-    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr);
+    // Sets the depth of the capture buffer ring.  Only valid while the stream is stopped.
+    bool setNumBuffers(unsigned numBuffers);
+
+    // Asks the driver to capture directly into the provided dmabufs (V4L2_MEMORY_DMABUF)
+    // instead of into buffers we mmap ourselves.  The ring depth becomes the number of fds
+    // given, and the buffer index reported with each frame is the index into this list.
+    // Passing an empty list restores the default mmap mode.  Only valid while stopped.
+    bool setExternalBuffers(const std::vector<int>& dmaBufFds);
+    bool isUsingExternalBuffers()   { return !mDmaBufFds.empty(); };
+
+    // Allocates, maps and queues the capture buffers without starting the stream, so that a
+    // later startStream() only has to turn the camera on.  Once primed, the buffers are kept
+    // between streams until close(), or until the buffer settings above change.
+    bool prime();
+    bool isPrimed()             { return mKeepBuffers && mBuffersReady; };
+
+    // The callback gets each frame on the capture thread.  onStop, if given, is called on that
+    // thread as it finishes, so whatever belongs to the thread (eg: a GL context) can go with it.
+    bool startStream(std::function<void(VideoCapture*, imageBuffer*, void*)> callback = nullptr,
+                     std::function<void()> onStop = nullptr);
     void stopStream();
 
     // Valid only after open()
@@ -38,31 +66,68 @@ public:
     __u32   getHeight()         { return mHeight; };
     __u32   getStride()         { return mStride; };
     __u32   getV4LFormat()      { return mFormat; };
+    __u32   getImageSize()      { return mSizeImage; };
+
+    // Valid only after startStream(), and may be less than requested via setNumBuffers()
+    unsigned getNumBuffers()    { return mBufferInfos.size(); };
+
+    // NULL until stream is started, and always NULL when using external buffers
+    void* getLatestData()       { return (mLatestBuffer < 0 || isUsingExternalBuffers()) ?
+                                         nullptr : mPixelBuffers[mLatestBuffer]; };
 
-    // NULL until stream is started
-    void* getLatestData()       { return mPixelBuffer; };
+    // Returns a dmabuf fd for one of our mmap'd capture buffers so it can be imported elsewhere
+    // (eg: by EGL), or -1 if the driver can't export it.  We keep ownership of the fd, which
+    // stays valid until the stream is stopped.
+    int exportBuffer(unsigned bufferIndex);
+
+    // When the given buffer's current frame was captured, in CLOCK_MONOTONIC nanoseconds.  This
+    // is the driver's timestamp when it uses the monotonic clock, otherwise when we dequeued it.
+    int64_t getCaptureTimeNs(unsigned bufferIndex) {
+        return bufferIndex < mCaptureTimes.size() ? mCaptureTimes[bufferIndex] : 0;
+    };
 
     bool isFrameReady()         { return mFrameReady; };
-    void markFrameConsumed()    { returnFrame(); };
+    void markFrameConsumed(unsigned bufferIndex)    { returnFrame(bufferIndex); };
 
     bool isOpen()               { return mDeviceFd >= 0; };
 
 private:
+    bool chooseFrameSize(__u32 format, __u32& width, __u32& height);
+    bool openEventLoop();
+    void closeEventLoop();
     void collectFrames();
-    void markFrameReady();
-    bool returnFrame();
+    bool collectFrame();
+    void markFrameReady(unsigned bufferIndex);
+    bool returnFrame(unsigned bufferIndex);
+    bool allocateBuffers();
+    bool requeueBuffers();
+    void releaseBuffers();
 
     int mDeviceFd = -1;
-
-    v4l2_buffer mBufferInfo = {};
-    void* mPixelBuffer = nullptr;
+    int mEpollFd = -1;                      // What the capture thread waits on
+    int mWakeFd = -1;                       // Signaled to wake the capture thread to stop
+
+    // How long the capture thread waits before retrying after the device reports an error
+    static const int kErrorBackoffMs = 5;
+
+    unsigned mNumBuffers = kDefaultNumCaptureBuffers;
+    std::vector<v4l2_buffer> mBufferInfos;  // One record per buffer in the capture ring
+    std::vector<void*> mPixelBuffers;       // Our mapping of each of the capture buffers
+    std::vector<int> mDmaBufFds;            // Externally owned capture buffers, if any
+    std::vector<int> mExportedFds;          // Dmabufs we've exported for mmap'd buffers
+    std::vector<int64_t> mCaptureTimes;     // Monotonic capture time of each buffer's frame
+    std::atomic<int> mLatestBuffer {-1};    // Index of the most recently dequeued buffer
+    bool mBuffersReady = false;             // Are the buffers above allocated and queued?
+    bool mKeepBuffers = false;              // Should they survive stopStream()?  See prime()
 
     __u32   mFormat = 0;
     __u32   mWidth  = 0;
     __u32   mHeight = 0;
     __u32   mStride = 0;
+    __u32   mSizeImage = 0;
 
     std::function<void(VideoCapture*, imageBuffer*, void*)> mCallback;
+    std::function<void()> mOnStop;
 
     std::thread mCaptureThread;             // The thread we'll use to dispatch frames
     std::atomic<int> mRunMode;              // Used to signal the frame loop (see RunModes below)
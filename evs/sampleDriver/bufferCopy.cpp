@@ -16,6 +16,12 @@
 
 #include "bufferCopy.h"
 
+#include <linux/videodev2.h>
+#include <string.h>
+#include <system/graphics.h>
+
+#include "YuvConvert.h"
+
 
 namespace android {
 namespace hardware {
@@ -24,6 +30,11 @@ namespace evs {
 namespace V1_0 {
 namespace implementation {
 
+using ::android::automotive::evs::support::nv21FromYuyvRows;
+using ::android::automotive::evs::support::rgbaFromYuyvRow;
+using ::android::automotive::evs::support::yuvToRgbx;
+using ::android::automotive::evs::support::yuyvFromUyvyRow;
+
 
 // Round up to the nearest multiple of the given alignment value
 template<unsigned alignment>
@@ -36,36 +47,8 @@ int align(int value) {
 }
 
 
-// Limit the given value to the provided range.  :)
-static inline float clamp(float v, float min, float max) {
-    if (v < min) return min;
-    if (v > max) return max;
-    return v;
-}
-
-
-static uint32_t yuvToRgbx(const unsigned char Y, const unsigned char Uin, const unsigned char Vin) {
-    // Don't use this if you want to see the best performance.  :)
-    // Better to do this in a pixel shader if we really have to, but on actual
-    // embedded hardware we expect to be able to texture directly from the YUV data
-    float U = Uin - 128.0f;
-    float V = Vin - 128.0f;
-
-    float Rf = Y + 1.140f*V;
-    float Gf = Y - 0.395f*U - 0.581f*V;
-    float Bf = Y + 2.032f*U;
-    unsigned char R = (unsigned char)clamp(Rf, 0.0f, 255.0f);
-    unsigned char G = (unsigned char)clamp(Gf, 0.0f, 255.0f);
-    unsigned char B = (unsigned char)clamp(Bf, 0.0f, 255.0f);
-
-    return ((R & 0xFF))       |
-           ((G & 0xFF) << 8)  |
-           ((B & 0xFF) << 16) |
-           0xFF000000;  // Fill the alpha channel with ones
-}
-
-
-void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned) {
+void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned,
+                      unsigned firstRow, unsigned numRows) {
     // The NV21 format provides a Y array of 8bit values, followed by a 1/2 x 1/2 interleave U/V array.
     // It assumes an even width and height for the overall image, and a horizontal stride that is
     // an even multiple of 16 bytes for both the Y and UV arrays.
@@ -74,15 +57,17 @@ void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     const unsigned strideLum = align<16>(tgtBuff.width);
     const unsigned sizeY = strideLum * tgtBuff.height;
     const unsigned strideColor = strideLum;   // 1/2 the samples, but two interleaved channels
-    const unsigned sizeColor = strideColor * tgtBuff.height/2;
-    const unsigned totalBytes = sizeY + sizeColor;
+    const uint8_t* src = (uint8_t*)imgData;
 
-    // Simply copy the data byte for byte
-    memcpy(tgt, imgData, totalBytes);
+    // Simply copy the data byte for byte, one plane at a time
+    memcpy(tgt + firstRow * strideLum, src + firstRow * strideLum, numRows * strideLum);
+    memcpy(tgt + sizeY + (firstRow/2) * strideColor, src + sizeY + (firstRow/2) * strideColor,
+           (numRows/2) * strideColor);
 }
 
 
-void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows) {
     // The YUYV format provides an interleaved array of pixel values with U and V subsampled in
     // the horizontal direction only.  Also known as interleaved 422 format.  A 4 byte
     // "macro pixel" provides the Y value for two adjacent pixels and the U and V values shared
@@ -107,18 +92,22 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
     // Source image layout properties
     const unsigned srcRowPixels = imgStride/4;  // imgStride is in units of bytes
     const unsigned srcRowDoubleStep = srcRowPixels * 2;
-    uint32_t* topSrcRow =  srcDataYUYV;
-    uint32_t* botSrcRow =  srcDataYUYV + srcRowPixels;
+    uint32_t* topSrcRow =  srcDataYUYV + firstRow * srcRowPixels;
+    uint32_t* botSrcRow =  topSrcRow + srcRowPixels;
 
     // We're going to work on one 2x2 cell in the output image at at time
-    for (unsigned cellRow = 0; cellRow < tgtBuff.height/2; cellRow++) {
+    const unsigned lastCellRow = (firstRow + numRows)/2;
+    for (unsigned cellRow = firstRow/2; cellRow < lastCellRow; cellRow++) {
 
         // Set up the output pointers
         uint8_t* yTopRow = tgt + (cellRow*2) * strideLum;
         uint8_t* yBotRow = yTopRow + strideLum;
         uint8_t* uvRow   = (tgt + sizeY) + cellRow * strideColor;
 
-        for (unsigned cellCol = 0; cellCol < tgtBuff.width/2; cellCol++) {
+        const unsigned vectorPixels = nv21FromYuyvRows((uint8_t*)topSrcRow, (uint8_t*)botSrcRow,
+                                                       yTopRow, yBotRow, uvRow, tgtBuff.width);
+
+        for (unsigned cellCol = vectorPixels/2; cellCol < tgtBuff.width/2; cellCol++) {
             // Collect the values from the YUYV interleaved data
             const YUYVpixel* pTopMacroPixel = (YUYVpixel*)&topSrcRow[cellCol];
             const YUYVpixel* pBotMacroPixel = (YUYVpixel*)&botSrcRow[cellCol];
@@ -143,19 +132,23 @@ void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
 }
 
 
-void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows) {
     unsigned width = tgtBuff.width;
-    unsigned height = tgtBuff.height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
     unsigned srcStridePixels = imgStride / 2;
     unsigned dstStridePixels = tgtBuff.stride;
+    uint32_t* src = (uint32_t*)imgData + firstRow * srcStridePixels/2;
+    uint32_t* dst = (uint32_t*)tgt + firstRow * dstStridePixels;
 
     const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
     const int dstRowPadding32 = dstStridePixels   - width;    // 4 bytes per pixel, 4 bytes per word
 
-    for (unsigned r=0; r<height; r++) {
-        for (unsigned c=0; c<width/2; c++) {
+    for (unsigned r=0; r<numRows; r++) {
+        const unsigned vectorPixels = rgbaFromYuyvRow((uint8_t*)src, (uint8_t*)dst, width);
+        src += vectorPixels/2;
+        dst += vectorPixels;
+
+        for (unsigned c=vectorPixels/2; c<width/2; c++) {
             // Note:  we're walking two pixels at a time here (even/odd)
             uint32_t srcPixel = *src++;
 
@@ -177,34 +170,38 @@ void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
 }
 
 
-void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows) {
     unsigned width = tgtBuff.width;
-    unsigned height = tgtBuff.height;
     uint8_t* src = (uint8_t*)imgData;
     uint8_t* dst = (uint8_t*)tgt;
     unsigned srcStrideBytes = imgStride;
     unsigned dstStrideBytes = tgtBuff.stride * 2;
 
-    for (unsigned r=0; r<height; r++) {
+    for (unsigned r=firstRow; r<firstRow+numRows; r++) {
         // Copy a pixel row at a time (2 bytes per pixel, averaged over a YUYV macro pixel)
         memcpy(dst+r*dstStrideBytes, src+r*srcStrideBytes, width*2);
     }
 }
 
 
-void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride) {
+void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows) {
     unsigned width = tgtBuff.width;
-    unsigned height = tgtBuff.height;
-    uint32_t* src = (uint32_t*)imgData;
-    uint32_t* dst = (uint32_t*)tgt;
     unsigned srcStridePixels = imgStride / 2;
     unsigned dstStridePixels = tgtBuff.stride;
+    uint32_t* src = (uint32_t*)imgData + firstRow * srcStridePixels/2;
+    uint32_t* dst = (uint32_t*)tgt + firstRow * dstStridePixels/2;
 
     const int srcRowPadding32 = srcStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
     const int dstRowPadding32 = dstStridePixels/2 - width/2;  // 2 bytes per pixel, 4 bytes per word
 
-    for (unsigned r=0; r<height; r++) {
-        for (unsigned c=0; c<width/2; c++) {
+    for (unsigned r=0; r<numRows; r++) {
+        const unsigned vectorPixels = yuyvFromUyvyRow((uint8_t*)src, (uint8_t*)dst, width);
+        src += vectorPixels/2;
+        dst += vectorPixels/2;
+
+        for (unsigned c=vectorPixels/2; c<width/2; c++) {
             // Note:  we're walking two pixels at a time here (even/odd)
             uint32_t srcPixel = *src++;
 
@@ -227,6 +224,71 @@ void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt, void* imgData, un
 }
 
 
+
+bool fillScaledView(const BufferDesc& tgtBuff, uint8_t* tgt,
+                    const void* imgData, uint32_t imgFormat,
+                    unsigned imgWidth, unsigned imgHeight, unsigned imgStride,
+                    unsigned cropX, unsigned cropY, unsigned cropWidth, unsigned cropHeight) {
+    if (imgFormat != V4L2_PIX_FMT_YUYV && imgFormat != V4L2_PIX_FMT_UYVY &&
+        imgFormat != V4L2_PIX_FMT_NV21) {
+        return false;
+    }
+
+    const uint8_t* src = (const uint8_t*)imgData;
+    const bool rgba = tgtBuff.format == HAL_PIXEL_FORMAT_RGBA_8888;
+    const unsigned dstStrideBytes = tgtBuff.stride * (rgba ? 4 : 1);
+
+    // NV21 rows are packed to 16 bytes, as in fillNV21FromNV21, with the chroma plane after the
+    // Y and its bytes in the order YuvConvert.h gives
+    const bool planar = imgFormat == V4L2_PIX_FMT_NV21;
+    const unsigned srcStride = planar ? align<16>(imgWidth) : imgStride;
+    const uint8_t* srcColor = src + srcStride * imgHeight;
+
+    // 16.16 fixed point steps through the source, starting half a step in so each target pixel
+    // takes the source pixel nearest its center
+    const uint32_t stepX = (cropWidth << 16) / tgtBuff.width;
+    const uint32_t stepY = (cropHeight << 16) / tgtBuff.height;
+    uint32_t y = (cropY << 16) + stepY / 2;
+    for (unsigned r = 0; r < tgtBuff.height; r++, y += stepY) {
+        const unsigned row = y >> 16;
+        const uint8_t* srcRow = src + row * srcStride;
+        uint8_t* dst = tgt + r * dstStrideBytes;
+
+        uint32_t x = (cropX << 16) + stepX / 2;
+        for (unsigned c = 0; c < tgtBuff.width; c++, x += stepX) {
+            const unsigned col = x >> 16;
+            uint8_t Y, U = 128, V = 128;
+            switch (imgFormat) {
+            case V4L2_PIX_FMT_UYVY:
+                Y = srcRow[col * 2 + 1];
+                U = srcRow[(col & ~1u) * 2];
+                V = srcRow[(col & ~1u) * 2 + 2];
+                break;
+            case V4L2_PIX_FMT_NV21:
+                Y = srcRow[col];
+                if (rgba) {
+                    const uint8_t* uv = srcColor + (row / 2) * srcStride + (col & ~1u);
+                    U = uv[0];
+                    V = uv[1];
+                }
+                break;
+            default:    // V4L2_PIX_FMT_YUYV, since we checked for the others above
+                Y = srcRow[col * 2];
+                U = srcRow[(col & ~1u) * 2 + 1];
+                V = srcRow[(col & ~1u) * 2 + 3];
+                break;
+            }
+
+            if (rgba) {
+                ((uint32_t*)dst)[c] = yuvToRgbx(Y, U, V);
+            } else {
+                dst[c] = Y;
+            }
+        }
+    }
+    return true;
+}
+
 } // namespace implementation
 } // namespace V1_0
 } // namespace evs
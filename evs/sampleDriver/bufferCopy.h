@@ -28,20 +28,41 @@ namespace V1_0 {
 namespace implementation {
 
 
+// Each of these converts rows [firstRow, firstRow + numRows) of the source image into the
+// target buffer, so a frame may be split across threads.  The NV21 targets work on 2x2 cells,
+// so for them both values must be even.
+typedef void (*FillFunction)(const BufferDesc& tgtBuff, uint8_t* tgt,
+                             void* imgData, unsigned imgStride,
+                             unsigned firstRow, unsigned numRows);
+
 void fillNV21FromNV21(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows);
 
 void fillNV21FromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows);
 
 void fillRGBAFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows);
 
 void fillYUYVFromYUYV(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows);
 
 void fillYUYVFromUYVY(const BufferDesc& tgtBuff, uint8_t* tgt,
-                      void* imgData, unsigned imgStride);
+                      void* imgData, unsigned imgStride,
+                      unsigned firstRow, unsigned numRows);
+
+// Fills a Y8 or RGBA target with the given rectangle of a YUYV, UYVY or NV21 source image
+// (a V4L2_PIX_FMT), scaled to fit by taking the nearest source pixel.  Only the source pixels it
+// samples are read, so a small view of a big image costs far less than converting all of it.
+// Returns false, leaving the target alone, if the source is in any other format.
+bool fillScaledView(const BufferDesc& tgtBuff, uint8_t* tgt,
+                    const void* imgData, uint32_t imgFormat,
+                    unsigned imgWidth, unsigned imgHeight, unsigned imgStride,
+                    unsigned cropX, unsigned cropY, unsigned cropWidth, unsigned cropHeight);
 
 } // namespace implementation
 } // namespace V1_0
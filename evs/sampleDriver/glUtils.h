@@ -0,0 +1,31 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GLUTILS_H
+#define ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GLUTILS_H
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+
+// Returns a printable name for the most recent EGL error on this thread
+const char *getEGLError(void);
+
+// Create a program object given vertex and pixels shader source.  Linked programs are cached
+// on disk, so later starts skip compiling and linking.
+GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc);
+
+#endif // ANDROID_HARDWARE_AUTOMOTIVE_EVS_V1_0_GLUTILS_H
@@ -14,7 +14,12 @@
  * limitations under the License.
  */
 
+#include <errno.h>
+#include <inttypes.h>
 #include <unistd.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <atomic>
 
 #include <hidl/HidlTransportSupport.h>
@@ -23,8 +28,13 @@
 #include <utils/Log.h>
 
 #include "ServiceNames.h"
+#include "ConversionPool.h"
+#include "EvsDerivedCamera.h"
 #include "EvsEnumerator.h"
 #include "EvsGlDisplay.h"
+#include "EvsReplayCamera.h"
+#include "EvsV4lCamera.h"
+#include "GrallocPool.h"
 
 
 // libhidl:
@@ -38,18 +48,188 @@ using android::hardware::automotive::evs::V1_0::IEvsDisplay;
 // The namespace in which all our implementation code lives
 using namespace android::hardware::automotive::evs::V1_0::implementation;
 using namespace android;
+using ::android::automotive::evs::support::ConversionPool;
 
 
-int main() {
+// The manager returns frames and changes streams from several threads of its own, so we serve
+// it on more than one
+static const int kDefaultRpcThreads = 4;
+
+
+int main(int argc, char** argv) {
     ALOGI("EVS Hardware Enumerator service is starting");
 
+    // Set up default behavior, then check for command line options
+    bool printHelp = false;
+    int rpcThreads = kDefaultRpcThreads;
+    for (int i=1; i< argc; i++) {
+        if (strcmp(argv[i], "--zerocopy") == 0) {
+            EvsV4lCamera::enableZeroCopy(true);
+        } else if (strcmp(argv[i], "--gpu-convert") == 0) {
+            EvsV4lCamera::enableGpuConversion(true);
+        } else if (strcmp(argv[i], "--mjpeg") == 0) {
+            EvsV4lCamera::enableMjpeg(true);
+        } else if (strcmp(argv[i], "--format") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--format <rgba|yuyv|nv21> was not provided with a format\n");
+            } else if (strcmp(argv[i], "rgba") == 0) {
+                EvsV4lCamera::setOutputFormat(HAL_PIXEL_FORMAT_RGBA_8888);
+            } else if (strcmp(argv[i], "yuyv") == 0) {
+                EvsV4lCamera::setOutputFormat(HAL_PIXEL_FORMAT_YCBCR_422_I);
+            } else if (strcmp(argv[i], "nv21") == 0) {
+                EvsV4lCamera::setOutputFormat(HAL_PIXEL_FORMAT_YCRCB_420_SP);
+            } else {
+                ALOGE("Ignoring unrecognized output format '%s'\n", argv[i]);
+            }
+        } else if (strcmp(argv[i], "--resolution") == 0) {
+            i++;
+            unsigned width = 0, height = 0;
+            if (i >= argc || sscanf(argv[i], "%ux%u", &width, &height) != 2) {
+                ALOGE("--resolution <width>x<height> was not provided with a valid size\n");
+            } else {
+                EvsV4lCamera::setRequestedResolution(width, height);
+            }
+        } else if (strcmp(argv[i], "--conversion-threads") == 0) {
+            i++;
+            unsigned threads = 0;
+            if (i >= argc || !ConversionPool::parseThreadCount(argv[i], &threads)) {
+                ALOGE("--conversion-threads <count> was not provided with a count from 1 to %u\n",
+                      ConversionPool::kMaxBands);
+            } else {
+                EvsV4lCamera::setConversionThreads(threads);
+            }
+        } else if (strcmp(argv[i], "--adaptive-buffers") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1) {
+                ALOGE("--adaptive-buffers <count> was not provided with a valid count\n");
+            } else {
+                EvsV4lCamera::setAdaptiveBufferLimit(atoi(argv[i]));
+            }
+        } else if (strcmp(argv[i], "--pool-idle") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 0) {
+                ALOGE("--pool-idle <seconds> was not provided with a valid time\n");
+            } else {
+                GrallocPool::setIdleTimeout(seconds_to_nanoseconds(atoi(argv[i])));
+            }
+        } else if (strcmp(argv[i], "--overlay") == 0) {
+            EvsGlDisplay::enableOverlay(true);
+        } else if (strcmp(argv[i], "--display-buffers") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1 ||
+                atoi(argv[i]) > static_cast<int>(EvsGlDisplay::kMaxBufferCount)) {
+                ALOGE("--display-buffers <count> was not provided with a valid count "
+                      "(1 to %u)\n", EvsGlDisplay::kMaxBufferCount);
+            } else {
+                EvsGlDisplay::setBufferCount(atoi(argv[i]));
+            }
+        } else if (strcmp(argv[i], "--mirror") == 0) {
+            i++;
+            uint64_t physicalId = 0;
+            uint32_t layerStack = 0;
+            if (i >= argc ||
+                sscanf(argv[i], "%" SCNu64 ":%" SCNu32, &physicalId, &layerStack) != 2) {
+                ALOGE("--mirror <display_id>:<layer_stack> was not provided with a display\n");
+            } else {
+                EvsGlDisplay::addMirrorDisplay(physicalId, layerStack);
+            }
+        } else if (strcmp(argv[i], "--kms") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--kms <device> was not provided with a DRM device\n");
+            } else {
+                EvsGlDisplay::enableKms(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--standby") == 0) {
+            i++;
+            if (i >= argc) {
+                ALOGE("--standby <camera_id> was not provided with a camera id\n");
+            } else {
+                EvsEnumerator::addStandbyCamera(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--derived") == 0) {
+            i++;
+            EvsDerivedCamera::Spec spec;
+            if (i >= argc || !EvsDerivedCamera::parseSpec(argv[i], &spec)) {
+                ALOGE("--derived <spec> was not provided with a valid spec\n");
+            } else {
+                EvsEnumerator::addDerivedCamera(spec);
+            }
+        } else if (strcmp(argv[i], "--replay") == 0) {
+            i++;
+            EvsReplayCamera::Spec spec;
+            if (i >= argc || !EvsReplayCamera::parseSpec(argv[i], &spec)) {
+                ALOGE("--replay <name>=<path>[:fast] was not provided with a valid spec\n");
+            } else {
+                EvsEnumerator::addReplayCamera(spec);
+            }
+        } else if (strcmp(argv[i], "--record-raw") == 0) {
+            i++;
+            const char* equals = (i < argc) ? strchr(argv[i], '=') : nullptr;
+            if (equals == nullptr || equals == argv[i] || equals[1] == '\0') {
+                ALOGE("--record-raw <camera_id>=<path> was not provided with a valid spec\n");
+            } else {
+                EvsV4lCamera::addCaptureTap(std::string(argv[i], equals - argv[i]).c_str(),
+                                            equals + 1);
+            }
+        } else if (strcmp(argv[i], "--rpc-threads") == 0) {
+            i++;
+            if (i >= argc || atoi(argv[i]) < 1) {
+                ALOGE("--rpc-threads <count> was not provided with a valid count\n");
+            } else {
+                rpcThreads = atoi(argv[i]);
+            }
+        } else if (strcmp(argv[i], "--help") == 0) {
+            printHelp = true;
+        } else {
+            printf("Ignoring unrecognized command line arg '%s'\n", argv[i]);
+            printHelp = true;
+        }
+    }
+    if (printHelp) {
+        printf("Options include:\n");
+        printf("  --zerocopy                    Capture YUYV cameras directly into the buffers "
+               "sent to clients\n");
+        printf("  --format <rgba|yuyv|nv21>     Preferred output format (default rgba)\n");
+        printf("  --resolution <width>x<height> Preferred capture size (default is the camera's)"
+               "\n");
+        printf("  --gpu-convert                 Convert YUYV to RGBA on the GPU\n");
+        printf("  --mjpeg                       Capture MJPEG where cameras offer it, and decode "
+               "it to RGBA\n");
+        printf("  --conversion-threads <count>  Split the conversion of each frame across "
+               "<count> threads\n");
+        printf("  --adaptive-buffers <count>    Add buffers for clients that drop frames, up to "
+               "<count> per camera\n");
+        printf("  --pool-idle <seconds>         Keep output buffers this long after a stream "
+               "for the next one (default 30)\n");
+        printf("  --overlay                     Show display buffers as an overlay layer instead "
+               "of drawing them with GL\n");
+        printf("  --display-buffers <count>     Number of display target buffers (default 3)\n");
+        printf("  --mirror <display_id>:<layer_stack>  Also show the display on this physical "
+               "display (may be repeated)\n");
+        printf("  --kms <device>                Drive this DRM device directly until "
+               "SurfaceFlinger is up (eg: /dev/dri/card0)\n");
+        printf("  --standby <camera_id>         Keep this camera primed while it isn't in use "
+               "(may be repeated)\n");
+        printf("  --derived <name>=<camera_id>:<gray|rgba>:<width>x<height>[:<x>,<y>,<w>x<h>]\n"
+               "                                Offer a scaled, cropped view of a camera as "
+               "camera <name> (may be repeated)\n");
+        printf("  --replay <name>=<path>[:fast] Offer camera <name> playing back a capture file, "
+               "as fast as frames are taken with :fast\n");
+        printf("  --record-raw <camera_id>=<path>  Record this camera's captured frames to a "
+               "capture file while it streams\n");
+        printf("  --rpc-threads <count>         Serve calls on this many threads (default %d)\n",
+               kDefaultRpcThreads);
+    }
+
     // Start a thread to listen video device addition events.
     std::atomic<bool> running { true };
     std::thread ueventHandler(EvsEnumerator::EvsUeventThread, std::ref(running));
 
     android::sp<IEvsEnumerator> service = new EvsEnumerator();
 
-    configureRpcThreadpool(1, true /* callerWillJoin */);
+    configureRpcThreadpool(rpcThreads, true /* callerWillJoin */);
 
     // Register our service -- if somebody is already registered by our name,
     // they will be killed (their thread pool will throw an exception).
@@ -0,0 +1,31 @@
+LOCAL_PATH:= $(call my-dir)
+
+##################################
+# Code shared by the EVS app, manager and sample driver
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    BufferCache.cpp \
+    ConversionPool.cpp \
+    FileUtils.cpp \
+    ProgramCache.cpp \
+    ShaderProgram.cpp \
+    TraceCookie.cpp \
+    YuvConvert.cpp \
+
+LOCAL_EXPORT_C_INCLUDE_DIRS := $(LOCAL_PATH)
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libGLESv2 \
+    libhidlbase \
+    liblog \
+    libutils \
+    android.hardware.automotive.evs@1.0 \
+
+LOCAL_MODULE := libevssupport
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_STATIC_LIBRARY)
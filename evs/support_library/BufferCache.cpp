@@ -0,0 +1,38 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "BufferCache.h"
+
+#include <sys/stat.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+uint64_t bufferIdentity(const native_handle_t* handle) {
+    struct stat st;
+    if (handle == nullptr || handle->numFds < 1 || fstat(handle->data[0], &st) != 0) {
+        return 0;
+    }
+    return (static_cast<uint64_t>(st.st_dev) << 32) ^ static_cast<uint64_t>(st.st_ino);
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
@@ -0,0 +1,158 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_BUFFERCACHE_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_BUFFERCACHE_H
+
+#include <android/hardware/automotive/evs/1.0/types.h>
+#include <cutils/native_handle.h>
+
+#include <stdint.h>
+
+#include <algorithm>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// Tells apart the buffers behind a handle.  Each frame may come with fresh fds, and a bufferId
+// (or a handle's address) may be reused for a new buffer once the old one is freed, so we go by
+// the dmabuf the first fd refers to instead.  Zero if the handle has no fd to go by.
+uint64_t bufferIdentity(const native_handle_t* handle);
+
+
+// What a client makes of the graphics buffers it is handed, such as GL images, render targets
+// or encoder inputs, kept for the next time the same buffer comes around.  Entries go by
+// bufferIdentity() and the buffer's layout, so a new buffer behind an old bufferId is never
+// mistaken for the one that was there before.  (Buffers without an fd go by bufferId alone.)
+// Once full, the least recently used entry makes way for the next.
+//
+// Nothing is released on destruction, since that usually depends on a GL context being current,
+// so owners must clear() the cache themselves.  Not thread safe.
+template <typename Entry>
+class BufferCache {
+public:
+    using BufferDesc = ::android::hardware::automotive::evs::V1_0::BufferDesc;
+
+    explicit BufferCache(size_t capacity) { setCapacity(capacity); };
+
+    // The entry kept for this buffer, or nullptr if there isn't one
+    Entry* find(const BufferDesc& buffer) {
+        Slot* slot = findSlot(makeKey(buffer));
+        if (slot == nullptr) {
+            return nullptr;
+        }
+        slot->lastUse = ++mUseCount;
+        return &slot->entry;
+    };
+
+    // Keeps the given entry for this buffer.  Whatever it replaces, or has to make room for, is
+    // handed to release() first.
+    template <typename Release>
+    Entry* insert(const BufferDesc& buffer, const Entry& entry, Release release) {
+        const Key key = makeKey(buffer);
+        Slot* slot = findSlot(key);
+        if (slot == nullptr && mSlots.size() < mCapacity) {
+            mSlots.emplace_back();
+            slot = &mSlots.back();
+        } else {
+            if (slot == nullptr) {
+                slot = &mSlots[0];
+                for (auto&& candidate : mSlots) {
+                    if (candidate.lastUse < slot->lastUse) {
+                        slot = &candidate;
+                    }
+                }
+            }
+            release(slot->entry);
+        }
+        slot->key = key;
+        slot->entry = entry;
+        slot->lastUse = ++mUseCount;
+        return &slot->entry;
+    };
+
+    // Hands every entry to release() and forgets them all
+    template <typename Release>
+    void clear(Release release) {
+        for (auto&& slot : mSlots) {
+            release(slot.entry);
+        }
+        mSlots.clear();
+    };
+
+    // Takes effect as entries are next inserted.  Entries stay where they are until they're
+    // replaced, so what find() and insert() return may be held across other calls until then.
+    void setCapacity(size_t capacity) {
+        mCapacity = std::max<size_t>(capacity, 1);
+        mSlots.reserve(mCapacity);
+    };
+
+    size_t size() const                 { return mSlots.size(); };
+
+private:
+    struct Key {
+        uint64_t    identity;
+        uint32_t    bufferId;
+        uint32_t    width;
+        uint32_t    height;
+        uint32_t    stride;
+        uint32_t    format;
+
+        bool operator==(const Key& other) const {
+            // Two frames of the same buffer may well come with different ids, but a buffer we
+            // can't identify has nothing else to go by
+            return identity == other.identity &&
+                   (identity != 0 || bufferId == other.bufferId) &&
+                   width  == other.width  && height == other.height &&
+                   stride == other.stride && format == other.format;
+        };
+    };
+
+    struct Slot {
+        Key         key = {};
+        uint64_t    lastUse = 0;
+        Entry       entry = {};
+    };
+
+    static Key makeKey(const BufferDesc& buffer) {
+        return { bufferIdentity(buffer.memHandle.getNativeHandle()), buffer.bufferId,
+                 buffer.width, buffer.height, buffer.stride, buffer.format };
+    };
+
+    Slot* findSlot(const Key& key) {
+        for (auto&& slot : mSlots) {
+            if (slot.key == key) {
+                return &slot;
+            }
+        }
+        return nullptr;
+    };
+
+    size_t              mCapacity = 1;
+    uint64_t            mUseCount = 0;
+    std::vector<Slot>   mSlots;     // Few enough that looking through them all is quickest
+};
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_BUFFERCACHE_H
@@ -0,0 +1,125 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ConversionPool.h"
+
+#include <utils/Trace.h>
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include <algorithm>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+bool ConversionPool::parseThreadCount(const char* arg, unsigned* count) {
+    char* end = nullptr;
+    errno = 0;
+    const unsigned long value = strtoul(arg, &end, 10);
+    if (errno != 0 || end == arg || *end != '\0' || value < 1 || value > kMaxBands) {
+        return false;
+    }
+    *count = static_cast<unsigned>(value);
+    return true;
+}
+
+
+ConversionPool::ConversionPool(unsigned numBands) {
+    numBands = std::min(numBands, kMaxBands);
+    for (unsigned band = 1; band < numBands; band++) {
+        mWorkers.emplace_back(&ConversionPool::workerThread, this, band);
+    }
+}
+
+
+ConversionPool::~ConversionPool() {
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mQuit = true;
+    }
+    mWorkReady.notify_all();
+
+    for (auto&& worker : mWorkers) {
+        worker.join();
+    }
+}
+
+
+void ConversionPool::convert(const BandFunction& convertRows, unsigned height) {
+    const unsigned numBands = mWorkers.size() + 1;
+
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mConvertRows = &convertRows;
+        mHeight      = height;
+
+        // Keep every band an even number of rows so no 4:2:0 cell is split between threads
+        mRowsPerBand = ((height + numBands - 1) / numBands + 1) & ~1u;
+
+        mBandsPending = mWorkers.size();
+        mGeneration++;
+    }
+    mWorkReady.notify_all();
+
+    // Do our share while the workers do theirs
+    convertBand(0);
+
+    std::unique_lock<std::mutex> lock(mLock);
+    mWorkDone.wait(lock, [this]() { return mBandsPending == 0; });
+    mConvertRows = nullptr;
+}
+
+
+void ConversionPool::convertBand(unsigned band) {
+    const unsigned firstRow = std::min(band * mRowsPerBand, mHeight);
+    const unsigned numRows  = std::min(mRowsPerBand, mHeight - firstRow);
+    if (numRows > 0) {
+        ATRACE_NAME("convertBand");
+        (*mConvertRows)(firstRow, numRows);
+    }
+}
+
+
+void ConversionPool::workerThread(unsigned band) {
+    unsigned lastGeneration = 0;
+
+    std::unique_lock<std::mutex> lock(mLock);
+    while (true) {
+        mWorkReady.wait(lock, [&]() { return mQuit || mGeneration != lastGeneration; });
+        if (mQuit) {
+            break;
+        }
+        lastGeneration = mGeneration;
+
+        // The frame description can't change until every band is done, so we can drop the lock
+        lock.unlock();
+        convertBand(band);
+        lock.lock();
+
+        if (--mBandsPending == 0) {
+            mWorkDone.notify_one();
+        }
+    }
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
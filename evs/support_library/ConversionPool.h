@@ -0,0 +1,80 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_CONVERSIONPOOL_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_CONVERSIONPOOL_H
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+/*
+ * Splits the conversion of a frame into horizontal bands and runs them in parallel.  The calling
+ * thread converts the first band itself while the worker threads take the rest.  Both the app's
+ * pixel copy and the sample driver's capture thread use one.
+ */
+class ConversionPool {
+public:
+    // More than this many bands only costs us more threads waking for each frame
+    static const unsigned kMaxBands = 16;
+
+    // Reads a thread count from the command line, which must be a plain number we can take
+    static bool parseThreadCount(const char* arg, unsigned* count);
+
+    // Converts the rows [firstRow, firstRow + numRows) of the frame
+    typedef std::function<void(unsigned firstRow, unsigned numRows)> BandFunction;
+
+    // numBands includes the calling thread, so numBands - 1 workers are started (and no more
+    // than kMaxBands - 1)
+    explicit ConversionPool(unsigned numBands);
+    ~ConversionPool();
+
+    // Blocks until all the given rows have been converted
+    void convert(const BandFunction& convertRows, unsigned height);
+
+private:
+    void workerThread(unsigned band);
+    void convertBand(unsigned band);
+
+    std::vector<std::thread> mWorkers;
+
+    // The frame currently being converted
+    const BandFunction* mConvertRows = nullptr;
+    unsigned            mHeight = 0;
+    unsigned            mRowsPerBand = 0;
+
+    std::mutex              mLock;
+    std::condition_variable mWorkReady;     // Signaled when a new frame is posted
+    std::condition_variable mWorkDone;      // Signaled when the last worker finishes its band
+    unsigned                mGeneration = 0;
+    unsigned                mBandsPending = 0;
+    bool                    mQuit = false;
+};
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_CONVERSIONPOOL_H
@@ -0,0 +1,98 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "FileUtils.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <log/log.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+uint64_t hashBytes(uint64_t hash, const void* data, size_t length) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
+
+
+uint64_t hashString(uint64_t hash, const char* str) {
+    return (str != nullptr) ? hashBytes(hash, str, strlen(str)) : hash;
+}
+
+
+bool readFile(const std::string& path, size_t maxLength, std::vector<uint8_t>* contents) {
+    const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    // Go by the size the file actually has, never by a length recorded inside it
+    struct stat info;
+    bool ok = fstat(fd, &info) == 0 && S_ISREG(info.st_mode) &&
+              static_cast<uint64_t>(info.st_size) <= maxLength;
+    if (ok) {
+        contents->resize(info.st_size);
+        size_t done = 0;
+        while (ok && done < contents->size()) {
+            const ssize_t got = read(fd, contents->data() + done, contents->size() - done);
+            if (got < 0 && errno == EINTR) {
+                continue;
+            }
+            ok = got > 0;
+            done += (got > 0) ? got : 0;
+        }
+    }
+    close(fd);
+    if (!ok) {
+        contents->clear();
+    }
+    return ok;
+}
+
+
+bool writeFileAtomically(const std::string& path, const void* data, size_t length) {
+    const std::string tmpPath = path + ".tmp";
+    FILE* fp = fopen(tmpPath.c_str(), "we");
+    if (!fp) {
+        ALOGW("Failed to create %s: %s", tmpPath.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(data, 1, length, fp) == length;
+    ok = ok && fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+    ok = (fclose(fp) == 0) && ok;
+    if (!ok || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        ALOGW("Failed to write %s: %s", path.c_str(), strerror(errno));
+        unlink(tmpPath.c_str());
+        return false;
+    }
+    return true;
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
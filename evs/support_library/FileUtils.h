@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_FILEUTILS_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_FILEUTILS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// 64 bit FNV-1a, continuing from the given hash.  Good enough to name cache files for what
+// they hold; nothing here needs to be secure.
+static const uint64_t kHashSeed = 0xcbf29ce484222325ull;
+uint64_t hashBytes(uint64_t hash, const void* data, size_t length);
+uint64_t hashString(uint64_t hash, const char* str);
+
+// Reads the whole of a file, which must be no larger than maxLength.  Returns false if it can't,
+// including when the file doesn't exist.
+bool readFile(const std::string& path, size_t maxLength, std::vector<uint8_t>* contents);
+
+// Writes a new file and renames it over the old, so a crash or power cut mid-way can't leave a
+// partial file behind.  Logs and returns false if that fails, leaving any old file in place.
+bool writeFileAtomically(const std::string& path, const void* data, size_t length);
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_FILEUTILS_H
@@ -0,0 +1,139 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ProgramCache.h"
+#include "FileUtils.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <GLES3/gl3.h>
+#include <log/log.h>
+
+#include <string>
+#include <vector>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+static const uint32_t kProgramCacheMagic = 0x50535645;  // "EVSP"
+
+// No program binary we know of comes anywhere near this
+static const size_t kMaxProgramCacheSize = 16 * 1024 * 1024;
+
+// Leads each cached program binary.  The driver hash has the binary thrown away when the GPU
+// driver changes underneath it.
+struct ProgramCacheHeader {
+    uint32_t    magic;
+    uint32_t    binaryFormat;
+    uint64_t    driverHash;
+    uint32_t    length;
+};
+
+
+// Identifies the GPU driver in the current context, which must agree with a cached binary's
+static uint64_t getDriverHash() {
+    uint64_t hash = kHashSeed;
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VENDOR)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+    hash = hashString(hash, reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+    return hash;
+}
+
+
+// Named for the program's source, so a new driver replaces its old binary
+static std::string getProgramCachePath(const char* cacheDir,
+                                       const char* vtxSrc, const char* pxlSrc) {
+    const uint64_t hash = hashString(hashString(kHashSeed, vtxSrc), pxlSrc);
+    char name[32];
+    snprintf(name, sizeof(name), "/shader_%016" PRIx64 ".bin", hash);
+    return std::string(cacheDir) + name;
+}
+
+
+GLuint loadProgramBinary(const char* cacheDir, const char* vtxSrc, const char* pxlSrc) {
+    const std::string path = getProgramCachePath(cacheDir, vtxSrc, pxlSrc);
+    std::vector<uint8_t> contents;
+    if (!readFile(path, kMaxProgramCacheSize, &contents) ||
+        contents.size() < sizeof(ProgramCacheHeader)) {
+        return 0;
+    }
+
+    // The binary must be exactly what's left of the file after the header
+    ProgramCacheHeader header = {};
+    memcpy(&header, contents.data(), sizeof(header));
+    if (header.magic != kProgramCacheMagic || header.driverHash != getDriverHash() ||
+        header.length != contents.size() - sizeof(header)) {
+        return 0;
+    }
+
+    GLuint program = glCreateProgram();
+    if (program == 0) {
+        return 0;
+    }
+    glProgramBinary(program, header.binaryFormat, contents.data() + sizeof(header),
+                    header.length);
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        // The driver may reject binaries for reasons of its own, in which case we just build
+        // the program again
+        ALOGW("Discarding cached shader program %s", path.c_str());
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    return program;
+}
+
+
+void saveProgramBinary(GLuint program, const char* cacheDir,
+                       const char* vtxSrc, const char* pxlSrc) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 ||
+        static_cast<size_t>(length) > kMaxProgramCacheSize - sizeof(ProgramCacheHeader)) {
+        return;
+    }
+
+    std::vector<uint8_t> contents(sizeof(ProgramCacheHeader) + length);
+    GLenum binaryFormat = 0;
+    glGetProgramBinary(program, length, &length, &binaryFormat,
+                       contents.data() + sizeof(ProgramCacheHeader));
+    if (length <= 0) {
+        return;
+    }
+    contents.resize(sizeof(ProgramCacheHeader) + length);
+
+    ProgramCacheHeader header = {};
+    header.magic        = kProgramCacheMagic;
+    header.binaryFormat = binaryFormat;
+    header.driverHash   = getDriverHash();
+    header.length       = length;
+    memcpy(contents.data(), &header, sizeof(header));
+
+    writeFileAtomically(getProgramCachePath(cacheDir, vtxSrc, pxlSrc),
+                        contents.data(), contents.size());
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
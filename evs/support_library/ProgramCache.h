@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_PROGRAMCACHE_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_PROGRAMCACHE_H
+
+#include <GLES2/gl2.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// Keeps linked GL programs on disk, so we only compile our shaders the first time we start.
+// Each program gets a file in cacheDir named for its source, and is thrown away if the GPU
+// driver in the current context isn't the one that built it.
+
+// Returns the program saveProgramBinary() kept for these sources, or 0 if there isn't a usable
+// one, in which case the caller builds it as usual
+GLuint loadProgramBinary(const char* cacheDir, const char* vtxSrc, const char* pxlSrc);
+
+// Saves a program linked from these sources for loadProgramBinary() to find next time.  The
+// program should be linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.  Failure isn't an
+// error; we'll just be building the program again.
+void saveProgramBinary(GLuint program, const char* cacheDir,
+                       const char* vtxSrc, const char* pxlSrc);
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_PROGRAMCACHE_H
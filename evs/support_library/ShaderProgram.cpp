@@ -0,0 +1,126 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "ShaderProgram.h"
+#include "ProgramCache.h"
+
+#include <GLES3/gl3.h>
+#include <log/log.h>
+
+#include <memory>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// Given shader source, load and compile it
+static GLuint loadShader(GLenum type, const char* shaderSrc, const char* name) {
+    GLuint shader = glCreateShader(type);
+    if (shader == 0) {
+        return 0;
+    }
+
+    glShaderSource(shader, 1, &shaderSrc, nullptr);
+    glCompileShader(shader);
+
+    GLint compiled = 0;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &compiled);
+    if (!compiled) {
+        ALOGE("Error compiling %s shader for %s", (type == GL_VERTEX_SHADER) ? "vtx" : "pxl",
+              name);
+
+        GLint size = 0;
+        glGetShaderiv(shader, GL_INFO_LOG_LENGTH, &size);
+        if (size > 0) {
+            std::unique_ptr<char[]> infoLog(new char[size]);
+            glGetShaderInfoLog(shader, size, nullptr, infoLog.get());
+            ALOGE("  msg:\n%s", infoLog.get());
+        }
+
+        glDeleteShader(shader);
+        return 0;
+    }
+
+    return shader;
+}
+
+
+GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc, const char* name,
+                          const char* cacheDir) {
+    // Use the program we linked last time, if we have it
+    GLuint program = 0;
+    if (cacheDir != nullptr) {
+        program = loadProgramBinary(cacheDir, vtxSrc, pxlSrc);
+        if (program != 0) {
+            return program;
+        }
+    }
+
+    program = glCreateProgram();
+    if (program == 0) {
+        ALOGE("Failed to allocate program object for %s", name);
+        return 0;
+    }
+
+    // Compile the shaders and bind them to this program
+    GLuint vertexShader = loadShader(GL_VERTEX_SHADER, vtxSrc, name);
+    GLuint pixelShader = vertexShader ? loadShader(GL_FRAGMENT_SHADER, pxlSrc, name) : 0;
+    if (pixelShader == 0) {
+        glDeleteProgram(program);
+        glDeleteShader(vertexShader);
+        return 0;
+    }
+    glAttachShader(program, vertexShader);
+    glAttachShader(program, pixelShader);
+
+    // Link the program, asking to be able to save the result if we're going to
+    if (cacheDir != nullptr) {
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+    glLinkProgram(program);
+
+    // The program keeps what it needs of the shaders
+    glDeleteShader(vertexShader);
+    glDeleteShader(pixelShader);
+
+    GLint linked = 0;
+    glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    if (!linked) {
+        ALOGE("Error linking program for %s", name);
+        GLint size = 0;
+        glGetProgramiv(program, GL_INFO_LOG_LENGTH, &size);
+        if (size > 0) {
+            std::unique_ptr<char[]> infoLog(new char[size]);
+            glGetProgramInfoLog(program, size, nullptr, infoLog.get());
+            ALOGE("  msg:  %s", infoLog.get());
+        }
+
+        glDeleteProgram(program);
+        return 0;
+    }
+
+    if (cacheDir != nullptr) {
+        saveProgramBinary(program, cacheDir, vtxSrc, pxlSrc);
+    }
+    return program;
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
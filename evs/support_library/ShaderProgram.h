@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_SHADERPROGRAM_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_SHADERPROGRAM_H
+
+#include <GLES2/gl2.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// Compiles and links a program from the given vertex and pixel shader sources, logging why if it
+// can't, in which case it returns 0.  |name| is what the log calls the program.
+//
+// Given a cacheDir, the linked program is kept there (see ProgramCache.h) and later starts skip
+// compiling and linking.  That needs an ES 3 context; without a cacheDir, ES 2 will do.
+GLuint buildShaderProgram(const char* vtxSrc, const char* pxlSrc, const char* name,
+                          const char* cacheDir = nullptr);
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_SHADERPROGRAM_H
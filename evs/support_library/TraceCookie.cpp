@@ -0,0 +1,35 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "TraceCookie.h"
+
+#include <atomic>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+unsigned nextTraceOwner() {
+    static std::atomic<unsigned> sNextOwner {0};
+    return sNextOwner.fetch_add(1, std::memory_order_relaxed) & 0x7FFF;
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
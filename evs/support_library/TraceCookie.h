@@ -0,0 +1,41 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_TRACECOOKIE_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_TRACECOOKIE_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// Frames show in traces as spans on async tracks, whose cookies must be unique among the spans
+// open on a track at once.  Buffer ids are only unique per camera, so each owner of such spans
+// (a camera, or a client's stream of one) takes a number of its own to combine with them.
+unsigned nextTraceOwner();
+inline int32_t makeTraceCookie(unsigned owner, uint32_t bufferId) {
+    return static_cast<int32_t>((owner << 16) | (bufferId & 0xFFFF));
+}
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_TRACECOOKIE_H
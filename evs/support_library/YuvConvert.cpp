@@ -0,0 +1,338 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "YuvConvert.h"
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+#if defined(__ARM_NEON)
+
+
+struct VectorOffsets {
+    int16x8_t r;
+    int16x8_t g;
+    int16x8_t b;
+};
+
+// The offsets for 8 chroma samples, which cover 16 pixels of a row
+static inline VectorOffsets chromaOffsets(const uint8x8_t Uin, const uint8x8_t Vin) {
+    const int16x8_t bias = vdupq_n_s16(128);
+    const int16x8_t U = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(Uin)), bias);
+    const int16x8_t V = vsubq_s16(vreinterpretq_s16_u16(vmovl_u8(Vin)), bias);
+    return {
+        vrshrq_n_s16(vmulq_n_s16(V, kCoeffRV), kCoeffShift),
+        vrshrq_n_s16(vmlaq_n_s16(vmulq_n_s16(U, kCoeffGU), V, kCoeffGV), kCoeffShift),
+        vrshrq_n_s16(vmulq_n_s16(U, kCoeffBU), kCoeffShift),
+    };
+}
+
+// Writes 16 RGBA pixels given the Y values of the even and the odd ones
+static inline void storeRgba16(const uint8x8_t yEven, const uint8x8_t yOdd,
+                               const VectorOffsets& offsets, uint8_t* dst) {
+    const int16x8_t Y1 = vreinterpretq_s16_u16(vmovl_u8(yEven));
+    const int16x8_t Y2 = vreinterpretq_s16_u16(vmovl_u8(yOdd));
+
+    // Put the even and odd pixels back in order
+    const uint8x8x2_t R = vzip_u8(vqmovun_s16(vaddq_s16(Y1, offsets.r)),
+                                  vqmovun_s16(vaddq_s16(Y2, offsets.r)));
+    const uint8x8x2_t G = vzip_u8(vqmovun_s16(vsubq_s16(Y1, offsets.g)),
+                                  vqmovun_s16(vsubq_s16(Y2, offsets.g)));
+    const uint8x8x2_t B = vzip_u8(vqmovun_s16(vaddq_s16(Y1, offsets.b)),
+                                  vqmovun_s16(vaddq_s16(Y2, offsets.b)));
+
+    const uint8x8_t alpha = vdup_n_u8(0xFF);
+    const uint8x8x4_t rgba0 = { { R.val[0], G.val[0], B.val[0], alpha } };
+    const uint8x8x4_t rgba1 = { { R.val[1], G.val[1], B.val[1], alpha } };
+    vst4_u8(dst, rgba0);
+    vst4_u8(dst + 32, rgba1);
+}
+
+
+unsigned rgbaFromNv21Rows(const uint8_t* yTop, const uint8_t* yBot, const uint8_t* uv,
+                          uint8_t* dstTop, uint8_t* dstBot, unsigned width) {
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        const uint8x8x2_t chroma = vld2_u8(uv + done);
+        const VectorOffsets offsets = chromaOffsets(chroma.val[0], chroma.val[1]);
+
+        const uint8x8x2_t top = vld2_u8(yTop + done);
+        const uint8x8x2_t bot = vld2_u8(yBot + done);
+        storeRgba16(top.val[0], top.val[1], offsets, dstTop + done*4);
+        storeRgba16(bot.val[0], bot.val[1], offsets, dstBot + done*4);
+    }
+    return done;
+}
+
+
+unsigned rgbaFromYv12Rows(const uint8_t* yTop, const uint8_t* yBot,
+                          const uint8_t* u, const uint8_t* v,
+                          uint8_t* dstTop, uint8_t* dstBot, unsigned width) {
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        const VectorOffsets offsets = chromaOffsets(vld1_u8(u + done/2), vld1_u8(v + done/2));
+
+        const uint8x8x2_t top = vld2_u8(yTop + done);
+        const uint8x8x2_t bot = vld2_u8(yBot + done);
+        storeRgba16(top.val[0], top.val[1], offsets, dstTop + done*4);
+        storeRgba16(bot.val[0], bot.val[1], offsets, dstBot + done*4);
+    }
+    return done;
+}
+
+
+unsigned rgbaFromYuyvRow(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        // Split 8 macro pixels into their components
+        const uint8x8x4_t yuyv = vld4_u8(src + done*2);
+        storeRgba16(yuyv.val[0], yuyv.val[2], chromaOffsets(yuyv.val[1], yuyv.val[3]),
+                    dst + done*4);
+    }
+    return done;
+}
+
+
+unsigned nv21FromYuyvRows(const uint8_t* topSrc, const uint8_t* botSrc,
+                          uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        const uint8x8x4_t top = vld4_u8(topSrc + done*2);
+        const uint8x8x4_t bot = vld4_u8(botSrc + done*2);
+
+        const uint8x8x2_t yTopPixels = { { top.val[0], top.val[2] } };
+        const uint8x8x2_t yBotPixels = { { bot.val[0], bot.val[2] } };
+        vst2_u8(yTop + done, yTopPixels);
+        vst2_u8(yBot + done, yBotPixels);
+
+        // Halving add truncates, just like the scalar average
+        const uint8x8x2_t uvPixels = { { vhadd_u8(top.val[1], bot.val[1]),
+                                         vhadd_u8(top.val[3], bot.val[3]) } };
+        vst2_u8(uv + done, uvPixels);
+    }
+    return done;
+}
+
+
+unsigned yuyvFromUyvyRow(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned done = 0;
+    for (; done + 8 <= width; done += 8) {
+        // Swapping the bytes of each 16 bit pixel is all it takes
+        vst1q_u8(dst + done*2, vrev16q_u8(vld1q_u8(src + done*2)));
+    }
+    return done;
+}
+
+#elif defined(__SSE2__)
+
+
+struct VectorOffsets {
+    __m128i r;
+    __m128i g;
+    __m128i b;
+};
+
+// The offsets for 8 chroma samples (one per 16 bit lane), which cover 16 pixels of a row
+static inline VectorOffsets chromaOffsets(const __m128i Uin, const __m128i Vin) {
+    const __m128i bias  = _mm_set1_epi16(128);
+    const __m128i round = _mm_set1_epi16(kCoeffRound);
+    const __m128i U = _mm_sub_epi16(Uin, bias);
+    const __m128i V = _mm_sub_epi16(Vin, bias);
+    return {
+        _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(V, _mm_set1_epi16(kCoeffRV)), round),
+                       kCoeffShift),
+        _mm_srai_epi16(_mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(U, _mm_set1_epi16(kCoeffGU)),
+                                                   _mm_mullo_epi16(V, _mm_set1_epi16(kCoeffGV))),
+                                     round),
+                       kCoeffShift),
+        _mm_srai_epi16(_mm_add_epi16(_mm_mullo_epi16(U, _mm_set1_epi16(kCoeffBU)), round),
+                       kCoeffShift),
+    };
+}
+
+// Writes 16 RGBA pixels given their 16 Y values
+static inline void storeRgba16(const __m128i Y, const VectorOffsets& offsets, uint8_t* dst) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+    const __m128i yEven = _mm_and_si128(Y, lowBytes);
+    const __m128i yOdd  = _mm_srli_epi16(Y, 8);
+
+    // Saturate each of the even and odd pixels to bytes, then put them back in order
+    const __m128i R = _mm_unpacklo_epi8(
+            _mm_packus_epi16(_mm_add_epi16(yEven, offsets.r), _mm_setzero_si128()),
+            _mm_packus_epi16(_mm_add_epi16(yOdd,  offsets.r), _mm_setzero_si128()));
+    const __m128i G = _mm_unpacklo_epi8(
+            _mm_packus_epi16(_mm_sub_epi16(yEven, offsets.g), _mm_setzero_si128()),
+            _mm_packus_epi16(_mm_sub_epi16(yOdd,  offsets.g), _mm_setzero_si128()));
+    const __m128i B = _mm_unpacklo_epi8(
+            _mm_packus_epi16(_mm_add_epi16(yEven, offsets.b), _mm_setzero_si128()),
+            _mm_packus_epi16(_mm_add_epi16(yOdd,  offsets.b), _mm_setzero_si128()));
+
+    // Interleave into RGBA pixels
+    const __m128i alpha = _mm_set1_epi8(static_cast<char>(0xFF));
+    const __m128i RGlo = _mm_unpacklo_epi8(R, G);
+    const __m128i RGhi = _mm_unpackhi_epi8(R, G);
+    const __m128i BAlo = _mm_unpacklo_epi8(B, alpha);
+    const __m128i BAhi = _mm_unpackhi_epi8(B, alpha);
+    __m128i* out = reinterpret_cast<__m128i*>(dst);
+    _mm_storeu_si128(out + 0, _mm_unpacklo_epi16(RGlo, BAlo));
+    _mm_storeu_si128(out + 1, _mm_unpackhi_epi16(RGlo, BAlo));
+    _mm_storeu_si128(out + 2, _mm_unpacklo_epi16(RGhi, BAhi));
+    _mm_storeu_si128(out + 3, _mm_unpackhi_epi16(RGhi, BAhi));
+}
+
+static inline __m128i loadBytes16(const uint8_t* src) {
+    return _mm_loadu_si128(reinterpret_cast<const __m128i*>(src));
+}
+
+// Loads 8 bytes, widening each into a 16 bit lane
+static inline __m128i loadBytes8(const uint8_t* src) {
+    return _mm_unpacklo_epi8(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(src)),
+                             _mm_setzero_si128());
+}
+
+
+unsigned rgbaFromNv21Rows(const uint8_t* yTop, const uint8_t* yBot, const uint8_t* uv,
+                          uint8_t* dstTop, uint8_t* dstBot, unsigned width) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        const __m128i chroma = loadBytes16(uv + done);
+        const VectorOffsets offsets = chromaOffsets(_mm_and_si128(chroma, lowBytes),
+                                                    _mm_srli_epi16(chroma, 8));
+
+        storeRgba16(loadBytes16(yTop + done), offsets, dstTop + done*4);
+        storeRgba16(loadBytes16(yBot + done), offsets, dstBot + done*4);
+    }
+    return done;
+}
+
+
+unsigned rgbaFromYv12Rows(const uint8_t* yTop, const uint8_t* yBot,
+                          const uint8_t* u, const uint8_t* v,
+                          uint8_t* dstTop, uint8_t* dstBot, unsigned width) {
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        const VectorOffsets offsets = chromaOffsets(loadBytes8(u + done/2),
+                                                    loadBytes8(v + done/2));
+
+        storeRgba16(loadBytes16(yTop + done), offsets, dstTop + done*4);
+        storeRgba16(loadBytes16(yBot + done), offsets, dstBot + done*4);
+    }
+    return done;
+}
+
+
+unsigned rgbaFromYuyvRow(const uint8_t* src, uint8_t* dst, unsigned width) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        // Gather the 16 Y values, and the 8 U/V pairs in the same shape as an NV21 row
+        const __m128i yuyv0 = loadBytes16(src + done*2);
+        const __m128i yuyv1 = loadBytes16(src + done*2 + 16);
+        const __m128i Y  = _mm_packus_epi16(_mm_and_si128(yuyv0, lowBytes),
+                                            _mm_and_si128(yuyv1, lowBytes));
+        const __m128i UV = _mm_packus_epi16(_mm_srli_epi16(yuyv0, 8), _mm_srli_epi16(yuyv1, 8));
+
+        storeRgba16(Y, chromaOffsets(_mm_and_si128(UV, lowBytes), _mm_srli_epi16(UV, 8)),
+                    dst + done*4);
+    }
+    return done;
+}
+
+
+unsigned nv21FromYuyvRows(const uint8_t* topSrc, const uint8_t* botSrc,
+                          uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width) {
+    const __m128i lowBytes = _mm_set1_epi16(0x00FF);
+
+    unsigned done = 0;
+    for (; done + 16 <= width; done += 16) {
+        const __m128i* top = reinterpret_cast<const __m128i*>(topSrc + done*2);
+        const __m128i* bot = reinterpret_cast<const __m128i*>(botSrc + done*2);
+        const __m128i top0 = _mm_loadu_si128(top);
+        const __m128i top1 = _mm_loadu_si128(top + 1);
+        const __m128i bot0 = _mm_loadu_si128(bot);
+        const __m128i bot1 = _mm_loadu_si128(bot + 1);
+
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yTop + done),
+                         _mm_packus_epi16(_mm_and_si128(top0, lowBytes),
+                                          _mm_and_si128(top1, lowBytes)));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(yBot + done),
+                         _mm_packus_epi16(_mm_and_si128(bot0, lowBytes),
+                                          _mm_and_si128(bot1, lowBytes)));
+
+        // Average in 16 bits so we truncate just like the scalar code (_mm_avg_epu8 rounds)
+        const __m128i uv0 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(top0, 8),
+                                                         _mm_srli_epi16(bot0, 8)), 1);
+        const __m128i uv1 = _mm_srli_epi16(_mm_add_epi16(_mm_srli_epi16(top1, 8),
+                                                         _mm_srli_epi16(bot1, 8)), 1);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(uv + done), _mm_packus_epi16(uv0, uv1));
+    }
+    return done;
+}
+
+
+unsigned yuyvFromUyvyRow(const uint8_t* src, uint8_t* dst, unsigned width) {
+    unsigned done = 0;
+    for (; done + 8 <= width; done += 8) {
+        // Swapping the bytes of each 16 bit pixel is all it takes
+        const __m128i uyvy = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + done*2));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(dst + done*2),
+                         _mm_or_si128(_mm_slli_epi16(uyvy, 8), _mm_srli_epi16(uyvy, 8)));
+    }
+    return done;
+}
+
+#else
+
+unsigned rgbaFromNv21Rows(const uint8_t*, const uint8_t*, const uint8_t*,
+                          uint8_t*, uint8_t*, unsigned) {
+    return 0;
+}
+
+unsigned rgbaFromYv12Rows(const uint8_t*, const uint8_t*, const uint8_t*, const uint8_t*,
+                          uint8_t*, uint8_t*, unsigned) {
+    return 0;
+}
+
+unsigned rgbaFromYuyvRow(const uint8_t*, uint8_t*, unsigned) {
+    return 0;
+}
+
+unsigned nv21FromYuyvRows(const uint8_t*, const uint8_t*, uint8_t*, uint8_t*, uint8_t*, unsigned) {
+    return 0;
+}
+
+unsigned yuyvFromUyvyRow(const uint8_t*, uint8_t*, unsigned) {
+    return 0;
+}
+
+#endif
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
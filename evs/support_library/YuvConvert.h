@@ -0,0 +1,113 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_AUTOMOTIVE_EVS_SUPPORT_YUVCONVERT_H
+#define ANDROID_AUTOMOTIVE_EVS_SUPPORT_YUVCONVERT_H
+
+#include <stdint.h>
+
+
+namespace android {
+namespace automotive {
+namespace evs {
+namespace support {
+
+// The YUV to RGB arithmetic shared by the app's FormatConvert and the sample driver's
+// bufferCopy, so both sides of the stack agree on every pixel.
+
+// The conversion is done in fixed point with the BT.601 coefficients below scaled by
+// 2^kCoeffShift.  They are small enough that every intermediate value fits in 16 bits, which is
+// what lets the vector versions below produce exactly the same results as the scalar code.
+static const int kCoeffShift = 6;
+static const int kCoeffRound = 1 << (kCoeffShift - 1);
+static const int kCoeffRV    = 73;   // 1.140
+static const int kCoeffGU    = 25;   // 0.395
+static const int kCoeffGV    = 37;   // 0.581
+static const int kCoeffBU    = 130;  // 2.032
+
+
+// Limit the given value to the range of a byte
+static inline uint8_t clampToByte(int v) {
+    if (v < 0) return 0;
+    if (v > 255) return 255;
+    return v;
+}
+
+
+// What a U/V pair adds to (or takes from) the luminance of each pixel it covers.  A chroma
+// sample covers several pixels, so we work these out once and use them for each.
+struct ChromaOffsets {
+    int r;
+    int g;
+    int b;
+};
+
+static inline ChromaOffsets chromaOffsets(const uint8_t Uin, const uint8_t Vin) {
+    const int U = Uin - 128;
+    const int V = Vin - 128;
+    return {
+        (kCoeffRV*V + kCoeffRound) >> kCoeffShift,
+        (kCoeffGU*U + kCoeffGV*V + kCoeffRound) >> kCoeffShift,
+        (kCoeffBU*U + kCoeffRound) >> kCoeffShift,
+    };
+}
+
+static inline uint32_t rgbxFromY(const uint8_t Y, const ChromaOffsets& offsets) {
+    return (clampToByte(Y + offsets.r)      ) |
+           (clampToByte(Y - offsets.g) <<  8) |
+           (clampToByte(Y + offsets.b) << 16) |
+           0xFF000000;  // Fill the alpha channel with ones
+}
+
+static inline uint32_t yuvToRgbx(const uint8_t Y, const uint8_t U, const uint8_t V) {
+    return rgbxFromY(Y, chromaOffsets(U, V));
+}
+
+
+// Vector versions of the converters' inner loops.  Each one converts as many pixels from the
+// start of its row(s) as fit its vector width and returns how many it did;  the caller finishes
+// the row(s) with the scalar code above.  NEON is always present on arm64 and SSE2 on x86, so
+// we pick them at compile time, and without either these do nothing and return 0.
+
+// The NV21 images the EVS app and sample driver exchange interleave their chroma with U in the
+// even bytes and V in the odd ones, and every path that reads or writes them here does the same.
+//
+// A pair of RGBA rows from the pair of Y rows sharing an NV21 chroma row
+unsigned rgbaFromNv21Rows(const uint8_t* yTop, const uint8_t* yBot, const uint8_t* uv,
+                          uint8_t* dstTop, uint8_t* dstBot, unsigned width);
+
+// The same from the separate U and V rows of YV12
+unsigned rgbaFromYv12Rows(const uint8_t* yTop, const uint8_t* yBot,
+                          const uint8_t* u, const uint8_t* v,
+                          uint8_t* dstTop, uint8_t* dstBot, unsigned width);
+
+// An RGBA row from a YUYV row
+unsigned rgbaFromYuyvRow(const uint8_t* src, uint8_t* dst, unsigned width);
+
+// A pair of NV21 Y rows and the chroma row they share from a pair of YUYV rows, averaging the
+// chroma of the two (truncating)
+unsigned nv21FromYuyvRows(const uint8_t* topSrc, const uint8_t* botSrc,
+                          uint8_t* yTop, uint8_t* yBot, uint8_t* uv, unsigned width);
+
+// A YUYV row from a UYVY row
+unsigned yuyvFromUyvyRow(const uint8_t* src, uint8_t* dst, unsigned width);
+
+} // namespace support
+} // namespace evs
+} // namespace automotive
+} // namespace android
+
+#endif  // ANDROID_AUTOMOTIVE_EVS_SUPPORT_YUVCONVERT_H
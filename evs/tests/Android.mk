@@ -0,0 +1,36 @@
+LOCAL_PATH:= $(call my-dir)
+
+##################################
+# Unit tests for the EVS app, manager and sample driver
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES := \
+    BufferCopyTest.cpp \
+    FileUtilsTest.cpp \
+    FrameExportTest.cpp \
+    FormatConvertTest.cpp \
+    ../app/FormatConvert.cpp \
+    ../sampleDriver/bufferCopy.cpp \
+
+LOCAL_C_INCLUDES += \
+    $(LOCAL_PATH)/../app \
+    $(LOCAL_PATH)/../manager \
+    $(LOCAL_PATH)/../sampleDriver \
+
+LOCAL_STATIC_LIBRARIES := \
+    libevssupport \
+
+LOCAL_SHARED_LIBRARIES := \
+    libcutils \
+    libGLESv2 \
+    libhidlbase \
+    liblog \
+    libutils \
+    android.hardware.automotive.evs@1.0 \
+
+LOCAL_MODULE := evs_unit_tests
+LOCAL_MODULE_TAGS := optional
+
+LOCAL_CFLAGS += -Wall -Werror -Wunused -Wunreachable-code
+
+include $(BUILD_NATIVE_TEST)
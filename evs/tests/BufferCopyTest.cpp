@@ -0,0 +1,313 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the sample driver's conversions (bufferCopy) pixel for pixel against the plain per pixel
+// arithmetic they implement.  The vector versions (NEON on arm, SSE2 on x86) handle as much of
+// each row as fits their width and the scalar code the rest, so we cover widths either side of
+// the vector sizes and rows padded out past the image.  Run on each architecture, this checks
+// whichever vector unit it has.
+
+#include <gtest/gtest.h>
+
+#include <linux/videodev2.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include <system/graphics.h>
+
+#include "bufferCopy.h"
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+using namespace ::android::hardware::automotive::evs::V1_0::implementation;
+
+
+namespace {
+
+// Covers no vector work, exact multiples of 8 and 16 pixels, and every kind of leftover
+const unsigned kWidths[] = { 2, 6, 8, 14, 16, 18, 24, 30, 32, 34, 46, 64, 98, 640 };
+const unsigned kHeight = 6;
+
+// Filled in before each conversion, so we can tell a pixel nobody wrote
+const uint8_t kUntouched = 0xAB;
+
+
+// Deterministic noise, so a failure can be reproduced
+std::vector<uint8_t> noise(size_t bytes, uint32_t seed) {
+    std::vector<uint8_t> data(bytes);
+    for (auto&& byte : data) {
+        seed = seed * 1103515245 + 12345;
+        byte = seed >> 16;
+    }
+    return data;
+}
+
+
+uint8_t clampToByte(int v) {
+    return (v < 0) ? 0 : (v > 255) ? 255 : v;
+}
+
+// BT.601 in fixed point with 6 fractional bits, as bufferCopy documents it
+uint32_t referenceRgbx(int Y, int U, int V) {
+    U -= 128;
+    V -= 128;
+    const int r = (73*V + 32) >> 6;
+    const int g = (25*U + 37*V + 32) >> 6;
+    const int b = (130*U + 32) >> 6;
+    return clampToByte(Y + r) | (clampToByte(Y - g) << 8) | (clampToByte(Y + b) << 16) |
+           0xFF000000;
+}
+
+
+BufferDesc makeTarget(unsigned width, unsigned height, unsigned stride, unsigned pixelSize) {
+    BufferDesc buff = {};
+    buff.width     = width;
+    buff.height    = height;
+    buff.stride    = stride;
+    buff.pixelSize = pixelSize;
+    return buff;
+}
+
+unsigned align16(unsigned value) {
+    return (value + 15) & ~15u;
+}
+
+} // namespace
+
+
+TEST(BufferCopyTest, RgbaFromYuyvMatchesReference) {
+    for (const unsigned width : kWidths) {
+        for (const unsigned padding : { 0u, 8u, 34u }) {
+            SCOPED_TRACE(testing::Message() << "width " << width << ", padding " << padding);
+            const unsigned stride = width + padding;    // In pixels, for both images
+
+            std::vector<uint8_t> src = noise(stride * 2 * kHeight, width + padding);
+            std::vector<uint32_t> dst(stride * kHeight, 0xABABABAB);
+            fillRGBAFromYUYV(makeTarget(width, kHeight, stride, 4), (uint8_t*)dst.data(),
+                             src.data(), stride * 2, 0, kHeight);
+
+            for (unsigned r = 0; r < kHeight; r++) {
+                const uint8_t* row = &src[r * stride * 2];
+                for (unsigned c = 0; c < stride; c++) {
+                    const uint8_t* pair = row + (c & ~1u) * 2;
+                    const uint32_t expected = (c < width) ?
+                            referenceRgbx(row[c * 2], pair[1], pair[3]) : 0xABABABAB;
+                    ASSERT_EQ(expected, dst[r * stride + c]) << "at row " << r << ", col " << c;
+                }
+            }
+        }
+    }
+}
+
+
+TEST(BufferCopyTest, YuyvFromUyvyMatchesReference) {
+    for (const unsigned width : kWidths) {
+        for (const unsigned padding : { 0u, 8u, 34u }) {
+            SCOPED_TRACE(testing::Message() << "width " << width << ", padding " << padding);
+            const unsigned stride = width + padding;
+
+            std::vector<uint8_t> src = noise(stride * 2 * kHeight, width * 3 + padding);
+            std::vector<uint8_t> dst(stride * 2 * kHeight, kUntouched);
+            fillYUYVFromUYVY(makeTarget(width, kHeight, stride, 2), dst.data(),
+                             src.data(), stride * 2, 0, kHeight);
+
+            for (unsigned r = 0; r < kHeight; r++) {
+                for (unsigned i = 0; i < stride * 2; i++) {
+                    const unsigned offset = r * stride * 2 + i;
+                    const uint8_t expected = (i < width * 2) ? src[offset ^ 1] : kUntouched;
+                    ASSERT_EQ(expected, dst[offset]) << "at row " << r << ", byte " << i;
+                }
+            }
+        }
+    }
+}
+
+
+TEST(BufferCopyTest, Nv21FromYuyvMatchesReference) {
+    for (const unsigned width : kWidths) {
+        for (const unsigned padding : { 0u, 8u, 34u }) {
+            SCOPED_TRACE(testing::Message() << "width " << width << ", padding " << padding);
+            const unsigned srcStride = (width + padding) * 2;   // In bytes
+            const unsigned dstStride = align16(width);          // NV21 fixes its own
+            const unsigned sizeY = dstStride * kHeight;
+
+            std::vector<uint8_t> src = noise(srcStride * kHeight, width * 5 + padding);
+            std::vector<uint8_t> dst(sizeY * 3 / 2, kUntouched);
+            fillNV21FromYUYV(makeTarget(width, kHeight, width, 1), dst.data(),
+                             src.data(), srcStride, 0, kHeight);
+
+            for (unsigned r = 0; r < kHeight; r++) {
+                for (unsigned c = 0; c < dstStride; c++) {
+                    const uint8_t expected = (c < width) ? src[r * srcStride + c * 2]
+                                                         : kUntouched;
+                    ASSERT_EQ(expected, dst[r * dstStride + c]) << "Y at row " << r
+                                                                << ", col " << c;
+                }
+            }
+
+            // Each chroma sample is the truncated average of the two rows it covers
+            for (unsigned r = 0; r < kHeight / 2; r++) {
+                const uint8_t* top = &src[(r * 2) * srcStride];
+                const uint8_t* bot = top + srcStride;
+                for (unsigned c = 0; c < dstStride; c++) {
+                    const unsigned sample = (c & ~1u) * 2 + ((c & 1) ? 3 : 1);
+                    const uint8_t expected = (c < width) ? (top[sample] + bot[sample]) >> 1
+                                                         : kUntouched;
+                    ASSERT_EQ(expected, dst[sizeY + r * dstStride + c]) << "UV at row " << r
+                                                                        << ", col " << c;
+                }
+            }
+        }
+    }
+}
+
+
+// The capture thread splits frames into bands across its conversion pool, so converting in
+// bands must come out just the same as converting the whole frame at once
+TEST(BufferCopyTest, BandsMatchWholeFrame) {
+    const unsigned width = 98;
+    const unsigned height = 12;
+    std::vector<uint8_t> src = noise(width * 2 * height, 7);
+
+    std::vector<uint32_t> whole(width * height), banded(width * height);
+    const BufferDesc rgba = makeTarget(width, height, width, 4);
+    fillRGBAFromYUYV(rgba, (uint8_t*)whole.data(), src.data(), width * 2, 0, height);
+    for (unsigned firstRow = 0; firstRow < height; firstRow += 4) {
+        fillRGBAFromYUYV(rgba, (uint8_t*)banded.data(), src.data(), width * 2, firstRow, 4);
+    }
+    EXPECT_EQ(whole, banded);
+
+    const unsigned sizeNv21 = align16(width) * height * 3 / 2;
+    std::vector<uint8_t> wholeNv21(sizeNv21), bandedNv21(sizeNv21);
+    const BufferDesc nv21 = makeTarget(width, height, width, 1);
+    fillNV21FromYUYV(nv21, wholeNv21.data(), src.data(), width * 2, 0, height);
+    for (unsigned firstRow = 0; firstRow < height; firstRow += 4) {
+        fillNV21FromYUYV(nv21, bandedNv21.data(), src.data(), width * 2, firstRow, 4);
+    }
+    EXPECT_EQ(wholeNv21, bandedNv21);
+}
+
+
+// Scaled views take the source pixel nearest each target pixel's center, stepping through the
+// crop in 16.16 fixed point, so we work out each expected pixel straight from the source bytes
+TEST(BufferCopyTest, ScaledViewMatchesReference) {
+    const unsigned width = 46;
+    const unsigned height = 12;
+    const unsigned padding = 10;    // Bytes past each packed row
+
+    struct Crop { unsigned x, y, width, height, outWidth, outHeight; };
+    const Crop crops[] = {
+        {  0, 0, width, height, width, height },    // Everything, one to one
+        {  0, 0, width, height, 16, 7 },            // Everything, shrunk
+        {  5, 3, 20, 6, 8, 4 },                     // Part of it, shrunk
+        { 11, 1, 7, 5, 21, 10 },                    // Part of it, blown up
+    };
+
+    for (const uint32_t format : { (uint32_t)V4L2_PIX_FMT_YUYV, (uint32_t)V4L2_PIX_FMT_UYVY,
+                                   (uint32_t)V4L2_PIX_FMT_NV21 }) {
+        const bool planar = format == V4L2_PIX_FMT_NV21;
+        const unsigned srcStride = planar ? align16(width) : width * 2 + padding;
+        std::vector<uint8_t> src = noise(planar ? srcStride * height * 3 / 2
+                                                : srcStride * height, format);
+
+        // What the source holds at a pixel, whichever the format
+        auto sample = [&](unsigned col, unsigned row, uint8_t* Y, uint8_t* U, uint8_t* V) {
+            const uint8_t* line = &src[row * srcStride];
+            const unsigned pair = (col & ~1u) * 2;
+            if (format == V4L2_PIX_FMT_YUYV) {
+                *Y = line[col * 2];
+                *U = line[pair + 1];
+                *V = line[pair + 3];
+            } else if (format == V4L2_PIX_FMT_UYVY) {
+                *Y = line[col * 2 + 1];
+                *U = line[pair];
+                *V = line[pair + 2];
+            } else {
+                // U in the even chroma bytes, as YuvConvert.h says
+                const uint8_t* uv = &src[srcStride * height + (row / 2) * srcStride + (col & ~1u)];
+                *Y = line[col];
+                *U = uv[0];
+                *V = uv[1];
+            }
+        };
+
+        for (auto&& crop : crops) {
+            for (const bool rgba : { false, true }) {
+                SCOPED_TRACE(testing::Message() << "format " << std::hex << format << std::dec
+                             << ", crop " << crop.x << "," << crop.y << " " << crop.width
+                             << "x" << crop.height << " to " << crop.outWidth << "x"
+                             << crop.outHeight << (rgba ? " rgba" : " gray"));
+                const unsigned pixelSize = rgba ? 4 : 1;
+                const unsigned dstStride = crop.outWidth + 3;
+                BufferDesc view = makeTarget(crop.outWidth, crop.outHeight, dstStride, pixelSize);
+                view.format = rgba ? HAL_PIXEL_FORMAT_RGBA_8888 : HAL_PIXEL_FORMAT_Y8;
+                std::vector<uint8_t> dst(dstStride * pixelSize * crop.outHeight, kUntouched);
+                ASSERT_TRUE(fillScaledView(view, dst.data(), src.data(), format, width, height,
+                                           srcStride, crop.x, crop.y, crop.width, crop.height));
+
+                const uint32_t stepX = (crop.width << 16) / crop.outWidth;
+                const uint32_t stepY = (crop.height << 16) / crop.outHeight;
+                for (unsigned r = 0; r < crop.outHeight; r++) {
+                    const unsigned row = ((crop.y << 16) + stepY / 2 + r * stepY) >> 16;
+                    const uint8_t* out = &dst[r * dstStride * pixelSize];
+                    for (unsigned c = 0; c < dstStride; c++) {
+                        if (c >= crop.outWidth) {
+                            for (unsigned b = 0; b < pixelSize; b++) {
+                                ASSERT_EQ(kUntouched, out[c * pixelSize + b])
+                                        << "padding at row " << r << ", col " << c;
+                            }
+                            continue;
+                        }
+                        const unsigned col = ((crop.x << 16) + stepX / 2 + c * stepX) >> 16;
+                        uint8_t Y, U, V;
+                        sample(col, row, &Y, &U, &V);
+                        if (rgba) {
+                            uint32_t pixel;
+                            memcpy(&pixel, &out[c * 4], sizeof(pixel));
+                            ASSERT_EQ(referenceRgbx(Y, U, V), pixel) << "at row " << r
+                                                                     << ", col " << c;
+                        } else {
+                            ASSERT_EQ(Y, out[c]) << "at row " << r << ", col " << c;
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+
+// A derived view of a format we can't sample must not come out as a misread YUYV image
+TEST(BufferCopyTest, ScaledViewRejectsUnknownFormats) {
+    const unsigned width = 32;
+    const unsigned height = 8;
+    std::vector<uint8_t> src = noise(width * 4 * height, 11);
+
+    BufferDesc gray = makeTarget(width / 2, height / 2, width / 2, 1);
+    gray.format = HAL_PIXEL_FORMAT_Y8;
+    std::vector<uint8_t> dst(gray.stride * gray.height, kUntouched);
+    for (const uint32_t format : { (uint32_t)V4L2_PIX_FMT_MJPEG, (uint32_t)V4L2_PIX_FMT_RGB32 }) {
+        EXPECT_FALSE(fillScaledView(gray, dst.data(), src.data(), format, width, height,
+                                    width * 4, 0, 0, width, height));
+    }
+    EXPECT_EQ(std::vector<uint8_t>(dst.size(), kUntouched), dst);
+
+    // While the formats it knows still go through
+    ASSERT_TRUE(fillScaledView(gray, dst.data(), src.data(), V4L2_PIX_FMT_YUYV, width, height,
+                               width * 2, 0, 0, width, height));
+    EXPECT_EQ(src[(1 * width * 2) + 1 * 2], dst[0]);
+}
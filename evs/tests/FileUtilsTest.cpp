@@ -0,0 +1,116 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the file helpers the EVS caches are built on:  that a file is read back just as it was
+// written, that nothing larger than the caller allows is read, and that a write leaves nothing
+// but the finished file behind.
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "FileUtils.h"
+
+using namespace ::android::automotive::evs::support;
+
+
+namespace {
+
+class FileUtilsTest : public testing::Test {
+protected:
+    void SetUp() override {
+        const char* tmp = getenv("TMPDIR");
+        std::string pattern = std::string(tmp ? tmp : "/data/local/tmp") + "/evs_file_XXXXXX";
+        ASSERT_NE(nullptr, mkdtemp(&pattern[0]));
+        mDir = pattern;
+        mPath = mDir + "/cache.bin";
+    }
+
+    void TearDown() override {
+        unlink(mPath.c_str());
+        unlink((mPath + ".tmp").c_str());
+        rmdir(mDir.c_str());
+    }
+
+    std::string mDir;
+    std::string mPath;
+};
+
+} // namespace
+
+
+TEST(FileUtilsHashTest, MatchesFnv1a) {
+    // The published 64 bit FNV-1a values
+    EXPECT_EQ(0xcbf29ce484222325ull, hashString(kHashSeed, ""));
+    EXPECT_EQ(0xaf63dc4c8601ec8cull, hashString(kHashSeed, "a"));
+    EXPECT_EQ(0x85944171f73967e8ull, hashString(kHashSeed, "foobar"));
+
+    // Hashing in pieces comes out the same as all at once
+    EXPECT_EQ(hashString(kHashSeed, "foobar"), hashString(hashString(kHashSeed, "foo"), "bar"));
+    EXPECT_EQ(hashString(kHashSeed, "foo"), hashBytes(kHashSeed, "foo", 3));
+    EXPECT_EQ(kHashSeed, hashString(kHashSeed, nullptr));
+}
+
+
+TEST_F(FileUtilsTest, ReadsBackWhatWasWritten) {
+    std::vector<uint8_t> data(100000);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = i * 7;
+    }
+    ASSERT_TRUE(writeFileAtomically(mPath, data.data(), data.size()));
+
+    std::vector<uint8_t> contents;
+    ASSERT_TRUE(readFile(mPath, data.size(), &contents));
+    EXPECT_EQ(data, contents);
+
+    // Nothing but the finished file is left
+    struct stat info;
+    EXPECT_NE(0, stat((mPath + ".tmp").c_str(), &info));
+
+    // Writing again replaces the file as a whole
+    const uint8_t shorter[] = { 1, 2, 3 };
+    ASSERT_TRUE(writeFileAtomically(mPath, shorter, sizeof(shorter)));
+    ASSERT_TRUE(readFile(mPath, data.size(), &contents));
+    EXPECT_EQ(std::vector<uint8_t>(shorter, shorter + sizeof(shorter)), contents);
+}
+
+
+TEST_F(FileUtilsTest, RefusesFilesOverTheLimit) {
+    const std::vector<uint8_t> data(4096, 0x5A);
+    ASSERT_TRUE(writeFileAtomically(mPath, data.data(), data.size()));
+
+    std::vector<uint8_t> contents = { 1 };
+    EXPECT_FALSE(readFile(mPath, data.size() - 1, &contents));
+    EXPECT_TRUE(contents.empty());
+    EXPECT_TRUE(readFile(mPath, data.size(), &contents));
+}
+
+
+TEST_F(FileUtilsTest, FailsWithoutAFile) {
+    std::vector<uint8_t> contents;
+    EXPECT_FALSE(readFile(mPath, 1024, &contents));
+    EXPECT_FALSE(readFile(mDir, 1024, &contents));      // A directory isn't a file
+
+    // Nowhere to write leaves nothing behind either
+    const uint8_t data[] = { 1 };
+    EXPECT_FALSE(writeFileAtomically(mDir + "/missing/cache.bin", data, sizeof(data)));
+}
@@ -0,0 +1,218 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the app's conversions (FormatConvert) pixel for pixel against the plain per pixel
+// arithmetic they implement, the same way BufferCopyTest does for the sample driver's, and that
+// the two come out the same for the format they both convert.
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+#include <string.h>
+
+#include <vector>
+
+#include "FormatConvert.h"
+#include "bufferCopy.h"
+
+using namespace ::android::hardware::automotive::evs::V1_0;
+using namespace ::android::hardware::automotive::evs::V1_0::implementation;
+
+
+namespace {
+
+// Covers no vector work, exact multiples of 16 pixels, and every kind of leftover
+const unsigned kWidths[] = { 2, 6, 14, 16, 18, 30, 32, 34, 46, 64, 98, 640 };
+const unsigned kHeight = 6;
+
+const uint32_t kUntouched = 0xABABABAB;
+
+
+std::vector<uint8_t> noise(size_t bytes, uint32_t seed) {
+    std::vector<uint8_t> data(bytes);
+    for (auto&& byte : data) {
+        seed = seed * 1103515245 + 12345;
+        byte = seed >> 16;
+    }
+    return data;
+}
+
+
+uint8_t clampToByte(int v) {
+    return (v < 0) ? 0 : (v > 255) ? 255 : v;
+}
+
+// BT.601 in fixed point with 6 fractional bits, as both sides of the stack document it
+uint32_t referenceRgbx(int Y, int U, int V) {
+    U -= 128;
+    V -= 128;
+    const int r = (73*V + 32) >> 6;
+    const int g = (25*U + 37*V + 32) >> 6;
+    const int b = (130*U + 32) >> 6;
+    return clampToByte(Y + r) | (clampToByte(Y - g) << 8) | (clampToByte(Y + b) << 16) |
+           0xFF000000;
+}
+
+
+unsigned align16(unsigned value) {
+    return (value + 15) & ~15u;
+}
+
+} // namespace
+
+
+TEST(FormatConvertTest, RgbFromNv21MatchesReference) {
+    for (const unsigned width : kWidths) {
+        for (const unsigned padding : { 0u, 8u }) {
+            SCOPED_TRACE(testing::Message() << "width " << width << ", padding " << padding);
+            const unsigned strideLum = align16(width);  // NV21 fixes its own
+            const unsigned sizeY = strideLum * kHeight;
+            const unsigned dstStride = width + padding;
+
+            std::vector<uint8_t> src = noise(sizeY * 3 / 2, width + padding);
+            std::vector<uint32_t> dst(dstStride * kHeight, kUntouched);
+            copyNV21toRGB32(width, kHeight, src.data(), dst.data(), dstStride, 0, kHeight);
+
+            for (unsigned r = 0; r < kHeight; r++) {
+                const uint8_t* uv = &src[sizeY + (r / 2) * strideLum];
+                for (unsigned c = 0; c < dstStride; c++) {
+                    const uint32_t expected = (c < width) ?
+                            referenceRgbx(src[r * strideLum + c], uv[c & ~1u], uv[c | 1]) :
+                            kUntouched;
+                    ASSERT_EQ(expected, dst[r * dstStride + c]) << "at row " << r << ", col " << c;
+                }
+            }
+        }
+    }
+}
+
+
+TEST(FormatConvertTest, RgbFromYv12MatchesReference) {
+    for (const unsigned width : kWidths) {
+        for (const unsigned padding : { 0u, 8u }) {
+            SCOPED_TRACE(testing::Message() << "width " << width << ", padding " << padding);
+            const unsigned strideLum = align16(width);
+            const unsigned strideColor = align16(strideLum / 2);
+            const unsigned sizeY = strideLum * kHeight;
+            const unsigned sizeColor = strideColor * kHeight / 2;
+            const unsigned dstStride = width + padding;
+
+            std::vector<uint8_t> src = noise(sizeY + sizeColor * 2, width * 3 + padding);
+            std::vector<uint32_t> dst(dstStride * kHeight, kUntouched);
+            copyYV12toRGB32(width, kHeight, src.data(), dst.data(), dstStride, 0, kHeight);
+
+            for (unsigned r = 0; r < kHeight; r++) {
+                const uint8_t* u = &src[sizeY + (r / 2) * strideColor];
+                const uint8_t* v = u + sizeColor;
+                for (unsigned c = 0; c < dstStride; c++) {
+                    const uint32_t expected = (c < width) ?
+                            referenceRgbx(src[r * strideLum + c], u[c / 2], v[c / 2]) :
+                            kUntouched;
+                    ASSERT_EQ(expected, dst[r * dstStride + c]) << "at row " << r << ", col " << c;
+                }
+            }
+        }
+    }
+}
+
+
+TEST(FormatConvertTest, RgbFromYuyvMatchesReference) {
+    for (const unsigned width : kWidths) {
+        for (const unsigned padding : { 0u, 8u, 34u }) {
+            SCOPED_TRACE(testing::Message() << "width " << width << ", padding " << padding);
+            const unsigned stride = width + padding;    // In pixels, for both images
+
+            std::vector<uint8_t> src = noise(stride * 2 * kHeight, width * 5 + padding);
+            std::vector<uint32_t> dst(stride * kHeight, kUntouched);
+            copyYUYVtoRGB32(width, kHeight, src.data(), stride, dst.data(), stride, 0, kHeight);
+
+            for (unsigned r = 0; r < kHeight; r++) {
+                const uint8_t* row = &src[r * stride * 2];
+                for (unsigned c = 0; c < stride; c++) {
+                    const uint8_t* pair = row + (c & ~1u) * 2;
+                    const uint32_t expected = (c < width) ?
+                            referenceRgbx(row[c * 2], pair[1], pair[3]) : kUntouched;
+                    ASSERT_EQ(expected, dst[r * stride + c]) << "at row " << r << ", col " << c;
+                }
+            }
+        }
+    }
+}
+
+
+// The app and the sample driver convert YUYV to RGBA with the same shared arithmetic
+TEST(FormatConvertTest, YuyvMatchesSampleDriver) {
+    const unsigned width = 98;
+    std::vector<uint8_t> src = noise(width * 2 * kHeight, 11);
+
+    std::vector<uint32_t> app(width * kHeight), driver(width * kHeight);
+    copyYUYVtoRGB32(width, kHeight, src.data(), width, app.data(), width, 0, kHeight);
+
+    BufferDesc target = {};
+    target.width     = width;
+    target.height    = kHeight;
+    target.stride    = width;
+    target.pixelSize = 4;
+    fillRGBAFromYUYV(target, (uint8_t*)driver.data(), src.data(), width * 2, 0, kHeight);
+    EXPECT_EQ(app, driver);
+}
+
+
+TEST(FormatConvertTest, InterleavedCopyKeepsPadding) {
+    const unsigned width = 13, srcStride = 16, dstStride = 20, pixelSize = 4;
+    std::vector<uint8_t> src = noise(srcStride * kHeight * pixelSize, 3);
+    std::vector<uint8_t> dst(dstStride * kHeight * pixelSize, 0xAB);
+    copyMatchedInterleavedFormats(width, kHeight, src.data(), srcStride, dst.data(), dstStride,
+                                  pixelSize, 0, kHeight);
+
+    for (unsigned r = 0; r < kHeight; r++) {
+        for (unsigned i = 0; i < dstStride * pixelSize; i++) {
+            const uint8_t expected = (i < width * pixelSize) ?
+                    src[r * srcStride * pixelSize + i] : 0xAB;
+            ASSERT_EQ(expected, dst[r * dstStride * pixelSize + i]) << "at row " << r
+                                                                    << ", byte " << i;
+        }
+    }
+}
+
+
+// RenderPixelCopy splits frames into bands across its threads, so converting in bands must come
+// out just the same as converting the whole frame at once
+TEST(FormatConvertTest, BandsMatchWholeFrame) {
+    const unsigned width = 98;
+    const unsigned height = 12;
+    const unsigned sizeY = align16(width) * height;
+    std::vector<uint8_t> src = noise(sizeY * 2, 5);
+
+    std::vector<uint32_t> whole(width * height), banded(width * height);
+    copyNV21toRGB32(width, height, src.data(), whole.data(), width, 0, height);
+    for (unsigned firstRow = 0; firstRow < height; firstRow += 4) {
+        copyNV21toRGB32(width, height, src.data(), banded.data(), width, firstRow, 4);
+    }
+    EXPECT_EQ(whole, banded);
+
+    copyYV12toRGB32(width, height, src.data(), whole.data(), width, 0, height);
+    for (unsigned firstRow = 0; firstRow < height; firstRow += 4) {
+        copyYV12toRGB32(width, height, src.data(), banded.data(), width, firstRow, 4);
+    }
+    EXPECT_EQ(whole, banded);
+
+    copyYUYVtoRGB32(width, height, src.data(), width, whole.data(), width, 0, height);
+    for (unsigned firstRow = 0; firstRow < height; firstRow += 4) {
+        copyYUYVtoRGB32(width, height, src.data(), width, banded.data(), width, firstRow, 4);
+    }
+    EXPECT_EQ(whole, banded);
+}
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Checks the protocol the manager uses to publish exported frames (FrameExport.h):  a reader
+// racing the writer must only ever come away with a frame exactly as the writer published it.
+
+#include <gtest/gtest.h>
+
+#include <stdint.h>
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#include "FrameExport.h"
+
+using namespace ::android::automotive::evs::V1_0::implementation;
+
+
+namespace {
+
+const uint32_t kBuffers = 7;
+
+// The ring as the manager sets it up, except that it lives on the heap rather than in ashmem
+std::unique_ptr<ExportRing> makeRing() {
+    std::unique_ptr<ExportRing> ring(new ExportRing());
+    ring->magic      = kExportMagic;
+    ring->version    = kExportVersion;
+    ring->slotCount  = kExportSlots;
+    ring->maxBuffers = kBuffers;
+    return ring;
+}
+
+// What frame |n| holds, so the reader can tell what it should have got
+uint32_t bufferIdOf(uint64_t n)     { return n % kBuffers; }
+int64_t  arrivalTimeOf(uint64_t n)  { return n * 3; }
+
+} // namespace
+
+
+TEST(FrameExportTest, ReaderOnlySeesWholeFrames) {
+    const unsigned kReads = 200000;
+    std::unique_ptr<ExportRing> ring = makeRing();
+
+    // The writer keeps publishing for as long as the reader is reading, so they race throughout
+    std::atomic<bool> stop(false);
+    uint64_t framesPublished = 0;
+    std::thread writer([&ring, &stop, &framesPublished]() {
+        uint64_t n = 0;
+        while (!stop.load(std::memory_order_relaxed)) {
+            n++;
+            publishExportedFrame(ring.get(), bufferIdOf(n), n, arrivalTimeOf(n));
+        }
+        framesPublished = n;
+    });
+
+    uint64_t lastFrameNumber = 0;
+    for (unsigned reads = 0; reads < kReads; ) {
+        ExportedFrame frame = {};
+        if (!readLatestExportedFrame(*ring, &frame)) {
+            continue;
+        }
+        reads++;
+        EXPECT_GE(frame.frameNumber, 1u);
+        EXPECT_EQ(bufferIdOf(frame.frameNumber), frame.bufferId);
+        EXPECT_EQ(arrivalTimeOf(frame.frameNumber), frame.arrivalTimeNs);
+        EXPECT_EQ(0u, frame.sequence.load() & 1);
+
+        // The ring only moves forward
+        EXPECT_GE(frame.frameNumber, lastFrameNumber);
+        lastFrameNumber = frame.frameNumber;
+        if (HasFailure()) {
+            break;
+        }
+    }
+    stop = true;
+    writer.join();
+
+    // Once the writer is done, the latest frame is the last one it published
+    ExportedFrame frame = {};
+    ASSERT_TRUE(readLatestExportedFrame(*ring, &frame));
+    EXPECT_EQ(framesPublished, frame.frameNumber);
+    EXPECT_EQ(bufferIdOf(framesPublished), frame.bufferId);
+}
+
+
+TEST(FrameExportTest, RejectsEmptyRing) {
+    std::unique_ptr<ExportRing> ring = makeRing();
+    ExportedFrame frame = {};
+    EXPECT_FALSE(readLatestExportedFrame(*ring, &frame));
+}
+
+
+TEST(FrameExportTest, RejectsSlotBeingWritten) {
+    std::unique_ptr<ExportRing> ring = makeRing();
+    publishExportedFrame(ring.get(), 1, 1, 100);
+
+    // As if the writer had started on the slot again and not yet finished
+    ring->slots[0].sequence.fetch_add(1);
+    ExportedFrame frame = {};
+    EXPECT_FALSE(readLatestExportedFrame(*ring, &frame));
+
+    ring->slots[0].sequence.fetch_add(1);
+    EXPECT_TRUE(readLatestExportedFrame(*ring, &frame));
+}
+
+
+TEST(FrameExportTest, RejectsBufferOutOfRange) {
+    std::unique_ptr<ExportRing> ring = makeRing();
+    publishExportedFrame(ring.get(), kBuffers, 1, 100);
+    ExportedFrame frame = {};
+    EXPECT_FALSE(readLatestExportedFrame(*ring, &frame));
+}
+
+
+TEST(FrameExportTest, RetiredBufferIsNoLongerCurrent) {
+    std::unique_ptr<ExportRing> ring = makeRing();
+    publishExportedFrame(ring.get(), 3, 1, 100);
+
+    ExportedFrame frame = {};
+    ASSERT_TRUE(readLatestExportedFrame(*ring, &frame));
+    EXPECT_TRUE(isExportedFrameCurrent(*ring, frame));
+
+    // Retiring some other buffer doesn't matter
+    retireExportedBuffer(ring.get(), 4);
+    EXPECT_TRUE(isExportedFrameCurrent(*ring, frame));
+
+    retireExportedBuffer(ring.get(), 3);
+    EXPECT_FALSE(isExportedFrameCurrent(*ring, frame));
+
+    // A frame published into the buffer after that is current again
+    publishExportedFrame(ring.get(), 3, 2, 200);
+    ASSERT_TRUE(readLatestExportedFrame(*ring, &frame));
+    EXPECT_EQ(2u, frame.frameNumber);
+    EXPECT_TRUE(isExportedFrameCurrent(*ring, frame));
+}
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.car.procfsinspector;
+
+import android.os.Parcel;
+import android.os.Parcelable;
+
+/**
+ * Something that happened to a process, as reported by the kernel proc connector.
+ */
+public class ProcessEvent implements Parcelable {
+    public static final Parcelable.Creator<ProcessEvent> CREATOR =
+        new Parcelable.Creator<ProcessEvent>() {
+            public ProcessEvent createFromParcel(Parcel in) {
+                return new ProcessEvent(in);
+            }
+
+            public ProcessEvent[] newArray(int size) {
+                return new ProcessEvent[size];
+            }
+        };
+
+    // a new process, started by parentPid
+    public static final int TYPE_FORK = 1;
+    // the process is running a new program
+    public static final int TYPE_EXEC = 2;
+    // the process is gone, with exitCode as given to wait()
+    public static final int TYPE_EXIT = 3;
+    // the process switched to a different user
+    public static final int TYPE_UID_CHANGE = 4;
+    // the kernel dropped events, so any copy of the process table has to be read again; only
+    // the type and timestamp are set
+    public static final int TYPE_RESYNC = 5;
+
+    public final int type;
+    public final int pid;
+    public final int uid;
+    public final int parentPid;
+    public final int exitCode;
+    // CLOCK_MONOTONIC, as in SystemClock.uptimeMillis() but in nanoseconds
+    public final long timestampNs;
+
+    public ProcessEvent(Parcel in) {
+        this.type = in.readInt();
+        this.pid = in.readInt();
+        this.uid = in.readInt();
+        this.parentPid = in.readInt();
+        this.exitCode = in.readInt();
+        this.timestampNs = in.readLong();
+    }
+
+    @Override
+    public int describeContents() {
+        return 0;
+    }
+
+    @Override
+    public void writeToParcel(Parcel dest, int flags) {
+        dest.writeInt(type);
+        dest.writeInt(pid);
+        dest.writeInt(uid);
+        dest.writeInt(parentPid);
+        dest.writeInt(exitCode);
+        dest.writeLong(timestampNs);
+    }
+
+    @Override
+    public String toString() {
+        return String.format("type = %d, pid = %d, uid = %d, parentPid = %d, exitCode = %d",
+            type, pid, uid, parentPid, exitCode);
+    }
+}
@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.car.procfsinspector;
+
+/**
+ * Resource usage of one process. Only the fields asked for from
+ * {@link ProcfsInspector#readProcessStats} are filled in, the others are 0.
+ */
+public final class ProcessStats {
+    // utimeMs, stimeMs
+    public static final int FIELD_CPU_TIME = 1 << 0;
+    // rssKb, privateKb
+    public static final int FIELD_MEMORY = 1 << 1;
+    // threads
+    public static final int FIELD_THREADS = 1 << 2;
+    // state
+    public static final int FIELD_STATE = 1 << 3;
+    // oomScoreAdj
+    public static final int FIELD_OOM_SCORE_ADJ = 1 << 4;
+
+    public final int pid;
+    public final int uid;
+    public long utimeMs;
+    public long stimeMs;
+    public long rssKb;
+    // resident memory that isn't shared with other processes, a cheap stand-in for PSS
+    public long privateKb;
+    public int threads;
+    // as in /proc/<pid>/stat, e.g. 'R' or 'S'
+    public char state;
+    public int oomScoreAdj;
+
+    ProcessStats(int pid, int uid) {
+        this.pid = pid;
+        this.uid = uid;
+    }
+
+    @Override
+    public String toString() {
+        return String.format("pid = %d, uid = %d, utime = %dms, stime = %dms, rss = %dkB, "
+            + "private = %dkB, threads = %d, state = %c, oom_score_adj = %d",
+            pid, uid, utimeMs, stimeMs, rssKb, privateKb, threads, state, oomScoreAdj);
+    }
+}
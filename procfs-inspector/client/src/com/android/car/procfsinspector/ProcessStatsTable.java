@@ -0,0 +1,100 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.car.procfsinspector;
+
+import android.os.Parcel;
+import android.os.Parcelable;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * The stats of every process. Only the fields in {@link #fields} go into the parcel, so asking
+ * for fewer fields makes the reply smaller too.
+ */
+public class ProcessStatsTable implements Parcelable {
+    public static final Parcelable.Creator<ProcessStatsTable> CREATOR =
+        new Parcelable.Creator<ProcessStatsTable>() {
+            public ProcessStatsTable createFromParcel(Parcel in) {
+                return new ProcessStatsTable(in);
+            }
+
+            public ProcessStatsTable[] newArray(int size) {
+                return new ProcessStatsTable[size];
+            }
+        };
+
+    public final int fields;
+    public final List<ProcessStats> processes;
+
+    public ProcessStatsTable(Parcel in) {
+        this.fields = in.readInt();
+        int count = in.readInt();
+        this.processes = new ArrayList<>(Math.max(count, 0));
+        for (int i = 0; i < count; i++) {
+            ProcessStats stats = new ProcessStats(in.readInt(), in.readInt());
+            if ((fields & ProcessStats.FIELD_CPU_TIME) != 0) {
+                stats.utimeMs = in.readLong();
+                stats.stimeMs = in.readLong();
+            }
+            if ((fields & ProcessStats.FIELD_MEMORY) != 0) {
+                stats.rssKb = in.readLong();
+                stats.privateKb = in.readLong();
+            }
+            if ((fields & ProcessStats.FIELD_THREADS) != 0) {
+                stats.threads = in.readInt();
+            }
+            if ((fields & ProcessStats.FIELD_STATE) != 0) {
+                stats.state = (char) in.readInt();
+            }
+            if ((fields & ProcessStats.FIELD_OOM_SCORE_ADJ) != 0) {
+                stats.oomScoreAdj = in.readInt();
+            }
+            processes.add(stats);
+        }
+    }
+
+    @Override
+    public int describeContents() {
+        return 0;
+    }
+
+    @Override
+    public void writeToParcel(Parcel dest, int flags) {
+        dest.writeInt(fields);
+        dest.writeInt(processes.size());
+        for (ProcessStats stats : processes) {
+            dest.writeInt(stats.pid);
+            dest.writeInt(stats.uid);
+            if ((fields & ProcessStats.FIELD_CPU_TIME) != 0) {
+                dest.writeLong(stats.utimeMs);
+                dest.writeLong(stats.stimeMs);
+            }
+            if ((fields & ProcessStats.FIELD_MEMORY) != 0) {
+                dest.writeLong(stats.rssKb);
+                dest.writeLong(stats.privateKb);
+            }
+            if ((fields & ProcessStats.FIELD_THREADS) != 0) {
+                dest.writeInt(stats.threads);
+            }
+            if ((fields & ProcessStats.FIELD_STATE) != 0) {
+                dest.writeInt(stats.state);
+            }
+            if ((fields & ProcessStats.FIELD_OOM_SCORE_ADJ) != 0) {
+                dest.writeInt(stats.oomScoreAdj);
+            }
+        }
+    }
+}
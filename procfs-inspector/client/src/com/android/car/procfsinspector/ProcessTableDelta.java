@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.car.procfsinspector;
+
+import android.os.Parcel;
+import android.os.Parcelable;
+import java.util.List;
+
+/**
+ * What changed in the process table since the generation a client last saw. If the server no
+ * longer has that generation, or the client saw it from an earlier {@link #epoch} of the server,
+ * {@link #fullTable} is set and {@link #added} is the whole table.
+ */
+public class ProcessTableDelta implements Parcelable {
+    public static final Parcelable.Creator<ProcessTableDelta> CREATOR =
+        new Parcelable.Creator<ProcessTableDelta>() {
+            public ProcessTableDelta createFromParcel(Parcel in) {
+                return new ProcessTableDelta(in);
+            }
+
+            public ProcessTableDelta[] newArray(int size) {
+                return new ProcessTableDelta[size];
+            }
+        };
+
+    // changes each time the server starts, and goes with generation in the next request
+    public final long epoch;
+    public final long generation;
+    public final boolean fullTable;
+    // processes that are new, or whose pid was reused by a different user
+    public final List<ProcessInfo> added;
+    // pids that are gone, to be removed before the added processes are applied
+    public final int[] removed;
+
+    public ProcessTableDelta(Parcel in) {
+        this.epoch = in.readLong();
+        this.generation = in.readLong();
+        this.fullTable = in.readInt() != 0;
+        this.added = in.createTypedArrayList(ProcessInfo.CREATOR);
+        this.removed = in.createIntArray();
+    }
+
+    @Override
+    public int describeContents() {
+        return 0;
+    }
+
+    @Override
+    public void writeToParcel(Parcel dest, int flags) {
+        dest.writeLong(epoch);
+        dest.writeLong(generation);
+        dest.writeInt(fullTable ? 1 : 0);
+        dest.writeTypedList(added);
+        dest.writeIntArray(removed);
+    }
+
+    @Override
+    public String toString() {
+        return String.format(
+            "epoch = %d, generation = %d, fullTable = %b, added = %d, removed = %d",
+            epoch, generation, fullTable, added.size(), removed.length);
+    }
+}
@@ -19,6 +19,8 @@ import android.annotation.Nullable;
 import android.os.RemoteException;
 import android.os.ServiceManager;
 import android.util.Log;
+import android.util.SparseArray;
+import java.util.ArrayList;
 import java.util.Arrays;
 import java.util.Collections;
 import java.util.List;
@@ -29,6 +31,13 @@ public final class ProcfsInspector {
     private static final String SERVICE_NAME = "com.android.car.procfsinspector";
     private final IProcfsInspector mService;
 
+    // The process table as of sGeneration, kept up to date with deltas from the service. The
+    // service restarts its generations with each epoch, so we need both to name a table.
+    private static final Object sLock = new Object();
+    private static long sEpoch = 0;
+    private static long sGeneration = 0;
+    private static final SparseArray<ProcessInfo> sProcesses = new SparseArray<>();
+
     private ProcfsInspector(IProcfsInspector service) {
         mService = service;
     }
@@ -43,7 +52,7 @@ public final class ProcfsInspector {
         IProcfsInspector procfsInspector = tryGet();
         if (procfsInspector != null) {
             try {
-                return procfsInspector.readProcessTable();
+                return readProcessTable(procfsInspector);
             } catch (RemoteException e) {
                 Log.w(TAG, "caught RemoteException", e);
             }
@@ -51,4 +60,101 @@ public final class ProcfsInspector {
 
         return Collections.emptyList();
     }
+
+    /**
+     * Returns the resource usage of every process, with the {@code ProcessStats.FIELD_*} values
+     * in {@code fields} filled in.
+     */
+    public static List<ProcessStats> readProcessStats(int fields) {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                return procfsInspector.readProcessStats(fields).processes;
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+
+        return Collections.emptyList();
+    }
+
+    /**
+     * Returns the resource usage of every uid's processes added up, with the
+     * {@code ProcessStats.FIELD_*} values in {@code fields} that {@link UidStats#ALL_FIELDS}
+     * allows filled in. Cheaper than grouping {@link #readProcessStats} by uid, since only one
+     * row per uid comes over binder.
+     */
+    public static List<UidStats> readUidStats(int fields) {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                return procfsInspector.readUidStats(fields).uids;
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+
+        return Collections.emptyList();
+    }
+
+    /**
+     * Has {@code listener} told about processes starting, exiting and changing user as it
+     * happens. Returns false if the service can't do that, and the table has to be polled.
+     */
+    public static boolean registerProcessEventListener(IProcessEventListener listener) {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                return procfsInspector.registerProcessEventListener(listener);
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+
+        return false;
+    }
+
+    public static void unregisterProcessEventListener(IProcessEventListener listener) {
+        IProcfsInspector procfsInspector = tryGet();
+        if (procfsInspector != null) {
+            try {
+                procfsInspector.unregisterProcessEventListener(listener);
+            } catch (RemoteException e) {
+                Log.w(TAG, "caught RemoteException", e);
+            }
+        }
+    }
+
+    // Only asks the service for what changed since last time, then applies that to our copy
+    private static List<ProcessInfo> readProcessTable(IProcfsInspector procfsInspector)
+            throws RemoteException {
+        synchronized (sLock) {
+            ProcessTableDelta delta = procfsInspector.readProcessTableDelta(sEpoch, sGeneration);
+            if (delta.fullTable || delta.epoch != sEpoch) {
+                if (!delta.fullTable) {
+                    // The service should never do this, but a delta against someone else's
+                    // table would leave ours wrong for good
+                    Log.w(TAG, "delta from a new epoch without the whole table, resyncing");
+                    sEpoch = 0;
+                    sGeneration = 0;
+                    return readProcessTable(procfsInspector);
+                }
+                sProcesses.clear();
+            }
+            for (int pid : delta.removed) {
+                sProcesses.delete(pid);
+            }
+            for (ProcessInfo processInfo : delta.added) {
+                sProcesses.put(processInfo.pid, processInfo);
+            }
+            sEpoch = delta.epoch;
+            sGeneration = delta.generation;
+
+            List<ProcessInfo> processes = new ArrayList<>(sProcesses.size());
+            for (int i = 0; i < sProcesses.size(); i++) {
+                processes.add(sProcesses.valueAt(i));
+            }
+            return processes;
+        }
+    }
 }
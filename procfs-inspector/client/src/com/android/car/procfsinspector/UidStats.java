@@ -0,0 +1,47 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.car.procfsinspector;
+
+/**
+ * The resource usage of all the processes of one uid, added up. Only the fields asked for from
+ * {@link ProcfsInspector#readUidStats} are filled in, the others are 0, except for
+ * {@link #processes} which always is.
+ */
+public final class UidStats {
+    // the ProcessStats.FIELD_* values that mean anything added up
+    public static final int ALL_FIELDS = ProcessStats.FIELD_CPU_TIME
+        | ProcessStats.FIELD_MEMORY | ProcessStats.FIELD_THREADS;
+
+    public final int uid;
+    public final int processes;
+    public long utimeMs;
+    public long stimeMs;
+    public long rssKb;
+    public long privateKb;
+    public int threads;
+
+    UidStats(int uid, int processes) {
+        this.uid = uid;
+        this.processes = processes;
+    }
+
+    @Override
+    public String toString() {
+        return String.format("uid = %d, processes = %d, utime = %dms, stime = %dms, rss = %dkB, "
+            + "private = %dkB, threads = %d",
+            uid, processes, utimeMs, stimeMs, rssKb, privateKb, threads);
+    }
+}
@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2017 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.android.car.procfsinspector;
+
+import android.os.Parcel;
+import android.os.Parcelable;
+import java.util.ArrayList;
+import java.util.List;
+
+/**
+ * One row of {@link UidStats} per uid, sorted by uid. Like {@link ProcessStatsTable}, only the
+ * fields in {@link #fields} go into the parcel.
+ */
+public class UidStatsTable implements Parcelable {
+    public static final Parcelable.Creator<UidStatsTable> CREATOR =
+        new Parcelable.Creator<UidStatsTable>() {
+            public UidStatsTable createFromParcel(Parcel in) {
+                return new UidStatsTable(in);
+            }
+
+            public UidStatsTable[] newArray(int size) {
+                return new UidStatsTable[size];
+            }
+        };
+
+    public final int fields;
+    public final List<UidStats> uids;
+
+    public UidStatsTable(Parcel in) {
+        this.fields = in.readInt();
+        int count = in.readInt();
+        this.uids = new ArrayList<>(Math.max(count, 0));
+        for (int i = 0; i < count; i++) {
+            UidStats stats = new UidStats(in.readInt(), in.readInt());
+            if ((fields & ProcessStats.FIELD_CPU_TIME) != 0) {
+                stats.utimeMs = in.readLong();
+                stats.stimeMs = in.readLong();
+            }
+            if ((fields & ProcessStats.FIELD_MEMORY) != 0) {
+                stats.rssKb = in.readLong();
+                stats.privateKb = in.readLong();
+            }
+            if ((fields & ProcessStats.FIELD_THREADS) != 0) {
+                stats.threads = in.readInt();
+            }
+            uids.add(stats);
+        }
+    }
+
+    @Override
+    public int describeContents() {
+        return 0;
+    }
+
+    @Override
+    public void writeToParcel(Parcel dest, int flags) {
+        dest.writeInt(fields);
+        dest.writeInt(uids.size());
+        for (UidStats stats : uids) {
+            dest.writeInt(stats.uid);
+            dest.writeInt(stats.processes);
+            if ((fields & ProcessStats.FIELD_CPU_TIME) != 0) {
+                dest.writeLong(stats.utimeMs);
+                dest.writeLong(stats.stimeMs);
+            }
+            if ((fields & ProcessStats.FIELD_MEMORY) != 0) {
+                dest.writeLong(stats.rssKb);
+                dest.writeLong(stats.privateKb);
+            }
+            if ((fields & ProcessStats.FIELD_THREADS) != 0) {
+                dest.writeInt(stats.threads);
+            }
+        }
+    }
+}
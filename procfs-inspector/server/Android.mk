@@ -23,7 +23,8 @@ LOCAL_SRC_FILES := \
     server.cpp \
     impl.cpp \
     process.cpp \
-    directory.cpp
+    directory.cpp \
+    procconnector.cpp
 
 LOCAL_C_INCLUDES += \
     frameworks/base/include
@@ -35,7 +36,12 @@ LOCAL_SHARED_LIBRARIES := \
 
 LOCAL_STRIP_MODULE := keep_symbols
 
+# Following the proc connector needs CAP_NET_ADMIN, so only products that ask for it get it
+ifeq ($(CAR_PROCFS_INSPECTOR_PROC_CONNECTOR),true)
+LOCAL_INIT_RC := com.android.car.procfsinspector.procconnector.rc
+else
 LOCAL_INIT_RC := com.android.car.procfsinspector.rc
+endif
 
 LOCAL_MODULE := com.android.car.procfsinspector
 LOCAL_MODULE_TAGS := optional
@@ -16,30 +16,39 @@
 
 #include "directory.h"
 
-#include <android-base/stringprintf.h>
+#include <sys/syscall.h>
 
 procfsinspector::Directory::Directory(const char* path) {
     if (path && path[0]) {
         mPath.assign(path);
-        mDirectory.reset(opendir(path));
+        if (mPath.back() != '/') {
+            mPath += '/';
+        }
+        mFd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (mFd >= 0) {
+            mBuffer.reset(new char[kBufferSize]);
+        }
     }
 }
 
-bool procfsinspector::Directory::Entry::isEmpty() const {
-    return mParent.empty() && mChild.empty();
+procfsinspector::Directory::~Directory() {
+    if (mFd >= 0) {
+        close(mFd);
+    }
 }
 
-procfsinspector::Directory::Entry::Entry(std::string parent, std::string child) :
-    mParent(parent), mChild(child) {
-    if (!isEmpty()) {
-        if (mParent.back() != '/') {
-            mParent += '/';
-        }
-    }
+bool procfsinspector::Directory::Entry::isEmpty() const {
+    return mChild == nullptr;
 }
 
+procfsinspector::Directory::Entry::Entry(int dirFd, const char* parent, const char* child) :
+    mDirFd(dirFd), mParent(parent), mChild(child) {}
+
 std::string procfsinspector::Directory::Entry::str() {
-    return mParent + mChild;
+    if (isEmpty()) {
+        return "";
+    }
+    return std::string(mParent) + mChild;
 }
 
 uid_t procfsinspector::Directory::Entry::getOwnerUserId() {
@@ -48,23 +57,46 @@ uid_t procfsinspector::Directory::Entry::getOwnerUserId() {
     }
     struct stat buf;
     // fill in stat info for this entry, or return invalid UID on failure
-    if (stat(str().c_str(), &buf)) {
+    if (fstatat(mDirFd, mChild, &buf, 0)) {
         return -1;
     }
     return buf.st_uid;
 }
 
+int procfsinspector::Directory::Entry::open(int flags) {
+    if (isEmpty()) {
+        return -1;
+    }
+    return openat(mDirFd, mChild, flags | O_CLOEXEC);
+}
+
+bool procfsinspector::Directory::fill() {
+    long bytes = syscall(__NR_getdents64, mFd, mBuffer.get(), kBufferSize);
+    if (bytes <= 0) {
+        // end of the directory, or an error we can't do anything about
+        mBufferUsed = mBufferPos = 0;
+        return false;
+    }
+    mBufferUsed = bytes;
+    mBufferPos = 0;
+    return true;
+}
+
 procfsinspector::Directory::Entry procfsinspector::Directory::next(unsigned char type) {
-    if (auto dir = mDirectory.get()) {
-        dirent *entry = readdir(dir);
-        if (entry) {
-            // only return entries of the right type (regular file, directory, ...)
-            // but always return UNKNOWN entries as it is an allowed wildcard entry
-            if (entry->d_type == DT_UNKNOWN ||
-                type == DT_UNKNOWN ||
-                entry->d_type == type) {
-                return Entry(mPath, entry->d_name);
-            }
+    if (mFd < 0) {
+        return Entry();
+    }
+
+    while (mBufferPos < mBufferUsed || fill()) {
+        auto entry = reinterpret_cast<const struct dirent64*>(mBuffer.get() + mBufferPos);
+        mBufferPos += entry->d_reclen;
+
+        // only return entries of the right type (regular file, directory, ...)
+        // but always return UNKNOWN entries as it is an allowed wildcard entry
+        if (entry->d_type == DT_UNKNOWN ||
+            type == DT_UNKNOWN ||
+            entry->d_type == type) {
+            return Entry(mFd, mPath.c_str(), entry->d_name);
         }
     }
 
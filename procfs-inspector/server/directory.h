@@ -18,6 +18,7 @@
 #define CAR_PROCFS_DIRECTORY
 
 #include <dirent.h>
+#include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -27,13 +28,16 @@
 
 namespace procfsinspector {
 
+// Reads the entries of a directory a batch at a time with getdents64(), so that walking a
+// large directory like /proc takes a handful of system calls and no allocation per entry.
 class Directory {
 public:
     class Entry {
     public:
-        Entry(std::string parent = "", std::string child = "");
+        Entry(int dirFd = -1, const char* parent = nullptr, const char* child = nullptr);
 
-        const std::string& getChild() { return mChild; }
+        // Only valid until the next call to Directory::next()
+        const char* getChild() const { return mChild; }
         std::string str();
 
         bool isEmpty() const;
@@ -44,24 +48,31 @@ public:
 
         uid_t getOwnerUserId();
 
+        // Opens this entry relative to its directory.  Returns the new descriptor, or -1.
+        int open(int flags = O_RDONLY);
+
     private:
-        std::string mParent;
-        std::string mChild;
+        int mDirFd;
+        const char* mParent;
+        const char* mChild;
     };
 
     Directory(const char* path);
+    ~Directory();
 
     Entry next(unsigned char type = DT_UNKNOWN);
 
 private:
-    class Deleter {
-    public:
-        void operator()(DIR* dir) {
-            if (dir) closedir(dir);
-        }
-    };
+    // Large enough for all of /proc on a busy system in one or two getdents64() calls
+    static constexpr size_t kBufferSize = 32 * 1024;
+
+    bool fill();
+
     std::string mPath;
-    std::unique_ptr<DIR, Deleter> mDirectory;
+    int mFd = -1;
+    std::unique_ptr<char[]> mBuffer;
+    size_t mBufferUsed = 0;     // bytes returned by the last getdents64()
+    size_t mBufferPos = 0;      // offset of the next record to return
 };
 
 }
@@ -15,16 +15,25 @@
  */
 
 #include "directory.h"
+#include "procconnector.h"
 #include "server.h"
 
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <random>
+
 template<typename IntTy>
-static bool asNumber(const std::string& s, IntTy *value) {
+static bool asNumber(const char* s, IntTy *value) {
     IntTy v = 0;
-    for (auto&& c : s) {
-        if (c < '0' || c > '9') {
+    for (; *s; s++) {
+        if (*s < '0' || *s > '9') {
             return false;
         } else {
-            v = v * 10 + (c - '0');
+            v = v * 10 + (*s - '0');
         }
     }
 
@@ -33,9 +42,52 @@ static bool asNumber(const std::string& s, IntTy *value) {
     return true;
 }
 
+// A random epoch, so that a client can't mistake one instance's generations for another's
+static int64_t newEpoch() {
+    std::random_device random;
+    std::uniform_int_distribution<int64_t> distribution(1, INT64_MAX);
+    return distribution(random);
+}
+
+procfsinspector::Impl::Impl() : mEpoch(newEpoch()) {}
+
+procfsinspector::Impl::~Impl() {}
+
+bool procfsinspector::Impl::enableProcConnector() {
+    std::unique_ptr<ProcConnector> procConnector(new ProcConnector(&Impl::scanProcessTable));
+    if (!procConnector->start()) {
+        return false;
+    }
+    mProcConnector = std::move(procConnector);
+    return true;
+}
+
+bool procfsinspector::Impl::registerProcessEventListener(
+    const sp<IProcessEventListener>& listener) {
+    return mProcConnector && mProcConnector->addListener(listener);
+}
+
+void procfsinspector::Impl::unregisterProcessEventListener(
+    const sp<IProcessEventListener>& listener) {
+    if (mProcConnector) {
+        mProcConnector->removeListener(listener);
+    }
+}
+
 std::vector<procfsinspector::ProcessInfo> procfsinspector::Impl::readProcessTable() {
+    if (mProcConnector) {
+        return mProcConnector->readProcessTable();
+    }
+    return scanProcessTable();
+}
+
+std::vector<procfsinspector::ProcessInfo> procfsinspector::Impl::scanProcessTable() {
     std::vector<procfsinspector::ProcessInfo> processes;
 
+    // Most of /proc is processes, so only the first scan has to grow the vector
+    static std::atomic<size_t> sLastCount{0};
+    processes.reserve(sLastCount);
+
     Directory dir("/proc");
     while (auto entry = dir.next()) {
         pid_t pid;
@@ -44,5 +96,225 @@ std::vector<procfsinspector::ProcessInfo> procfsinspector::Impl::readProcessTabl
         }
     }
 
+    sLastCount = processes.size();
     return processes;
 }
+
+// Reads the small file |name| under |dirFd| into |buffer| as a C string.
+template<size_t N>
+static bool readSmallFile(int dirFd, const char* name, char (&buffer)[N]) {
+    int fd = openat(dirFd, name, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t length = TEMP_FAILURE_RETRY(read(fd, buffer, N - 1));
+    close(fd);
+    if (length <= 0) {
+        return false;
+    }
+    buffer[length] = '\0';
+    return true;
+}
+
+// Parses the number at |*s| and moves |*s| past it and the following space
+static int64_t nextNumber(const char** s) {
+    const char* p = *s;
+    bool negative = (*p == '-');
+    if (negative) p++;
+    int64_t v = 0;
+    for (; *p >= '0' && *p <= '9'; p++) {
+        v = v * 10 + (*p - '0');
+    }
+    if (*p == ' ') p++;
+    *s = p;
+    return negative ? -v : v;
+}
+
+// Skips the next |count| space separated fields at |*s|
+static void skipFields(const char** s, int count) {
+    const char* p = *s;
+    while (count-- > 0 && *p) {
+        while (*p && *p != ' ') p++;
+        if (*p == ' ') p++;
+    }
+    *s = p;
+}
+
+// Fills in |stats| from /proc/<pid>/stat.  The fields after the command name are, counting
+// from state as 0: utime 11, stime 12, num_threads 17.
+static bool parseStat(int pidFd, uint32_t fields, procfsinspector::ProcessStats* stats) {
+    char buffer[1024];
+    if (!readSmallFile(pidFd, "stat", buffer)) {
+        return false;
+    }
+    // the command name can have spaces and parens in it, but is always last to close
+    const char* p = strrchr(buffer, ')');
+    if (p == nullptr || p[1] != ' ') {
+        return false;
+    }
+    p += 2;
+
+    stats->state = *p;
+    skipFields(&p, 11);
+    static const int64_t msPerTick = 1000 / sysconf(_SC_CLK_TCK);
+    int64_t utime = nextNumber(&p);
+    int64_t stime = nextNumber(&p);
+    if (fields & procfsinspector::ProcessStats::CPU_TIME) {
+        stats->utimeMs = utime * msPerTick;
+        stats->stimeMs = stime * msPerTick;
+    }
+    skipFields(&p, 4);
+    stats->threads = nextNumber(&p);
+    return true;
+}
+
+// Fills in the memory use in |stats| from /proc/<pid>/statm, which counts pages: size,
+// resident, shared, ...
+static bool parseStatm(int pidFd, procfsinspector::ProcessStats* stats) {
+    char buffer[256];
+    if (!readSmallFile(pidFd, "statm", buffer)) {
+        return false;
+    }
+    static const int64_t kbPerPage = sysconf(_SC_PAGESIZE) / 1024;
+    const char* p = buffer;
+    nextNumber(&p);
+    int64_t resident = nextNumber(&p);
+    int64_t shared = nextNumber(&p);
+    stats->rssKb = resident * kbPerPage;
+    stats->privateKb = (resident - shared) * kbPerPage;
+    return true;
+}
+
+// Reads the |fields| of every process in /proc and hands them to |fn|
+template<typename Fn>
+static void forEachProcessStats(uint32_t fields, Fn fn) {
+    const bool needStat = fields & (procfsinspector::ProcessStats::CPU_TIME |
+        procfsinspector::ProcessStats::THREADS | procfsinspector::ProcessStats::STATE);
+    procfsinspector::Directory dir("/proc");
+    while (auto entry = dir.next()) {
+        procfsinspector::ProcessStats stats;
+        if (!asNumber(entry.getChild(), &stats.pid)) {
+            continue;
+        }
+        int pidFd = entry.open(O_RDONLY | O_DIRECTORY);
+        if (pidFd < 0) {
+            // the process went away since we listed it
+            continue;
+        }
+
+        struct stat buf;
+        bool ok = (fstat(pidFd, &buf) == 0);
+        stats.uid = ok ? buf.st_uid : -1;
+        if (ok && needStat) {
+            ok = parseStat(pidFd, fields, &stats);
+        }
+        if (ok && (fields & procfsinspector::ProcessStats::MEMORY)) {
+            ok = parseStatm(pidFd, &stats);
+        }
+        if (ok && (fields & procfsinspector::ProcessStats::OOM_SCORE_ADJ)) {
+            char buffer[32];
+            ok = readSmallFile(pidFd, "oom_score_adj", buffer);
+            if (ok) {
+                const char* p = buffer;
+                stats.oomScoreAdj = nextNumber(&p);
+            }
+        }
+        close(pidFd);
+
+        if (ok) {
+            fn(stats);
+        }
+    }
+}
+
+procfsinspector::ProcessStatsTable procfsinspector::Impl::readProcessStats(uint32_t fields) {
+    fields &= ProcessStats::kAllFields;
+    ProcessStatsTable table(fields);
+
+    static std::atomic<size_t> sLastCount{0};
+    table.reserve(sLastCount);
+
+    forEachProcessStats(fields, [&table](const ProcessStats& stats) { table.add(stats); });
+
+    sLastCount = table.getProcesses().size();
+    return table;
+}
+
+procfsinspector::UidStatsTable procfsinspector::Impl::readUidStats(uint32_t fields) {
+    fields &= UidStats::kAllFields;
+
+    // there are far fewer uids than processes, and the reply goes out sorted by uid
+    std::map<uid_t, UidStats> uids;
+    forEachProcessStats(fields, [&uids](const ProcessStats& stats) {
+        UidStats& total = uids[stats.uid];
+        total.uid = stats.uid;
+        total.add(stats);
+    });
+
+    UidStatsTable table(fields);
+    for (const auto& [uid, total] : uids) {
+        table.add(total);
+    }
+    return table;
+}
+
+procfsinspector::ProcessTableDelta procfsinspector::Impl::readProcessTableDelta(
+    int64_t epoch, int64_t generation) {
+    std::vector<ProcessInfo> processes = readProcessTable();
+    std::sort(processes.begin(), processes.end(),
+        [](const ProcessInfo& a, const ProcessInfo& b) { return a.getPid() < b.getPid(); });
+
+    std::lock_guard<std::mutex> lock(mSnapshotsLock);
+
+    // only start a new generation if something actually changed
+    if (mSnapshots.empty() || !std::equal(processes.begin(), processes.end(),
+            mSnapshots.back().processes.begin(), mSnapshots.back().processes.end(),
+            [](const ProcessInfo& a, const ProcessInfo& b) {
+                return a.getPid() == b.getPid() && a.getUid() == b.getUid();
+            })) {
+        int64_t next = mSnapshots.empty() ? 1 : mSnapshots.back().generation + 1;
+        mSnapshots.push_back(Snapshot{next, std::move(processes)});
+        if (mSnapshots.size() > kMaxSnapshots) {
+            mSnapshots.pop_front();
+        }
+    }
+    const Snapshot& current = mSnapshots.back();
+
+    auto base = mSnapshots.end();
+    if (epoch == mEpoch) {
+        base = std::find_if(mSnapshots.begin(), mSnapshots.end(),
+            [generation](const Snapshot& s) { return s.generation == generation; });
+    }
+    if (base == mSnapshots.end()) {
+        // the client never saw a table we still have, or saw one from before we restarted, so
+        // it gets all of it
+        ProcessTableDelta delta(mEpoch, current.generation, true);
+        for (const auto& process : current.processes) {
+            delta.add(process);
+        }
+        return delta;
+    }
+
+    // both tables are sorted by pid, so walk them side by side
+    ProcessTableDelta delta(mEpoch, current.generation, false);
+    auto before = base->processes.begin();
+    auto after = current.processes.begin();
+    while (before != base->processes.end() || after != current.processes.end()) {
+        if (after == current.processes.end() ||
+            (before != base->processes.end() && before->getPid() < after->getPid())) {
+            delta.remove(before->getPid());
+            ++before;
+        } else if (before == base->processes.end() || after->getPid() < before->getPid()) {
+            delta.add(*after);
+            ++after;
+        } else {
+            if (before->getUid() != after->getUid()) {
+                delta.remove(before->getPid());
+                delta.add(*after);
+            }
+            ++before;
+            ++after;
+        }
+    }
+    return delta;
+}
@@ -17,6 +17,7 @@
 #include "server.h"
 
 #include <signal.h>
+#include <string.h>
 
 #include <binder/IServiceManager.h>
 
@@ -24,15 +25,28 @@
 
 using namespace android;
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
     ALOGI("starting " LOG_TAG);
     signal(SIGPIPE, SIG_IGN);
 
+    bool useProcConnector = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--proc-connector") == 0) {
+            useProcConnector = true;
+        } else {
+            ALOGW("ignoring unknown argument %s", argv[i]);
+        }
+    }
+
     sp<ProcessState> processSelf(ProcessState::self());
     sp<IServiceManager> serviceManager = defaultServiceManager();
     std::unique_ptr<procfsinspector::Impl> server(new procfsinspector::Impl());
 
+    if (useProcConnector && !server->enableProcConnector()) {
+        ALOGW("proc connector not available, falling back to scanning /proc");
+    }
+
     serviceManager->addService(String16(SERVICE_NAME), server.get());
 
     processSelf->startThreadPool();
@@ -0,0 +1,306 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "procconnector.h"
+#include "server.h"
+
+#include <errno.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+// Room for a burst of events while the table is being scanned or listeners are called
+static constexpr int kReceiveBufferSize = 1024 * 1024;
+
+static int64_t uptimeNanos() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static int64_t uptimeMillis() {
+    return uptimeNanos() / 1000000;
+}
+
+procfsinspector::ProcConnector::ProcConnector(Scanner scanner) :
+    mScanner(scanner), mDeathRecipient(new DeathRecipient(this)) {}
+
+procfsinspector::ProcConnector::~ProcConnector() {
+    if (mThread.joinable()) {
+        uint64_t one = 1;
+        write(mStopFd, &one, sizeof(one));
+        mThread.join();
+    }
+    if (mSocket >= 0) {
+        subscribe(false);
+        close(mSocket);
+    }
+    if (mStopFd >= 0) {
+        close(mStopFd);
+    }
+}
+
+bool procfsinspector::ProcConnector::start() {
+    mSocket = socket(PF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+    if (mSocket < 0) {
+        ALOGE("failed to open proc connector socket: %s", strerror(errno));
+        return false;
+    }
+    // SO_RCVBUFFORCE needs CAP_NET_ADMIN too, which we need anyway
+    if (setsockopt(mSocket, SOL_SOCKET, SO_RCVBUFFORCE, &kReceiveBufferSize,
+                   sizeof(kReceiveBufferSize)) != 0) {
+        setsockopt(mSocket, SOL_SOCKET, SO_RCVBUF, &kReceiveBufferSize,
+                   sizeof(kReceiveBufferSize));
+    }
+
+    struct sockaddr_nl addr = {};
+    addr.nl_family = AF_NETLINK;
+    addr.nl_groups = CN_IDX_PROC;
+    if (bind(mSocket, (struct sockaddr*)&addr, sizeof(addr)) != 0 || !subscribe(true)) {
+        ALOGE("failed to subscribe to the proc connector: %s", strerror(errno));
+        close(mSocket);
+        mSocket = -1;
+        return false;
+    }
+
+    mStopFd = eventfd(0, EFD_CLOEXEC);
+    if (mStopFd < 0) {
+        ALOGE("failed to create eventfd: %s", strerror(errno));
+        return false;
+    }
+
+    // Whatever happens while we scan waits in the socket, and is applied on top of the scan
+    resync();
+    mThread = std::thread(&ProcConnector::run, this);
+    ALOGI("following the proc connector, %zu processes to start with", mProcesses.size());
+    return true;
+}
+
+bool procfsinspector::ProcConnector::subscribe(bool listen) {
+    // a netlink header, then a connector message carrying the operation
+    constexpr size_t kLength = NLMSG_LENGTH(sizeof(struct cn_msg) + sizeof(enum proc_cn_mcast_op));
+    alignas(struct nlmsghdr) char request[NLMSG_SPACE(kLength - NLMSG_HDRLEN)] = {};
+
+    auto header = reinterpret_cast<struct nlmsghdr*>(request);
+    header->nlmsg_len = kLength;
+    header->nlmsg_type = NLMSG_DONE;
+    header->nlmsg_pid = getpid();
+
+    auto message = reinterpret_cast<struct cn_msg*>(NLMSG_DATA(header));
+    message->id.idx = CN_IDX_PROC;
+    message->id.val = CN_VAL_PROC;
+    message->len = sizeof(enum proc_cn_mcast_op);
+    enum proc_cn_mcast_op op = listen ? PROC_CN_MCAST_LISTEN : PROC_CN_MCAST_IGNORE;
+    memcpy(message->data, &op, sizeof(op));
+
+    return TEMP_FAILURE_RETRY(send(mSocket, request, kLength, 0)) == (ssize_t)kLength;
+}
+
+std::vector<procfsinspector::ProcessInfo> procfsinspector::ProcConnector::readProcessTable() {
+    std::lock_guard<std::mutex> lock(mTableLock);
+    std::vector<ProcessInfo> processes;
+    processes.reserve(mProcesses.size());
+    for (const auto& process : mProcesses) {
+        processes.push_back(ProcessInfo{process.first, process.second});
+    }
+    return processes;
+}
+
+bool procfsinspector::ProcConnector::addListener(const sp<IProcessEventListener>& listener) {
+    sp<IBinder> binder = IInterface::asBinder(listener);
+    std::lock_guard<std::mutex> lock(mListenersLock);
+    for (const auto& existing : mListeners) {
+        if (IInterface::asBinder(existing) == binder) {
+            return true;
+        }
+    }
+    if (binder->linkToDeath(mDeathRecipient) != OK) {
+        return false;
+    }
+    mListeners.push_back(listener);
+    return true;
+}
+
+void procfsinspector::ProcConnector::removeListener(const sp<IProcessEventListener>& listener) {
+    sp<IBinder> binder = IInterface::asBinder(listener);
+    std::lock_guard<std::mutex> lock(mListenersLock);
+    auto it = std::find_if(mListeners.begin(), mListeners.end(),
+        [&binder](const sp<IProcessEventListener>& existing) {
+            return IInterface::asBinder(existing) == binder;
+        });
+    if (it != mListeners.end()) {
+        binder->unlinkToDeath(mDeathRecipient);
+        mListeners.erase(it);
+    }
+}
+
+void procfsinspector::ProcConnector::DeathRecipient::binderDied(const wp<IBinder>& who) {
+    std::lock_guard<std::mutex> lock(mOwner->mListenersLock);
+    auto& listeners = mOwner->mListeners;
+    listeners.erase(std::remove_if(listeners.begin(), listeners.end(),
+        [&who](const sp<IProcessEventListener>& listener) {
+            return IInterface::asBinder(listener).get() == who.unsafe_get();
+        }), listeners.end());
+}
+
+void procfsinspector::ProcConnector::run() {
+    // Big enough for many events at once; each is a netlink message of its own
+    alignas(struct nlmsghdr) char buffer[16 * 1024];
+
+    struct pollfd fds[] = {
+        { .fd = mSocket, .events = POLLIN, .revents = 0 },
+        { .fd = mStopFd, .events = POLLIN, .revents = 0 },
+    };
+    while (true) {
+        int timeout = -1;
+        if (!mPending.empty()) {
+            timeout = std::max<int64_t>(0, mPendingSinceMs + kBatchIntervalMs - uptimeMillis());
+        }
+        int ready = TEMP_FAILURE_RETRY(poll(fds, 2, timeout));
+        if (ready < 0) {
+            ALOGE("poll failed: %s", strerror(errno));
+            break;
+        }
+        if (fds[1].revents) {
+            break;
+        }
+        if (fds[0].revents & POLLIN) {
+            // Take everything that's there before handing anything out
+            while (true) {
+                ssize_t length = recv(mSocket, buffer, sizeof(buffer), MSG_DONTWAIT);
+                if (length > 0) {
+                    handleMessage(buffer, length);
+                } else if (length < 0 && errno == ENOBUFS) {
+                    // The kernel dropped events, so we can't trust the table any more, and
+                    // neither can listeners who follow the events
+                    ALOGW("proc connector overflowed, rescanning /proc");
+                    resync();
+                    if (mPending.empty()) {
+                        mPendingSinceMs = uptimeMillis();
+                    }
+                    mPending.emplace_back(ProcessEvent::RESYNC, -1, -1, uptimeNanos());
+                    mFlushNow = true;
+                } else {
+                    break;
+                }
+            }
+        }
+        if (!mPending.empty() && (mFlushNow || mPending.size() >= kMaxBatchSize ||
+                uptimeMillis() >= mPendingSinceMs + kBatchIntervalMs)) {
+            flush();
+        }
+    }
+    flush();
+}
+
+void procfsinspector::ProcConnector::handleMessage(const char* buffer, size_t length) {
+    std::lock_guard<std::mutex> lock(mTableLock);
+    size_t remaining = length;
+    for (auto header = reinterpret_cast<const struct nlmsghdr*>(buffer);
+            NLMSG_OK(header, remaining); header = NLMSG_NEXT(header, remaining)) {
+        if (header->nlmsg_type != NLMSG_DONE) {
+            continue;
+        }
+        auto message = reinterpret_cast<const struct cn_msg*>(NLMSG_DATA(header));
+        if (message->id.idx != CN_IDX_PROC || message->id.val != CN_VAL_PROC) {
+            continue;
+        }
+        auto event = reinterpret_cast<const struct proc_event*>(message->data);
+        const int64_t timestamp = event->timestamp_ns;
+        size_t before = mPending.size();
+
+        switch (event->what) {
+            case proc_event::PROC_EVENT_FORK: {
+                const auto& fork = event->event_data.fork;
+                // a new thread in the same process isn't interesting
+                if (fork.child_pid != fork.child_tgid) break;
+                // the child starts out as the same user as its parent
+                auto parent = mProcesses.find(fork.parent_tgid);
+                uid_t uid = (parent != mProcesses.end()) ? parent->second : -1;
+                mProcesses[fork.child_tgid] = uid;
+                mPending.emplace_back(ProcessEvent::FORK, fork.child_tgid, uid, timestamp,
+                    fork.parent_tgid);
+            } break;
+            case proc_event::PROC_EVENT_EXEC: {
+                const auto& exec = event->event_data.exec;
+                auto process = mProcesses.find(exec.process_tgid);
+                uid_t uid = (process != mProcesses.end()) ? process->second : -1;
+                mPending.emplace_back(ProcessEvent::EXEC, exec.process_tgid, uid, timestamp);
+            } break;
+            case proc_event::PROC_EVENT_UID: {
+                const auto& id = event->event_data.id;
+                if (id.process_pid != id.process_tgid) break;
+                // /proc/<pid> belongs to the effective user, so go by that one
+                uid_t uid = id.e.euid;
+                mProcesses[id.process_tgid] = uid;
+                mPending.emplace_back(ProcessEvent::UID_CHANGE, id.process_tgid, uid, timestamp);
+            } break;
+            case proc_event::PROC_EVENT_EXIT: {
+                const auto& exit = event->event_data.exit;
+                // only the last thread leaving takes the process with it
+                if (exit.process_pid != exit.process_tgid) break;
+                auto process = mProcesses.find(exit.process_tgid);
+                uid_t uid = -1;
+                if (process != mProcesses.end()) {
+                    uid = process->second;
+                    mProcesses.erase(process);
+                }
+                mPending.emplace_back(ProcessEvent::EXIT, exit.process_tgid, uid, timestamp,
+                    -1, exit.exit_code);
+            } break;
+            default:
+                break;
+        }
+
+        if (before == 0 && !mPending.empty()) {
+            mPendingSinceMs = uptimeMillis();
+        }
+    }
+}
+
+void procfsinspector::ProcConnector::resync() {
+    std::vector<ProcessInfo> processes = mScanner();
+    std::lock_guard<std::mutex> lock(mTableLock);
+    mProcesses.clear();
+    for (auto& process : processes) {
+        mProcesses[process.getPid()] = process.getUid();
+    }
+}
+
+void procfsinspector::ProcConnector::flush() {
+    if (mPending.empty()) {
+        return;
+    }
+    std::vector<sp<IProcessEventListener>> listeners;
+    {
+        std::lock_guard<std::mutex> lock(mListenersLock);
+        listeners = mListeners;
+    }
+    // oneway calls, so a slow listener doesn't hold up the others or us
+    for (const auto& listener : listeners) {
+        listener->onProcessEvents(mPending);
+    }
+    mPending.clear();
+    mFlushNow = false;
+}
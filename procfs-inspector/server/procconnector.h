@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_PROCFS_PROCCONNECTOR
+#define CAR_PROCFS_PROCCONNECTOR
+
+#include <sys/types.h>
+
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <binder/IBinder.h>
+
+#include "process.h"
+
+namespace procfsinspector {
+
+class IProcessEventListener;
+
+// Keeps the process table up to date from the kernel proc connector, instead of scanning /proc
+// for every request, and passes the fork/exec/exit events on to listeners in batches.
+// Only processes are tracked; threads coming and going are ignored.
+class ProcConnector {
+public:
+    using Scanner = std::function<std::vector<ProcessInfo>()>;
+
+    // |scanner| reads the whole table from /proc, to start with and whenever we lose events
+    ProcConnector(Scanner scanner);
+    ~ProcConnector();
+
+    // Subscribes to the proc connector.  Needs CAP_NET_ADMIN; returns false if the kernel
+    // won't let us, in which case the caller should go on scanning /proc.
+    bool start();
+
+    std::vector<ProcessInfo> readProcessTable();
+
+    bool addListener(const sp<IProcessEventListener>& listener);
+    void removeListener(const sp<IProcessEventListener>& listener);
+
+private:
+    class DeathRecipient : public IBinder::DeathRecipient {
+    public:
+        DeathRecipient(ProcConnector* owner) : mOwner(owner) {}
+        virtual void binderDied(const wp<IBinder>& who) override;
+    private:
+        ProcConnector* mOwner;
+    };
+
+    // Events are delivered no later than this after they happened...
+    static constexpr int kBatchIntervalMs = 100;
+    // ...or as soon as there are this many of them
+    static constexpr size_t kMaxBatchSize = 256;
+
+    bool subscribe(bool listen);
+    void run();
+    void handleMessage(const char* buffer, size_t length);
+    void resync();
+    void flush();
+
+    Scanner mScanner;
+    int mSocket = -1;
+    int mStopFd = -1;   // eventfd that wakes run() up to quit
+    std::thread mThread;
+
+    std::mutex mTableLock;
+    std::unordered_map<pid_t, uid_t> mProcesses;
+
+    // Only touched by run()
+    std::vector<ProcessEvent> mPending;
+    int64_t mPendingSinceMs = 0;
+    bool mFlushNow = false;     // a resync event is pending, which shouldn't wait for the batch
+
+    std::mutex mListenersLock;
+    std::vector<sp<IProcessEventListener>> mListeners;
+    sp<DeathRecipient> mDeathRecipient;
+};
+
+}
+
+#endif // CAR_PROCFS_PROCCONNECTOR
@@ -13,3 +13,143 @@ status_t procfsinspector::ProcessInfo::readFromParcel(const Parcel* parcel) {
     mUid = parcel->readUint32();
     return android::OK;
 }
+
+status_t procfsinspector::ProcessTableDelta::writeToParcel(Parcel* parcel) const {
+    parcel->writeInt64(mEpoch);
+    parcel->writeInt64(mGeneration);
+    parcel->writeInt32(mFullTable ? 1 : 0);
+    parcel->writeParcelableVector(mAdded);
+    parcel->writeInt32Vector(mRemoved);
+    return android::OK;
+}
+
+status_t procfsinspector::ProcessTableDelta::readFromParcel(const Parcel* parcel) {
+    mEpoch = parcel->readInt64();
+    mGeneration = parcel->readInt64();
+    mFullTable = parcel->readInt32() != 0;
+    parcel->readParcelableVector(&mAdded);
+    parcel->readInt32Vector(&mRemoved);
+    return android::OK;
+}
+
+status_t procfsinspector::ProcessStatsTable::writeToParcel(Parcel* parcel) const {
+    parcel->writeUint32(mFields);
+    parcel->writeInt32(mProcesses.size());
+    for (const auto& stats : mProcesses) {
+        parcel->writeInt32(stats.pid);
+        parcel->writeInt32(stats.uid);
+        if (mFields & ProcessStats::CPU_TIME) {
+            parcel->writeInt64(stats.utimeMs);
+            parcel->writeInt64(stats.stimeMs);
+        }
+        if (mFields & ProcessStats::MEMORY) {
+            parcel->writeInt64(stats.rssKb);
+            parcel->writeInt64(stats.privateKb);
+        }
+        if (mFields & ProcessStats::THREADS) {
+            parcel->writeInt32(stats.threads);
+        }
+        if (mFields & ProcessStats::STATE) {
+            parcel->writeInt32(stats.state);
+        }
+        if (mFields & ProcessStats::OOM_SCORE_ADJ) {
+            parcel->writeInt32(stats.oomScoreAdj);
+        }
+    }
+    return android::OK;
+}
+
+status_t procfsinspector::ProcessStatsTable::readFromParcel(const Parcel* parcel) {
+    mFields = parcel->readUint32();
+    int32_t count = parcel->readInt32();
+    mProcesses.clear();
+    for (int32_t i = 0; i < count; i++) {
+        ProcessStats stats;
+        stats.pid = parcel->readInt32();
+        stats.uid = parcel->readInt32();
+        if (mFields & ProcessStats::CPU_TIME) {
+            stats.utimeMs = parcel->readInt64();
+            stats.stimeMs = parcel->readInt64();
+        }
+        if (mFields & ProcessStats::MEMORY) {
+            stats.rssKb = parcel->readInt64();
+            stats.privateKb = parcel->readInt64();
+        }
+        if (mFields & ProcessStats::THREADS) {
+            stats.threads = parcel->readInt32();
+        }
+        if (mFields & ProcessStats::STATE) {
+            stats.state = parcel->readInt32();
+        }
+        if (mFields & ProcessStats::OOM_SCORE_ADJ) {
+            stats.oomScoreAdj = parcel->readInt32();
+        }
+        mProcesses.push_back(stats);
+    }
+    return android::OK;
+}
+
+status_t procfsinspector::UidStatsTable::writeToParcel(Parcel* parcel) const {
+    parcel->writeUint32(mFields);
+    parcel->writeInt32(mUids.size());
+    for (const auto& stats : mUids) {
+        parcel->writeInt32(stats.uid);
+        parcel->writeInt32(stats.processes);
+        if (mFields & ProcessStats::CPU_TIME) {
+            parcel->writeInt64(stats.utimeMs);
+            parcel->writeInt64(stats.stimeMs);
+        }
+        if (mFields & ProcessStats::MEMORY) {
+            parcel->writeInt64(stats.rssKb);
+            parcel->writeInt64(stats.privateKb);
+        }
+        if (mFields & ProcessStats::THREADS) {
+            parcel->writeInt32(stats.threads);
+        }
+    }
+    return android::OK;
+}
+
+status_t procfsinspector::UidStatsTable::readFromParcel(const Parcel* parcel) {
+    mFields = parcel->readUint32();
+    int32_t count = parcel->readInt32();
+    mUids.clear();
+    for (int32_t i = 0; i < count; i++) {
+        UidStats stats;
+        stats.uid = parcel->readInt32();
+        stats.processes = parcel->readInt32();
+        if (mFields & ProcessStats::CPU_TIME) {
+            stats.utimeMs = parcel->readInt64();
+            stats.stimeMs = parcel->readInt64();
+        }
+        if (mFields & ProcessStats::MEMORY) {
+            stats.rssKb = parcel->readInt64();
+            stats.privateKb = parcel->readInt64();
+        }
+        if (mFields & ProcessStats::THREADS) {
+            stats.threads = parcel->readInt32();
+        }
+        mUids.push_back(stats);
+    }
+    return android::OK;
+}
+
+status_t procfsinspector::ProcessEvent::writeToParcel(Parcel* parcel) const {
+    parcel->writeInt32(mType);
+    parcel->writeInt32(mPid);
+    parcel->writeInt32(mUid);
+    parcel->writeInt32(mParentPid);
+    parcel->writeInt32(mExitCode);
+    parcel->writeInt64(mTimestampNs);
+    return android::OK;
+}
+
+status_t procfsinspector::ProcessEvent::readFromParcel(const Parcel* parcel) {
+    mType = parcel->readInt32();
+    mPid = parcel->readInt32();
+    mUid = parcel->readInt32();
+    mParentPid = parcel->readInt32();
+    mExitCode = parcel->readInt32();
+    mTimestampNs = parcel->readInt64();
+    return android::OK;
+}
@@ -19,6 +19,8 @@
 
 #include <sys/types.h>
 
+#include <vector>
+
 #include <binder/Parcelable.h>
 
 using namespace android;
@@ -26,8 +28,8 @@ using namespace android;
 namespace procfsinspector {
     class ProcessInfo : public Parcelable {
     public:
-        pid_t getPid() { return mPid; }
-        uid_t getUid() { return mUid; }
+        pid_t getPid() const { return mPid; }
+        uid_t getUid() const { return mUid; }
 
         // default initialize to invalid values
         ProcessInfo(pid_t pid = -1, uid_t uid = -1) : mPid(pid), mUid(uid) {}
@@ -39,6 +41,158 @@ namespace procfsinspector {
         pid_t mPid;
         uid_t mUid;
     };
+
+    // Resource usage of one process.  Only the fields asked for in ProcessStatsTable are filled in.
+    struct ProcessStats {
+        enum Field : uint32_t {
+            CPU_TIME        = 1 << 0,   // utimeMs, stimeMs
+            MEMORY          = 1 << 1,   // rssKb, privateKb
+            THREADS         = 1 << 2,   // threads
+            STATE           = 1 << 3,   // state
+            OOM_SCORE_ADJ   = 1 << 4,   // oomScoreAdj
+        };
+        static constexpr uint32_t kAllFields =
+            CPU_TIME | MEMORY | THREADS | STATE | OOM_SCORE_ADJ;
+
+        pid_t pid = -1;
+        uid_t uid = -1;
+        int64_t utimeMs = 0;
+        int64_t stimeMs = 0;
+        int64_t rssKb = 0;
+        // Resident memory that isn't shared with other processes: a cheap stand-in for PSS
+        int64_t privateKb = 0;
+        int32_t threads = 0;
+        int32_t state = 0;          // as in /proc/<pid>/stat, e.g. 'R' or 'S'
+        int32_t oomScoreAdj = 0;
+    };
+
+    // The stats of every process, written to the parcel with only the fields in the mask so
+    // that leaving fields out makes the reply smaller too.
+    class ProcessStatsTable : public Parcelable {
+    public:
+        uint32_t getFields() const { return mFields; }
+        const std::vector<ProcessStats>& getProcesses() const { return mProcesses; }
+
+        ProcessStatsTable(uint32_t fields = 0) : mFields(fields) {}
+
+        void add(const ProcessStats& stats) { mProcesses.push_back(stats); }
+        void reserve(size_t count) { mProcesses.reserve(count); }
+
+        virtual status_t writeToParcel(Parcel* parcel) const override;
+        virtual status_t readFromParcel(const Parcel* parcel) override;
+
+    private:
+        uint32_t mFields;
+        std::vector<ProcessStats> mProcesses;
+    };
+
+    // The stats of all the processes running as one uid, added up.  Only the fields asked for
+    // in UidStatsTable are filled in, except for the process count, which always is.
+    struct UidStats {
+        // the fields that mean anything added up across processes
+        static constexpr uint32_t kAllFields =
+            ProcessStats::CPU_TIME | ProcessStats::MEMORY | ProcessStats::THREADS;
+
+        uid_t uid = -1;
+        int32_t processes = 0;
+        int64_t utimeMs = 0;
+        int64_t stimeMs = 0;
+        int64_t rssKb = 0;
+        int64_t privateKb = 0;
+        int32_t threads = 0;
+
+        void add(const ProcessStats& stats) {
+            processes++;
+            utimeMs += stats.utimeMs;
+            stimeMs += stats.stimeMs;
+            rssKb += stats.rssKb;
+            privateKb += stats.privateKb;
+            threads += stats.threads;
+        }
+    };
+
+    // One row of UidStats per uid, sorted by uid, written to the parcel with only the fields in
+    // the mask like ProcessStatsTable.
+    class UidStatsTable : public Parcelable {
+    public:
+        uint32_t getFields() const { return mFields; }
+        const std::vector<UidStats>& getUids() const { return mUids; }
+
+        UidStatsTable(uint32_t fields = 0) : mFields(fields) {}
+
+        void add(const UidStats& stats) { mUids.push_back(stats); }
+
+        virtual status_t writeToParcel(Parcel* parcel) const override;
+        virtual status_t readFromParcel(const Parcel* parcel) override;
+
+    private:
+        uint32_t mFields;
+        std::vector<UidStats> mUids;
+    };
+
+    // Something that happened to a process, as reported by the kernel proc connector
+    class ProcessEvent : public Parcelable {
+    public:
+        enum Type : int32_t {
+            FORK = 1,           // a new process, started by parentPid
+            EXEC = 2,           // the process is running a new program
+            EXIT = 3,           // the process is gone, with exitCode as given to wait()
+            UID_CHANGE = 4,     // the process switched to a different user
+            RESYNC = 5,         // events were lost, so the table has to be read again
+        };
+
+        int32_t getType() const { return mType; }
+        pid_t getPid() const { return mPid; }
+        uid_t getUid() const { return mUid; }
+        pid_t getParentPid() const { return mParentPid; }
+        int32_t getExitCode() const { return mExitCode; }
+        int64_t getTimestampNs() const { return mTimestampNs; }
+
+        ProcessEvent(int32_t type = 0, pid_t pid = -1, uid_t uid = -1, int64_t timestampNs = 0,
+                     pid_t parentPid = -1, int32_t exitCode = 0)
+            : mType(type), mPid(pid), mUid(uid), mParentPid(parentPid), mExitCode(exitCode),
+              mTimestampNs(timestampNs) {}
+
+        virtual status_t writeToParcel(Parcel* parcel) const override;
+        virtual status_t readFromParcel(const Parcel* parcel) override;
+
+    private:
+        int32_t mType;
+        pid_t mPid;
+        uid_t mUid;
+        pid_t mParentPid;
+        int32_t mExitCode;
+        int64_t mTimestampNs;   // CLOCK_MONOTONIC
+    };
+
+    // What changed in the process table since the generation a client last saw.  If the server
+    // no longer has that generation, the delta is the whole table instead.
+    class ProcessTableDelta : public Parcelable {
+    public:
+        int64_t getEpoch() const { return mEpoch; }
+        int64_t getGeneration() const { return mGeneration; }
+        bool isFullTable() const { return mFullTable; }
+        const std::vector<ProcessInfo>& getAdded() const { return mAdded; }
+        const std::vector<int32_t>& getRemoved() const { return mRemoved; }
+
+        ProcessTableDelta(int64_t epoch = 0, int64_t generation = 0, bool fullTable = true)
+            : mEpoch(epoch), mGeneration(generation), mFullTable(fullTable) {}
+
+        // Processes that are new, or whose pid was reused by a different user
+        void add(const ProcessInfo& process) { mAdded.push_back(process); }
+        // Processes that are gone; they are removed before the added ones are applied
+        void remove(pid_t pid) { mRemoved.push_back(pid); }
+
+        virtual status_t writeToParcel(Parcel* parcel) const override;
+        virtual status_t readFromParcel(const Parcel* parcel) override;
+
+    private:
+        int64_t mEpoch;
+        int64_t mGeneration;
+        bool mFullTable;
+        std::vector<ProcessInfo> mAdded;
+        std::vector<int32_t> mRemoved;
+    };
 }
 
 #endif // CAR_PROCFS_PROCESS
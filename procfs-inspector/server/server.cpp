@@ -36,6 +36,23 @@ static bool isSystemUser() {
 }
 
 namespace procfsinspector {
+class BpProcessEventListener: public BpInterface<IProcessEventListener> {
+    public:
+        BpProcessEventListener(sp<IBinder> binder)
+            : BpInterface<IProcessEventListener>(binder) {}
+
+        virtual void onProcessEvents(const std::vector<ProcessEvent>& events) override {
+            Parcel data;
+            data.writeInterfaceToken(IProcessEventListener::getInterfaceDescriptor());
+            data.writeParcelableVector(events);
+            remote()->transact((uint32_t)IProcessEventListener::Call::ON_PROCESS_EVENTS,
+                data, nullptr, IBinder::FLAG_ONEWAY);
+        }
+};
+
+IMPLEMENT_META_INTERFACE(ProcessEventListener,
+    "com.android.car.procfsinspector.IProcessEventListener");
+
 class BpProcfsInspector: public BpInterface<IProcfsInspector> {
     public:
         BpProcfsInspector(sp<IBinder> binder) : BpInterface<IProcfsInspector>(binder) {}
@@ -49,6 +66,57 @@ class BpProcfsInspector: public BpInterface<IProcfsInspector> {
             return result;
         }
 
+        virtual ProcessTableDelta readProcessTableDelta(int64_t epoch,
+            int64_t generation) override {
+            Parcel data, reply;
+            data.writeInt64(epoch);
+            data.writeInt64(generation);
+            remote()->transact((uint32_t)IProcfsInspector::Call::READ_PROCESS_TABLE_DELTA,
+                data, &reply);
+
+            procfsinspector::ProcessTableDelta result;
+            reply.readParcelable(&result);
+            return result;
+        }
+
+        virtual ProcessStatsTable readProcessStats(uint32_t fields) override {
+            Parcel data, reply;
+            data.writeUint32(fields);
+            remote()->transact((uint32_t)IProcfsInspector::Call::READ_PROCESS_STATS,
+                data, &reply);
+
+            procfsinspector::ProcessStatsTable result;
+            reply.readParcelable(&result);
+            return result;
+        }
+
+        virtual bool registerProcessEventListener(
+            const sp<IProcessEventListener>& listener) override {
+            Parcel data, reply;
+            data.writeStrongBinder(IInterface::asBinder(listener));
+            remote()->transact(
+                (uint32_t)IProcfsInspector::Call::REGISTER_PROCESS_EVENT_LISTENER, data, &reply);
+            return reply.readInt32() != 0;
+        }
+
+        virtual void unregisterProcessEventListener(
+            const sp<IProcessEventListener>& listener) override {
+            Parcel data, reply;
+            data.writeStrongBinder(IInterface::asBinder(listener));
+            remote()->transact(
+                (uint32_t)IProcfsInspector::Call::UNREGISTER_PROCESS_EVENT_LISTENER, data, &reply);
+        }
+
+        virtual UidStatsTable readUidStats(uint32_t fields) override {
+            Parcel data, reply;
+            data.writeUint32(fields);
+            remote()->transact((uint32_t)IProcfsInspector::Call::READ_UID_STATS, data, &reply);
+
+            procfsinspector::UidStatsTable result;
+            reply.readParcelable(&result);
+            return result;
+        }
+
 };
 
 IMPLEMENT_META_INTERFACE(ProcfsInspector, "com.android.car.procfsinspector.IProcfsInspector");
@@ -67,6 +135,62 @@ status_t Impl::onTransact(uint32_t code,
         }
     }
 
+    if (code == (uint32_t)IProcfsInspector::Call::READ_PROCESS_TABLE_DELTA) {
+        CHECK_INTERFACE(IProcfsInspector, data, reply);
+        if (isSystemUser()) {
+            reply->writeNoException();
+            int64_t epoch = data.readInt64();
+            int64_t generation = data.readInt64();
+            reply->writeParcelable(readProcessTableDelta(epoch, generation));
+            return NO_ERROR;
+        } else {
+            return PERMISSION_DENIED;
+        }
+    }
+
+    if (code == (uint32_t)IProcfsInspector::Call::READ_PROCESS_STATS) {
+        CHECK_INTERFACE(IProcfsInspector, data, reply);
+        if (isSystemUser()) {
+            reply->writeNoException();
+            reply->writeParcelable(readProcessStats(data.readUint32()));
+            return NO_ERROR;
+        } else {
+            return PERMISSION_DENIED;
+        }
+    }
+
+    if (code == (uint32_t)IProcfsInspector::Call::READ_UID_STATS) {
+        CHECK_INTERFACE(IProcfsInspector, data, reply);
+        if (isSystemUser()) {
+            reply->writeNoException();
+            reply->writeParcelable(readUidStats(data.readUint32()));
+            return NO_ERROR;
+        } else {
+            return PERMISSION_DENIED;
+        }
+    }
+
+    if (code == (uint32_t)IProcfsInspector::Call::REGISTER_PROCESS_EVENT_LISTENER ||
+        code == (uint32_t)IProcfsInspector::Call::UNREGISTER_PROCESS_EVENT_LISTENER) {
+        CHECK_INTERFACE(IProcfsInspector, data, reply);
+        if (isSystemUser()) {
+            sp<IProcessEventListener> listener =
+                interface_cast<IProcessEventListener>(data.readStrongBinder());
+            if (listener == nullptr) {
+                return BAD_VALUE;
+            }
+            reply->writeNoException();
+            if (code == (uint32_t)IProcfsInspector::Call::REGISTER_PROCESS_EVENT_LISTENER) {
+                reply->writeInt32(registerProcessEventListener(listener) ? 1 : 0);
+            } else {
+                unregisterProcessEventListener(listener);
+            }
+            return NO_ERROR;
+        } else {
+            return PERMISSION_DENIED;
+        }
+    }
+
     return BBinder::onTransact(code, data, reply, flags);
 }
 
@@ -20,6 +20,9 @@
 #define LOG_TAG "com.android.car.procfsinspector"
 #define SERVICE_NAME "com.android.car.procfsinspector"
 
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <vector>
 
 #include <binder/Parcel.h>
@@ -37,16 +40,55 @@
 using namespace android;
 
 namespace procfsinspector {
+    class ProcConnector;
+
+    // Implemented by clients that want to hear about processes starting and going away
+    class IProcessEventListener : public IInterface {
+    public:
+        DECLARE_META_INTERFACE(ProcessEventListener);
+
+        enum class Call : uint32_t {
+            ON_PROCESS_EVENTS = IBinder::FIRST_CALL_TRANSACTION,
+        };
+
+        // oneway, events are in the order they happened
+        virtual void onProcessEvents(const std::vector<ProcessEvent>& events) = 0;
+    };
+
     class IProcfsInspector : public IInterface {
     public:
         DECLARE_META_INTERFACE(ProcfsInspector);
 
         enum class Call : uint32_t {
             READ_PROCESS_TABLE = IBinder::FIRST_CALL_TRANSACTION,
+            READ_PROCESS_TABLE_DELTA,
+            READ_PROCESS_STATS,
+            REGISTER_PROCESS_EVENT_LISTENER,
+            UNREGISTER_PROCESS_EVENT_LISTENER,
+            READ_UID_STATS,
         };
 
         // API declarations start here
         virtual std::vector<ProcessInfo> readProcessTable() = 0;
+
+        // Returns the changes to the process table since |generation| of |epoch|, as returned
+        // by an earlier call.  Each start of the service has an epoch of its own, so a client
+        // that last saw another one gets the whole table.  Pass 0 for both to get the whole table.
+        virtual ProcessTableDelta readProcessTableDelta(int64_t epoch, int64_t generation) = 0;
+
+        // Returns the ProcessStats::Field values in |fields| for every process.
+        virtual ProcessStatsTable readProcessStats(uint32_t fields) = 0;
+
+        // Returns false if process events aren't available, because the service isn't
+        // following the proc connector.
+        virtual bool registerProcessEventListener(
+            const sp<IProcessEventListener>& listener) = 0;
+        virtual void unregisterProcessEventListener(
+            const sp<IProcessEventListener>& listener) = 0;
+
+        // Returns the UidStats::kAllFields values in |fields| added up for each uid, so that
+        // callers who only want totals needn't be sent every process.
+        virtual UidStatsTable readUidStats(uint32_t fields) = 0;
     };
 
     class Impl : public BnInterface<IProcfsInspector> {
@@ -56,6 +98,43 @@ namespace procfsinspector {
             Parcel *reply,
             uint32_t flags) override;
         virtual std::vector<ProcessInfo> readProcessTable() override;
+        virtual ProcessTableDelta readProcessTableDelta(int64_t epoch,
+            int64_t generation) override;
+        virtual ProcessStatsTable readProcessStats(uint32_t fields) override;
+        virtual bool registerProcessEventListener(
+            const sp<IProcessEventListener>& listener) override;
+        virtual void unregisterProcessEventListener(
+            const sp<IProcessEventListener>& listener) override;
+        virtual UidStatsTable readUidStats(uint32_t fields) override;
+
+        Impl();
+        ~Impl();
+
+        // Follows the kernel proc connector rather than scanning /proc for each request.
+        // Returns false if the kernel won't let us.
+        bool enableProcConnector();
+
+    private:
+        // Reads the process table from /proc
+        static std::vector<ProcessInfo> scanProcessTable();
+
+        std::unique_ptr<ProcConnector> mProcConnector;
+
+        // The process table as a client saw it, sorted by pid
+        struct Snapshot {
+            int64_t generation;
+            std::vector<ProcessInfo> processes;
+        };
+
+        // Clients that poll less often than this many changes get the whole table again
+        static constexpr size_t kMaxSnapshots = 16;
+
+        // Tells this instance's generations from those of the service before it restarted, which
+        // also count from 1.  Never 0.
+        const int64_t mEpoch;
+
+        std::mutex mSnapshotsLock;
+        std::deque<Snapshot> mSnapshots;    // oldest first
     };
 }
 
@@ -50,6 +50,8 @@ import java.io.InputStream;
 import java.io.InputStreamReader;
 import java.io.OutputStream;
 import java.io.PrintWriter;
+import java.util.concurrent.ExecutionException;
+import java.util.concurrent.FutureTask;
 
 /**
  * Bugreport service for cars.
@@ -201,10 +203,14 @@ public class CarBugreportManagerService extends ICarBugreportService.Stub implem
     }
 
     private void handleFinished(ParcelFileDescriptor output, ParcelFileDescriptor extraOutput,
-            ICarBugreportCallback callback) {
+            ICarBugreportCallback callback, @Nullable FutureTask<Boolean> outputCopy) {
         Slog.i(TAG, "Finished reading bugreport");
         // copysockettopfd calls callback.onError on error
-        if (!copySocketToPfd(output, BUGREPORT_OUTPUT_SOCKET, callback)) {
+        if (outputCopy != null) {
+            if (!waitForOutputCopy(outputCopy, callback)) {
+                return;
+            }
+        } else if (!copySocketToPfd(output, BUGREPORT_OUTPUT_SOCKET, callback)) {
             return;
         }
         if (!copySocketToPfd(extraOutput, BUGREPORT_EXTRA_OUTPUT_SOCKET, callback)) {
@@ -223,6 +229,9 @@ public class CarBugreportManagerService extends ICarBugreportService.Stub implem
      * <p>dumpstate prints {@code BEGIN:} right away, then prints {@code PROGRESS:} as it
      * progresses. When it finishes or fails it prints {@code OK:pathToTheZipFile} or
      * {@code FAIL:message} accordingly.
+     *
+     * <p>car-bugreportd starts streaming the zip file on the output socket as soon as dumpstate
+     * prints {@code BEGIN:}, so from then on the output socket is copied on a separate thread.
      */
     private void processBugreportSockets(
             ParcelFileDescriptor output, ParcelFileDescriptor extraOutput,
@@ -233,6 +242,7 @@ public class CarBugreportManagerService extends ICarBugreportService.Stub implem
             return;
         }
 
+        FutureTask<Boolean> outputCopy = null;
         try (BufferedReader reader =
                 new BufferedReader(new InputStreamReader(localSocket.getInputStream()))) {
             String line;
@@ -245,9 +255,16 @@ public class CarBugreportManagerService extends ICarBugreportService.Stub implem
                     reportError(callback, CAR_BUGREPORT_DUMPSTATE_FAILED);
                     return;
                 } else if (line.startsWith(OK_PREFIX)) {
-                    handleFinished(output, extraOutput, callback);
+                    handleFinished(output, extraOutput, callback, outputCopy);
+                    outputCopy = null;
                     return;
-                } else if (!line.startsWith(BEGIN_PREFIX)) {
+                } else if (line.startsWith(BEGIN_PREFIX)) {
+                    if (outputCopy == null) {
+                        outputCopy = new FutureTask<>(
+                                () -> copySocketToPfd(output, BUGREPORT_OUTPUT_SOCKET, callback));
+                        new Thread(outputCopy, TAG + "-output").start();
+                    }
+                } else {
                     Slog.w(TAG, "Received unknown progress line from dumpstate: " + line);
                 }
             }
@@ -256,6 +273,27 @@ public class CarBugreportManagerService extends ICarBugreportService.Stub implem
         } catch (IOException | RuntimeException e) {
             Slog.i(TAG, "Failed to read from progress socket", e);
             reportError(callback, CAR_BUGREPORT_DUMPSTATE_CONNECTION_FAILED);
+        } finally {
+            // car-bugreportd closes the output socket once dumpstate is done, even if it failed,
+            // so don't start another bugreport until the copy lets go of the output.
+            if (outputCopy != null) {
+                try {
+                    outputCopy.get();
+                } catch (InterruptedException | ExecutionException e) {
+                    Slog.w(TAG, "Output copy did not finish cleanly", e);
+                }
+            }
+        }
+    }
+
+    private boolean waitForOutputCopy(FutureTask<Boolean> outputCopy,
+            ICarBugreportCallback callback) {
+        try {
+            return outputCopy.get();
+        } catch (InterruptedException | ExecutionException e) {
+            Slog.e(TAG, "Failed to copy " + BUGREPORT_OUTPUT_SOCKET, e);
+            reportError(callback, CAR_BUGREPORT_DUMPSTATE_FAILED);
+            return false;
         }
     }
 
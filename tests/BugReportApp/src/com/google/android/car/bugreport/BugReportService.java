@@ -97,6 +97,8 @@ public class BugReportService extends Service {
 
     private static final String OUTPUT_ZIP_FILE = "output_file.zip";
     private static final String EXTRA_OUTPUT_ZIP_FILE = "extra_output_file.zip";
+    // Suffix of the zip file decoded from car-bugreportd's chunked output.
+    private static final String DECODED_SUFFIX = ".decoded";
 
     private static final String MESSAGE_FAILURE_DUMPSTATE = "Failed to grab dumpstate";
     private static final String MESSAGE_FAILURE_ZIP = "Failed to zip files";
@@ -451,6 +453,11 @@ public class BugReportService extends Service {
 
     private void extractZippedFileToOutputStream(File file, ZipOutputStream zipStream)
             throws IOException {
+        if (ChunkedZipDecoder.isChunked(file)) {
+            File decoded = new File(file.getParentFile(), file.getName() + DECODED_SUFFIX);
+            ChunkedZipDecoder.decode(file, decoded);
+            file = decoded;
+        }
         ZipFile zipFile = new ZipFile(file);
         Enumeration<? extends ZipEntry> entries = zipFile.entries();
         while (entries.hasMoreElements()) {
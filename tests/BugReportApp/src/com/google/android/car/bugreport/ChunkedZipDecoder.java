@@ -0,0 +1,99 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.android.car.bugreport;
+
+import java.io.BufferedInputStream;
+import java.io.BufferedOutputStream;
+import java.io.DataInputStream;
+import java.io.EOFException;
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.OutputStream;
+import java.util.zip.CRC32;
+
+/**
+ * Decodes the chunked output of car-bugreportd.
+ *
+ * <p>When {@code android.car.bugreportd.chunkedoutput} is set, car-bugreportd sends the bugreport
+ * zip in chunks so that it can be uploaded and resumed chunk by chunk. Each chunk starts with four
+ * big-endian 32 bit words: {@link #CHUNK_MAGIC}, its sequence number counting from 0, the length
+ * of its payload (at most {@link #MAX_CHUNK_LENGTH}) and the CRC32 of the payload. A header with
+ * no payload ends the stream; its sequence number is the number of chunks and its checksum is the
+ * CRC32 of the whole zip.
+ */
+final class ChunkedZipDecoder {
+    // "CBRC", must match kChunkMagic in car-bugreportd.
+    private static final int CHUNK_MAGIC = 0x43425243;
+
+    /** Largest payload a chunk may carry, which must match kOutputChunkSize in car-bugreportd. */
+    static final int MAX_CHUNK_LENGTH = 1024 * 1024;
+
+    private ChunkedZipDecoder() {
+    }
+
+    /** Returns true if {@code file} holds chunked output rather than a plain zip file. */
+    static boolean isChunked(File file) throws IOException {
+        try (DataInputStream in = new DataInputStream(new FileInputStream(file))) {
+            return in.readInt() == CHUNK_MAGIC;
+        } catch (EOFException e) {
+            return false;
+        }
+    }
+
+    /**
+     * Writes the zip file carried by the chunked output in {@code in} to {@code out}.
+     *
+     * @throws IOException if the chunks are missing, out of order or corrupt.
+     */
+    static void decode(File in, File out) throws IOException {
+        try (DataInputStream reader =
+                     new DataInputStream(new BufferedInputStream(new FileInputStream(in)));
+             OutputStream writer = new BufferedOutputStream(new FileOutputStream(out))) {
+            CRC32 totalCrc = new CRC32();
+            CRC32 chunkCrc = new CRC32();
+            byte[] payload = new byte[MAX_CHUNK_LENGTH];
+            for (int expectedSequence = 0; ; expectedSequence++) {
+                if (reader.readInt() != CHUNK_MAGIC) {
+                    throw new IOException("Bad header for chunk " + expectedSequence);
+                }
+                int sequence = reader.readInt();
+                int length = reader.readInt();
+                long crc = reader.readInt() & 0xffffffffL;
+                if (sequence != expectedSequence || length < 0 || length > MAX_CHUNK_LENGTH) {
+                    throw new IOException("Expected chunk " + expectedSequence + ", got "
+                            + sequence + " of length " + length);
+                }
+                if (length == 0) {
+                    if (crc != totalCrc.getValue()) {
+                        throw new IOException("Checksum mismatch over " + sequence + " chunks");
+                    }
+                    return;
+                }
+                reader.readFully(payload, 0, length);
+                chunkCrc.reset();
+                chunkCrc.update(payload, 0, length);
+                if (crc != chunkCrc.getValue()) {
+                    throw new IOException("Checksum mismatch in chunk " + sequence);
+                }
+                totalCrc.update(payload, 0, length);
+                writer.write(payload, 0, length);
+            }
+        }
+    }
+}
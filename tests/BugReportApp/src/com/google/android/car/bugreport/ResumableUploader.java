@@ -0,0 +1,236 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+package com.google.android.car.bugreport;
+
+import android.annotation.NonNull;
+import android.annotation.Nullable;
+import android.util.Log;
+
+import com.google.api.client.http.ByteArrayContent;
+import com.google.api.client.http.EmptyContent;
+import com.google.api.client.http.GenericUrl;
+import com.google.api.client.http.HttpRequest;
+import com.google.api.client.http.HttpRequestFactory;
+import com.google.api.client.http.HttpResponse;
+import com.google.api.client.http.HttpStatusCodes;
+import com.google.api.client.http.json.JsonHttpContent;
+import com.google.api.client.json.JsonFactory;
+import com.google.api.services.storage.model.StorageObject;
+
+import java.io.File;
+import java.io.FileInputStream;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.io.RandomAccessFile;
+import java.nio.charset.StandardCharsets;
+
+/**
+ * Uploads a file to GCS with the resumable upload protocol, one chunk per request.
+ *
+ * <p>The upload session is kept in a file next to the one being uploaded, so when the link drops
+ * or the job is stopped, the next attempt asks GCS how much it already has and sends only the
+ * rest, instead of the whole bugreport again.
+ */
+final class ResumableUploader {
+    private static final String TAG = ResumableUploader.class.getSimpleName();
+
+    /** Where resumable uploads start, given the bucket name. */
+    private static final String UPLOAD_URL_FORMAT =
+            "https://www.googleapis.com/upload/storage/v1/b/%s/o";
+
+    private static final String CONTENT_TYPE = "application/zip";
+
+    /**
+     * Bytes sent per request. GCS needs every chunk but the last to be a multiple of 256KB; this
+     * matches the chunks car-bugreportd writes.
+     */
+    static final int CHUNK_SIZE = ChunkedZipDecoder.MAX_CHUNK_LENGTH;
+
+    /** GCS answers this to a chunk that doesn't finish the upload. */
+    private static final int STATUS_RESUME_INCOMPLETE = 308;
+
+    /** GCS answers this, or 404, once a session has expired. */
+    private static final int STATUS_GONE = 410;
+
+    /** Suffix of the file holding the upload session of the file it is named after. */
+    static final String SESSION_SUFFIX = ".upload";
+
+    private final HttpRequestFactory mRequestFactory;
+    private final JsonFactory mJsonFactory;
+
+    ResumableUploader(@NonNull HttpRequestFactory requestFactory,
+            @NonNull JsonFactory jsonFactory) {
+        mRequestFactory = requestFactory;
+        mJsonFactory = jsonFactory;
+    }
+
+    /** Returns the file that holds the upload session of {@code file}. */
+    static File getSessionFile(@NonNull File file) {
+        return new File(file.getPath() + SESSION_SUFFIX);
+    }
+
+    /**
+     * Uploads {@code file} as {@code object}, carrying on from where an earlier call left off if
+     * GCS still has its session.
+     *
+     * @throws IOException if the upload didn't finish; calling again resumes it.
+     */
+    void upload(@NonNull File file, @NonNull StorageObject object) throws IOException {
+        File sessionFile = getSessionFile(file);
+        long length = file.length();
+        if (length == 0) {
+            // GCS would wait for the rest forever
+            throw new IOException(file.getName() + " is empty");
+        }
+
+        GenericUrl session = readSession(sessionFile);
+        long offset = -1;
+        if (session != null) {
+            offset = queryOffset(session, length);
+            if (offset < 0) {
+                Log.i(TAG, "Upload session of " + file.getName() + " expired, starting again");
+            } else {
+                Log.i(TAG, "Resuming upload of " + file.getName() + " at " + offset + " of "
+                        + length + " bytes");
+            }
+        }
+        if (offset < 0) {
+            session = startSession(object, length);
+            writeSession(sessionFile, session);
+            offset = 0;
+        }
+
+        try (RandomAccessFile reader = new RandomAccessFile(file, "r")) {
+            byte[] chunk = new byte[CHUNK_SIZE];
+            while (offset < length) {
+                int count = (int) Math.min(CHUNK_SIZE, length - offset);
+                reader.seek(offset);
+                reader.readFully(chunk, 0, count);
+                HttpRequest request = mRequestFactory.buildPutRequest(session,
+                        new ByteArrayContent(CONTENT_TYPE, chunk, 0, count));
+                request.getHeaders().setContentRange(
+                        "bytes " + offset + "-" + (offset + count - 1) + "/" + length);
+                long received = execute(request, length);
+                if (received < 0) {
+                    throw new IOException("Upload session of " + file.getName() + " expired");
+                }
+                if (received <= offset) {
+                    throw new IOException("GCS took none of the chunk at " + offset);
+                }
+                offset = received;
+            }
+        }
+        sessionFile.delete();
+    }
+
+    /** Starts an upload session for {@code length} bytes of {@code object}. */
+    private GenericUrl startSession(StorageObject object, long length) throws IOException {
+        GenericUrl url = new GenericUrl(String.format(UPLOAD_URL_FORMAT, object.getBucket()));
+        url.set("uploadType", "resumable");
+        HttpRequest request = mRequestFactory.buildPostRequest(url,
+                new JsonHttpContent(mJsonFactory, object));
+        request.getHeaders()
+                .set("X-Upload-Content-Type", CONTENT_TYPE)
+                .set("X-Upload-Content-Length", length);
+        HttpResponse response = request.execute();
+        try {
+            String location = response.getHeaders().getLocation();
+            if (location == null) {
+                throw new IOException("GCS didn't return an upload session");
+            }
+            return new GenericUrl(location);
+        } finally {
+            response.disconnect();
+        }
+    }
+
+    /**
+     * Asks GCS how much of an upload of {@code length} bytes it has. Returns -1 if it no longer
+     * knows the session.
+     */
+    private long queryOffset(GenericUrl session, long length) throws IOException {
+        HttpRequest request = mRequestFactory.buildPutRequest(session, new EmptyContent());
+        request.getHeaders().setContentRange("bytes */" + length);
+        return execute(request, length);
+    }
+
+    /**
+     * Sends a request within an upload session of {@code length} bytes, and returns how many of
+     * them GCS has now, or -1 if the session is gone.
+     */
+    private long execute(HttpRequest request, long length) throws IOException {
+        // GCS says how far it has got with a 308, which isn't a redirect to follow
+        request.setFollowRedirects(false);
+        request.setThrowExceptionOnExecuteError(false);
+        HttpResponse response = request.execute();
+        try {
+            int status = response.getStatusCode();
+            if (status == HttpStatusCodes.STATUS_CODE_OK
+                    || status == HttpStatusCodes.STATUS_CODE_CREATED) {
+                return length;
+            }
+            if (status == HttpStatusCodes.STATUS_CODE_NOT_FOUND || status == STATUS_GONE) {
+                return -1;
+            }
+            if (status != STATUS_RESUME_INCOMPLETE) {
+                throw new IOException("Upload failed with status " + status + " "
+                        + response.getStatusMessage());
+            }
+            // The range, if any, is "bytes=0-<last byte received>"
+            String range = response.getHeaders().getRange();
+            if (range == null) {
+                return 0;
+            }
+            int dash = range.lastIndexOf('-');
+            try {
+                return Long.parseLong(range.substring(dash + 1)) + 1;
+            } catch (NumberFormatException e) {
+                throw new IOException("Bad range from GCS: " + range);
+            }
+        } finally {
+            response.disconnect();
+        }
+    }
+
+    @Nullable
+    private static GenericUrl readSession(File sessionFile) {
+        if (!sessionFile.exists()) {
+            return null;
+        }
+        try (FileInputStream in = new FileInputStream(sessionFile)) {
+            byte[] data = new byte[(int) sessionFile.length()];
+            int read = 0;
+            while (read < data.length) {
+                int count = in.read(data, read, data.length - read);
+                if (count < 0) {
+                    break;
+                }
+                read += count;
+            }
+            return new GenericUrl(new String(data, 0, read, StandardCharsets.UTF_8).trim());
+        } catch (IOException | IllegalArgumentException e) {
+            Log.w(TAG, "Ignoring unreadable upload session " + sessionFile.getName(), e);
+            return null;
+        }
+    }
+
+    private static void writeSession(File sessionFile, GenericUrl session) throws IOException {
+        try (FileOutputStream out = new FileOutputStream(sessionFile)) {
+            out.write(session.build().getBytes(StandardCharsets.UTF_8));
+            out.getFD().sync();
+        }
+    }
+}
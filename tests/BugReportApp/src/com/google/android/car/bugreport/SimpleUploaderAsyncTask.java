@@ -24,23 +24,21 @@ import android.util.Log;
 import com.google.api.client.extensions.android.http.AndroidHttp;
 import com.google.api.client.googleapis.auth.oauth2.GoogleCredential;
 import com.google.api.client.http.HttpTransport;
-import com.google.api.client.http.InputStreamContent;
 import com.google.api.client.json.JsonFactory;
 import com.google.api.client.json.jackson2.JacksonFactory;
-import com.google.api.services.storage.Storage;
 import com.google.api.services.storage.model.StorageObject;
 import com.google.common.collect.ImmutableMap;
 
 import java.io.File;
-import java.io.FileInputStream;
 import java.io.IOException;
-import java.io.InputStream;
 import java.util.Collections;
 import java.util.List;
 import java.util.Map;
 
 /**
- * Uploads a file to GCS using a simple (no-multipart / no-resume) upload policy.
+ * Uploads bugreports to GCS. Each one goes up in chunks, and an upload that fails part way (for
+ * example when the link drops) carries on from the last chunk GCS has the next time this runs; see
+ * {@link ResumableUploader}.
  *
  * <p>Please see {@code res/values/configs.xml} and {@code res/raw/gcs_credentials.json} for the
  * configuration.
@@ -72,16 +70,22 @@ class SimpleUploaderAsyncTask extends AsyncTask<Void, Void, Boolean> {
         mResult = result;
     }
 
-    private StorageObject uploadSimple(
-            Storage storage, MetaBugReport bugReport, String fileName, InputStream data)
-            throws IOException {
-        InputStreamContent mediaContent = new InputStreamContent("application/zip", data);
+    private void upload(MetaBugReport bugReport) throws IOException {
+        GoogleCredential credential = GoogleCredential
+                .fromStream(mContext.getResources().openRawResource(R.raw.gcs_credentials))
+                .createScoped(Collections.singleton(ACCESS_SCOPE));
+        Log.v(TAG, "Created credential");
+        HttpTransport httpTransport = AndroidHttp.newCompatibleTransport();
+        JsonFactory jsonFactory = JacksonFactory.getDefaultInstance();
 
         String bucket = mContext.getString(R.string.config_gcs_bucket);
         if (TextUtils.isEmpty(bucket)) {
             throw new RuntimeException("config_gcs_bucket is empty.");
         }
 
+        File bugReportFile = new File(bugReport.getFilePath());
+        String fileName = bugReportFile.getName();
+
         // Create GCS MetaData.
         Map<String, String> metadata = ImmutableMap.of(
                 STORAGE_METADATA_TITLE, bugReport.getTitle()
@@ -91,34 +95,12 @@ class SimpleUploaderAsyncTask extends AsyncTask<Void, Void, Boolean> {
                 .setName(fileName)
                 .setMetadata(metadata)
                 .setContentDisposition("attachment");
-        Storage.Objects.Insert insertObject = storage.objects().insert(bucket, object,
-                mediaContent);
 
-        // The media uploader gzips content by default, and alters the Content-Encoding accordingly.
-        // GCS dutifully stores content as-uploaded. This line disables the media uploader behavior,
-        // so the service stores exactly what is in the InputStream, without transformation.
-        insertObject.getMediaHttpUploader().setDisableGZipContent(true);
         Log.v(TAG, "started uploading object " + fileName + " to bucket " + bucket);
-        return insertObject.execute();
-    }
+        new ResumableUploader(httpTransport.createRequestFactory(credential), jsonFactory)
+                .upload(bugReportFile, object);
+        Log.v(TAG, "finished uploading object " + fileName);
 
-    private void upload(MetaBugReport bugReport) throws IOException {
-        GoogleCredential credential = GoogleCredential
-                .fromStream(mContext.getResources().openRawResource(R.raw.gcs_credentials))
-                .createScoped(Collections.singleton(ACCESS_SCOPE));
-        Log.v(TAG, "Created credential");
-        HttpTransport httpTransport = AndroidHttp.newCompatibleTransport();
-        JsonFactory jsonFactory = JacksonFactory.getDefaultInstance();
-
-        Storage storage = new Storage.Builder(httpTransport, jsonFactory, credential)
-                .setApplicationName("Bugreportupload/1.0").build();
-
-        File bugReportFile = new File(bugReport.getFilePath());
-        String fileName = bugReportFile.getName();
-        try (FileInputStream inputStream = new FileInputStream(bugReportFile)) {
-            StorageObject object = uploadSimple(storage, bugReport, fileName, inputStream);
-            Log.v(TAG, "finished uploading object " + object.getName() + " file " + fileName);
-        }
         Log.v(TAG, "Deleting file " + fileName);
         bugReportFile.delete();
     }
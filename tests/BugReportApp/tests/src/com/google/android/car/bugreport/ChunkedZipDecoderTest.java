@@ -0,0 +1,172 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.android.car.bugreport;
+
+import static com.google.common.truth.Truth.assertThat;
+
+import androidx.test.runner.AndroidJUnit4;
+
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.ExpectedException;
+import org.junit.rules.TemporaryFolder;
+import org.junit.runner.RunWith;
+
+import java.io.ByteArrayOutputStream;
+import java.io.DataOutputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.nio.file.Files;
+import java.util.Random;
+import java.util.zip.CRC32;
+
+@RunWith(AndroidJUnit4.class)
+public class ChunkedZipDecoderTest {
+    // How car-bugreportd frames its output, see car-bugreportd/main.cpp
+    private static final int CHUNK_MAGIC = 0x43425243;
+    private static final int HEADER_SIZE = 16;
+    private static final int CHUNK_SIZE = ChunkedZipDecoder.MAX_CHUNK_LENGTH;
+
+    @Rule
+    public TemporaryFolder mTempFolder = new TemporaryFolder();
+
+    @Rule
+    public ExpectedException mException = ExpectedException.none();
+
+    private static byte[] randomBytes(int length) {
+        byte[] data = new byte[length];
+        new Random(length).nextBytes(data);
+        return data;
+    }
+
+    private static long crc32(byte[] data, int offset, int length) {
+        CRC32 crc = new CRC32();
+        crc.update(data, offset, length);
+        return crc.getValue();
+    }
+
+    private static void writeHeader(DataOutputStream out, int sequence, int length, long crc)
+            throws IOException {
+        out.writeInt(CHUNK_MAGIC);
+        out.writeInt(sequence);
+        out.writeInt(length);
+        out.writeInt((int) crc);
+    }
+
+    /** Frames {@code data} the way car-bugreportd does. */
+    private static byte[] encode(byte[] data) throws IOException {
+        ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+        DataOutputStream out = new DataOutputStream(bytes);
+        int sequence = 0;
+        for (int offset = 0; offset < data.length; offset += CHUNK_SIZE, sequence++) {
+            int length = Math.min(CHUNK_SIZE, data.length - offset);
+            writeHeader(out, sequence, length, crc32(data, offset, length));
+            out.write(data, offset, length);
+        }
+        writeHeader(out, sequence, 0, crc32(data, 0, data.length));
+        return bytes.toByteArray();
+    }
+
+    private File writeFile(String name, byte[] contents) throws IOException {
+        File file = mTempFolder.newFile(name);
+        try (FileOutputStream out = new FileOutputStream(file)) {
+            out.write(contents);
+        }
+        return file;
+    }
+
+    private byte[] decode(byte[] chunked) throws IOException {
+        File out = new File(mTempFolder.getRoot(), "decoded.zip");
+        ChunkedZipDecoder.decode(writeFile("chunked", chunked), out);
+        return Files.readAllBytes(out.toPath());
+    }
+
+    @Test
+    public void decodesWholeAndPartialChunks() throws IOException {
+        byte[] data = randomBytes(CHUNK_SIZE * 2 + CHUNK_SIZE / 3);
+        assertThat(decode(encode(data))).isEqualTo(data);
+    }
+
+    @Test
+    public void decodesChunkOfExactlyMaxLength() throws IOException {
+        byte[] data = randomBytes(CHUNK_SIZE);
+        assertThat(decode(encode(data))).isEqualTo(data);
+    }
+
+    @Test
+    public void recognisesChunkedOutput() throws IOException {
+        assertThat(ChunkedZipDecoder.isChunked(writeFile("chunked", encode(randomBytes(10)))))
+                .isTrue();
+        assertThat(ChunkedZipDecoder.isChunked(writeFile("plain.zip",
+                new byte[] {'P', 'K', 3, 4, 0, 0, 0, 0}))).isFalse();
+        assertThat(ChunkedZipDecoder.isChunked(writeFile("empty", new byte[0]))).isFalse();
+    }
+
+    @Test
+    public void rejectsCorruptPayload() throws IOException {
+        byte[] chunked = encode(randomBytes(1000));
+        chunked[HEADER_SIZE + 500] ^= 1;
+
+        mException.expect(IOException.class);
+        decode(chunked);
+    }
+
+    @Test
+    public void rejectsWrongTotalChecksum() throws IOException {
+        byte[] chunked = encode(randomBytes(1000));
+        chunked[chunked.length - 1] ^= 1;
+
+        mException.expect(IOException.class);
+        decode(chunked);
+    }
+
+    @Test
+    public void rejectsChunksOutOfOrder() throws IOException {
+        byte[] data = randomBytes(100);
+        ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+        DataOutputStream out = new DataOutputStream(bytes);
+        writeHeader(out, 1, data.length, crc32(data, 0, data.length));
+        out.write(data);
+        writeHeader(out, 2, 0, crc32(data, 0, data.length));
+
+        mException.expect(IOException.class);
+        decode(bytes.toByteArray());
+    }
+
+    @Test
+    public void rejectsChunkLongerThanTheWriterSends() throws IOException {
+        // Only the header: the length alone must be enough to reject it, before we allocate for
+        // or read the payload
+        ByteArrayOutputStream bytes = new ByteArrayOutputStream();
+        writeHeader(new DataOutputStream(bytes), 0, CHUNK_SIZE + 1, 0);
+
+        mException.expect(IOException.class);
+        mException.expectMessage("length " + (CHUNK_SIZE + 1));
+        decode(bytes.toByteArray());
+    }
+
+    @Test
+    public void rejectsOutputWithoutEnd() throws IOException {
+        byte[] chunked = encode(randomBytes(1000));
+        byte[] truncated = new byte[chunked.length - HEADER_SIZE];
+        System.arraycopy(chunked, 0, truncated, 0, truncated.length);
+
+        mException.expect(IOException.class);
+        decode(truncated);
+    }
+}
@@ -0,0 +1,198 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+package com.google.android.car.bugreport;
+
+import static com.google.common.truth.Truth.assertThat;
+
+import static org.junit.Assert.fail;
+
+import androidx.test.runner.AndroidJUnit4;
+
+import com.google.api.client.http.LowLevelHttpRequest;
+import com.google.api.client.http.LowLevelHttpResponse;
+import com.google.api.client.json.jackson2.JacksonFactory;
+import com.google.api.client.testing.http.MockHttpTransport;
+import com.google.api.client.testing.http.MockLowLevelHttpRequest;
+import com.google.api.client.testing.http.MockLowLevelHttpResponse;
+import com.google.api.services.storage.model.StorageObject;
+
+import org.junit.Before;
+import org.junit.Rule;
+import org.junit.Test;
+import org.junit.rules.TemporaryFolder;
+import org.junit.runner.RunWith;
+
+import java.io.ByteArrayOutputStream;
+import java.io.File;
+import java.io.FileOutputStream;
+import java.io.IOException;
+import java.util.Random;
+
+@RunWith(AndroidJUnit4.class)
+public class ResumableUploaderTest {
+    private static final int CHUNK_SIZE = ResumableUploader.CHUNK_SIZE;
+
+    @Rule
+    public TemporaryFolder mTempFolder = new TemporaryFolder();
+
+    private FakeGcs mGcs;
+    private File mFile;
+    private byte[] mData;
+    private StorageObject mObject;
+
+    /** Enough of the GCS resumable upload protocol to upload one object. */
+    private static final class FakeGcs extends MockHttpTransport {
+        private static final String SESSION_URL = "https://gcs.example.com/session/";
+
+        final ByteArrayOutputStream mReceived = new ByteArrayOutputStream();
+        int mSessionsStarted;
+        long mBytesSent;            // Payload sent over all sessions, counting any sent again
+        int mChunksBeforeDrop = -1;  // Drops the link instead of taking the chunk after these
+        boolean mExpired;
+
+        @Override
+        public LowLevelHttpRequest buildRequest(String method, String url) {
+            return new MockLowLevelHttpRequest(url) {
+                @Override
+                public LowLevelHttpResponse execute() throws IOException {
+                    return handle(method, url, this);
+                }
+            };
+        }
+
+        private LowLevelHttpResponse handle(String method, String url,
+                MockLowLevelHttpRequest request) throws IOException {
+            MockLowLevelHttpResponse response = new MockLowLevelHttpResponse();
+            if (method.equals("POST")) {
+                assertThat(url).contains("uploadType=resumable");
+                mSessionsStarted++;
+                mExpired = false;
+                mReceived.reset();
+                return response.addHeader("Location", SESSION_URL + mSessionsStarted);
+            }
+
+            assertThat(method).isEqualTo("PUT");
+            if (mExpired || !url.equals(SESSION_URL + mSessionsStarted)) {
+                return response.setStatusCode(404);
+            }
+            String range = request.getFirstHeaderValue("Content-Range");
+            if (!range.startsWith("bytes */")) {
+                if (mChunksBeforeDrop == 0) {
+                    mChunksBeforeDrop = -1;
+                    throw new IOException("Link dropped");
+                }
+                if (mChunksBeforeDrop > 0) {
+                    mChunksBeforeDrop--;
+                }
+
+                // "bytes <first>-<last>/<total>", which must carry on from what we have
+                long first = Long.parseLong(range.substring("bytes ".length(),
+                        range.indexOf('-')));
+                assertThat(first).isEqualTo((long) mReceived.size());
+                ByteArrayOutputStream content = new ByteArrayOutputStream();
+                request.getStreamingContent().writeTo(content);
+                assertThat(content.size()).isAtMost(CHUNK_SIZE);
+                mReceived.write(content.toByteArray());
+                mBytesSent += content.size();
+            }
+
+            long total = Long.parseLong(range.substring(range.indexOf('/') + 1));
+            if (mReceived.size() == total) {
+                return response.setStatusCode(200);
+            }
+            response.setStatusCode(308);
+            if (mReceived.size() > 0) {
+                response.addHeader("Range", "bytes=0-" + (mReceived.size() - 1));
+            }
+            return response;
+        }
+    }
+
+    @Before
+    public void setUp() throws IOException {
+        mGcs = new FakeGcs();
+        mData = new byte[CHUNK_SIZE * 3 + 1234];
+        new Random(1).nextBytes(mData);
+        mFile = mTempFolder.newFile("bugreport.zip");
+        try (FileOutputStream out = new FileOutputStream(mFile)) {
+            out.write(mData);
+        }
+        mObject = new StorageObject().setBucket("bucket").setName(mFile.getName());
+    }
+
+    private void upload() throws IOException {
+        new ResumableUploader(mGcs.createRequestFactory(), JacksonFactory.getDefaultInstance())
+                .upload(mFile, mObject);
+    }
+
+    private void uploadUntilLinkDrops(int chunksBeforeDrop) {
+        mGcs.mChunksBeforeDrop = chunksBeforeDrop;
+        try {
+            upload();
+            fail("Upload carried on after the link dropped");
+        } catch (IOException e) {
+            // Expected
+        }
+        assertThat(ResumableUploader.getSessionFile(mFile).exists()).isTrue();
+    }
+
+    @Test
+    public void uploadsInChunks() throws IOException {
+        upload();
+
+        assertThat(mGcs.mReceived.toByteArray()).isEqualTo(mData);
+        assertThat(mGcs.mSessionsStarted).isEqualTo(1);
+        assertThat(mGcs.mBytesSent).isEqualTo((long) mData.length);
+        assertThat(ResumableUploader.getSessionFile(mFile).exists()).isFalse();
+    }
+
+    @Test
+    public void resumesFromTheLastChunkReceived() throws IOException {
+        uploadUntilLinkDrops(2);
+        assertThat(mGcs.mReceived.size()).isEqualTo(CHUNK_SIZE * 2);
+
+        upload();
+
+        // The same session carried on, and no chunk went up twice
+        assertThat(mGcs.mReceived.toByteArray()).isEqualTo(mData);
+        assertThat(mGcs.mSessionsStarted).isEqualTo(1);
+        assertThat(mGcs.mBytesSent).isEqualTo((long) mData.length);
+        assertThat(ResumableUploader.getSessionFile(mFile).exists()).isFalse();
+    }
+
+    @Test
+    public void resumesBeforeAnyChunkWasReceived() throws IOException {
+        uploadUntilLinkDrops(0);
+
+        upload();
+
+        assertThat(mGcs.mReceived.toByteArray()).isEqualTo(mData);
+        assertThat(mGcs.mSessionsStarted).isEqualTo(1);
+    }
+
+    @Test
+    public void startsAgainOnceTheSessionExpires() throws IOException {
+        uploadUntilLinkDrops(1);
+        mGcs.mExpired = true;
+
+        upload();
+
+        assertThat(mGcs.mReceived.toByteArray()).isEqualTo(mData);
+        assertThat(mGcs.mSessionsStarted).isEqualTo(2);
+        assertThat(ResumableUploader.getSessionFile(mFile).exists()).isFalse();
+    }
+}
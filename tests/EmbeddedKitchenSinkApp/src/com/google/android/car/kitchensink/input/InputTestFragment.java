@@ -170,6 +170,13 @@ public class InputTestFragment extends Fragment {
             Log.d(TAG, "received event " + keypressEvent);
             mEventReaderServiceKeyDownCounter.count(keypressEvent.keycode, keypressEvent.isKeydown);
         }
+
+        @Override
+        public void onEvents(List<KeypressEvent> keypressEvents) throws RemoteException {
+            for (KeypressEvent keypressEvent : keypressEvents) {
+                onEvent(keypressEvent);
+            }
+        }
     };
 
     private final IVehicleCallback.Stub mHalKeyEventHandler = new Stub() {
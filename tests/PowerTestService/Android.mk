@@ -19,7 +19,8 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := com.android.car.powertestservice
 
 LOCAL_SRC_FILES := \
-    src/main.cpp
+    src/main.cpp \
+    src/SuspendBenchmark.cpp
 
 LOCAL_CFLAGS += \
     -Wall \
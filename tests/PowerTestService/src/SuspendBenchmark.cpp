@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "PowerTestService: "
+
+#include "SuspendBenchmark.h"
+
+#include <inttypes.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <utils/Log.h>
+
+namespace android {
+namespace car {
+namespace hardware {
+namespace power {
+
+static int64_t now(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static double toMs(int64_t ns) {
+    return ns / 1e6;
+}
+
+void SuspendBenchmark::Samples::log() const {
+    if (values.empty()) {
+        ALOGI(LOG_TAG "%s: no samples", name);
+        return;
+    }
+
+    std::vector<int64_t> sorted(values);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&sorted](int p) {
+        // Nearest rank
+        size_t rank = (sorted.size() * p + 99) / 100;
+        return sorted[std::max<size_t>(rank, 1) - 1];
+    };
+    ALOGI(LOG_TAG "%s: n=%zu min=%.1fms p50=%.1fms p90=%.1fms p99=%.1fms max=%.1fms", name,
+          sorted.size(), toMs(sorted.front()), toMs(percentile(50)), toMs(percentile(90)),
+          toMs(percentile(99)), toMs(sorted.back()));
+}
+
+SuspendBenchmark::SuspendBenchmark(const Options& options) :
+        mOptions(options), mCarPowerManager(new CarPowerManager()) {}
+
+bool SuspendBenchmark::start() {
+    // Our own thread, and an explicit finished(), so the time spent preparing is ours to choose
+    return mCarPowerManager->setListenerWithCompletion(
+            [this](CarPowerManager::State state) { onStateChanged(state); }) == 0;
+}
+
+void SuspendBenchmark::waitUntilDone() {
+    std::unique_lock<std::mutex> lock(mLock);
+    mDone.wait(lock, [this]() { return mOptions.cycles > 0 && mCycles >= mOptions.cycles; });
+}
+
+void SuspendBenchmark::stop() {
+    mCarPowerManager->clearListener();
+}
+
+void SuspendBenchmark::report() {
+    std::lock_guard<std::mutex> lock(mLock);
+    ALOGI(LOG_TAG "after %d cycles (%zu transitions):", mCycles, mTransitions.size());
+    mSuspendTotal.log();
+    mSuspendAwake.log();
+    mPrepareToFinished.log();
+    mPrepareToSuspend.log();
+}
+
+void SuspendBenchmark::onStateChanged(CarPowerManager::State state) {
+    const Transition transition = {state, now(CLOCK_MONOTONIC), now(CLOCK_BOOTTIME)};
+    ALOGI(LOG_TAG "onStateChanged callback = %d at %" PRId64 "ns (boottime %" PRId64 "ns)",
+          static_cast<int>(state), transition.monotonicNs, transition.boottimeNs);
+
+    bool cycleDone = false;
+    {
+        std::lock_guard<std::mutex> lock(mLock);
+        mTransitions.push_back(transition);
+
+        switch (state) {
+            case CarPowerManager::State::kShutdownPrepare:
+                mShutdownPrepare = transition;
+                break;
+            case CarPowerManager::State::kSuspendEnter:
+                mSuspendEnter = transition;
+                if (mShutdownPrepare.monotonicNs != 0) {
+                    mPrepareToSuspend.values.push_back(
+                            transition.monotonicNs - mShutdownPrepare.monotonicNs);
+                    mShutdownPrepare = {};
+                }
+                break;
+            case CarPowerManager::State::kSuspendExit:
+                if (mSuspendEnter.monotonicNs != 0) {
+                    mSuspendTotal.values.push_back(
+                            transition.boottimeNs - mSuspendEnter.boottimeNs);
+                    mSuspendAwake.values.push_back(
+                            transition.monotonicNs - mSuspendEnter.monotonicNs);
+                    mSuspendEnter = {};
+                    mCycles++;
+                    cycleDone = true;
+                }
+                break;
+            default:
+                break;
+        }
+    }
+
+    if (state == CarPowerManager::State::kShutdownPrepare) {
+        // Stand in for the work a real client would do before it lets the system go to sleep
+        if (mOptions.workMs > 0) {
+            usleep(mOptions.workMs * 1000);
+        }
+        mCarPowerManager->finished();
+
+        std::lock_guard<std::mutex> lock(mLock);
+        mPrepareToFinished.values.push_back(now(CLOCK_MONOTONIC) - transition.monotonicNs);
+    }
+
+    if (cycleDone) {
+        report();
+        mDone.notify_all();
+    }
+}
+
+} // namespace power
+} // namespace hardware
+} // namespace car
+} // namespace android
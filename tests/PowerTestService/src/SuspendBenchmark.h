@@ -0,0 +1,96 @@
+/*
+ * Copyright (C) 2019 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAR_POWER_TEST_SERVICE_SUSPEND_BENCHMARK
+#define CAR_POWER_TEST_SERVICE_SUSPEND_BENCHMARK
+
+#include <condition_variable>
+#include <mutex>
+#include <stdint.h>
+#include <vector>
+
+#include "CarPowerManager.h"
+
+namespace android {
+namespace car {
+namespace hardware {
+namespace power {
+
+// Follows CarPowerManager through suspend/resume cycles and reports how long each phase takes
+class SuspendBenchmark {
+public:
+    struct Options {
+        int cycles = 0;         // stop after this many suspend/resume cycles, or never if 0
+        int workMs = 0;         // how long to pretend to prepare for shutdown before finishing
+    };
+
+    explicit SuspendBenchmark(const Options& options);
+
+    // Registers with CarPowerManager.  Returns false if it can't.
+    bool start();
+
+    // Blocks until the requested number of cycles have been seen
+    void waitUntilDone();
+
+    void stop();
+
+    // Logs the percentiles of everything measured so far
+    void report();
+
+private:
+    struct Transition {
+        CarPowerManager::State state;
+        int64_t monotonicNs;    // stops while the system is suspended...
+        int64_t boottimeNs;     // ...and this one doesn't
+    };
+
+    // Measurements in ns, one per cycle
+    struct Samples {
+        const char* name;
+        std::vector<int64_t> values;
+
+        void log() const;
+    };
+
+    void onStateChanged(CarPowerManager::State state);
+
+    Options mOptions;
+    sp<CarPowerManager> mCarPowerManager;
+
+    std::mutex mLock;
+    std::condition_variable mDone;
+    std::vector<Transition> mTransitions;
+    int mCycles = 0;
+
+    // The last time we saw these, to measure from
+    Transition mShutdownPrepare = {};
+    Transition mSuspendEnter = {};
+
+    // kSuspendEnter to kSuspendExit, counting and not counting the time spent asleep
+    Samples mSuspendTotal = {"suspend enter to exit (wall)", {}};
+    Samples mSuspendAwake = {"suspend enter to exit (awake)", {}};
+    // kShutdownPrepare until we've told CarService we're done with it
+    Samples mPrepareToFinished = {"shutdown prepare to finished()", {}};
+    // kShutdownPrepare until CarService goes on to suspend
+    Samples mPrepareToSuspend = {"shutdown prepare to suspend enter", {}};
+};
+
+} // namespace power
+} // namespace hardware
+} // namespace car
+} // namespace android
+
+#endif // CAR_POWER_TEST_SERVICE_SUSPEND_BENCHMARK
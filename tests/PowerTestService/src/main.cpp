@@ -17,6 +17,8 @@
 #define LOG_TAG "PowerTestService: "
 
 #include <signal.h>
+#include <stdlib.h>
+#include <string.h>
 #include <utils/Log.h>
 
 #include <binder/IPCThreadState.h>
@@ -25,51 +27,51 @@
 #include <binder/IBinder.h>
 #include <binder/IInterface.h>
 
-#include "android/car/ICar.h"
-#include "android/car/hardware/power/ICarPower.h"
-#include "CarPowerManager.h"
+#include "SuspendBenchmark.h"
 
 using namespace android;
-using namespace android::binder;
-using namespace android::car;
 using namespace android::car::hardware::power;
 
-static std::atomic_bool run(true);
-
-void onStateChanged(CarPowerManager::State state) {
-    ALOGI(LOG_TAG "onStateChanged callback = %d", state);
-    if (state == CarPowerManager::State::kShutdownPrepare) {
-        // Stop the loop
-        run = false;
+// Usage: com.android.car.powertestservice [--cycles N] [--work-ms N]
+//  Measures N suspend/resume cycles (all of them if N is 0), spending the given time preparing
+//  for each one.  The results are in the log.
+static SuspendBenchmark::Options parseOptions(int argc, char** argv) {
+    SuspendBenchmark::Options options;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--cycles") == 0) {
+            options.cycles = atoi(argv[i + 1]);
+        } else if (strcmp(argv[i], "--work-ms") == 0) {
+            options.workMs = atoi(argv[i + 1]);
+        } else {
+            ALOGW(LOG_TAG "Ignoring unknown option %s", argv[i]);
+        }
     }
+    return options;
 }
 
-int main(int, char**)
+int main(int argc, char** argv)
 {
-    int retVal;
-
     sp<ProcessState> processSelf(ProcessState::self());
     processSelf->startThreadPool();
     ALOGI(LOG_TAG "started");
 
-    std::unique_ptr<CarPowerManager> carPowerManager(new CarPowerManager());
-
-    do {
-        retVal = carPowerManager->setListener(onStateChanged);
-    } while (retVal != 0);
+    // CarPowerManager connects in the background if CarService isn't up yet
+    SuspendBenchmark benchmark(parseOptions(argc, argv));
+    if (!benchmark.start()) {
+        ALOGE(LOG_TAG "Cannot listen to CarPowerManager");
+        return 1;
+    }
 
-    do {
-        ALOGI(LOG_TAG "Waiting for CarPowerManager listener to initiate SHUTDOWN_PREPARE...");
-        sleep(5);
-    } while (run);
+    ALOGI(LOG_TAG "Waiting for suspend/resume cycles...");
+    benchmark.waitUntilDone();
 
-    ALOGI(LOG_TAG "Exited loop, shutting down");
+    ALOGI(LOG_TAG "Done, shutting down");
+    benchmark.report();
 
     // Unregister the listener
-    carPowerManager->clearListener();
+    benchmark.stop();
 
     // Wait for threads to finish, and then exit.
     IPCThreadState::self()->joinThreadPool();
     return 0;
 }
-
@@ -581,6 +581,8 @@ public final class KeypressEvent implements Parcelable {
     public final String source;
     public final int keycode;
     public final boolean isKeydown;
+    // when the kernel saw the key, in the same timebase as SystemClock.uptimeMillis()
+    public final long timestampNanos;
 
     public static final Parcelable.Creator<KeypressEvent> CREATOR =
         new Parcelable.Creator<KeypressEvent>() {
@@ -597,6 +599,7 @@ public final class KeypressEvent implements Parcelable {
         source = in.readString();
         keycode = in.readInt();
         isKeydown = (in.readInt() != 0);
+        timestampNanos = in.readLong();
     }
 
     @Override
@@ -609,6 +612,7 @@ public final class KeypressEvent implements Parcelable {
         dest.writeString(source);
         dest.writeInt(keycode);
         dest.writeInt(isKeydown ? 1 : 0);
+        dest.writeLong(timestampNanos);
     }
 
     @Override
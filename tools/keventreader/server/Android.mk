@@ -25,6 +25,7 @@ LOCAL_SRC_FILES := \
     keymap.cpp \
     event.cpp \
     eventprovider.cpp \
+    latencyhistogram.cpp \
     ../common/com/android/car/keventreader/IEventCallback.aidl \
     ../common/com/android/car/keventreader/IEventProvider.aidl \
 
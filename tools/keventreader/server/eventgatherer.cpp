@@ -17,49 +17,217 @@
 #include "defines.h"
 #include <utils/Log.h>
 
+#include <dirent.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
 using namespace com::android::car::keventreader;
 
+static bool isEventFile(const char* name) {
+    return strncmp(name, "event", 5) == 0;
+}
+
 EventGatherer::EventGatherer(int argc, const char** argv) {
+    mEpollFd = epoll_create1(EPOLL_CLOEXEC);
+    mInotifyFd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    mStopFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (mEpollFd < 0 || mStopFd < 0) {
+        ALOGE("unable to set up epoll: errno = %d", errno);
+        return;
+    }
+
+    epoll_event evt = {};
+    evt.events = EPOLLIN;
+    evt.data.fd = mStopFd;
+    epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mStopFd, &evt);
+    if (mInotifyFd >= 0) {
+        evt.data.fd = mInotifyFd;
+        epoll_ctl(mEpollFd, EPOLL_CTL_ADD, mInotifyFd, &evt);
+    } else {
+        ALOGW("inotify not available (errno = %d), input sources will not be hotplugged", errno);
+    }
+
     for (auto i = 1; i < argc; ++i) {
-        auto dev = std::make_unique<InputSource>(argv[i]);
-        if (dev && *dev) {
-            ALOGD("opened input source file %s", argv[i]);
-            mFds.push_back({dev->descriptor(), POLLIN, 0});
-            mDevices.emplace(dev->descriptor(), std::move(dev));
+        watch(argv[i]);
+    }
+
+    // only once every argument is in, so that files named on their own get their own config
+    for (const auto& wanted : mWanted) {
+        add(wanted.first, wanted.second);
+    }
+    for (const auto& dir : mWholeDirs) {
+        scan(dir.first);
+    }
+}
+
+EventGatherer::EventGatherer(EventGatherer&& other) :
+        mEpollFd(other.mEpollFd), mInotifyFd(other.mInotifyFd), mStopFd(other.mStopFd),
+        mRunning(other.mRunning.load()), mDevices(std::move(other.mDevices)),
+        mWatches(std::move(other.mWatches)), mWholeDirs(std::move(other.mWholeDirs)),
+        mWanted(std::move(other.mWanted)) {
+    other.mEpollFd = other.mInotifyFd = other.mStopFd = -1;
+}
+
+EventGatherer::~EventGatherer() {
+    mDevices.clear();
+    if (mInotifyFd >= 0) close(mInotifyFd);
+    if (mStopFd >= 0) close(mStopFd);
+    if (mEpollFd >= 0) close(mEpollFd);
+}
+
+size_t EventGatherer::size() const {
+    return mDevices.size() + mWholeDirs.size();
+}
+
+void EventGatherer::watch(const char* arg) {
+    std::string path;
+    InputSource::Config config;
+    if (!InputSource::parse(arg, &path, &config)) {
+        ALOGE("ignoring invalid input source %s", arg);
+        return;
+    }
+
+    struct stat st;
+    const bool isDir = (stat(path.c_str(), &st) == 0) && S_ISDIR(st.st_mode);
+
+    // files are watched for from the directory they live in
+    std::string dir(path);
+    if (!isDir) {
+        auto slash = dir.rfind('/');
+        dir = (slash == std::string::npos) ? "." : dir.substr(0, slash);
+    }
+    if (mInotifyFd >= 0) {
+        int wd = inotify_add_watch(mInotifyFd, dir.c_str(), IN_CREATE | IN_MOVED_TO | IN_ATTRIB);
+        if (wd >= 0) {
+            mWatches[wd] = dir;
         } else {
-            ALOGW("failed to open input source file %s", argv[i]);
+            ALOGW("unable to watch %s for new input sources: errno = %d", dir.c_str(), errno);
         }
     }
+
+    if (isDir) {
+        mWholeDirs[dir] = config;
+    } else {
+        mWanted[path] = config;
+    }
 }
 
-size_t EventGatherer::size() const {
-    return mDevices.size();
+void EventGatherer::scan(const std::string& dir) {
+    if (DIR* d = opendir(dir.c_str())) {
+        while (auto entry = readdir(d)) {
+            if (auto config = configFor(dir, entry->d_name)) {
+                add(dir + "/" + entry->d_name, *config);
+            }
+        }
+        closedir(d);
+    }
+}
+
+const InputSource::Config* EventGatherer::configFor(const std::string& dir,
+                                                    const char* name) const {
+    if (auto it = mWanted.find(dir + "/" + name); it != mWanted.end()) {
+        return &it->second;
+    }
+    if (auto it = mWholeDirs.find(dir); it != mWholeDirs.end() && isEventFile(name)) {
+        return &it->second;
+    }
+    return nullptr;
+}
+
+void EventGatherer::add(const std::string& path, const InputSource::Config& config) {
+    for (const auto& device : mDevices) {
+        if (device.second->path() == path) return;
+    }
+
+    auto dev = std::make_unique<InputSource>(path.c_str(), config);
+    if (!dev || !*dev) {
+        // this happens for new devices until ueventd gets to them; we'll try again on IN_ATTRIB
+        ALOGW("failed to open input source file %s", path.c_str());
+        return;
+    }
+
+    epoll_event evt = {};
+    evt.events = EPOLLIN;
+    evt.data.fd = dev->descriptor();
+    if (epoll_ctl(mEpollFd, EPOLL_CTL_ADD, dev->descriptor(), &evt) != 0) {
+        ALOGW("unable to poll input source file %s: errno = %d", path.c_str(), errno);
+        return;
+    }
+    ALOGD("opened input source file %s", path.c_str());
+    mDevices.emplace(dev->descriptor(), std::move(dev));
+}
+
+void EventGatherer::remove(int fd) {
+    auto it = mDevices.find(fd);
+    if (it == mDevices.end()) return;
+
+    ALOGD("input source file %s went away", it->second->path().c_str());
+    epoll_ctl(mEpollFd, EPOLL_CTL_DEL, fd, nullptr);
+    mDevices.erase(it);
+}
+
+void EventGatherer::handleHotplug() {
+    alignas(inotify_event) char buffer[4096];
+    ssize_t len;
+    while ((len = ::read(mInotifyFd, buffer, sizeof(buffer))) > 0) {
+        for (ssize_t offset = 0; offset < len; ) {
+            auto ie = reinterpret_cast<const inotify_event*>(buffer + offset);
+            offset += sizeof(inotify_event) + ie->len;
+
+            auto dir = mWatches.find(ie->wd);
+            if (dir == mWatches.end() || ie->len == 0) continue;
+
+            if (auto config = configFor(dir->second, ie->name)) {
+                add(dir->second + "/" + ie->name, *config);
+            }
+        }
+    }
 }
 
 std::vector<com::android::car::keventreader::KeypressEvent> EventGatherer::read() {
     constexpr int FOREVER = -1;
     std::vector<com::android::car::keventreader::KeypressEvent> result;
 
-    int count = poll(&mFds[0], mFds.size(), FOREVER);
+    epoll_event events[kMaxEpollEvents];
+    int count = epoll_wait(mEpollFd, events, kMaxEpollEvents, FOREVER);
     if (count < 0) {
-        ALOGE("poll failed: errno = %d", errno);
+        if (errno != EINTR) ALOGE("epoll_wait failed: errno = %d", errno);
         return result;
     }
 
-    for (auto& fd : mFds) {
-        if (fd.revents != 0) {
-            if (fd.revents == POLLIN) {
-                if (auto dev = mDevices[fd.fd].get()) {
-                    while(auto evt = dev->read()) {
-                        result.push_back(*evt);
-                    }
-                    --count; // found one source of events we care abour
-                }
+    // only the sources that are ready are looked at, however many there are
+    for (int i = 0; i < count; ++i) {
+        const int fd = events[i].data.fd;
+        if (fd == mStopFd) {
+            mRunning = false;
+        } else if (fd == mInotifyFd) {
+            handleHotplug();
+        } else if (auto it = mDevices.find(fd); it != mDevices.end()) {
+            // a device that was unplugged reports EPOLLHUP or fails to read with ENODEV
+            bool ok = !(events[i].events & (EPOLLERR | EPOLLHUP));
+            if (events[i].events & EPOLLIN) {
+                ok = it->second->read(&result) && ok;
             }
-            fd.revents = 0;
-            if (count == 0) break; // if we read all events, no point in continuing the scan
+            if (!ok) remove(fd);
         }
     }
 
     return result;
 }
+
+void EventGatherer::stop() {
+    mRunning = false;
+    uint64_t one = 1;
+    if (mStopFd >= 0 && ::write(mStopFd, &one, sizeof(one)) != sizeof(one)) {
+        ALOGW("unable to wake up the event loop: errno = %d", errno);
+    }
+}
+
+bool EventGatherer::running() const {
+    return mRunning;
+}
@@ -19,22 +19,55 @@
 #include "inputsource.h"
 #include "event.h"
 
+#include <atomic>
 #include <map>
 #include <memory>
-#include <poll.h>
+#include <string>
 #include <vector>
 
 namespace com::android::car::keventreader {
+    // Waits on any number of input sources at once.  Each argument is either an event file, which
+    // is opened again should it go away and come back, or a directory such as /dev/input, in
+    // which case every event* file in it is used, including ones plugged in later.
     class EventGatherer {
     public:
         EventGatherer(int argc, const char** argv);
+        EventGatherer(EventGatherer&& other);
+        ~EventGatherer();
 
+        EventGatherer(const EventGatherer&) = delete;
+        EventGatherer& operator=(const EventGatherer&) = delete;
+
+        // how many input sources are open or being watched for
         size_t size() const;
 
+        // blocks until there are keypresses to return, or stop() is called
         std::vector<com::android::car::keventreader::KeypressEvent> read();
+
+        // can be called from any thread to have read() return and running() become false
+        void stop();
+        bool running() const;
     private:
+        static constexpr int kMaxEpollEvents = 16;
+
+        void watch(const char* arg);
+        void scan(const std::string& dir);
+        const InputSource::Config* configFor(const std::string& dir, const char* name) const;
+        void add(const std::string& path, const InputSource::Config& config);
+        void remove(int fd);
+        void handleHotplug();
+
+        int mEpollFd = -1;
+        int mInotifyFd = -1;
+        int mStopFd = -1;   // eventfd that stop() signals
+        std::atomic<bool> mRunning = true;
+
         std::map<int, std::unique_ptr<InputSource>> mDevices;
-        std::vector<pollfd> mFds;
+        // inotify watch descriptor -> the directory it's for
+        std::map<int, std::string> mWatches;
+        // directories all of whose event* files we want, and single files we want
+        std::map<std::string, InputSource::Config> mWholeDirs;
+        std::map<std::string, InputSource::Config> mWanted;
     };
 }
 
@@ -16,37 +16,136 @@
 #include "defines.h"
 #include "eventprovider.h"
 #include <algorithm>
+#include <unistd.h>
 #include <utils/Log.h>
+#include <utils/Timers.h>
 
 using namespace com::android::car::keventreader;
 
-EventProviderImpl::EventProviderImpl(EventGatherer&& g) : mGatherer(std::move(g)) {}
+EventProviderImpl::Client::Client(const sp<IEventCallback>& callback,
+                                  LatencyHistogram* deliveryLatency) :
+        mCallback(callback), mDeliveryLatency(deliveryLatency),
+        mThread([this] () -> void { run(); }) {}
+
+EventProviderImpl::Client::~Client() {
+    {
+        std::scoped_lock lock(mMutex);
+        mStopping = true;
+    }
+    mWakeup.notify_one();
+    mThread.join();
+}
+
+void EventProviderImpl::Client::post(const std::vector<KeypressEvent>& events) {
+    {
+        std::scoped_lock lock(mMutex);
+        if (mPending.size() >= kMaxPendingBatches) {
+            ALOGW("callback is not keeping up, dropping %zu events", mPending.front().size());
+            mPending.pop_front();
+        }
+        mPending.push_back(events);
+    }
+    mWakeup.notify_one();
+}
+
+void EventProviderImpl::Client::run() {
+    std::unique_lock lock(mMutex);
+    while (true) {
+        mWakeup.wait(lock, [this] () { return mStopping || !mPending.empty(); });
+        if (mStopping) return;
+
+        // whatever piled up while we were busy goes out in one transaction
+        std::vector<KeypressEvent> events = std::move(mPending.front());
+        mPending.pop_front();
+        while (!mPending.empty()) {
+            events.insert(events.end(), mPending.front().begin(), mPending.front().end());
+            mPending.pop_front();
+        }
+
+        lock.unlock();
+        auto status = mCallback->onEvents(events);
+        if (status.isOk()) {
+            const int64_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (const auto& event : events) {
+                mDeliveryLatency->add(now - event.timestampNs);
+            }
+        } else {
+            ALOGW("unable to deliver %zu events: %s", events.size(),
+                  status.toString8().string());
+        }
+        lock.lock();
+    }
+}
+
+EventProviderImpl::EventProviderImpl(EventGatherer&& g) :
+        mGatherer(std::move(g)), mClients(std::make_shared<ClientList>()) {}
+
+std::shared_ptr<const EventProviderImpl::ClientList> EventProviderImpl::clients() {
+    std::scoped_lock lock(mMutex);
+    return mClients;
+}
 
 std::thread EventProviderImpl::startLoop() {
     auto t = std::thread( [this] () -> void {
-        while(true) {
+        while(mGatherer.running()) {
             auto events = mGatherer.read();
-            {
-                std::scoped_lock lock(mMutex);
-                for (auto&& cb : mCallbacks) {
-                    for (const auto& event : events) {
-                        cb->onEvent(event);
-                    }
-                }
+            if (events.empty()) continue;
+
+            const int64_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            for (const auto& event : events) {
+                mReadLatency.add(now - event.timestampNs);
+            }
+
+            for (const auto& client : *clients()) {
+                client->post(events);
             }
         }
     });
     return t;
 }
 
+void EventProviderImpl::stopLoop() {
+    mGatherer.stop();
+}
+
 Status EventProviderImpl::registerCallback(const sp<IEventCallback>& cb) {
+    auto client = std::make_shared<Client>(cb, &mDeliveryLatency);
+
     std::scoped_lock lock(mMutex);
-    mCallbacks.push_back(cb);
+    auto clients = std::make_shared<ClientList>(*mClients);
+    clients->push_back(std::move(client));
+    mClients = std::move(clients);
     return Status::ok();
 }
 
 Status EventProviderImpl::unregisterCallback(const sp<IEventCallback>& cb) {
-    std::scoped_lock lock(mMutex);
-    std::remove(mCallbacks.begin(), mCallbacks.end(), cb);
+    // the same client comes back to us as a different proxy object, but the same binder
+    const sp<IBinder> binder = IInterface::asBinder(cb);
+    std::shared_ptr<const ClientList> removed;
+    {
+        std::scoped_lock lock(mMutex);
+        auto clients = std::make_shared<ClientList>(*mClients);
+        clients->erase(std::remove_if(clients->begin(), clients->end(),
+            [&binder] (const auto& client) {
+                return IInterface::asBinder(client->callback()) == binder;
+            }), clients->end());
+        removed = std::move(mClients);
+        mClients = std::move(clients);
+    }
+    // the old list (and with it the removed client, once the reader thread lets go of it) is
+    // released out here, so we don't hold the lock while its delivery thread winds down
     return Status::ok();
 }
+
+status_t EventProviderImpl::dump(int fd, const Vector<String16>&) {
+    std::string out;
+    out.append(LOG_TAG "\n");
+    out.append("callbacks: " + std::to_string(clients()->size()) + "\n");
+    mReadLatency.dump(&out);
+    mDeliveryLatency.dump(&out);
+
+    if (::write(fd, out.data(), out.size()) != static_cast<ssize_t>(out.size())) {
+        return -errno;
+    }
+    return OK;
+}
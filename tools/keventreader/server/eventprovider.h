@@ -20,6 +20,10 @@
 #include "com/android/car/keventreader/BnEventProvider.h"
 #include <binder/Binder.h>
 #include "eventgatherer.h"
+#include "latencyhistogram.h"
+#include <condition_variable>
+#include <deque>
+#include <memory>
 #include <mutex>
 #include <thread>
 #include <vector>
@@ -32,13 +36,48 @@ namespace com::android::car::keventreader {
     public:
         EventProviderImpl(EventGatherer&&);
         std::thread startLoop();
+        // has the thread returned by startLoop() finish once it's done with the current events
+        void stopLoop();
 
         virtual Status registerCallback(const sp<IEventCallback>& callback) override;
         virtual Status unregisterCallback(const sp<IEventCallback>& callback) override;
+
+        // for dumpsys: how long keys take from the kernel to us, and on to the clients
+        virtual status_t dump(int fd, const Vector<String16>& args) override;
     private:
+        // Delivers batches of events to one callback from a thread of its own, so that however
+        // slow the client is, the reader thread only ever has to queue them
+        class Client {
+        public:
+            Client(const sp<IEventCallback>& callback, LatencyHistogram* deliveryLatency);
+            ~Client();
+
+            const sp<IEventCallback>& callback() const { return mCallback; }
+            void post(const std::vector<KeypressEvent>& events);
+        private:
+            // a client that falls this far behind loses its oldest events
+            static constexpr size_t kMaxPendingBatches = 64;
+
+            void run();
+
+            sp<IEventCallback> mCallback;
+            LatencyHistogram* mDeliveryLatency;
+            std::mutex mMutex;
+            std::condition_variable mWakeup;
+            std::deque<std::vector<KeypressEvent>> mPending;
+            bool mStopping = false;
+            std::thread mThread;
+        };
+        using ClientList = std::vector<std::shared_ptr<Client>>;
+
+        std::shared_ptr<const ClientList> clients();
+
         EventGatherer mGatherer;
+        LatencyHistogram mReadLatency{"kernel to read"};
+        LatencyHistogram mDeliveryLatency{"kernel to delivery"};
+        // copy-on-write, so the reader thread only holds mMutex long enough to take a reference
         std::mutex mMutex;
-        std::vector<sp<IEventCallback>> mCallbacks;
+        std::shared_ptr<const ClientList> mClients;
     };
 }
 
@@ -18,8 +18,11 @@
 #include <utils/Log.h>
 
 #include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sstream>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 using namespace com::android::car::keventreader;
@@ -40,7 +43,112 @@ bool InputSource::kevent::isKeyup() const {
     return isKeypress() && (value == 0);
 }
 
-InputSource::InputSource(const char* file) : mFilePath(file), mDescriptor(open(file, O_RDONLY)) {}
+int64_t InputSource::kevent::timestampNs() const {
+    return static_cast<int64_t>(input_event_sec) * 1000000000LL +
+           static_cast<int64_t>(input_event_usec) * 1000LL;
+}
+
+static int64_t now(clockid_t clock) {
+    timespec ts;
+    clock_gettime(clock, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static constexpr size_t kBitsPerLong = sizeof(unsigned long) * 8;
+
+static void setBit(std::vector<unsigned long>* bitmap, unsigned bit) {
+    (*bitmap)[bit / kBitsPerLong] |= 1UL << (bit % kBitsPerLong);
+}
+
+static bool testBit(const std::vector<unsigned long>& bitmap, unsigned bit) {
+    return (bitmap[bit / kBitsPerLong] >> (bit % kBitsPerLong)) & 1UL;
+}
+
+static bool setMask(int fd, unsigned type, const std::vector<unsigned long>& codes) {
+    input_mask mask = {};
+    mask.type = type;
+    mask.codes_size = codes.size() * sizeof(unsigned long);
+    mask.codes_ptr = reinterpret_cast<uintptr_t>(codes.data());
+    return ioctl(fd, EVIOCSMASK, &mask) == 0;
+}
+
+bool InputSource::parse(const char* arg, std::string* path, Config* config) {
+    std::stringstream ss(arg);
+    if (!std::getline(ss, *path, ':') || path->empty()) {
+        return false;
+    }
+
+    *config = Config();
+    std::string option;
+    while (std::getline(ss, option, ':')) {
+        if (option == "grab") {
+            config->grab = true;
+        } else if (option.compare(0, 5, "keys=") == 0) {
+            std::stringstream codes(option.substr(5));
+            std::string code;
+            while (std::getline(codes, code, ',')) {
+                char* end = nullptr;
+                auto value = strtoul(code.c_str(), &end, 0);
+                if (code.empty() || *end != 0 || value >= KEY_CNT) {
+                    return false;
+                }
+                config->keys.push_back(static_cast<uint16_t>(value));
+            }
+            if (config->keys.empty()) {
+                return false;
+            }
+        } else {
+            return false;
+        }
+    }
+    return true;
+}
+
+InputSource::InputSource(const char* file, const Config& config) :
+        mFilePath(file), mDescriptor(open(file, O_RDONLY)) {
+    // the same clock the rest of the system measures input latency against
+    int clock = CLOCK_MONOTONIC;
+    if (mDescriptor >= 0) {
+        mMonotonic = (ioctl(mDescriptor, EVIOCSCLOCKID, &clock) == 0);
+        if (!mMonotonic) {
+            ALOGW("input source %s can't report CLOCK_MONOTONIC timestamps", file);
+        }
+        applyConfig(config);
+    }
+}
+
+void InputSource::applyConfig(const Config& config) {
+    if (!config.keys.empty()) {
+        mKeys.resize((KEY_CNT + kBitsPerLong - 1) / kBitsPerLong);
+        for (auto code : config.keys) {
+            setBit(&mKeys, code);
+        }
+    }
+
+    // have the kernel drop everything but keypresses before they get to us; it also drops the
+    // EV_SYN reports that are left empty by that, so a touchscreen only wakes us up when one of
+    // its buttons is pressed, rather than for every movement
+    std::vector<unsigned long> types((EV_CNT + kBitsPerLong - 1) / kBitsPerLong);
+    setBit(&types, EV_KEY);
+    bool masked = setMask(mDescriptor, 0, types);
+    if (masked && !mKeys.empty()) {
+        masked = setMask(mDescriptor, EV_KEY, mKeys);
+    }
+    if (!masked) {
+        // EVIOCSMASK is in Linux 4.4 and later; read() filters just the same without it
+        ALOGW("input source %s can't filter events in the kernel: errno = %d",
+              mFilePath.c_str(), errno);
+    }
+
+    if (config.grab && ioctl(mDescriptor, EVIOCGRAB, 1) != 0) {
+        // most likely because someone else has it already
+        ALOGW("unable to grab input source %s: errno = %d", mFilePath.c_str(), errno);
+    }
+}
+
+bool InputSource::isWanted(uint16_t code) const {
+    return mKeys.empty() || (code < KEY_CNT && testBit(mKeys, code));
+}
 
 InputSource::operator bool() const {
     return descriptor() >= 0;
@@ -50,22 +158,29 @@ int InputSource::descriptor() const {
     return mDescriptor;
 }
 
-std::optional<com::android::car::keventreader::KeypressEvent> InputSource::read() const {
-    kevent evt;
+const std::string& InputSource::path() const {
+    return mFilePath;
+}
 
-    auto cnt = ::read(mDescriptor, &evt, sizeof(evt));
+bool InputSource::read(std::vector<com::android::car::keventreader::KeypressEvent>* events) {
+    auto cnt = TEMP_FAILURE_RETRY(::read(mDescriptor, mBuffer.data(), sizeof(mBuffer)));
+    if (cnt <= 0) {
+        return false;
+    }
 
     // the kernel guarantees that we will always be able to read a whole number of events
-    if (cnt < static_cast<decltype(cnt)>(sizeof(evt))) {
-        return std::nullopt;
-    }
-    if (!evt.isKeypress()) {
-        return std::nullopt;
-    }
+    const size_t n = static_cast<size_t>(cnt) / sizeof(kevent);
+    const int64_t clockOffset = mMonotonic ? 0 : now(CLOCK_REALTIME) - now(CLOCK_MONOTONIC);
+    for (size_t i = 0; i < n; ++i) {
+        const kevent& evt = mBuffer[i];
+        if (!evt.isKeypress() || !isWanted(evt.code)) continue;
 
-    ALOGD("input source %s generated code %u (down = %s)",
-      mFilePath.c_str(), evt.code, evt.isKeydown() ? "true" : "false");
-    return com::android::car::keventreader::KeypressEvent(mFilePath, evt.code, evt.isKeydown());
+        ALOGV("input source %s generated code %u (down = %s)",
+          mFilePath.c_str(), evt.code, evt.isKeydown() ? "true" : "false");
+        events->emplace_back(mFilePath, evt.code, evt.isKeydown(),
+                             evt.timestampNs() - clockOffset);
+    }
+    return true;
 }
 
 InputSource::~InputSource() {
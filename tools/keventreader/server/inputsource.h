@@ -17,20 +17,36 @@
 #define CAR_KEVENTREADER_INPUTSOURCE
 
 #include <linux/input.h>
-#include <optional>
+#include <array>
 #include <string>
+#include <vector>
 #include "event.h"
 
 namespace com::android::car::keventreader {
     class InputSource {
     public:
-        explicit InputSource(const char* file);
+        // what we want from a source, given after its path as <path>[:grab][:keys=<code>,...]
+        struct Config {
+            // keep its events from everyone else, including Android's own input pipeline
+            bool grab = false;
+            // the only key codes we care about; all of them if empty
+            std::vector<uint16_t> keys;
+        };
+
+        // splits a command line argument into the path it names and the configuration for it
+        static bool parse(const char* arg, std::string* path, Config* config);
+
+        InputSource(const char* file, const Config& config);
 
         explicit operator bool() const;
 
         int descriptor() const;
 
-        std::optional<com::android::car::keventreader::KeypressEvent> read() const;
+        const std::string& path() const;
+
+        // reads whatever events are ready (up to a buffer's worth) with a single syscall, and
+        // appends the keypresses among them to events; returns false if nothing could be read
+        bool read(std::vector<com::android::car::keventreader::KeypressEvent>* events);
 
         virtual ~InputSource();
     private:
@@ -39,11 +55,24 @@ namespace com::android::car::keventreader {
             bool isKeypress() const;
             bool isKeydown() const;
             bool isKeyup() const;
+            int64_t timestampNs() const;
         };
         static_assert(sizeof(kevent) == sizeof(::input_event), "do not add data to input_event");
 
+        // enough for a burst of key repeats along with their EV_SYN/EV_MSC companions
+        static constexpr size_t kMaxEventsPerRead = 64;
+
+        void applyConfig(const Config& config);
+        bool isWanted(uint16_t code) const;
+
         std::string mFilePath;
         int mDescriptor;
+        // older kernels can't be asked for CLOCK_MONOTONIC, so their timestamps get converted
+        bool mMonotonic = false;
+        // the key codes in Config::keys, in the bitmap layout evdev uses; empty for all keys.
+        // kept around because older kernels can't be asked to filter for us
+        std::vector<unsigned long> mKeys;
+        std::array<kevent, kMaxEventsPerRead> mBuffer;
     };
 }
 
@@ -14,582 +14,602 @@
  * limitations under the License.
  */
 #include "keymap.h"
-#include <sstream>
+
+#include <linux/input.h>
+
+#include <array>
 
 using namespace com::android::car::keventreader;
 
+namespace {
+    struct KeyName {
+        int keycode;
+        const char* name;
+    };
+
+    // from linux/input-event-codes.h; where a code has more than one name, the first one wins
+    constexpr KeyName kKeyNames[] = {
+        { 0, "RESERVED" },
+        { 1, "ESC" },
+        { 2, "1" },
+        { 3, "2" },
+        { 4, "3" },
+        { 5, "4" },
+        { 6, "5" },
+        { 7, "6" },
+        { 8, "7" },
+        { 9, "8" },
+        { 10, "9" },
+        { 11, "0" },
+        { 12, "MINUS" },
+        { 13, "EQUAL" },
+        { 14, "BACKSPACE" },
+        { 15, "TAB" },
+        { 16, "Q" },
+        { 17, "W" },
+        { 18, "E" },
+        { 19, "R" },
+        { 20, "T" },
+        { 21, "Y" },
+        { 22, "U" },
+        { 23, "I" },
+        { 24, "O" },
+        { 25, "P" },
+        { 26, "LEFTBRACE" },
+        { 27, "RIGHTBRACE" },
+        { 28, "ENTER" },
+        { 29, "LEFTCTRL" },
+        { 30, "A" },
+        { 31, "S" },
+        { 32, "D" },
+        { 33, "F" },
+        { 34, "G" },
+        { 35, "H" },
+        { 36, "J" },
+        { 37, "K" },
+        { 38, "L" },
+        { 39, "SEMICOLON" },
+        { 40, "APOSTROPHE" },
+        { 41, "GRAVE" },
+        { 42, "LEFTSHIFT" },
+        { 43, "BACKSLASH" },
+        { 44, "Z" },
+        { 45, "X" },
+        { 46, "C" },
+        { 47, "V" },
+        { 48, "B" },
+        { 49, "N" },
+        { 50, "M" },
+        { 51, "COMMA" },
+        { 52, "DOT" },
+        { 53, "SLASH" },
+        { 54, "RIGHTSHIFT" },
+        { 55, "KPASTERISK" },
+        { 56, "LEFTALT" },
+        { 57, "SPACE" },
+        { 58, "CAPSLOCK" },
+        { 59, "F1" },
+        { 60, "F2" },
+        { 61, "F3" },
+        { 62, "F4" },
+        { 63, "F5" },
+        { 64, "F6" },
+        { 65, "F7" },
+        { 66, "F8" },
+        { 67, "F9" },
+        { 68, "F10" },
+        { 69, "NUMLOCK" },
+        { 70, "SCROLLLOCK" },
+        { 71, "KP7" },
+        { 72, "KP8" },
+        { 73, "KP9" },
+        { 74, "KPMINUS" },
+        { 75, "KP4" },
+        { 76, "KP5" },
+        { 77, "KP6" },
+        { 78, "KPPLUS" },
+        { 79, "KP1" },
+        { 80, "KP2" },
+        { 81, "KP3" },
+        { 82, "KP0" },
+        { 83, "KPDOT" },
+        { 85, "ZENKAKUHANKAKU" },
+        { 86, "102ND" },
+        { 87, "F11" },
+        { 88, "F12" },
+        { 89, "RO" },
+        { 90, "KATAKANA" },
+        { 91, "HIRAGANA" },
+        { 92, "HENKAN" },
+        { 93, "KATAKANAHIRAGANA" },
+        { 94, "MUHENKAN" },
+        { 95, "KPJPCOMMA" },
+        { 96, "KPENTER" },
+        { 97, "RIGHTCTRL" },
+        { 98, "KPSLASH" },
+        { 99, "SYSRQ" },
+        { 100, "RIGHTALT" },
+        { 101, "LINEFEED" },
+        { 102, "HOME" },
+        { 103, "UP" },
+        { 104, "PAGEUP" },
+        { 105, "LEFT" },
+        { 106, "RIGHT" },
+        { 107, "END" },
+        { 108, "DOWN" },
+        { 109, "PAGEDOWN" },
+        { 110, "INSERT" },
+        { 111, "DELETE" },
+        { 112, "MACRO" },
+        { 113, "MUTE" },
+        { 114, "VOLUMEDOWN" },
+        { 115, "VOLUMEUP" },
+        { 116, "POWER" },
+        { 117, "KPEQUAL" },
+        { 118, "KPPLUSMINUS" },
+        { 119, "PAUSE" },
+        { 120, "SCALE" },
+        { 121, "KPCOMMA" },
+        { 122, "HANGEUL" },
+        { 123, "HANJA" },
+        { 124, "YEN" },
+        { 125, "LEFTMETA" },
+        { 126, "RIGHTMETA" },
+        { 127, "COMPOSE" },
+        { 128, "STOP" },
+        { 129, "AGAIN" },
+        { 130, "PROPS" },
+        { 131, "UNDO" },
+        { 132, "FRONT" },
+        { 133, "COPY" },
+        { 134, "OPEN" },
+        { 135, "PASTE" },
+        { 136, "FIND" },
+        { 137, "CUT" },
+        { 138, "HELP" },
+        { 139, "MENU" },
+        { 140, "CALC" },
+        { 141, "SETUP" },
+        { 142, "SLEEP" },
+        { 143, "WAKEUP" },
+        { 144, "FILE" },
+        { 145, "SENDFILE" },
+        { 146, "DELETEFILE" },
+        { 147, "XFER" },
+        { 148, "PROG1" },
+        { 149, "PROG2" },
+        { 150, "WWW" },
+        { 151, "MSDOS" },
+        { 152, "SCREENLOCK" },
+        { 153, "ROTATE_DISPLAY" },
+        { 154, "CYCLEWINDOWS" },
+        { 155, "MAIL" },
+        { 156, "BOOKMARKS" },
+        { 157, "COMPUTER" },
+        { 158, "BACK" },
+        { 159, "FORWARD" },
+        { 160, "CLOSECD" },
+        { 161, "EJECTCD" },
+        { 162, "EJECTCLOSECD" },
+        { 163, "NEXTSONG" },
+        { 164, "PLAYPAUSE" },
+        { 165, "PREVIOUSSONG" },
+        { 166, "STOPCD" },
+        { 167, "RECORD" },
+        { 168, "REWIND" },
+        { 169, "PHONE" },
+        { 170, "ISO" },
+        { 171, "CONFIG" },
+        { 172, "HOMEPAGE" },
+        { 173, "REFRESH" },
+        { 174, "EXIT" },
+        { 175, "MOVE" },
+        { 176, "EDIT" },
+        { 177, "SCROLLUP" },
+        { 178, "SCROLLDOWN" },
+        { 179, "KPLEFTPAREN" },
+        { 180, "KPRIGHTPAREN" },
+        { 181, "NEW" },
+        { 182, "REDO" },
+        { 183, "F13" },
+        { 184, "F14" },
+        { 185, "F15" },
+        { 186, "F16" },
+        { 187, "F17" },
+        { 188, "F18" },
+        { 189, "F19" },
+        { 190, "F20" },
+        { 191, "F21" },
+        { 192, "F22" },
+        { 193, "F23" },
+        { 194, "F24" },
+        { 200, "PLAYCD" },
+        { 201, "PAUSECD" },
+        { 202, "PROG3" },
+        { 203, "PROG4" },
+        { 204, "DASHBOARD" },
+        { 205, "SUSPEND" },
+        { 206, "CLOSE" },
+        { 207, "PLAY" },
+        { 208, "FASTFORWARD" },
+        { 209, "BASSBOOST" },
+        { 210, "PRINT" },
+        { 211, "HP" },
+        { 212, "CAMERA" },
+        { 213, "SOUND" },
+        { 214, "QUESTION" },
+        { 215, "EMAIL" },
+        { 216, "CHAT" },
+        { 217, "SEARCH" },
+        { 218, "CONNECT" },
+        { 219, "FINANCE" },
+        { 220, "SPORT" },
+        { 221, "SHOP" },
+        { 222, "ALTERASE" },
+        { 223, "CANCEL" },
+        { 224, "BRIGHTNESSDOWN" },
+        { 225, "BRIGHTNESSUP" },
+        { 226, "MEDIA" },
+        { 227, "SWITCHVIDEOMODE" },
+        { 228, "KBDILLUMTOGGLE" },
+        { 229, "KBDILLUMDOWN" },
+        { 230, "KBDILLUMUP" },
+        { 231, "SEND" },
+        { 232, "REPLY" },
+        { 233, "FORWARDMAIL" },
+        { 234, "SAVE" },
+        { 235, "DOCUMENTS" },
+        { 236, "BATTERY" },
+        { 237, "BLUETOOTH" },
+        { 238, "WLAN" },
+        { 239, "UWB" },
+        { 240, "UNKNOWN" },
+        { 241, "VIDEO_NEXT" },
+        { 242, "VIDEO_PREV" },
+        { 243, "BRIGHTNESS_CYCLE" },
+        { 244, "BRIGHTNESS_AUTO" },
+        { 245, "DISPLAY_OFF" },
+        { 246, "WWAN" },
+        { 247, "RFKILL" },
+        { 248, "MICMUTE" },
+        { 0x160, "OK" },
+        { 0x161, "SELECT" },
+        { 0x162, "GOTO" },
+        { 0x163, "CLEAR" },
+        { 0x164, "POWER2" },
+        { 0x165, "OPTION" },
+        { 0x166, "INFO" },
+        { 0x167, "TIME" },
+        { 0x168, "VENDOR" },
+        { 0x169, "ARCHIVE" },
+        { 0x16a, "PROGRAM" },
+        { 0x16b, "CHANNEL" },
+        { 0x16c, "FAVORITES" },
+        { 0x16d, "EPG" },
+        { 0x16e, "PVR" },
+        { 0x16f, "MHP" },
+        { 0x170, "LANGUAGE" },
+        { 0x171, "TITLE" },
+        { 0x172, "SUBTITLE" },
+        { 0x173, "ANGLE" },
+        { 0x174, "ZOOM" },
+        { 0x175, "MODE" },
+        { 0x176, "KEYBOARD" },
+        { 0x177, "SCREEN" },
+        { 0x178, "PC" },
+        { 0x179, "TV" },
+        { 0x17a, "TV2" },
+        { 0x17b, "VCR" },
+        { 0x17c, "VCR2" },
+        { 0x17d, "SAT" },
+        { 0x17e, "SAT2" },
+        { 0x17f, "CD" },
+        { 0x180, "TAPE" },
+        { 0x181, "RADIO" },
+        { 0x182, "TUNER" },
+        { 0x183, "PLAYER" },
+        { 0x184, "TEXT" },
+        { 0x185, "DVD" },
+        { 0x186, "AUX" },
+        { 0x187, "MP3" },
+        { 0x188, "AUDIO" },
+        { 0x189, "VIDEO" },
+        { 0x18a, "DIRECTORY" },
+        { 0x18b, "LIST" },
+        { 0x18c, "MEMO" },
+        { 0x18d, "CALENDAR" },
+        { 0x18e, "RED" },
+        { 0x18f, "GREEN" },
+        { 0x190, "YELLOW" },
+        { 0x191, "BLUE" },
+        { 0x192, "CHANNELUP" },
+        { 0x193, "CHANNELDOWN" },
+        { 0x194, "FIRST" },
+        { 0x195, "LAST" },
+        { 0x196, "AB" },
+        { 0x197, "NEXT" },
+        { 0x198, "RESTART" },
+        { 0x199, "SLOW" },
+        { 0x19a, "SHUFFLE" },
+        { 0x19b, "BREAK" },
+        { 0x19c, "PREVIOUS" },
+        { 0x19d, "DIGITS" },
+        { 0x19e, "TEEN" },
+        { 0x19f, "TWEN" },
+        { 0x1a0, "VIDEOPHONE" },
+        { 0x1a1, "GAMES" },
+        { 0x1a2, "ZOOMIN" },
+        { 0x1a3, "ZOOMOUT" },
+        { 0x1a4, "ZOOMRESET" },
+        { 0x1a5, "WORDPROCESSOR" },
+        { 0x1a6, "EDITOR" },
+        { 0x1a7, "SPREADSHEET" },
+        { 0x1a8, "GRAPHICSEDITOR" },
+        { 0x1a9, "PRESENTATION" },
+        { 0x1aa, "DATABASE" },
+        { 0x1ab, "NEWS" },
+        { 0x1ac, "VOICEMAIL" },
+        { 0x1ad, "ADDRESSBOOK" },
+        { 0x1ae, "MESSENGER" },
+        { 0x1af, "DISPLAYTOGGLE" },
+        { 0x1b0, "SPELLCHECK" },
+        { 0x1b1, "LOGOFF" },
+        { 0x1b2, "DOLLAR" },
+        { 0x1b3, "EURO" },
+        { 0x1b4, "FRAMEBACK" },
+        { 0x1b5, "FRAMEFORWARD" },
+        { 0x1b6, "CONTEXT_MENU" },
+        { 0x1b7, "MEDIA_REPEAT" },
+        { 0x1b8, "10CHANNELSUP" },
+        { 0x1b9, "10CHANNELSDOWN" },
+        { 0x1ba, "IMAGES" },
+        { 0x1c0, "DEL_EOL" },
+        { 0x1c1, "DEL_EOS" },
+        { 0x1c2, "INS_LINE" },
+        { 0x1c3, "DEL_LINE" },
+        { 0x1d0, "FN" },
+        { 0x1d1, "FN_ESC" },
+        { 0x1d2, "FN_F1" },
+        { 0x1d3, "FN_F2" },
+        { 0x1d4, "FN_F3" },
+        { 0x1d5, "FN_F4" },
+        { 0x1d6, "FN_F5" },
+        { 0x1d7, "FN_F6" },
+        { 0x1d8, "FN_F7" },
+        { 0x1d9, "FN_F8" },
+        { 0x1da, "FN_F9" },
+        { 0x1db, "FN_F10" },
+        { 0x1dc, "FN_F11" },
+        { 0x1dd, "FN_F12" },
+        { 0x1de, "FN_1" },
+        { 0x1df, "FN_2" },
+        { 0x1e0, "FN_D" },
+        { 0x1e1, "FN_E" },
+        { 0x1e2, "FN_F" },
+        { 0x1e3, "FN_S" },
+        { 0x1e4, "FN_B" },
+        { 0x1f1, "BRL_DOT1" },
+        { 0x1f2, "BRL_DOT2" },
+        { 0x1f3, "BRL_DOT3" },
+        { 0x1f4, "BRL_DOT4" },
+        { 0x1f5, "BRL_DOT5" },
+        { 0x1f6, "BRL_DOT6" },
+        { 0x1f7, "BRL_DOT7" },
+        { 0x1f8, "BRL_DOT8" },
+        { 0x1f9, "BRL_DOT9" },
+        { 0x1fa, "BRL_DOT10" },
+        { 0x200, "NUMERIC_0" },
+        { 0x201, "NUMERIC_1" },
+        { 0x202, "NUMERIC_2" },
+        { 0x203, "NUMERIC_3" },
+        { 0x204, "NUMERIC_4" },
+        { 0x205, "NUMERIC_5" },
+        { 0x206, "NUMERIC_6" },
+        { 0x207, "NUMERIC_7" },
+        { 0x208, "NUMERIC_8" },
+        { 0x209, "NUMERIC_9" },
+        { 0x20a, "NUMERIC_STAR" },
+        { 0x20b, "NUMERIC_POUND" },
+        { 0x20c, "NUMERIC_A" },
+        { 0x20d, "NUMERIC_B" },
+        { 0x20e, "NUMERIC_C" },
+        { 0x20f, "NUMERIC_D" },
+        { 0x210, "CAMERA_FOCUS" },
+        { 0x211, "WPS_BUTTON" },
+        { 0x212, "TOUCHPAD_TOGGLE" },
+        { 0x213, "TOUCHPAD_ON" },
+        { 0x214, "TOUCHPAD_OFF" },
+        { 0x215, "CAMERA_ZOOMIN" },
+        { 0x216, "CAMERA_ZOOMOUT" },
+        { 0x217, "CAMERA_UP" },
+        { 0x218, "CAMERA_DOWN" },
+        { 0x219, "CAMERA_LEFT" },
+        { 0x21a, "CAMERA_RIGHT" },
+        { 0x21b, "ATTENDANT_ON" },
+        { 0x21c, "ATTENDANT_OFF" },
+        { 0x21d, "ATTENDANT_TOGGLE" },
+        { 0x21e, "LIGHTS_TOGGLE" },
+        { 0x230, "ALS_TOGGLE" },
+        { 0x240, "BUTTONCONFIG" },
+        { 0x241, "TASKMANAGER" },
+        { 0x242, "JOURNAL" },
+        { 0x243, "CONTROLPANEL" },
+        { 0x244, "APPSELECT" },
+        { 0x245, "SCREENSAVER" },
+        { 0x246, "VOICECOMMAND" },
+        { 0x247, "ASSISTANT" },
+        { 0x250, "BRIGHTNESS_MIN" },
+        { 0x251, "BRIGHTNESS_MAX" },
+        { 0x260, "KBDINPUTASSIST_PREV" },
+        { 0x261, "KBDINPUTASSIST_NEXT" },
+        { 0x262, "KBDINPUTASSIST_PREVGROUP" },
+        { 0x263, "KBDINPUTASSIST_NEXTGROUP" },
+        { 0x264, "KBDINPUTASSIST_ACCEPT" },
+        { 0x265, "KBDINPUTASSIST_CANCEL" },
+        { 0x266, "RIGHT_UP" },
+        { 0x267, "RIGHT_DOWN" },
+        { 0x268, "LEFT_UP" },
+        { 0x269, "LEFT_DOWN" },
+        { 0x26a, "ROOT_MENU" },
+        { 0x26b, "MEDIA_TOP_MENU" },
+        { 0x26c, "NUMERIC_11" },
+        { 0x26d, "NUMERIC_12" },
+        { 0x26e, "AUDIO_DESC" },
+        { 0x26f, "3D_MODE" },
+        { 0x270, "NEXT_FAVORITE" },
+        { 0x271, "STOP_RECORD" },
+        { 0x272, "PAUSE_RECORD" },
+        { 0x273, "VOD" },
+        { 0x274, "UNMUTE" },
+        { 0x275, "FASTREVERSE" },
+        { 0x276, "SLOWREVERSE" },
+        { 0x277, "DATA" },
+        { 0x278, "ONSCREEN_KEYBOARD" },
+        { 113, "MIN_INTERESTING" },
+        { 0x2ff, "MAX" },
+        { 0x100, "MISC" },
+        { 0x100, "0" },
+        { 0x101, "1" },
+        { 0x102, "2" },
+        { 0x103, "3" },
+        { 0x104, "4" },
+        { 0x105, "5" },
+        { 0x106, "6" },
+        { 0x107, "7" },
+        { 0x108, "8" },
+        { 0x109, "9" },
+        { 0x110, "MOUSE" },
+        { 0x110, "LEFT" },
+        { 0x111, "RIGHT" },
+        { 0x112, "MIDDLE" },
+        { 0x113, "SIDE" },
+        { 0x114, "EXTRA" },
+        { 0x115, "FORWARD" },
+        { 0x116, "BACK" },
+        { 0x117, "TASK" },
+        { 0x120, "JOYSTICK" },
+        { 0x120, "TRIGGER" },
+        { 0x121, "THUMB" },
+        { 0x122, "THUMB2" },
+        { 0x123, "TOP" },
+        { 0x124, "TOP2" },
+        { 0x125, "PINKIE" },
+        { 0x126, "BASE" },
+        { 0x127, "BASE2" },
+        { 0x128, "BASE3" },
+        { 0x129, "BASE4" },
+        { 0x12a, "BASE5" },
+        { 0x12b, "BASE6" },
+        { 0x12f, "DEAD" },
+        { 0x130, "GAMEPAD" },
+        { 0x130, "SOUTH" },
+        { 0x131, "EAST" },
+        { 0x132, "C" },
+        { 0x133, "NORTH" },
+        { 0x134, "WEST" },
+        { 0x135, "Z" },
+        { 0x136, "TL" },
+        { 0x137, "TR" },
+        { 0x138, "TL2" },
+        { 0x139, "TR2" },
+        { 0x13a, "SELECT" },
+        { 0x13b, "START" },
+        { 0x13c, "MODE" },
+        { 0x13d, "THUMBL" },
+        { 0x13e, "THUMBR" },
+        { 0x140, "DIGI" },
+        { 0x140, "TOOL_PEN" },
+        { 0x141, "TOOL_RUBBER" },
+        { 0x142, "TOOL_BRUSH" },
+        { 0x143, "TOOL_PENCIL" },
+        { 0x144, "TOOL_AIRBRUSH" },
+        { 0x145, "TOOL_FINGER" },
+        { 0x146, "TOOL_MOUSE" },
+        { 0x147, "TOOL_LENS" },
+        { 0x148, "TOOL_QUINTTAP" },
+        { 0x149, "STYLUS3" },
+        { 0x14a, "TOUCH" },
+        { 0x14b, "STYLUS" },
+        { 0x14c, "STYLUS2" },
+        { 0x14d, "TOOL_DOUBLETAP" },
+        { 0x14e, "TOOL_TRIPLETAP" },
+        { 0x14f, "TOOL_QUADTAP" },
+        { 0x150, "WHEEL" },
+        { 0x150, "GEAR_DOWN" },
+        { 0x151, "GEAR_UP" },
+        { 0x220, "DPAD_UP" },
+        { 0x221, "DPAD_DOWN" },
+        { 0x222, "DPAD_LEFT" },
+        { 0x223, "DPAD_RIGHT" },
+        { 0x2c0, "TRIGGER_HAPPY" },
+        { 0x2c0, "TRIGGER_HAPPY1" },
+        { 0x2c1, "TRIGGER_HAPPY2" },
+        { 0x2c2, "TRIGGER_HAPPY3" },
+        { 0x2c3, "TRIGGER_HAPPY4" },
+        { 0x2c4, "TRIGGER_HAPPY5" },
+        { 0x2c5, "TRIGGER_HAPPY6" },
+        { 0x2c6, "TRIGGER_HAPPY7" },
+        { 0x2c7, "TRIGGER_HAPPY8" },
+        { 0x2c8, "TRIGGER_HAPPY9" },
+        { 0x2c9, "TRIGGER_HAPPY10" },
+        { 0x2ca, "TRIGGER_HAPPY11" },
+        { 0x2cb, "TRIGGER_HAPPY12" },
+        { 0x2cc, "TRIGGER_HAPPY13" },
+        { 0x2cd, "TRIGGER_HAPPY14" },
+        { 0x2ce, "TRIGGER_HAPPY15" },
+        { 0x2cf, "TRIGGER_HAPPY16" },
+        { 0x2d0, "TRIGGER_HAPPY17" },
+        { 0x2d1, "TRIGGER_HAPPY18" },
+        { 0x2d2, "TRIGGER_HAPPY19" },
+        { 0x2d3, "TRIGGER_HAPPY20" },
+        { 0x2d4, "TRIGGER_HAPPY21" },
+        { 0x2d5, "TRIGGER_HAPPY22" },
+        { 0x2d6, "TRIGGER_HAPPY23" },
+        { 0x2d7, "TRIGGER_HAPPY24" },
+        { 0x2d8, "TRIGGER_HAPPY25" },
+        { 0x2d9, "TRIGGER_HAPPY26" },
+        { 0x2da, "TRIGGER_HAPPY27" },
+        { 0x2db, "TRIGGER_HAPPY28" },
+        { 0x2dc, "TRIGGER_HAPPY29" },
+        { 0x2dd, "TRIGGER_HAPPY30" },
+        { 0x2de, "TRIGGER_HAPPY31" },
+        { 0x2df, "TRIGGER_HAPPY32" },
+        { 0x2e0, "TRIGGER_HAPPY33" },
+        { 0x2e1, "TRIGGER_HAPPY34" },
+        { 0x2e2, "TRIGGER_HAPPY35" },
+        { 0x2e3, "TRIGGER_HAPPY36" },
+        { 0x2e4, "TRIGGER_HAPPY37" },
+        { 0x2e5, "TRIGGER_HAPPY38" },
+        { 0x2e6, "TRIGGER_HAPPY39" },
+        { 0x2e7, "TRIGGER_HAPPY40" },
+    };
+
+    // indexed directly by keycode, and filled in at compile time so there is no startup cost
+    using KeyTable = std::array<const char*, KEY_CNT>;
+
+    constexpr KeyTable makeKeyTable() {
+        KeyTable table{};
+        for (const auto& key : kKeyNames) {
+            if (table[key.keycode] == nullptr) {
+                table[key.keycode] = key.name;
+            }
+        }
+        return table;
+    }
+
+    constexpr KeyTable kKeyTable = makeKeyTable();
+}
+
 Keymap& Keymap::get() {
     static Keymap gKeymap;
 
     return gKeymap;
 }
 
-Keymap::Keymap() {
-    fillMap();
-}
-
-std::string_view Keymap::getDisplayName(int keycode) {
-    auto iter = mKeyMap.find(keycode), end = mKeyMap.end();
-    if (iter == end) {
-        std::stringstream ss;
-        ss << "unknown " << keycode;
-        return ss.str();
+std::string_view Keymap::getDisplayName(int keycode) const {
+    if (keycode < 0 || keycode >= static_cast<int>(kKeyTable.size()) ||
+        kKeyTable[keycode] == nullptr) {
+        return "unknown";
     }
-    return iter->second;
-}
-
-void Keymap::fillMap() {
-    mKeyMap.emplace(0,"RESERVED");
-    mKeyMap.emplace(1,"ESC");
-    mKeyMap.emplace(2,"1");
-    mKeyMap.emplace(3,"2");
-    mKeyMap.emplace(4,"3");
-    mKeyMap.emplace(5,"4");
-    mKeyMap.emplace(6,"5");
-    mKeyMap.emplace(7,"6");
-    mKeyMap.emplace(8,"7");
-    mKeyMap.emplace(9,"8");
-    mKeyMap.emplace(10,"9");
-    mKeyMap.emplace(11,"0");
-    mKeyMap.emplace(12,"MINUS");
-    mKeyMap.emplace(13,"EQUAL");
-    mKeyMap.emplace(14,"BACKSPACE");
-    mKeyMap.emplace(15,"TAB");
-    mKeyMap.emplace(16,"Q");
-    mKeyMap.emplace(17,"W");
-    mKeyMap.emplace(18,"E");
-    mKeyMap.emplace(19,"R");
-    mKeyMap.emplace(20,"T");
-    mKeyMap.emplace(21,"Y");
-    mKeyMap.emplace(22,"U");
-    mKeyMap.emplace(23,"I");
-    mKeyMap.emplace(24,"O");
-    mKeyMap.emplace(25,"P");
-    mKeyMap.emplace(26,"LEFTBRACE");
-    mKeyMap.emplace(27,"RIGHTBRACE");
-    mKeyMap.emplace(28,"ENTER");
-    mKeyMap.emplace(29,"LEFTCTRL");
-    mKeyMap.emplace(30,"A");
-    mKeyMap.emplace(31,"S");
-    mKeyMap.emplace(32,"D");
-    mKeyMap.emplace(33,"F");
-    mKeyMap.emplace(34,"G");
-    mKeyMap.emplace(35,"H");
-    mKeyMap.emplace(36,"J");
-    mKeyMap.emplace(37,"K");
-    mKeyMap.emplace(38,"L");
-    mKeyMap.emplace(39,"SEMICOLON");
-    mKeyMap.emplace(40,"APOSTROPHE");
-    mKeyMap.emplace(41,"GRAVE");
-    mKeyMap.emplace(42,"LEFTSHIFT");
-    mKeyMap.emplace(43,"BACKSLASH");
-    mKeyMap.emplace(44,"Z");
-    mKeyMap.emplace(45,"X");
-    mKeyMap.emplace(46,"C");
-    mKeyMap.emplace(47,"V");
-    mKeyMap.emplace(48,"B");
-    mKeyMap.emplace(49,"N");
-    mKeyMap.emplace(50,"M");
-    mKeyMap.emplace(51,"COMMA");
-    mKeyMap.emplace(52,"DOT");
-    mKeyMap.emplace(53,"SLASH");
-    mKeyMap.emplace(54,"RIGHTSHIFT");
-    mKeyMap.emplace(55,"KPASTERISK");
-    mKeyMap.emplace(56,"LEFTALT");
-    mKeyMap.emplace(57,"SPACE");
-    mKeyMap.emplace(58,"CAPSLOCK");
-    mKeyMap.emplace(59,"F1");
-    mKeyMap.emplace(60,"F2");
-    mKeyMap.emplace(61,"F3");
-    mKeyMap.emplace(62,"F4");
-    mKeyMap.emplace(63,"F5");
-    mKeyMap.emplace(64,"F6");
-    mKeyMap.emplace(65,"F7");
-    mKeyMap.emplace(66,"F8");
-    mKeyMap.emplace(67,"F9");
-    mKeyMap.emplace(68,"F10");
-    mKeyMap.emplace(69,"NUMLOCK");
-    mKeyMap.emplace(70,"SCROLLLOCK");
-    mKeyMap.emplace(71,"KP7");
-    mKeyMap.emplace(72,"KP8");
-    mKeyMap.emplace(73,"KP9");
-    mKeyMap.emplace(74,"KPMINUS");
-    mKeyMap.emplace(75,"KP4");
-    mKeyMap.emplace(76,"KP5");
-    mKeyMap.emplace(77,"KP6");
-    mKeyMap.emplace(78,"KPPLUS");
-    mKeyMap.emplace(79,"KP1");
-    mKeyMap.emplace(80,"KP2");
-    mKeyMap.emplace(81,"KP3");
-    mKeyMap.emplace(82,"KP0");
-    mKeyMap.emplace(83,"KPDOT");
-    mKeyMap.emplace(85,"ZENKAKUHANKAKU");
-    mKeyMap.emplace(86,"102ND");
-    mKeyMap.emplace(87,"F11");
-    mKeyMap.emplace(88,"F12");
-    mKeyMap.emplace(89,"RO");
-    mKeyMap.emplace(90,"KATAKANA");
-    mKeyMap.emplace(91,"HIRAGANA");
-    mKeyMap.emplace(92,"HENKAN");
-    mKeyMap.emplace(93,"KATAKANAHIRAGANA");
-    mKeyMap.emplace(94,"MUHENKAN");
-    mKeyMap.emplace(95,"KPJPCOMMA");
-    mKeyMap.emplace(96,"KPENTER");
-    mKeyMap.emplace(97,"RIGHTCTRL");
-    mKeyMap.emplace(98,"KPSLASH");
-    mKeyMap.emplace(99,"SYSRQ");
-    mKeyMap.emplace(100,"RIGHTALT");
-    mKeyMap.emplace(101,"LINEFEED");
-    mKeyMap.emplace(102,"HOME");
-    mKeyMap.emplace(103,"UP");
-    mKeyMap.emplace(104,"PAGEUP");
-    mKeyMap.emplace(105,"LEFT");
-    mKeyMap.emplace(106,"RIGHT");
-    mKeyMap.emplace(107,"END");
-    mKeyMap.emplace(108,"DOWN");
-    mKeyMap.emplace(109,"PAGEDOWN");
-    mKeyMap.emplace(110,"INSERT");
-    mKeyMap.emplace(111,"DELETE");
-    mKeyMap.emplace(112,"MACRO");
-    mKeyMap.emplace(113,"MUTE");
-    mKeyMap.emplace(114,"VOLUMEDOWN");
-    mKeyMap.emplace(115,"VOLUMEUP");
-    mKeyMap.emplace(116,"POWER");
-    mKeyMap.emplace(117,"KPEQUAL");
-    mKeyMap.emplace(118,"KPPLUSMINUS");
-    mKeyMap.emplace(119,"PAUSE");
-    mKeyMap.emplace(120,"SCALE");
-    mKeyMap.emplace(121,"KPCOMMA");
-    mKeyMap.emplace(122,"HANGEUL");
-    mKeyMap.emplace(123,"HANJA");
-    mKeyMap.emplace(124,"YEN");
-    mKeyMap.emplace(125,"LEFTMETA");
-    mKeyMap.emplace(126,"RIGHTMETA");
-    mKeyMap.emplace(127,"COMPOSE");
-    mKeyMap.emplace(128,"STOP");
-    mKeyMap.emplace(129,"AGAIN");
-    mKeyMap.emplace(130,"PROPS");
-    mKeyMap.emplace(131,"UNDO");
-    mKeyMap.emplace(132,"FRONT");
-    mKeyMap.emplace(133,"COPY");
-    mKeyMap.emplace(134,"OPEN");
-    mKeyMap.emplace(135,"PASTE");
-    mKeyMap.emplace(136,"FIND");
-    mKeyMap.emplace(137,"CUT");
-    mKeyMap.emplace(138,"HELP");
-    mKeyMap.emplace(139,"MENU");
-    mKeyMap.emplace(140,"CALC");
-    mKeyMap.emplace(141,"SETUP");
-    mKeyMap.emplace(142,"SLEEP");
-    mKeyMap.emplace(143,"WAKEUP");
-    mKeyMap.emplace(144,"FILE");
-    mKeyMap.emplace(145,"SENDFILE");
-    mKeyMap.emplace(146,"DELETEFILE");
-    mKeyMap.emplace(147,"XFER");
-    mKeyMap.emplace(148,"PROG1");
-    mKeyMap.emplace(149,"PROG2");
-    mKeyMap.emplace(150,"WWW");
-    mKeyMap.emplace(151,"MSDOS");
-    mKeyMap.emplace(152,"SCREENLOCK");
-    mKeyMap.emplace(153,"ROTATE_DISPLAY");
-    mKeyMap.emplace(154,"CYCLEWINDOWS");
-    mKeyMap.emplace(155,"MAIL");
-    mKeyMap.emplace(156,"BOOKMARKS");
-    mKeyMap.emplace(157,"COMPUTER");
-    mKeyMap.emplace(158,"BACK");
-    mKeyMap.emplace(159,"FORWARD");
-    mKeyMap.emplace(160,"CLOSECD");
-    mKeyMap.emplace(161,"EJECTCD");
-    mKeyMap.emplace(162,"EJECTCLOSECD");
-    mKeyMap.emplace(163,"NEXTSONG");
-    mKeyMap.emplace(164,"PLAYPAUSE");
-    mKeyMap.emplace(165,"PREVIOUSSONG");
-    mKeyMap.emplace(166,"STOPCD");
-    mKeyMap.emplace(167,"RECORD");
-    mKeyMap.emplace(168,"REWIND");
-    mKeyMap.emplace(169,"PHONE");
-    mKeyMap.emplace(170,"ISO");
-    mKeyMap.emplace(171,"CONFIG");
-    mKeyMap.emplace(172,"HOMEPAGE");
-    mKeyMap.emplace(173,"REFRESH");
-    mKeyMap.emplace(174,"EXIT");
-    mKeyMap.emplace(175,"MOVE");
-    mKeyMap.emplace(176,"EDIT");
-    mKeyMap.emplace(177,"SCROLLUP");
-    mKeyMap.emplace(178,"SCROLLDOWN");
-    mKeyMap.emplace(179,"KPLEFTPAREN");
-    mKeyMap.emplace(180,"KPRIGHTPAREN");
-    mKeyMap.emplace(181,"NEW");
-    mKeyMap.emplace(182,"REDO");
-    mKeyMap.emplace(183,"F13");
-    mKeyMap.emplace(184,"F14");
-    mKeyMap.emplace(185,"F15");
-    mKeyMap.emplace(186,"F16");
-    mKeyMap.emplace(187,"F17");
-    mKeyMap.emplace(188,"F18");
-    mKeyMap.emplace(189,"F19");
-    mKeyMap.emplace(190,"F20");
-    mKeyMap.emplace(191,"F21");
-    mKeyMap.emplace(192,"F22");
-    mKeyMap.emplace(193,"F23");
-    mKeyMap.emplace(194,"F24");
-    mKeyMap.emplace(200,"PLAYCD");
-    mKeyMap.emplace(201,"PAUSECD");
-    mKeyMap.emplace(202,"PROG3");
-    mKeyMap.emplace(203,"PROG4");
-    mKeyMap.emplace(204,"DASHBOARD");
-    mKeyMap.emplace(205,"SUSPEND");
-    mKeyMap.emplace(206,"CLOSE");
-    mKeyMap.emplace(207,"PLAY");
-    mKeyMap.emplace(208,"FASTFORWARD");
-    mKeyMap.emplace(209,"BASSBOOST");
-    mKeyMap.emplace(210,"PRINT");
-    mKeyMap.emplace(211,"HP");
-    mKeyMap.emplace(212,"CAMERA");
-    mKeyMap.emplace(213,"SOUND");
-    mKeyMap.emplace(214,"QUESTION");
-    mKeyMap.emplace(215,"EMAIL");
-    mKeyMap.emplace(216,"CHAT");
-    mKeyMap.emplace(217,"SEARCH");
-    mKeyMap.emplace(218,"CONNECT");
-    mKeyMap.emplace(219,"FINANCE");
-    mKeyMap.emplace(220,"SPORT");
-    mKeyMap.emplace(221,"SHOP");
-    mKeyMap.emplace(222,"ALTERASE");
-    mKeyMap.emplace(223,"CANCEL");
-    mKeyMap.emplace(224,"BRIGHTNESSDOWN");
-    mKeyMap.emplace(225,"BRIGHTNESSUP");
-    mKeyMap.emplace(226,"MEDIA");
-    mKeyMap.emplace(227,"SWITCHVIDEOMODE");
-    mKeyMap.emplace(228,"KBDILLUMTOGGLE");
-    mKeyMap.emplace(229,"KBDILLUMDOWN");
-    mKeyMap.emplace(230,"KBDILLUMUP");
-    mKeyMap.emplace(231,"SEND");
-    mKeyMap.emplace(232,"REPLY");
-    mKeyMap.emplace(233,"FORWARDMAIL");
-    mKeyMap.emplace(234,"SAVE");
-    mKeyMap.emplace(235,"DOCUMENTS");
-    mKeyMap.emplace(236,"BATTERY");
-    mKeyMap.emplace(237,"BLUETOOTH");
-    mKeyMap.emplace(238,"WLAN");
-    mKeyMap.emplace(239,"UWB");
-    mKeyMap.emplace(240,"UNKNOWN");
-    mKeyMap.emplace(241,"VIDEO_NEXT");
-    mKeyMap.emplace(242,"VIDEO_PREV");
-    mKeyMap.emplace(243,"BRIGHTNESS_CYCLE");
-    mKeyMap.emplace(244,"BRIGHTNESS_AUTO");
-    mKeyMap.emplace(245,"DISPLAY_OFF");
-    mKeyMap.emplace(246,"WWAN");
-    mKeyMap.emplace(247,"RFKILL");
-    mKeyMap.emplace(248,"MICMUTE");
-    mKeyMap.emplace(0x160,"OK");
-    mKeyMap.emplace(0x161,"SELECT");
-    mKeyMap.emplace(0x162,"GOTO");
-    mKeyMap.emplace(0x163,"CLEAR");
-    mKeyMap.emplace(0x164,"POWER2");
-    mKeyMap.emplace(0x165,"OPTION");
-    mKeyMap.emplace(0x166,"INFO");
-    mKeyMap.emplace(0x167,"TIME");
-    mKeyMap.emplace(0x168,"VENDOR");
-    mKeyMap.emplace(0x169,"ARCHIVE");
-    mKeyMap.emplace(0x16a,"PROGRAM");
-    mKeyMap.emplace(0x16b,"CHANNEL");
-    mKeyMap.emplace(0x16c,"FAVORITES");
-    mKeyMap.emplace(0x16d,"EPG");
-    mKeyMap.emplace(0x16e,"PVR");
-    mKeyMap.emplace(0x16f,"MHP");
-    mKeyMap.emplace(0x170,"LANGUAGE");
-    mKeyMap.emplace(0x171,"TITLE");
-    mKeyMap.emplace(0x172,"SUBTITLE");
-    mKeyMap.emplace(0x173,"ANGLE");
-    mKeyMap.emplace(0x174,"ZOOM");
-    mKeyMap.emplace(0x175,"MODE");
-    mKeyMap.emplace(0x176,"KEYBOARD");
-    mKeyMap.emplace(0x177,"SCREEN");
-    mKeyMap.emplace(0x178,"PC");
-    mKeyMap.emplace(0x179,"TV");
-    mKeyMap.emplace(0x17a,"TV2");
-    mKeyMap.emplace(0x17b,"VCR");
-    mKeyMap.emplace(0x17c,"VCR2");
-    mKeyMap.emplace(0x17d,"SAT");
-    mKeyMap.emplace(0x17e,"SAT2");
-    mKeyMap.emplace(0x17f,"CD");
-    mKeyMap.emplace(0x180,"TAPE");
-    mKeyMap.emplace(0x181,"RADIO");
-    mKeyMap.emplace(0x182,"TUNER");
-    mKeyMap.emplace(0x183,"PLAYER");
-    mKeyMap.emplace(0x184,"TEXT");
-    mKeyMap.emplace(0x185,"DVD");
-    mKeyMap.emplace(0x186,"AUX");
-    mKeyMap.emplace(0x187,"MP3");
-    mKeyMap.emplace(0x188,"AUDIO");
-    mKeyMap.emplace(0x189,"VIDEO");
-    mKeyMap.emplace(0x18a,"DIRECTORY");
-    mKeyMap.emplace(0x18b,"LIST");
-    mKeyMap.emplace(0x18c,"MEMO");
-    mKeyMap.emplace(0x18d,"CALENDAR");
-    mKeyMap.emplace(0x18e,"RED");
-    mKeyMap.emplace(0x18f,"GREEN");
-    mKeyMap.emplace(0x190,"YELLOW");
-    mKeyMap.emplace(0x191,"BLUE");
-    mKeyMap.emplace(0x192,"CHANNELUP");
-    mKeyMap.emplace(0x193,"CHANNELDOWN");
-    mKeyMap.emplace(0x194,"FIRST");
-    mKeyMap.emplace(0x195,"LAST");
-    mKeyMap.emplace(0x196,"AB");
-    mKeyMap.emplace(0x197,"NEXT");
-    mKeyMap.emplace(0x198,"RESTART");
-    mKeyMap.emplace(0x199,"SLOW");
-    mKeyMap.emplace(0x19a,"SHUFFLE");
-    mKeyMap.emplace(0x19b,"BREAK");
-    mKeyMap.emplace(0x19c,"PREVIOUS");
-    mKeyMap.emplace(0x19d,"DIGITS");
-    mKeyMap.emplace(0x19e,"TEEN");
-    mKeyMap.emplace(0x19f,"TWEN");
-    mKeyMap.emplace(0x1a0,"VIDEOPHONE");
-    mKeyMap.emplace(0x1a1,"GAMES");
-    mKeyMap.emplace(0x1a2,"ZOOMIN");
-    mKeyMap.emplace(0x1a3,"ZOOMOUT");
-    mKeyMap.emplace(0x1a4,"ZOOMRESET");
-    mKeyMap.emplace(0x1a5,"WORDPROCESSOR");
-    mKeyMap.emplace(0x1a6,"EDITOR");
-    mKeyMap.emplace(0x1a7,"SPREADSHEET");
-    mKeyMap.emplace(0x1a8,"GRAPHICSEDITOR");
-    mKeyMap.emplace(0x1a9,"PRESENTATION");
-    mKeyMap.emplace(0x1aa,"DATABASE");
-    mKeyMap.emplace(0x1ab,"NEWS");
-    mKeyMap.emplace(0x1ac,"VOICEMAIL");
-    mKeyMap.emplace(0x1ad,"ADDRESSBOOK");
-    mKeyMap.emplace(0x1ae,"MESSENGER");
-    mKeyMap.emplace(0x1af,"DISPLAYTOGGLE");
-    mKeyMap.emplace(0x1b0,"SPELLCHECK");
-    mKeyMap.emplace(0x1b1,"LOGOFF");
-    mKeyMap.emplace(0x1b2,"DOLLAR");
-    mKeyMap.emplace(0x1b3,"EURO");
-    mKeyMap.emplace(0x1b4,"FRAMEBACK");
-    mKeyMap.emplace(0x1b5,"FRAMEFORWARD");
-    mKeyMap.emplace(0x1b6,"CONTEXT_MENU");
-    mKeyMap.emplace(0x1b7,"MEDIA_REPEAT");
-    mKeyMap.emplace(0x1b8,"10CHANNELSUP");
-    mKeyMap.emplace(0x1b9,"10CHANNELSDOWN");
-    mKeyMap.emplace(0x1ba,"IMAGES");
-    mKeyMap.emplace(0x1c0,"DEL_EOL");
-    mKeyMap.emplace(0x1c1,"DEL_EOS");
-    mKeyMap.emplace(0x1c2,"INS_LINE");
-    mKeyMap.emplace(0x1c3,"DEL_LINE");
-    mKeyMap.emplace(0x1d0,"FN");
-    mKeyMap.emplace(0x1d1,"FN_ESC");
-    mKeyMap.emplace(0x1d2,"FN_F1");
-    mKeyMap.emplace(0x1d3,"FN_F2");
-    mKeyMap.emplace(0x1d4,"FN_F3");
-    mKeyMap.emplace(0x1d5,"FN_F4");
-    mKeyMap.emplace(0x1d6,"FN_F5");
-    mKeyMap.emplace(0x1d7,"FN_F6");
-    mKeyMap.emplace(0x1d8,"FN_F7");
-    mKeyMap.emplace(0x1d9,"FN_F8");
-    mKeyMap.emplace(0x1da,"FN_F9");
-    mKeyMap.emplace(0x1db,"FN_F10");
-    mKeyMap.emplace(0x1dc,"FN_F11");
-    mKeyMap.emplace(0x1dd,"FN_F12");
-    mKeyMap.emplace(0x1de,"FN_1");
-    mKeyMap.emplace(0x1df,"FN_2");
-    mKeyMap.emplace(0x1e0,"FN_D");
-    mKeyMap.emplace(0x1e1,"FN_E");
-    mKeyMap.emplace(0x1e2,"FN_F");
-    mKeyMap.emplace(0x1e3,"FN_S");
-    mKeyMap.emplace(0x1e4,"FN_B");
-    mKeyMap.emplace(0x1f1,"BRL_DOT1");
-    mKeyMap.emplace(0x1f2,"BRL_DOT2");
-    mKeyMap.emplace(0x1f3,"BRL_DOT3");
-    mKeyMap.emplace(0x1f4,"BRL_DOT4");
-    mKeyMap.emplace(0x1f5,"BRL_DOT5");
-    mKeyMap.emplace(0x1f6,"BRL_DOT6");
-    mKeyMap.emplace(0x1f7,"BRL_DOT7");
-    mKeyMap.emplace(0x1f8,"BRL_DOT8");
-    mKeyMap.emplace(0x1f9,"BRL_DOT9");
-    mKeyMap.emplace(0x1fa,"BRL_DOT10");
-    mKeyMap.emplace(0x200,"NUMERIC_0");
-    mKeyMap.emplace(0x201,"NUMERIC_1");
-    mKeyMap.emplace(0x202,"NUMERIC_2");
-    mKeyMap.emplace(0x203,"NUMERIC_3");
-    mKeyMap.emplace(0x204,"NUMERIC_4");
-    mKeyMap.emplace(0x205,"NUMERIC_5");
-    mKeyMap.emplace(0x206,"NUMERIC_6");
-    mKeyMap.emplace(0x207,"NUMERIC_7");
-    mKeyMap.emplace(0x208,"NUMERIC_8");
-    mKeyMap.emplace(0x209,"NUMERIC_9");
-    mKeyMap.emplace(0x20a,"NUMERIC_STAR");
-    mKeyMap.emplace(0x20b,"NUMERIC_POUND");
-    mKeyMap.emplace(0x20c,"NUMERIC_A");
-    mKeyMap.emplace(0x20d,"NUMERIC_B");
-    mKeyMap.emplace(0x20e,"NUMERIC_C");
-    mKeyMap.emplace(0x20f,"NUMERIC_D");
-    mKeyMap.emplace(0x210,"CAMERA_FOCUS");
-    mKeyMap.emplace(0x211,"WPS_BUTTON");
-    mKeyMap.emplace(0x212,"TOUCHPAD_TOGGLE");
-    mKeyMap.emplace(0x213,"TOUCHPAD_ON");
-    mKeyMap.emplace(0x214,"TOUCHPAD_OFF");
-    mKeyMap.emplace(0x215,"CAMERA_ZOOMIN");
-    mKeyMap.emplace(0x216,"CAMERA_ZOOMOUT");
-    mKeyMap.emplace(0x217,"CAMERA_UP");
-    mKeyMap.emplace(0x218,"CAMERA_DOWN");
-    mKeyMap.emplace(0x219,"CAMERA_LEFT");
-    mKeyMap.emplace(0x21a,"CAMERA_RIGHT");
-    mKeyMap.emplace(0x21b,"ATTENDANT_ON");
-    mKeyMap.emplace(0x21c,"ATTENDANT_OFF");
-    mKeyMap.emplace(0x21d,"ATTENDANT_TOGGLE");
-    mKeyMap.emplace(0x21e,"LIGHTS_TOGGLE");
-    mKeyMap.emplace(0x230,"ALS_TOGGLE");
-    mKeyMap.emplace(0x240,"BUTTONCONFIG");
-    mKeyMap.emplace(0x241,"TASKMANAGER");
-    mKeyMap.emplace(0x242,"JOURNAL");
-    mKeyMap.emplace(0x243,"CONTROLPANEL");
-    mKeyMap.emplace(0x244,"APPSELECT");
-    mKeyMap.emplace(0x245,"SCREENSAVER");
-    mKeyMap.emplace(0x246,"VOICECOMMAND");
-    mKeyMap.emplace(0x247,"ASSISTANT");
-    mKeyMap.emplace(0x250,"BRIGHTNESS_MIN");
-    mKeyMap.emplace(0x251,"BRIGHTNESS_MAX");
-    mKeyMap.emplace(0x260,"KBDINPUTASSIST_PREV");
-    mKeyMap.emplace(0x261,"KBDINPUTASSIST_NEXT");
-    mKeyMap.emplace(0x262,"KBDINPUTASSIST_PREVGROUP");
-    mKeyMap.emplace(0x263,"KBDINPUTASSIST_NEXTGROUP");
-    mKeyMap.emplace(0x264,"KBDINPUTASSIST_ACCEPT");
-    mKeyMap.emplace(0x265,"KBDINPUTASSIST_CANCEL");
-    mKeyMap.emplace(0x266,"RIGHT_UP");
-    mKeyMap.emplace(0x267,"RIGHT_DOWN");
-    mKeyMap.emplace(0x268,"LEFT_UP");
-    mKeyMap.emplace(0x269,"LEFT_DOWN");
-    mKeyMap.emplace(0x26a,"ROOT_MENU");
-    mKeyMap.emplace(0x26b,"MEDIA_TOP_MENU");
-    mKeyMap.emplace(0x26c,"NUMERIC_11");
-    mKeyMap.emplace(0x26d,"NUMERIC_12");
-    mKeyMap.emplace(0x26e,"AUDIO_DESC");
-    mKeyMap.emplace(0x26f,"3D_MODE");
-    mKeyMap.emplace(0x270,"NEXT_FAVORITE");
-    mKeyMap.emplace(0x271,"STOP_RECORD");
-    mKeyMap.emplace(0x272,"PAUSE_RECORD");
-    mKeyMap.emplace(0x273,"VOD");
-    mKeyMap.emplace(0x274,"UNMUTE");
-    mKeyMap.emplace(0x275,"FASTREVERSE");
-    mKeyMap.emplace(0x276,"SLOWREVERSE");
-    mKeyMap.emplace(0x277,"DATA");
-    mKeyMap.emplace(0x278,"ONSCREEN_KEYBOARD");
-    mKeyMap.emplace(113,"MIN_INTERESTING");
-    mKeyMap.emplace(0x2ff,"MAX");
-    mKeyMap.emplace(0x100,"MISC");
-    mKeyMap.emplace(0x100,"0");
-    mKeyMap.emplace(0x101,"1");
-    mKeyMap.emplace(0x102,"2");
-    mKeyMap.emplace(0x103,"3");
-    mKeyMap.emplace(0x104,"4");
-    mKeyMap.emplace(0x105,"5");
-    mKeyMap.emplace(0x106,"6");
-    mKeyMap.emplace(0x107,"7");
-    mKeyMap.emplace(0x108,"8");
-    mKeyMap.emplace(0x109,"9");
-    mKeyMap.emplace(0x110,"MOUSE");
-    mKeyMap.emplace(0x110,"LEFT");
-    mKeyMap.emplace(0x111,"RIGHT");
-    mKeyMap.emplace(0x112,"MIDDLE");
-    mKeyMap.emplace(0x113,"SIDE");
-    mKeyMap.emplace(0x114,"EXTRA");
-    mKeyMap.emplace(0x115,"FORWARD");
-    mKeyMap.emplace(0x116,"BACK");
-    mKeyMap.emplace(0x117,"TASK");
-    mKeyMap.emplace(0x120,"JOYSTICK");
-    mKeyMap.emplace(0x120,"TRIGGER");
-    mKeyMap.emplace(0x121,"THUMB");
-    mKeyMap.emplace(0x122,"THUMB2");
-    mKeyMap.emplace(0x123,"TOP");
-    mKeyMap.emplace(0x124,"TOP2");
-    mKeyMap.emplace(0x125,"PINKIE");
-    mKeyMap.emplace(0x126,"BASE");
-    mKeyMap.emplace(0x127,"BASE2");
-    mKeyMap.emplace(0x128,"BASE3");
-    mKeyMap.emplace(0x129,"BASE4");
-    mKeyMap.emplace(0x12a,"BASE5");
-    mKeyMap.emplace(0x12b,"BASE6");
-    mKeyMap.emplace(0x12f,"DEAD");
-    mKeyMap.emplace(0x130,"GAMEPAD");
-    mKeyMap.emplace(0x130,"SOUTH");
-    mKeyMap.emplace(0x131,"EAST");
-    mKeyMap.emplace(0x132,"C");
-    mKeyMap.emplace(0x133,"NORTH");
-    mKeyMap.emplace(0x134,"WEST");
-    mKeyMap.emplace(0x135,"Z");
-    mKeyMap.emplace(0x136,"TL");
-    mKeyMap.emplace(0x137,"TR");
-    mKeyMap.emplace(0x138,"TL2");
-    mKeyMap.emplace(0x139,"TR2");
-    mKeyMap.emplace(0x13a,"SELECT");
-    mKeyMap.emplace(0x13b,"START");
-    mKeyMap.emplace(0x13c,"MODE");
-    mKeyMap.emplace(0x13d,"THUMBL");
-    mKeyMap.emplace(0x13e,"THUMBR");
-    mKeyMap.emplace(0x140,"DIGI");
-    mKeyMap.emplace(0x140,"TOOL_PEN");
-    mKeyMap.emplace(0x141,"TOOL_RUBBER");
-    mKeyMap.emplace(0x142,"TOOL_BRUSH");
-    mKeyMap.emplace(0x143,"TOOL_PENCIL");
-    mKeyMap.emplace(0x144,"TOOL_AIRBRUSH");
-    mKeyMap.emplace(0x145,"TOOL_FINGER");
-    mKeyMap.emplace(0x146,"TOOL_MOUSE");
-    mKeyMap.emplace(0x147,"TOOL_LENS");
-    mKeyMap.emplace(0x148,"TOOL_QUINTTAP");
-    mKeyMap.emplace(0x149,"STYLUS3");
-    mKeyMap.emplace(0x14a,"TOUCH");
-    mKeyMap.emplace(0x14b,"STYLUS");
-    mKeyMap.emplace(0x14c,"STYLUS2");
-    mKeyMap.emplace(0x14d,"TOOL_DOUBLETAP");
-    mKeyMap.emplace(0x14e,"TOOL_TRIPLETAP");
-    mKeyMap.emplace(0x14f,"TOOL_QUADTAP");
-    mKeyMap.emplace(0x150,"WHEEL");
-    mKeyMap.emplace(0x150,"GEAR_DOWN");
-    mKeyMap.emplace(0x151,"GEAR_UP");
-    mKeyMap.emplace(0x220,"DPAD_UP");
-    mKeyMap.emplace(0x221,"DPAD_DOWN");
-    mKeyMap.emplace(0x222,"DPAD_LEFT");
-    mKeyMap.emplace(0x223,"DPAD_RIGHT");
-    mKeyMap.emplace(0x2c0,"TRIGGER_HAPPY");
-    mKeyMap.emplace(0x2c0,"TRIGGER_HAPPY1");
-    mKeyMap.emplace(0x2c1,"TRIGGER_HAPPY2");
-    mKeyMap.emplace(0x2c2,"TRIGGER_HAPPY3");
-    mKeyMap.emplace(0x2c3,"TRIGGER_HAPPY4");
-    mKeyMap.emplace(0x2c4,"TRIGGER_HAPPY5");
-    mKeyMap.emplace(0x2c5,"TRIGGER_HAPPY6");
-    mKeyMap.emplace(0x2c6,"TRIGGER_HAPPY7");
-    mKeyMap.emplace(0x2c7,"TRIGGER_HAPPY8");
-    mKeyMap.emplace(0x2c8,"TRIGGER_HAPPY9");
-    mKeyMap.emplace(0x2c9,"TRIGGER_HAPPY10");
-    mKeyMap.emplace(0x2ca,"TRIGGER_HAPPY11");
-    mKeyMap.emplace(0x2cb,"TRIGGER_HAPPY12");
-    mKeyMap.emplace(0x2cc,"TRIGGER_HAPPY13");
-    mKeyMap.emplace(0x2cd,"TRIGGER_HAPPY14");
-    mKeyMap.emplace(0x2ce,"TRIGGER_HAPPY15");
-    mKeyMap.emplace(0x2cf,"TRIGGER_HAPPY16");
-    mKeyMap.emplace(0x2d0,"TRIGGER_HAPPY17");
-    mKeyMap.emplace(0x2d1,"TRIGGER_HAPPY18");
-    mKeyMap.emplace(0x2d2,"TRIGGER_HAPPY19");
-    mKeyMap.emplace(0x2d3,"TRIGGER_HAPPY20");
-    mKeyMap.emplace(0x2d4,"TRIGGER_HAPPY21");
-    mKeyMap.emplace(0x2d5,"TRIGGER_HAPPY22");
-    mKeyMap.emplace(0x2d6,"TRIGGER_HAPPY23");
-    mKeyMap.emplace(0x2d7,"TRIGGER_HAPPY24");
-    mKeyMap.emplace(0x2d8,"TRIGGER_HAPPY25");
-    mKeyMap.emplace(0x2d9,"TRIGGER_HAPPY26");
-    mKeyMap.emplace(0x2da,"TRIGGER_HAPPY27");
-    mKeyMap.emplace(0x2db,"TRIGGER_HAPPY28");
-    mKeyMap.emplace(0x2dc,"TRIGGER_HAPPY29");
-    mKeyMap.emplace(0x2dd,"TRIGGER_HAPPY30");
-    mKeyMap.emplace(0x2de,"TRIGGER_HAPPY31");
-    mKeyMap.emplace(0x2df,"TRIGGER_HAPPY32");
-    mKeyMap.emplace(0x2e0,"TRIGGER_HAPPY33");
-    mKeyMap.emplace(0x2e1,"TRIGGER_HAPPY34");
-    mKeyMap.emplace(0x2e2,"TRIGGER_HAPPY35");
-    mKeyMap.emplace(0x2e3,"TRIGGER_HAPPY36");
-    mKeyMap.emplace(0x2e4,"TRIGGER_HAPPY37");
-    mKeyMap.emplace(0x2e5,"TRIGGER_HAPPY38");
-    mKeyMap.emplace(0x2e6,"TRIGGER_HAPPY39");
-    mKeyMap.emplace(0x2e7,"TRIGGER_HAPPY40");
+    return kKeyTable[keycode];
 }
@@ -16,8 +16,7 @@
 #ifndef CAR_KEVENTREADER_KEYMAP
 #define CAR_KEVENTREADER_KEYMAP
 
-#include <string>
-#include <map>
+#include <string_view>
 
 namespace com::android::car::keventreader {
     // this class provides output that is based on the Linux keycodes table
@@ -25,12 +24,11 @@ namespace com::android::car::keventreader {
     public:
         static Keymap& get();
 
-        std::string_view getDisplayName(int keycode);
+        // names that aren't in the table come back as "unknown"
+        std::string_view getDisplayName(int keycode) const;
 
     private:
-        std::map<int, const char*> mKeyMap;
-        void fillMap();
-        Keymap();
+        Keymap() = default;
     };
 }
 
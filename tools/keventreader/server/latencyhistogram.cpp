@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#include "latencyhistogram.h"
+
+#include <inttypes.h>
+#include <stdio.h>
+
+using namespace com::android::car::keventreader;
+
+LatencyHistogram::LatencyHistogram(const char* name) : mName(name) {}
+
+int64_t LatencyHistogram::upperBoundNs(size_t bucket) {
+    return kFirstBucketNs << bucket;
+}
+
+void LatencyHistogram::add(int64_t latencyNs) {
+    // a clock that went backwards is not a negative latency
+    if (latencyNs < 0) latencyNs = 0;
+
+    size_t bucket = 0;
+    while (bucket < kBuckets - 1 && latencyNs >= upperBoundNs(bucket)) {
+        ++bucket;
+    }
+    mCounts[bucket].fetch_add(1, std::memory_order_relaxed);
+    mTotalNs.fetch_add(latencyNs, std::memory_order_relaxed);
+
+    int64_t max = mMaxNs.load(std::memory_order_relaxed);
+    while (latencyNs > max &&
+           !mMaxNs.compare_exchange_weak(max, latencyNs, std::memory_order_relaxed)) {}
+}
+
+int64_t LatencyHistogram::percentileNs(uint64_t total, double fraction) const {
+    const uint64_t rank = static_cast<uint64_t>(total * fraction);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < kBuckets; ++i) {
+        seen += mCounts[i].load(std::memory_order_relaxed);
+        if (seen > rank) {
+            return (i == kBuckets - 1) ? mMaxNs.load(std::memory_order_relaxed) : upperBoundNs(i);
+        }
+    }
+    return mMaxNs.load(std::memory_order_relaxed);
+}
+
+void LatencyHistogram::dump(std::string* out) const {
+    char line[256];
+    uint64_t total = 0;
+    for (const auto& count : mCounts) {
+        total += count.load(std::memory_order_relaxed);
+    }
+
+    snprintf(line, sizeof(line), "%s: %" PRIu64 " events", mName, total);
+    out->append(line);
+    if (total == 0) {
+        out->append("\n");
+        return;
+    }
+    snprintf(line, sizeof(line),
+             ", mean %" PRId64 "us, p50 <%" PRId64 "us, p90 <%" PRId64 "us, p99 <%" PRId64
+             "us, max %" PRId64 "us\n",
+             mTotalNs.load(std::memory_order_relaxed) / static_cast<int64_t>(total) / 1000,
+             percentileNs(total, 0.50) / 1000, percentileNs(total, 0.90) / 1000,
+             percentileNs(total, 0.99) / 1000, mMaxNs.load(std::memory_order_relaxed) / 1000);
+    out->append(line);
+
+    for (size_t i = 0; i < kBuckets; ++i) {
+        uint64_t count = mCounts[i].load(std::memory_order_relaxed);
+        if (count == 0) continue;
+        if (i == kBuckets - 1) {
+            snprintf(line, sizeof(line), "  >=%8" PRId64 "us: %" PRIu64 "\n",
+                     upperBoundNs(i - 1) / 1000, count);
+        } else {
+            snprintf(line, sizeof(line), "  < %8" PRId64 "us: %" PRIu64 "\n",
+                     upperBoundNs(i) / 1000, count);
+        }
+        out->append(line);
+    }
+}
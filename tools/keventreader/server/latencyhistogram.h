@@ -0,0 +1,49 @@
+/*
+ * Copyright (C) 2018 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+#ifndef CAR_KEVENTREADER_LATENCYHISTOGRAM
+#define CAR_KEVENTREADER_LATENCYHISTOGRAM
+
+#include <array>
+#include <atomic>
+#include <stdint.h>
+#include <string>
+
+namespace com::android::car::keventreader {
+    // Counts latencies into buckets that double in width, from under 125us to over 4s.  Adding
+    // a sample is lock-free, so it can be done on the event path from any thread.
+    class LatencyHistogram {
+    public:
+        explicit LatencyHistogram(const char* name);
+
+        void add(int64_t latencyNs);
+
+        // appends a human readable summary, with percentiles estimated from the buckets
+        void dump(std::string* out) const;
+    private:
+        static constexpr int64_t kFirstBucketNs = 125000;
+        static constexpr size_t kBuckets = 17;
+
+        static int64_t upperBoundNs(size_t bucket);
+        int64_t percentileNs(uint64_t total, double fraction) const;
+
+        const char* mName;
+        std::array<std::atomic<uint64_t>, kBuckets> mCounts = {};
+        std::atomic<int64_t> mTotalNs = 0;
+        std::atomic<int64_t> mMaxNs = 0;
+    };
+}
+
+#endif //CAR_KEVENTREADER_LATENCYHISTOGRAM
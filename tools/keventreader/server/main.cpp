@@ -33,10 +33,14 @@ using namespace com::android::car::keventreader;
  * This tool expects to be able to read input events in the Linux kernel input_event format
  * (see linux/input.h); that format is available by means of /dev/input/event* files (which are
  * mapped 1-to-1 to input sources that provide keypresses as input (e.g. keyboards)
- * The tool will hook up to each such file passed as input
+ * The tool will hook up to each such file passed as input, and has the kernel only wake it up
+ * for keypresses (or just the ones asked for) where the kernel supports that
  */
 static const char* SYNTAX_INSTRUCTIONS =
-    "invalid command line arguments - provide one or more /dev/input/event files";
+    "invalid command line arguments - provide one or more /dev/input/event files, "
+    "or /dev/input to use every input source including ones plugged in later; each can be "
+    "followed by :grab to keep its events from everyone else, and by :keys=<code>,<code>... "
+    "to only report those key codes";
 
 static void error(int code) {
     ALOGE("%s", SYNTAX_INSTRUCTIONS);
@@ -70,5 +74,7 @@ int main(int argc, const char** argv) {
     IPCThreadState::self()->joinThreadPool();
 
     ALOGW(LOG_TAG " joined and going down");
+    service->stopLoop();
+    svcthread.join();
     exit(0);
 }